@@ -23,5 +23,7 @@
 #define ZBX_ICMP 21
 
 //#define HAVE_GLB_TESTS 1
+/* the benchmarks take long, they are only run with the tests when explicitly enabled */
+//#define HAVE_GLB_BENCHMARKS 1
 
 #endif
\ No newline at end of file
@@ -25,6 +25,7 @@
 #include "zbxcommon.h"
 #include "zbxtime.h"
 #include "zbxjson.h"
+#include "zbxalgo.h"
 /* value_avg_t structure is used for item average value trend calculations. */
 /*                                                                          */
 /* For double values the average value is calculated on the fly with the    */
@@ -115,6 +116,7 @@ typedef struct
 
 
 int glb_history_init(char **history_modules, char **error);
+void glb_history_destroy(void);
 
 int glb_history_add_history(ZBX_DC_HISTORY *history, int history_num);
 int glb_history_get_history(zbx_uint64_t itemid, int value_type, int start, int count, int end, unsigned char interactive, zbx_vector_history_record_t *values);
@@ -122,6 +124,24 @@ int glb_history_add_trend(trend_t *trend);
 
 int glb_history_get_trends_json(zbx_uint64_t itemid, int value_type, int start, int end, struct zbx_json *json);
  
+/* one aggregation interval of an item, rows of an item are passed ordered by i */
+typedef struct {
+	u_int64_t	itemid;
+	const char	*clock;
+	const char	*i;
+	const char	*count;
+	const char	*min;
+	const char	*max;
+	const char	*avg;
+} glb_history_agg_row_t;
+
+typedef void (*glb_history_agg_row_cb_t)(const glb_history_agg_row_t *row, void *cb_data);
+
+int glb_history_get_history_aggregates_multi(zbx_vector_uint64_t *itemids, int value_type, int start, int end, int aggregates,
+		glb_history_agg_row_cb_t row_cb, void *cb_data);
+int glb_history_get_trends_aggregates_multi(zbx_vector_uint64_t *itemids, int value_type, int start, int end, int aggregates,
+		glb_history_agg_row_cb_t row_cb, void *cb_data);
+
 int glb_history_get_trends_aggregates_json(zbx_uint64_t itemid, int value_type, int start, int end, int aggregates, struct zbx_json *json);
 int glb_history_get_history_aggregates_json(zbx_uint64_t itemid, int value_type, int start, int end, int aggregates, struct zbx_json *json);
 
@@ -40,6 +40,10 @@ int processing_force_flush();
 typedef void (*ipc2_data_process_cb_t)(mem_funcs_t *memf, int i, void *ipc_data, void *cb_data);
 
 int preproc_receive_metrics(int process_num, metric_preprocess_func_t proc_func, void *cb_data, int max_count);
+int preproc_get_wakeup_fd(int process_num);
+void preproc_ack_wakeup(int process_num);
+u_int64_t *preproc_get_barrier(int process_num);
+int preproc_is_barrier_passed(int process_num, const u_int64_t *barrier);
 int process_receive_metrics(int process_num, metric_process_func_t proc_func, void *cb_data, int max_count);
 
 #define IPC_CREATE_CB(name) \
@@ -244,6 +244,8 @@ typedef enum {
 	GLB_MODULE_API_HISTORY_READ_AGG_JSON, //read aggregated history
 	GLB_MODULE_API_HISTORY_READ_TRENDS_AGG_JSON, //read aggregated trends
 	GLB_MODULE_API_HISTORY_READ_TRENDS_JSON,  //history read aggreagated to n points, rets max min avf, usefull for stats and graph processing 
+	GLB_MODULE_API_HISTORY_READ_AGG_MULTI, //read aggregated history of several items in one request
+	GLB_MODULE_API_HISTORY_READ_TRENDS_AGG_MULTI, //read aggregated trends of several items in one request
 	GLB_MODULE_API_DESTROY, //all modules who needs deinit should register in this callback
 	 //total number of callbacks == last callback id +1 , theese two should always go last
 	GLB_MODULE_API_TOTAL_CALLBACKS,
@@ -261,6 +263,8 @@ static struct API_HOOKS APIcfg[]=
 	{"History_Read_Aggregated_JSON",	GLB_MODULE_API_HISTORY_READ_AGG_JSON },		
 	{"History_Read_Trends_JSON",		GLB_MODULE_API_HISTORY_READ_TRENDS_JSON },	
 	{"History_Read_Aggregated_Trends_JSON",		GLB_MODULE_API_HISTORY_READ_TRENDS_AGG_JSON },		
+	{"History_Read_Aggregated_Multi",	GLB_MODULE_API_HISTORY_READ_AGG_MULTI },
+	{"History_Read_Aggregated_Trends_Multi",	GLB_MODULE_API_HISTORY_READ_TRENDS_AGG_MULTI },
 	{"ModuleDestroy" , GLB_MODULE_API_DESTROY },
 	{NULL}
 };
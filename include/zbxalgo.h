@@ -788,6 +788,34 @@ void	glb_tsbuff_dump(glb_tsbuff_t *tsbuff);
 int    glb_tsbuff_check_has_enough_count_data_time(glb_tsbuff_t *tsbuff, int need_count, int time);
 int    glb_tsbuff_check_has_enough_count_data_idx(glb_tsbuff_t *tsbuff, int need_count, int head_idx);
 
+/* sealed compressed block of numeric time-series values, see ts_block.c */
+#define GLB_TSBLOCK_MAX_VALUES	128
+
+typedef struct {
+	int		first_time;
+	int		last_time;
+	unsigned short	count;
+	unsigned short	size;
+	unsigned char	data[];
+} glb_tsblock_t;
+
+typedef struct {
+	const glb_tsblock_t	*block;
+	size_t			pos;
+	int			idx;
+	int			time;
+	int			delta;
+	u_int64_t		value;
+	int			leading;
+	int			trailing;
+} glb_tsblock_reader_t;
+
+glb_tsblock_t	*glb_tsblock_create(const glb_tsbuff_value_t *values, int count, zbx_mem_malloc_func_t malloc_func);
+void	glb_tsblock_destroy(glb_tsblock_t *block, zbx_mem_free_func_t free_func);
+size_t	glb_tsblock_get_size(const glb_tsblock_t *block);
+void	glb_tsblock_reader_init(glb_tsblock_reader_t *reader, const glb_tsblock_t *block);
+int	glb_tsblock_reader_next(glb_tsblock_reader_t *reader, glb_tsbuff_value_t *value);
+
 
 
 #define ELEMS_CALLBACK(name) \
@@ -821,11 +849,19 @@ typedef int	(*elems_hash_free_cb_t)(elems_hash_elem_t *elem, mem_funcs_t *memf);
 typedef int	(*elems_hash_process_cb_t)(elems_hash_elem_t *elem, mem_funcs_t *memf, void *params);
 typedef int	(*elems_hash_update_cb_t)(elems_hash_elem_t *elem, elems_hash_elem_t *elem_new, mem_funcs_t *memf);
 
+/* elements are spread by id among the shards, each shard has its own lock,
+   so the processes working on different elements seldom wait for each other */
+#define ELEMS_HASH_SHARDS	16
+
+typedef struct {
+    zbx_hashset_t elems;
+    pthread_rwlock_t meta_lock; 
+} elems_hash_shard_t;
+
 //todo: hide elems_hash_t structure
 typedef struct  {
-    zbx_hashset_t elems;
+    elems_hash_shard_t shards[ELEMS_HASH_SHARDS];
 	mem_funcs_t memf;
-    pthread_rwlock_t meta_lock; 
 	elems_hash_create_cb_t elem_create_func;
 	elems_hash_free_cb_t elem_free_func;
 } elems_hash_t;
@@ -833,6 +869,8 @@ typedef struct  {
 elems_hash_t *elems_hash_init(mem_funcs_t *memf, elems_hash_create_cb_t create_func, elems_hash_free_cb_t elem_free_func );
 
 int		elems_hash_process(elems_hash_t *elems, uint64_t id, elems_hash_process_cb_t process_func, void *data, u_int64_t flags);
+int		elems_hash_process_batch(elems_hash_t *elems, const uint64_t *ids, void **data, int num,
+		elems_hash_process_cb_t process_func, u_int64_t flags);
 int		elems_hash_delete(elems_hash_t *elems,  uint64_t id);
 int 	elems_hash_mass_delete(elems_hash_t *elems, zbx_vector_uint64_t *ids);
 void	elems_hash_destroy(elems_hash_t *elems);
@@ -719,7 +719,10 @@ void	zbx_connector_filter_free(zbx_connector_filter_t connector_filter);
 
 int	DCconfig_get_active_items_count_by_hostid(zbx_uint64_t hostid);
 void	DCconfig_get_active_items_by_hostid(DC_ITEM *items, zbx_uint64_t hostid, int *errcodes, size_t num);
-void	DCconfig_get_preprocessable_items(zbx_hashset_t *items, zbx_uint64_t *revision, int manager_num);
+typedef int (*zbx_dc_item_filter_func_t)(zbx_uint64_t itemid, int dep_items_num, void *data);
+
+void	DCconfig_get_preprocessable_items(zbx_hashset_t *items, zbx_uint64_t *revision,
+		zbx_dc_item_filter_func_t filter_func, void *filter_data);
 void	DCconfig_get_functions_by_functionids(DC_FUNCTION *functions,
 		zbx_uint64_t *functionids, int *errcodes, size_t num);
 void	DCconfig_clean_functions(DC_FUNCTION *functions, int *errcodes, size_t num);
@@ -1152,6 +1155,7 @@ int	zbx_dc_httptest_next(time_t now, zbx_uint64_t *httptestid, time_t *nextcheck
 void	zbx_dc_httptest_queue(time_t now, zbx_uint64_t httptestid, int delay);
 
 zbx_uint64_t	zbx_dc_get_received_revision(void);
+zbx_uint64_t	zbx_dc_get_config_revision(void);
 void	zbx_dc_update_received_revision(zbx_uint64_t revision);
 
 void	zbx_dc_get_proxy_config_updates(zbx_uint64_t proxy_hostid, zbx_uint64_t revision, zbx_vector_uint64_t *hostids,
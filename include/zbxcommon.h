@@ -343,7 +343,9 @@ const char	*get_program_type_string(unsigned char program_type);
 #define GLB_PROCESS_TYPE_API_TRAPPER	44
 #define GLB_PROCESS_TYPE_PREPROCESSOR	45
 #define GLB_PROCESS_TYPE_SNMP_WORKER	46
-#define ZBX_PROCESS_TYPE_COUNT		47	/* number of process types */
+#define GLB_PROCESS_TYPE_HISTORY_WRITER	47
+#define GLB_PROCESS_TYPE_HTTP	48
+#define ZBX_PROCESS_TYPE_COUNT		49	/* number of process types */
 
 
 /* special processes that are not present worker list */
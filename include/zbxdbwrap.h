@@ -30,6 +30,9 @@
 #define ZBX_PROXY_UPLOAD_DISABLED	1
 #define ZBX_PROXY_UPLOAD_ENABLED	2
 
+#define ZBX_PROXY_HISTORY_FORMAT_JSON	0
+#define ZBX_PROXY_HISTORY_FORMAT_BINARY	1
+
 typedef enum
 {
 	ZBX_TEMPLATE_LINK_MANUAL = 0,
@@ -46,7 +49,8 @@ int	zbx_check_access_passive_proxy(zbx_socket_t *sock, int send_response, const
 int	zbx_get_active_proxy_from_request(const struct zbx_json_parse *jp, DC_PROXY *proxy, char **error);
 int	zbx_proxy_check_permissions(const DC_PROXY *proxy, const zbx_socket_t *sock, char **error);
 
-int	zbx_proxy_get_hist_data(struct zbx_json *j, zbx_uint64_t *lastid, int *more);
+int	zbx_proxy_get_hist_data(struct zbx_json *j, unsigned char format, zbx_uint64_t *lastid, int *more);
+unsigned char	zbx_get_proxy_history_format(const char *buffer);
 int	zbx_proxy_get_dhis_data(struct zbx_json *j, zbx_uint64_t *lastid, int *more);
 int	zbx_proxy_get_areg_data(struct zbx_json *j, zbx_uint64_t *lastid, int *more);
 void	zbx_proxy_set_hist_lastid(const zbx_uint64_t lastid);
@@ -66,6 +66,29 @@ int	zbx_http_request(unsigned char request_method, const char *url, const char *
 		const char *ssl_key_password, unsigned char verify_peer, unsigned char verify_host,
 		unsigned char authtype, const char *username, const char *password, const char *token,
 		unsigned char post_type, char *status_codes, unsigned char output_format, char **out, char **error);
+
+/* the request might be prepared once and performed many times by the same easy handle, synchronously */
+/* or via a multi handle, the context must not be moved as the curl callbacks refer to its buffers     */
+typedef struct
+{
+	CURL			*easyhandle;
+	struct curl_slist	*headers_slist;
+	zbx_http_response_t	header;
+	zbx_http_response_t	body;
+	char			errbuf[CURL_ERROR_SIZE];
+}
+zbx_http_context_t;
+
+void	zbx_http_context_init(zbx_http_context_t *context);
+void	zbx_http_context_destroy(zbx_http_context_t *context);
+int	zbx_http_request_prepare(zbx_http_context_t *context, unsigned char request_method, const char *url,
+		const char *query_fields, char *headers, const char *posts, unsigned char retrieve_mode,
+		const char *http_proxy, unsigned char follow_redirects, const char *timeout,
+		const char *ssl_cert_file, const char *ssl_key_file, const char *ssl_key_password,
+		unsigned char verify_peer, unsigned char verify_host, unsigned char authtype, const char *username,
+		const char *password, const char *token, unsigned char post_type, char **error);
+int	zbx_http_handle_response(zbx_http_context_t *context, CURLcode err, unsigned char retrieve_mode,
+		char *status_codes, unsigned char output_format, char **out, char **error);
 #endif
 
 #endif
@@ -66,6 +66,8 @@
 #define ZBX_PROTO_TAG_VERSION			"version"
 #define ZBX_PROTO_TAG_INTERFACE_AVAILABILITY	"interface availability"
 #define ZBX_PROTO_TAG_HISTORY_DATA		"history data"
+#define ZBX_PROTO_TAG_HISTORY_DATA_BINARY	"history data binary"
+#define ZBX_PROTO_TAG_HISTORY_FORMAT		"history format"
 #define ZBX_PROTO_TAG_DISCOVERY_DATA		"discovery data"
 #define ZBX_PROTO_TAG_AUTOREGISTRATION		"auto registration"
 #define ZBX_PROTO_TAG_MORE			"more"
@@ -254,6 +256,7 @@
 
 #define ZBX_PROTO_VALUE_PROXY_UPLOAD_ENABLED	"enabled"
 #define ZBX_PROTO_VALUE_PROXY_UPLOAD_DISABLED	"disabled"
+#define ZBX_PROTO_VALUE_HISTORY_FORMAT_BINARY	"binary"
 
 #define ZBX_PROTO_VALUE_REPORT_TEST		"report.test"
 
@@ -408,8 +411,17 @@ void	zbx_jsonpath_clear(zbx_jsonpath_t *jsonpath);
 int	zbx_jsonobj_open(const char *data, zbx_jsonobj_t *obj);
 void	zbx_jsonobj_clear(zbx_jsonobj_t *obj);
 int	zbx_jsonobj_query(zbx_jsonobj_t *obj, const char *path, char **output);
+int	zbx_jsonobj_query_compiled(zbx_jsonobj_t *obj, const zbx_jsonpath_t *jsonpath, char **output);
 int	zbx_jsonobj_to_string(char **str, size_t *str_alloc, size_t *str_offset, zbx_jsonobj_t *obj);
 
 void	zbx_jsonobj_disable_indexing(zbx_jsonobj_t *obj);
 
+typedef struct zbx_jsonpath_set	zbx_jsonpath_set_t;
+
+zbx_jsonpath_set_t	*zbx_jsonpath_set_create(void);
+void	zbx_jsonpath_set_free(zbx_jsonpath_set_t *set);
+int	zbx_jsonpath_set_add(zbx_jsonpath_set_t *set, const char *path);
+int	zbx_jsonpath_set_slots_num(const zbx_jsonpath_set_t *set);
+void	zbx_jsonobj_query_set(zbx_jsonobj_t *obj, const zbx_jsonpath_set_t *set, char **outputs);
+
 #endif /* ZABBIX_ZJSON_H */
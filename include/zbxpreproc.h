@@ -72,6 +72,8 @@ void	zbx_pp_step_free(zbx_pp_step_t *step);
 
 ZBX_PTR_VECTOR_DECL(pp_step_ptr, zbx_pp_step_t *)
 
+typedef struct zbx_pp_step_cache	zbx_pp_step_cache_t;
+
 typedef struct
 {
 	zbx_uint32_t		refcount;
@@ -89,6 +91,11 @@ typedef struct
 
 	zbx_pp_history_t	*history;	/* the preprocessing history */
 	int			history_num;	/* the number of preprocessing steps requiring history */
+
+	zbx_pp_step_cache_t	*steps_cache;	/* compiled step parameters, NULL if not cached */
+
+	/* the first step jsonpaths of the dependent items, NULL till the dependent items are processed */
+	struct zbx_jsonpath_set	*dep_jsonpaths;
 }
 zbx_pp_item_preproc_t;
 
@@ -163,6 +170,8 @@ void	zbx_pp_tasks_clear(zbx_vector_pp_task_ptr_t *tasks);
 
 zbx_pp_item_preproc_t	*zbx_pp_item_preproc_create(unsigned char type, unsigned char value_type, unsigned char flags);
 void	zbx_pp_item_preproc_release(zbx_pp_item_preproc_t *preproc);
+void	zbx_pp_item_preproc_cache_steps(zbx_pp_item_preproc_t *preproc);
+void	zbx_pp_item_preproc_clear_dep_jsonpaths(zbx_pp_item_preproc_t *preproc);
 int	zbx_pp_preproc_has_history(int type);
 
 typedef struct zbx_pp_manager zbx_pp_manager_t;
@@ -66,6 +66,15 @@ int	zbx_prometheus_pattern_ex(zbx_prometheus_t *prom, const char *filter_data, c
 
 int	zbx_prometheus_pattern(const char *data, const char *filter_data, const char *request, const char *output,
 		char **value, char **error);
+
+typedef struct zbx_prometheus_filter	zbx_prometheus_filter_t;
+
+zbx_prometheus_filter_t	*zbx_prometheus_filter_create(const char *filter_data, char **error);
+void	zbx_prometheus_filter_free(zbx_prometheus_filter_t *filter);
+int	zbx_prometheus_pattern_compiled(const char *data, zbx_prometheus_filter_t *filter, const char *request,
+		const char *output, char **value, char **error);
+int	zbx_prometheus_pattern_ex_compiled(zbx_prometheus_t *prom, zbx_prometheus_filter_t *filter,
+		const char *request, const char *output, char **value, char **error);
 int	zbx_prometheus_to_json(const char *data, const char *filter_data, char **value, char **error);
 
 int	zbx_prometheus_validate_filter(const char *pattern, char **error);
@@ -0,0 +1,61 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef ZABBIX_PROXY_JOURNAL_H
+#define ZABBIX_PROXY_JOURNAL_H
+
+#include "zbxcommon.h"
+
+/* proxy history record, the fields are the same as of the proxy_history table; */
+/* the strings of the records being read point to the mapped journal segment     */
+typedef struct
+{
+	zbx_uint64_t	id;
+	zbx_uint64_t	itemid;
+	zbx_uint64_t	lastlogsize;
+	const char	*source;
+	const char	*value;
+	int		clock;
+	int		ns;
+	int		timestamp;
+	int		severity;
+	int		logeventid;
+	int		mtime;
+	unsigned char	state;
+	unsigned char	flags;
+}
+zbx_proxy_journal_record_t;
+
+/* returns SUCCEED to continue reading, FAIL to stop before the record */
+typedef int	(*zbx_proxy_journal_read_cb_t)(const zbx_proxy_journal_record_t *record, void *cb_data);
+
+int	zbx_proxy_journal_init(const char *dir, zbx_uint64_t max_size, int max_age, char **error);
+int	zbx_proxy_journal_enabled(void);
+
+void	zbx_proxy_journal_add(const zbx_proxy_journal_record_t *record);
+int	zbx_proxy_journal_commit(void);
+int	zbx_proxy_journal_flush(void);
+
+int	zbx_proxy_journal_read(zbx_uint64_t lastid, int max_records, zbx_proxy_journal_read_cb_t cb, void *cb_data);
+zbx_uint64_t	zbx_proxy_journal_get_lastid(void);
+void	zbx_proxy_journal_set_lastid(zbx_uint64_t lastid);
+int	zbx_proxy_journal_get_delay(zbx_uint64_t lastid);
+int	zbx_proxy_journal_get_count(void);
+int	zbx_proxy_journal_housekeep(int now);
+
+#endif
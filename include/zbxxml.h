@@ -34,6 +34,9 @@ char	*zbx_xml_escape_dyn(const char *data);
 void	zbx_xml_escape_xpath(char **data);
 
 int	zbx_query_xpath(zbx_variant_t *value, const char *params, char **errmsg);
+int	zbx_query_xpath_compiled(zbx_variant_t *value, void *xpath, char **errmsg);
+void	*zbx_xpath_compile(const char *expression);
+void	zbx_xpath_free(void *xpath);
 
 #ifdef HAVE_LIBXML2
 int	zbx_open_xml(char *data, int options, int maxerrlen, void **xml_doc, void **root_node, char **errmsg);
@@ -326,6 +326,73 @@ int	glb_history_get_trends_aggregates_json(zbx_uint64_t itemid, int value_type,
 }
 
 
+static int	history_get_aggregates_multi(int cb_type, zbx_vector_uint64_t *itemids, int value_type, int start, int end,
+		int aggregates, glb_history_agg_row_cb_t row_cb, void *cb_data)
+{
+	int	j;
+
+	for (j = 0; j < API_CALLBACKS[cb_type]->values_num; j++) {
+
+		glb_api_callback_t *callback = API_CALLBACKS[cb_type]->values[j];
+		glb_history_get_agg_multi_func_t get_values = callback->callback;
+
+		if (SUCCEED == get_values(callback->callbackData, value_type, itemids, start, end, aggregates, row_cb, cb_data))
+			return SUCCEED;
+	}
+
+	return FAIL;
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Function: glb_history_get_history_aggregates_multi                               *
+ *                                                                                  *
+ * Purpose: gets aggregated history of several items of the same value type        *
+ *          with one storage request                                                *
+ *                                                                                  *
+ * Parameters:  itemids    - [IN] the items, all must have value_type               *
+ *              value_type - [IN] the items value type                              *
+ *              start      - [IN] the period start timestamp                        *
+ *              end        - [IN] the period end timestamp                          *
+ *              aggregates - [IN] the number of intervals to aggregate to           *
+ *              row_cb     - [IN] called for each interval of each item, rows       *
+ *                                come grouped by item                              *
+ *                                                                                  *
+ * Return value: SUCCEED - the history data were read successfully                  *
+ *               FAIL - otherwise                                                   *
+ *                                                                                  *
+ ************************************************************************************/
+int	glb_history_get_history_aggregates_multi(zbx_vector_uint64_t *itemids, int value_type, int start, int end,
+		int aggregates, glb_history_agg_row_cb_t row_cb, void *cb_data)
+{
+	if (0 == itemids->values_num)
+		return SUCCEED;
+
+	return history_get_aggregates_multi(GLB_MODULE_API_HISTORY_READ_AGG_MULTI, itemids, value_type, start, end,
+			aggregates, row_cb, cb_data);
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Function: glb_history_get_trends_aggregates_multi                                *
+ *                                                                                  *
+ * Purpose: same as glb_history_get_history_aggregates_multi, but reads trends      *
+ *                                                                                  *
+ ************************************************************************************/
+int	glb_history_get_trends_aggregates_multi(zbx_vector_uint64_t *itemids, int value_type, int start, int end,
+		int aggregates, glb_history_agg_row_cb_t row_cb, void *cb_data)
+{
+	if (ITEM_VALUE_TYPE_FLOAT != value_type && 
+		ITEM_VALUE_TYPE_UINT64 != value_type)
+		return FAIL;
+
+	if (0 == itemids->values_num)
+		return SUCCEED;
+
+	return history_get_aggregates_multi(GLB_MODULE_API_HISTORY_READ_TRENDS_AGG_MULTI, itemids, value_type, start,
+			end, aggregates, row_cb, cb_data);
+}
+
 /************************************************************************************
  *                                                                                  *
  * Function: glb_history_get_trends                                                 *
@@ -32,6 +32,8 @@ typedef int (*glb_history_get_func_t)(void *data, int value_type, zbx_uint64_t i
 typedef int (*glb_history_add_trend_func_t)(void *data, trend_t *trend);
 
 typedef int (*glb_history_get_agg_buff_func_t)(void *data, int value_type, zbx_uint64_t itemid, int start, int aggregates, int end, struct zbx_json* json);
+typedef int (*glb_history_get_agg_multi_func_t)(void *data, int value_type, zbx_vector_uint64_t *itemids, int start, int end, int aggregates,
+		glb_history_agg_row_cb_t row_cb, void *cb_data);
 typedef int (*glb_history_get_trends_json_func_t)(void *data, int value_type, zbx_uint64_t itemid, int start, int end, struct zbx_json* json);
 
 
@@ -7,9 +7,12 @@
 #include "history.h"
 #include "module.h"
 #include "zbxstr.h"
+#include "zbxnum.h"
 #include "zbx_item_constants.h"
 #include "zbx_trigger_constants.h"
 #include "zbxcacheconfig.h"
+#include "zbxcompress.h"
+#include "history_clickhouse_format.h"
 
 #if defined(HAVE_LIBCURL) && LIBCURL_VERSION_NUM >= 0x071c00
 
@@ -22,21 +25,46 @@
 #define GLB_DEFAULT_CLICKHOUSE_DISABLE_TRENDS 0
 #define GLB_CLICKHOUSE_WRITE_BATCH	1000000
 #define GLB_CLICKHOUSE_FLUSH_TIMEOUT 3
+#define GLB_DEFAULT_CLICKHOUSE_CONN_IDLE_TIMEOUT	30
+#define GLB_MAX_CLICKHOUSE_CONN_IDLE_TIMEOUT	SEC_PER_HOUR
+#define GLB_DEFAULT_CLICKHOUSE_SPOOL_MAX_FILES	10000
+#define GLB_CLICKHOUSE_SPOOL_REPLAY_BATCH	16
+#define GLB_CLICKHOUSE_SPOOL_PREFIX	"clickhouse_"
 
 #define MAX_REASONABLE_BUFFER_SIZE 10000000
-#define ESCAPE_CHARS "'\\"
+#define GLB_CLICKHOUSE_LOG_POSTDATA_LEN	1024
+
+/* idle keep-alive connection of the process, the handle is created lazily after fork;
+   requests are made one by one from the single thread of a process, so there is
+   never more than one idle handle to keep */
+typedef struct
+{
+	CURL	*handle;
+	int	lastused;
+	int	idle_timeout;
+	struct curl_slist	*headers;
+	struct curl_slist	*deflate_headers;
+}
+glb_clickhouse_conn_pool_t;
 
 typedef struct
 {
 	char	*url;
 	char 	dbname[MAX_STRING_LEN];
+	glb_clickhouse_conn_pool_t conn_pool;
 	u_int8_t read_types[ITEM_VALUE_TYPE_MAX];
 	u_int8_t write_types[ITEM_VALUE_TYPE_MAX];
 	u_int8_t read_aggregate_types[ITEM_VALUE_TYPE_MAX];
 	u_int8_t disable_host_item_names;
 	u_int8_t disable_nanoseconds;
+	u_int8_t write_format;
+	u_int8_t compress_writes;
 	u_int16_t disable_read_timeout;
 	int startup_time;
+	char	*spool_dir;
+	int	spool_max_files;
+	glb_clickhouse_buffer_t history_buffers[ITEM_VALUE_TYPE_MAX];
+	glb_clickhouse_buffer_t trend_buffers[ITEM_VALUE_TYPE_MAX];
 }
 glb_clickhouse_data_t;
 
@@ -48,15 +76,6 @@ typedef struct
 }
 zbx_httppage_t;
 
-typedef struct {
-	char *buffer;
-	size_t alloc;
-	size_t offset;
-	int lastflush;
-	int num;
-} 
-glb_clickhouse_buffer_t;
-
 static char *trend_tables[] = {"trends_dbl", "", "", "trends_uint",""};
 static char *hist_tables[] = {"history_dbl", "history_str", "history_log", "history_uint", "history_str"};
 
@@ -77,7 +96,7 @@ static void	clickhouse_log_error(CURL *handle, CURLcode error, const char *errbu
 	if (CURLE_HTTP_RETURNED_ERROR == error)
 	{
 		curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &http_code);
-		if (0 != page_r->offset)
+		if (NULL != page_r && 0 != page_r->offset)
 			LOG_WRN("cannot get values from clickhouse, HTTP error: %ld, message: %s",http_code, page_r->data);
 		else
 			LOG_WRN("cannot get values from clickhouse, HTTP error: %ld", http_code);
@@ -86,6 +105,74 @@ static void	clickhouse_log_error(CURL *handle, CURLcode error, const char *errbu
 		LOG_WRN("cannot get values from clickhouse: %s",'\0' != *errbuf ? errbuf : curl_easy_strerror(error));
 }
 
+static CURL *conn_pool_create_handle(glb_clickhouse_data_t *conf) {
+	CURL	*handle;
+
+	if (NULL == (handle = curl_easy_init()))
+		return NULL;
+
+	curl_easy_setopt(handle, CURLOPT_URL, conf->url);
+	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, conf->conn_pool.headers);
+	curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+#if LIBCURL_VERSION_NUM >= 0x074100
+	curl_easy_setopt(handle, CURLOPT_MAXAGE_CONN, (long)conf->conn_pool.idle_timeout);
+#endif
+	return handle;
+}
+
+/* the handle idle for too long is dropped as the server has most probably closed the connection */
+static CURL *conn_pool_acquire(glb_clickhouse_data_t *conf) {
+	glb_clickhouse_conn_pool_t *pool = &conf->conn_pool;
+	CURL *handle;
+
+	if (NULL != (handle = pool->handle)) {
+		pool->handle = NULL;
+
+		if (pool->lastused + pool->idle_timeout >= time(NULL))
+			return handle;
+
+		curl_easy_cleanup(handle);
+	}
+
+	return conn_pool_create_handle(conf);
+}
+
+static void conn_pool_release(glb_clickhouse_data_t *conf, CURL *handle, CURLcode err) {
+	glb_clickhouse_conn_pool_t *pool = &conf->conn_pool;
+
+	/* transport level errors mean the connection is broken, not worth keeping */
+	if (NULL != pool->handle || 
+		CURLE_COULDNT_CONNECT == err || CURLE_SEND_ERROR == err || 
+		CURLE_RECV_ERROR == err || CURLE_GOT_NOTHING == err || CURLE_OPERATION_TIMEDOUT == err) 
+	{
+		curl_easy_cleanup(handle);
+		return;
+	}
+
+	pool->handle = handle;
+	pool->lastused = time(NULL);
+}
+
+static void conn_pool_init(glb_clickhouse_conn_pool_t *pool, int idle_timeout) {
+	pool->handle = NULL;
+	pool->idle_timeout = idle_timeout;
+	
+	/* avoid extra round trip on big inserts */
+	pool->headers = curl_slist_append(NULL, "Expect:");
+	pool->deflate_headers = curl_slist_append(NULL, "Expect:");
+	pool->deflate_headers = curl_slist_append(pool->deflate_headers, "Content-Encoding: deflate");
+}
+
+static void conn_pool_destroy(glb_clickhouse_conn_pool_t *pool) {
+	if (NULL != pool->handle)
+		curl_easy_cleanup(pool->handle);
+
+	curl_slist_free_all(pool->headers);
+	curl_slist_free_all(pool->deflate_headers);
+}
+
 /************************************************************************************
  *                                                                                  *
  * Function: clickhouse_destroy                                                        *
@@ -95,170 +182,390 @@ static void	clickhouse_log_error(CURL *handle, CURLcode error, const char *errbu
  * Parameters:  hist - [IN] the history storage interface                           *
  *                                                                                  *
  ************************************************************************************/
+static void clickhouse_flush_buffers(glb_clickhouse_data_t *conf, glb_clickhouse_buffer_t *buffers, 
+		const char *name, int force);
+
 static void	clickhouse_destroy(void *data)
 {
 	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
+	int i;
 
+	/* the last not yet sent values of the process */
+	clickhouse_flush_buffers(conf, conf->history_buffers, "values", 1);
+	clickhouse_flush_buffers(conf, conf->trend_buffers, "trends", 1);
+
+	for (i = 0; i < ITEM_VALUE_TYPE_MAX; i++) {
+		zbx_free(conf->history_buffers[i].buffer);
+		zbx_free(conf->trend_buffers[i].buffer);
+	}
+
+	conn_pool_destroy(&conf->conn_pool);
+	zbx_free(conf->spool_dir);
 	zbx_free(conf->url);
 	zbx_free(data);
 }
 
 
-static int curl_post_request(char *url, char *postdata, char **responce) {
- 	
-	static zbx_httppage_t page_r = {0};
-	struct curl_slist	*curl_headers = NULL;
+/* handles are pooled and shared by inserts and queries, so the response sink is set on every request */
+static int curl_perform_post(glb_clickhouse_data_t *conf, const char *postdata, size_t size, int deflate,
+		size_t (*write_cb)(void *, size_t, size_t, void *), void *write_data, zbx_httppage_t *page_r) {
 	CURLcode		err;
 	CURL	*handle = NULL;
 	char  errbuf[CURL_ERROR_SIZE];
-	
-	if (page_r.alloc > MAX_REASONABLE_BUFFER_SIZE) {
-		zbx_free(page_r.data);
-		bzero(&page_r,sizeof(zbx_httppage_t));	
-	}
 
-	if (NULL == (handle = curl_easy_init()))
+	if (NULL == (handle = conn_pool_acquire(conf)))
 	{
 		LOG_WRN("cannot initialize cURL session");
 		return FAIL;
 	} 
 
-	curl_easy_setopt(handle, CURLOPT_URL, url);
 	curl_easy_setopt(handle, CURLOPT_POSTFIELDS, postdata);
-	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_cb);
-	curl_easy_setopt(handle, CURLOPT_WRITEDATA, &page_r);
-	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, curl_headers);
-	curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)size);
+	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, 0 == deflate ? conf->conn_pool.headers : conf->conn_pool.deflate_headers);
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_cb);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, write_data);
 	curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, errbuf);
 
-	page_r.offset = 0;
 	*errbuf = '\0';
 
 	if (CURLE_OK != (err = curl_easy_perform(handle)))
 	{
 
-		clickhouse_log_error(handle, err, errbuf,&page_r);
-        LOG_WRN("Failed url '%s' postdata '%s' ",url, postdata);
+		clickhouse_log_error(handle, err, errbuf, page_r);
+		
+		/* binary and deflated bodies aren't NUL-terminated, so only the head of the body is logged */
+		if (0 == deflate)
+			LOG_WRN("Failed url '%s' postdata of %zu bytes '%.*s'", conf->url, size, 
+				(int)MIN(size, GLB_CLICKHOUSE_LOG_POSTDATA_LEN), postdata);
+		else 
+			LOG_WRN("Failed url '%s' deflated postdata of %zu bytes", conf->url, size);
 	} 
-	//LOG_DBG("Recieved from clickhouse: %s", page_r.data);	
 
-	curl_easy_cleanup(handle);
-	curl_slist_free_all(curl_headers);
+	curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, NULL);
+	conn_pool_release(conf, handle, err);
+
 	if (CURLE_OK != err) 
 		return FAIL;
-	*responce = page_r.data;
+
 	return SUCCEED;
 }
 
-/* agregation just checks for fields presence without actial conversion */
-static int parse_aggregate_responce(u_int64_t itemid, char *responce, struct zbx_json *json) {
-	const char *p = NULL;
-	size_t alloc = 0, offset = 0; 
-	struct zbx_json_parse jp, jp_data;
-	int valuecount = 0;
+static int curl_post_data(glb_clickhouse_data_t *conf, const char *postdata, size_t size, int deflate, char **responce) {
+ 	
+	static zbx_httppage_t page_r = {0};
+	
+	if (page_r.alloc > MAX_REASONABLE_BUFFER_SIZE) {
+		zbx_free(page_r.data);
+		bzero(&page_r,sizeof(zbx_httppage_t));	
+	}
+
+	page_r.offset = 0;
 
-	if ( NULL == responce) 
+	if (SUCCEED != curl_perform_post(conf, postdata, size, deflate, curl_write_cb, &page_r, &page_r))
 		return FAIL;
 
-	if (SUCCEED != zbx_json_open(responce, &jp)) {
-		LOG_WRN("Couldn't parse json response %s", responce);
+	*responce = page_r.data;
+	return SUCCEED;
+}
+
+static size_t	curl_tsv_write_cb(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	size_t	r_size = size * nmemb;
+
+	clickhouse_tsv_parse((clickhouse_tsv_parser_t *)userdata, ptr, r_size);
+
+	return r_size;
+}
+
+/* query results are parsed while they are being received, so only one row at a time is kept
+   in memory instead of the whole response */
+static int clickhouse_query_tsv(glb_clickhouse_data_t *conf, const char *sql, clickhouse_tsv_row_cb_t row_cb, 
+		void *cb_data) {
+	static clickhouse_tsv_parser_t parser = {0};
+	int ret;
+
+	if (parser.line_alloc > MAX_REASONABLE_BUFFER_SIZE)
+		clickhouse_tsv_clean(&parser);
+
+	parser.line_offset = 0;
+	parser.rows = 0;
+	parser.row_cb = row_cb;
+	parser.cb_data = cb_data;
+
+	if (SUCCEED == (ret = curl_perform_post(conf, sql, strlen(sql), 0, curl_tsv_write_cb, &parser, NULL)))
+		clickhouse_tsv_finish(&parser);
+
+	LOG_DBG("Parsed %d rows from clickhouse response", parser.rows);
+
+	return ret;
+}
+
+/* failed inserts are kept on disk as ready to send request bodies, the file suffix tells */
+/* if the body is deflated; files are shared by all processes and claimed by rename on replay */
+static int spool_is_spool_file(const char *name) {
+	size_t len = strlen(name);
+
+	if (0 != strncmp(name, GLB_CLICKHOUSE_SPOOL_PREFIX, ZBX_CONST_STRLEN(GLB_CLICKHOUSE_SPOOL_PREFIX)))
 		return FAIL;
+
+	if ((len > ZBX_CONST_STRLEN(".raw") && 0 == strcmp(name + len - ZBX_CONST_STRLEN(".raw"), ".raw")) ||
+		(len > ZBX_CONST_STRLEN(".deflate") && 0 == strcmp(name + len - ZBX_CONST_STRLEN(".deflate"), ".deflate")))
+		return SUCCEED;
+
+	return FAIL;
+}
+
+/* the directory is shared by all the processes, so the files are counted on disk */
+static int spool_count_files(glb_clickhouse_data_t *conf) {
+	DIR *dir;
+	struct dirent *d;
+	int num = 0;
+
+	if (NULL == (dir = opendir(conf->spool_dir)))
+		return 0;
+
+	while (NULL != (d = readdir(dir)))
+		if (SUCCEED == spool_is_spool_file(d->d_name))
+			num++;
+
+	closedir(dir);
+
+	return num;
+}
+
+/* files claimed as "<file>.<pid>" by the processes that died before sending them are returned to the spool */
+static void spool_reclaim_files(glb_clickhouse_data_t *conf) {
+	DIR *dir;
+	struct dirent *d;
+
+	if (NULL == (dir = opendir(conf->spool_dir)))
+		return;
+
+	while (NULL != (d = readdir(dir))) {
+		char name[MAX_STRING_LEN], path[MAX_STRING_LEN], claimed[MAX_STRING_LEN], *pid_ptr;
+		int pid;
+
+		if (NULL == (pid_ptr = strrchr(d->d_name, '.')) || SUCCEED != zbx_is_uint31(pid_ptr + 1, &pid))
+			continue;
+
+		zbx_snprintf(name, sizeof(name), "%.*s", (int)(pid_ptr - d->d_name), d->d_name);
+
+		if (SUCCEED != spool_is_spool_file(name) || 0 == kill(pid, 0) || EPERM == errno)
+			continue;
+
+		zbx_snprintf(claimed, sizeof(claimed), "%s/%s", conf->spool_dir, d->d_name);
+		zbx_snprintf(path, sizeof(path), "%s/%s", conf->spool_dir, name);
+
+		if (0 != rename(claimed, path))
+			LOG_WRN("Cannot return clickhouse spool file '%s' to the spool: %s", claimed, zbx_strerror(errno));
+		else
+			LOG_INF("Returned clickhouse spool file '%s' claimed by the finished process %d", path, (int)pid);
 	}
-	
-	if (SUCCEED != zbx_json_brackets_by_name(&jp, "data", &jp_data)) {
-		LOG_WRN("Couldn't find data section in the responce %s:", responce);
+
+	closedir(dir);
+}
+
+static void spool_save(glb_clickhouse_data_t *conf, const char *data, size_t size, int deflate) {
+	static int seq = 0;
+	char path[MAX_STRING_LEN], tmp_path[MAX_STRING_LEN];
+	FILE *f;
+	int spool_files;
+
+	if ((spool_files = spool_count_files(conf)) >= conf->spool_max_files) {
+		LOG_WRN("Clickhouse spool '%s' is full (%d files), dropping %zu bytes of data", conf->spool_dir,
+				spool_files, size);
+		return;
+	}
+
+	zbx_snprintf(path, sizeof(path), "%s/" GLB_CLICKHOUSE_SPOOL_PREFIX "%d_%d_%d.%s", conf->spool_dir,
+			(int)time(NULL), (int)getpid(), seq++, 0 == deflate ? "raw" : "deflate");
+	zbx_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	if (NULL == (f = fopen(tmp_path, "w"))) {
+		LOG_WRN("Cannot create clickhouse spool file '%s': %s", tmp_path, zbx_strerror(errno));
+		return;
+	}
+
+	if (size != fwrite(data, 1, size, f)) {
+		LOG_WRN("Cannot write clickhouse spool file '%s': %s", tmp_path, zbx_strerror(errno));
+		fclose(f);
+		unlink(tmp_path);
+		return;
+	}
+
+	fclose(f);
+
+	if (0 != rename(tmp_path, path)) {
+		LOG_WRN("Cannot rename clickhouse spool file '%s': %s", tmp_path, zbx_strerror(errno));
+		unlink(tmp_path);
+		return;
+	}
+
+	LOG_WRN("Saved %zu bytes of failed clickhouse insert to '%s'", size, path);
+}
+
+static int spool_read_file(const char *path, char **data, size_t *size) {
+	FILE *f;
+	zbx_stat_t st;
+
+	if (0 != zbx_stat(path, &st) || NULL == (f = fopen(path, "r")))
+		return FAIL;
+
+	*size = st.st_size;
+	*data = zbx_malloc(NULL, *size + 1);
+
+	if (*size != fread(*data, 1, *size, f)) {
+		zbx_free(*data);
+		fclose(f);
 		return FAIL;
-	};
-    
-	LOG_DBG("Responce is %s", responce);
-	
-    while (NULL != (p = zbx_json_next(&jp_data, p)))
-	{
-        char clck[MAX_ID_LEN], value[MAX_STRING_LEN];
-		char request[MAX_STRING_LEN],min_value[MAX_ID_LEN],max_value[MAX_ID_LEN],avg_value[MAX_ID_LEN], i[MAX_ID_LEN], count[MAX_ID_LEN];
-		zbx_json_type_t type;
-        
-        struct zbx_json_parse	jp_row;
-		
-        if (SUCCEED == zbx_json_brackets_open(p, &jp_row) &&
-            SUCCEED == zbx_json_value_by_name(&jp_row, "clcck", clck,MAX_ID_LEN, &type) &&
-            SUCCEED == zbx_json_value_by_name(&jp_row, "count", count, MAX_ID_LEN,&type) &&
-			SUCCEED == zbx_json_value_by_name(&jp_row, "max", max_value, MAX_ID_LEN,&type) && 
-			SUCCEED == zbx_json_value_by_name(&jp_row, "avg", avg_value, MAX_ID_LEN,&type) && 
-			SUCCEED == zbx_json_value_by_name(&jp_row, "min", min_value, MAX_ID_LEN,&type) && 
-			SUCCEED == zbx_json_value_by_name(&jp_row, "i", i, MAX_ID_LEN,&type) )
-		{
-			zbx_json_addobject(json,NULL);
-			zbx_json_adduint64 (json, "itemid", itemid);
-			zbx_json_addstring( json, "clock", clck, ZBX_JSON_TYPE_INT);
-			zbx_json_addstring( json, "count", count, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "max", max_value, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "min", min_value, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "avg", avg_value, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "i", i, ZBX_JSON_TYPE_INT);
-			zbx_json_close(json);
-        } else {
-            zabbix_log(LOG_LEVEL_DEBUG,"Couldn't parse JSON row: %s",p);
-        };
 	}
-	
+
+	(*data)[*size] = '\0';
+	fclose(f);
+
 	return SUCCEED;
 }
 
+static int curl_post_data(glb_clickhouse_data_t *conf, const char *postdata, size_t size, int deflate, char **responce);
 
-static int parse_trends_responce(char *responce, struct zbx_json *json) {
-	const char *p = NULL;
-	size_t alloc = 0, offset = 0; 
-	struct zbx_json_parse jp, jp_data;
-	int valuecount = 0;
+/* resends the oldest spooled inserts, stops on the first failure to keep the order */
+static void spool_replay(glb_clickhouse_data_t *conf) {
+	static int last_replay = 0;
+	DIR *dir;
+	struct dirent *d;
+	zbx_vector_str_t names;
+	int i, now = time(NULL);
 
-	if ( NULL == responce) 
-		return FAIL;
-	
-	if (SUCCEED != zbx_json_open(responce, &jp)) {
-		LOG_WRN("Couldn't parse json response %s", responce);
-		return FAIL;
+	if (last_replay == now)
+		return;
+
+	last_replay = now;
+
+	if (NULL == (dir = opendir(conf->spool_dir)))
+		return;
+
+	zbx_vector_str_create(&names);
+
+	while (NULL != (d = readdir(dir)))
+		if (SUCCEED == spool_is_spool_file(d->d_name))
+			zbx_vector_str_append(&names, zbx_strdup(NULL, d->d_name));
+
+	closedir(dir);
+
+	zbx_vector_str_sort(&names, ZBX_DEFAULT_STR_COMPARE_FUNC);
+
+	for (i = 0; i < names.values_num && i < GLB_CLICKHOUSE_SPOOL_REPLAY_BATCH; i++) {
+		char path[MAX_STRING_LEN], claimed[MAX_STRING_LEN], *data, *responce;
+		size_t size;
+		int ret, deflate = (NULL != strstr(names.values[i], ".deflate"));
+
+		zbx_snprintf(path, sizeof(path), "%s/%s", conf->spool_dir, names.values[i]);
+		zbx_snprintf(claimed, sizeof(claimed), "%s.%d", path, (int)getpid());
+
+		/* other process has claimed the file */
+		if (0 != rename(path, claimed))
+			continue;
+
+		if (SUCCEED != spool_read_file(claimed, &data, &size)) {
+			LOG_WRN("Cannot read clickhouse spool file '%s', removing it", claimed);
+			unlink(claimed);
+			continue;
+		}
+
+		ret = curl_post_data(conf, data, size, deflate, &responce);
+		zbx_free(data);
+
+		if (SUCCEED != ret) {
+			rename(claimed, path);
+			break;
+		}
+
+		LOG_INF("Replayed clickhouse spool file '%s', %zu bytes", path, size);
+		unlink(claimed);
 	}
-	
-	if (SUCCEED != zbx_json_brackets_by_name(&jp, "data", &jp_data)) {
-		LOG_WRN("Couldn't find data section in the responce %s:", responce);
-		return FAIL;
-	};
-    
-	LOG_DBG("Responce is %s", responce);
 
-    while (NULL != (p = zbx_json_next(&jp_data, p)))
-	{
-        char itemid[MAX_ID_LEN], clck[MAX_ID_LEN], ns[MAX_ID_LEN],value[MAX_STRING_LEN];
-		char request[MAX_STRING_LEN],min_value[MAX_ID_LEN],max_value[MAX_ID_LEN],avg_value[MAX_ID_LEN], count[MAX_ID_LEN];
-		zbx_json_type_t type;
-        
-        struct zbx_json_parse	jp_row;
-
-        if (SUCCEED == zbx_json_brackets_open(p, &jp_row) &&
-			SUCCEED == zbx_json_value_by_name(&jp_row, "clcck", clck,MAX_ID_LEN, &type) &&
-            SUCCEED == zbx_json_value_by_name(&jp_row, "num", count, MAX_ID_LEN,&type) &&
-			SUCCEED == zbx_json_value_by_name(&jp_row, "value_max", max_value, MAX_ID_LEN,&type) && 
-			SUCCEED == zbx_json_value_by_name(&jp_row, "value_avg", avg_value, MAX_ID_LEN,&type) && 
-			SUCCEED == zbx_json_value_by_name(&jp_row, "value_min", min_value, MAX_ID_LEN,&type) && 
-			SUCCEED == zbx_json_value_by_name(&jp_row, "itemid", itemid, MAX_ID_LEN,&type)
-		)
-		{
-			zbx_json_addobject(json,NULL);
-			zbx_json_addstring (json, "itemid", itemid, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "clock", clck, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "value_max", max_value, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "value_min", min_value, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "value_avg", avg_value, ZBX_JSON_TYPE_STRING);
-			zbx_json_addstring( json, "num", count, ZBX_JSON_TYPE_STRING);
-			zbx_json_close(json);
-		} else {
-           LOG_INF("Couldn't parse JSON row: %s",p);
-        };
+	zbx_vector_str_clear_ext(&names, zbx_str_free);
+	zbx_vector_str_destroy(&names);
+}
+
+static int clickhouse_post_insert(glb_clickhouse_data_t *conf, const char *data, size_t size, int deflate) {
+	char *responce;
+
+	if (SUCCEED != curl_post_data(conf, data, size, deflate, &responce)) {
+		if (NULL != conf->spool_dir)
+			spool_save(conf, data, size, deflate);
+		return FAIL;
 	}
+
+	if (NULL != conf->spool_dir)
+		spool_replay(conf);
+
 	return SUCCEED;
 }
 
+static int clickhouse_flush_buffer(glb_clickhouse_data_t *conf, glb_clickhouse_buffer_t *buf) {
+	char *compressed = NULL;
+	size_t compressed_size;
+	int ret;
+
+	if (0 == conf->compress_writes) 
+		return clickhouse_post_insert(conf, buf->buffer, buf->offset, 0);
+
+	if (SUCCEED != zbx_compress(buf->buffer, buf->offset, &compressed, &compressed_size)) {
+		LOG_WRN("Cannot compress clickhouse insert: %s, sending uncompressed", zbx_compress_strerror());
+		return clickhouse_post_insert(conf, buf->buffer, buf->offset, 0);
+	}
+
+	ret = clickhouse_post_insert(conf, compressed, compressed_size, 1);
+	zbx_free(compressed);
+
+	return ret;
+}
+
+/* sends the buffers having enough rows or waiting for too long, or all non-empty ones if forced */
+static void clickhouse_flush_buffers(glb_clickhouse_data_t *conf, glb_clickhouse_buffer_t *buffers, 
+		const char *name, int force) {
+	int i;
+
+	for (i = 0; i < ITEM_VALUE_TYPE_MAX; i++) {
+		glb_clickhouse_buffer_t *buf = &buffers[i];
+
+		if (0 == buf->num || (0 == force && GLB_CLICKHOUSE_WRITE_BATCH >= buf->num &&
+				buf->lastflush + GLB_CLICKHOUSE_FLUSH_TIMEOUT >= time(NULL)))
+			continue;
+
+		if (SUCCEED != clickhouse_flush_buffer(conf, buf)) 
+			LOG_WRN("FAILED to flush %d %s of type %d to clickhouse", buf->num, name, i);
+
+		buf->offset = 0;
+		buf->num = 0;
+		buf->lastflush = time(NULL);
+
+		if (buf->alloc > MAX_REASONABLE_BUFFER_SIZE) {
+			zbx_free(buf->buffer);
+			buf->alloc = 0;
+		}
+	}
+}
+
+/* itemid, num, clcck, value_avg, value_min, value_max */
+static void trends_json_row_cb(char **fields, int fields_num, void *cb_data) {
+	struct zbx_json *json = cb_data;
+
+	if (6 != fields_num) {
+		LOG_DBG("Skipping row of %d fields, 6 expected: %s", fields_num, fields[0]);
+		return;
+	}
+
+	zbx_json_addobject(json,NULL);
+	zbx_json_addstring (json, "itemid", fields[0], ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "clock", fields[2], ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "value_max", fields[5], ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "value_min", fields[4], ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "value_avg", fields[3], ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "num", fields[1], ZBX_JSON_TYPE_STRING);
+	zbx_json_close(json);
+}
 
 static int	get_trend_values_json(void *data, int value_type, zbx_uint64_t itemid, int start, int end, struct zbx_json *json) {
 	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
@@ -266,14 +573,12 @@ static int	get_trend_values_json(void *data, int value_type, zbx_uint64_t itemid
 	static char	*sql_buffer=NULL;
     static size_t buf_alloc = 0, buf_offset;
 	
-	char *responce;
-
 	buf_offset = 0;
 	
 	LOG_DBG("In %s() trends request for item %ld", __func__,itemid);
 
 	if (end < start ) {
-		zabbix_log(LOG_LEVEL_WARNING,"%s: wrong params requested: start:%d, end:%d, steps:%d",__func__, start, end);
+		zabbix_log(LOG_LEVEL_WARNING,"%s: wrong params requested: start:%d, end:%d",__func__, start, end);
 		return FAIL;
 	}
 
@@ -288,128 +593,184 @@ static int	get_trend_values_json(void *data, int value_type, zbx_uint64_t itemid
 		WHERE clock BETWEEN %ld AND %ld AND \
 		itemid = %ld \
 		ORDER BY clock \
-		FORMAT JSON",  conf->dbname, trend_tables[value_type], start, end, itemid); 
+		FORMAT TabSeparated",  conf->dbname, trend_tables[value_type], start, end, itemid); 
 
 	LOG_DBG("Sending query to '%s' post data: '%s'", conf->url, sql_buffer);
 
-	if (SUCCEED != curl_post_request(conf->url, sql_buffer, &responce)) 
+	if (SUCCEED != clickhouse_query_tsv(conf, sql_buffer, trends_json_row_cb, json)) 
 		return FAIL;
 	
-	LOG_DBG("Recieved from clickhouse: %s", responce);
-	
-	if (SUCCEED != parse_trends_responce(responce, json)) 
-			return FAIL;
-	
 	LOG_DBG("Resulting trends JSON is %s", json->buffer);
 
 	return SUCCEED;
 }
 
-static int	get_trend_aggregates_json(void *data, int value_type, zbx_uint64_t itemid, int start, int end, int steps, struct zbx_json *json)
-{
-	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
-	
-	static char	*sql_buffer=NULL;
-    static size_t buf_alloc = 0, buf_offset;
+typedef struct {
+	glb_history_agg_row_cb_t row_cb;
+	void *cb_data;
+} aggregate_multi_ctx_t;
+
+/* itemid, i, clcck, avg, count, min, max */
+static void aggregate_multi_row_cb(char **fields, int fields_num, void *cb_data) {
+	glb_history_agg_row_t row;
+	aggregate_multi_ctx_t *ctx = cb_data;
+
+	if (7 != fields_num) {
+		LOG_DBG("Skipping row of %d fields, 7 expected: %s", fields_num, fields[0]);
+		return;
+	}
 	
-	char *responce;
+	row.itemid = strtoull(fields[0], NULL, 10);
+	row.i = fields[1];
+	row.clock = fields[2];
+	row.avg = fields[3];
+	row.count = fields[4];
+	row.min = fields[5];
+	row.max = fields[6];
+
+	ctx->row_cb(&row, ctx->cb_data);
+}
 
-	buf_offset = 0;
-	
-	LOG_DBG("In %s() trends request for item %ld", __func__,itemid);
+static void add_itemids_list(char **sql_buffer, size_t *buf_alloc, size_t *buf_offset, zbx_vector_uint64_t *itemids) {
+	int i;
 
-	if (0 == conf->read_aggregate_types[value_type])	
-			return SUCCEED;
+	for (i = 0; i < itemids->values_num; i++)
+		zbx_snprintf_alloc(sql_buffer, buf_alloc, buf_offset, "%s" ZBX_FS_UI64, 0 == i ? "" : ",",
+				itemids->values[i]);
+}
 
-	if (end < start || 1 > steps ) {
-		zabbix_log(LOG_LEVEL_WARNING,"%s: wrong params requested: start:%d, end:%d, steps:%d",__func__, start, end);
+/************************************************************************************
+	Aggregated history or trends of several items of the same value type,
+	done by one IN (...) query, rows are ordered by item to come grouped
+ ************************************************************************************/
+static int	get_aggregates_multi(glb_clickhouse_data_t *conf, const char *table, const char *count_expr,
+		const char *avg_expr, const char *min_expr, const char *max_expr, zbx_vector_uint64_t *itemids, 
+		int start, int end, int steps, glb_history_agg_row_cb_t row_cb, void *cb_data)
+{
+	static char	*sql_buffer = NULL;
+	static size_t buf_alloc = 0;
+	size_t buf_offset = 0;
+	aggregate_multi_ctx_t ctx = {.row_cb = row_cb, .cb_data = cb_data};
+
+	if (end < start || 1 > steps) {
+		LOG_WRN("%s: wrong params requested: start:%d end:%d, aggregates: %d", __func__, start, end, steps);
 		return FAIL;
 	}
-	
+
 	zbx_snprintf_alloc(&sql_buffer, &buf_alloc, &buf_offset, 
 		"SELECT itemid, \
-			sum(count) as count, \
-			round( multiply((toUnixTimestamp(clock)-%ld), %ld) / %ld ,0) as i,\
+			round( multiply((toUnixTimestamp(clock)-%d), %d) / %d ,0) as i,\
 			max(toUnixTimestamp(clock)) as clcck ,\
-			avg(value_avg) as avg, \
-			min(value_min) as min , \
-			max(value_max) as max \
-		FROM %s.%s  \
-		WHERE clock BETWEEN %ld AND %ld AND \
-		itemid = %ld \
-		GROUP BY itemid, i \
-		ORDER BY i \
-		FORMAT JSON",  start, steps, end-start, conf->dbname, trend_tables[value_type], start, end, itemid); 
+			%s as avg, \
+			%s as count, \
+			%s as min , \
+			%s as max \
+		FROM %s.%s \
+		WHERE clock BETWEEN %d AND %d AND \
+		itemid IN (", start, steps, MAX(1, end - start), avg_expr, count_expr, min_expr, max_expr, 
+		conf->dbname, table, start, end);
 	
+	add_itemids_list(&sql_buffer, &buf_alloc, &buf_offset, itemids);
+
+	zbx_snprintf_alloc(&sql_buffer, &buf_alloc, &buf_offset, 
+			") GROUP BY itemid, i ORDER BY itemid, i FORMAT TabSeparated");
+
 	LOG_DBG("Sending query to '%s' post data: '%s'", conf->url, sql_buffer);
-		
-	if (SUCCEED != curl_post_request(conf->url, sql_buffer, &responce)) 
+
+	return clickhouse_query_tsv(conf, sql_buffer, aggregate_multi_row_cb, &ctx);
+}
+
+static int	get_history_aggregates_multi(void *data, int value_type, zbx_vector_uint64_t *itemids, int start, int end,
+		int steps, glb_history_agg_row_cb_t row_cb, void *cb_data)
+{
+	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
+
+	if (0 == conf->read_aggregate_types[value_type] ||
+		(value_type != ITEM_VALUE_TYPE_FLOAT && value_type != ITEM_VALUE_TYPE_UINT64))
 		return FAIL;
-	
-	LOG_DBG("Recieved from clickhouse: %s", responce);
-	
-	if (SUCCEED != parse_aggregate_responce(itemid, responce, json)) 
-			return FAIL;
 
-	return SUCCEED;
+	return get_aggregates_multi(conf, hist_tables[value_type], "count(value)", "avg(value)", "min(value)", 
+			"max(value)", itemids, start, end, steps, row_cb, cb_data);
+}
+
+static int	get_trend_aggregates_multi(void *data, int value_type, zbx_vector_uint64_t *itemids, int start, int end,
+		int steps, glb_history_agg_row_cb_t row_cb, void *cb_data)
+{
+	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
+
+	if (0 == conf->read_aggregate_types[value_type])
+		return FAIL;
+
+	return get_aggregates_multi(conf, trend_tables[value_type], "sum(count)", "avg(value_avg)", "min(value_min)", 
+			"max(value_max)", itemids, start, end, steps, row_cb, cb_data);
+}
+
+/* single item aggregates keep their legacy json layout */
+static void aggregate_json_row_cb(const glb_history_agg_row_t *row, void *cb_data) {
+	struct zbx_json *json = cb_data;
+
+	zbx_json_addobject(json,NULL);
+	zbx_json_adduint64 (json, "itemid", row->itemid);
+	zbx_json_addstring( json, "clock", row->clock, ZBX_JSON_TYPE_INT);
+	zbx_json_addstring( json, "count", row->count, ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "max", row->max, ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "min", row->min, ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "avg", row->avg, ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring( json, "i", row->i, ZBX_JSON_TYPE_INT);
+	zbx_json_close(json);
 }
 
-static int parse_history_get_values(u_int64_t itemid, glb_clickhouse_data_t *conf, char *responce, int value_type, zbx_vector_history_record_t *values) {
-	struct zbx_json_parse	jp, jp_row, jp_data;
-	const char		*p = NULL;
+static int	get_trend_aggregates_json(void *data, int value_type, zbx_uint64_t itemid, int start, int end, int steps, struct zbx_json *json)
+{
+	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
+	zbx_vector_uint64_t itemids = {.values = &itemid, .values_num = 1, .values_alloc = 1};
+
+	LOG_DBG("In %s() trends request for item %ld", __func__,itemid);
+
+	if (0 == conf->read_aggregate_types[value_type])	
+			return SUCCEED;
+
+	return get_trend_aggregates_multi(data, value_type, &itemids, start, end, steps, aggregate_json_row_cb, json);
+}
+
+typedef struct {
+	glb_clickhouse_data_t *conf;
+	int value_type;
+	zbx_vector_history_record_t *values;
+} history_values_ctx_t;
+
+/* clock, value, [source, severity, logeventid], [ns] */
+static void history_values_row_cb(char **fields, int fields_num, void *cb_data) {
+	history_values_ctx_t *ctx = cb_data;
 	zbx_history_record_t	hr;
+	int expected = 2;
 
-    char  clck[MAX_ID_LEN], ns[MAX_ID_LEN], *value = NULL, *source = NULL;
-    size_t value_alloc = 0;
+	if (ITEM_VALUE_TYPE_LOG == ctx->value_type)
+		expected += 3;
+	
+	if (0 == ctx->conf->disable_nanoseconds)
+		expected++;
 
-    zbx_json_open(responce, &jp);
-    zbx_json_brackets_by_name(&jp, "data", &jp_data);
-    
-	//LOG_INF("Read history value for item %ld value type is %d", itemid, value_type);
+	if (expected != fields_num) {
+		LOG_DBG("Skipping row of %d fields, %d expected: %s", fields_num, expected, fields[0]);
+		return;
+	}
 
-    while (NULL != (p = zbx_json_next(&jp_data, p)))
-	{
-		zbx_json_type_t type;
+	hr.timestamp.sec = strtoll(fields[0], NULL, 10);
+	hr.timestamp.ns = 0;
 
-        if (FAIL == zbx_json_brackets_open(p, &jp_row) ||
-			FAIL == zbx_json_value_by_name(&jp_row, "clock", clck, MAX_ID_LEN, &type) ||
-			FAIL == zbx_json_value_by_name_dyn(&jp_row, "value", &value, &value_alloc, &type ) )
-		{
-			LOG_DBG("Cannot parse row of data (might be ok, but empty): %s", p);
-			continue;
-		}
-		
-	   	if ( 0 == conf->disable_nanoseconds &&
-			 SUCCEED == zbx_json_value_by_name(&jp_row, "ns", ns, MAX_ID_LEN, &type) ) 
-		{
-			hr.timestamp.ns =  strtoll(ns,NULL, 10); 
-		} else 
-			hr.timestamp.ns = 0;
-
-	    hr.timestamp.sec = strtoll( clck,NULL, 10); ;
-		hr.value = history_str2value(value, value_type);
-		zbx_vector_history_record_append_ptr(values, &hr);
-		
-		if (ITEM_VALUE_TYPE_LOG == value_type) {
-			//additionally parsing severity, source and logeventid
-			hr.value.log->logeventid = 0;
-			hr.value.log->severity = TRIGGER_SEVERITY_UNDEFINED;
-			hr.value.log->source = NULL;
-			
-			if (SUCCEED == zbx_json_value_by_name(&jp_row, "logeventid", ns, MAX_ID_LEN, &type)) 
-				hr.value.log->logeventid = strtoll(ns,NULL, 10); 
-			
-			if (SUCCEED == zbx_json_value_by_name(&jp_row, "severity", ns, MAX_ID_LEN, &type)) 
-				hr.value.log->severity = strtoll(ns,NULL, 10); 
-			
-			if (SUCCEED ==  zbx_json_value_by_name(&jp_row, "source", ns, MAX_ID_LEN, &type )) 
-				hr.value.log->source = zbx_strdup(NULL,ns);
-			 
-		//	LOG_INF("Parsed additional LOG data: logeventid: %ld, severity: %d, source: %s",
-		//		hr.value.log->logeventid, hr.value.log->severity,hr.value.log->source );
-		}
+	if ( 0 == ctx->conf->disable_nanoseconds )
+		hr.timestamp.ns = strtoll(fields[fields_num - 1], NULL, 10);
+
+	hr.value = history_str2value(fields[1], ctx->value_type);
+	
+	if (ITEM_VALUE_TYPE_LOG == ctx->value_type) {
+		hr.value.log->source = zbx_strdup(NULL, fields[2]);
+		hr.value.log->severity = strtoll(fields[3], NULL, 10);
+		hr.value.log->logeventid = strtoll(fields[4], NULL, 10);
 	}
-	return SUCCEED;
+
+	zbx_vector_history_record_append_ptr(ctx->values, &hr);
 }
 
 /************************************************************************************
@@ -426,15 +787,14 @@ static int parse_history_get_values(u_int64_t itemid, glb_clickhouse_data_t *con
 static int	clickhouse_get_values(void *data, int value_type, zbx_uint64_t itemid, int start, int count, int end, unsigned char interactive,
 		zbx_vector_history_record_t *values)
 {
-	int valuecount=0;
-
 	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
+	history_values_ctx_t ctx = {.conf = conf, .value_type = value_type, .values = values};
+	int i, values_num = values->values_num;
 
 	static char	*sql_buffer=NULL;
     static size_t buf_alloc = 0, buf_offset;
 
 	buf_offset = 0;
-    char *response;
 
 	LOG_DBG("In %s()", __func__);
 	
@@ -477,17 +837,20 @@ static int	clickhouse_get_values(void *data, int value_type, zbx_uint64_t itemid
 	    zbx_snprintf_alloc(&sql_buffer, &buf_alloc, &buf_offset, "LIMIT %d ", count);
 	}
 
-    zbx_snprintf_alloc(&sql_buffer, &buf_alloc, &buf_offset, "format JSON ");
+    zbx_snprintf_alloc(&sql_buffer, &buf_alloc, &buf_offset, "FORMAT TabSeparated");
 
 	DEBUG_ITEM(itemid, "Executing clickhouse query: %s", sql_buffer);
-	if (SUCCEED != curl_post_request(conf->url, sql_buffer, &response)) {
-		DEBUG_ITEM(itemid, "Query failed");
+	
+	if (SUCCEED != clickhouse_query_tsv(conf, sql_buffer, history_values_row_cb, &ctx)) {
+		DEBUG_ITEM(itemid, "Query failed, dropping %d partially read values", values->values_num - values_num);
+		
+		/* the rows are streamed, so the query might fail after some of them have been added */
+		for (i = values_num; i < values->values_num; i++)
+			zbx_history_record_clear(&values->values[i], value_type);
+
+		values->values_num = values_num;
 	 	return FAIL;
 	}
-    if (SUCCEED != parse_history_get_values(itemid, conf, response, value_type, values)) {
-		DEBUG_ITEM(itemid, "Couldn't parse response %s", response);
-		return FAIL;
-	}
 
 	zbx_vector_history_record_sort(values, (zbx_compare_func_t)zbx_history_record_compare_desc_func);
 	LOG_DBG( "End of %s()", __func__);
@@ -502,62 +865,17 @@ static int	clickhouse_get_values(void *data, int value_type, zbx_uint64_t itemid
  ************************************************************************************/
 static int	get_history_aggregates_json(void *data, int value_type, zbx_uint64_t itemid, int start, int end, int steps, struct zbx_json *json)
 {
-	int valuecount=0;
 	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
-	
-   	static char	*sql_buffer=NULL;
-    static size_t buf_alloc = 0, buf_offset;
-
-	buf_offset = 0;
-	char *response;
-
-    char *table_name=NULL;
+	zbx_vector_uint64_t itemids = {.values = &itemid, .values_num = 1, .values_alloc = 1};
 
 	LOG_DBG("In %s()", __func__);
 	
 	if (0 == conf->read_aggregate_types[value_type])	
 		return SUCCEED;
 	
-	if ( value_type != ITEM_VALUE_TYPE_FLOAT && value_type != ITEM_VALUE_TYPE_UINT64)
-		return FAIL;
-
-	if (end < start || steps <1 ) {
-		LOG_WRN("%s: wrong params requested: start:%d end:%d, aggregates: %ld",__func__,start,end, steps);
-		return FAIL;
-	}
-	
-	if ( value_type != ITEM_VALUE_TYPE_FLOAT && value_type != ITEM_VALUE_TYPE_UINT64 ) {
-		THIS_SHOULD_NEVER_HAPPEN;
-		return FAIL;
-	}
-	
-	table_name=hist_tables[value_type];
-   
-	zbx_snprintf_alloc(&sql_buffer, &buf_alloc, &buf_offset, 
-	"SELECT itemid, \
-		round( multiply((toUnixTimestamp(clock)-%ld), %ld) / %ld ,0) as i,\
-		max(toUnixTimestamp(clock)) as clcck ,\
-		avg(value) as avg, \
-		count(value) as count, \
-		min(value) as min , \
-		max(value) as max \
-	FROM %s.%s h \
-	WHERE clock BETWEEN %ld AND %ld AND \
-	itemid = %ld \
-	GROUP BY itemid, i \
-	ORDER BY i \
-	FORMAT JSON", start, steps, end-start, 
-				conf->dbname, table_name,  start, end, itemid);
-
-	DEBUG_ITEM(itemid, "Executing aggregation query: %s", sql_buffer);
-
-	if (SUCCEED != curl_post_request(conf->url, sql_buffer, &response)) { 
-		DEBUG_ITEM(itemid, "Request failed");
-		return FAIL;
-	}
-    
-	if (SUCCEED != parse_aggregate_responce(itemid, response, json))  {
-		DEBUG_ITEM(itemid, "Couldn't parse response: %s", response);
+	if (SUCCEED != get_history_aggregates_multi(data, value_type, &itemids, start, end, steps, 
+			aggregate_json_row_cb, json)) {
+		DEBUG_ITEM(itemid, "Aggregation request failed");
 		return FAIL;
 	}
 
@@ -578,17 +896,18 @@ static int	get_history_aggregates_json(void *data, int value_type, zbx_uint64_t
 static int	add_history_values(void *data, ZBX_DC_HISTORY *hist, int history_num)
 {
 	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
-	int			i,j;
+	int			i, flags = 0;
 	
-	char *escaped_value=NULL;
-	char *responce;
-
 	ZBX_DC_HISTORY		*h;
 	
-	static glb_clickhouse_buffer_t tbuffer[ITEM_VALUE_TYPE_MAX] = {0};	
-
 	LOG_DBG("In %s()", __func__);
 
+	if ( 0 == conf->disable_nanoseconds ) 
+		flags |= GLB_CLICKHOUSE_FLAG_NS;
+	
+	if ( 0 == conf->disable_host_item_names ) 
+		flags |= GLB_CLICKHOUSE_FLAG_NAMES;
+
 	for (i = 0; i < history_num; i++)
 	{
 		h = (ZBX_DC_HISTORY *)&hist[i];
@@ -605,116 +924,19 @@ static int	add_history_values(void *data, ZBX_DC_HISTORY *hist, int history_num)
 		if (value_type < 0 || value_type >= ITEM_VALUE_TYPE_MAX) {
 			LOG_INF("Wrong value type: %d, internal programming bug", value_type);
 			THIS_SHOULD_NEVER_HAPPEN;
+			continue;
 		}
 	
 		if (0 == conf->write_types[h->value_type])	{
 			zabbix_log(LOG_LEVEL_INFORMATION,"Skipping unsupported value type %d",h->value_type);
 			continue;
 		}
-	
-		if (tbuffer[value_type].num == 0) {
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,"INSERT INTO %s.%s (day,itemid,clock,value", conf->dbname,hist_tables[value_type]); 
-			
-			if (ITEM_VALUE_TYPE_LOG == value_type) {
-				zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",source,severity,logeventid" ); 
-			}
-
-			if ( 0 == conf->disable_nanoseconds ) {
-				zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",ns");
-			}
-	
-			if ( 0 == conf->disable_host_item_names ) {
-				zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",hostname, itemname");
-			}
-
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,") VALUES ");
-		} else  zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",");
-		
-		//common part
-		zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,"(CAST(%d as date) ,%ld,%d",
-				h->ts.sec,h->itemid,h->ts.sec);
-    	
-		switch (h->value_type)
-		{
-		case ITEM_VALUE_TYPE_UINT64:
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",%ld",h->value.ui64);
-    		break;
-		case ITEM_VALUE_TYPE_FLOAT:
-		    zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",%f",h->value.dbl);
-			break;
-		case ITEM_VALUE_TYPE_STR:
-		case ITEM_VALUE_TYPE_TEXT:
-			if (NULL == h->value.str)
-				escaped_value = zbx_strdup(NULL, "");
-			else 
-				escaped_value = zbx_dyn_escape_string(h->value.str, ESCAPE_CHARS);
-
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer, &tbuffer[value_type].alloc, &tbuffer[value_type].offset,", '%s'", escaped_value);
-			zbx_free(escaped_value);
-			break;
-		case ITEM_VALUE_TYPE_LOG:
-			escaped_value=zbx_dyn_escape_string(h->value.log->value, ESCAPE_CHARS);
-		
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",'%s','%s',%d, %ld",
-					escaped_value, h->value.log->source, h->value.log->severity, h->value.log->logeventid);
-			zbx_free(escaped_value);
-		
-			DEBUG_ITEM(h->itemid, "Adding log record with event id %ld, severity %d, source %d itemid %ld", 
-				h->value.log->logeventid, h->value.log->severity, h->value.log->source,	h->itemid);
-			break;
-		default:
-			LOG_WRN("Unknown value type %d", h->value_type);
-			THIS_SHOULD_NEVER_HAPPEN;
-	//		exit(-1);
-			break;
-		}
-
-		if ( 0 == conf->disable_nanoseconds) {
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",%d", h->ts.ns);
-		}
 		
-		if ( 0 == conf->disable_host_item_names ) {
-			char *host_name, *item_key;
-			if ( h->host_name == NULL) 
-				host_name = zbx_strdup(NULL,"");
-			else 
-				host_name = zbx_dyn_escape_string(h->host_name, ESCAPE_CHARS);   
-			
-			if (h->item_key == NULL)	
-				item_key = zbx_strdup(NULL, "");
-			else 
-			    item_key = zbx_dyn_escape_string(h->item_key, ESCAPE_CHARS);   
-			
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",'%s','%s'", host_name, item_key);
-			
-			zbx_free(host_name);
-			zbx_free(item_key);
-		}
-
-		zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,")");
-
-		tbuffer[value_type].num++;
+		clickhouse_format_history(&conf->history_buffers[value_type], conf->write_format, conf->dbname, 
+				hist_tables[value_type], h, flags);
 	}
 	
-	for ( i=0 ; i < ITEM_VALUE_TYPE_MAX; i++ ) {
-		if ( (tbuffer[i].num > GLB_CLICKHOUSE_WRITE_BATCH) || 
-	    	 (tbuffer[i].lastflush + GLB_CLICKHOUSE_FLUSH_TIMEOUT < time(NULL) && tbuffer[i].num > 0 ) )
-		{ 
-			//LOG_INF("Submitting query %s", tbuffer[i].buffer );
-			if (SUCCEED != curl_post_request(conf->url, tbuffer[i].buffer, &responce)) 
-			LOG_WRN("FAILED to flush %d values of type %d to clickhouse", tbuffer[i].num, i);
-
-			tbuffer[i].offset=0;
-			tbuffer[i].num=0;
-			tbuffer[i].lastflush=time(NULL);
-
-			if (tbuffer[i].alloc > MAX_REASONABLE_BUFFER_SIZE) {
-				zbx_free(tbuffer[i].buffer);
-				tbuffer[i].buffer = NULL;
-				tbuffer[i].alloc=0;
-			}
-		}
-	}
+	clickhouse_flush_buffers(conf, conf->history_buffers, "values", 0);
 
 	LOG_DBG("End of %s()", __func__);
 
@@ -737,90 +959,18 @@ static int	add_trend_values(void *data, trend_t *trend)
 	glb_clickhouse_data_t	*conf = (glb_clickhouse_data_t *)data;
 	int		value_type = trend->value_type;
 	
-	static glb_clickhouse_buffer_t tbuffer[ITEM_VALUE_TYPE_MAX] = {0};	
-	char *responce;
-
-	char *host_name, *item_key;	
-	char *precision="%0.4f,";
-
-	//if (0 == trends->values_num ) 
-	//	return SUCCEED;
-    
-	//for (i = 0; i < trends->values_num; i++)
-	//{  
-	//trend_t *trend = trends->values[i];
-	//value_type=trend->value_type;
-		
 	DEBUG_ITEM(trend->itemid, "Got trend data: itemid %ld %s:%s", trend->itemid, trend->host_name, trend->item_key);
-	//LOG_INF("Clickhouse got trend data: itemid %ld %s:%s", trend->itemid, trend->host_name, trend->item_key);
 	
-	//if ( 0 == trend->num ) 
-	//	 	continue;
-
-	if (0 == tbuffer[value_type].num) {
-		zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,
-			"INSERT INTO %s.%s (day, itemid, clock, value_min, value_max, value_avg, count, hostname, itemname) VALUES", 
-			conf->dbname, trend_tables[value_type]);
-	} else {
-		zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,",");
+	if (ITEM_VALUE_TYPE_FLOAT != value_type && ITEM_VALUE_TYPE_UINT64 != value_type) {
+		LOG_INF("Clickhouse export trend: type %d is not supported, itemid %ld", value_type, trend->itemid);
+		THIS_SHOULD_NEVER_HAPPEN;
+		return FAIL;
 	}
 
-	zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,
-		"(CAST(%d as date) ,%ld,%d,", trend->account_hour,trend->itemid,trend->account_hour);
-    	
-	switch (value_type) {
-		
-		case ITEM_VALUE_TYPE_FLOAT:
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer, &tbuffer[value_type].alloc,
-							&tbuffer[value_type].offset,precision,trend->value_min.dbl);
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,
-							&tbuffer[value_type].offset,precision,trend->value_max.dbl);
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,
-							&tbuffer[value_type].offset,precision,trend->value_avg.dbl);
-			break;
-		case ITEM_VALUE_TYPE_UINT64:
-			zbx_snprintf_alloc(&tbuffer[value_type].buffer,&tbuffer[value_type].alloc,&tbuffer[value_type].offset,"%ld,%ld,%ld,",
-		   			trend->value_min.ui64,
-					trend->value_max.ui64,
-					(trend->value_avg.ui64 / trend->num) );
-			break;
-		default:
-			LOG_INF("Clickhouse export trend: type %d is not supported, itemid %ld", value_type, trend->itemid);
-			THIS_SHOULD_NEVER_HAPPEN;
-			break;
-	}	
+	clickhouse_format_trend(&conf->trend_buffers[value_type], conf->write_format, conf->dbname, 
+			trend_tables[value_type], trend);
+	clickhouse_flush_buffers(conf, conf->trend_buffers, "trends", 0);
 	
-	host_name = zbx_dyn_escape_string(trend->host_name, ESCAPE_CHARS);   
-	item_key = zbx_dyn_escape_string(trend->item_key, ESCAPE_CHARS);   
-
-	zbx_snprintf_alloc(&tbuffer[value_type].buffer, &tbuffer[value_type].alloc, &tbuffer[value_type].offset,
-			"%d, '%s','%s')", trend->num, host_name, item_key);
-		
-	zbx_free(host_name);
-	zbx_free(item_key);
-
-    tbuffer[value_type].num++;
-	
-    for (value_type = 0; value_type < ITEM_VALUE_TYPE_MAX; value_type ++ ) {
-		if ((tbuffer[value_type].num > GLB_CLICKHOUSE_WRITE_BATCH || 
-			 tbuffer[value_type].lastflush + GLB_CLICKHOUSE_FLUSH_TIMEOUT < time(NULL)) && 
-			 tbuffer[value_type].num > 0 )
-		{ 
-			if (SUCCEED != curl_post_request(conf->url,tbuffer[value_type].buffer, &responce))
-				LOG_DBG("FAILED to flush %d trends of type %d to clickhouse", tbuffer[value_type].num, value_type);
-				
-			tbuffer[value_type].offset=0;
-			tbuffer[value_type].num=0;
-			tbuffer[value_type].lastflush=time(NULL);
-
-			if (tbuffer[value_type].alloc > MAX_REASONABLE_BUFFER_SIZE) {
-				zbx_free(tbuffer[value_type].buffer);
-				tbuffer[value_type].buffer = NULL;
-				tbuffer[value_type].alloc=0;
-			}
-		}
-	}
-
 	LOG_DBG("End of %s()", __func__);
 	return SUCCEED;
 }
@@ -848,6 +998,7 @@ int	glb_history_clickhouse_init(char *params)
 	char  username[MAX_ID_LEN],password[MAX_ID_LEN],tmp_str[MAX_STRING_LEN];
 	size_t alloc=0,offset=0;
 	zbx_json_type_t type;
+	int idle_timeout;
 
 	conf = (glb_clickhouse_data_t *)zbx_malloc(NULL, sizeof(glb_clickhouse_data_t));
 	memset(conf, 0, sizeof(glb_clickhouse_data_t));
@@ -903,6 +1054,7 @@ int	glb_history_clickhouse_init(char *params)
 	if (glb_types_array_sum(conf->read_aggregate_types) > 0) {
 		zabbix_log(LOG_LEVEL_INFORMATION, "Init clickhouse module: AGGREGATE READ types '%s'",tmp_str);
 		glb_register_callback(GLB_MODULE_API_HISTORY_READ_AGG_JSON,(void (*)(void))get_history_aggregates_json,conf);
+		glb_register_callback(GLB_MODULE_API_HISTORY_READ_AGG_MULTI,(void (*)(void))get_history_aggregates_multi,conf);
 	}
 	
 	if ( (SUCCEED == zbx_json_value_by_name(&jp_config,"enable_trends", tmp_str, MAX_ID_LEN,&type))  &&
@@ -911,6 +1063,7 @@ int	glb_history_clickhouse_init(char *params)
 	} else {
 		glb_register_callback(GLB_MODULE_API_HISTORY_WRITE_TRENDS,(void (*)(void))add_trend_values, conf);
 		glb_register_callback(GLB_MODULE_API_HISTORY_READ_TRENDS_AGG_JSON,(void (*)(void))get_trend_aggregates_json, conf);
+		glb_register_callback(GLB_MODULE_API_HISTORY_READ_TRENDS_AGG_MULTI,(void (*)(void))get_trend_aggregates_multi, conf);
 		glb_register_callback(GLB_MODULE_API_HISTORY_READ_TRENDS_JSON,(void (*)(void))get_trend_values_json, conf);
 	}
 
@@ -923,6 +1076,25 @@ int	glb_history_clickhouse_init(char *params)
 	if (SUCCEED ==zbx_json_value_by_name(&jp_config,"disable_ns", tmp_str, MAX_ID_LEN, &type) ) 
 			conf->disable_nanoseconds = strtol(tmp_str,NULL,10);
 	
+	if (SUCCEED == zbx_json_value_by_name(&jp_config, "write_format", tmp_str, MAX_ID_LEN, &type)) {
+		int format;
+
+		if (FAIL == (format = clickhouse_format_parse(tmp_str))) {
+			LOG_WRN("Unknown clickhouse write_format '%s', supported are 'values' and 'rowbinary'", tmp_str);
+			return FAIL;
+		}
+		conf->write_format = format;
+	}
+	
+	if (SUCCEED == zbx_json_value_by_name(&jp_config, "compression", tmp_str, MAX_ID_LEN, &type)) {
+		if (0 == strcmp(tmp_str, "deflate"))
+			conf->compress_writes = 1;
+		else if (0 != strcmp(tmp_str, "none")) {
+			LOG_WRN("Unknown clickhouse compression '%s', supported are 'none' and 'deflate'", tmp_str);
+			return FAIL;
+		}
+	}
+
 	conf->disable_host_item_names = GLB_DEFAULT_CLICKHOUSE_DISABLE_HOST_ITEMS_NAMES;
 	if (SUCCEED ==zbx_json_value_by_name(&jp_config,"disable_host_item_names", tmp_str, MAX_ID_LEN,&type) ) 
 			conf->disable_host_item_names=strtol(tmp_str,NULL,10);
@@ -932,6 +1104,39 @@ int	glb_history_clickhouse_init(char *params)
 		return FAIL;
 	}
 
+	idle_timeout = GLB_DEFAULT_CLICKHOUSE_CONN_IDLE_TIMEOUT;
+	if (SUCCEED ==zbx_json_value_by_name(&jp_config,"conn_idle_timeout", tmp_str, MAX_ID_LEN,&type) ) {
+		if (SUCCEED != zbx_is_uint_range(tmp_str, &idle_timeout, 0, GLB_MAX_CLICKHOUSE_CONN_IDLE_TIMEOUT)) {
+			LOG_WRN("Wrong clickhouse conn_idle_timeout '%s', should be 0-%d seconds", tmp_str, 
+				GLB_MAX_CLICKHOUSE_CONN_IDLE_TIMEOUT);
+			return FAIL;
+		}
+	}
+
+	conn_pool_init(&conf->conn_pool, idle_timeout);
+
+	if (SUCCEED == zbx_json_value_by_name(&jp_config, "spool_dir", tmp_str, MAX_STRING_LEN, &type)) {
+		size_t len = strlen(tmp_str);
+
+		/* the root directory keeps its only slash */
+		while (1 < len && '/' == tmp_str[len - 1])
+			tmp_str[--len] = '\0';
+
+		if (0 == len) {
+			LOG_WRN("Clickhouse spool_dir is set, but empty");
+			return FAIL;
+		}
+
+		conf->spool_dir = zbx_strdup(NULL, tmp_str);
+		
+		conf->spool_max_files = GLB_DEFAULT_CLICKHOUSE_SPOOL_MAX_FILES;
+		if (SUCCEED == zbx_json_value_by_name(&jp_config, "spool_max_files", tmp_str, MAX_ID_LEN, &type))
+			conf->spool_max_files = strtol(tmp_str, NULL, 10);
+
+		LOG_INF("Init clickhouse module: failed inserts will be spooled to '%s'", conf->spool_dir);
+		spool_reclaim_files(conf);
+	}
+
 	//now, need to setup callbacks for the functions we're involved
 	glb_register_callback(GLB_MODULE_API_DESTROY,(void (*)(void))clickhouse_destroy,conf);
 	
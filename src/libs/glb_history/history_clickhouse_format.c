@@ -0,0 +1,412 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+/* serializers for the clickhouse inserts: the classic SQL VALUES text and RowBinary
+   https://clickhouse.com/docs/en/interfaces/formats#rowbinary 
+   and the incremental reader of the TabSeparated query responses */
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "zbxstr.h"
+#include "zbx_item_constants.h"
+#include "history_clickhouse_format.h"
+
+#define ESCAPE_CHARS "'\\"
+#define SEC_PER_DAY 86400
+
+int clickhouse_format_parse(const char *name) {
+	if (NULL == name || 0 == strcmp(name, "values"))
+		return GLB_CLICKHOUSE_FORMAT_VALUES;
+
+	if (0 == strcasecmp(name, "rowbinary"))
+		return GLB_CLICKHOUSE_FORMAT_ROWBINARY;
+
+	return FAIL;
+}
+
+static void buf_reserve(glb_clickhouse_buffer_t *buf, size_t len) {
+	if (buf->offset + len <= buf->alloc)
+		return;
+
+	while (buf->offset + len > buf->alloc)
+		buf->alloc = (0 == buf->alloc ? ZBX_KIBIBYTE : buf->alloc * 2);
+
+	buf->buffer = zbx_realloc(buf->buffer, buf->alloc);
+}
+
+static void buf_add_raw(glb_clickhouse_buffer_t *buf, const void *data, size_t len) {
+	buf_reserve(buf, len);
+	memcpy(buf->buffer + buf->offset, data, len);
+	buf->offset += len;
+}
+
+static void rb_add_uint16(glb_clickhouse_buffer_t *buf, u_int16_t value) {
+	unsigned char data[2] = { value & 0xff, value >> 8 };
+
+	buf_add_raw(buf, data, sizeof(data));
+}
+
+static void rb_add_uint32(glb_clickhouse_buffer_t *buf, u_int32_t value) {
+	value = zbx_htole_uint32(value);
+	buf_add_raw(buf, &value, sizeof(value));
+}
+
+static void rb_add_uint64(glb_clickhouse_buffer_t *buf, u_int64_t value) {
+	value = zbx_htole_uint64(value);
+	buf_add_raw(buf, &value, sizeof(value));
+}
+
+static void rb_add_double(glb_clickhouse_buffer_t *buf, double value) {
+	u_int64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	rb_add_uint64(buf, bits);
+}
+
+/* strings are LEB128 length followed by the raw bytes, no escaping needed */
+static void rb_add_string(glb_clickhouse_buffer_t *buf, const char *str) {
+	size_t len = (NULL == str ? 0 : strlen(str)), l = len;
+
+	buf_reserve(buf, len + 10);
+
+	do {
+		unsigned char byte = l & 0x7f;
+
+		if (0 != (l >>= 7))
+			byte |= 0x80;
+
+		buf->buffer[buf->offset++] = byte;
+	} while (0 != l);
+
+	if (0 < len)
+		buf_add_raw(buf, str, len);
+}
+
+static void history_add_header(glb_clickhouse_buffer_t *buf, int format, const char *dbname, const char *table,
+		int value_type, int flags) {
+
+	zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, "INSERT INTO %s.%s (day,itemid,clock,value", dbname, table);
+
+	if (ITEM_VALUE_TYPE_LOG == value_type)
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",source,severity,logeventid" );
+
+	if (0 != (flags & GLB_CLICKHOUSE_FLAG_NS))
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",ns");
+
+	if (0 != (flags & GLB_CLICKHOUSE_FLAG_NAMES))
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",hostname, itemname");
+
+	if (GLB_CLICKHOUSE_FORMAT_ROWBINARY == format)
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ") FORMAT RowBinary\n");
+	else
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ") VALUES ");
+}
+
+static void history_add_values_row(glb_clickhouse_buffer_t *buf, const ZBX_DC_HISTORY *h, int flags) {
+	char *escaped_value;
+
+	if (0 < buf->num)
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",");
+
+	zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, "(CAST(%d as date) ,%ld,%d", h->ts.sec, h->itemid, h->ts.sec);
+
+	switch (h->value_type)
+	{
+		case ITEM_VALUE_TYPE_UINT64:
+			zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",%ld", h->value.ui64);
+			break;
+		case ITEM_VALUE_TYPE_FLOAT:
+			zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",%f", h->value.dbl);
+			break;
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			if (NULL == h->value.str)
+				escaped_value = zbx_strdup(NULL, "");
+			else
+				escaped_value = zbx_dyn_escape_string(h->value.str, ESCAPE_CHARS);
+
+			zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ", '%s'", escaped_value);
+			zbx_free(escaped_value);
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			escaped_value = zbx_dyn_escape_string(h->value.log->value, ESCAPE_CHARS);
+
+			zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",'%s','%s',%d, %ld",
+					escaped_value, h->value.log->source, h->value.log->severity, h->value.log->logeventid);
+			zbx_free(escaped_value);
+			break;
+		default:
+			LOG_WRN("Unknown value type %d", h->value_type);
+			THIS_SHOULD_NEVER_HAPPEN;
+			break;
+	}
+
+	if (0 != (flags & GLB_CLICKHOUSE_FLAG_NS))
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",%d", h->ts.ns);
+
+	if (0 != (flags & GLB_CLICKHOUSE_FLAG_NAMES)) {
+		char *host_name, *item_key;
+
+		if ( h->host_name == NULL)
+			host_name = zbx_strdup(NULL,"");
+		else
+			host_name = zbx_dyn_escape_string(h->host_name, ESCAPE_CHARS);
+
+		if (h->item_key == NULL)
+			item_key = zbx_strdup(NULL, "");
+		else
+			item_key = zbx_dyn_escape_string(h->item_key, ESCAPE_CHARS);
+
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",'%s','%s'", host_name, item_key);
+
+		zbx_free(host_name);
+		zbx_free(item_key);
+	}
+
+	zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ")");
+}
+
+static void history_add_rowbinary_row(glb_clickhouse_buffer_t *buf, const ZBX_DC_HISTORY *h, int flags) {
+
+	rb_add_uint16(buf, h->ts.sec / SEC_PER_DAY);
+	rb_add_uint64(buf, h->itemid);
+	rb_add_uint32(buf, h->ts.sec);
+
+	switch (h->value_type)
+	{
+		case ITEM_VALUE_TYPE_UINT64:
+			rb_add_uint64(buf, h->value.ui64);
+			break;
+		case ITEM_VALUE_TYPE_FLOAT:
+			rb_add_double(buf, h->value.dbl);
+			break;
+		case ITEM_VALUE_TYPE_STR:
+		case ITEM_VALUE_TYPE_TEXT:
+			rb_add_string(buf, h->value.str);
+			break;
+		case ITEM_VALUE_TYPE_LOG:
+			rb_add_string(buf, h->value.log->value);
+			rb_add_string(buf, h->value.log->source);
+			rb_add_uint16(buf, (u_int16_t)h->value.log->severity);
+			rb_add_uint64(buf, h->value.log->logeventid);
+			break;
+		default:
+			LOG_WRN("Unknown value type %d", h->value_type);
+			THIS_SHOULD_NEVER_HAPPEN;
+			break;
+	}
+
+	if (0 != (flags & GLB_CLICKHOUSE_FLAG_NS))
+		rb_add_uint32(buf, h->ts.ns);
+
+	if (0 != (flags & GLB_CLICKHOUSE_FLAG_NAMES)) {
+		rb_add_string(buf, h->host_name);
+		rb_add_string(buf, h->item_key);
+	}
+}
+
+/************************************************************************************
+ *                                                                                  *
+ * Purpose: appends history value to the per value type insert buffer, the insert   *
+ *          statement header is written on the first value                         *
+ *                                                                                  *
+ ************************************************************************************/
+void clickhouse_format_history(glb_clickhouse_buffer_t *buf, int format, const char *dbname, const char *table,
+		const ZBX_DC_HISTORY *h, int flags) {
+
+	if (0 == buf->num)
+		history_add_header(buf, format, dbname, table, h->value_type, flags);
+
+	if (GLB_CLICKHOUSE_FORMAT_ROWBINARY == format)
+		history_add_rowbinary_row(buf, h, flags);
+	else
+		history_add_values_row(buf, h, flags);
+
+	buf->num++;
+}
+
+static void trend_add_values_row(glb_clickhouse_buffer_t *buf, const trend_t *trend) {
+	char *host_name, *item_key;
+	char *precision="%0.4f,";
+
+	if (0 < buf->num)
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, ",");
+
+	zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset,
+		"(CAST(%d as date) ,%ld,%d,", trend->account_hour, trend->itemid, trend->account_hour);
+
+	switch (trend->value_type) {
+		case ITEM_VALUE_TYPE_FLOAT:
+			zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, precision, trend->value_min.dbl);
+			zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, precision, trend->value_max.dbl);
+			zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, precision, trend->value_avg.dbl);
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, "%ld,%ld,%ld,",
+					trend->value_min.ui64, trend->value_max.ui64, (trend->value_avg.ui64 / trend->num) );
+			break;
+		default:
+			LOG_INF("Clickhouse export trend: type %d is not supported, itemid %ld", trend->value_type, trend->itemid);
+			THIS_SHOULD_NEVER_HAPPEN;
+			break;
+	}
+
+	host_name = zbx_dyn_escape_string(trend->host_name, ESCAPE_CHARS);
+	item_key = zbx_dyn_escape_string(trend->item_key, ESCAPE_CHARS);
+
+	zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset, "%d, '%s','%s')", trend->num, host_name, item_key);
+
+	zbx_free(host_name);
+	zbx_free(item_key);
+}
+
+static void trend_add_rowbinary_row(glb_clickhouse_buffer_t *buf, const trend_t *trend) {
+	rb_add_uint16(buf, trend->account_hour / SEC_PER_DAY);
+	rb_add_uint64(buf, trend->itemid);
+	rb_add_uint32(buf, trend->account_hour);
+
+	switch (trend->value_type) {
+		case ITEM_VALUE_TYPE_FLOAT:
+			rb_add_double(buf, trend->value_min.dbl);
+			rb_add_double(buf, trend->value_max.dbl);
+			rb_add_double(buf, trend->value_avg.dbl);
+			break;
+		case ITEM_VALUE_TYPE_UINT64:
+			rb_add_uint64(buf, trend->value_min.ui64);
+			rb_add_uint64(buf, trend->value_max.ui64);
+			rb_add_uint64(buf, trend->value_avg.ui64 / trend->num);
+			break;
+		default:
+			LOG_INF("Clickhouse export trend: type %d is not supported, itemid %ld", trend->value_type, trend->itemid);
+			THIS_SHOULD_NEVER_HAPPEN;
+			break;
+	}
+
+	rb_add_uint32(buf, trend->num);
+	rb_add_string(buf, trend->host_name);
+	rb_add_string(buf, trend->item_key);
+}
+
+void clickhouse_format_trend(glb_clickhouse_buffer_t *buf, int format, const char *dbname, const char *table,
+		const trend_t *trend) {
+
+	if (0 == buf->num)
+		zbx_snprintf_alloc(&buf->buffer, &buf->alloc, &buf->offset,
+			"INSERT INTO %s.%s (day, itemid, clock, value_min, value_max, value_avg, count, hostname, itemname) %s",
+			dbname, table, GLB_CLICKHOUSE_FORMAT_ROWBINARY == format ? "FORMAT RowBinary\n" : "VALUES");
+
+	if (GLB_CLICKHOUSE_FORMAT_ROWBINARY == format)
+		trend_add_rowbinary_row(buf, trend);
+	else
+		trend_add_values_row(buf, trend);
+
+	buf->num++;
+}
+
+void clickhouse_tsv_init(clickhouse_tsv_parser_t *parser, clickhouse_tsv_row_cb_t row_cb, void *cb_data) {
+	memset(parser, 0, sizeof(clickhouse_tsv_parser_t));
+	parser->row_cb = row_cb;
+	parser->cb_data = cb_data;
+}
+
+void clickhouse_tsv_clean(clickhouse_tsv_parser_t *parser) {
+	zbx_free(parser->line);
+	parser->line_alloc = 0;
+	parser->line_offset = 0;
+}
+
+/* unescapes the field in place, returns the field end */
+static char *tsv_unescape_field(char *field, char *end) {
+	char *src = field, *dst = field;
+
+	while (src < end) {
+		if ('\\' != *src || src + 1 == end) {
+			*dst++ = *src++;
+			continue;
+		}
+
+		src++;
+
+		switch (*src) {
+			case 'n': *dst++ = '\n'; break;
+			case 't': *dst++ = '\t'; break;
+			case 'r': *dst++ = '\r'; break;
+			case 'b': *dst++ = '\b'; break;
+			case 'f': *dst++ = '\f'; break;
+			case '0': *dst++ = '\0'; break;
+			default: *dst++ = *src; break;
+		}
+		src++;
+	}
+
+	*dst = '\0';
+	return dst;
+}
+
+static void tsv_parse_line(clickhouse_tsv_parser_t *parser, char *line, size_t len) {
+	char *fields[GLB_CLICKHOUSE_TSV_MAX_FIELDS], *p = line, *end = line + len, *tab;
+	int num = 0;
+
+	while (num < GLB_CLICKHOUSE_TSV_MAX_FIELDS) {
+		if (NULL == (tab = memchr(p, '\t', end - p)))
+			tab = end;
+
+		fields[num++] = p;
+		tsv_unescape_field(p, tab);
+
+		if (tab == end)
+			break;
+
+		p = tab + 1;
+	}
+
+	parser->rows++;
+	parser->row_cb(fields, num, parser->cb_data);
+}
+
+void clickhouse_tsv_parse(clickhouse_tsv_parser_t *parser, const char *data, size_t len) {
+	const char *p = data, *end = data + len, *nl;
+
+	while (p < end) {
+		size_t chunk;
+
+		if (NULL == (nl = memchr(p, '\n', end - p))) {
+			zbx_strncpy_alloc(&parser->line, &parser->line_alloc, &parser->line_offset, p, end - p);
+			return;
+		}
+
+		chunk = nl - p;
+
+		/* the whole line is in the data, only copied to have a writable null terminated buffer */
+		if (0 != chunk || 0 != parser->line_offset)
+			zbx_strncpy_alloc(&parser->line, &parser->line_alloc, &parser->line_offset, p, chunk);
+
+		if (0 != parser->line_offset)
+			tsv_parse_line(parser, parser->line, parser->line_offset);
+
+		parser->line_offset = 0;
+		p = nl + 1;
+	}
+}
+
+void clickhouse_tsv_finish(clickhouse_tsv_parser_t *parser) {
+	if (0 != parser->line_offset)
+		tsv_parse_line(parser, parser->line, parser->line_offset);
+
+	parser->line_offset = 0;
+}
@@ -0,0 +1,66 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef GLB_HISTORY_CLICKHOUSE_FORMAT_H
+#define GLB_HISTORY_CLICKHOUSE_FORMAT_H
+
+#include "glb_history.h"
+
+#define GLB_CLICKHOUSE_FORMAT_VALUES	0
+#define GLB_CLICKHOUSE_FORMAT_ROWBINARY	1
+
+#define GLB_CLICKHOUSE_FLAG_NS		1
+#define GLB_CLICKHOUSE_FLAG_NAMES	2
+
+typedef struct {
+	char *buffer;
+	size_t alloc;
+	size_t offset;
+	int lastflush;
+	int num;
+}
+glb_clickhouse_buffer_t;
+
+int	clickhouse_format_parse(const char *name);
+
+void	clickhouse_format_history(glb_clickhouse_buffer_t *buf, int format, const char *dbname, const char *table,
+		const ZBX_DC_HISTORY *h, int flags);
+void	clickhouse_format_trend(glb_clickhouse_buffer_t *buf, int format, const char *dbname, const char *table,
+		const trend_t *trend);
+
+#define GLB_CLICKHOUSE_TSV_MAX_FIELDS	16
+
+typedef void (*clickhouse_tsv_row_cb_t)(char **fields, int fields_num, void *cb_data);
+
+/* keeps only the current incomplete line between the chunks */
+typedef struct {
+	char	*line;
+	size_t	line_alloc;
+	size_t	line_offset;
+	int	rows;
+	clickhouse_tsv_row_cb_t row_cb;
+	void	*cb_data;
+}
+clickhouse_tsv_parser_t;
+
+void	clickhouse_tsv_init(clickhouse_tsv_parser_t *parser, clickhouse_tsv_row_cb_t row_cb, void *cb_data);
+void	clickhouse_tsv_parse(clickhouse_tsv_parser_t *parser, const char *data, size_t len);
+void	clickhouse_tsv_finish(clickhouse_tsv_parser_t *parser);
+void	clickhouse_tsv_clean(clickhouse_tsv_parser_t *parser);
+
+#endif
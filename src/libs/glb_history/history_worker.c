@@ -272,6 +272,113 @@ static int	worker_get_agg_json(void *data, int value_type, zbx_uint64_t itemid,
 	return SUCCEED;
 }
 
+/************************************************************************************
+ *                                                                                  *
+ * Function: worker_get_agg_multi                                                   *
+ *                                                                                  *
+ * Purpose: gets aggregated history of several items with one worker request,      *
+ *          the worker is expected to return "itemid" in each of "aggmetrics" rows  *
+ *          in any order, the rows are passed to row_cb grouped by item             *
+ *                                                                                  *
+ ************************************************************************************/
+static int	worker_get_agg_multi(void *data, int value_type, zbx_vector_uint64_t *itemids, int start, int end, int aggregates,
+		glb_history_agg_row_cb_t row_cb, void *cb_data)
+{
+	zbx_worker_data_t	*conf = (zbx_worker_data_t *)data;
+	char *response = NULL;
+	struct zbx_json_parse	jp, jp_data;
+	struct zbx_json request;
+	const char		*p = NULL;
+	zbx_json_type_t type;
+	zbx_vector_uint64_pair_t rows;
+	int i;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "Start %s()", __func__);
+
+	if (0 == conf->read_agg_types[value_type])	
+		return FAIL;
+
+	zbx_json_init(&request, ZBX_JSON_STAT_BUF_LEN);
+	zbx_json_addstring(&request, "request", "get_agg_multi", ZBX_JSON_TYPE_STRING);
+	zbx_json_addint64(&request, "value_type", value_type);
+	zbx_json_addint64(&request, "start", start);
+	zbx_json_addint64(&request, "count", aggregates);
+	zbx_json_addint64(&request, "end", end);
+	zbx_json_addarray(&request, "itemids");
+	
+	for (i = 0; i < itemids->values_num; i++)
+		zbx_json_adduint64(&request, NULL, itemids->values[i]);
+	
+	zbx_json_close(&request);
+
+	if (SUCCEED != glb_process_worker_request(conf->worker, request.buffer, &response)) {
+		zabbix_log(LOG_LEVEL_INFORMATION,"Failed to get info from worker");
+		zbx_json_free(&request);
+		return FAIL;
+	}
+	
+	zbx_json_free(&request);
+
+	if (SUCCEED != zbx_json_open(response, &jp) || 
+		SUCCEED != zbx_json_brackets_by_name(&jp, "aggmetrics", &jp_data)) {
+		LOG_DBG("Couldn't find data section in the worker %s  responce %s:",worker_get_path(conf->worker), response);
+		zbx_free(response);
+		return FAIL;
+	}
+    
+	zbx_vector_uint64_pair_create(&rows);
+
+	/* rows are ordered by the item and then by their place in the response */
+	while (NULL != (p = zbx_json_next(&jp_data, p)))
+	{
+		char itemid[MAX_ID_LEN];
+		struct zbx_json_parse	jp_row;
+		zbx_uint64_pair_t row = {.second = p - response};
+
+		if (SUCCEED != zbx_json_brackets_open(p, &jp_row) ||
+			SUCCEED != zbx_json_value_by_name(&jp_row, "itemid", itemid, MAX_ID_LEN, &type) ||
+			SUCCEED != zbx_is_uint64(itemid, &row.first)) {
+			zabbix_log(LOG_LEVEL_DEBUG,"Couldn't parse JSON row: %s",p);
+			continue;
+		}
+
+		zbx_vector_uint64_pair_append(&rows, row);
+	}
+
+	zbx_vector_uint64_pair_sort(&rows, ZBX_DEFAULT_UINT64_PAIR_COMPARE_FUNC);
+
+	for (i = 0; i < rows.values_num; i++)
+	{
+		char clck[MAX_ID_LEN], min_value[MAX_ID_LEN], max_value[MAX_ID_LEN], 
+			avg_value[MAX_ID_LEN], idx[MAX_ID_LEN], count[MAX_ID_LEN];
+		struct zbx_json_parse	jp_row;
+		
+		p = response + rows.values[i].second;
+
+		if (SUCCEED == zbx_json_brackets_open(p, &jp_row) &&
+			SUCCEED == zbx_json_value_by_name(&jp_row, "clock", clck, MAX_ID_LEN, &type) &&
+			SUCCEED == zbx_json_value_by_name(&jp_row, "count", count, MAX_ID_LEN, &type) &&
+			SUCCEED == zbx_json_value_by_name(&jp_row, "max", max_value, MAX_ID_LEN, &type) && 
+			SUCCEED == zbx_json_value_by_name(&jp_row, "avg", avg_value, MAX_ID_LEN, &type) && 
+			SUCCEED == zbx_json_value_by_name(&jp_row, "min", min_value, MAX_ID_LEN, &type) && 
+			SUCCEED == zbx_json_value_by_name(&jp_row, "i", idx, MAX_ID_LEN, &type))
+		{
+			glb_history_agg_row_t row = {.itemid = rows.values[i].first, .clock = clck, .i = idx,
+					.count = count, .min = min_value, .max = max_value, .avg = avg_value};
+
+			row_cb(&row, cb_data);
+		} else {
+			zabbix_log(LOG_LEVEL_DEBUG,"Couldn't parse JSON row: %s",p);
+		}
+	}
+	
+	zbx_vector_uint64_pair_destroy(&rows);
+	zbx_free(response);
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+	return SUCCEED;
+}
+
 /************************************************************************************
  *                                                                                  *
  * Function: worker_get_values                                                     *
@@ -723,6 +830,7 @@ int	glb_history_worker_init(char *params)
 	if (glb_types_array_sum(conf->read_agg_types) > 0) {
 		zabbix_log(LOG_LEVEL_INFORMATION, "Init worker module: read agg types '%s'",tmp_str);
 		glb_register_callback(GLB_MODULE_API_HISTORY_READ_AGG_JSON,(void (*)(void))worker_get_agg_json,conf);
+		glb_register_callback(GLB_MODULE_API_HISTORY_READ_AGG_MULTI,(void (*)(void))worker_get_agg_multi,conf);
 	}
 
 	conf->preload_values=GLB_DEFAULT_WORKER_PRELOAD_VALUES;
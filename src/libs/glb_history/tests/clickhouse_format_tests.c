@@ -0,0 +1,166 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "zbxtime.h"
+#include "zbxcompress.h"
+#include "zbxstr.h"
+#include "zbx_item_constants.h"
+#include "../history_clickhouse_format.h"
+
+#define BENCH_VALUES 1000000
+
+static void test_rowbinary_encoding() {
+    glb_clickhouse_buffer_t buf = {0};
+    ZBX_DC_HISTORY h = {.itemid = 0x0102030405060708, .value_type = ITEM_VALUE_TYPE_STR, 
+            .ts = {.sec = 86400 * 3 + 5, .ns = 7}, .host_name = "host", .item_key = NULL};
+    const char *header = "INSERT INTO glaber.history_str (day,itemid,clock,value,ns,hostname, itemname) FORMAT RowBinary\n";
+    const unsigned char row[] = { 3, 0, 
+            8, 7, 6, 5, 4, 3, 2, 1, 
+            0x85, 0xf4, 0x03, 0, 
+            3, 'a', '\'', 'c', 
+            7, 0, 0, 0, 
+            4, 'h', 'o', 's', 't', 
+            0 };
+
+    h.value.str = "a'c";
+    
+    clickhouse_format_history(&buf, GLB_CLICKHOUSE_FORMAT_ROWBINARY, "glaber", "history_str", &h, 
+        GLB_CLICKHOUSE_FLAG_NS | GLB_CLICKHOUSE_FLAG_NAMES);
+    
+    assert(1 == buf.num);
+    assert(buf.offset == strlen(header) + sizeof(row) && "Row should have exact binary size");
+    assert(0 == memcmp(buf.buffer, header, strlen(header)));
+    assert(0 == memcmp(buf.buffer + strlen(header), row, sizeof(row)) && "Row should be little endian with varint strings");
+
+    zbx_free(buf.buffer);
+}
+
+typedef struct {
+    int rows;
+    int fields;
+    char last[64];
+} tsv_test_ctx_t;
+
+static void tsv_test_row_cb(char **fields, int fields_num, void *cb_data) {
+    tsv_test_ctx_t *ctx = cb_data;
+
+    ctx->rows++;
+    ctx->fields += fields_num;
+    zbx_strlcpy(ctx->last, fields[fields_num - 1], sizeof(ctx->last));
+}
+
+/* the response is fed by every possible split to make sure rows crossing chunk boundaries are kept */
+static void test_tsv_chunked_parsing() {
+    const char *resp = "1700000000\t1.5\t7\n1700000001\ta\\tb\\\\c\t8\n1700000002\tlast\t9";
+    size_t len = strlen(resp), split;
+
+    for (split = 0; split <= len; split++) {
+        clickhouse_tsv_parser_t parser;
+        tsv_test_ctx_t ctx = {0};
+
+        clickhouse_tsv_init(&parser, tsv_test_row_cb, &ctx);
+        clickhouse_tsv_parse(&parser, resp, split);
+        clickhouse_tsv_parse(&parser, resp + split, len - split);
+        clickhouse_tsv_finish(&parser);
+        clickhouse_tsv_clean(&parser);
+
+        assert(3 == ctx.rows && "All rows should be parsed regardless of the split");
+        assert(9 == ctx.fields);
+        assert(0 == strcmp(ctx.last, "9"));
+    }
+}
+
+static void tsv_test_escape_cb(char **fields, int fields_num, void *cb_data) {
+    assert(3 == fields_num);
+    assert(0 == strcmp(fields[1], "a\tb\\c") && "Escaped tab and backslash should be unescaped");
+    (*(int *)cb_data)++;
+}
+
+static void test_tsv_unescape() {
+    const char *resp = "1\ta\\tb\\\\c\t2\n";
+    clickhouse_tsv_parser_t parser;
+    int rows = 0;
+
+    clickhouse_tsv_init(&parser, tsv_test_escape_cb, &rows);
+    clickhouse_tsv_parse(&parser, resp, strlen(resp));
+    clickhouse_tsv_finish(&parser);
+    clickhouse_tsv_clean(&parser);
+
+    assert(1 == rows);
+}
+
+#ifdef HAVE_GLB_BENCHMARKS
+static void bench_format(int format, const char *name, int value_type) {
+    glb_clickhouse_buffer_t buf = {0};
+    ZBX_DC_HISTORY h = {.value_type = value_type, .host_name = "some.host.name", .item_key = "net.if.in[eth0]"};
+    char *compressed = NULL;
+    size_t compressed_size = 0;
+    double start;
+    int i;
+
+    start = zbx_time();
+    
+    for (i = 0; i < BENCH_VALUES; i++) {
+        h.itemid = 100000 + i % 10000;
+        h.ts.sec = 1700000000 + i / 10000;
+        h.ts.ns = i;
+        
+        if (ITEM_VALUE_TYPE_FLOAT == value_type)
+            h.value.dbl = i * 1.37;
+        else 
+            h.value.ui64 = i * 137;
+
+        clickhouse_format_history(&buf, format, "glaber", "history", &h, 
+                GLB_CLICKHOUSE_FLAG_NS | GLB_CLICKHOUSE_FLAG_NAMES);
+    }
+    
+    LOG_INF("Clickhouse %s format, value type %d: %d values in %f sec, %zu bytes", name, value_type, 
+            BENCH_VALUES, zbx_time() - start, buf.offset);
+
+    start = zbx_time();
+    
+    if (SUCCEED == zbx_compress(buf.buffer, buf.offset, &compressed, &compressed_size))
+        LOG_INF("Clickhouse %s format: deflated to %zu bytes in %f sec", name, compressed_size, zbx_time() - start);
+    
+    zbx_free(compressed);
+    zbx_free(buf.buffer);
+}
+#endif
+
+void glb_history_clickhouse_format_run_tests(void) {
+    LOG_INF("Starting clickhouse format tests");
+    test_rowbinary_encoding();
+    test_tsv_chunked_parsing();
+    test_tsv_unescape();
+
+#ifdef HAVE_GLB_BENCHMARKS
+    bench_format(GLB_CLICKHOUSE_FORMAT_VALUES, "values", ITEM_VALUE_TYPE_FLOAT);
+    bench_format(GLB_CLICKHOUSE_FORMAT_ROWBINARY, "rowbinary", ITEM_VALUE_TYPE_FLOAT);
+    bench_format(GLB_CLICKHOUSE_FORMAT_VALUES, "values", ITEM_VALUE_TYPE_UINT64);
+    bench_format(GLB_CLICKHOUSE_FORMAT_ROWBINARY, "rowbinary", ITEM_VALUE_TYPE_UINT64);
+#endif
+    
+    LOG_INF("Clickhouse format tests are finished");
+}
+
+#endif
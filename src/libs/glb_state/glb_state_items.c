@@ -33,6 +33,7 @@
 #include "../../zabbix_server/glb_poller/internal.h"
 
 extern char	*CONFIG_VCDUMP_LOCATION;
+extern int	CONFIG_VALUECACHE_COMPRESS;
 
 typedef struct
 {
@@ -55,11 +56,42 @@ typedef struct {
     int errcode;
 } glb_state_item_meta_t;
 
+/* monotonic deque of the tsbuff indexes, kept as a ring of the buffer size */
+typedef struct
+{
+    int *idx;
+    int first;
+    int num;
+} item_window_deque_t;
+
+/* sliding time window aggregates of a numeric item, updated as the values arrive;
+   the window holds the same values as the time range request at win_time does:
+   the newest value not newer than win_time - seconds and all the newer ones */
+typedef struct
+{
+    int seconds;
+    int win_time;
+    int last_read;
+    int buff_size; /* size of the buffer the indexes belong to, 0 if the window is invalid */
+    int deque_size;
+    int tail_idx;  /* expiry cursor, the oldest value of the window */
+    int count;
+    int removed;   /* values expired since the sums were calculated from scratch */
+    double dbl_sum;
+    zbx_uint64_t ui64_sum;
+    item_window_deque_t min;
+    item_window_deque_t max;
+} item_window_t;
+
 typedef struct
 {
     glb_state_item_meta_t meta;
     glb_tsbuff_t tsbuff;
     item_demand_t demand;
+    item_window_t *windows;
+    int windows_num;
+    glb_tsblock_t **blocks; /* sealed compressed values older than the tsbuff tail, the oldest first */
+    int blocks_num;
 
     unsigned char value_type;
     int last_accessed;
@@ -92,6 +124,7 @@ typedef struct
     int ts_head;
     int seconds;
     zbx_vector_history_record_t *values;
+    glb_state_item_agg_t *agg;
 } fetch_req_t;
 
 typedef struct {
@@ -123,6 +156,465 @@ typedef struct {
 #define GLB_CACHE_DEFAULT_DURATION 2 * 86400 //by default we downloading two days worth of data
                                             //however if duration is set, this might be bigger
 #define GLB_CACHE_ITEM_DEMAND_UPDATE 86400
+#define GLB_CACHE_ITEM_MAX_WINDOWS 4
+
+static glb_state_item_value_t *window_value(item_elem_t *elm, int idx)
+{
+    return (glb_state_item_value_t *)glb_tsbuff_get_value_ptr(&elm->tsbuff, idx);
+}
+
+/* position of the value counting from the oldest one in the buffer */
+static int window_pos(item_elem_t *elm, int idx)
+{
+    return (idx - elm->tsbuff.tail + elm->tsbuff.size) % elm->tsbuff.size;
+}
+
+/* the time search returns any of the values of the found second, the time ranges
+   start at the first value of the second and end at the last one */
+static int items_find_time_tail_idx(item_elem_t *elm, int time)
+{
+    int idx, prev;
+
+    if (-1 == (idx = glb_tsbuff_find_time_idx(&elm->tsbuff, time)))
+        return -1;
+
+    while (idx != elm->tsbuff.tail && window_value(elm, prev = glb_tsbuff_index(&elm->tsbuff, idx - 1))->time_sec ==
+            window_value(elm, idx)->time_sec)
+        idx = prev;
+
+    return idx;
+}
+
+static int items_find_time_head_idx(item_elem_t *elm, int time)
+{
+    int idx, next;
+
+    if (-1 == (idx = glb_tsbuff_find_time_idx(&elm->tsbuff, time)))
+        return -1;
+
+    while (idx != elm->tsbuff.head && window_value(elm, next = glb_tsbuff_index(&elm->tsbuff, idx + 1))->time_sec ==
+            window_value(elm, idx)->time_sec)
+        idx = next;
+
+    return idx;
+}
+
+static int window_value_cmp(item_elem_t *elm, int idx1, int idx2)
+{
+    glb_state_item_value_t *v1 = window_value(elm, idx1), *v2 = window_value(elm, idx2);
+
+    if (ITEM_VALUE_TYPE_FLOAT == elm->value_type)
+    {
+        ZBX_RETURN_IF_NOT_EQUAL(v1->value.data.dbl, v2->value.data.dbl);
+        return 0;
+    }
+
+    ZBX_RETURN_IF_NOT_EQUAL(v1->value.data.ui64, v2->value.data.ui64);
+    return 0;
+}
+
+/* drops the values from the back which will never be the min(max) while the new value is in the window */
+static void window_deque_push(item_elem_t *elm, item_window_deque_t *dq, int idx, int sign)
+{
+    int size = elm->tsbuff.size;
+
+    while (0 < dq->num && 0 <= sign * window_value_cmp(elm, idx, dq->idx[(dq->first + dq->num - 1) % size]))
+        dq->num--;
+
+    dq->idx[(dq->first + dq->num) % size] = idx;
+    dq->num++;
+}
+
+static void window_deque_expire(item_elem_t *elm, item_window_deque_t *dq, int tail_pos)
+{
+    while (0 < dq->num && window_pos(elm, dq->idx[dq->first]) < tail_pos)
+    {
+        dq->first = (dq->first + 1) % elm->tsbuff.size;
+        dq->num--;
+    }
+}
+
+static void window_add_value(item_elem_t *elm, item_window_t *win, int idx)
+{
+    glb_state_item_value_t *c_val = window_value(elm, idx);
+
+    if (ITEM_VALUE_TYPE_FLOAT == elm->value_type)
+        win->dbl_sum += c_val->value.data.dbl;
+    else
+    {
+        win->ui64_sum += c_val->value.data.ui64;
+        win->dbl_sum += (double)c_val->value.data.ui64;
+    }
+
+    win->count++;
+    window_deque_push(elm, &win->min, idx, -1);
+    window_deque_push(elm, &win->max, idx, 1);
+}
+
+/* the sums are recalculated once the window has been renewed, so the float rounding errors don't pile up */
+static void window_calc_sums(item_elem_t *elm, item_window_t *win)
+{
+    int i = win->tail_idx;
+
+    win->dbl_sum = 0;
+    win->ui64_sum = 0;
+    win->removed = 0;
+
+    while (1)
+    {
+        glb_state_item_value_t *c_val = window_value(elm, i);
+
+        if (ITEM_VALUE_TYPE_FLOAT == elm->value_type)
+            win->dbl_sum += c_val->value.data.dbl;
+        else
+        {
+            win->ui64_sum += c_val->value.data.ui64;
+            win->dbl_sum += (double)c_val->value.data.ui64;
+        }
+
+        if (i == elm->tsbuff.head)
+            break;
+
+        i = glb_tsbuff_index(&elm->tsbuff, i + 1);
+    }
+}
+
+static void window_advance(item_elem_t *elm, item_window_t *win, int win_time)
+{
+    int i, tail_idx;
+
+    if (win_time <= win->win_time)
+        return;
+
+    win->win_time = win_time;
+
+    /* the new tail is the first of the values of the newest second not newer than the window start */
+    for (i = tail_idx = win->tail_idx; i != elm->tsbuff.head;)
+    {
+        i = glb_tsbuff_index(&elm->tsbuff, i + 1);
+
+        if (window_value(elm, i)->time_sec > win_time - win->seconds)
+            break;
+
+        if (window_value(elm, i)->time_sec != window_value(elm, tail_idx)->time_sec)
+            tail_idx = i;
+    }
+
+    while (win->tail_idx != tail_idx)
+    {
+        glb_state_item_value_t *c_val = window_value(elm, win->tail_idx);
+
+        if (ITEM_VALUE_TYPE_FLOAT == elm->value_type)
+            win->dbl_sum -= c_val->value.data.dbl;
+        else
+        {
+            win->ui64_sum -= c_val->value.data.ui64;
+            win->dbl_sum -= (double)c_val->value.data.ui64;
+        }
+
+        win->count--;
+        win->removed++;
+        win->tail_idx = glb_tsbuff_index(&elm->tsbuff, win->tail_idx + 1);
+    }
+
+    window_deque_expire(elm, &win->min, window_pos(elm, win->tail_idx));
+    window_deque_expire(elm, &win->max, window_pos(elm, win->tail_idx));
+
+    if (win->removed >= win->count)
+        window_calc_sums(elm, win);
+}
+
+static int window_is_valid(item_elem_t *elm, item_window_t *win)
+{
+    if (0 == win->buff_size || win->buff_size != glb_tsbuff_get_size(&elm->tsbuff) ||
+        window_pos(elm, win->tail_idx) >= glb_tsbuff_get_count(&elm->tsbuff))
+        return FAIL;
+
+    return SUCCEED;
+}
+
+static void window_free_deques(item_window_t *win)
+{
+    if (NULL != win->min.idx)
+        state->memf.free_func(win->min.idx);
+
+    if (NULL != win->max.idx)
+        state->memf.free_func(win->max.idx);
+
+    win->min.idx = win->max.idx = NULL;
+    win->deque_size = 0;
+}
+
+/* calculates the window at win_time from scratch */
+static int window_build(item_elem_t *elm, item_window_t *win, int win_time)
+{
+    int i, size = glb_tsbuff_get_size(&elm->tsbuff);
+
+    win->buff_size = 0;
+
+    if (0 == glb_tsbuff_get_count(&elm->tsbuff) || win_time < glb_tsbuff_get_time_head(&elm->tsbuff) ||
+        -1 == (win->tail_idx = items_find_time_tail_idx(elm, win_time - win->seconds)))
+        return FAIL;
+
+    if (win->deque_size != size)
+    {
+        window_free_deques(win);
+
+        if (NULL == (win->min.idx = state->memf.malloc_func(NULL, sizeof(int) * size)) ||
+            NULL == (win->max.idx = state->memf.malloc_func(NULL, sizeof(int) * size)))
+        {
+            window_free_deques(win);
+            return FAIL;
+        }
+
+        win->deque_size = size;
+    }
+
+    win->min.first = win->min.num = 0;
+    win->max.first = win->max.num = 0;
+    win->count = 0;
+    win->win_time = win_time;
+
+    for (i = win->tail_idx;; i = glb_tsbuff_index(&elm->tsbuff, i + 1))
+    {
+        window_add_value(elm, win, i);
+
+        if (i == elm->tsbuff.head)
+            break;
+    }
+
+    window_calc_sums(elm, win);
+    win->buff_size = size;
+
+    return SUCCEED;
+}
+
+static void items_windows_free(item_elem_t *elm)
+{
+    int i;
+
+    for (i = 0; i < elm->windows_num; i++)
+        window_free_deques(&elm->windows[i]);
+
+    if (NULL != elm->windows)
+        state->memf.free_func(elm->windows);
+
+    elm->windows = NULL;
+    elm->windows_num = 0;
+}
+
+/* invalidates the windows which have lost their values, must be called after values are freed or moved */
+static void items_windows_check(item_elem_t *elm)
+{
+    int i;
+
+    for (i = 0; i < elm->windows_num; i++)
+    {
+        if (SUCCEED != window_is_valid(elm, &elm->windows[i]))
+            elm->windows[i].buff_size = 0;
+    }
+}
+
+/* updates the windows with the new head value, the windows not read for a day are dropped */
+static void items_windows_add_value(item_elem_t *elm, int now)
+{
+    int i;
+
+    for (i = 0; i < elm->windows_num; i++)
+    {
+        item_window_t *win = &elm->windows[i];
+
+        if (win->last_read < now - GLB_CACHE_ITEM_DEMAND_UPDATE)
+        {
+            window_free_deques(win);
+            *win = elm->windows[--elm->windows_num];
+            i--;
+            continue;
+        }
+
+        if (SUCCEED != window_is_valid(elm, win))
+        {
+            win->buff_size = 0;
+            continue;
+        }
+
+        window_add_value(elm, win, elm->tsbuff.head);
+        window_advance(elm, win, glb_tsbuff_get_time_head(&elm->tsbuff));
+    }
+}
+
+static item_window_t *items_windows_find(item_elem_t *elm, int seconds)
+{
+    int i;
+
+    for (i = 0; i < elm->windows_num; i++)
+    {
+        if (elm->windows[i].seconds == seconds)
+            return &elm->windows[i];
+    }
+
+    return NULL;
+}
+
+/* older values of numeric items might be sealed to compressed blocks, the newest
+   GLB_TSBLOCK_MAX_VALUES values at least are always kept in the tsbuff as is */
+static int items_blocks_enabled(item_elem_t *elm)
+{
+    if (0 == CONFIG_VALUECACHE_COMPRESS)
+        return FAIL;
+
+    if (ITEM_VALUE_TYPE_FLOAT != elm->value_type && ITEM_VALUE_TYPE_UINT64 != elm->value_type)
+        return FAIL;
+
+    return SUCCEED;
+}
+
+static int items_blocks_count(item_elem_t *elm)
+{
+    int i, count = 0;
+
+    for (i = 0; i < elm->blocks_num; i++)
+        count += elm->blocks[i]->count;
+
+    return count;
+}
+
+/* the oldest value time of the item, -1 if there are no values */
+static int items_get_time_tail(item_elem_t *elm)
+{
+    if (0 < elm->blocks_num)
+        return elm->blocks[0]->first_time;
+
+    if (0 < glb_tsbuff_get_count(&elm->tsbuff))
+        return glb_tsbuff_get_time_tail(&elm->tsbuff);
+
+    return -1;
+}
+
+static void block_value_to_cache(glb_state_item_value_t *c_val, glb_tsbuff_value_t *b_val, unsigned char value_type)
+{
+    c_val->time_sec = b_val->sec;
+
+    if (ITEM_VALUE_TYPE_FLOAT == value_type)
+    {
+        c_val->value.type = ZBX_VARIANT_DBL;
+        memcpy(&c_val->value.data.dbl, &b_val->value, sizeof(double));
+    }
+    else
+    {
+        c_val->value.type = ZBX_VARIANT_UI64;
+        c_val->value.data.ui64 = b_val->value;
+    }
+}
+
+static int items_blocks_insert(item_elem_t *elm, glb_tsblock_t *block, int pos)
+{
+    glb_tsblock_t **blocks;
+
+    if (NULL == (blocks = state->memf.realloc_func(elm->blocks, sizeof(glb_tsblock_t *) * (elm->blocks_num + 1))))
+    {
+        glb_tsblock_destroy(block, state->memf.free_func);
+        return FAIL;
+    }
+
+    memmove(&blocks[pos + 1], &blocks[pos], sizeof(glb_tsblock_t *) * (elm->blocks_num - pos));
+    blocks[pos] = block;
+
+    elm->blocks = blocks;
+    elm->blocks_num++;
+
+    return SUCCEED;
+}
+
+static void items_blocks_free_oldest(item_elem_t *elm)
+{
+    glb_tsblock_destroy(elm->blocks[0], state->memf.free_func);
+
+    if (0 == --elm->blocks_num)
+    {
+        state->memf.free_func(elm->blocks);
+        elm->blocks = NULL;
+        return;
+    }
+
+    memmove(&elm->blocks[0], &elm->blocks[1], sizeof(glb_tsblock_t *) * elm->blocks_num);
+}
+
+static void items_blocks_free(item_elem_t *elm)
+{
+    while (0 < elm->blocks_num)
+        items_blocks_free_oldest(elm);
+}
+
+/* moves the oldest tsbuff values to a new compressed block */
+static int items_blocks_seal_tail(item_elem_t *elm)
+{
+    glb_tsbuff_value_t values[GLB_TSBLOCK_MAX_VALUES];
+    glb_tsblock_t *block;
+    int i;
+
+    for (i = 0; i < GLB_TSBLOCK_MAX_VALUES; i++)
+    {
+        glb_state_item_value_t *c_val = glb_tsbuff_get_value_ptr(&elm->tsbuff,
+                glb_tsbuff_index(&elm->tsbuff, elm->tsbuff.tail + i));
+
+        values[i].sec = c_val->time_sec;
+
+        if (ITEM_VALUE_TYPE_FLOAT == elm->value_type)
+            memcpy(&values[i].value, &c_val->value.data.dbl, sizeof(double));
+        else
+            values[i].value = c_val->value.data.ui64;
+    }
+
+    if (NULL == (block = glb_tsblock_create(values, GLB_TSBLOCK_MAX_VALUES, state->memf.malloc_func)) ||
+        SUCCEED != items_blocks_insert(elm, block, elm->blocks_num))
+        return FAIL;
+
+    for (i = 0; i < GLB_TSBLOCK_MAX_VALUES; i++)
+        glb_tsbuff_free_tail(&elm->tsbuff);
+
+    items_windows_check(elm);
+
+    return SUCCEED;
+}
+
+/* seals the history values older than the item's values to blocks, history values are sorted
+   from the newest to the oldest, returns number of values added */
+static int items_blocks_add_history(item_elem_t *elm, zbx_vector_history_record_t *history, int from)
+{
+    glb_tsbuff_value_t values[GLB_TSBLOCK_MAX_VALUES];
+    glb_tsblock_t *block;
+    int i, j, num, added = 0, tail_time = items_get_time_tail(elm);
+
+    while (from < history->values_num && -1 != tail_time && history->values[from].timestamp.sec >= tail_time)
+        from++;
+
+    /* the newest values are sealed first so that only the oldest block might be incomplete */
+    for (i = from; i < history->values_num; i += num)
+    {
+        num = MIN(GLB_TSBLOCK_MAX_VALUES, history->values_num - i);
+
+        for (j = 0; j < num; j++)
+        {
+            zbx_history_record_t *record = &history->values[i + num - 1 - j];
+
+            values[j].sec = record->timestamp.sec;
+
+            if (ITEM_VALUE_TYPE_FLOAT == elm->value_type)
+                memcpy(&values[j].value, &record->value.dbl, sizeof(double));
+            else
+                values[j].value = record->value.ui64;
+        }
+
+        if (NULL == (block = glb_tsblock_create(values, num, state->memf.malloc_func)) ||
+            SUCCEED != items_blocks_insert(elm, block, 0))
+            break;
+
+        added += num;
+    }
+
+    return added;
+}
 
 ELEMS_CREATE(item_create_cb)
 {
@@ -175,6 +667,8 @@ ELEMS_FREE(item_free_cb) {
         glb_tsbuff_free_tail(&elm->tsbuff);
     }
 
+    items_windows_free(elm);
+    items_blocks_free(elm);
     glb_tsbuff_destroy(&elm->tsbuff, memf->free_func);
     return SUCCEED;
 }
@@ -268,6 +762,90 @@ static int glb_state_value_to_hist_copy(zbx_history_record_t *record,
     record->timestamp.sec = c_val->time_sec;
 }
 
+static void agg_reset(glb_state_item_agg_t *agg)
+{
+    agg->count = 0;
+    agg->first_sec = 0;
+    agg->last_sec = 0;
+    agg->avg = 0;
+
+    if (NULL != agg->dbl_values)
+        zbx_vector_dbl_clear(agg->dbl_values);
+
+    if (NULL != agg->ui64_values)
+        zbx_vector_uint64_clear(agg->ui64_values);
+}
+
+/******************************************************
+ * Folds the cached value into the aggregates, values *
+ * are expected to go from the oldest to the newest   *
+ * ***************************************************/
+static void agg_add_value(glb_state_item_agg_t *agg, glb_state_item_value_t *c_val, unsigned char value_type)
+{
+    if (0 == agg->count)
+        agg->first_sec = c_val->time_sec;
+
+    agg->last_sec = c_val->time_sec;
+    agg->count++;
+
+    switch (value_type)
+    {
+    case ITEM_VALUE_TYPE_FLOAT:
+    {
+        double dbl = c_val->value.data.dbl;
+
+        if (1 == agg->count)
+        {
+            agg->first.dbl = agg->min.dbl = agg->max.dbl = dbl;
+            agg->sum.dbl = 0;
+        }
+        else if (dbl < agg->min.dbl)
+            agg->min.dbl = dbl;
+        else if (dbl > agg->max.dbl)
+            agg->max.dbl = dbl;
+
+        agg->last.dbl = dbl;
+        agg->sum.dbl += dbl;
+        agg->avg += dbl / agg->count - agg->avg / agg->count;
+
+        if (NULL != agg->dbl_values)
+            zbx_vector_dbl_append(agg->dbl_values, dbl);
+        break;
+    }
+    case ITEM_VALUE_TYPE_UINT64:
+    {
+        zbx_uint64_t ui64 = c_val->value.data.ui64;
+
+        if (1 == agg->count)
+        {
+            agg->first.ui64 = agg->min.ui64 = agg->max.ui64 = ui64;
+            agg->sum.ui64 = 0;
+        }
+        else if (ui64 < agg->min.ui64)
+            agg->min.ui64 = ui64;
+        else if (ui64 > agg->max.ui64)
+            agg->max.ui64 = ui64;
+
+        agg->last.ui64 = ui64;
+        agg->sum.ui64 += ui64;
+        /* avg is kept as a sum until the range is finished to match the history based calculation */
+        agg->avg += (double)ui64;
+
+        if (NULL != agg->ui64_values)
+            zbx_vector_uint64_append(agg->ui64_values, ui64);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void agg_finish(glb_state_item_agg_t *agg, unsigned char value_type)
+{
+    if (ITEM_VALUE_TYPE_UINT64 == value_type && 0 < agg->count)
+        agg->avg /= agg->count;
+}
+
 int hist_val_to_value(glb_state_item_value_t *cache_val, zbx_history_value_t *hist_val, int time_sec, unsigned char value_type)
 {
 
@@ -446,6 +1024,22 @@ int item_update_demand(item_elem_t *elm, unsigned int new_count, unsigned int ne
     return SUCCEED;
 }
 
+/* adds the history values sorted from the newest to the oldest to the tsbuff tail while it
+   has free space, the rest of the values are sealed to the blocks */
+static void items_add_history_compressed(item_elem_t *elm, zbx_vector_history_record_t *history)
+{
+    glb_state_item_value_t *c_val;
+    int i;
+
+    for (i = 0; 0 == elm->blocks_num && i < history->values_num && FAIL == glb_tsbuff_is_full(&elm->tsbuff); i++)
+    {
+        if (NULL != (c_val = glb_tsbuff_add_to_tail(&elm->tsbuff, history->values[i].timestamp.sec)))
+            hist_val_to_value(c_val, &history->values[i].value, history->values[i].timestamp.sec, elm->value_type);
+    }
+
+    items_blocks_add_history(elm, history, i);
+}
+
 static int fetch_from_db_by_count(u_int64_t itemid, item_elem_t *elm, int count, int head_time, int now )
 {
     int ret = FAIL, i;
@@ -490,10 +1084,15 @@ static int fetch_from_db_by_count(u_int64_t itemid, item_elem_t *elm, int count,
             zbx_vector_history_record_sort(&values, (zbx_compare_func_t)zbx_history_record_compare_desc_func);
             zbx_history_value_t hist_v;
 
-            for (i = 0; i < values.values_num; i++)
+            if (SUCCEED == items_blocks_enabled(elm))
+                items_add_history_compressed(elm, &values);
+            else
             {
-                if (NULL != (c_val = glb_tsbuff_add_to_tail(&elm->tsbuff, values.values[i].timestamp.sec)))
-                    hist_val_to_value(c_val, &values.values[i].value, values.values[i].timestamp.sec, elm->value_type);
+                for (i = 0; i < values.values_num; i++)
+                {
+                    if (NULL != (c_val = glb_tsbuff_add_to_tail(&elm->tsbuff, values.values[i].timestamp.sec)))
+                        hist_val_to_value(c_val, &values.values[i].value, values.values[i].timestamp.sec, elm->value_type);
+                }
             }
         }
         else
@@ -543,7 +1142,8 @@ static int ensure_tsbuff_has_space(item_elem_t *elm)
     
         c_val = glb_tsbuff_get_value_ptr(&elm->tsbuff, glb_tsbuff_index(&elm->tsbuff, elm->tsbuff.tail + 1));
 
-        if (SUCCEED == ensure_cache_demand_count_met(elm, glb_tsbuff_get_count(&elm->tsbuff) - 1) &&
+        if (0 == elm->blocks_num &&
+            SUCCEED == ensure_cache_demand_count_met(elm, glb_tsbuff_get_count(&elm->tsbuff) - 1) &&
             SUCCEED == ensure_cache_demand_time_met(elm, c_val->time_sec))
         {
 
@@ -551,12 +1151,30 @@ static int ensure_tsbuff_has_space(item_elem_t *elm)
 
             item_variant_clear(&c_val->value);
             glb_tsbuff_free_tail(&elm->tsbuff);
+            items_windows_check(elm);
+            return SUCCEED;
         }
-        else
+
+        /* the oldest values are in the blocks then, the tsbuff tail cannot be freed */
+        if (0 < elm->blocks_num)
         {
-            int new_size = calc_grow_buffer_size(glb_tsbuff_get_size(&elm->tsbuff));
-            return glb_tsbuff_resize(&elm->tsbuff, new_size, state->memf.malloc_func, state->memf.free_func, NULL);
+            int count = glb_tsbuff_get_count(&elm->tsbuff) + items_blocks_count(elm) - elm->blocks[0]->count;
+            int next_time = 1 < elm->blocks_num ? elm->blocks[1]->first_time : glb_tsbuff_get_time_tail(&elm->tsbuff);
+
+            if (SUCCEED == ensure_cache_demand_count_met(elm, count) &&
+                SUCCEED == ensure_cache_demand_time_met(elm, next_time))
+                items_blocks_free_oldest(elm);
         }
+
+        if (SUCCEED == items_blocks_enabled(elm) && 2 * GLB_TSBLOCK_MAX_VALUES <= glb_tsbuff_get_count(&elm->tsbuff) &&
+            SUCCEED == items_blocks_seal_tail(elm))
+            return SUCCEED;
+
+        int new_size = calc_grow_buffer_size(glb_tsbuff_get_size(&elm->tsbuff));
+        int ret = glb_tsbuff_resize(&elm->tsbuff, new_size, state->memf.malloc_func, state->memf.free_func, NULL);
+
+        items_windows_check(elm);
+        return ret;
     }
     return SUCCEED;
 }
@@ -598,20 +1216,25 @@ static int glb_state_fetch_from_db_by_time(u_int64_t itemid, item_elem_t *elm, i
             zbx_vector_history_record_sort(&values, (zbx_compare_func_t)zbx_history_record_compare_desc_func);
             zbx_history_value_t hist_v;
 
-            for (i = 0; i < values.values_num; i++)
-            {
-
-                ensure_tsbuff_has_space(elm);
-
-                if (NULL != (c_val = glb_tsbuff_add_to_tail(&elm->tsbuff, values.values[i].timestamp.sec)))
-                {
-                    DEBUG_ITEM(itemid, "Added value from the history to the cache with timestamp %d", values.values[i].timestamp.sec);
-                    hist_val_to_value(c_val, &values.values[i].value, values.values[i].timestamp.sec, elm->value_type);
-                }
-                else
+            if (SUCCEED == items_blocks_enabled(elm))
+                items_add_history_compressed(elm, &values);
+            else
+            {
+                for (i = 0; i < values.values_num; i++)
                 {
-                    DEBUG_ITEM(itemid, "WARN: COULDN'T add item with timestamp %d, lowest time in the cache is %d",
-                               values.values[i].timestamp.sec, glb_tsbuff_get_time_tail(&elm->tsbuff));
+
+                    ensure_tsbuff_has_space(elm);
+
+                    if (NULL != (c_val = glb_tsbuff_add_to_tail(&elm->tsbuff, values.values[i].timestamp.sec)))
+                    {
+                        DEBUG_ITEM(itemid, "Added value from the history to the cache with timestamp %d", values.values[i].timestamp.sec);
+                        hist_val_to_value(c_val, &values.values[i].value, values.values[i].timestamp.sec, elm->value_type);
+                    }
+                    else
+                    {
+                        DEBUG_ITEM(itemid, "WARN: COULDN'T add item with timestamp %d, lowest time in the cache is %d",
+                                   values.values[i].timestamp.sec, glb_tsbuff_get_time_tail(&elm->tsbuff));
+                    }
                 }
             }
             elm->db_fetched_time = MIN(values.values[values.values_num - 1].timestamp.sec, head_time - seconds);
@@ -628,12 +1251,57 @@ static int glb_state_fetch_from_db_by_time(u_int64_t itemid, item_elem_t *elm, i
     return FAIL;
 }
 
-static int fill_items_values_by_index(u_int64_t itemid, item_elem_t *elm, int tail_idx, int head_idx, zbx_vector_history_record_t *values)
+static void fill_reset(fetch_req_t *req)
+{
+    if (NULL != req->agg)
+        agg_reset(req->agg);
+    else
+        zbx_vector_history_record_clear(req->values);
+}
+
+static void fill_add_value(u_int64_t itemid, fetch_req_t *req, glb_state_item_value_t *item_val, unsigned char value_type)
 {
-    int i, iter = 0;
-    glb_state_item_value_t *item_val;
     zbx_history_record_t record;
 
+    if (NULL != req->agg)
+    {
+        agg_add_value(req->agg, item_val, value_type);
+        return;
+    }
+
+    DEBUG_ITEM(itemid, "Filled value from cache: ts: %ld, type: '%s', value: '%s'", item_val->time_sec, 
+        zbx_variant_type_desc(&item_val->value), zbx_variant_value_desc(&item_val->value));
+
+    glb_state_value_to_hist_copy(&record, item_val, value_type);
+    zbx_vector_history_record_append_ptr(req->values, &record);
+}
+
+static void fill_finish(u_int64_t itemid, fetch_req_t *req, unsigned char value_type)
+{
+    if (NULL != req->agg)
+    {
+        agg_finish(req->agg, value_type);
+        DEBUG_ITEM(itemid, "Aggregated %d values in the cache", req->agg->count);
+    }
+}
+
+static int fill_add_tsbuff_values(u_int64_t itemid, item_elem_t *elm, int tail_idx, int head_idx, fetch_req_t *req)
+{
+    int i, iter = 0;
+
+    for (i = tail_idx; iter == 0 || i != glb_tsbuff_index(&elm->tsbuff, head_idx + 1); i = glb_tsbuff_index(&elm->tsbuff, i + 1))
+    {
+        iter++;
+        fill_add_value(itemid, req, glb_tsbuff_get_value_ptr(&elm->tsbuff, i), elm->value_type);
+    }
+
+    return i;
+}
+
+static int fill_items_values_by_index(u_int64_t itemid, item_elem_t *elm, int tail_idx, int head_idx, fetch_req_t *req)
+{
+    int i;
+
     if (0 > head_idx || 0 > tail_idx)
     {
         LOG_WRN("improper head/tail indexes, FAILing, this is a programming bug ");
@@ -641,30 +1309,172 @@ static int fill_items_values_by_index(u_int64_t itemid, item_elem_t *elm, int ta
         exit(-1);
     }
 
-    zbx_vector_history_record_clear(values);
+    fill_reset(req);
+    i = fill_add_tsbuff_values(itemid, elm, tail_idx, head_idx, req);
+    fill_finish(itemid, req, elm->value_type);
 
-    for (i = tail_idx; iter == 0 || i != glb_tsbuff_index(&elm->tsbuff, head_idx + 1); i = glb_tsbuff_index(&elm->tsbuff, i + 1))
+    return i;
+}
+
+/* adds the block values starting from the skip'th one, returns FAIL when a value newer than ts_head is met */
+static int fill_add_block_values(u_int64_t itemid, item_elem_t *elm, glb_tsblock_t *block, int skip, int ts_head,
+        fetch_req_t *req)
+{
+    glb_tsblock_reader_t reader;
+    glb_tsbuff_value_t b_val;
+    glb_state_item_value_t c_val;
+
+    glb_tsblock_reader_init(&reader, block);
+
+    while (SUCCEED == glb_tsblock_reader_next(&reader, &b_val))
     {
-        iter++;
+        if (0 < skip--)
+            continue;
 
-        item_val = glb_tsbuff_get_value_ptr(&elm->tsbuff, i);
-        
-        DEBUG_ITEM(itemid, "Filled value from cache: ts: %ld, type: '%s', value: '%s'", item_val->time_sec, 
-            zbx_variant_type_desc(&item_val->value), zbx_variant_value_desc(&item_val->value));
+        if ((int)b_val.sec > ts_head)
+            return FAIL;
+
+        block_value_to_cache(&c_val, &b_val, elm->value_type);
+        fill_add_value(itemid, req, &c_val, elm->value_type);
+    }
+
+    return SUCCEED;
+}
 
-        glb_state_value_to_hist_copy(&record, item_val, elm->value_type);
+/* the range request when the range starts before the tsbuff tail, in the compressed blocks */
+static int fill_items_values_by_time_blocks(u_int64_t itemid, item_elem_t *elm, fetch_req_t *req)
+{
+    glb_tsblock_reader_t reader;
+    glb_tsbuff_value_t b_val;
+    int b, skip = 0, i = 0, start = req->ts_head - req->seconds, boundary = -1;
+
+    if (0 == elm->blocks_num || elm->blocks[0]->first_time > start ||
+        (0 < glb_tsbuff_get_count(&elm->tsbuff) && glb_tsbuff_get_time_tail(&elm->tsbuff) <= start))
+        return FAIL;
+
+    for (b = elm->blocks_num - 1; elm->blocks[b]->first_time > start; b--)
+        ;
+
+    /* the range starts from the first value of the newest second not after the start */
+    glb_tsblock_reader_init(&reader, elm->blocks[b]);
+
+    while (SUCCEED == glb_tsblock_reader_next(&reader, &b_val) && (int)b_val.sec <= start)
+    {
+        if ((int)b_val.sec != boundary)
+        {
+            boundary = b_val.sec;
+            skip = i;
+        }
+        i++;
+    }
 
-        zbx_vector_history_record_append_ptr(values, &record);
+    fill_reset(req);
+
+    for (; b < elm->blocks_num; b++, skip = 0)
+    {
+        if (SUCCEED != fill_add_block_values(itemid, elm, elm->blocks[b], skip, req->ts_head, req))
+            break;
     }
 
-    return i;
+    if (b == elm->blocks_num && 0 < glb_tsbuff_get_count(&elm->tsbuff) &&
+        glb_tsbuff_get_time_tail(&elm->tsbuff) <= req->ts_head)
+    {
+        int head_idx = glb_tsbuff_get_head_idx(&elm->tsbuff);
+
+        if (req->ts_head < glb_tsbuff_get_time_head(&elm->tsbuff))
+            head_idx = glb_tsbuff_find_time_idx(&elm->tsbuff, req->ts_head);
+
+        fill_add_tsbuff_values(itemid, elm, glb_tsbuff_get_tail_idx(&elm->tsbuff), head_idx, req);
+    }
+
+    fill_finish(itemid, req, elm->value_type);
+
+    return SUCCEED;
 }
 
-static int fill_items_values_by_count(u_int64_t itemid, item_elem_t *elm, int count, int head_idx, zbx_vector_history_record_t *values)
+static int tsbuff_count_to_idx(item_elem_t *elm, int head_idx)
+{
+    return (head_idx - elm->tsbuff.tail + elm->tsbuff.size) % elm->tsbuff.size + 1;
+}
+
+static int fill_items_values_by_count(u_int64_t itemid, item_elem_t *elm, int count, int head_idx, fetch_req_t *req)
 {
     int tail_idx = glb_tsbuff_index(&elm->tsbuff, head_idx - count + 1);
 
-    return fill_items_values_by_index(itemid, elm, tail_idx, head_idx, values);
+    return fill_items_values_by_index(itemid, elm, tail_idx, head_idx, req);
+}
+
+/* the count request when not enough values are in the tsbuff, the oldest or all of the
+   values are taken from the blocks, head_idx is -1 when ts_head is older than the tsbuff */
+static int fill_items_values_by_count_blocks(u_int64_t itemid, item_elem_t *elm, int count, int ts_head, int head_idx,
+        fetch_req_t *req)
+{
+    glb_tsblock_reader_t reader;
+    glb_tsbuff_value_t b_val;
+    int b, need_count = count;
+
+    if (0 == elm->blocks_num)
+        return FAIL;
+
+    if (-1 != head_idx)
+    {
+        b = elm->blocks_num;
+
+        if (0 >= (need_count -= tsbuff_count_to_idx(elm, head_idx)))
+            return FAIL;
+    }
+    else
+    {
+        if (elm->blocks[0]->first_time > ts_head ||
+            (0 < glb_tsbuff_get_count(&elm->tsbuff) && glb_tsbuff_get_time_tail(&elm->tsbuff) <= ts_head))
+            return FAIL;
+
+        for (b = elm->blocks_num - 1; elm->blocks[b]->first_time > ts_head; b--)
+            ;
+
+        glb_tsblock_reader_init(&reader, elm->blocks[b]);
+
+        while (SUCCEED == glb_tsblock_reader_next(&reader, &b_val) && (int)b_val.sec <= ts_head)
+            need_count--;
+    }
+
+    while (0 < b && 0 < need_count)
+        need_count -= elm->blocks[--b]->count;
+
+    if (0 < need_count)
+        return FAIL;
+
+    fill_reset(req);
+
+    for (; b < elm->blocks_num; b++, need_count = 0)
+    {
+        if (SUCCEED != fill_add_block_values(itemid, elm, elm->blocks[b], -need_count, ts_head, req))
+            break;
+    }
+
+    if (-1 != head_idx)
+        fill_add_tsbuff_values(itemid, elm, glb_tsbuff_get_tail_idx(&elm->tsbuff), head_idx, req);
+
+    fill_finish(itemid, req, elm->value_type);
+
+    return SUCCEED;
+}
+
+/* timestamp of the oldest value returned by the request */
+static int fetch_req_get_tail_time(fetch_req_t *req)
+{
+    if (NULL != req->agg)
+        return 0 < req->agg->count ? req->agg->first_sec : -1;
+
+    return 0 < req->values->values_num ? req->values->values[0].timestamp.sec : -1;
+}
+
+static int fetch_req_get_count(fetch_req_t *req)
+{
+    if (NULL != req->agg)
+        return req->agg->count;
+
+    return req->values->values_num;
 }
 
 static int count_request()
@@ -712,6 +1522,8 @@ static void free_item(item_elem_t *elm)
         glb_tsbuff_free_tail(&elm->tsbuff);
     }
 
+    items_windows_free(elm);
+    items_blocks_free(elm);
     glb_tsbuff_destroy(&elm->tsbuff, state->memf.free_func);
     state->memf.free_func(elm);
 }
@@ -733,7 +1545,7 @@ int cache_fetch_count_cb(elems_hash_elem_t *elem, mem_funcs_t *memf,  void *req_
             elem->id,  glb_tsbuff_get_count(&elm->tsbuff), glb_tsbuff_get_time_tail(&elm->tsbuff), glb_tsbuff_get_size(&elm->tsbuff),
             req->ts_head, req->count, req->seconds  );
     
-    int head_idx = -1, need_count = 0;
+    int head_idx = -1, need_count = 0, tail_time;
     
     if (req->value_type != elm->value_type && glb_tsbuff_get_count(&elm->tsbuff) > 0 )
     {
@@ -757,11 +1569,19 @@ int cache_fetch_count_cb(elems_hash_elem_t *elem, mem_funcs_t *memf,  void *req_
     if (-1 < head_idx && SUCCEED == glb_tsbuff_check_has_enough_count_data_idx(&elm->tsbuff, req->count, head_idx))
     {
         count_hit();
-        fill_items_values_by_count(elem->id, elm, req->count, head_idx, req->values);
-        DEBUG_ITEM(elem->id, "filled %d values from the cache", req->values->values_num);
+        fill_items_values_by_count(elem->id, elm, req->count, head_idx, req);
+        DEBUG_ITEM(elem->id, "filled %d values from the cache", fetch_req_get_count(req));
         
         return SUCCEED;
     }
+
+    if (SUCCEED == fill_items_values_by_count_blocks(elem->id, elm, req->count, req->ts_head, head_idx, req))
+    {
+        count_hit();
+        DEBUG_ITEM(elem->id, "filled %d values from the cache blocks", fetch_req_get_count(req));
+
+        return SUCCEED;
+    }
     
     count_miss();
  
@@ -786,7 +1606,8 @@ int cache_fetch_count_cb(elems_hash_elem_t *elem, mem_funcs_t *memf,  void *req_
         need_count = req->count;
     }
     else // excluding data that fits from the count
-        need_count = req->count - (head_idx - elm->tsbuff.tail + elm->tsbuff.size) % elm->tsbuff.size;
+        need_count = req->count - (head_idx - elm->tsbuff.tail + elm->tsbuff.size) % elm->tsbuff.size -
+                items_blocks_count(elm);
 
     if (need_count > 0)
     {
@@ -801,7 +1622,17 @@ int cache_fetch_count_cb(elems_hash_elem_t *elem, mem_funcs_t *memf,  void *req_
         update_db_fetch(elm, req->ts_head);
     }
 
-    if (-1 == (head_idx = glb_tsbuff_find_time_idx(&elm->tsbuff, req->ts_head)))
+    head_idx = glb_tsbuff_find_time_idx(&elm->tsbuff, req->ts_head);
+
+    if (SUCCEED == fill_items_values_by_count_blocks(elem->id, elm, req->count, req->ts_head, head_idx, req))
+    {
+        count_db_hit();
+        DEBUG_ITEM(elem->id, "Fetch from db successful, filled %d values", req->count);
+
+        return SUCCEED;
+    }
+
+    if (-1 == head_idx)
     {
         count_db_miss();
         count_miss();
@@ -818,13 +1649,13 @@ int cache_fetch_count_cb(elems_hash_elem_t *elem, mem_funcs_t *memf,  void *req_
         return FAIL;
     }
     
-    fill_items_values_by_count(elem->id, elm, req->count, head_idx, req->values);
+    fill_items_values_by_count(elem->id, elm, req->count, head_idx, req);
     count_db_hit();
 
     DEBUG_ITEM(elem->id, "Fetch from db successful, filled %d values", req->count);
 
-    if (req->values->values_num > 0)
-        update_db_fetch(elm, req->values->values[0].timestamp.sec);
+    if (-1 != (tail_time = fetch_req_get_tail_time(req)))
+        update_db_fetch(elm, tail_time);
 
     return SUCCEED;
 }
@@ -861,8 +1692,8 @@ static int cache_fetch_time_cb(elems_hash_elem_t *elem, mem_funcs_t *memf, void
         now = time(NULL),
         fetch_seconds = req->seconds;
 
-    head_idx = glb_tsbuff_find_time_idx(&elm->tsbuff, req->ts_head);
-    tail_idx = glb_tsbuff_find_time_idx(&elm->tsbuff, req->ts_head - req->seconds);
+    head_idx = items_find_time_head_idx(elm, req->ts_head);
+    tail_idx = items_find_time_tail_idx(elm, req->ts_head - req->seconds);
 
     //if requested range start is more recent than the cache, then use what there are in the cache anyway
     //but only if there is a tail exists - if there are data at all.
@@ -886,8 +1717,15 @@ static int cache_fetch_time_cb(elems_hash_elem_t *elem, mem_funcs_t *memf, void
     {
         DEBUG_ITEM(elem->id, "Filling from the cache");
         count_hit();
-        fill_items_values_by_index(elem->id, elm, tail_idx, head_idx, req->values);
-        DEBUG_ITEM(elem->id, "Filled from the cache %d items", req->values->values_num);
+        fill_items_values_by_index(elem->id, elm, tail_idx, head_idx, req);
+        DEBUG_ITEM(elem->id, "Filled from the cache %d items", fetch_req_get_count(req));
+        return SUCCEED;
+    }
+
+    if (SUCCEED == fill_items_values_by_time_blocks(elem->id, elm, req))
+    {
+        count_hit();
+        DEBUG_ITEM(elem->id, "Filled from the cache blocks %d items", fetch_req_get_count(req));
         return SUCCEED;
     }
 
@@ -896,11 +1734,10 @@ static int cache_fetch_time_cb(elems_hash_elem_t *elem, mem_funcs_t *memf, void
 
     count_miss();
 
-    if (glb_tsbuff_get_count(&elm->tsbuff) > 0 &&
-        req->ts_head >= glb_tsbuff_get_time_tail(&elm->tsbuff))
+    if (-1 != items_get_time_tail(elm) && req->ts_head >= items_get_time_tail(elm))
     {
 
-        fetch_head_time = glb_tsbuff_get_time_tail(&elm->tsbuff) + 1;
+        fetch_head_time = items_get_time_tail(elm) + 1;
         fetch_seconds = req->seconds - (req->ts_head - fetch_head_time);
         // to make sure we have the data needed, we need to request a bit more data
         fetch_seconds = calc_time_data_overhead(fetch_seconds);
@@ -918,15 +1755,22 @@ static int cache_fetch_time_cb(elems_hash_elem_t *elem, mem_funcs_t *memf, void
     }
     update_db_fetch(elm, req->ts_head);
 
+    if (SUCCEED == fill_items_values_by_time_blocks(elem->id, elm, req))
+    {
+        count_db_hit();
+        DEBUG_ITEM(elem->id, "DB request successful, data cached and filled %d values", fetch_req_get_count(req));
+        return SUCCEED;
+    }
+
     // looking for start/end againg
     if (req->ts_head >= glb_tsbuff_get_time_head(&elm->tsbuff))
     {
         head_idx = elm->tsbuff.head;
     }
     else
-        head_idx = glb_tsbuff_find_time_idx(&elm->tsbuff, req->ts_head);
+        head_idx = items_find_time_head_idx(elm, req->ts_head);
 
-    tail_idx = glb_tsbuff_find_time_idx(&elm->tsbuff, now - req->seconds);
+    tail_idx = items_find_time_tail_idx(elm, now - req->seconds);
 
     if (-1 == tail_idx)
     {
@@ -947,13 +1791,108 @@ static int cache_fetch_time_cb(elems_hash_elem_t *elem, mem_funcs_t *memf, void
     if (-1 != tail_idx && -1 != head_idx)
     {
         count_db_hit();
-        fill_items_values_by_index(elem->id, elm, tail_idx, head_idx, req->values);
+        fill_items_values_by_index(elem->id, elm, tail_idx, head_idx, req);
         DEBUG_ITEM(elem->id, "DB request successful, data cached and filled %d values", glb_tsbuff_get_count(&elm->tsbuff));
     }
 
     return SUCCEED;
 }
 
+static int window_get_aggregate(item_elem_t *elm, item_window_t *win, int win_time, glb_state_item_agg_t *agg)
+{
+    glb_state_item_value_t *first, *last, *min, *max;
+
+    if (SUCCEED != window_is_valid(elm, win) || win_time < win->win_time ||
+        win_time < glb_tsbuff_get_time_head(&elm->tsbuff))
+        return FAIL;
+
+    window_advance(elm, win, win_time);
+
+    first = window_value(elm, win->tail_idx);
+    last = window_value(elm, elm->tsbuff.head);
+    min = window_value(elm, win->min.idx[win->min.first]);
+    max = window_value(elm, win->max.idx[win->max.first]);
+
+    agg->count = win->count;
+    agg->first_sec = first->time_sec;
+    agg->last_sec = last->time_sec;
+    agg->avg = win->dbl_sum / win->count;
+
+    if (ITEM_VALUE_TYPE_FLOAT == elm->value_type)
+    {
+        agg->first.dbl = first->value.data.dbl;
+        agg->last.dbl = last->value.data.dbl;
+        agg->min.dbl = min->value.data.dbl;
+        agg->max.dbl = max->value.data.dbl;
+        agg->sum.dbl = win->dbl_sum;
+    }
+    else
+    {
+        agg->first.ui64 = first->value.data.ui64;
+        agg->last.ui64 = last->value.data.ui64;
+        agg->min.ui64 = min->value.data.ui64;
+        agg->max.ui64 = max->value.data.ui64;
+        agg->sum.ui64 = win->ui64_sum;
+    }
+
+    return SUCCEED;
+}
+
+/* starts maintaining the window after it has been requested, time shifted windows aren't kept */
+static void window_register(item_elem_t *elm, fetch_req_t *req, int now)
+{
+    item_window_t *win;
+
+    if (req->ts_head < glb_tsbuff_get_time_head(&elm->tsbuff) || req->ts_head > now)
+        return;
+
+    if (NULL == (win = items_windows_find(elm, req->seconds)))
+    {
+        if (GLB_CACHE_ITEM_MAX_WINDOWS <= elm->windows_num)
+            return;
+
+        elm->windows = state->memf.realloc_func(elm->windows, sizeof(item_window_t) * (elm->windows_num + 1));
+        win = &elm->windows[elm->windows_num++];
+        memset(win, 0, sizeof(item_window_t));
+        win->seconds = req->seconds;
+    }
+
+    win->last_read = now;
+    window_build(elm, win, req->ts_head);
+}
+
+/******************************************************************************
+ * time range aggregates of the numeric items are taken from the sliding      *
+ * window, the window is (re)calculated from the range if it's not usable     *
+ ******************************************************************************/
+static int cache_aggregate_time_cb(elems_hash_elem_t *elem, mem_funcs_t *memf, void *req_data)
+{
+    fetch_req_t *req = (fetch_req_t *)req_data;
+    item_elem_t *elm = (item_elem_t *)elem->data;
+    item_window_t *win;
+    int now = time(NULL), ret;
+
+    if (req->value_type == elm->value_type && NULL != (win = items_windows_find(elm, req->seconds)))
+    {
+        win->last_read = now;
+
+        if (SUCCEED == window_get_aggregate(elm, win, req->ts_head, req->agg))
+        {
+            count_request();
+            count_hit();
+            DEBUG_ITEM(elem->id, "Aggregated %d values of the %d seconds window", req->agg->count, req->seconds);
+            return SUCCEED;
+        }
+    }
+
+    if (SUCCEED != (ret = cache_fetch_time_cb(elem, memf, req_data)))
+        return ret;
+
+    window_register((item_elem_t *)elem->data, req, now);
+
+    return SUCCEED;
+}
+
 int add_value_lld_cb(elems_hash_elem_t *elem, mem_funcs_t *memf,  void *data) {
     glb_state_item_value_t *c_val;
     item_elem_t *elm = elem->data;
@@ -975,6 +1914,9 @@ int add_value_lld_cb(elems_hash_elem_t *elem, mem_funcs_t *memf,  void *data) {
   
     }
 
+    items_blocks_free(elm);
+    items_windows_check(elm);
+
 
     if (NULL != (c_val = (glb_state_item_value_t *)glb_tsbuff_add_to_head(&elm->tsbuff, h->ts.sec)))
     {
@@ -1042,6 +1984,7 @@ int add_value_cb(elems_hash_elem_t *elem, mem_funcs_t *memf,  void *data)
     if (NULL != (c_val = (glb_state_item_value_t *)glb_tsbuff_add_to_head(&elm->tsbuff, h->ts.sec)))
     {
         dc_hist_to_value(c_val, h);
+        items_windows_add_value(elm, now);
       //  DEBUG_ITEM(elem->id, "Item added, oldest timestamp is %ld", glb_tsbuff_get_time_tail(&elm->tsbuff));
     }
     else
@@ -1129,6 +2072,11 @@ int item_get_nextcheck_cb(elems_hash_elem_t *elem, mem_funcs_t *memf, void *cb_d
     return elm->meta.nextcheck;
 }
 
+static int item_get_compressed_count_cb(elems_hash_elem_t *elem, mem_funcs_t *memf, void *cb_data)
+{
+    return items_blocks_count((item_elem_t *)elem->data);
+}
+
 #define ZBX_DC_FLAGS_NOT_FOR_HISTORY (ZBX_DC_FLAG_NOVALUE | ZBX_DC_FLAG_UNDEF | ZBX_DC_FLAG_NOHISTORY)
 int add_json_item_value(int value_type, struct zbx_json *json, glb_state_item_value_t *c_val)
 {
@@ -1403,6 +2351,30 @@ int glb_state_item_update_nextcheck(u_int64_t itemid, int nextcheck) {
 		return elems_hash_process(state->items, itemid, item_update_nextcheck_cb, &nextcheck, 0);	
 }
 
+int glb_state_items_update_nextchecks(glb_state_item_nextcheck_t *nextchecks, int num) {
+    u_int64_t *ids;
+    void **data;
+    int i, ret;
+
+    if (0 >= num)
+        return 0;
+
+    ids = zbx_malloc(NULL, sizeof(u_int64_t) * num);
+    data = zbx_malloc(NULL, sizeof(void *) * num);
+
+    for (i = 0; i < num; i++) {
+        ids[i] = nextchecks[i].itemid;
+        data[i] = &nextchecks[i].nextcheck;
+    }
+
+    ret = elems_hash_process_batch(state->items, ids, data, num, item_update_nextcheck_cb, 0);
+
+    zbx_free(data);
+    zbx_free(ids);
+
+    return ret;
+}
+
 int  glb_state_item_set_lastdata_by_metric(const metric_t *metric) {
 	return elems_hash_process(state->items, metric->itemid, item_update_lastdata_cb, (void *)metric, 0);
 }
@@ -1429,31 +2401,60 @@ int  glb_state_item_set_error(u_int64_t itemid, const char *error) {
 	return elems_hash_process(state->items, itemid, item_set_error_cb, (void *)error, 0);
 }
 
+ELEMS_CALLBACK(add_history_cb) {
+    ZBX_DC_HISTORY *h = (ZBX_DC_HISTORY *)data;
+
+    if (ITEM_STATE_NOTSUPPORTED == h->state) {
+        DEBUG_ITEM(h->itemid, "Added error %s as state error", h->value.err);
+        return item_set_error_cb(elem, memf, h->value.err);
+    }
+
+    return add_value_cb(elem, memf, h);
+}
+
+/* values are ordered by the item keeping the order of arrival within the item,
+   so the whole history batch costs one lock of each shard of the items hash */
 int  glb_state_item_add_values( ZBX_DC_HISTORY *history, int history_num) {
-    int i, ret = SUCCEED;
+    int i;
+    zbx_vector_uint64_pair_t order;
+    u_int64_t *ids;
+    void **data;
 
     LOG_DBG("In %s: starting adding new history %d values", __func__, history_num);
 
+    zbx_vector_uint64_pair_create(&order);
+    zbx_vector_uint64_pair_reserve(&order, history_num);
+
     for (i = 0; i < history_num; i++)
     {
-        ZBX_DC_HISTORY *h;
-        h = (ZBX_DC_HISTORY *)&history[i];
+        ZBX_DC_HISTORY *h = &history[i];
+        zbx_uint64_pair_t pair = {.first = h->itemid, .second = i};
 
         DEBUG_ITEM(h->itemid, "Adding to value cache, flags is %d state is %d", h->flags, h->state);
-        if (ITEM_STATE_NOTSUPPORTED == h->state)
-        {
-            if ( NULL != h->value.err ) {
-                DEBUG_ITEM(h->itemid, "Added error %s as state error", h->value.err);
-                elems_hash_process(state->items, h->itemid, item_set_error_cb,  h->value.err, 0);
-            }
+        
+        if (ITEM_STATE_NOTSUPPORTED == h->state && NULL == h->value.err)
             continue;
-        }
 
-        ret = elems_hash_process(state->items, h->itemid, add_value_cb, h, 0);
-        DEBUG_ITEM(h->itemid, "Added value with timestamp %d to the cache", h->ts.sec);
+        zbx_vector_uint64_pair_append(&order, pair);
     }
 
-    return ret;
+    zbx_vector_uint64_pair_sort(&order, ZBX_DEFAULT_UINT64_PAIR_COMPARE_FUNC);
+
+    ids = zbx_malloc(NULL, sizeof(u_int64_t) * order.values_num);
+    data = zbx_malloc(NULL, sizeof(void *) * order.values_num);
+
+    for (i = 0; i < order.values_num; i++) {
+        ids[i] = order.values[i].first;
+        data[i] = &history[order.values[i].second];
+    }
+
+    elems_hash_process_batch(state->items, ids, data, order.values_num, add_history_cb, 0);
+
+    zbx_free(data);
+    zbx_free(ids);
+    zbx_vector_uint64_pair_destroy(&order);
+
+    return SUCCEED;
 };
 
 int glb_state_item_get_oper_state(u_int64_t itemid) {
@@ -1471,6 +2472,11 @@ int glb_state_item_get_nextcheck(u_int64_t itemid) {
 	return elems_hash_process(state->items, itemid, item_get_nextcheck_cb, NULL, ELEM_FLAG_DO_NOT_CREATE);
 }
 
+/* the number of the item's values sealed to the compressed blocks */
+int glb_state_item_get_compressed_count(u_int64_t itemid) {
+	return elems_hash_process(state->items, itemid, item_get_compressed_count_cb, NULL, ELEM_FLAG_DO_NOT_CREATE);
+}
+
 
 int  glb_state_item_get_values( u_int64_t itemid, int value_type, zbx_vector_history_record_t *values, int seconds, int count, int ts_head) {
 	
@@ -1487,6 +2493,38 @@ int  glb_state_item_get_values( u_int64_t itemid, int value_type, zbx_vector_his
     return elems_hash_process(state->items, itemid, cache_fetch_time_cb, &req, ELEM_FLAG_DO_NOT_CREATE);
 };
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: calculates aggregates of the item's values in the cache without   *
+ *          copying them out, the range is selected the same way as by        *
+ *          glb_state_item_get_values()                                       *
+ *                                                                            *
+ ******************************************************************************/
+int glb_state_item_get_aggregate(u_int64_t itemid, int value_type, glb_state_item_agg_t *agg, int seconds, int count, int ts_end)
+{
+    DEBUG_ITEM(itemid, "In %s:starting itemid: %ld, seconds: %d, count: %d", __func__, itemid, seconds, count);
+
+    agg_reset(agg);
+
+    if (count > 0)
+    {
+        fetch_req_t req = {.itemid = itemid, .count = count, .value_type = value_type, .agg = agg, .ts_head = ts_end};
+
+        return elems_hash_process(state->items, itemid, cache_fetch_count_cb, &req, ELEM_FLAG_DO_NOT_CREATE);
+    }
+
+    fetch_req_t req = {.itemid = itemid, .value_type = value_type, .agg = agg, .seconds = seconds, .ts_head = ts_end};
+
+    /* percentiles need all the values of the range */
+    if (0 < seconds && NULL == agg->dbl_values && NULL == agg->ui64_values &&
+        (ITEM_VALUE_TYPE_FLOAT == value_type || ITEM_VALUE_TYPE_UINT64 == value_type))
+    {
+        return elems_hash_process(state->items, itemid, cache_aggregate_time_cb, &req, ELEM_FLAG_DO_NOT_CREATE);
+    }
+
+    return elems_hash_process(state->items, itemid, cache_fetch_time_cb, &req, ELEM_FLAG_DO_NOT_CREATE);
+}
+
 /******************************************************************************
  *                                                                            *
  * Function: glb_state_get_item_stats                                         *
@@ -1594,6 +2632,22 @@ DUMPER_TO_JSON(item_to_json_cb)
 
     // data
     zbx_json_addarray(json, "values");
+
+    for (int i = 0; i < elm->blocks_num; i++)
+    {
+        glb_tsblock_reader_t reader;
+        glb_tsbuff_value_t b_val;
+        glb_state_item_value_t c_val;
+
+        glb_tsblock_reader_init(&reader, elm->blocks[i]);
+
+        while (SUCCEED == glb_tsblock_reader_next(&reader, &b_val))
+        {
+            block_value_to_cache(&c_val, &b_val, elm->value_type);
+            add_json_item_value(elm->value_type, json, &c_val);
+        }
+    }
+
     int tail_idx = elm->tsbuff.tail;
     if (-1 < tail_idx)
     {
@@ -1611,7 +2665,7 @@ DUMPER_TO_JSON(item_to_json_cb)
     }
     zbx_json_close(json);
 
-    return (glb_tsbuff_get_count(&elm->tsbuff));
+    return (glb_tsbuff_get_count(&elm->tsbuff) + items_blocks_count(elm));
 }
 
 
@@ -1651,6 +2705,11 @@ ELEMS_CALLBACK(clean_old_values) {
     items_hkeep_stat_t *stat = data;
     
     int cnt = 0;
+
+    while (0 < elm->blocks_num && elm->blocks[0]->last_time < stat->clean_time) {
+        stat->clean_count += elm->blocks[0]->count;
+        items_blocks_free_oldest(elm);
+    }
         
     while(glb_tsbuff_get_count(&elm->tsbuff) > 0 ){
         glb_state_item_value_t *c_val = glb_tsbuff_get_value_tail(&elm->tsbuff);
@@ -1666,6 +2725,8 @@ ELEMS_CALLBACK(clean_old_values) {
         
         break;
     }
+
+    items_windows_check(elm);
     
     return SUCCEED;
 }
@@ -1676,28 +2737,47 @@ void glb_state_items_housekeep() {
     elems_hash_iterate(state->items,clean_old_values, &stat, ELEMS_HASH_WRITE);
 }
 
-typedef struct {
-    unsigned int lastcheck;
-    unsigned int nextcheck;
-    int state;
-} poll_result_t;
-
 ELEMS_CALLBACK(set_item_poll_result) {
     item_elem_t *item=elem->data;
-    poll_result_t *res = data;
+    glb_state_item_poll_result_t *res = data;
     
-    if (res->state > -1) 
+    /* a value or error of the same or a later second has already set the state */
+    if (res->state > -1 && item->meta.lastdata < res->lastcheck) 
         item->meta.state = res->state;
     
     if (res->lastcheck > item->meta.lastdata)
         item->meta.lastdata = res->lastcheck;
+
+    return SUCCEED;
 }
 
 void glb_state_items_set_poll_result(u_int64_t itemid, unsigned int lastcheck, int laststate) {
-    poll_result_t poll_res ={.lastcheck = lastcheck, .state = laststate};
+    glb_state_item_poll_result_t poll_res ={.itemid = itemid, .lastcheck = lastcheck, .state = laststate};
     elems_hash_process(state->items,itemid, set_item_poll_result, &poll_res, 0);
 }
 
+void glb_state_items_set_poll_results(glb_state_item_poll_result_t *results, int num) {
+    u_int64_t *ids;
+    void **data;
+    int i;
+
+    if (0 >= num)
+        return;
+
+    ids = zbx_malloc(NULL, sizeof(u_int64_t) * num);
+    data = zbx_malloc(NULL, sizeof(void *) * num);
+
+    for (i = 0; i < num; i++) {
+        ids[i] = results[i].itemid;
+        data[i] = &results[i];
+    }
+
+    elems_hash_process_batch(state->items, ids, data, num, set_item_poll_result, 0);
+
+    zbx_free(data);
+    zbx_free(ids);
+}
+
 ELEMS_CALLBACK(get_error_cb) {
     item_elem_t *item=elem->data;
     char **error = data;
@@ -28,17 +28,58 @@
 
 #define ZBX_DC_FLAGS_NOT_FOR_HISTORY (ZBX_DC_FLAG_NOVALUE | ZBX_DC_FLAG_UNDEF | ZBX_DC_FLAG_NOHISTORY)
 
+/* aggregates of the cached values of a time or count range, they are calculated
+   in place while the item is locked, so the values aren't copied out of the cache;
+   min, max, sum and avg are only calculated for the numeric items, the values are
+   kept in the item's value type, first is the oldest value of the range, last - the newest */
+typedef struct
+{
+    int count;
+    int first_sec;
+    int last_sec;
+
+    zbx_history_value_t first;
+    zbx_history_value_t last;
+    zbx_history_value_t min;
+    zbx_history_value_t max;
+    zbx_history_value_t sum;
+    double avg;
+
+    /* optional, numeric values of the range are collected to calculate percentiles */
+    zbx_vector_dbl_t *dbl_values;
+    zbx_vector_uint64_t *ui64_values;
+} glb_state_item_agg_t;
+
+/* results of the items polling and the nextchecks are passed to the batch updates
+   in arrays sorted by the itemid, so each shard of the cache is locked once per batch */
+typedef struct
+{
+    u_int64_t itemid;
+    unsigned int lastcheck;
+    int state;
+} glb_state_item_poll_result_t;
+
+typedef struct
+{
+    u_int64_t itemid;
+    int nextcheck;
+} glb_state_item_nextcheck_t;
+
 int glb_state_items_init(mem_funcs_t *memf);
 
 int     glb_state_item_get_valuetype(u_int64_t itemid);
 int     glb_state_item_get_values(u_int64_t itemid, int value_type, zbx_vector_history_record_t *values, int ts_start, int count, int ts_end);
+int     glb_state_item_get_aggregate(u_int64_t itemid, int value_type, glb_state_item_agg_t *agg, int seconds, int count, int ts_end);
 int     glb_state_item_get_nextcheck(u_int64_t itemid);
+int     glb_state_item_get_compressed_count(u_int64_t itemid);
 int     glb_state_item_update_nextcheck(u_int64_t itemid, int nextcheck);
+int     glb_state_items_update_nextchecks(glb_state_item_nextcheck_t *nextchecks, int num);
 int     glb_state_item_get_oper_state(u_int64_t itemid);
 int     glb_state_items_get_state_json(zbx_vector_uint64_t *itemids, struct zbx_json *json);
 int     glb_state_item_set_error(u_int64_t itemid, const char *error);
 
 void    glb_state_items_set_poll_result(u_int64_t itemid, unsigned int lastcheck, int laststate);
+void    glb_state_items_set_poll_results(glb_state_item_poll_result_t *results, int num);
 int     glb_state_item_set_lastdata_by_metric(const metric_t *metric);
 
 
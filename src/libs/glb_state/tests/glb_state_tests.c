@@ -19,6 +19,8 @@
 #include "zbx_trigger_constants.h"
 #include "../glb_state_triggers.h"
 #include "../glb_state_hosts.h"
+#include "../glb_state_items.h"
+#include "zbx_item_constants.h"
 
 static void state_test_triggers(){
     LOG_INF("Starting triggers tests");
@@ -151,11 +153,390 @@ static void state_test_triggers(){
 }
 
 
+#define TEST_ITEMID 9000000000001
+
+static void state_test_items_batch(){
+    ZBX_DC_HISTORY history[6] = {0};
+    glb_state_item_nextcheck_t nextchecks[3];
+    glb_state_item_poll_result_t poll_results[2];
+    zbx_vector_uint64_t itemids;
+    char *error = NULL;
+    int i, now = time(NULL);
+
+    LOG_INF("Starting items batch tests");
+
+    /* the values of the items are interleaved, each item keeps the order of its values */
+    for (i = 0; i < 6; i++) {
+        history[i].itemid = TEST_ITEMID + i % 3;
+        history[i].ts.sec = now - 6 + i;
+        history[i].value_type = ITEM_VALUE_TYPE_UINT64;
+        history[i].value.ui64 = i;
+        history[i].state = ITEM_STATE_NORMAL;
+    }
+
+    /* the first item gets an error after the value, the second one recovers after the error */
+    history[3].state = ITEM_STATE_NOTSUPPORTED;
+    history[3].value.err = "item error";
+    history[1].state = ITEM_STATE_NOTSUPPORTED;
+    history[1].value.err = "recovered error";
+
+    assert(SUCCEED == glb_state_item_add_values(history, 6));
+
+    assert(ITEM_STATE_NOTSUPPORTED == glb_state_item_get_oper_state(TEST_ITEMID));
+    assert(SUCCEED == glb_state_item_get_error(TEST_ITEMID, &error));
+    assert(0 == strcmp(error, "item error"));
+    zbx_free(error);
+
+    assert(ITEM_STATE_NORMAL == glb_state_item_get_oper_state(TEST_ITEMID + 1));
+    assert(ITEM_STATE_NORMAL == glb_state_item_get_oper_state(TEST_ITEMID + 2));
+
+    for (i = 0; i < 3; i++) {
+        nextchecks[i].itemid = TEST_ITEMID + i;
+        nextchecks[i].nextcheck = now + 10 * (i + 1);
+    }
+
+    glb_state_items_update_nextchecks(nextchecks, 3);
+
+    for (i = 0; i < 3; i++)
+        assert(now + 10 * (i + 1) == glb_state_item_get_nextcheck(TEST_ITEMID + i));
+
+    /* the result of the poll made before the error must not hide it */
+    poll_results[0].itemid = TEST_ITEMID;
+    poll_results[0].lastcheck = now - 10;
+    poll_results[0].state = ITEM_STATE_NORMAL;
+    poll_results[1].itemid = TEST_ITEMID + 1;
+    poll_results[1].lastcheck = now + 10;
+    poll_results[1].state = ITEM_STATE_NOTSUPPORTED;
+
+    glb_state_items_set_poll_results(poll_results, 2);
+
+    assert(ITEM_STATE_NOTSUPPORTED == glb_state_item_get_oper_state(TEST_ITEMID));
+    assert(ITEM_STATE_NOTSUPPORTED == glb_state_item_get_oper_state(TEST_ITEMID + 1));
+
+    /* the poll of the same second as the last value doesn't change the state */
+    poll_results[0].lastcheck = now - 3;
+    glb_state_items_set_poll_results(poll_results, 1);
+    assert(ITEM_STATE_NOTSUPPORTED == glb_state_item_get_oper_state(TEST_ITEMID));
+
+    /* the later poll sets the state */
+    poll_results[0].lastcheck = now + 10;
+    glb_state_items_set_poll_results(poll_results, 1);
+    assert(ITEM_STATE_NORMAL == glb_state_item_get_oper_state(TEST_ITEMID));
+
+    zbx_vector_uint64_create(&itemids);
+
+    for (i = 0; i < 3; i++)
+        zbx_vector_uint64_append(&itemids, TEST_ITEMID + i);
+
+    glb_state_items_remove(&itemids);
+    zbx_vector_uint64_destroy(&itemids);
+
+    LOG_INF("Items batch tests are finished");
+}
+
+/* the window aggregates of the range must be the same as the ones calculated over the range values */
+static void state_test_window_check(u_int64_t itemid, int value_type, int seconds, int ts_end)
+{
+    glb_state_item_agg_t win = {0}, range = {0};
+    zbx_vector_dbl_t dbl_values;
+    zbx_vector_uint64_t ui64_values;
+
+    zbx_vector_dbl_create(&dbl_values);
+    zbx_vector_uint64_create(&ui64_values);
+
+    /* the range with the values collected for the percentiles is aggregated without the window */
+    if (ITEM_VALUE_TYPE_FLOAT == value_type)
+        range.dbl_values = &dbl_values;
+    else
+        range.ui64_values = &ui64_values;
+
+    assert(SUCCEED == glb_state_item_get_aggregate(itemid, value_type, &win, seconds, 0, ts_end));
+    assert(SUCCEED == glb_state_item_get_aggregate(itemid, value_type, &range, seconds, 0, ts_end));
+
+    assert(0 < win.count && win.count == range.count);
+    assert(win.first_sec == range.first_sec);
+    assert(win.last_sec == range.last_sec);
+
+    /* the values are integer, so the float sums are exact */
+    if (ITEM_VALUE_TYPE_FLOAT == value_type) {
+        assert(win.sum.dbl == range.sum.dbl);
+        assert(win.min.dbl == range.min.dbl);
+        assert(win.max.dbl == range.max.dbl);
+        assert(win.first.dbl == range.first.dbl);
+        assert(win.last.dbl == range.last.dbl);
+    } else {
+        assert(win.sum.ui64 == range.sum.ui64);
+        assert(win.min.ui64 == range.min.ui64);
+        assert(win.max.ui64 == range.max.ui64);
+        assert(win.first.ui64 == range.first.ui64);
+        assert(win.last.ui64 == range.last.ui64);
+    }
+
+    zbx_vector_dbl_destroy(&dbl_values);
+    zbx_vector_uint64_destroy(&ui64_values);
+}
+
+#define TEST_WINDOW_SECONDS 2
+#define TEST_WINDOW_STEPS 20
+
+static void state_test_items_window(u_int64_t itemid, int value_type, int now)
+{
+    ZBX_DC_HISTORY history = {0};
+    zbx_vector_uint64_t itemids;
+    int i, j, sec;
+
+    history.itemid = itemid;
+    history.value_type = value_type;
+    history.state = ITEM_STATE_NORMAL;
+
+    /* the old values are freed from the tail of the full buffer as the window only needs the
+       last seconds, the last second gets the values younger than the window so the buffer grows */
+    for (i = 0; i <= TEST_WINDOW_STEPS; i++) {
+        int values_num = (TEST_WINDOW_STEPS == i ? 30 : 1 + i % 3);
+
+        sec = now - TEST_WINDOW_STEPS + i;
+        history.ts.sec = sec;
+
+        for (j = 0; j < values_num; j++) {
+            int value = (i * 7 + j * 5) % 11;
+
+            if (ITEM_VALUE_TYPE_FLOAT == value_type)
+                history.value.dbl = value;
+            else
+                history.value.ui64 = value;
+
+            assert(SUCCEED == glb_state_item_add_values(&history, 1));
+
+            /* there must be the values older than the window start in the cache */
+            if (TEST_WINDOW_SECONDS <= i)
+                state_test_window_check(itemid, value_type, TEST_WINDOW_SECONDS, sec);
+        }
+    }
+
+    zbx_vector_uint64_create(&itemids);
+    zbx_vector_uint64_append(&itemids, itemid);
+    glb_state_items_remove(&itemids);
+    zbx_vector_uint64_destroy(&itemids);
+}
+
+static void state_test_items_windows(){
+    int now = time(NULL);
+
+    LOG_INF("Starting items window tests");
+
+    state_test_items_window(TEST_ITEMID + 3, ITEM_VALUE_TYPE_FLOAT, now);
+    state_test_items_window(TEST_ITEMID + 4, ITEM_VALUE_TYPE_UINT64, now);
+
+    LOG_INF("Items window tests are finished");
+}
+
+#define TEST_ELEMS 20
+
+ELEMS_CREATE(state_test_elem_create_cb) {
+    elem->data = memf->malloc_func(NULL, sizeof(int));
+    *(int *)elem->data = 0;
+
+    return SUCCEED;
+}
+
+ELEMS_FREE(state_test_elem_free_cb) {
+    memf->free_func(elem->data);
+    elem->data = NULL;
+
+    return SUCCEED;
+}
+
+ELEMS_CALLBACK(state_test_elem_count_cb) {
+    (*(int *)elem->data)++;
+    (*(int *)data)++;
+
+    return SUCCEED;
+}
+
+ELEMS_CALLBACK(state_test_elem_get_cb) {
+    return *(int *)elem->data;
+}
+
+/* the batch processing the cache updates rely on: the shards are locked once per
+   batch, the missing elements are created unless asked not to, the repeated ids are
+   processed in the order of the batch */
+static void state_test_elems_batch(){
+    mem_funcs_t memf = {.malloc_func = ZBX_DEFAULT_MEM_MALLOC_FUNC, .realloc_func = ZBX_DEFAULT_MEM_REALLOC_FUNC,
+            .free_func = ZBX_DEFAULT_MEM_FREE_FUNC};
+    u_int64_t ids[TEST_ELEMS * 2];
+    void *params[TEST_ELEMS * 2];
+    elems_hash_t *ehash;
+    int i, calls = 0;
+
+    LOG_INF("Starting elems hash batch tests");
+
+    ehash = elems_hash_init(&memf, state_test_elem_create_cb, state_test_elem_free_cb);
+
+    /* every id goes twice, so the created elements are processed once more */
+    for (i = 0; i < TEST_ELEMS * 2; i++) {
+        ids[i] = i / 2;
+        params[i] = &calls;
+    }
+
+    assert(TEST_ELEMS * 2 == elems_hash_process_batch(ehash, ids, params, TEST_ELEMS * 2,
+            state_test_elem_count_cb, 0));
+    assert(TEST_ELEMS * 2 == calls);
+    assert(TEST_ELEMS == elems_hash_get_num(ehash));
+
+    /* the missing element is skipped when it must not be created */
+    calls = 0;
+    ids[0] = TEST_ELEMS * 2;
+    assert(TEST_ELEMS - 1 == elems_hash_process_batch(ehash, ids, params, TEST_ELEMS,
+            state_test_elem_count_cb, ELEM_FLAG_DO_NOT_CREATE));
+    assert(TEST_ELEMS - 1 == calls);
+    assert(TEST_ELEMS == elems_hash_get_num(ehash));
+
+    /* every element is processed as many times as its id is in the batches */
+    for (i = 0; i < TEST_ELEMS; i++) {
+        int expected = 2 + (0 == i ? 1 : (TEST_ELEMS / 2 > i ? 2 : 0));
+
+        assert(expected == elems_hash_process(ehash, i, state_test_elem_get_cb, NULL, ELEM_FLAG_DO_NOT_CREATE));
+    }
+
+    elems_hash_destroy(ehash);
+
+    LOG_INF("Elems hash batch tests are finished");
+}
+
+extern int CONFIG_VALUECACHE_COMPRESS;
+
+#define TEST_BLOCKS_PERIOD 100000
+#define TEST_BLOCKS_VALUES 1000
+
+/* the first value is kept alone at the start of the demanded period, the others
+   follow two per second, so the values are numbered by their order */
+static int state_test_blocks_sec(int base, int i)
+{
+    return 0 == i ? base : base + 10 + (i - 1) / 2;
+}
+
+static u_int64_t state_test_blocks_value(const zbx_history_record_t *record, int value_type)
+{
+    return ITEM_VALUE_TYPE_FLOAT == value_type ? (u_int64_t)record->value.dbl : record->value.ui64;
+}
+
+/* the fetched values must be the values from..to in the order of adding */
+static void state_test_blocks_check(zbx_vector_history_record_t *values, int value_type, int base, int from, int to)
+{
+    int i;
+
+    assert(to - from + 1 == values->values_num);
+
+    for (i = 0; i < values->values_num; i++) {
+        assert(from + i == (int)state_test_blocks_value(&values->values[i], value_type));
+        assert(state_test_blocks_sec(base, from + i) == values->values[i].timestamp.sec);
+    }
+
+    zbx_history_record_vector_clean(values, value_type);
+}
+
+static void state_test_items_block(u_int64_t itemid, int value_type, int now)
+{
+    ZBX_DC_HISTORY history = {0};
+    zbx_vector_history_record_t values;
+    zbx_vector_uint64_t itemids;
+    glb_state_item_agg_t agg = {0};
+    int i, compressed, tsbuff_count, base = now - TEST_BLOCKS_PERIOD;
+
+    zbx_history_record_vector_create(&values);
+
+    history.itemid = itemid;
+    history.value_type = value_type;
+    history.state = ITEM_STATE_NORMAL;
+
+    for (i = 0; i <= TEST_BLOCKS_VALUES; i++) {
+        history.ts.sec = state_test_blocks_sec(base, i);
+
+        if (ITEM_VALUE_TYPE_FLOAT == value_type)
+            history.value.dbl = i;
+        else
+            history.value.ui64 = i;
+
+        assert(SUCCEED == glb_state_item_add_values(&history, 1));
+
+        /* the demanded period keeps the old values from being freed from the full buffer */
+        if (0 == i) {
+            assert(SUCCEED == glb_state_item_get_values(itemid, value_type, &values, TEST_BLOCKS_PERIOD, 0, now));
+            state_test_blocks_check(&values, value_type, base, 0, 0);
+        }
+    }
+
+    /* the full buffer was sealed by the whole blocks, the newest values are left in the buffer */
+    compressed = glb_state_item_get_compressed_count(itemid);
+    assert(2 * GLB_TSBLOCK_MAX_VALUES < compressed && 0 == compressed % GLB_TSBLOCK_MAX_VALUES);
+    tsbuff_count = TEST_BLOCKS_VALUES + 1 - compressed;
+    assert(GLB_TSBLOCK_MAX_VALUES <= tsbuff_count);
+
+    /* count: all the values from the blocks and the buffer */
+    assert(SUCCEED == glb_state_item_get_values(itemid, value_type, &values, 0, TEST_BLOCKS_VALUES + 1, now));
+    state_test_blocks_check(&values, value_type, base, 0, TEST_BLOCKS_VALUES);
+
+    /* count: the buffer and the newest values of the last block */
+    assert(SUCCEED == glb_state_item_get_values(itemid, value_type, &values, 0, tsbuff_count + 5, now));
+    state_test_blocks_check(&values, value_type, base, compressed - 5, TEST_BLOCKS_VALUES);
+
+    /* count: the end is older than the buffer, the second of the end is included completely */
+    assert(SUCCEED == glb_state_item_get_values(itemid, value_type, &values, 0, 50,
+            state_test_blocks_sec(base, 99)));
+    state_test_blocks_check(&values, value_type, base, 51, 100);
+
+    /* time: the range starts in the blocks at the first value of the second and ends in the buffer */
+    assert(SUCCEED == glb_state_item_get_values(itemid, value_type, &values,
+            now - state_test_blocks_sec(base, 200), 0, now));
+    state_test_blocks_check(&values, value_type, base, 199, TEST_BLOCKS_VALUES);
+
+    /* time: the range is in the blocks only */
+    assert(SUCCEED == glb_state_item_get_values(itemid, value_type, &values,
+            state_test_blocks_sec(base, 300) - state_test_blocks_sec(base, 200), 0, state_test_blocks_sec(base, 300)));
+    state_test_blocks_check(&values, value_type, base, 199, 300);
+
+    /* the aggregates are calculated over the blocks in place */
+    assert(SUCCEED == glb_state_item_get_aggregate(itemid, value_type, &agg, 0, TEST_BLOCKS_VALUES + 1, now));
+    assert(TEST_BLOCKS_VALUES + 1 == agg.count);
+    assert(base == agg.first_sec && state_test_blocks_sec(base, TEST_BLOCKS_VALUES) == agg.last_sec);
+
+    if (ITEM_VALUE_TYPE_FLOAT == value_type)
+        assert(TEST_BLOCKS_VALUES * (TEST_BLOCKS_VALUES + 1) / 2 == agg.sum.dbl && TEST_BLOCKS_VALUES == agg.max.dbl);
+    else
+        assert(TEST_BLOCKS_VALUES * (TEST_BLOCKS_VALUES + 1) / 2 == agg.sum.ui64 && TEST_BLOCKS_VALUES == agg.max.ui64);
+
+    zbx_history_record_vector_destroy(&values, value_type);
+
+    zbx_vector_uint64_create(&itemids);
+    zbx_vector_uint64_append(&itemids, itemid);
+    glb_state_items_remove(&itemids);
+    zbx_vector_uint64_destroy(&itemids);
+}
+
+static void state_test_items_blocks(){
+    int now = time(NULL), compress = CONFIG_VALUECACHE_COMPRESS;
+
+    LOG_INF("Starting items blocks tests");
+
+    CONFIG_VALUECACHE_COMPRESS = 1;
+
+    state_test_items_block(TEST_ITEMID + 5, ITEM_VALUE_TYPE_FLOAT, now);
+    state_test_items_block(TEST_ITEMID + 6, ITEM_VALUE_TYPE_UINT64, now);
+
+    CONFIG_VALUECACHE_COMPRESS = compress;
+
+    LOG_INF("Items blocks tests are finished");
+}
+
 #ifdef HAVE_GLB_TESTS
 
 void glb_state_run_tests(void) {
 
 //    glb_state_hosts_interfaces_run_tests();
     state_test_triggers();
+    state_test_elems_batch();
+    state_test_items_batch();
+    state_test_items_windows();
+    state_test_items_blocks();
 }
 #endif
\ No newline at end of file
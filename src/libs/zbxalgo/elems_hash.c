@@ -26,8 +26,19 @@
 #define elem_unlock(elem) \
       glb_rwlock_unlock(&(elem)->rw_lock); 
 
+/* the top bits of the hash select the shard, the hashset slots depend on the whole hash */
+#define ELEMS_HASH_SHARD_BITS	4
+
+static int get_shard_idx(uint64_t id) {
+    return ZBX_DEFAULT_UINT64_HASH_FUNC(&id) >> (32 - ELEMS_HASH_SHARD_BITS);
+}
+
+static elems_hash_shard_t *get_shard(elems_hash_t *elems, uint64_t id) {
+    return &elems->shards[get_shard_idx(id)];
+}
+
 elems_hash_t *elems_hash_init(mem_funcs_t *memf, elems_hash_create_cb_t create_func, elems_hash_free_cb_t free_func ) {
-    
+    int i;
     mem_funcs_t local_memf = { .malloc_func = zbx_default_mem_malloc_func, 
             .free_func = zbx_default_mem_free_func, .realloc_func = zbx_default_mem_realloc_func};
     
@@ -36,22 +47,24 @@ elems_hash_t *elems_hash_init(mem_funcs_t *memf, elems_hash_create_cb_t create_f
 
     elems_hash_t *e_hash = (elems_hash_t *) (*memf->malloc_func)(NULL, sizeof(elems_hash_t));  
     
-    zbx_hashset_create_ext(&e_hash->elems, 0, ZBX_DEFAULT_UINT64_HASH_FUNC,
+    for (i = 0; i < ELEMS_HASH_SHARDS; i++) {
+        zbx_hashset_create_ext(&e_hash->shards[i].elems, 0, ZBX_DEFAULT_UINT64_HASH_FUNC,
             ZBX_DEFAULT_UINT64_COMPARE_FUNC, NULL, 
                             memf->malloc_func, memf->realloc_func, memf->free_func); 
+        glb_rwlock_init(&e_hash->shards[i].meta_lock);
+    }
   
     e_hash->elem_create_func = create_func;
     e_hash->elem_free_func = free_func;
     
-    glb_rwlock_init(&e_hash->meta_lock);
     e_hash->memf = *memf;
      return e_hash;
 }
 
-static int delete_element(elems_hash_t *elems, elems_hash_elem_t *elem) {
+static int delete_element(elems_hash_t *elems, elems_hash_shard_t *shard, elems_hash_elem_t *elem) {
     
     int ret = (*elems->elem_free_func)(elem, &elems->memf);
-    zbx_hashset_remove_direct(&elems->elems, elem);
+    zbx_hashset_remove_direct(&shard->elems, elem);
     
     return ret;
 }
@@ -60,29 +73,31 @@ void elems_hash_destroy(elems_hash_t *elems) {
     
     zbx_hashset_iter_t iter;
     elems_hash_elem_t *elem;
+    int i;
    
-    zbx_hashset_iter_reset(&elems->elems, &iter);
+    for (i = 0; i < ELEMS_HASH_SHARDS; i++) {
+        zbx_hashset_iter_reset(&elems->shards[i].elems, &iter);
     
-    while ( NULL != (elem = (elems_hash_elem_t*)zbx_hashset_iter_next(&iter))) 
-        (*elems->elem_free_func)(elem, &elems->memf);
+        while ( NULL != (elem = (elems_hash_elem_t*)zbx_hashset_iter_next(&iter))) 
+            (*elems->elem_free_func)(elem, &elems->memf);
    
-    
-    zbx_hashset_destroy(&elems->elems);
+        zbx_hashset_destroy(&elems->shards[i].elems);
+    }
    
     (*elems->memf.free_func)(elems);
 }
 
-elems_hash_elem_t *create_element(elems_hash_t *elems,  uint64_t id, void *data ) {
+static elems_hash_elem_t *create_element(elems_hash_t *elems, elems_hash_shard_t *shard, uint64_t id, void *data ) {
     elems_hash_elem_t *elem, elem_local = {.id = id, .data = data };
     
-    if (NULL == (elem = zbx_hashset_search(&elems->elems, &elem_local))) {  
+    if (NULL == (elem = zbx_hashset_search(&shard->elems, &elem_local))) {  
 
         glb_rwlock_init(&elem_local.rw_lock);
         glb_rwlock_wrlock(&elem_local.rw_lock);
 
         (*elems->elem_create_func)(&elem_local, &elems->memf, data);
 
-        elem = zbx_hashset_insert(&elems->elems,&elem_local,sizeof(elems_hash_elem_t) );
+        elem = zbx_hashset_insert(&shard->elems,&elem_local,sizeof(elems_hash_elem_t) );
     
     } else {
         elem = NULL;
@@ -95,28 +110,29 @@ int elems_hash_process(elems_hash_t *elems, uint64_t id, elems_hash_process_cb_t
     
     int ret;
     elems_hash_elem_t *elem;
+    elems_hash_shard_t *shard = get_shard(elems, id);
     
 	if (NULL == process_func)
 		return FAIL;
 
-	glb_rwlock_rdlock(&elems->meta_lock);
+	glb_rwlock_rdlock(&shard->meta_lock);
 
-    if (NULL == (elem = zbx_hashset_search(&elems->elems, &id))) {
+    if (NULL == (elem = zbx_hashset_search(&shard->elems, &id))) {
 
-        glb_rwlock_unlock(&elems->meta_lock);
+        glb_rwlock_unlock(&shard->meta_lock);
 		
         if ( 1 == (flags & ELEM_FLAG_DO_NOT_CREATE))
             return FAIL;
 
-        glb_rwlock_wrlock(&elems->meta_lock);
+        glb_rwlock_wrlock(&shard->meta_lock);
 
-        if (NULL == ( elem = create_element( elems, id, params ))) {
-            glb_rwlock_unlock(&elems->meta_lock);
+        if (NULL == ( elem = create_element( elems, shard, id, params ))) {
+            glb_rwlock_unlock(&shard->meta_lock);
         	return FAIL;
         }
 	
-        glb_rwlock_unlock(&elems->meta_lock);
-        glb_rwlock_rdlock(&elems->meta_lock);
+        glb_rwlock_unlock(&shard->meta_lock);
+        glb_rwlock_rdlock(&shard->meta_lock);
 
 	}  else  
         elem_lock(elem, flags);
@@ -125,57 +141,184 @@ int elems_hash_process(elems_hash_t *elems, uint64_t id, elems_hash_process_cb_t
         
     if ( 1 == (elem->flags & ELEM_FLAG_DELETE)) {
 
-        glb_rwlock_unlock(&elems->meta_lock);
-        glb_rwlock_wrlock(&elems->meta_lock);
+        glb_rwlock_unlock(&shard->meta_lock);
+        glb_rwlock_wrlock(&shard->meta_lock);
         
-        delete_element(elems, elem);
+        delete_element(elems, shard, elem);
         
-        glb_rwlock_unlock(&elems->meta_lock);
+        glb_rwlock_unlock(&shard->meta_lock);
         return ret;
     }
 
     elem_unlock(elem);
-    glb_rwlock_unlock(&elems->meta_lock);
+    glb_rwlock_unlock(&shard->meta_lock);
 
 	return ret;
 }
 
+/* stable ordering of the ids positions by the shard, offsets has ELEMS_HASH_SHARDS + 1 entries */
+static void order_by_shards(const uint64_t *ids, int num, int *order, int *offsets) {
+    int i, *shard_idx = zbx_malloc(NULL, sizeof(int) * num);
+
+    memset(offsets, 0, sizeof(int) * (ELEMS_HASH_SHARDS + 1));
+
+    for (i = 0; i < num; i++) {
+        shard_idx[i] = get_shard_idx(ids[i]);
+        offsets[shard_idx[i] + 1]++;
+    }
+
+    for (i = 0; i < ELEMS_HASH_SHARDS; i++)
+        offsets[i + 1] += offsets[i];
+
+    for (i = 0; i < num; i++)
+        order[offsets[shard_idx[i]]++] = i;
+
+    for (i = ELEMS_HASH_SHARDS; i > 0; i--)
+        offsets[i] = offsets[i - 1];
+
+    offsets[0] = 0;
+    zbx_free(shard_idx);
+}
+
+/******************************************************************************
+ * processes num elements with one shard lock per the shard, ids are expected *
+ * to be sorted so the same element's calls go one after another in the      *
+ * given order, data[i] (or NULL if data is NULL) is passed to the callback   *
+ * for the ids[i], returns number of elements processed                       *
+ ******************************************************************************/
+int elems_hash_process_batch(elems_hash_t *elems, const uint64_t *ids, void **data, int num,
+        elems_hash_process_cb_t process_func, u_int64_t flags) {
+    
+    int s, i, count = 0, *order, *delayed, delayed_num, offsets[ELEMS_HASH_SHARDS + 1];
+    elems_hash_elem_t *elem;
+
+    if (NULL == process_func || 0 >= num)
+        return 0;
+
+    order = zbx_malloc(NULL, sizeof(int) * num);
+    delayed = zbx_malloc(NULL, sizeof(int) * num);
+    order_by_shards(ids, num, order, offsets);
+
+    for (s = 0; s < ELEMS_HASH_SHARDS; s++) {
+        elems_hash_shard_t *shard = &elems->shards[s];
+
+        if (offsets[s] == offsets[s + 1])
+            continue;
+
+        delayed_num = 0;
+        glb_rwlock_rdlock(&shard->meta_lock);
+
+        for (i = offsets[s]; i < offsets[s + 1]; i++) {
+            int pos = order[i];
+
+            /* the element will be created or deleted under the write lock, all its calls go there */
+            if (0 < delayed_num && ids[delayed[delayed_num - 1]] == ids[pos]) {
+                delayed[delayed_num++] = pos;
+                continue;
+            }
+
+            if (NULL == (elem = zbx_hashset_search(&shard->elems, &ids[pos]))) {
+                if (0 == (flags & ELEM_FLAG_DO_NOT_CREATE))
+                    delayed[delayed_num++] = pos;
+                continue;
+            }
+
+            elem_lock(elem, flags);
+            process_func(elem, &elems->memf, NULL == data ? NULL : data[pos]);
+
+            if (0 != (elem->flags & ELEM_FLAG_DELETE))
+                delayed[delayed_num++] = pos;
+
+            elem_unlock(elem);
+            count++;
+        }
+
+        glb_rwlock_unlock(&shard->meta_lock);
+
+        if (0 == delayed_num)
+            continue;
+
+        glb_rwlock_wrlock(&shard->meta_lock);
+
+        for (i = 0; i < delayed_num; i++) {
+            int pos = delayed[i];
+            void *params = NULL == data ? NULL : data[pos];
+
+            if (NULL != (elem = zbx_hashset_search(&shard->elems, &ids[pos]))) {
+                if (0 != (elem->flags & ELEM_FLAG_DELETE)) {
+                    delete_element(elems, shard, elem);
+                    continue;
+                }
+                elem_lock(elem, flags);
+            } else if (0 != (flags & ELEM_FLAG_DO_NOT_CREATE) ||
+                    NULL == (elem = create_element(elems, shard, ids[pos], params)))
+                continue;
+
+            process_func(elem, &elems->memf, params);
+            elem_unlock(elem);
+            count++;
+
+            if (0 != (elem->flags & ELEM_FLAG_DELETE))
+                delete_element(elems, shard, elem);
+        }
+
+        glb_rwlock_unlock(&shard->meta_lock);
+    }
+
+    zbx_free(delayed);
+    zbx_free(order);
+
+    return count;
+}
+
 int elems_hash_delete(elems_hash_t *elems, uint64_t id) {
     elems_hash_elem_t *elem;
+    elems_hash_shard_t *shard = get_shard(elems, id);
     int ret = SUCCEED;
 
-    glb_rwlock_wrlock(&elems->meta_lock);
+    glb_rwlock_wrlock(&shard->meta_lock);
     
-    elem = zbx_hashset_search(&elems->elems, &id);
+    elem = zbx_hashset_search(&shard->elems, &id);
     if (NULL != elem) 
-      ret = delete_element(elems, elem);
+      ret = delete_element(elems, shard, elem);
     else 
       ret = FAIL;
     
-    glb_rwlock_unlock(&elems->meta_lock);
+    glb_rwlock_unlock(&shard->meta_lock);
     return ret;
 }
 
 int elems_hash_mass_delete(elems_hash_t *elems, zbx_vector_uint64_t *ids) {
     elems_hash_elem_t *elem;
-    int i, count = 0;
+    int s, i, count = 0, *order, offsets[ELEMS_HASH_SHARDS + 1];
 
     if (0 == ids->values_num)
         return 0;
 
-    glb_rwlock_wrlock(&elems->meta_lock);
+    order = zbx_malloc(NULL, sizeof(int) * ids->values_num);
+    order_by_shards(ids->values, ids->values_num, order, offsets);
 
-    for (i = 0; i<ids->values_num; i++) {
+    for (s = 0; s < ELEMS_HASH_SHARDS; s++) {
+        elems_hash_shard_t *shard = &elems->shards[s];
 
-        if (NULL != (elem = zbx_hashset_search(&elems->elems, &ids->values[i])));
-        {
-            //LOG_INF("Deleting element id %ld", elem->id);
-            delete_element(elems, elem);
-            count++;
+        if (offsets[s] == offsets[s + 1])
+            continue;
+
+        glb_rwlock_wrlock(&shard->meta_lock);
+
+        for (i = offsets[s]; i < offsets[s + 1]; i++) {
+            if (NULL != (elem = zbx_hashset_search(&shard->elems, &ids->values[order[i]])))
+            {
+                //LOG_INF("Deleting element id %ld", elem->id);
+                delete_element(elems, shard, elem);
+                count++;
+            }
         }
+
+        glb_rwlock_unlock(&shard->meta_lock);
     }
 
-    glb_rwlock_unlock(&elems->meta_lock);
+    zbx_free(order);
     return count;
 }
 
@@ -226,13 +369,16 @@ int elems_hash_update(elems_hash_t *elems, elems_hash_t *new_elems, elems_hash_u
 void elems_hash_replace(elems_hash_t *old_elems, elems_hash_t *new_elems) {
    
     zbx_hashset_t tmp_hset;
+    int i;
     
-    glb_rwlock_wrlock(&old_elems->meta_lock);
-    glb_rwlock_wrlock(&new_elems->meta_lock);
-    memcpy(&tmp_hset, &old_elems->elems, sizeof(zbx_hashset_t));
-    memcpy(&old_elems->elems, &new_elems->elems,sizeof(zbx_hashset_t));
-    memcpy(&new_elems->elems, &tmp_hset, sizeof(zbx_hashset_t));
-    glb_rwlock_unlock(&old_elems->meta_lock);
+    for (i = 0; i < ELEMS_HASH_SHARDS; i++) {
+        glb_rwlock_wrlock(&old_elems->shards[i].meta_lock);
+        glb_rwlock_wrlock(&new_elems->shards[i].meta_lock);
+        memcpy(&tmp_hset, &old_elems->shards[i].elems, sizeof(zbx_hashset_t));
+        memcpy(&old_elems->shards[i].elems, &new_elems->shards[i].elems,sizeof(zbx_hashset_t));
+        memcpy(&new_elems->shards[i].elems, &tmp_hset, sizeof(zbx_hashset_t));
+        glb_rwlock_unlock(&old_elems->shards[i].meta_lock);
+    }
     elems_hash_destroy(new_elems);
   
 }   
@@ -242,41 +388,47 @@ int elems_hash_iterate(elems_hash_t *elems, elems_hash_process_cb_t proc_func, v
     elems_hash_elem_t *elem;
     int last_ret = SUCCEED;
     zbx_hashset_iter_t iter;
-    int count = 0;
+    int count = 0, i;
 
-    glb_rwlock_rdlock(&elems->meta_lock);
+    for (i = 0; i < ELEMS_HASH_SHARDS; i++) {
+        glb_rwlock_rdlock(&elems->shards[i].meta_lock);
 
-    zbx_hashset_iter_reset(&elems->elems, &iter);
+        zbx_hashset_iter_reset(&elems->shards[i].elems, &iter);
     
-    while ( (NULL !=(elem = (elems_hash_elem_t*) zbx_hashset_iter_next(&iter))) &&
-            SUCCEED == last_ret ) {
-        elem_lock(elem, flags);
-        (*proc_func)(elem, &elems->memf, params);
-        elem_unlock(elem);
-        count++;
-    }
+        while ( (NULL !=(elem = (elems_hash_elem_t*) zbx_hashset_iter_next(&iter))) &&
+                SUCCEED == last_ret ) {
+            elem_lock(elem, flags);
+            (*proc_func)(elem, &elems->memf, params);
+            elem_unlock(elem);
+            count++;
+        }
     
-    glb_rwlock_unlock(&elems->meta_lock);
+        glb_rwlock_unlock(&elems->shards[i].meta_lock);
+    }
     return count;
 }
 
 int  elems_hash_get_num(elems_hash_t *elems) {
-    int num_data = 0;
-    glb_rwlock_rdlock(&elems->meta_lock);
-    num_data = elems->elems.num_data;
-    glb_rwlock_unlock(&elems->meta_lock);
+    int num_data = 0, i;
+
+    for (i = 0; i < ELEMS_HASH_SHARDS; i++) {
+        glb_rwlock_rdlock(&elems->shards[i].meta_lock);
+        num_data += elems->shards[i].elems.num_data;
+        glb_rwlock_unlock(&elems->shards[i].meta_lock);
+    }
 
     return num_data;
 }
 
 int elems_hash_id_exists(elems_hash_t *elems, u_int64_t id) {
     int ret = FAIL;
+    elems_hash_shard_t *shard = get_shard(elems, id);
 
-    glb_rwlock_rdlock(&elems->meta_lock);
+    glb_rwlock_rdlock(&shard->meta_lock);
     
-    if (NULL != zbx_hashset_search(&elems->elems, &id))
+    if (NULL != zbx_hashset_search(&shard->elems, &id))
         ret = SUCCEED;
 
-    glb_rwlock_unlock(&elems->meta_lock);
+    glb_rwlock_unlock(&shard->meta_lock);
     return ret;
-}
\ No newline at end of file
+}
@@ -249,5 +249,5 @@ void obj_index_dump(obj_index_t *idx) {
 }
 
 int obj_index_get_numdata(obj_index_t *idx) {
-    return idx->from_to->elems.num_data;
+    return elems_hash_get_num(idx->from_to);
 }
\ No newline at end of file
@@ -22,15 +22,18 @@
 #include "zbxalgo.h"
 #include "elems_hash_tests.h"
 #include "obj_index_tests.h"
+#include "ts_block_tests.h"
 
 #include "elems_hash_tests.c"
 #include "obj_index_tests.c"
+#include "ts_block_tests.c"
 
 void tests_algo_run() {
     LOG_INF("Running algo tests");
     sleep(1);
     tests_elems_hash_run();
     tests_obj_index_run();
+    tests_ts_block_run();
     LOG_INF("Finished algo tests");
 }
 
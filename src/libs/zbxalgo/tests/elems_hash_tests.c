@@ -85,7 +85,6 @@ void test_records_create_del_leak() {
     LOG_INF("test %s SUCCEDED", __func__);
 }
 
-
 void   tests_elems_hash_run(void) {
     LOG_INF("%s Running TESTS", __func__);
     init();
@@ -0,0 +1,117 @@
+/*
+** Glaber
+** Copyright (C) 2018-2042 Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "log.h"
+#include "zbxalgo.h"
+
+#define TEST_TSBLOCK_SERIES 6
+
+static void	fill_series(glb_tsbuff_value_t *values, int count, int kind)
+{
+	int	i, time = 1700000000;
+
+	for (i = 0; i < count; i++)
+	{
+		double	dbl;
+
+		switch (kind)
+		{
+			case 0: /* constant value, regular interval */
+				time += 60;
+				values[i].value = 42;
+				break;
+			case 1: /* slowly changing float, jittered interval */
+				time += 30 + (i % 3) - 1;
+				dbl = 20.5 + (double)(i % 10) / 4;
+				memcpy(&values[i].value, &dbl, sizeof(dbl));
+				break;
+			case 2: /* growing counter, several values per second */
+				time += (0 == i % 4 ? 1 : 0);
+				values[i].value = (u_int64_t)i * 1000;
+				break;
+			case 3: /* random values and large gaps */
+				time += rand() % 100000;
+				values[i].value = ((u_int64_t)rand() << 32) | (u_int64_t)rand();
+				break;
+			case 4: /* all 64 bits are meaningful */
+				time += 1;
+				values[i].value = (0 == i % 2 ? 0 : ~(u_int64_t)0);
+				break;
+			default: /* negative delta of deltas */
+				time += (0 == i % 2 ? 3000 : 1);
+				dbl = -1.0 / (i + 1);
+				memcpy(&values[i].value, &dbl, sizeof(dbl));
+				break;
+		}
+
+		values[i].sec = time;
+	}
+}
+
+static void	test_roundtrip(void)
+{
+	glb_tsbuff_value_t	values[GLB_TSBLOCK_MAX_VALUES], value;
+	glb_tsblock_reader_t	reader;
+	glb_tsblock_t		*block;
+	int			kind, count, i;
+
+	LOG_INF("running test %s", __func__);
+
+	for (kind = 0; kind < TEST_TSBLOCK_SERIES; kind++)
+	{
+		for (count = 1; count <= GLB_TSBLOCK_MAX_VALUES; count += 7)
+		{
+			fill_series(values, count, kind);
+
+			if (NULL == (block = glb_tsblock_create(values, count, ZBX_DEFAULT_MEM_MALLOC_FUNC)))
+				HALT_HERE("Couldn't create block for series %d of %d values", kind, count);
+
+			if (block->first_time != (int)values[0].sec || block->last_time != (int)values[count - 1].sec)
+				HALT_HERE("Wrong block time range for series %d", kind);
+
+			glb_tsblock_reader_init(&reader, block);
+
+			for (i = 0; SUCCEED == glb_tsblock_reader_next(&reader, &value); i++)
+			{
+				if (i >= count || value.sec != values[i].sec || value.value != values[i].value)
+					HALT_HERE("Series %d of %d values differs at value %d", kind, count, i);
+			}
+
+			if (i != count)
+				HALT_HERE("Series %d decoded %d values instead of %d", kind, i, count);
+
+			if (0 == kind && GLB_TSBLOCK_MAX_VALUES - 1 == count &&
+					glb_tsblock_get_size(block) > sizeof(glb_tsbuff_value_t) * count / 8)
+				HALT_HERE("Constant series isn't compressed: %d bytes", (int)glb_tsblock_get_size(block));
+
+			glb_tsblock_destroy(block, ZBX_DEFAULT_MEM_FREE_FUNC);
+		}
+	}
+
+	if (NULL != glb_tsblock_create(values, GLB_TSBLOCK_MAX_VALUES + 1, ZBX_DEFAULT_MEM_MALLOC_FUNC))
+		HALT_HERE("Block shouldn't accept more than %d values", GLB_TSBLOCK_MAX_VALUES);
+
+	LOG_INF("test %s SUCCEDED", __func__);
+}
+
+void	tests_ts_block_run(void)
+{
+	LOG_INF("Running ts block tests");
+	test_roundtrip();
+}
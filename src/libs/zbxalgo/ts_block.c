@@ -0,0 +1,266 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+/* sealed blocks of numeric time series compressed the "Gorilla" way:
+   timestamps are stored as delta-of-delta with variable length prefixes,
+   values are XORed with the previous one and only the meaningful bits
+   of the result are written. Values are opaque 64 bit words, so both
+   doubles and unsigned integers are handled the same way */
+
+#include "zbxcommon.h"
+#include "zbxalgo.h"
+#include "log.h"
+
+/* worst case per value: 4 + 32 bits of time, 2 + 5 + 6 + 64 bits of value */
+#define TSBLOCK_MAX_VALUE_BITS	113
+#define TSBLOCK_HEADER_BITS	96
+
+typedef struct {
+	unsigned char	*data;
+	size_t		pos;
+} tsblock_writer_t;
+
+static void	writer_put_bits(tsblock_writer_t *writer, u_int64_t bits, int num)
+{
+	while (0 < num)
+	{
+		int	free_bits = 8 - (writer->pos & 7), put = MIN(num, free_bits);
+		unsigned char	chunk = (unsigned char)((bits >> (num - put)) & ((1u << put) - 1));
+
+		writer->data[writer->pos >> 3] |= (unsigned char)(chunk << (free_bits - put));
+		writer->pos += put;
+		num -= put;
+	}
+}
+
+static u_int64_t	reader_get_bits(glb_tsblock_reader_t *reader, int num)
+{
+	u_int64_t	bits = 0;
+
+	while (0 < num)
+	{
+		int	left_bits = 8 - (reader->pos & 7), get = MIN(num, left_bits);
+		unsigned char	byte = reader->block->data[reader->pos >> 3];
+
+		bits = (bits << get) | ((byte >> (left_bits - get)) & ((1u << get) - 1));
+		reader->pos += get;
+		num -= get;
+	}
+
+	return bits;
+}
+
+static int	bits_leading_zeros(u_int64_t value)
+{
+	return __builtin_clzll(value);
+}
+
+static int	bits_trailing_zeros(u_int64_t value)
+{
+	return __builtin_ctzll(value);
+}
+
+static void	writer_put_time(tsblock_writer_t *writer, int dod)
+{
+	if (0 == dod)
+		writer_put_bits(writer, 0, 1);
+	else if (-63 <= dod && 64 >= dod)
+	{
+		writer_put_bits(writer, 0x2, 2);
+		writer_put_bits(writer, (u_int64_t)(dod + 63), 7);
+	}
+	else if (-255 <= dod && 256 >= dod)
+	{
+		writer_put_bits(writer, 0x6, 3);
+		writer_put_bits(writer, (u_int64_t)(dod + 255), 9);
+	}
+	else if (-2047 <= dod && 2048 >= dod)
+	{
+		writer_put_bits(writer, 0xE, 4);
+		writer_put_bits(writer, (u_int64_t)(dod + 2047), 12);
+	}
+	else
+	{
+		writer_put_bits(writer, 0xF, 4);
+		writer_put_bits(writer, (u_int64_t)(unsigned int)dod, 32);
+	}
+}
+
+static int	reader_get_time(glb_tsblock_reader_t *reader)
+{
+	if (0 == reader_get_bits(reader, 1))
+		return 0;
+
+	if (0 == reader_get_bits(reader, 1))
+		return (int)reader_get_bits(reader, 7) - 63;
+
+	if (0 == reader_get_bits(reader, 1))
+		return (int)reader_get_bits(reader, 9) - 255;
+
+	if (0 == reader_get_bits(reader, 1))
+		return (int)reader_get_bits(reader, 12) - 2047;
+
+	return (int)(unsigned int)reader_get_bits(reader, 32);
+}
+
+static void	writer_put_value(tsblock_writer_t *writer, u_int64_t xor, int *leading, int *trailing)
+{
+	int	new_leading, new_trailing;
+
+	if (0 == xor)
+	{
+		writer_put_bits(writer, 0, 1);
+		return;
+	}
+
+	writer_put_bits(writer, 1, 1);
+
+	new_leading = MIN(bits_leading_zeros(xor), 31);
+	new_trailing = bits_trailing_zeros(xor);
+
+	/* reuse previous meaningful bits window when the value fits in it */
+	if (-1 != *leading && new_leading >= *leading && new_trailing >= *trailing)
+	{
+		writer_put_bits(writer, 0, 1);
+		writer_put_bits(writer, xor >> *trailing, 64 - *leading - *trailing);
+		return;
+	}
+
+	writer_put_bits(writer, 1, 1);
+	writer_put_bits(writer, (u_int64_t)new_leading, 5);
+	/* 64 meaningful bits don't fit 6 bits and are written as 0 */
+	writer_put_bits(writer, (u_int64_t)((64 - new_leading - new_trailing) & 0x3F), 6);
+	writer_put_bits(writer, xor >> new_trailing, 64 - new_leading - new_trailing);
+
+	*leading = new_leading;
+	*trailing = new_trailing;
+}
+
+static u_int64_t	reader_get_value(glb_tsblock_reader_t *reader)
+{
+	int	meaningful;
+
+	if (0 == reader_get_bits(reader, 1))
+		return 0;
+
+	if (1 == reader_get_bits(reader, 1))
+	{
+		reader->leading = (int)reader_get_bits(reader, 5);
+
+		if (0 == (meaningful = (int)reader_get_bits(reader, 6)))
+			meaningful = 64;
+
+		reader->trailing = 64 - reader->leading - meaningful;
+	}
+
+	return reader_get_bits(reader, 64 - reader->leading - reader->trailing) << reader->trailing;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compresses count (up to GLB_TSBLOCK_MAX_VALUES) values sorted by  *
+ *          time into a new block, returns NULL on invalid input              *
+ *                                                                            *
+ ******************************************************************************/
+glb_tsblock_t	*glb_tsblock_create(const glb_tsbuff_value_t *values, int count, zbx_mem_malloc_func_t malloc_func)
+{
+	unsigned char		buffer[(TSBLOCK_HEADER_BITS + TSBLOCK_MAX_VALUE_BITS * GLB_TSBLOCK_MAX_VALUES) / 8 + 1];
+	tsblock_writer_t	writer = {.data = buffer, .pos = 0};
+	glb_tsblock_t		*block;
+	int			i, delta = 0, leading = -1, trailing = 0;
+	size_t			size;
+
+	if (0 >= count || GLB_TSBLOCK_MAX_VALUES < count)
+		return NULL;
+
+	memset(buffer, 0, sizeof(buffer));
+
+	writer_put_bits(&writer, values[0].sec, 32);
+	writer_put_bits(&writer, values[0].value, 64);
+
+	for (i = 1; i < count; i++)
+	{
+		int	new_delta = (int)(values[i].sec - values[i - 1].sec);
+
+		writer_put_time(&writer, new_delta - delta);
+		writer_put_value(&writer, values[i].value ^ values[i - 1].value, &leading, &trailing);
+		delta = new_delta;
+	}
+
+	size = (writer.pos + 7) / 8;
+
+	if (NULL == (block = malloc_func(NULL, sizeof(glb_tsblock_t) + size)))
+		return NULL;
+
+	block->first_time = (int)values[0].sec;
+	block->last_time = (int)values[count - 1].sec;
+	block->count = (unsigned short)count;
+	block->size = (unsigned short)size;
+	memcpy(block->data, buffer, size);
+
+	return block;
+}
+
+void	glb_tsblock_destroy(glb_tsblock_t *block, zbx_mem_free_func_t free_func)
+{
+	free_func(block);
+}
+
+size_t	glb_tsblock_get_size(const glb_tsblock_t *block)
+{
+	return sizeof(glb_tsblock_t) + block->size;
+}
+
+void	glb_tsblock_reader_init(glb_tsblock_reader_t *reader, const glb_tsblock_t *block)
+{
+	memset(reader, 0, sizeof(glb_tsblock_reader_t));
+	reader->block = block;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: decodes the next value of the block in time ascending order       *
+ *                                                                            *
+ * Return value: SUCCEED - the value is decoded                               *
+ *               FAIL    - all values of the block has been read              *
+ *                                                                            *
+ ******************************************************************************/
+int	glb_tsblock_reader_next(glb_tsblock_reader_t *reader, glb_tsbuff_value_t *value)
+{
+	if (reader->idx >= reader->block->count)
+		return FAIL;
+
+	if (0 == reader->idx)
+	{
+		reader->time = (int)reader_get_bits(reader, 32);
+		reader->value = reader_get_bits(reader, 64);
+	}
+	else
+	{
+		reader->delta += reader_get_time(reader);
+		reader->time += reader->delta;
+		reader->value ^= reader_get_value(reader);
+	}
+
+	reader->idx++;
+
+	value->sec = (unsigned int)reader->time;
+	value->value = reader->value;
+
+	return SUCCEED;
+}
@@ -162,6 +162,16 @@ static int glb_might_be_async_polled( const ZBX_DC_ITEM *zbx_dc_item,const ZBX_D
 
 			return SUCCEED;
 
+		case ITEM_TYPE_HTTPAGENT:
+#ifdef HAVE_LIBCURL
+			if (0 < CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP]) {
+				DEBUG_ITEM(zbx_dc_item->itemid, "Item can be async polled");
+				return SUCCEED;
+			}
+#endif
+			DEBUG_ITEM(zbx_dc_item->itemid, "Item can not be async polled");
+			return FAIL;
+
 		case ITEM_TYPE_SNMP: {
 			ZBX_DC_SNMPINTERFACE *snmp_iface;
 #ifdef HAVE_NETSNMP				
@@ -9792,6 +9802,23 @@ static void	dc_preproc_sync_item(zbx_hashset_t *items, ZBX_DC_ITEM *dc_item, zbx
 		zbx_pp_item_preproc_release(pp_item->preproc);
 	}
 
+	/* masters are synced before their dependent items, the master's jsonpaths set
+	   has to be collected again with the dependent item's new steps */
+	if (ITEM_TYPE_DEPENDENT == dc_item->type)
+	{
+		const ZBX_DC_DEPENDENTITEM	*depitem;
+		zbx_pp_item_t			*master_pp_item;
+
+		if (NULL != (depitem = (ZBX_DC_DEPENDENTITEM *)zbx_hashset_search(&config->dependentitems,
+				&dc_item->itemid)) && NULL != (master_pp_item = (zbx_pp_item_t *)zbx_hashset_search(items,
+				&depitem->master_itemid)) && NULL != master_pp_item->preproc)
+		{
+			DEBUG_ITEM(depitem->master_itemid, "Dependent item " ZBX_FS_UI64 " preprocessing has changed, "
+					"dropping the collected jsonpaths", dc_item->itemid);
+			zbx_pp_item_preproc_clear_dep_jsonpaths(master_pp_item->preproc);
+		}
+	}
+
 	for (int i = 0; i < preproc->steps_num; i++)
 	{
 		if (SUCCEED == zbx_pp_preproc_has_history(preproc->steps[i].type))
@@ -9886,9 +9913,14 @@ static void	dc_preproc_add_item_rec(ZBX_DC_ITEM *dc_item, zbx_vector_dc_item_ptr
  *                                                                            *
  * Parameters: items       - [IN/OUT] hashset with DC_ITEMs                   *
  *             timestamp   - [IN/OUT] timestamp of a last update              *
+ *             filter_func - [IN] selects the items of the caller by itemid   *
+ *                                and number of dependent items, dependent    *
+ *                                items follow their master, NULL - all items *
+ *             filter_data - [IN] filter_func argument                        *
  *                                                                            *
  ******************************************************************************/
-void DCconfig_get_preprocessable_items(zbx_hashset_t *items, zbx_uint64_t *revision, int manager_num)
+void DCconfig_get_preprocessable_items(zbx_hashset_t *items, zbx_uint64_t *revision,
+		zbx_dc_item_filter_func_t filter_func, void *filter_data)
 {
 	ZBX_DC_HOST *dc_host;
 	zbx_pp_item_t			*pp_item;
@@ -9915,9 +9947,6 @@ void DCconfig_get_preprocessable_items(zbx_hashset_t *items, zbx_uint64_t *revis
 		//alive check
 		if (HOST_STATUS_MONITORED != dc_host->status)
 			continue;
-		//only the process config fetching
-		if (manager_num >= 0  && (dc_host->hostid % CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR]) != (manager_num - 1))
-			continue;
 		
 		//iterating on all hosts items
 		for (i = 0; i < dc_host->items.values_num; i++)
@@ -9927,6 +9956,11 @@ void DCconfig_get_preprocessable_items(zbx_hashset_t *items, zbx_uint64_t *revis
 			if (ITEM_STATUS_ACTIVE != dc_item->status || ITEM_TYPE_DEPENDENT == dc_item->type)
 				continue;
 
+			//only the process config fetching
+			if (NULL != filter_func && SUCCEED != filter_func(dc_item->itemid, NULL == dc_item->master_item ?
+					0 : dc_item->master_item->dep_itemids.values_num, filter_data))
+				continue;
+
 			if (NULL == dc_item->preproc_item && NULL == dc_item->master_item &&
 					ITEM_TYPE_INTERNAL != dc_item->type &&
 					ZBX_FLAG_DISCOVERY_RULE != dc_item->flags)
@@ -9941,7 +9975,7 @@ void DCconfig_get_preprocessable_items(zbx_hashset_t *items, zbx_uint64_t *revis
 			dc_preproc_add_item_rec(dc_item, &items_sync);
 			
 			//just a log
-			if (manager_num >= 0 && dc_item->master_itemid > 0)  
+			if (NULL != filter_func && dc_item->master_itemid > 0)  
 				LOG_INF("Processing item %ld, has master item %ld", dc_item->itemid, dc_item->master_itemid);
 			
 		}
@@ -15471,6 +15505,24 @@ zbx_uint64_t zbx_dc_get_received_revision(void)
 	return config->revision.upstream;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get the configuration cache revision, it is increased on every   *
+ *          sync, so caches built from the configuration know when to be     *
+ *          rebuilt                                                           *
+ *                                                                            *
+ ******************************************************************************/
+zbx_uint64_t zbx_dc_get_config_revision(void)
+{
+	zbx_uint64_t revision;
+
+	RDLOCK_CACHE;
+	revision = config->revision.config;
+	UNLOCK_CACHE;
+
+	return revision;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: cache the configuration revision received from server             *
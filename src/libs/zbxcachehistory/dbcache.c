@@ -38,7 +38,9 @@
 #include "glb_preproc.h"
 #include "metric.h"
 #include "../zabbix_server/dbsyncer/trends.h"
+#include "../zabbix_server/dbsyncer/history_writer.h"
 #include "zbxconnector.h"
+#include "zbxproxyjournal.h"
 
 static zbx_shmem_info_t *hc_index_mem = NULL;
 
@@ -1369,6 +1371,103 @@ static void DBmass_proxy_add_history(ZBX_DC_HISTORY *history, int history_num)
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes history data to the proxy history journal, the records     *
+ *          are the same as the rows DBmass_proxy_add_history() inserts       *
+ *                                                                            *
+ * Parameters: history     - array of history data                            *
+ *             history_num - number of history structures                     *
+ *                                                                            *
+ ******************************************************************************/
+static void dc_journal_proxy_history(ZBX_DC_HISTORY *history, int history_num)
+{
+	int i;
+	char buffer[64];
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
+
+	for (i = 0; i < history_num; i++)
+	{
+		const ZBX_DC_HISTORY *h = &history[i];
+		zbx_proxy_journal_record_t record = {0};
+
+		record.itemid = h->itemid;
+		record.clock = h->ts.sec;
+		record.ns = h->ts.ns;
+		record.source = "";
+		record.value = "";
+
+		if (ITEM_STATE_NOTSUPPORTED == h->state)
+		{
+			record.state = h->state;
+			record.value = ZBX_NULL2EMPTY_STR(h->value.err);
+		}
+		else if (ITEM_VALUE_TYPE_LOG == h->value_type)
+		{
+			if (0 == (h->flags & ZBX_DC_FLAG_NOVALUE))
+			{
+				zbx_log_value_t *log = h->value.log;
+
+				record.timestamp = log->timestamp;
+				record.source = ZBX_NULL2EMPTY_STR(log->source);
+				record.severity = log->severity;
+				record.value = log->value;
+				record.logeventid = log->logeventid;
+
+				if (0 != (h->flags & ZBX_DC_FLAG_META))
+					record.flags = PROXY_HISTORY_FLAG_META;
+			}
+			else
+				record.flags = PROXY_HISTORY_FLAG_META | PROXY_HISTORY_FLAG_NOVALUE;
+		}
+		else
+		{
+			if (0 != (h->flags & ZBX_DC_FLAG_UNDEF))
+				continue;
+
+			if (0 != (h->flags & ZBX_DC_FLAG_META))
+				record.flags = PROXY_HISTORY_FLAG_META;
+
+			if (0 == (h->flags & ZBX_DC_FLAG_NOVALUE) && h->value_type != ITEM_VALUE_TYPE_NONE)
+			{
+				switch (h->value_type)
+				{
+				case ITEM_VALUE_TYPE_FLOAT:
+					zbx_snprintf(buffer, sizeof(buffer), ZBX_FS_DBL64, h->value.dbl);
+					record.value = buffer;
+					break;
+				case ITEM_VALUE_TYPE_UINT64:
+					zbx_snprintf(buffer, sizeof(buffer), ZBX_FS_UI64, h->value.ui64);
+					record.value = buffer;
+					break;
+				case ITEM_VALUE_TYPE_STR:
+				case ITEM_VALUE_TYPE_TEXT:
+					record.value = h->value.str;
+					break;
+				default:
+					THIS_SHOULD_NEVER_HAPPEN;
+					continue;
+				}
+			}
+			else
+				record.flags |= PROXY_HISTORY_FLAG_NOVALUE;
+		}
+
+		if (0 != (record.flags & PROXY_HISTORY_FLAG_META))
+		{
+			record.lastlogsize = h->lastlogsize;
+			record.mtime = h->mtime;
+		}
+
+		zbx_proxy_journal_add(&record);
+	}
+
+	zbx_proxy_journal_commit();
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: prepare history data using items from configuration cache and     *
@@ -1676,11 +1775,18 @@ static void sync_proxy_history(int *total_num, int proc_num)
 
 		proxy_prepare_history(history, history_num);
 
-		do
+		if (SUCCEED == zbx_proxy_journal_enabled())
 		{
-			zbx_db_begin();
-			DBmass_proxy_add_history(history, history_num);
-		} while (ZBX_DB_DOWN == (txn_rc = zbx_db_commit()));
+			dc_journal_proxy_history(history, history_num);
+		}
+		else
+		{
+			do
+			{
+				zbx_db_begin();
+				DBmass_proxy_add_history(history, history_num);
+			} while (ZBX_DB_DOWN == (txn_rc = zbx_db_commit()));
+		}
 
 		*total_num += history_num;
 
@@ -1854,7 +1960,7 @@ static void sync_server_history(int *values_num, int *triggers_num, int proc_num
 
 		if (0 != history_num)
 		{
-			glb_history_add_history(history, history_num);
+			history_writer_send_history(history, history_num, proc_num);
 			DCmass_update_trends(history, history_num);
 
 			do
@@ -37,6 +37,8 @@ const char	*get_process_type_string(unsigned char proc_type)
 		
 		case GLB_PROCESS_TYPE_SNMP_WORKER:
 			return "glb_snmp_worker_poller";
+		case GLB_PROCESS_TYPE_HISTORY_WRITER:
+			return "glb_history_writer";
 		case GLB_PROCESS_TYPE_SNMP:
 			return "glb_snmp_poller";
 		case GLB_PROCESS_TYPE_PINGER:
@@ -47,6 +49,8 @@ const char	*get_process_type_string(unsigned char proc_type)
 			return "glb_server";
 		case GLB_PROCESS_TYPE_AGENT:
 			return "glb_agent_poller";
+		case GLB_PROCESS_TYPE_HTTP:
+			return "glb_http_poller";
 		case ZBX_PROCESS_TYPE_POLLER:
 			return "poller";
 		case GLB_PROCESS_TYPE_API_TRAPPER:
@@ -39,6 +39,8 @@
 #include "zbx_host_constants.h"
 #include "zbx_item_constants.h"
 #include "metric.h"
+#include "zbxproxyjournal.h"
+#include "proxy_history_bin.h"
 #include "../glb_state/glb_state_hosts.h"
 #include "../glb_state/glb_state_items.h"
 
@@ -472,6 +474,12 @@ static void	proxy_set_lastid(const char *table_name, const char *lastidfield, co
 
 void	zbx_proxy_set_hist_lastid(const zbx_uint64_t lastid)
 {
+	if (SUCCEED == zbx_proxy_journal_enabled())
+	{
+		zbx_proxy_journal_set_lastid(lastid);
+		return;
+	}
+
 	proxy_set_lastid("proxy_history", "history_lastid", lastid);
 }
 
@@ -494,6 +502,12 @@ int	zbx_proxy_get_delay(const zbx_uint64_t lastid)
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() [lastid=" ZBX_FS_UI64 "]", __func__, lastid);
 
+	if (SUCCEED == zbx_proxy_journal_enabled())
+	{
+		ts = zbx_proxy_journal_get_delay(lastid);
+		goto out;
+	}
+
 	sql = zbx_dsprintf(sql, "select write_clock from proxy_history where id>" ZBX_FS_UI64 " order by id asc",
 			lastid);
 
@@ -504,7 +518,7 @@ int	zbx_proxy_get_delay(const zbx_uint64_t lastid)
 		ts = (int)time(NULL) - atoi(row[0]);
 
 	zbx_db_free_result(result);
-
+out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 
 	return ts;
@@ -759,11 +773,101 @@ try_again:
 	return data_num;
 }
 
+typedef struct
+{
+	zbx_history_data_t	**data;
+	size_t			*data_alloc;
+	size_t			data_num;
+	char			**string_buffer;
+	size_t			*string_buffer_alloc;
+	size_t			string_buffer_offset;
+}
+zbx_history_journal_read_t;
+
+static size_t	proxy_history_journal_copy_str(zbx_history_journal_read_t *rd, const char *str)
+{
+	size_t	offset = rd->string_buffer_offset, len = strlen(str) + 1;
+
+	if (*rd->string_buffer_alloc < offset + len)
+	{
+		while (*rd->string_buffer_alloc < offset + len)
+			*rd->string_buffer_alloc += ZBX_KIBIBYTE;
+
+		*rd->string_buffer = (char *)zbx_realloc(*rd->string_buffer, *rd->string_buffer_alloc);
+	}
+
+	memcpy(*rd->string_buffer + offset, str, len);
+	rd->string_buffer_offset += len;
+
+	return offset;
+}
+
+static int	proxy_history_journal_read_cb(const zbx_proxy_journal_record_t *record, void *cb_data)
+{
+	zbx_history_journal_read_t	*rd = (zbx_history_journal_read_t *)cb_data;
+	zbx_history_data_t		*hd;
+
+	if (*rd->data_alloc == rd->data_num)
+	{
+		*rd->data_alloc *= 2;
+		*rd->data = (zbx_history_data_t *)zbx_realloc(*rd->data, sizeof(zbx_history_data_t) * *rd->data_alloc);
+	}
+
+	hd = *rd->data + rd->data_num++;
+	hd->id = record->id;
+	hd->itemid = record->itemid;
+	hd->flags = record->flags;
+	hd->clock = record->clock;
+	hd->ns = record->ns;
+	hd->state = record->state;
+	hd->timestamp = record->timestamp;
+	hd->severity = record->severity;
+	hd->logeventid = record->logeventid;
+	hd->lastlogsize = record->lastlogsize;
+	hd->mtime = record->mtime;
+
+	if (PROXY_HISTORY_FLAG_NOVALUE != (hd->flags & PROXY_HISTORY_MASK_NOVALUE) &&
+			0 == (hd->flags & PROXY_HISTORY_FLAG_NOVALUE))
+	{
+		hd->source_offset = proxy_history_journal_copy_str(rd, record->source);
+		hd->value_offset = proxy_history_journal_copy_str(rd, record->value);
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: read proxy history data from the history journal                  *
+ *                                                                            *
+ * Comments: see proxy_get_history_data() for the parameters, the journal     *
+ *           has no holes as only the committed batches are read              *
+ *                                                                            *
+ ******************************************************************************/
+static int	proxy_get_history_journal(zbx_uint64_t lastid, zbx_history_data_t **data, size_t *data_alloc,
+		char **string_buffer, size_t *string_buffer_alloc, int *more)
+{
+	zbx_history_journal_read_t	rd = {data, data_alloc, 0, string_buffer, string_buffer_alloc, 0};
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() lastid:" ZBX_FS_UI64, __func__, lastid);
+
+	zbx_proxy_journal_read(lastid, ZBX_MAX_HRECORDS, proxy_history_journal_read_cb, &rd);
+
+	if (ZBX_MAX_HRECORDS != rd.data_num)
+		*more = ZBX_PROXY_DATA_DONE;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() data_num:" ZBX_FS_SIZE_T, __func__, rd.data_num);
+
+	return (int)rd.data_num;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: add history records to output json                                *
  *                                                                            *
  * Parameters: j             - [IN] the json output buffer                    *
+ *             writer        - [IN] the binary history writer, NULL to add    *
+ *                                  the records as json                       *
  *             records_num   - [IN] the total number of records added         *
  *             dc_items      - [IN] the item configuration data               *
  *             errcodes      - [IN] the item configuration status codes       *
@@ -774,8 +878,9 @@ try_again:
  * Return value: The total number of records added.                           *
  *                                                                            *
  ******************************************************************************/
-static int	proxy_add_hist_data(struct zbx_json *j, int records_num, const DC_ITEM *dc_items, const int *errcodes,
-		const zbx_vector_ptr_t *records, const char *string_buffer, zbx_uint64_t *lastid)
+static int	proxy_add_hist_data(struct zbx_json *j, zbx_history_bin_writer_t *writer, int records_num,
+		const DC_ITEM *dc_items, const int *errcodes, const zbx_vector_ptr_t *records,
+		const char *string_buffer, zbx_uint64_t *lastid)
 {
 	int				i;
 	const zbx_history_data_t	*hd;
@@ -800,6 +905,30 @@ static int	proxy_add_hist_data(struct zbx_json *j, int records_num, const DC_ITE
 				continue;
 		}
 
+		if (NULL != writer)
+		{
+			zbx_history_bin_record_t	record = {.id = hd->id, .itemid = hd->itemid,
+					.clock = hd->clock, .ns = hd->ns, .state = hd->state, .flags = hd->flags,
+					.timestamp = hd->timestamp, .severity = hd->severity,
+					.logeventid = hd->logeventid, .lastlogsize = hd->lastlogsize,
+					.mtime = hd->mtime, .source = "", .value = ""};
+
+			if (PROXY_HISTORY_FLAG_NOVALUE != (hd->flags & PROXY_HISTORY_MASK_NOVALUE) &&
+					0 == (hd->flags & PROXY_HISTORY_FLAG_NOVALUE))
+			{
+				record.source = string_buffer + hd->source_offset;
+				record.value = string_buffer + hd->value_offset;
+			}
+
+			history_bin_writer_add(writer, &record);
+			records_num++;
+
+			if (ZBX_DATA_JSON_RECORD_LIMIT < j->buffer_offset + history_bin_writer_size(writer))
+				break;
+
+			continue;
+		}
+
 		if (0 == records_num)
 			zbx_json_addarray(j, ZBX_PROTO_TAG_HISTORY_DATA);
 
@@ -853,7 +982,21 @@ static int	proxy_add_hist_data(struct zbx_json *j, int records_num, const DC_ITE
 	return records_num;
 }
 
-int	zbx_proxy_get_hist_data(struct zbx_json *j, zbx_uint64_t *lastid, int *more)
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get history data to send to server                                *
+ *                                                                            *
+ * Parameters: j      - [IN/OUT] the json output buffer                       *
+ *             format - [IN] the history format supported by server           *
+ *                           (ZBX_PROXY_HISTORY_FORMAT_*)                     *
+ *             lastid - [OUT] the id of last added record                     *
+ *             more   - [OUT] set to ZBX_PROXY_DATA_MORE if there might be    *
+ *                            more data to read                               *
+ *                                                                            *
+ * Return value: The number of records added.                                 *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_proxy_get_hist_data(struct zbx_json *j, unsigned char format, zbx_uint64_t *lastid, int *more)
 {
 	int			records_num = 0, data_num, i, *errcodes = NULL, items_alloc = 0;
 	zbx_uint64_t		id;
@@ -864,6 +1007,9 @@ int	zbx_proxy_get_hist_data(struct zbx_json *j, zbx_uint64_t *lastid, int *more)
 	zbx_vector_uint64_t	itemids;
 	zbx_vector_ptr_t	records;
 	DC_ITEM			*dc_items = 0;
+	int			(*get_history_data)(zbx_uint64_t lastid, zbx_history_data_t **data,
+				size_t *data_alloc, char **string_buffer, size_t *string_buffer_alloc, int *more);
+	zbx_history_bin_writer_t	writer, *pwriter = NULL;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
@@ -873,17 +1019,35 @@ int	zbx_proxy_get_hist_data(struct zbx_json *j, zbx_uint64_t *lastid, int *more)
 	string_buffer = (char *)zbx_malloc(NULL, string_buffer_alloc);
 
 	*more = ZBX_PROXY_DATA_MORE;
-	proxy_get_lastid("proxy_history", "history_lastid", &id);
+
+	if (SUCCEED == zbx_proxy_journal_enabled())
+	{
+		id = zbx_proxy_journal_get_lastid();
+		get_history_data = proxy_get_history_journal;
+	}
+	else
+	{
+		proxy_get_lastid("proxy_history", "history_lastid", &id);
+		get_history_data = proxy_get_history_data;
+	}
 
 	zbx_hashset_create(&itemids_added, data_alloc, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
 
+	if (ZBX_PROXY_HISTORY_FORMAT_BINARY == format)
+	{
+		history_bin_writer_init(&writer);
+		pwriter = &writer;
+	}
+
 	/* get history data in batches by ZBX_MAX_HRECORDS records and stop if: */
 	/*   1) there are no more data to read                                  */
 	/*   2) we have retrieved more than the total maximum number of records */
 	/*   3) we have gathered more than half of the maximum packet size      */
-	while (ZBX_DATA_JSON_BATCH_LIMIT > j->buffer_offset && ZBX_MAX_HRECORDS_TOTAL > records_num &&
-			0 != (data_num = proxy_get_history_data(id, &data, &data_alloc, &string_buffer,
-					&string_buffer_alloc, more)))
+	while (ZBX_DATA_JSON_BATCH_LIMIT > j->buffer_offset +
+			(NULL != pwriter ? history_bin_writer_size(pwriter) : 0) &&
+			ZBX_MAX_HRECORDS_TOTAL > records_num &&
+			0 != (data_num = get_history_data(id, &data, &data_alloc, &string_buffer, &string_buffer_alloc,
+					more)))
 	{
 		zbx_vector_uint64_reserve(&itemids, data_num);
 		zbx_vector_ptr_reserve(&records, data_num);
@@ -914,7 +1078,8 @@ int	zbx_proxy_get_hist_data(struct zbx_json *j, zbx_uint64_t *lastid, int *more)
 
 		DCconfig_get_items_by_itemids(dc_items, itemids.values, errcodes, itemids.values_num);
 
-		records_num = proxy_add_hist_data(j, records_num, dc_items, errcodes, &records, string_buffer, lastid);
+		records_num = proxy_add_hist_data(j, pwriter, records_num, dc_items, errcodes, &records, string_buffer,
+				lastid);
 		DCconfig_clean_items(dc_items, errcodes, itemids.values_num);
 
 		/* got less data than requested - either no more data to read or the history is full of */
@@ -928,7 +1093,14 @@ int	zbx_proxy_get_hist_data(struct zbx_json *j, zbx_uint64_t *lastid, int *more)
 		id = *lastid;
 	}
 
-	if (0 != records_num)
+	if (NULL != pwriter)
+	{
+		if (0 != records_num)
+			history_bin_writer_flush(pwriter, j, ZBX_PROTO_TAG_HISTORY_DATA_BINARY);
+
+		history_bin_writer_clear(pwriter);
+	}
+	else if (0 != records_num)
 		zbx_json_close(j);
 
 	zbx_hashset_destroy(&itemids_added);
@@ -1596,6 +1768,54 @@ out:
 	return ret;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: decodes up to ZBX_HISTORY_VALUES_MAX item values and item         *
+ *          identifiers from binary history data                              *
+ *                                                                            *
+ * Parameters: reader     - [IN] the binary history data reader               *
+ *             values     - [OUT] the item values                             *
+ *             itemids    - [OUT] the corresponding item identifiers          *
+ *             values_num - [OUT] number of elements in values and itemids    *
+ *                                arrays                                      *
+ *             parsed_num - [OUT] the number of values parsed                 *
+ *             error      - [OUT] the error message                           *
+ *                                                                            *
+ * Return value:  SUCCEED - values were parsed successfully                   *
+ *                FAIL    - an error occurred                                 *
+ *                                                                            *
+ ******************************************************************************/
+static int	parse_history_data_binary(zbx_history_bin_reader_t *reader, zbx_agent_value_t *values,
+		zbx_uint64_t *itemids, int *values_num, int *parsed_num, char **error)
+{
+	int	ret = SUCCEED;
+
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
+
+	*values_num = 0;
+	*parsed_num = 0;
+
+	while (reader->records_read < reader->records_num && *values_num < ZBX_HISTORY_VALUES_MAX)
+	{
+		if (SUCCEED != history_bin_reader_next(reader, &itemids[*values_num], &values[*values_num]))
+		{
+			zbx_agent_values_clean(values, (size_t)*values_num + 1);
+			*values_num = 0;
+			*error = zbx_strdup(*error, "malformed binary history data");
+			ret = FAIL;
+			break;
+		}
+
+		(*parsed_num)++;
+		(*values_num)++;
+	}
+
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s processed:%d/%d", __func__, zbx_result_string(ret),
+			*values_num, *parsed_num);
+
+	return ret;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: validates item received from proxy                                *
@@ -1636,6 +1856,8 @@ static int	proxy_item_validator(zbx_history_recv_item_t *item, zbx_socket_t *soc
  *             validator_func - [IN]  function to validate item permission    *
  *             validator_args - [IN]  validator function arguments            *
  *             jp_data        - [IN]  JSON with history data array            *
+ *             reader         - [IN]  the binary history data, NULL if the    *
+ *                                    data is in jp_data                      *
  *             session        - [IN]  the data session                        *
  *             nodata_win     - [OUT] counter of delayed values               *
  *             info           - [OUT] address of a pointer to the info        *
@@ -1652,8 +1874,8 @@ static int	proxy_item_validator(zbx_history_recv_item_t *item, zbx_socket_t *soc
  *                                                                            *
  ******************************************************************************/
 static int	process_history_data_by_itemids(zbx_socket_t *sock, zbx_client_item_validator_t validator_func,
-		void *validator_args, struct zbx_json_parse *jp_data, zbx_session_t *session,
-		zbx_proxy_suppress_t *nodata_win, char **info, unsigned int mode)
+		void *validator_args, struct zbx_json_parse *jp_data, zbx_history_bin_reader_t *reader,
+		zbx_session_t *session, zbx_proxy_suppress_t *nodata_win, char **info, unsigned int mode)
 {
 	const char		*pnext = NULL;
 	int			ret = SUCCEED, processed_num = 0, total_num = 0, values_num, read_num, i, *errcodes;
@@ -1671,8 +1893,10 @@ static int	process_history_data_by_itemids(zbx_socket_t *sock, zbx_client_item_v
 
 	sec = zbx_time();
 
-	while (SUCCEED == parse_history_data_by_itemids(jp_data, &pnext, values, itemids, &values_num, &read_num,
-			&unique_shift, &error) && 0 != values_num)
+	while (SUCCEED == (NULL != reader ?
+			parse_history_data_binary(reader, values, itemids, &values_num, &read_num, &error) :
+			parse_history_data_by_itemids(jp_data, &pnext, values, itemids, &values_num, &read_num,
+			&unique_shift, &error)) && 0 != values_num)
 	{
 		zbx_dc_config_history_recv_get_items_by_itemids(items, itemids, errcodes, (size_t)values_num, mode);
 
@@ -1708,7 +1932,7 @@ static int	process_history_data_by_itemids(zbx_socket_t *sock, zbx_client_item_v
 
 		zbx_agent_values_clean(values, values_num);
 
-		if (NULL == pnext)
+		if (NULL == reader && NULL == pnext)
 			break;
 	}
 
@@ -2023,7 +2247,7 @@ static int		process_client_history_data(zbx_socket_t *sock, struct zbx_json_pars
 			session = zbx_dc_get_or_create_session(hostid, token, ZBX_SESSION_TYPE_DATA);
 
 		if (SUCCEED != (ret = process_history_data_by_itemids(sock, validator_func, validator_args, &jp_data,
-				session, NULL, info, ZBX_ITEM_GET_DEFAULT)))
+				NULL, session, NULL, info, ZBX_ITEM_GET_DEFAULT)))
 		{
 			goto out;
 		}
@@ -2632,6 +2856,9 @@ int	zbx_proxy_get_history_count(void)
 	zbx_uint64_t	id;
 	int		count = 0;
 
+	if (SUCCEED == zbx_proxy_journal_enabled())
+		return zbx_proxy_journal_get_count();
+
 	zbx_db_connect(ZBX_DB_CONNECT_NORMAL);
 
 	proxy_get_lastid("proxy_history", "history_lastid", &id);
@@ -2773,11 +3000,12 @@ static void	check_proxy_nodata_empty(zbx_timespec_t *ts, unsigned char proxy_sta
 int	zbx_process_proxy_data(const DC_PROXY *proxy, struct zbx_json_parse *jp, zbx_timespec_t *ts,
 		unsigned char proxy_status, int *more, char **error)
 {
-	struct zbx_json_parse	jp_data;
-	int			ret = SUCCEED, flags_old;
-	char			*error_step = NULL, value[MAX_STRING_LEN];
-	size_t			error_alloc = 0, error_offset = 0;
-	zbx_proxy_diff_t	proxy_diff;
+	struct zbx_json_parse		jp_data;
+	int				ret = SUCCEED, flags_old;
+	char				*error_step = NULL, value[MAX_STRING_LEN], *history_bin = NULL;
+	size_t				error_alloc = 0, error_offset = 0, history_bin_alloc = 0;
+	zbx_proxy_diff_t		proxy_diff;
+	zbx_history_bin_reader_t	reader, *preader = NULL;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
@@ -2830,7 +3058,23 @@ int	zbx_process_proxy_data(const DC_PROXY *proxy, struct zbx_json_parse *jp, zbx
 	
 	flags_old = proxy_diff.nodata_win.flags;
 
-	if (SUCCEED == zbx_json_brackets_by_name(jp, ZBX_PROTO_TAG_HISTORY_DATA, &jp_data))
+	if (SUCCEED == zbx_json_value_by_name_dyn(jp, ZBX_PROTO_TAG_HISTORY_DATA_BINARY, &history_bin,
+			&history_bin_alloc, NULL))
+	{
+		if (SUCCEED != history_bin_reader_open(&reader, history_bin, &error_step))
+		{
+			/* fail the whole request so the proxy keeps the history and resends it */
+			zbx_free(history_bin);
+			zbx_strcatnl_alloc(error, &error_alloc, &error_offset, error_step);
+			ret = FAIL;
+			goto out;
+		}
+
+		preader = &reader;
+		zbx_free(history_bin);
+	}
+
+	if (NULL != preader || SUCCEED == zbx_json_brackets_by_name(jp, ZBX_PROTO_TAG_HISTORY_DATA, &jp_data))
 	{
 		zbx_session_t	*session = NULL;
 
@@ -2849,7 +3093,7 @@ int	zbx_process_proxy_data(const DC_PROXY *proxy, struct zbx_json_parse *jp, zbx
 		}
 
 		if (SUCCEED != (ret = process_history_data_by_itemids(NULL, proxy_item_validator,
-				(void *)&proxy->hostid, &jp_data, session, &proxy_diff.nodata_win, &error_step,
+				(void *)&proxy->hostid, &jp_data, preader, session, &proxy_diff.nodata_win, &error_step,
 				ZBX_ITEM_GET_PROCESS)))
 		{
 			zbx_strcatnl_alloc(error, &error_alloc, &error_offset, error_step);
@@ -2893,12 +3137,43 @@ int	zbx_process_proxy_data(const DC_PROXY *proxy, struct zbx_json_parse *jp, zbx
 	}
 
 out:
+	if (NULL != preader)
+		history_bin_reader_clear(preader);
+
 	zbx_free(error_step);
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
 
 	return ret;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: gets the history format the peer can receive                      *
+ *                                                                            *
+ * Parameters: buffer - [IN] the request or response of the peer              *
+ *                                                                            *
+ * Return value: ZBX_PROXY_HISTORY_FORMAT_BINARY - the peer announced binary  *
+ *                                                 history support            *
+ *               ZBX_PROXY_HISTORY_FORMAT_JSON   - otherwise                  *
+ *                                                                            *
+ ******************************************************************************/
+unsigned char	zbx_get_proxy_history_format(const char *buffer)
+{
+	struct zbx_json_parse	jp;
+	char			value[MAX_STRING_LEN];
+
+	if (NULL == buffer || SUCCEED != zbx_json_open(buffer, &jp))
+		return ZBX_PROXY_HISTORY_FORMAT_JSON;
+
+	if (SUCCEED == zbx_json_value_by_name(&jp, ZBX_PROTO_TAG_HISTORY_FORMAT, value, sizeof(value), NULL) &&
+			0 == strcmp(value, ZBX_PROTO_VALUE_HISTORY_FORMAT_BINARY))
+	{
+		return ZBX_PROXY_HISTORY_FORMAT_BINARY;
+	}
+
+	return ZBX_PROXY_HISTORY_FORMAT_JSON;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: flushes lastaccess changes for proxies every                      *
@@ -0,0 +1,503 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+/* Binary proxy history format. Instead of a json object per value the history records are split
+   into columns which are encoded separately, so the similar data is kept together: ids, itemids and
+   clocks are delta encoded and all the numbers are varints. Numeric values are sent as numbers if
+   they convert back to exactly the same string, so the server sees the same values as with json.
+
+   The block is:
+     version     - byte
+     records_num - varint
+     column size - varint for each of the columns
+     columns     - the column data
+
+   The block is base64 encoded to be sent as a json string, the whole message is compressed by
+   the protocol as usual. */
+
+#include "proxy_history_bin.h"
+
+#include "zbxcacheconfig.h"
+#include "zbxnum.h"
+#include "zbx_item_constants.h"
+#include "base64.h"
+
+#define HISTORY_BIN_VERSION	1
+
+#define HISTORY_BIN_COLUMN_ID		0
+#define HISTORY_BIN_COLUMN_ITEMID	1
+#define HISTORY_BIN_COLUMN_CLOCK	2
+#define HISTORY_BIN_COLUMN_NS		3
+#define HISTORY_BIN_COLUMN_FLAGS	4
+#define HISTORY_BIN_COLUMN_VALUE	5
+#define HISTORY_BIN_COLUMN_LOG		6
+#define HISTORY_BIN_COLUMN_META		7
+
+/* the record flags, the first two are the proxy history flags */
+#define HISTORY_BIN_FLAG_META		PROXY_HISTORY_FLAG_META
+#define HISTORY_BIN_FLAG_NOVALUE	PROXY_HISTORY_FLAG_NOVALUE
+#define HISTORY_BIN_FLAG_NOTSUPPORTED	0x04
+#define HISTORY_BIN_FLAG_VALUE		0x08
+#define HISTORY_BIN_FLAG_UINT64		0x10
+#define HISTORY_BIN_FLAG_DOUBLE		0x20
+#define HISTORY_BIN_FLAG_LOG		0x40
+
+#define HISTORY_BIN_VARINT_MAX		10
+
+#define HISTORY_BIN_ZIGZAG(v)		(((zbx_uint64_t)(v) << 1) ^ (zbx_uint64_t)((zbx_int64_t)(v) >> 63))
+#define HISTORY_BIN_UNZIGZAG(v)		((zbx_int64_t)((v) >> 1) ^ -(zbx_int64_t)((v) & 1))
+
+static unsigned char	*column_reserve(zbx_history_bin_column_t *column, size_t size)
+{
+	if (column->data_alloc < column->data_offset + size)
+	{
+		while (column->data_alloc < column->data_offset + size)
+			column->data_alloc = MAX(ZBX_KIBIBYTE, column->data_alloc * 2);
+
+		column->data = (unsigned char *)zbx_realloc(column->data, column->data_alloc);
+	}
+
+	return column->data + column->data_offset;
+}
+
+static void	column_put_varint(zbx_history_bin_column_t *column, zbx_uint64_t value)
+{
+	unsigned char	*ptr = column_reserve(column, HISTORY_BIN_VARINT_MAX), *start = ptr;
+
+	while (0x80 <= value)
+	{
+		*ptr++ = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+
+	*ptr++ = (unsigned char)value;
+	column->data_offset += (size_t)(ptr - start);
+}
+
+static void	column_put_bytes(zbx_history_bin_column_t *column, const void *data, size_t size)
+{
+	memcpy(column_reserve(column, size), data, size);
+	column->data_offset += size;
+}
+
+static void	column_put_str(zbx_history_bin_column_t *column, const char *str)
+{
+	size_t	len = strlen(str);
+
+	column_put_varint(column, len);
+	column_put_bytes(column, str, len);
+}
+
+static int	column_get_varint(const unsigned char **ptr, const unsigned char *end, zbx_uint64_t *value)
+{
+	int	shift;
+
+	*value = 0;
+
+	for (shift = 0; shift < 64; shift += 7)
+	{
+		if (*ptr >= end)
+			return FAIL;
+
+		*value |= (zbx_uint64_t)(**ptr & 0x7f) << shift;
+
+		if (0 == (*(*ptr)++ & 0x80))
+			return SUCCEED;
+	}
+
+	return FAIL;
+}
+
+static int	column_get_int(const unsigned char **ptr, const unsigned char *end, int *value)
+{
+	zbx_uint64_t	v;
+
+	if (SUCCEED != column_get_varint(ptr, end, &v))
+		return FAIL;
+
+	*value = (int)HISTORY_BIN_UNZIGZAG(v);
+
+	return SUCCEED;
+}
+
+static int	column_get_str(const unsigned char **ptr, const unsigned char *end, char **str)
+{
+	zbx_uint64_t	len;
+
+	if (SUCCEED != column_get_varint(ptr, end, &len) || (zbx_uint64_t)(end - *ptr) < len)
+		return FAIL;
+
+	*str = (char *)zbx_malloc(NULL, len + 1);
+	memcpy(*str, *ptr, len);
+	(*str)[len] = '\0';
+	*ptr += len;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks if the value can be sent as a number                       *
+ *                                                                            *
+ * Return value: HISTORY_BIN_FLAG_UINT64 or HISTORY_BIN_FLAG_DOUBLE if the    *
+ *               number formats back to the same string, 0 otherwise          *
+ *                                                                            *
+ ******************************************************************************/
+static unsigned char	history_bin_value_type(const char *value, zbx_uint64_t *ui64, double *dbl)
+{
+	char	buffer[64];
+
+	if ('\0' == *value || ZBX_MAX_DOUBLE_LEN < strlen(value))
+		return 0;
+
+	if (SUCCEED == zbx_is_uint64(value, ui64))
+	{
+		zbx_snprintf(buffer, sizeof(buffer), ZBX_FS_UI64, *ui64);
+
+		return 0 == strcmp(buffer, value) ? HISTORY_BIN_FLAG_UINT64 : 0;
+	}
+
+	if (SUCCEED == zbx_is_double(value, dbl))
+	{
+		zbx_snprintf(buffer, sizeof(buffer), ZBX_FS_DBL64, *dbl);
+
+		return 0 == strcmp(buffer, value) ? HISTORY_BIN_FLAG_DOUBLE : 0;
+	}
+
+	return 0;
+}
+
+void	history_bin_writer_init(zbx_history_bin_writer_t *writer)
+{
+	memset(writer, 0, sizeof(zbx_history_bin_writer_t));
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds the record to the columns, the records are expected to go in *
+ *          the id order                                                      *
+ *                                                                            *
+ ******************************************************************************/
+void	history_bin_writer_add(zbx_history_bin_writer_t *writer, const zbx_history_bin_record_t *record)
+{
+	unsigned char	flags = record->flags & PROXY_HISTORY_MASK_NOVALUE;
+	zbx_uint64_t	ui64;
+	double		dbl;
+
+	column_put_varint(&writer->columns[HISTORY_BIN_COLUMN_ID], HISTORY_BIN_ZIGZAG(record->id - writer->last_id));
+	column_put_varint(&writer->columns[HISTORY_BIN_COLUMN_ITEMID],
+			HISTORY_BIN_ZIGZAG(record->itemid - writer->last_itemid));
+	column_put_varint(&writer->columns[HISTORY_BIN_COLUMN_CLOCK],
+			HISTORY_BIN_ZIGZAG((zbx_int64_t)record->clock - writer->last_clock));
+	column_put_varint(&writer->columns[HISTORY_BIN_COLUMN_NS], (zbx_uint64_t)record->ns);
+
+	writer->last_id = record->id;
+	writer->last_itemid = record->itemid;
+	writer->last_clock = record->clock;
+	writer->records_num++;
+
+	if (PROXY_HISTORY_FLAG_NOVALUE == flags)
+	{
+		column_put_bytes(&writer->columns[HISTORY_BIN_COLUMN_FLAGS], &flags, 1);
+		return;
+	}
+
+	if (ITEM_STATE_NOTSUPPORTED == record->state)
+		flags |= HISTORY_BIN_FLAG_NOTSUPPORTED;
+
+	if (0 == (flags & PROXY_HISTORY_FLAG_NOVALUE))
+	{
+		flags |= HISTORY_BIN_FLAG_VALUE;
+
+		if (ITEM_STATE_NOTSUPPORTED != record->state)
+			flags |= history_bin_value_type(record->value, &ui64, &dbl);
+
+		if (0 != record->timestamp || '\0' != *record->source || 0 != record->severity ||
+				0 != record->logeventid)
+		{
+			flags |= HISTORY_BIN_FLAG_LOG;
+		}
+	}
+
+	column_put_bytes(&writer->columns[HISTORY_BIN_COLUMN_FLAGS], &flags, 1);
+
+	if (0 != (flags & HISTORY_BIN_FLAG_UINT64))
+		column_put_varint(&writer->columns[HISTORY_BIN_COLUMN_VALUE], ui64);
+	else if (0 != (flags & HISTORY_BIN_FLAG_DOUBLE))
+		column_put_bytes(&writer->columns[HISTORY_BIN_COLUMN_VALUE], &dbl, sizeof(dbl));
+	else if (0 != (flags & HISTORY_BIN_FLAG_VALUE))
+		column_put_str(&writer->columns[HISTORY_BIN_COLUMN_VALUE], record->value);
+
+	if (0 != (flags & HISTORY_BIN_FLAG_LOG))
+	{
+		zbx_history_bin_column_t	*column = &writer->columns[HISTORY_BIN_COLUMN_LOG];
+
+		column_put_varint(column, HISTORY_BIN_ZIGZAG(record->timestamp));
+		column_put_varint(column, HISTORY_BIN_ZIGZAG(record->severity));
+		column_put_varint(column, HISTORY_BIN_ZIGZAG(record->logeventid));
+		column_put_str(column, record->source);
+	}
+
+	if (0 != (flags & HISTORY_BIN_FLAG_META))
+	{
+		column_put_varint(&writer->columns[HISTORY_BIN_COLUMN_META], record->lastlogsize);
+		column_put_varint(&writer->columns[HISTORY_BIN_COLUMN_META], HISTORY_BIN_ZIGZAG(record->mtime));
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns the approximate size of the encoded block                 *
+ *                                                                            *
+ ******************************************************************************/
+size_t	history_bin_writer_size(const zbx_history_bin_writer_t *writer)
+{
+	size_t	size = 0;
+	int	i;
+
+	for (i = 0; i < ZBX_HISTORY_BIN_COLUMNS_NUM; i++)
+		size += writer->columns[i].data_offset;
+
+	return size / 3 * 4;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds the encoded records to json and resets the writer            *
+ *                                                                            *
+ ******************************************************************************/
+void	history_bin_writer_flush(zbx_history_bin_writer_t *writer, struct zbx_json *j, const char *tag)
+{
+	zbx_history_bin_column_t	block = {0};
+	unsigned char			version = HISTORY_BIN_VERSION;
+	char				*base64 = NULL;
+	int				i;
+
+	column_put_bytes(&block, &version, 1);
+	column_put_varint(&block, (zbx_uint64_t)writer->records_num);
+
+	for (i = 0; i < ZBX_HISTORY_BIN_COLUMNS_NUM; i++)
+		column_put_varint(&block, writer->columns[i].data_offset);
+
+	for (i = 0; i < ZBX_HISTORY_BIN_COLUMNS_NUM; i++)
+		column_put_bytes(&block, writer->columns[i].data, writer->columns[i].data_offset);
+
+	str_base64_encode_dyn((const char *)block.data, &base64, (int)block.data_offset);
+	zbx_json_addstring(j, tag, base64, ZBX_JSON_TYPE_STRING);
+
+	zbx_free(base64);
+	zbx_free(block.data);
+
+	for (i = 0; i < ZBX_HISTORY_BIN_COLUMNS_NUM; i++)
+		writer->columns[i].data_offset = 0;
+
+	writer->last_id = 0;
+	writer->last_itemid = 0;
+	writer->last_clock = 0;
+	writer->records_num = 0;
+}
+
+void	history_bin_writer_clear(zbx_history_bin_writer_t *writer)
+{
+	int	i;
+
+	for (i = 0; i < ZBX_HISTORY_BIN_COLUMNS_NUM; i++)
+		zbx_free(writer->columns[i].data);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: decodes the binary history block                                  *
+ *                                                                            *
+ * Parameters: reader - [OUT] the reader                                      *
+ *             base64 - [IN] the base64 encoded block                         *
+ *             error  - [OUT] the error message                               *
+ *                                                                            *
+ * Return value: SUCCEED - the block header was parsed                        *
+ *               FAIL    - the block is malformed                             *
+ *                                                                            *
+ ******************************************************************************/
+int	history_bin_reader_open(zbx_history_bin_reader_t *reader, const char *base64, char **error)
+{
+	const unsigned char	*ptr, *end;
+	int			size, i;
+	zbx_uint64_t		value, sizes[ZBX_HISTORY_BIN_COLUMNS_NUM];
+
+	memset(reader, 0, sizeof(zbx_history_bin_reader_t));
+
+	size = (int)(strlen(base64) / 4 * 3 + 3);
+	reader->data = (char *)zbx_malloc(NULL, (size_t)size);
+	str_base64_decode(base64, reader->data, size, &size);
+
+	ptr = (const unsigned char *)reader->data;
+	end = ptr + size;
+
+	if (ptr == end || HISTORY_BIN_VERSION != *ptr++)
+	{
+		*error = zbx_strdup(*error, "unsupported binary history data version");
+		goto fail;
+	}
+
+	if (SUCCEED != column_get_varint(&ptr, end, &value) || INT_MAX < value)
+		goto malformed;
+
+	reader->records_num = (int)value;
+
+	for (i = 0; i < ZBX_HISTORY_BIN_COLUMNS_NUM; i++)
+	{
+		if (SUCCEED != column_get_varint(&ptr, end, &sizes[i]))
+			goto malformed;
+	}
+
+	for (i = 0; i < ZBX_HISTORY_BIN_COLUMNS_NUM; i++)
+	{
+		if ((zbx_uint64_t)(end - ptr) < sizes[i])
+			goto malformed;
+
+		reader->columns[i] = ptr;
+		ptr += sizes[i];
+		reader->columns_end[i] = ptr;
+	}
+
+	return SUCCEED;
+malformed:
+	*error = zbx_strdup(*error, "malformed binary history data");
+fail:
+	history_bin_reader_clear(reader);
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: decodes the next record into agent value the same way as the json *
+ *          history record is parsed                                          *
+ *                                                                            *
+ * Return value: SUCCEED - the record was decoded                             *
+ *               FAIL    - no more records or the block is malformed          *
+ *                                                                            *
+ ******************************************************************************/
+int	history_bin_reader_next(zbx_history_bin_reader_t *reader, zbx_uint64_t *itemid, zbx_agent_value_t *av)
+{
+	const unsigned char	**columns = reader->columns, **end = reader->columns_end;
+	zbx_uint64_t		value;
+	unsigned char		flags;
+	int			delta;
+
+	memset(av, 0, sizeof(zbx_agent_value_t));
+
+	if (reader->records_read >= reader->records_num)
+		return FAIL;
+
+	if (SUCCEED != column_get_varint(&columns[HISTORY_BIN_COLUMN_ID], end[HISTORY_BIN_COLUMN_ID], &value))
+		return FAIL;
+
+	av->id = reader->last_id += (zbx_uint64_t)HISTORY_BIN_UNZIGZAG(value);
+
+	if (SUCCEED != column_get_varint(&columns[HISTORY_BIN_COLUMN_ITEMID], end[HISTORY_BIN_COLUMN_ITEMID], &value))
+		return FAIL;
+
+	*itemid = reader->last_itemid += (zbx_uint64_t)HISTORY_BIN_UNZIGZAG(value);
+
+	if (SUCCEED != column_get_int(&columns[HISTORY_BIN_COLUMN_CLOCK], end[HISTORY_BIN_COLUMN_CLOCK], &delta) ||
+			SUCCEED != column_get_varint(&columns[HISTORY_BIN_COLUMN_NS], end[HISTORY_BIN_COLUMN_NS],
+			&value) || 999999999 < value)
+	{
+		return FAIL;
+	}
+
+	av->ts.sec = reader->last_clock += delta;
+	av->ts.ns = (int)value;
+
+	if (columns[HISTORY_BIN_COLUMN_FLAGS] >= end[HISTORY_BIN_COLUMN_FLAGS])
+		return FAIL;
+
+	flags = *columns[HISTORY_BIN_COLUMN_FLAGS]++;
+	reader->records_read++;
+
+	if (0 != (flags & HISTORY_BIN_FLAG_NOTSUPPORTED))
+		av->state = ITEM_STATE_NOTSUPPORTED;
+
+	if (0 != (flags & HISTORY_BIN_FLAG_UINT64))
+	{
+		if (SUCCEED != column_get_varint(&columns[HISTORY_BIN_COLUMN_VALUE], end[HISTORY_BIN_COLUMN_VALUE],
+				&value))
+		{
+			return FAIL;
+		}
+
+		av->value = zbx_dsprintf(NULL, ZBX_FS_UI64, value);
+	}
+	else if (0 != (flags & HISTORY_BIN_FLAG_DOUBLE))
+	{
+		double	dbl;
+
+		if ((size_t)(end[HISTORY_BIN_COLUMN_VALUE] - columns[HISTORY_BIN_COLUMN_VALUE]) < sizeof(dbl))
+			return FAIL;
+
+		memcpy(&dbl, columns[HISTORY_BIN_COLUMN_VALUE], sizeof(dbl));
+		columns[HISTORY_BIN_COLUMN_VALUE] += sizeof(dbl);
+		av->value = zbx_dsprintf(NULL, ZBX_FS_DBL64, dbl);
+	}
+	else if (0 != (flags & HISTORY_BIN_FLAG_VALUE))
+	{
+		if (SUCCEED != column_get_str(&columns[HISTORY_BIN_COLUMN_VALUE], end[HISTORY_BIN_COLUMN_VALUE],
+				&av->value))
+		{
+			return FAIL;
+		}
+	}
+
+	if (0 != (flags & HISTORY_BIN_FLAG_LOG))
+	{
+		const unsigned char	**log = &columns[HISTORY_BIN_COLUMN_LOG];
+
+		if (SUCCEED != column_get_int(log, end[HISTORY_BIN_COLUMN_LOG], &av->timestamp) ||
+				SUCCEED != column_get_int(log, end[HISTORY_BIN_COLUMN_LOG], &av->severity) ||
+				SUCCEED != column_get_int(log, end[HISTORY_BIN_COLUMN_LOG], &av->logeventid) ||
+				SUCCEED != column_get_str(log, end[HISTORY_BIN_COLUMN_LOG], &av->source))
+		{
+			return FAIL;
+		}
+
+		if ('\0' == *av->source)
+			zbx_free(av->source);
+	}
+
+	if (0 != (flags & HISTORY_BIN_FLAG_META))
+	{
+		const unsigned char	**meta = &columns[HISTORY_BIN_COLUMN_META];
+
+		if (SUCCEED != column_get_varint(meta, end[HISTORY_BIN_COLUMN_META], &av->lastlogsize) ||
+				SUCCEED != column_get_int(meta, end[HISTORY_BIN_COLUMN_META], &av->mtime))
+		{
+			return FAIL;
+		}
+
+		/* unsupported item meta information is ignored, see parse_history_data_row_value() */
+		if (ITEM_STATE_NOTSUPPORTED != av->state)
+			av->meta = 1;
+	}
+
+	return SUCCEED;
+}
+
+void	history_bin_reader_clear(zbx_history_bin_reader_t *reader)
+{
+	zbx_free(reader->data);
+}
@@ -0,0 +1,88 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef ZABBIX_PROXY_HISTORY_BIN_H
+#define ZABBIX_PROXY_HISTORY_BIN_H
+
+#include "zbxcommon.h"
+#include "zbxjson.h"
+#include "zbxcacheconfig.h"
+
+/* history record as the proxy sends it, the flags are the proxy_history table flags */
+typedef struct
+{
+	zbx_uint64_t	id;
+	zbx_uint64_t	itemid;
+	zbx_uint64_t	lastlogsize;
+	const char	*source;
+	const char	*value;
+	int		clock;
+	int		ns;
+	int		timestamp;
+	int		severity;
+	int		logeventid;
+	int		mtime;
+	unsigned char	state;
+	unsigned char	flags;
+}
+zbx_history_bin_record_t;
+
+typedef struct
+{
+	unsigned char	*data;
+	size_t		data_alloc;
+	size_t		data_offset;
+}
+zbx_history_bin_column_t;
+
+#define ZBX_HISTORY_BIN_COLUMNS_NUM	8
+
+typedef struct
+{
+	zbx_history_bin_column_t	columns[ZBX_HISTORY_BIN_COLUMNS_NUM];
+	zbx_uint64_t			last_id;
+	zbx_uint64_t			last_itemid;
+	int				last_clock;
+	int				records_num;
+}
+zbx_history_bin_writer_t;
+
+typedef struct
+{
+	char			*data;
+	const unsigned char	*columns[ZBX_HISTORY_BIN_COLUMNS_NUM];
+	const unsigned char	*columns_end[ZBX_HISTORY_BIN_COLUMNS_NUM];
+	zbx_uint64_t		last_id;
+	zbx_uint64_t		last_itemid;
+	int			last_clock;
+	int			records_num;
+	int			records_read;
+}
+zbx_history_bin_reader_t;
+
+void	history_bin_writer_init(zbx_history_bin_writer_t *writer);
+void	history_bin_writer_add(zbx_history_bin_writer_t *writer, const zbx_history_bin_record_t *record);
+size_t	history_bin_writer_size(const zbx_history_bin_writer_t *writer);
+void	history_bin_writer_flush(zbx_history_bin_writer_t *writer, struct zbx_json *j, const char *tag);
+void	history_bin_writer_clear(zbx_history_bin_writer_t *writer);
+
+int	history_bin_reader_open(zbx_history_bin_reader_t *reader, const char *base64, char **error);
+int	history_bin_reader_next(zbx_history_bin_reader_t *reader, zbx_uint64_t *itemid, zbx_agent_value_t *av);
+void	history_bin_reader_clear(zbx_history_bin_reader_t *reader);
+
+#endif
@@ -0,0 +1,1454 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+/* The proxy history journal keeps the values to be sent to the server in append-only segment files
+   instead of the proxy_history table. History syncers append the values in batches, each batch is
+   written by a single write() under an exclusive file lock and is followed by nothing else: its header
+   holds the payload length and checksum, so a batch is committed once its checksum matches. The reader
+   maps the segments and walks the committed batches after the last acknowledged record, the segments
+   that are sent completely are removed on the server acknowledgement.
+
+   The record id is the segment number in the high 32 bits and the offset of the record end in the
+   segment in the low 32 bits, so ids grow monotonically and the id of the last sent record is the
+   position to continue reading from.
+
+   The lock file holds the state shared by the writers: the segment being written, the end of its last
+   committed batch and the numbers of the written and acknowledged records. A writer finding the segment
+   size different from the committed end re-checks the tail and drops it, the segment which cannot be
+   truncated is sealed by moving the state to the next segment, so no batch is appended after garbage. */
+
+#include "zbxproxyjournal.h"
+#include "zbxcacheconfig.h"
+#include "zbxserialize.h"
+#include "zbxnum.h"
+#include "log.h"
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <dirent.h>
+
+#define JOURNAL_SEGMENT_MAGIC		0x4e524a47	/* "GJRN" */
+#define JOURNAL_BATCH_MAGIC		0x48435442	/* "BTCH" */
+#define JOURNAL_STATE_MAGIC		0x54534a47	/* "GJST" */
+#define JOURNAL_VERSION			1
+
+#define JOURNAL_SEGMENT_HEADER_SIZE	(2 * sizeof(zbx_uint32_t))
+#define JOURNAL_BATCH_HEADER_SIZE	(5 * sizeof(zbx_uint32_t))
+#define JOURNAL_SEGMENT_SIZE		(16 * ZBX_MEBIBYTE)
+#define JOURNAL_RETRY_DELAY_MAX		10
+
+/* batch header fields */
+#define JOURNAL_BATCH_MAGIC_IDX		0
+#define JOURNAL_BATCH_LEN_IDX		1
+#define JOURNAL_BATCH_RECORDS_IDX	2
+#define JOURNAL_BATCH_CLOCK_IDX		3
+#define JOURNAL_BATCH_CRC_IDX		4
+
+#define JOURNAL_ID(seq, offset)		(((zbx_uint64_t)(seq) << 32) | (zbx_uint32_t)(offset))
+#define JOURNAL_ID_SEQ(id)		((zbx_uint32_t)((id) >> 32))
+#define JOURNAL_ID_OFFSET(id)		((zbx_uint32_t)((id) & 0xffffffff))
+
+#define JOURNAL_SEGMENT_NAME_LEN	ZBX_CONST_STRLEN("history.00000000")
+#define JOURNAL_SPILL_PREFIX		"history.spill."
+
+typedef struct
+{
+	zbx_uint32_t	magic;
+	zbx_uint32_t	seq;		/* the segment being written */
+	zbx_uint64_t	end;		/* the end of the last committed batch of the segment */
+	zbx_uint64_t	written;	/* the records written and acknowledged or dropped since the start */
+	zbx_uint64_t	acked;
+}
+journal_state_t;
+
+static struct
+{
+	char		*dir;
+	zbx_uint64_t	max_size;
+	int		max_age;
+	pid_t		pid;		/* the process which opened the descriptors */
+	int		lock_fd;
+	int		fd;		/* the segment being written */
+	zbx_uint32_t	seq;
+	unsigned char	*batch;
+	size_t		batch_alloc;
+	size_t		batch_offset;
+	zbx_uint32_t	batch_records;
+	time_t		retry_time;	/* the failed batch is not written again before this time */
+	int		retry_delay;
+}
+journal = {.lock_fd = -1, .fd = -1};
+
+static zbx_uint32_t	journal_crc32(const unsigned char *data, size_t len)
+{
+	static zbx_uint32_t	table[256];
+	zbx_uint32_t		crc = 0xffffffff;
+	size_t			i;
+
+	if (0 == table[1])
+	{
+		for (i = 0; i < 256; i++)
+		{
+			zbx_uint32_t	c = (zbx_uint32_t)i;
+			int		k;
+
+			for (k = 0; k < 8; k++)
+				c = (0 != (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1);
+
+			table[i] = c;
+		}
+	}
+
+	for (i = 0; i < len; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+
+static char	*journal_path(const char *name)
+{
+	return zbx_dsprintf(NULL, "%s/%s", journal.dir, name);
+}
+
+static char	*journal_segment_path(zbx_uint32_t seq)
+{
+	return zbx_dsprintf(NULL, "%s/history.%08x", journal.dir, seq);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: finds the first and the last journal segments                     *
+ *                                                                            *
+ * Parameters: first - [OUT] the first segment number                         *
+ *             last  - [OUT] the last segment number                          *
+ *             size  - [OUT] the total size of the segments, optional         *
+ *                                                                            *
+ * Return value: the number of segments                                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	journal_scan(zbx_uint32_t *first, zbx_uint32_t *last, zbx_uint64_t *size)
+{
+	DIR		*dir;
+	struct dirent	*d;
+	int		segments_num = 0;
+
+	*first = 0;
+	*last = 0;
+
+	if (NULL != size)
+		*size = 0;
+
+	if (NULL == (dir = opendir(journal.dir)))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot open proxy history journal directory \"%s\": %s", journal.dir,
+				zbx_strerror(errno));
+		return 0;
+	}
+
+	while (NULL != (d = readdir(dir)))
+	{
+		unsigned int	seq;
+
+		if (JOURNAL_SEGMENT_NAME_LEN != strlen(d->d_name) || 1 != sscanf(d->d_name, "history.%8x", &seq) ||
+				0 == seq)
+		{
+			continue;
+		}
+
+		if (0 == segments_num++ || seq < *first)
+			*first = seq;
+
+		if (seq > *last)
+			*last = seq;
+
+		if (NULL != size)
+		{
+			char		*path = journal_segment_path(seq);
+			zbx_stat_t	st;
+
+			if (0 == zbx_stat(path, &st))
+				*size += (zbx_uint64_t)st.st_size;
+
+			zbx_free(path);
+		}
+	}
+
+	closedir(dir);
+
+	return segments_num;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: takes the journal lock shared by the writers                      *
+ *                                                                            *
+ ******************************************************************************/
+static int	journal_lock(void)
+{
+	if (journal.pid != getpid())
+	{
+		/* the descriptors inherited from the parent would share the lock with the siblings */
+		if (-1 != journal.lock_fd)
+			close(journal.lock_fd);
+
+		if (-1 != journal.fd)
+			close(journal.fd);
+
+		journal.lock_fd = -1;
+		journal.fd = -1;
+		journal.pid = getpid();
+	}
+
+	if (-1 == journal.lock_fd)
+	{
+		char	*path = journal_path("history.lock");
+
+		if (-1 == (journal.lock_fd = open(path, O_RDWR | O_CREAT, 0640)))
+		{
+			zabbix_log(LOG_LEVEL_ERR, "cannot open proxy history journal lock \"%s\": %s", path,
+					zbx_strerror(errno));
+			zbx_free(path);
+			return FAIL;
+		}
+
+		zbx_free(path);
+	}
+
+	if (0 != flock(journal.lock_fd, LOCK_EX))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot lock proxy history journal: %s", zbx_strerror(errno));
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+static void	journal_unlock(void)
+{
+	flock(journal.lock_fd, LOCK_UN);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads the writers state from the lock file                        *
+ *                                                                            *
+ * Comments: must be called under the journal lock, the missing state is      *
+ *           read as empty                                                    *
+ *                                                                            *
+ ******************************************************************************/
+static void	journal_state_read(journal_state_t *state)
+{
+	if (sizeof(journal_state_t) != pread(journal.lock_fd, state, sizeof(journal_state_t), 0) ||
+			JOURNAL_STATE_MAGIC != state->magic)
+	{
+		memset(state, 0, sizeof(journal_state_t));
+	}
+}
+
+static void	journal_state_write(const journal_state_t *state)
+{
+	journal_state_t	tmp = *state;
+
+	tmp.magic = JOURNAL_STATE_MAGIC;
+
+	if (sizeof(journal_state_t) != pwrite(journal.lock_fd, &tmp, sizeof(journal_state_t), 0))
+	{
+		/* the writers re-check the segment tail until the state is written again */
+		zabbix_log(LOG_LEVEL_WARNING, "cannot write proxy history journal state: %s", zbx_strerror(errno));
+	}
+}
+
+static int	journal_write(int fd, const unsigned char *data, size_t len)
+{
+	ssize_t	n;
+
+	while (0 != len)
+	{
+		if (-1 == (n = write(fd, data, len)))
+		{
+			if (EINTR == errno)
+				continue;
+
+			return FAIL;
+		}
+
+		data += n;
+		len -= (size_t)n;
+	}
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: finds the end of the committed batches of the mapped segment      *
+ *                                                                            *
+ * Parameters: map  - [IN] the mapped segment                                 *
+ *             size - [IN] the segment size                                   *
+ *             pos  - [IN] the end of a batch known to be committed, 0 to     *
+ *                         check the segment from the start                   *
+ *                                                                            *
+ * Return value: the offset after the last valid batch                        *
+ *                                                                            *
+ ******************************************************************************/
+static size_t	journal_segment_committed(const unsigned char *map, size_t size, size_t pos)
+{
+	zbx_uint32_t	header[5];
+
+	if (JOURNAL_SEGMENT_HEADER_SIZE > size)
+		return 0;
+
+	memcpy(header, map, JOURNAL_SEGMENT_HEADER_SIZE);
+
+	if (JOURNAL_SEGMENT_MAGIC != header[0] || JOURNAL_VERSION != header[1])
+		return 0;
+
+	if (JOURNAL_SEGMENT_HEADER_SIZE > pos || pos > size)
+		pos = JOURNAL_SEGMENT_HEADER_SIZE;
+
+	while (pos + JOURNAL_BATCH_HEADER_SIZE <= size)
+	{
+		size_t	end;
+
+		memcpy(header, map + pos, sizeof(header));
+		end = pos + JOURNAL_BATCH_HEADER_SIZE + header[JOURNAL_BATCH_LEN_IDX];
+
+		if (JOURNAL_BATCH_MAGIC != header[JOURNAL_BATCH_MAGIC_IDX] || end > size ||
+				header[JOURNAL_BATCH_CRC_IDX] != journal_crc32(map + pos + JOURNAL_BATCH_HEADER_SIZE,
+				header[JOURNAL_BATCH_LEN_IDX]))
+		{
+			break;
+		}
+
+		pos = end;
+	}
+
+	return pos;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: checks that the segment ends with a committed batch, the damaged  *
+ *          tail left by a failed write or a crashed writer is dropped        *
+ *                                                                            *
+ * Parameters: state - [IN] the writers state                                 *
+ *             size  - [IN/OUT] the segment size                              *
+ *                                                                            *
+ * Return value: SUCCEED - the batch can be appended to the segment           *
+ *               FAIL    - the segment must be sealed                         *
+ *                                                                            *
+ * Comments: must be called under the journal lock                            *
+ *                                                                            *
+ ******************************************************************************/
+static int	journal_check_tail(const journal_state_t *state, size_t *size)
+{
+	unsigned char	*map;
+	size_t		committed, pos = 0;
+
+	if (state->seq == journal.seq)
+	{
+		if (*size == state->end)
+			return SUCCEED;
+
+		pos = (size_t)state->end;
+	}
+
+	if (MAP_FAILED == (map = (unsigned char *)mmap(NULL, *size, PROT_READ, MAP_SHARED, journal.fd, 0)))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot map proxy history journal segment: %s", zbx_strerror(errno));
+		return FAIL;
+	}
+
+	committed = journal_segment_committed(map, *size, pos);
+	munmap(map, *size);
+
+	/* the state was not written after the last batch */
+	if (committed == *size)
+		return SUCCEED;
+
+	if (JOURNAL_SEGMENT_HEADER_SIZE > committed)
+		return FAIL;
+
+	zabbix_log(LOG_LEVEL_WARNING, "dropping " ZBX_FS_SIZE_T " bytes of damaged data at the end of proxy history"
+			" journal segment %08x", (zbx_fs_size_t)(*size - committed), journal.seq);
+
+	if (0 != ftruncate(journal.fd, (off_t)committed))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot truncate proxy history journal segment: %s", zbx_strerror(errno));
+		return FAIL;
+	}
+
+	*size = committed;
+
+	return SUCCEED;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: opens the segment to append the batch to, the next segment is     *
+ *          started when the current one is full or sealed                    *
+ *                                                                            *
+ * Parameters: state  - [IN/OUT] the writers state                            *
+ *             len    - [IN] the batch size                                   *
+ *             offset - [OUT] the batch offset in the segment                 *
+ *                                                                            *
+ * Comments: must be called under the journal lock                            *
+ *                                                                            *
+ ******************************************************************************/
+static int	journal_open_writer(journal_state_t *state, size_t len, zbx_uint32_t *offset)
+{
+	zbx_stat_t	st;
+	size_t		size;
+
+	if (-1 == journal.fd)
+	{
+		zbx_uint32_t	first, last;
+
+		if (0 != journal_scan(&first, &last, NULL) && last > journal.seq)
+			journal.seq = last;
+
+		if (0 == journal.seq)
+			journal.seq = 1;
+	}
+
+	/* another writer has started the next segment or sealed the current one */
+	if (state->seq > journal.seq)
+	{
+		if (-1 != journal.fd)
+		{
+			close(journal.fd);
+			journal.fd = -1;
+		}
+
+		journal.seq = state->seq;
+	}
+
+	while (1)
+	{
+		if (-1 == journal.fd)
+		{
+			char	*path = journal_segment_path(journal.seq);
+
+			if (-1 == (journal.fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0640)))
+			{
+				zabbix_log(LOG_LEVEL_ERR, "cannot open proxy history journal segment \"%s\": %s", path,
+						zbx_strerror(errno));
+				zbx_free(path);
+				return FAIL;
+			}
+
+			zbx_free(path);
+		}
+
+		if (0 != zbx_fstat(journal.fd, &st))
+		{
+			zabbix_log(LOG_LEVEL_ERR, "cannot stat proxy history journal segment: %s", zbx_strerror(errno));
+			return FAIL;
+		}
+
+		if (0 == (size = (size_t)st.st_size))
+		{
+			zbx_uint32_t	header[2] = {JOURNAL_SEGMENT_MAGIC, JOURNAL_VERSION};
+
+			if (SUCCEED != journal_write(journal.fd, (const unsigned char *)header, sizeof(header)))
+			{
+				zabbix_log(LOG_LEVEL_ERR, "cannot write proxy history journal segment: %s",
+						zbx_strerror(errno));
+				return FAIL;
+			}
+
+			size = JOURNAL_SEGMENT_HEADER_SIZE;
+		}
+		else if (SUCCEED != journal_check_tail(state, &size))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "sealing proxy history journal segment %08x", journal.seq);
+			size = JOURNAL_SEGMENT_SIZE;
+		}
+
+		if (JOURNAL_SEGMENT_SIZE > size && (zbx_uint64_t)size + len <= 0xffffffff)
+		{
+			*offset = (zbx_uint32_t)size;
+			return SUCCEED;
+		}
+
+		close(journal.fd);
+		journal.fd = -1;
+		journal.seq++;
+
+		state->seq = journal.seq;
+		state->end = 0;
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: appends the batch to the journal under the journal lock           *
+ *                                                                            *
+ * Parameters: batch   - [IN] the batch with the header                       *
+ *             len     - [IN] the batch size                                  *
+ *             records - [IN] the number of records in the batch              *
+ *                                                                            *
+ ******************************************************************************/
+static int	journal_append(const unsigned char *batch, size_t len, zbx_uint32_t records)
+{
+	journal_state_t	state;
+	zbx_uint32_t	offset;
+	int		ret = FAIL;
+
+	if (SUCCEED != journal_lock())
+		return FAIL;
+
+	journal_state_read(&state);
+
+	if (SUCCEED == journal_open_writer(&state, len, &offset))
+	{
+		state.seq = journal.seq;
+
+		if (SUCCEED != (ret = journal_write(journal.fd, batch, len)))
+		{
+			zabbix_log(LOG_LEVEL_ERR, "cannot write %u values to proxy history journal: %s", records,
+					zbx_strerror(errno));
+
+			/* drop the partially written batch so the next ones are readable */
+			if (0 != ftruncate(journal.fd, (off_t)offset))
+			{
+				zabbix_log(LOG_LEVEL_ERR, "cannot truncate proxy history journal segment: %s",
+						zbx_strerror(errno));
+
+				/* the readers skip the damaged tail of the segments which are not the last, */
+				/* the other writers follow the state to the next segment                    */
+				state.seq = ++journal.seq;
+				offset = 0;
+			}
+
+			close(journal.fd);
+			journal.fd = -1;
+
+			state.end = offset;
+		}
+		else
+		{
+			state.end = offset + len;
+			state.written += records;
+		}
+	}
+
+	/* the sealed segment is left by the other writers even if this one failed to start the next */
+	journal_state_write(&state);
+	journal_unlock();
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds the record to the batch of the process                       *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_proxy_journal_add(const zbx_proxy_journal_record_t *record)
+{
+	zbx_uint32_t	len = 0, source_len = 0, value_len = 0;
+	unsigned char	*ptr;
+
+	if (0 == journal.batch_offset)
+		journal.batch_offset = JOURNAL_BATCH_HEADER_SIZE;
+
+	zbx_serialize_prepare_value(len, record->itemid);
+	zbx_serialize_prepare_value(len, record->clock);
+	zbx_serialize_prepare_value(len, record->ns);
+	zbx_serialize_prepare_value(len, record->flags);
+
+	if (PROXY_HISTORY_FLAG_NOVALUE != (record->flags & PROXY_HISTORY_MASK_NOVALUE))
+	{
+		zbx_serialize_prepare_value(len, record->state);
+
+		if (0 == (record->flags & PROXY_HISTORY_FLAG_NOVALUE))
+		{
+			zbx_serialize_prepare_value(len, record->timestamp);
+			zbx_serialize_prepare_value(len, record->severity);
+			zbx_serialize_prepare_value(len, record->logeventid);
+			zbx_serialize_prepare_str_len(len, record->source, source_len);
+			zbx_serialize_prepare_str_len(len, record->value, value_len);
+		}
+
+		if (0 != (record->flags & PROXY_HISTORY_FLAG_META))
+		{
+			zbx_serialize_prepare_value(len, record->lastlogsize);
+			zbx_serialize_prepare_value(len, record->mtime);
+		}
+	}
+
+	if (journal.batch_alloc < journal.batch_offset + len)
+	{
+		while (journal.batch_alloc < journal.batch_offset + len)
+			journal.batch_alloc = MAX(16 * ZBX_KIBIBYTE, journal.batch_alloc * 2);
+
+		journal.batch = (unsigned char *)zbx_realloc(journal.batch, journal.batch_alloc);
+	}
+
+	ptr = journal.batch + journal.batch_offset;
+
+	ptr += zbx_serialize_uint64(ptr, record->itemid);
+	ptr += zbx_serialize_int(ptr, record->clock);
+	ptr += zbx_serialize_int(ptr, record->ns);
+	ptr += zbx_serialize_char(ptr, record->flags);
+
+	if (PROXY_HISTORY_FLAG_NOVALUE != (record->flags & PROXY_HISTORY_MASK_NOVALUE))
+	{
+		ptr += zbx_serialize_char(ptr, record->state);
+
+		if (0 == (record->flags & PROXY_HISTORY_FLAG_NOVALUE))
+		{
+			ptr += zbx_serialize_int(ptr, record->timestamp);
+			ptr += zbx_serialize_int(ptr, record->severity);
+			ptr += zbx_serialize_int(ptr, record->logeventid);
+			ptr += zbx_serialize_str(ptr, record->source, source_len);
+			ptr += zbx_serialize_str(ptr, record->value, value_len);
+		}
+
+		if (0 != (record->flags & PROXY_HISTORY_FLAG_META))
+		{
+			ptr += zbx_serialize_uint64(ptr, record->lastlogsize);
+			ptr += zbx_serialize_int(ptr, record->mtime);
+		}
+	}
+
+	journal.batch_offset += len;
+	journal.batch_records++;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes the batch of the process to the journal                    *
+ *                                                                            *
+ * Return value: SUCCEED - the batch was written, or there was nothing to     *
+ *                         write                                              *
+ *               FAIL    - the batch could not be written, it is kept and     *
+ *                         written with the next batches                      *
+ *                                                                            *
+ * Comments: the failed writes are retried with a growing delay, the syncer   *
+ *           waits for the journal once the kept batch reaches the segment    *
+ *           size the same way it waits for the database when it is down      *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_proxy_journal_commit(void)
+{
+	zbx_uint32_t	header[5];
+	int		ret;
+	time_t		now;
+
+	if (0 == journal.batch_records)
+		return SUCCEED;
+
+	if ((now = time(NULL)) < journal.retry_time)
+	{
+		if (JOURNAL_SEGMENT_SIZE > journal.batch_offset)
+			return FAIL;
+
+		sleep((unsigned int)(journal.retry_time - now));
+	}
+
+	header[JOURNAL_BATCH_MAGIC_IDX] = JOURNAL_BATCH_MAGIC;
+	header[JOURNAL_BATCH_LEN_IDX] = (zbx_uint32_t)(journal.batch_offset - JOURNAL_BATCH_HEADER_SIZE);
+	header[JOURNAL_BATCH_RECORDS_IDX] = journal.batch_records;
+	header[JOURNAL_BATCH_CLOCK_IDX] = (zbx_uint32_t)time(NULL);
+	header[JOURNAL_BATCH_CRC_IDX] = journal_crc32(journal.batch + JOURNAL_BATCH_HEADER_SIZE,
+			header[JOURNAL_BATCH_LEN_IDX]);
+
+	memcpy(journal.batch, header, sizeof(header));
+
+	if (SUCCEED != (ret = journal_append(journal.batch, journal.batch_offset, journal.batch_records)))
+	{
+		journal.retry_delay = MIN(0 == journal.retry_delay ? 1 : journal.retry_delay * 2,
+				JOURNAL_RETRY_DELAY_MAX);
+		journal.retry_time = time(NULL) + journal.retry_delay;
+
+		zabbix_log(LOG_LEVEL_WARNING, "%u proxy history values are kept, retrying in %d seconds",
+				journal.batch_records, journal.retry_delay);
+
+		return FAIL;
+	}
+
+	if (0 != journal.retry_delay)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "%u kept proxy history values were written to the journal",
+				journal.batch_records);
+		journal.retry_delay = 0;
+		journal.retry_time = 0;
+	}
+
+	journal.batch_offset = 0;
+	journal.batch_records = 0;
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: writes the batch kept after a failed write when the syncer stops, *
+ *          the batch which still cannot be written is spilled to a separate  *
+ *          file appended to the journal on the next start                    *
+ *                                                                            *
+ * Return value: SUCCEED - the batch was written or spilled                   *
+ *               FAIL    - the values of the batch are lost                   *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_proxy_journal_flush(void)
+{
+	char	*path;
+	int	fd, ret = FAIL;
+
+	if (0 == journal.batch_records)
+		return SUCCEED;
+
+	journal.retry_time = 0;
+
+	/* the commit sets the batch header before writing */
+	if (SUCCEED == zbx_proxy_journal_commit())
+		return SUCCEED;
+
+	path = zbx_dsprintf(NULL, "%s/" JOURNAL_SPILL_PREFIX "%d", journal.dir, (int)getpid());
+
+	if (-1 == (fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0640)))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot open \"%s\": %s", path, zbx_strerror(errno));
+		goto out;
+	}
+
+	if (SUCCEED != journal_write(fd, journal.batch, journal.batch_offset) || 0 != fsync(fd))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot write \"%s\": %s", path, zbx_strerror(errno));
+		close(fd);
+		goto out;
+	}
+
+	close(fd);
+
+	zabbix_log(LOG_LEVEL_WARNING, "%u proxy history values were spilled to \"%s\"", journal.batch_records, path);
+	ret = SUCCEED;
+out:
+	if (SUCCEED != ret)
+		zabbix_log(LOG_LEVEL_ERR, "%u proxy history values are lost", journal.batch_records);
+
+	journal.batch_offset = 0;
+	journal.batch_records = 0;
+	zbx_free(path);
+
+	return ret;
+}
+
+static const unsigned char	*journal_parse_str(const unsigned char *ptr, const char **str)
+{
+	zbx_uint32_t	len;
+
+	memcpy(&len, ptr, sizeof(len));
+	ptr += sizeof(len);
+
+	*str = (0 == len ? "" : (const char *)ptr);
+
+	return ptr + len;
+}
+
+static const unsigned char	*journal_parse_record(const unsigned char *ptr, zbx_proxy_journal_record_t *record)
+{
+	memset(record, 0, sizeof(zbx_proxy_journal_record_t));
+	record->source = "";
+	record->value = "";
+
+	ptr += zbx_deserialize_uint64(ptr, &record->itemid);
+	ptr += zbx_deserialize_int(ptr, &record->clock);
+	ptr += zbx_deserialize_int(ptr, &record->ns);
+	ptr += zbx_deserialize_char(ptr, &record->flags);
+
+	if (PROXY_HISTORY_FLAG_NOVALUE != (record->flags & PROXY_HISTORY_MASK_NOVALUE))
+	{
+		ptr += zbx_deserialize_char(ptr, &record->state);
+
+		if (0 == (record->flags & PROXY_HISTORY_FLAG_NOVALUE))
+		{
+			ptr += zbx_deserialize_int(ptr, &record->timestamp);
+			ptr += zbx_deserialize_int(ptr, &record->severity);
+			ptr += zbx_deserialize_int(ptr, &record->logeventid);
+			ptr = journal_parse_str(ptr, &record->source);
+			ptr = journal_parse_str(ptr, &record->value);
+		}
+
+		if (0 != (record->flags & PROXY_HISTORY_FLAG_META))
+		{
+			ptr += zbx_deserialize_uint64(ptr, &record->lastlogsize);
+			ptr += zbx_deserialize_int(ptr, &record->mtime);
+		}
+	}
+
+	return ptr;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: passes the committed records of the segment after the offset to   *
+ *          the callback                                                      *
+ *                                                                            *
+ * Return value: SUCCEED - continue with the next segment                     *
+ *               FAIL    - stop reading                                       *
+ *                                                                            *
+ ******************************************************************************/
+static int	journal_walk_segment(zbx_uint32_t seq, zbx_uint32_t offset, int is_last, int max_records,
+		int *records_num, zbx_proxy_journal_read_cb_t cb, void *cb_data, int *first_clock)
+{
+	char		*path = journal_segment_path(seq);
+	int		fd, ret = SUCCEED;
+	zbx_stat_t	st;
+	size_t		size, pos = JOURNAL_SEGMENT_HEADER_SIZE;
+	unsigned char	*map;
+	zbx_uint32_t	header[5];
+
+	if (-1 == (fd = open(path, O_RDONLY)))
+	{
+		/* removed by the housekeeper */
+		if (ENOENT != errno)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot open proxy history journal segment \"%s\": %s", path,
+					zbx_strerror(errno));
+		}
+
+		goto out;
+	}
+
+	if (0 != zbx_fstat(fd, &st) || (size = (size_t)st.st_size) <= offset ||
+			JOURNAL_SEGMENT_HEADER_SIZE + JOURNAL_BATCH_HEADER_SIZE > size)
+	{
+		close(fd);
+		goto out;
+	}
+
+	map = (unsigned char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (MAP_FAILED == map)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot map proxy history journal segment \"%s\": %s", path,
+				zbx_strerror(errno));
+		ret = FAIL;
+		goto out;
+	}
+
+	memcpy(header, map, JOURNAL_SEGMENT_HEADER_SIZE);
+
+	if (JOURNAL_SEGMENT_MAGIC != header[0] || JOURNAL_VERSION != header[1])
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "skipping invalid proxy history journal segment \"%s\"", path);
+		goto unmap;
+	}
+
+	while (pos + JOURNAL_BATCH_HEADER_SIZE <= size)
+	{
+		const unsigned char	*ptr, *end;
+
+		memcpy(header, map + pos, sizeof(header));
+
+		if (JOURNAL_BATCH_MAGIC != header[JOURNAL_BATCH_MAGIC_IDX] ||
+				pos + JOURNAL_BATCH_HEADER_SIZE + header[JOURNAL_BATCH_LEN_IDX] > size)
+		{
+			break;
+		}
+
+		ptr = map + pos + JOURNAL_BATCH_HEADER_SIZE;
+		end = ptr + header[JOURNAL_BATCH_LEN_IDX];
+
+		/* the batches which were sent completely are skipped without validation */
+		if ((size_t)(end - map) <= offset)
+		{
+			pos = (size_t)(end - map);
+			continue;
+		}
+
+		if (header[JOURNAL_BATCH_CRC_IDX] != journal_crc32(ptr, header[JOURNAL_BATCH_LEN_IDX]))
+			break;
+
+		while (ptr < end)
+		{
+			zbx_proxy_journal_record_t	record;
+
+			ptr = journal_parse_record(ptr, &record);
+			record.id = JOURNAL_ID(seq, ptr - map);
+
+			if (JOURNAL_ID_OFFSET(record.id) <= offset)
+				continue;
+
+			if (max_records <= *records_num || (NULL != cb && SUCCEED != cb(&record, cb_data)))
+			{
+				ret = FAIL;
+				goto unmap;
+			}
+
+			if (NULL != first_clock && 0 == *records_num)
+				*first_clock = (int)header[JOURNAL_BATCH_CLOCK_IDX];
+
+			(*records_num)++;
+		}
+
+		pos = (size_t)(end - map);
+	}
+
+	if (pos + JOURNAL_BATCH_HEADER_SIZE <= size || (pos < size && 0 == is_last))
+	{
+		/* the batch being written by a syncer is not committed yet, the rest of the last segment */
+		/* will be read next time; the other segments can only be damaged                         */
+		if (0 != is_last)
+			ret = FAIL;
+		else
+			zabbix_log(LOG_LEVEL_WARNING, "skipping damaged tail of proxy history journal segment \"%s\"", path);
+	}
+unmap:
+	munmap(map, size);
+out:
+	zbx_free(path);
+
+	return ret;
+}
+
+static int	journal_walk(zbx_uint64_t lastid, int max_records, zbx_proxy_journal_read_cb_t cb, void *cb_data,
+		int *first_clock)
+{
+	zbx_uint32_t	seq = JOURNAL_ID_SEQ(lastid), offset = JOURNAL_ID_OFFSET(lastid), first, last;
+	int		records_num = 0;
+
+	if (0 == journal_scan(&first, &last, NULL))
+		return 0;
+
+	if (seq < first)
+	{
+		seq = first;
+		offset = 0;
+	}
+
+	for (; seq <= last; seq++, offset = 0)
+	{
+		if (SUCCEED != journal_walk_segment(seq, offset, seq == last, max_records, &records_num, cb, cb_data,
+				first_clock))
+		{
+			break;
+		}
+	}
+
+	return records_num;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: reads the committed records after lastid                          *
+ *                                                                            *
+ * Parameters: lastid      - [IN] the id of the last sent record              *
+ *             max_records - [IN] the maximum number of records to read       *
+ *             cb          - [IN] the callback to pass the records to         *
+ *             cb_data     - [IN] the callback data                           *
+ *                                                                            *
+ * Return value: the number of records read                                   *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_proxy_journal_read(zbx_uint64_t lastid, int max_records, zbx_proxy_journal_read_cb_t cb, void *cb_data)
+{
+	return journal_walk(lastid, max_records, cb, cb_data, NULL);
+}
+
+zbx_uint64_t	zbx_proxy_journal_get_lastid(void)
+{
+	char		*path = journal_path("history.ack"), buffer[MAX_ID_LEN + 1];
+	int		fd;
+	ssize_t		n;
+	zbx_uint64_t	lastid = 0;
+
+	if (-1 != (fd = open(path, O_RDONLY)))
+	{
+		if (0 < (n = read(fd, buffer, sizeof(buffer) - 1)))
+		{
+			buffer[n] = '\0';
+
+			if (SUCCEED != zbx_is_uint64(buffer, &lastid))
+				lastid = 0;
+		}
+
+		close(fd);
+	}
+
+	zbx_free(path);
+
+	return lastid;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: adds the acknowledged or dropped records to the writers state     *
+ *                                                                            *
+ ******************************************************************************/
+static void	journal_add_acked(zbx_uint64_t records)
+{
+	journal_state_t	state;
+
+	if (0 == records || SUCCEED != journal_lock())
+		return;
+
+	journal_state_read(&state);
+	state.acked += records;
+	journal_state_write(&state);
+
+	journal_unlock();
+}
+
+static int	journal_acked_cb(const zbx_proxy_journal_record_t *record, void *cb_data)
+{
+	return record->id <= *(const zbx_uint64_t *)cb_data ? SUCCEED : FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: saves the id of the last record acknowledged by the server and    *
+ *          removes the segments which were sent completely                   *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_proxy_journal_set_lastid(zbx_uint64_t lastid)
+{
+	char		*path = journal_path("history.ack"), *path_tmp = journal_path("history.ack.tmp");
+	char		buffer[MAX_ID_LEN + 1];
+	int		fd, len, acked;
+	zbx_uint32_t	seq, first, last;
+
+	len = zbx_snprintf(buffer, sizeof(buffer), ZBX_FS_UI64, lastid);
+
+	/* only the records sent since the previous acknowledgement are walked */
+	acked = journal_walk(zbx_proxy_journal_get_lastid(), INT_MAX, journal_acked_cb, &lastid, NULL);
+
+	if (-1 == (fd = open(path_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0640)))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot open \"%s\": %s", path_tmp, zbx_strerror(errno));
+		goto out;
+	}
+
+	if (SUCCEED != journal_write(fd, (const unsigned char *)buffer, (size_t)len) || 0 != fsync(fd))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot write \"%s\": %s", path_tmp, zbx_strerror(errno));
+		close(fd);
+		goto out;
+	}
+
+	close(fd);
+
+	if (0 != rename(path_tmp, path))
+	{
+		zabbix_log(LOG_LEVEL_ERR, "cannot rename \"%s\" to \"%s\": %s", path_tmp, path, zbx_strerror(errno));
+		goto out;
+	}
+
+	journal_add_acked((zbx_uint64_t)acked);
+
+	if (0 == journal_scan(&first, &last, NULL))
+		goto out;
+
+	/* the segment of the last sent record is kept as it might have more records or be written to */
+	for (seq = first; seq < JOURNAL_ID_SEQ(lastid) && seq < last; seq++)
+	{
+		char	*segment = journal_segment_path(seq);
+
+		if (0 != unlink(segment) && ENOENT != errno)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot remove proxy history journal segment \"%s\": %s", segment,
+					zbx_strerror(errno));
+		}
+
+		zbx_free(segment);
+	}
+out:
+	zbx_free(path_tmp);
+	zbx_free(path);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns the age of the oldest record not sent to the server       *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_proxy_journal_get_delay(zbx_uint64_t lastid)
+{
+	int	clock = 0;
+
+	if (0 == journal_walk(lastid, 1, NULL, NULL, &clock))
+		return 0;
+
+	return (int)time(NULL) - clock;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns the number of records not sent to the server              *
+ *                                                                            *
+ * Comments: the count is kept by the writers and the acknowledgements, the   *
+ *           journal is not read                                              *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_proxy_journal_get_count(void)
+{
+	journal_state_t	state;
+
+	if (SUCCEED != journal_lock())
+		return 0;
+
+	journal_state_read(&state);
+	journal_unlock();
+
+	if (state.written <= state.acked)
+		return 0;
+
+	return (int)MIN(state.written - state.acked, INT_MAX);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: removes the segments exceeding the journal age and size limits    *
+ *                                                                            *
+ * Return value: the number of removed segments                               *
+ *                                                                            *
+ * Comments: the segment being written is never removed                       *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_proxy_journal_housekeep(int now)
+{
+	zbx_uint32_t	seq, first, last;
+	zbx_uint64_t	size, lastid, dropped = 0;
+	int		removed = 0;
+
+	if (0 == journal_scan(&first, &last, &size))
+		return 0;
+
+	lastid = zbx_proxy_journal_get_lastid();
+
+	for (seq = first; seq < last; seq++)
+	{
+		char		*path = journal_segment_path(seq);
+		zbx_stat_t	st;
+		int		records_num = 0;
+
+		if (0 != zbx_stat(path, &st))
+		{
+			zbx_free(path);
+			continue;
+		}
+
+		if (st.st_mtime >= now - journal.max_age && size <= journal.max_size)
+		{
+			zbx_free(path);
+			break;
+		}
+
+		if (seq >= JOURNAL_ID_SEQ(lastid))
+		{
+			journal_walk_segment(seq, seq == JOURNAL_ID_SEQ(lastid) ? JOURNAL_ID_OFFSET(lastid) : 0, 0,
+					INT_MAX, &records_num, NULL, NULL, NULL);
+		}
+
+		if (0 != unlink(path))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot remove proxy history journal segment \"%s\": %s", path,
+					zbx_strerror(errno));
+			zbx_free(path);
+			break;
+		}
+
+		if (0 != records_num)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "removed proxy history journal segment \"%s\" with %d values not"
+					" sent to server: journal %s limit is exceeded", path, records_num,
+					size > journal.max_size ? "size" : "age");
+			dropped += (zbx_uint64_t)records_num;
+		}
+
+		size -= (zbx_uint64_t)st.st_size;
+		removed++;
+		zbx_free(path);
+	}
+
+	journal_add_acked(dropped);
+
+	return removed;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: truncates the last segment after the last committed batch, the    *
+ *          batch being written when the proxy stopped is dropped             *
+ *                                                                            *
+ ******************************************************************************/
+static int	journal_recover(char **error)
+{
+	zbx_uint32_t	first, last;
+	char		*path;
+	int		fd, ret = FAIL;
+	zbx_stat_t	st;
+	size_t		committed = 0;
+
+	if (0 == journal_scan(&first, &last, NULL))
+		return SUCCEED;
+
+	path = journal_segment_path(last);
+
+	if (-1 == (fd = open(path, O_RDWR)))
+	{
+		*error = zbx_dsprintf(NULL, "cannot open \"%s\": %s", path, zbx_strerror(errno));
+		goto out;
+	}
+
+	if (0 != zbx_fstat(fd, &st))
+	{
+		*error = zbx_dsprintf(NULL, "cannot stat \"%s\": %s", path, zbx_strerror(errno));
+		goto close;
+	}
+
+	if (0 != st.st_size)
+	{
+		unsigned char	*map;
+
+		if (MAP_FAILED == (map = (unsigned char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0)))
+		{
+			*error = zbx_dsprintf(NULL, "cannot map \"%s\": %s", path, zbx_strerror(errno));
+			goto close;
+		}
+
+		committed = journal_segment_committed(map, (size_t)st.st_size, 0);
+		munmap(map, (size_t)st.st_size);
+	}
+
+	if (committed != (size_t)st.st_size)
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "dropping " ZBX_FS_SIZE_T " bytes of uncommitted data at the end of proxy"
+				" history journal segment \"%s\"", (zbx_fs_size_t)((size_t)st.st_size - committed), path);
+
+		if (0 != ftruncate(fd, (off_t)committed))
+		{
+			*error = zbx_dsprintf(NULL, "cannot truncate \"%s\": %s", path, zbx_strerror(errno));
+			goto close;
+		}
+	}
+
+	ret = SUCCEED;
+close:
+	close(fd);
+out:
+	zbx_free(path);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: rebuilds the writers state from the segments after the recovery   *
+ *                                                                            *
+ ******************************************************************************/
+static int	journal_reset_state(char **error)
+{
+	journal_state_t	state = {.magic = JOURNAL_STATE_MAGIC};
+	zbx_uint32_t	first, last;
+	char		*path;
+	int		fd, flags = O_WRONLY, ret = FAIL;
+
+	if (0 != journal_scan(&first, &last, NULL))
+	{
+		zbx_stat_t	st;
+
+		path = journal_segment_path(last);
+
+		if (0 == zbx_stat(path, &st))
+		{
+			state.seq = last;
+			state.end = (zbx_uint64_t)st.st_size;
+		}
+
+		zbx_free(path);
+
+		/* the records not sent when the proxy stopped are counted once on the start */
+		state.written = (zbx_uint64_t)journal_walk(zbx_proxy_journal_get_lastid(), INT_MAX, NULL, NULL, NULL);
+		flags |= O_CREAT;
+	}
+
+	path = journal_path("history.lock");
+
+	if (-1 == (fd = open(path, flags, 0640)))
+	{
+		/* the empty journal has no state */
+		if (ENOENT == errno && 0 == (flags & O_CREAT))
+			ret = SUCCEED;
+		else
+			*error = zbx_dsprintf(NULL, "cannot open \"%s\": %s", path, zbx_strerror(errno));
+
+		goto out;
+	}
+
+	if (sizeof(state) != pwrite(fd, &state, sizeof(state), 0))
+		*error = zbx_dsprintf(NULL, "cannot write \"%s\": %s", path, zbx_strerror(errno));
+	else
+		ret = SUCCEED;
+
+	close(fd);
+out:
+	zbx_free(path);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: appends the batches spilled by the syncers which could not write  *
+ *          them to the journal when stopping                                 *
+ *                                                                            *
+ ******************************************************************************/
+static void	journal_replay_spills(void)
+{
+	DIR		*dir;
+	struct dirent	*d;
+
+	if (NULL == (dir = opendir(journal.dir)))
+		return;
+
+	while (NULL != (d = readdir(dir)))
+	{
+		char		*path;
+		int		fd, records_num = 0, ret = SUCCEED;
+		zbx_stat_t	st;
+		unsigned char	*map;
+		size_t		pos = 0, size;
+		zbx_uint32_t	header[5];
+
+		if (0 != strncmp(d->d_name, JOURNAL_SPILL_PREFIX, ZBX_CONST_STRLEN(JOURNAL_SPILL_PREFIX)))
+			continue;
+
+		path = journal_path(d->d_name);
+
+		if (-1 == (fd = open(path, O_RDONLY)))
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot open \"%s\": %s", path, zbx_strerror(errno));
+			zbx_free(path);
+			continue;
+		}
+
+		if (0 != zbx_fstat(fd, &st) || 0 == (size = (size_t)st.st_size) ||
+				MAP_FAILED == (map = (unsigned char *)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)))
+		{
+			close(fd);
+			unlink(path);
+			zbx_free(path);
+			continue;
+		}
+
+		close(fd);
+
+		while (pos + JOURNAL_BATCH_HEADER_SIZE <= size)
+		{
+			size_t	len;
+
+			memcpy(header, map + pos, sizeof(header));
+			len = JOURNAL_BATCH_HEADER_SIZE + header[JOURNAL_BATCH_LEN_IDX];
+
+			if (JOURNAL_BATCH_MAGIC != header[JOURNAL_BATCH_MAGIC_IDX] || pos + len > size ||
+					header[JOURNAL_BATCH_CRC_IDX] != journal_crc32(map + pos + JOURNAL_BATCH_HEADER_SIZE,
+					header[JOURNAL_BATCH_LEN_IDX]))
+			{
+				zabbix_log(LOG_LEVEL_WARNING, "skipping damaged tail of \"%s\"", path);
+				break;
+			}
+
+			if (SUCCEED != (ret = journal_append(map + pos, len, header[JOURNAL_BATCH_RECORDS_IDX])))
+				break;
+
+			records_num += (int)header[JOURNAL_BATCH_RECORDS_IDX];
+			pos += len;
+		}
+
+		munmap(map, size);
+
+		/* the file is kept to be appended on the next start if the journal cannot be written */
+		if (SUCCEED != ret)
+		{
+			zabbix_log(LOG_LEVEL_WARNING, "cannot append \"%s\" to proxy history journal", path);
+		}
+		else
+		{
+			zabbix_log(LOG_LEVEL_INFORMATION, "appended %d spilled values from \"%s\" to proxy history"
+					" journal", records_num, path);
+			unlink(path);
+		}
+
+		zbx_free(path);
+	}
+
+	closedir(dir);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: enables the journal, must be called before forking the processes  *
+ *                                                                            *
+ * Parameters: dir      - [IN] the journal directory                          *
+ *             max_size - [IN] the total size of the segments, bytes          *
+ *             max_age  - [IN] the age of the segments to keep, seconds       *
+ *             error    - [OUT] the error message                             *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_proxy_journal_init(const char *dir, zbx_uint64_t max_size, int max_age, char **error)
+{
+	zbx_stat_t	st;
+
+	if (0 != zbx_stat(dir, &st) || 0 == S_ISDIR(st.st_mode) || 0 != access(dir, R_OK | W_OK | X_OK))
+	{
+		*error = zbx_dsprintf(NULL, "cannot access proxy history journal directory \"%s\": %s", dir,
+				0 != errno ? zbx_strerror(errno) : "not a directory");
+		return FAIL;
+	}
+
+	/* the segment of the previous directory is not continued */
+	if (-1 != journal.fd)
+	{
+		close(journal.fd);
+		journal.fd = -1;
+	}
+
+	if (-1 != journal.lock_fd)
+	{
+		close(journal.lock_fd);
+		journal.lock_fd = -1;
+	}
+
+	journal.seq = 0;
+	journal.dir = zbx_strdup(journal.dir, dir);
+	journal.max_size = max_size;
+	journal.max_age = max_age;
+
+	if (SUCCEED != journal_recover(error) || SUCCEED != journal_reset_state(error))
+	{
+		zbx_free(journal.dir);
+		return FAIL;
+	}
+
+	journal_replay_spills();
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "proxy history is kept in journal \"%s\"", dir);
+
+	return SUCCEED;
+}
+
+int	zbx_proxy_journal_enabled(void)
+{
+	return NULL != journal.dir ? SUCCEED : FAIL;
+}
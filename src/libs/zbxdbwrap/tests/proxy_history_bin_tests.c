@@ -0,0 +1,145 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "zbxjson.h"
+#include "zbx_item_constants.h"
+#include "../proxy_history_bin.h"
+
+#define TEST_RECORDS 1000
+
+static const char *values[] = {"123", "0123", "1.5", "0.10000000000000001", "-3", "text value", "",
+        "18446744073709551615", "1e5"};
+
+static void fill_record(zbx_history_bin_record_t *record, int i) {
+    memset(record, 0, sizeof(zbx_history_bin_record_t));
+
+    record->id = 1000 + i;
+    record->itemid = 500 + (i * 7919) % 300;
+    record->clock = 1700000000 + i / 10;
+    record->ns = i * 1000;
+    record->value = values[i % ARRSIZE(values)];
+    record->source = (0 == i % 5 ? "source" : "");
+    record->timestamp = i % 4;
+    record->severity = i % 3;
+    record->logeventid = -i;
+    record->lastlogsize = i * 10;
+    record->mtime = i;
+
+    if (0 == i % 17)
+        record->flags = PROXY_HISTORY_FLAG_META | PROXY_HISTORY_FLAG_NOVALUE;
+    else if (0 == i % 13)
+        record->flags = PROXY_HISTORY_FLAG_NOVALUE;
+    else if (0 == i % 6)
+        record->flags = PROXY_HISTORY_FLAG_META;
+
+    if (0 == i % 19)
+        record->state = ITEM_STATE_NOTSUPPORTED;
+}
+
+static void check_value(const zbx_history_bin_record_t *record, zbx_uint64_t itemid, const zbx_agent_value_t *av) {
+    assert(av->id == record->id);
+    assert(itemid == record->itemid);
+    assert(av->ts.sec == record->clock && av->ts.ns == record->ns);
+
+    if (PROXY_HISTORY_FLAG_NOVALUE == (record->flags & PROXY_HISTORY_MASK_NOVALUE)) {
+        assert(NULL == av->value && ITEM_STATE_NORMAL == av->state && 0 == av->meta);
+        return;
+    }
+
+    assert(av->state == record->state);
+
+    if (0 != (record->flags & PROXY_HISTORY_FLAG_NOVALUE)) {
+        assert(NULL == av->value);
+    } else {
+        assert(0 == strcmp(av->value, record->value));
+        assert(av->timestamp == record->timestamp);
+        assert(av->severity == record->severity);
+        assert(av->logeventid == record->logeventid);
+
+        if ('\0' == *record->source)
+            assert(NULL == av->source);
+        else
+            assert(0 == strcmp(av->source, record->source));
+    }
+
+    if (0 != (record->flags & PROXY_HISTORY_FLAG_META) && ITEM_STATE_NOTSUPPORTED != record->state)
+        assert(1 == av->meta && av->lastlogsize == record->lastlogsize && av->mtime == record->mtime);
+    else
+        assert(0 == av->meta);
+}
+
+static void test_roundtrip(void) {
+    zbx_history_bin_writer_t writer;
+    zbx_history_bin_reader_t reader;
+    zbx_history_bin_record_t record;
+    struct zbx_json j;
+    struct zbx_json_parse jp;
+    zbx_agent_value_t av;
+    zbx_uint64_t itemid;
+    char *data = NULL, *error = NULL;
+    size_t data_alloc = 0;
+    int i;
+
+    history_bin_writer_init(&writer);
+    zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
+
+    for (i = 0; i < TEST_RECORDS; i++) {
+        fill_record(&record, i);
+        history_bin_writer_add(&writer, &record);
+    }
+
+    history_bin_writer_flush(&writer, &j, ZBX_PROTO_TAG_HISTORY_DATA_BINARY);
+    history_bin_writer_clear(&writer);
+
+    assert(SUCCEED == zbx_json_open(j.buffer, &jp));
+    assert(SUCCEED == zbx_json_value_by_name_dyn(&jp, ZBX_PROTO_TAG_HISTORY_DATA_BINARY, &data, &data_alloc, NULL));
+    assert(SUCCEED == history_bin_reader_open(&reader, data, &error));
+    assert(TEST_RECORDS == reader.records_num);
+
+    for (i = 0; i < TEST_RECORDS; i++) {
+        fill_record(&record, i);
+        assert(SUCCEED == history_bin_reader_next(&reader, &itemid, &av));
+        check_value(&record, itemid, &av);
+        zbx_free(av.value);
+        zbx_free(av.source);
+    }
+
+    assert(FAIL == history_bin_reader_next(&reader, &itemid, &av));
+    history_bin_reader_clear(&reader);
+
+    /* the truncated block must be rejected rather than read past its end */
+    data[strlen(data) / 2] = '\0';
+    assert(FAIL == history_bin_reader_open(&reader, data, &error));
+    assert(FAIL == history_bin_reader_open(&reader, "", &error));
+
+    zbx_free(error);
+    zbx_free(data);
+    zbx_json_free(&j);
+}
+
+void proxy_history_bin_run_tests(void) {
+    test_roundtrip();
+    LOG_INF("Proxy binary history tests passed");
+}
+
+#endif
@@ -0,0 +1,401 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "zbxproxyjournal.h"
+#include "zbxcacheconfig.h"
+#include "zbx_item_constants.h"
+
+#include <dirent.h>
+#include <sys/wait.h>
+
+#define TEST_RECORDS 1000
+#define TEST_WRITERS 4
+#define TEST_WRITER_BATCHES 50
+#define TEST_BATCH_RECORDS 20
+
+/* the records carry the writer and the record number, so the order of the values */
+/* of every writer can be checked after the batches of the writers are mixed      */
+typedef struct {
+    char value[64];
+    zbx_proxy_journal_record_t record;
+} test_record_t;
+
+typedef struct {
+    int next[TEST_WRITERS + 1];
+    int records_num;
+    zbx_uint64_t lastid;
+} read_ctx_t;
+
+static void make_record(test_record_t *rec, int writer, int i) {
+    zbx_proxy_journal_record_t *record = &rec->record;
+
+    memset(record, 0, sizeof(zbx_proxy_journal_record_t));
+    zbx_snprintf(rec->value, sizeof(rec->value), "%d:%d", writer, i);
+
+    record->itemid = (zbx_uint64_t)writer;
+    record->clock = i;
+    record->ns = writer;
+    record->value = rec->value;
+    record->source = "";
+
+    /* log meta updates and empty values take the short record paths */
+    if (0 == i % 11) {
+        record->flags = PROXY_HISTORY_FLAG_META | PROXY_HISTORY_FLAG_NOVALUE;
+        record->lastlogsize = (zbx_uint64_t)i;
+        record->mtime = writer;
+    } else if (0 == i % 7)
+        record->flags = PROXY_HISTORY_FLAG_NOVALUE;
+}
+
+static void add_records(int writer, int from, int to) {
+    test_record_t rec;
+    int i;
+
+    for (i = from; i < to; i++) {
+        make_record(&rec, writer, i);
+        zbx_proxy_journal_add(&rec.record);
+    }
+}
+
+static int check_record_cb(const zbx_proxy_journal_record_t *record, void *cb_data) {
+    read_ctx_t *ctx = cb_data;
+    test_record_t expected;
+
+    assert(record->itemid <= TEST_WRITERS);
+    make_record(&expected, (int)record->itemid, ctx->next[record->itemid]++);
+
+    assert(record->id > ctx->lastid);
+    assert(record->clock == expected.record.clock && record->ns == expected.record.ns);
+    assert(record->flags == expected.record.flags);
+
+    if (0 == (record->flags & PROXY_HISTORY_FLAG_NOVALUE))
+        assert(0 == strcmp(record->value, expected.value));
+
+    if (0 != (record->flags & PROXY_HISTORY_FLAG_META))
+        assert(record->lastlogsize == expected.record.lastlogsize && record->mtime == expected.record.mtime);
+
+    ctx->lastid = record->id;
+    ctx->records_num++;
+
+    return SUCCEED;
+}
+
+static char *create_dir(void) {
+    char *dir = zbx_strdup(NULL, "/tmp/glb_journal_XXXXXX");
+
+    assert(NULL != mkdtemp(dir));
+
+    return dir;
+}
+
+static void remove_dir(char *dir) {
+    DIR *d;
+    struct dirent *e;
+
+    assert(NULL != (d = opendir(dir)));
+
+    while (NULL != (e = readdir(d))) {
+        char *path;
+
+        if ('.' == e->d_name[0])
+            continue;
+
+        path = zbx_dsprintf(NULL, "%s/%s", dir, e->d_name);
+        unlink(path);
+        zbx_free(path);
+    }
+
+    closedir(d);
+    rmdir(dir);
+    zbx_free(dir);
+}
+
+static char *segment_path(const char *dir, int seq) {
+    return zbx_dsprintf(NULL, "%s/history.%08x", dir, seq);
+}
+
+static void append_garbage(const char *dir, int seq, const void *data, size_t len) {
+    char *path = segment_path(dir, seq);
+    int fd;
+
+    assert(-1 != (fd = open(path, O_WRONLY | O_APPEND)));
+    assert(len == (size_t)write(fd, data, len));
+    close(fd);
+    zbx_free(path);
+}
+
+static off_t segment_size(const char *dir, int seq) {
+    char *path = segment_path(dir, seq);
+    zbx_stat_t st;
+
+    assert(0 == zbx_stat(path, &st));
+    zbx_free(path);
+
+    return st.st_size;
+}
+
+/* the count follows the writes and the acknowledgements, the reading */
+/* continues after the acknowledged record, also after a restart      */
+static void test_ack_resume(const char *dir) {
+    read_ctx_t ctx = {0};
+    char *error = NULL;
+
+    LOG_INF("Testing proxy history journal acknowledgement and resume");
+
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+    assert(0 == zbx_proxy_journal_get_count());
+
+    add_records(0, 0, TEST_RECORDS / 2);
+    assert(SUCCEED == zbx_proxy_journal_commit());
+    add_records(0, TEST_RECORDS / 2, TEST_RECORDS);
+    assert(SUCCEED == zbx_proxy_journal_commit());
+
+    /* nothing to write is not a failure */
+    assert(SUCCEED == zbx_proxy_journal_commit());
+    assert(TEST_RECORDS == zbx_proxy_journal_get_count());
+
+    assert(100 == zbx_proxy_journal_read(0, 100, check_record_cb, &ctx));
+    zbx_proxy_journal_set_lastid(ctx.lastid);
+    assert(ctx.lastid == zbx_proxy_journal_get_lastid());
+    assert(TEST_RECORDS - 100 == zbx_proxy_journal_get_count());
+
+    /* the repeated acknowledgement is not counted twice */
+    zbx_proxy_journal_set_lastid(ctx.lastid);
+    assert(TEST_RECORDS - 100 == zbx_proxy_journal_get_count());
+
+    /* the restart rebuilds the count from the journal */
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+    assert(TEST_RECORDS - 100 == zbx_proxy_journal_get_count());
+
+    assert(TEST_RECORDS - 100 == zbx_proxy_journal_read(zbx_proxy_journal_get_lastid(), INT_MAX, check_record_cb,
+            &ctx));
+    assert(TEST_RECORDS == ctx.next[0]);
+
+    zbx_proxy_journal_set_lastid(ctx.lastid);
+    assert(0 == zbx_proxy_journal_get_count());
+}
+
+/* the proxy stopped while a batch was written: its start is in the segment, */
+/* the readers stop before it and the restart drops it                       */
+static void test_torn_tail_restart(const char *dir) {
+    static const zbx_uint32_t torn[] = {0x48435442, 4096, 10, 1700000000, 0};
+    read_ctx_t ctx = {0};
+    char *error = NULL;
+    off_t committed;
+
+    LOG_INF("Testing proxy history journal torn tail recovery on restart");
+
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+
+    add_records(1, 0, 10);
+    assert(SUCCEED == zbx_proxy_journal_commit());
+    committed = segment_size(dir, 1);
+
+    append_garbage(dir, 1, torn, sizeof(torn));
+    append_garbage(dir, 1, "abc", 3);
+
+    assert(10 == zbx_proxy_journal_read(0, INT_MAX, check_record_cb, &ctx));
+
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+    assert(committed == segment_size(dir, 1));
+    assert(10 == zbx_proxy_journal_get_count());
+
+    /* the batches after the recovery are appended to the committed ones */
+    add_records(1, 10, 20);
+    assert(SUCCEED == zbx_proxy_journal_commit());
+
+    memset(&ctx, 0, sizeof(ctx));
+    assert(20 == zbx_proxy_journal_read(0, INT_MAX, check_record_cb, &ctx));
+    assert(20 == zbx_proxy_journal_get_count());
+}
+
+/* another writer left a damaged tail without a restart: the next writer */
+/* drops it under the lock instead of appending the batch after it       */
+static void test_torn_tail_writer(const char *dir) {
+    static const zbx_uint32_t torn[] = {0x48435442, 64, 3, 1700000000, 0};
+    read_ctx_t ctx = {0};
+    char *error = NULL;
+    off_t committed;
+
+    LOG_INF("Testing proxy history journal damaged tail left by a writer");
+
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+
+    add_records(1, 0, 10);
+    assert(SUCCEED == zbx_proxy_journal_commit());
+    committed = segment_size(dir, 1);
+
+    append_garbage(dir, 1, torn, sizeof(torn));
+
+    add_records(1, 10, 20);
+    assert(SUCCEED == zbx_proxy_journal_commit());
+
+    /* the garbage is replaced by the batch */
+    assert(committed < segment_size(dir, 1));
+    assert(20 == zbx_proxy_journal_read(0, INT_MAX, check_record_cb, &ctx));
+    assert(20 == ctx.next[1]);
+    assert(20 == zbx_proxy_journal_get_count());
+
+    /* the batches written after the check are not re-checked */
+    add_records(1, 20, 30);
+    assert(SUCCEED == zbx_proxy_journal_commit());
+
+    memset(&ctx, 0, sizeof(ctx));
+    assert(30 == zbx_proxy_journal_read(0, INT_MAX, check_record_cb, &ctx));
+    assert(30 == zbx_proxy_journal_get_count());
+}
+
+/* the syncers append their batches concurrently: every batch is readable */
+/* and the values of every writer are read in the order of writing        */
+static void test_concurrent_writers(const char *dir) {
+    read_ctx_t ctx = {0};
+    char *error = NULL;
+    int writer;
+
+    LOG_INF("Testing proxy history journal concurrent writers");
+
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+
+    for (writer = 1; writer <= TEST_WRITERS; writer++) {
+        pid_t pid;
+
+        assert(-1 != (pid = fork()));
+
+        if (0 == pid) {
+            int batch;
+
+            for (batch = 0; batch < TEST_WRITER_BATCHES; batch++) {
+                add_records(writer, batch * TEST_BATCH_RECORDS, (batch + 1) * TEST_BATCH_RECORDS);
+
+                if (SUCCEED != zbx_proxy_journal_commit())
+                    _exit(EXIT_FAILURE);
+            }
+
+            _exit(EXIT_SUCCESS);
+        }
+    }
+
+    for (writer = 1; writer <= TEST_WRITERS; writer++) {
+        int status;
+
+        assert(-1 != wait(&status));
+        assert(WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status));
+    }
+
+    assert(TEST_WRITERS * TEST_WRITER_BATCHES * TEST_BATCH_RECORDS == zbx_proxy_journal_get_count());
+    assert(TEST_WRITERS * TEST_WRITER_BATCHES * TEST_BATCH_RECORDS == zbx_proxy_journal_read(0, INT_MAX,
+            check_record_cb, &ctx));
+
+    for (writer = 1; writer <= TEST_WRITERS; writer++)
+        assert(TEST_WRITER_BATCHES * TEST_BATCH_RECORDS == ctx.next[writer]);
+}
+
+/* the failed batch is kept and written with the next ones after the delay */
+static void test_retry(const char *dir) {
+    read_ctx_t ctx = {0};
+    char *error = NULL;
+
+    LOG_INF("Testing proxy history journal write retry");
+
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+    assert(0 == rmdir(dir));
+
+    add_records(2, 0, 10);
+    assert(FAIL == zbx_proxy_journal_commit());
+
+    add_records(2, 10, 15);
+    assert(FAIL == zbx_proxy_journal_commit());
+
+    assert(0 == mkdir(dir, 0750));
+
+    /* the journal is not retried before the delay */
+    add_records(2, 15, 20);
+    assert(FAIL == zbx_proxy_journal_commit());
+    assert(0 == zbx_proxy_journal_get_count());
+
+    sleep(2);
+    assert(SUCCEED == zbx_proxy_journal_commit());
+    assert(20 == zbx_proxy_journal_read(0, INT_MAX, check_record_cb, &ctx));
+    assert(20 == ctx.next[2]);
+    assert(20 == zbx_proxy_journal_get_count());
+}
+
+/* the batch which cannot be written on the syncer shutdown is spilled */
+/* and appended to the journal on the next start                       */
+static void test_spill(const char *dir) {
+    read_ctx_t ctx = {0};
+    char *error = NULL, *blocked = segment_path(dir, 1);
+
+    LOG_INF("Testing proxy history journal spill on shutdown");
+
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+
+    /* the segment cannot be opened for writing */
+    assert(0 == mkdir(blocked, 0750));
+
+    add_records(3, 0, 10);
+    assert(FAIL == zbx_proxy_journal_commit());
+    assert(SUCCEED == zbx_proxy_journal_flush());
+
+    /* nothing is kept after the flush */
+    assert(SUCCEED == zbx_proxy_journal_flush());
+
+    assert(0 == rmdir(blocked));
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+
+    assert(10 == zbx_proxy_journal_get_count());
+    assert(10 == zbx_proxy_journal_read(0, INT_MAX, check_record_cb, &ctx));
+    assert(10 == ctx.next[3]);
+
+    /* the spill file is removed once appended */
+    assert(SUCCEED == zbx_proxy_journal_init(dir, ZBX_GIBIBYTE, SEC_PER_DAY, &error));
+    assert(10 == zbx_proxy_journal_get_count());
+
+    zbx_free(blocked);
+}
+
+void proxy_journal_run_tests(void) {
+    char *dir;
+
+    test_ack_resume(dir = create_dir());
+    remove_dir(dir);
+
+    test_torn_tail_restart(dir = create_dir());
+    remove_dir(dir);
+
+    test_torn_tail_writer(dir = create_dir());
+    remove_dir(dir);
+
+    test_concurrent_writers(dir = create_dir());
+    remove_dir(dir);
+
+    test_retry(dir = create_dir());
+    remove_dir(dir);
+
+    test_spill(dir = create_dir());
+    remove_dir(dir);
+
+    LOG_INF("Proxy history journal tests passed");
+}
+
+#endif
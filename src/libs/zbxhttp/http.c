@@ -569,21 +569,43 @@ static void	http_output_json(unsigned char retrieve_mode, char **buffer, zbx_htt
 	zbx_json_free(&json);
 }
 
-int	zbx_http_request(unsigned char request_method, const char *url, const char *query_fields, char *headers,
-		const char *posts, unsigned char retrieve_mode, const char *http_proxy, unsigned char follow_redirects,
-		const char *timeout, int max_attempts, const char *ssl_cert_file, const char *ssl_key_file,
-		const char *ssl_key_password, unsigned char verify_peer, unsigned char verify_host,
-		unsigned char authtype, const char *username, const char *password, const char *token,
-		unsigned char post_type, char *status_codes, unsigned char output_format, char **out, char **error)
+void	zbx_http_context_init(zbx_http_context_t *context)
+{
+	memset(context, 0, sizeof(zbx_http_context_t));
+}
+
+void	zbx_http_context_destroy(zbx_http_context_t *context)
+{
+	curl_slist_free_all(context->headers_slist);	/* must be called after curl_easy_perform() */
+	context->headers_slist = NULL;
+
+	if (NULL != context->easyhandle)
+	{
+		curl_easy_cleanup(context->easyhandle);
+		context->easyhandle = NULL;
+	}
+
+	zbx_free(context->body.data);
+	zbx_free(context->header.data);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: creates the easy handle of the context and sets all the request   *
+ *          options, so the handle might be performed synchronously or added  *
+ *          to a multi handle                                                 *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_http_request_prepare(zbx_http_context_t *context, unsigned char request_method, const char *url,
+		const char *query_fields, char *headers, const char *posts, unsigned char retrieve_mode,
+		const char *http_proxy, unsigned char follow_redirects, const char *timeout,
+		const char *ssl_cert_file, const char *ssl_key_file, const char *ssl_key_password,
+		unsigned char verify_peer, unsigned char verify_host, unsigned char authtype, const char *username,
+		const char *password, const char *token, unsigned char post_type, char **error)
 {
-	CURL			*easyhandle;
 	CURLcode		err;
-	char			url_buffer[ZBX_ITEM_URL_LEN_MAX], errbuf[CURL_ERROR_SIZE], *headers_ptr, *line, *buffer;
-	int			ret = NOTSUPPORTED, timeout_seconds, found = FAIL;
-	long			response_code;
-	struct curl_slist	*headers_slist = NULL;
-	struct zbx_json		json;
-	zbx_http_response_t	body = {0}, header = {0};
+	char			url_buffer[ZBX_ITEM_URL_LEN_MAX], *headers_ptr, *line;
+	int			timeout_seconds, found = FAIL;
 	zbx_curl_cb_t		curl_body_cb;
 	char			application_json[] = {"Content-Type: application/json"};
 	char			application_ndjson[] = {"Content-Type: application/x-ndjson"};
@@ -594,10 +616,10 @@ int	zbx_http_request(unsigned char request_method, const char *url, const char *
 
 	zabbix_log(LOG_LEVEL_TRACE, "message body '%s'", posts);
 
-	if (NULL == (easyhandle = curl_easy_init()))
+	if (NULL == (context->easyhandle = curl_easy_init()))
 	{
-		*error = zbx_strdup(NULL, "Cannot initialize cURL library");;
-		goto clean;
+		*error = zbx_strdup(NULL, "Cannot initialize cURL library");
+		return FAIL;
 	}
 
 	switch (retrieve_mode)
@@ -612,65 +634,63 @@ int	zbx_http_request(unsigned char request_method, const char *url, const char *
 		default:
 			THIS_SHOULD_NEVER_HAPPEN;
 			*error = zbx_strdup(NULL, "Invalid retrieve mode");
-			goto clean;
+			return FAIL;
 	}
 
-	if (SUCCEED != zbx_http_prepare_callbacks(easyhandle, &header, &body, zbx_curl_write_cb, curl_body_cb, errbuf,
-			error))
+	if (SUCCEED != zbx_http_prepare_callbacks(context->easyhandle, &context->header, &context->body,
+			zbx_curl_write_cb, curl_body_cb, context->errbuf, error))
 	{
-		goto clean;
+		return FAIL;
 	}
 
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_PROXY, http_proxy)))
+	if (CURLE_OK != (err = curl_easy_setopt(context->easyhandle, CURLOPT_PROXY, http_proxy)))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot set proxy: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_FOLLOWLOCATION,
+	if (CURLE_OK != (err = curl_easy_setopt(context->easyhandle, CURLOPT_FOLLOWLOCATION,
 			0 == follow_redirects ? 0L : 1L)))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot set follow redirects: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 
 	if (0 != follow_redirects &&
-			CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_MAXREDIRS, ZBX_CURLOPT_MAXREDIRS)))
+			CURLE_OK != (err = curl_easy_setopt(context->easyhandle, CURLOPT_MAXREDIRS, ZBX_CURLOPT_MAXREDIRS)))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot set number of redirects allowed: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 
 	if (FAIL == zbx_is_time_suffix(timeout, &timeout_seconds, (int)strlen(timeout)))
 	{
 		*error = zbx_dsprintf(NULL, "Invalid timeout: %s", timeout);
-		goto clean;
+		return FAIL;
 	}
 
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_TIMEOUT, (long)timeout_seconds)))
+	if (CURLE_OK != (err = curl_easy_setopt(context->easyhandle, CURLOPT_TIMEOUT, (long)timeout_seconds)))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot specify timeout: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 
-	if (SUCCEED != zbx_http_prepare_ssl(easyhandle, ssl_cert_file, ssl_key_file, ssl_key_password,
+	if (SUCCEED != zbx_http_prepare_ssl(context->easyhandle, ssl_cert_file, ssl_key_file, ssl_key_password,
 			verify_peer, verify_host, error))
 	{
-		goto clean;
+		return FAIL;
 	}
 
-	if (SUCCEED != zbx_http_prepare_auth(easyhandle, authtype, username, password, token, error))
-		goto clean;
+	if (SUCCEED != zbx_http_prepare_auth(context->easyhandle, authtype, username, password, token, error))
+		return FAIL;
 
-	if (SUCCEED != http_prepare_request(easyhandle, posts, request_method, error))
-	{
-		goto clean;
-	}
+	if (SUCCEED != http_prepare_request(context->easyhandle, posts, request_method, error))
+		return FAIL;
 
 	headers_ptr = headers;
 	while (NULL != (line = zbx_http_parse_header(&headers_ptr)))
 	{
-		headers_slist = curl_slist_append(headers_slist, line);
+		context->headers_slist = curl_slist_append(context->headers_slist, line);
 
 		if (FAIL == found && 0 == strncmp(line, "Content-Type:", ZBX_CONST_STRLEN("Content-Type:")))
 			found = SUCCEED;
@@ -681,69 +701,67 @@ int	zbx_http_request(unsigned char request_method, const char *url, const char *
 	if (FAIL == found)
 	{
 		if (ZBX_POSTTYPE_JSON == post_type)
-			headers_slist = curl_slist_append(headers_slist, application_json);
+			context->headers_slist = curl_slist_append(context->headers_slist, application_json);
 		else if (ZBX_POSTTYPE_XML == post_type)
-			headers_slist = curl_slist_append(headers_slist, application_xml);
+			context->headers_slist = curl_slist_append(context->headers_slist, application_xml);
 		else if (ZBX_POSTTYPE_NDJSON == post_type)
-			headers_slist = curl_slist_append(headers_slist, application_ndjson);
+			context->headers_slist = curl_slist_append(context->headers_slist, application_ndjson);
 	}
 
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_HTTPHEADER, headers_slist)))
+	if (CURLE_OK != (err = curl_easy_setopt(context->easyhandle, CURLOPT_HTTPHEADER, context->headers_slist)))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot specify headers: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 
 #if LIBCURL_VERSION_NUM >= 0x071304
 	/* CURLOPT_PROTOCOLS is supported starting with version 7.19.4 (0x071304) */
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS)))
+	if (CURLE_OK != (err = curl_easy_setopt(context->easyhandle, CURLOPT_PROTOCOLS,
+			CURLPROTO_HTTP | CURLPROTO_HTTPS)))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot set allowed protocols: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 #endif
 
 	zbx_snprintf(url_buffer, sizeof(url_buffer),"%s%s", url, query_fields);
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_URL, url_buffer)))
+	if (CURLE_OK != (err = curl_easy_setopt(context->easyhandle, CURLOPT_URL, url_buffer)))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot specify URL: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, ZBX_CURLOPT_ACCEPT_ENCODING, "")))
+	if (CURLE_OK != (err = curl_easy_setopt(context->easyhandle, ZBX_CURLOPT_ACCEPT_ENCODING, "")))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot set cURL encoding option: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_COOKIEFILE, "")))
+	if (CURLE_OK != (err = curl_easy_setopt(context->easyhandle, CURLOPT_COOKIEFILE, "")))
 	{
 		*error =  zbx_dsprintf(NULL, "Cannot enable cURL cookie engine: %s", curl_easy_strerror(err));
-		goto clean;
+		return FAIL;
 	}
 
-	/* try to retrieve page several times depending on number of retries */
-	do
-	{
-		*errbuf = '\0';
-
-		if (CURLE_OK == (err = curl_easy_perform(easyhandle)))
-		{
-			break;
-		}
-		else
-		{
-			if (1 != max_attempts)
-			{
-				zabbix_log(LOG_LEVEL_INFORMATION, "cannot perform request: %s",
-						'\0' == *errbuf ? curl_easy_strerror(err) : errbuf);
-			}
-		}
+	return SUCCEED;
+}
 
-		header.offset = 0;
-		body.offset = 0;
-	}
-	while (0 < --max_attempts);
+/******************************************************************************
+ *                                                                            *
+ * Purpose: converts the result of the performed context request to the item *
+ *          value according to the retrieve mode, output format and the       *
+ *          required status codes                                             *
+ *                                                                            *
+ * Return value: SUCCEED - out is set                                         *
+ *               NOTSUPPORTED - error is set                                  *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_http_handle_response(zbx_http_context_t *context, CURLcode err, unsigned char retrieve_mode,
+		char *status_codes, unsigned char output_format, char **out, char **error)
+{
+	char		*headers_ptr, *line, *buffer;
+	long		response_code;
+	struct zbx_json	json;
 
 	if (CURLE_OK != err)
 	{
@@ -754,60 +772,61 @@ int	zbx_http_request(unsigned char request_method, const char *url, const char *
 		else
 		{
 			*error = zbx_dsprintf(NULL, "Cannot perform request: %s",
-					'\0' == *errbuf ? curl_easy_strerror(err) : errbuf);
+					'\0' == *context->errbuf ? curl_easy_strerror(err) : context->errbuf);
 		}
-		goto clean;
+		return NOTSUPPORTED;
 	}
 
-	if (CURLE_OK != (err = curl_easy_getinfo(easyhandle, CURLINFO_RESPONSE_CODE, &response_code)))
+	if (CURLE_OK != (err = curl_easy_getinfo(context->easyhandle, CURLINFO_RESPONSE_CODE, &response_code)))
 	{
 		*error = zbx_dsprintf(NULL, "Cannot get the response code: %s", curl_easy_strerror(err));
-		goto clean;
+		return NOTSUPPORTED;
 	}
 
-	if (NULL == header.data)
+	if (NULL == context->header.data)
 	{
 		*error = zbx_dsprintf(NULL, "Server returned empty header");
-		goto clean;
+		return NOTSUPPORTED;
 	}
 
 	switch (retrieve_mode)
 	{
 		case ZBX_RETRIEVE_MODE_CONTENT:
-			if (NULL != body.data && FAIL == zbx_is_utf8(body.data))
+			if (NULL != context->body.data && FAIL == zbx_is_utf8(context->body.data))
 			{
 				*error = zbx_dsprintf(NULL, "Server returned invalid UTF-8 sequence");
-				goto clean;
+				return NOTSUPPORTED;
 			}
 
 			if (HTTP_STORE_JSON == output_format)
 			{
-				http_output_json(retrieve_mode, &buffer, &header, &body);
+				http_output_json(retrieve_mode, &buffer, &context->header, &context->body);
 				*out = buffer;
 			}
 			else
 			{
-				if (NULL != body.data)
+				if (NULL != context->body.data)
 				{
-					*out = body.data;
-					body.data = NULL;
+					*out = context->body.data;
+					context->body.data = NULL;
+					context->body.allocated = 0;
 				}
 				else
 					*out = zbx_strdup(NULL, "");
 			}
 			break;
 		case ZBX_RETRIEVE_MODE_HEADERS:
-			if (FAIL == zbx_is_utf8(header.data))
+			if (FAIL == zbx_is_utf8(context->header.data))
 			{
 				*error = zbx_dsprintf(NULL, "Server returned invalid UTF-8 sequence");
-				goto clean;
+				return NOTSUPPORTED;
 			}
 
 			if (HTTP_STORE_JSON == output_format)
 			{
 				zbx_json_init(&json, ZBX_JSON_STAT_BUF_LEN);
 				zbx_json_addobject(&json, "header");
-				headers_ptr = header.data;
+				headers_ptr = context->header.data;
 				while (NULL != (line = zbx_http_parse_header(&headers_ptr)))
 				{
 					http_add_json_header(&json, line);
@@ -818,49 +837,97 @@ int	zbx_http_request(unsigned char request_method, const char *url, const char *
 			}
 			else
 			{
-				*out = header.data;
-				header.data = NULL;
+				*out = context->header.data;
+				context->header.data = NULL;
+				context->header.allocated = 0;
 			}
 			break;
 		case ZBX_RETRIEVE_MODE_BOTH:
-			if (FAIL == zbx_is_utf8(header.data) || (NULL != body.data && FAIL == zbx_is_utf8(body.data)))
+			if (FAIL == zbx_is_utf8(context->header.data) ||
+					(NULL != context->body.data && FAIL == zbx_is_utf8(context->body.data)))
 			{
 				*error = zbx_dsprintf(NULL, "Server returned invalid UTF-8 sequence");
-				goto clean;
+				return NOTSUPPORTED;
 			}
 
 			if (HTTP_STORE_JSON == output_format)
 			{
-				http_output_json(retrieve_mode, &buffer, &header, &body);
+				http_output_json(retrieve_mode, &buffer, &context->header, &context->body);
 				*out = buffer;
 			}
 			else
 			{
-				if (NULL != body.data)
+				if (NULL != context->body.data)
 				{
-					zbx_strncpy_alloc(&header.data, &header.allocated, &header.offset, body.data,
-							body.offset);
+					zbx_strncpy_alloc(&context->header.data, &context->header.allocated,
+							&context->header.offset, context->body.data, context->body.offset);
 				}
 
-				*out = header.data;
-				header.data = NULL;
+				*out = context->header.data;
+				context->header.data = NULL;
+				context->header.allocated = 0;
 			}
 			break;
 	}
 
 	if ('\0' != *status_codes && FAIL == zbx_int_in_list(status_codes, (int)response_code))
 	{
+		zbx_free(*out);
 		*error = zbx_dsprintf(NULL, "Response code \"%ld\" did not match any of the"
 				" required status codes \"%s\"", response_code, status_codes);
+		return NOTSUPPORTED;
+	}
+
+	return SUCCEED;
+}
+
+int	zbx_http_request(unsigned char request_method, const char *url, const char *query_fields, char *headers,
+		const char *posts, unsigned char retrieve_mode, const char *http_proxy, unsigned char follow_redirects,
+		const char *timeout, int max_attempts, const char *ssl_cert_file, const char *ssl_key_file,
+		const char *ssl_key_password, unsigned char verify_peer, unsigned char verify_host,
+		unsigned char authtype, const char *username, const char *password, const char *token,
+		unsigned char post_type, char *status_codes, unsigned char output_format, char **out, char **error)
+{
+	CURLcode		err;
+	int			ret = NOTSUPPORTED;
+	zbx_http_context_t	context;
+
+	zbx_http_context_init(&context);
+
+	if (SUCCEED != zbx_http_request_prepare(&context, request_method, url, query_fields, headers, posts,
+			retrieve_mode, http_proxy, follow_redirects, timeout, ssl_cert_file, ssl_key_file,
+			ssl_key_password, verify_peer, verify_host, authtype, username, password, token, post_type,
+			error))
+	{
 		goto clean;
 	}
 
-	ret = SUCCEED;
+	/* try to retrieve page several times depending on number of retries */
+	do
+	{
+		*context.errbuf = '\0';
+
+		if (CURLE_OK == (err = curl_easy_perform(context.easyhandle)))
+		{
+			break;
+		}
+		else
+		{
+			if (1 != max_attempts)
+			{
+				zabbix_log(LOG_LEVEL_INFORMATION, "cannot perform request: %s",
+						'\0' == *context.errbuf ? curl_easy_strerror(err) : context.errbuf);
+			}
+		}
+
+		context.header.offset = 0;
+		context.body.offset = 0;
+	}
+	while (0 < --max_attempts);
+
+	ret = zbx_http_handle_response(&context, err, retrieve_mode, status_codes, output_format, out, error);
 clean:
-	curl_slist_free_all(headers_slist);	/* must be called after curl_easy_perform() */
-	curl_easy_cleanup(easyhandle);
-	zbx_free(body.data);
-	zbx_free(header.data);
+	zbx_http_context_destroy(&context);
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
 
 	return ret;
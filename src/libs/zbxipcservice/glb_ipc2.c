@@ -22,6 +22,13 @@
 #include "glb_lock.h"
 #include "glb_ipc2.h"
 
+#include <poll.h>
+#include <stdatomic.h>
+
+#ifdef HAVE_SYS_EVENTFD_H
+#	include <sys/eventfd.h>
+#endif
+
 typedef struct ipc2_chunk_t ipc2_chunk_t;
 
 //#define MAGIK 23473456
@@ -33,6 +40,8 @@ struct ipc2_chunk_t {
 	ipc2_chunk_t *next;
 	int size;
 	int items;
+	int producerid; //the sender's ring producer slot or -1
+	u_int64_t ring_head; //the sender's ring head when the chunk was queued
 //	int magik; used in betta for basic data integrity test
 } ;
 
@@ -45,8 +54,48 @@ typedef struct
 	pthread_mutex_t lock; //to lock for fetch/add
 	u_int64_t sent;
 	u_int64_t items_sent;
+	int wakeup_fd; //consumer's eventfd, -1 if the consumer polls the queue
+	_Atomic u_int64_t fetched; //chunks taken by the consumer, sent chunks are numbered by 'sent'
+	u_int64_t received; //chunks processed by the consumer, only the consumer uses it
 } ipc2_chunk_queue_t;
 
+#define IPC2_RING_ALIGN(len)	(((len) + 7) & ~(u_int64_t)7)
+#define IPC2_CACHE_LINE		64
+
+/* single producer - single consumer ring, head and tail are ever growing byte positions,
+   each side only writes its own cache line, so there is no lock and no false sharing */
+typedef struct
+{
+	_Atomic u_int64_t head;
+	u_int64_t sent;
+	u_int64_t items_sent;
+	char pad1[IPC2_CACHE_LINE - 3 * sizeof(u_int64_t)];
+
+	_Atomic u_int64_t tail;
+	u_int64_t received;
+	u_int64_t items_received;
+	char pad2[IPC2_CACHE_LINE - 3 * sizeof(u_int64_t)];
+
+	char *data;
+	u_int64_t size;
+} ipc2_ring_t;
+
+/* chunk header in the ring, IPC2_RING_WRAP size marks that the rest of the ring is unused
+   and the next chunk is at the ring start */
+#define IPC2_RING_WRAP	UINT32_MAX
+
+typedef struct {
+	u_int32_t size;
+	int items;
+} ipc2_ring_chunk_t;
+
+/* process local, allocated in the parent's heap, so each fork gets it's own copy */
+typedef struct {
+	int producerid;
+	int generation;
+	u_int64_t *queued; //per consumer number of the last chunk sent through the shared queue
+} ipc2_snd_conf_t;
+
 struct  ipc2_conf_t {
 	zbx_shmem_info_t *mem_info;
 	u_int64_t		low_mem_watermark;
@@ -55,10 +104,21 @@ struct  ipc2_conf_t {
 	char name[64];
  	ipc2_chunk_queue_t *queues; //init in the SHM for interprocess io
 	ipc2_rcv_conf_t *rcv;
+
+	ipc2_ring_t *rings; //consumers x producers, NULL if rings aren't used
+	int ring_producers;
+	_Atomic int ring_producers_claimed;
+	ipc2_snd_conf_t *snd;
 };
 
+/* rings are read before the shared queue, but the queue is checked after that many ring chunks
+   anyway, so it's not starved by the busy rings */
+#define IPC2_RING_QUEUE_CHECK	64
+
 struct ipc2_rcv_conf_t {
 	ipc2_chunk_t *rcv_queue;
+	int ring_next;
+	int ring_chunks;
 };
 
 static ipc2_chunk_t *allocate_chunk(ipc2_conf_t *ipc, size_t len, int items_count, int alloc_priority) {
@@ -89,17 +149,31 @@ static ipc2_chunk_t *allocate_chunk(ipc2_conf_t *ipc, size_t len, int items_coun
 	chunk->size = len;
 	chunk->next = 0;
 	chunk->items = items_count;
+	chunk->producerid = -1;
+	chunk->ring_head = 0;
 
 	return chunk;
 }
 
 
-static void add_chunk_to_queue(ipc2_chunk_queue_t *q, ipc2_chunk_t *chunk, int items_count) {
+static void queue_wakeup(ipc2_chunk_queue_t *q) {
+#ifdef HAVE_SYS_EVENTFD_H
+	eventfd_t one = 1;
+
+	/* only fails with EAGAIN on counter overflow, the consumer is awake anyway then */
+	eventfd_write(q->wakeup_fd, one);
+#endif
+}
+
+static u_int64_t add_chunk_to_queue(ipc2_chunk_queue_t *q, ipc2_chunk_t *chunk, int items_count) {
+	int was_empty = 0;
+	u_int64_t num;
 	
 //	chunk->magik = MAGIK;
 	glb_lock_block(&q->lock);
 	
 	if (NULL == (q->first)) {
+		was_empty = 1;
 		q->first = chunk;
 		q->last = chunk;
 		q->count = 1;
@@ -111,19 +185,166 @@ static void add_chunk_to_queue(ipc2_chunk_queue_t *q, ipc2_chunk_t *chunk, int i
 		q->items += chunk->items;
 	}
 	
-	q->sent++;
+	num = ++q->sent;
 	q->items_sent += items_count;
 	glb_lock_unlock(&q->lock);
+
+	/* the consumer drains the queue till it's empty, so it only has to be woken up when
+	   the first chunk arrives */
+	if (was_empty && -1 != q->wakeup_fd)
+		queue_wakeup(q);
+
+	return num;
+}
+
+/* incremented in the forked children, so they claim their own producer slots */
+static int fork_generation = 1, atfork_registered = 0;
+
+static void ipc2_atfork_child(void) {
+	fork_generation++;
+}
+
+static ipc2_ring_t *get_producer_ring(ipc2_conf_t *ipc, int consumerid) {
+	ipc2_snd_conf_t *snd = ipc->snd;
+
+	if (NULL == ipc->rings)
+		return NULL;
+
+	if (snd->generation != fork_generation) {
+		snd->generation = fork_generation;
+
+		if (ipc->ring_producers <= (snd->producerid = atomic_fetch_add(&ipc->ring_producers_claimed, 1))) {
+			LOG_INF("IPC '%s': all %d ring producer slots are taken, the process will use the shared queue",
+					ipc->name, ipc->ring_producers);
+			snd->producerid = -1;
+		}
+	}
+
+	if (-1 == snd->producerid)
+		return NULL;
+
+	/* the consumer reads the rings first, so chunks have to go after the ones left in the queue
+	   till it takes them, otherwise they would be received out of order */
+	if (snd->queued[consumerid] > atomic_load(&ipc->queues[consumerid].fetched))
+		return NULL;
+
+	return &ipc->rings[consumerid * ipc->ring_producers + snd->producerid];
+}
+
+/* reserves space for the chunk at the ring's head, returns NULL if the ring is full */
+static void *ring_reserve(ipc2_ring_t *ring, size_t len, int items_count, u_int64_t *new_head) {
+	u_int64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	u_int64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	u_int64_t pos = head % ring->size, chunk_len = sizeof(ipc2_ring_chunk_t) + IPC2_RING_ALIGN(len);
+	ipc2_ring_chunk_t *chunk;
+
+	if (pos + chunk_len > ring->size) {
+		if (head + ring->size - pos + chunk_len - tail > ring->size)
+			return NULL;
+
+		((ipc2_ring_chunk_t *)(ring->data + pos))->size = IPC2_RING_WRAP;
+		head += ring->size - pos;
+		pos = 0;
+	}
+	else if (head + chunk_len - tail > ring->size)
+		return NULL;
+
+	chunk = (ipc2_ring_chunk_t *)(ring->data + pos);
+	chunk->size = len;
+	chunk->items = items_count;
+
+	*new_head = head + chunk_len;
+
+	return (void *)chunk + sizeof(ipc2_ring_chunk_t);
+}
+
+static void ring_publish(ipc2_chunk_queue_t *q, ipc2_ring_t *ring, u_int64_t new_head, int items_count) {
+	u_int64_t old_head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	ring->sent++;
+	ring->items_sent += items_count;
+
+	/* seq_cst pairs with the consumer's tail store and head load: either the consumer sees
+	   the new head or it's seen here that the ring was drained and has to be woken up */
+	atomic_store(&ring->head, new_head);
+
+	if (-1 != q->wakeup_fd && atomic_load(&ring->tail) == old_head)
+		queue_wakeup(q);
+}
+
+/* waits for the room in the ring, returns NULL if the chunk has to go through the shared queue:
+   it's too big for the ring or it's a high priority chunk which shouldn't wait for the consumer */
+static void *ring_reserve_wait(ipc2_conf_t *ipc, ipc2_ring_t *ring, size_t len, int items_count, int priority,
+		u_int64_t *new_head) {
+	static int last_error = 0;
+	void *data_ptr;
+
+	if (sizeof(ipc2_ring_chunk_t) + IPC2_RING_ALIGN(len) > ring->size / 2)
+		return NULL;
+
+	while (NULL == (data_ptr = ring_reserve(ring, len, items_count, new_head))) {
+		if (ALLOC_PRIORITY_HIGH == priority)
+			return NULL;
+
+		usleep(IPC_WAIT_TIMEOUT);
+
+		if (time(NULL) != last_error) {
+			last_error = time(NULL);
+			LOG_INF("Cannot send to queue '%s', ring is full, waiting", ipc->name);
+		}
+	}
+
+	return data_ptr;
+}
+
+static int ring_send(ipc2_conf_t *ipc, int consumerid, int items_count, size_t len, ipc2_receive_cb_t cb_func,
+		void *ctx_data, void *data, int priority) {
+	ipc2_ring_t *ring;
+	void *data_ptr;
+	u_int64_t new_head;
+
+	if (NULL == (ring = get_producer_ring(ipc, consumerid)) ||
+			NULL == (data_ptr = ring_reserve_wait(ipc, ring, len, items_count, priority, &new_head)))
+		return FAIL;
+
+	if (NULL != cb_func)
+		cb_func(data_ptr, ctx_data);
+	else
+		memcpy(data_ptr, data, len);
+
+	ring_publish(&ipc->queues[consumerid], ring, new_head, items_count);
+
+	return SUCCEED;
+}
+
+static void queue_send(ipc2_conf_t *ipc, int consumerid, ipc2_chunk_t *chunk, int items_count) {
+	u_int64_t num;
+
+	/* the chunk is queued after the ring ones, which were too big or couldn't wait for
+	   the ring room, the consumer has to take the ring chunks till this head first */
+	if (NULL != ipc->rings && -1 != ipc->snd->producerid) {
+		chunk->producerid = ipc->snd->producerid;
+		chunk->ring_head = atomic_load_explicit(
+				&ipc->rings[consumerid * ipc->ring_producers + chunk->producerid].head, memory_order_relaxed);
+	}
+
+	num = add_chunk_to_queue(&ipc->queues[consumerid], chunk, items_count);
+
+	if (-1 != chunk->producerid)
+		ipc->snd->queued[consumerid] = num;
 }
 
 void ipc2_send_by_cb_fill(ipc2_conf_t *ipc, int consumerid, int items_count, size_t len, ipc2_receive_cb_t cb_func, void *ctx_data, int priority) {
 	
+	if (SUCCEED == ring_send(ipc, consumerid, items_count, len, cb_func, ctx_data, NULL, priority))
+		return;
+
 	ipc2_chunk_t *chunk = allocate_chunk(ipc, len, items_count, priority);
 	void *data_ptr = (void *)chunk + sizeof(ipc2_chunk_t);
 
 	cb_func(data_ptr, ctx_data);
 	
-	add_chunk_to_queue(&ipc->queues[consumerid], chunk, items_count);
+	queue_send(ipc, consumerid, chunk, items_count);
 } 
 
 
@@ -136,12 +357,15 @@ void ipc2_send_chunk(ipc2_conf_t *ipc, int consumerid, int items_count, void *da
 	if (consumerid >= ipc->consumers)
 		HALT_HERE("Wrong consumerid %d, this is bug", consumerid);
 
+	if (SUCCEED == ring_send(ipc, consumerid, items_count, len, NULL, NULL, data, priority))
+		return;
+
 	chunk = allocate_chunk(ipc, len, items_count, priority);
 	
 	void *data_ptr = (void *)chunk + sizeof(ipc2_chunk_t);
 
 	memcpy ( data_ptr, data, len);
-	add_chunk_to_queue(&ipc->queues[consumerid], chunk, items_count);
+	queue_send(ipc, consumerid, chunk, items_count);
 }
 
 static int ensure_chunks_in_local_queue(ipc2_conf_t *ipc, ipc2_rcv_conf_t *rcv, int consumerid) {
@@ -153,6 +377,7 @@ static int ensure_chunks_in_local_queue(ipc2_conf_t *ipc, ipc2_rcv_conf_t *rcv,
 	rcv->rcv_queue = ipc->queues[consumerid].first;
 	ipc->queues[consumerid].first = NULL;
 	ipc->queues[consumerid].last = NULL;
+	atomic_fetch_add(&ipc->queues[consumerid].fetched, ipc->queues[consumerid].count);
 	ipc->queues[consumerid].count = 0;
 	glb_lock_unlock(&ipc->queues[consumerid].lock);
 
@@ -162,10 +387,58 @@ static int ensure_chunks_in_local_queue(ipc2_conf_t *ipc, ipc2_rcv_conf_t *rcv,
 	return SUCCEED;
 }
 
+static int ring_receive_one_chunk(ipc2_ring_t *ring, ipc2_receive_cb_t receive_func, void *ctx_data) {
+	u_int64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed), pos;
+	ipc2_ring_chunk_t *chunk;
+	int items;
+
+	if (tail == atomic_load(&ring->head))
+		return 0;
+
+	pos = tail % ring->size;
+	chunk = (ipc2_ring_chunk_t *)(ring->data + pos);
+
+	/* the producer publishes the wrap marker together with the chunk after it */
+	if (IPC2_RING_WRAP == chunk->size) {
+		tail += ring->size - pos;
+		chunk = (ipc2_ring_chunk_t *)ring->data;
+	}
+
+	receive_func((void *)chunk + sizeof(ipc2_ring_chunk_t), ctx_data);
+
+	items = chunk->items;
+	ring->received++;
+	ring->items_received += items;
+
+	atomic_store(&ring->tail, tail + sizeof(ipc2_ring_chunk_t) + IPC2_RING_ALIGN(chunk->size));
+
+	return items;
+}
+
+/* takes one chunk from the consumer's rings, starting from the ring next to the last used one,
+   so a busy producer doesn't starve the others */
+static int rings_receive_one_chunk(ipc2_conf_t *ipc, ipc2_rcv_conf_t *rcv, int consumerid,
+		ipc2_receive_cb_t receive_func, void *ctx_data) {
+	ipc2_ring_t *rings = &ipc->rings[consumerid * ipc->ring_producers];
+	int i, items;
+
+	for (i = 0; i < ipc->ring_producers; i++) {
+		int ringid = (rcv->ring_next + i) % ipc->ring_producers;
+
+		if (0 != (items = ring_receive_one_chunk(&rings[ringid], receive_func, ctx_data))) {
+			rcv->ring_next = ringid + 1;
+			return items;
+		}
+	}
+
+	return 0;
+}
+
 int  ipc2_receive_one_chunk(ipc2_conf_t *ipc, ipc2_rcv_conf_t *rcv_in,  int consumerid, ipc2_receive_cb_t receive_func, void *ctx_data) {
 
 	ipc2_chunk_t *chunk;
 	ipc2_rcv_conf_t *rcv = ipc->rcv;
+	int items, rings_checked = 0;
 	
 	if (NULL != rcv_in)
 		rcv = rcv_in;
@@ -173,10 +446,33 @@ int  ipc2_receive_one_chunk(ipc2_conf_t *ipc, ipc2_rcv_conf_t *rcv_in,  int cons
 	if (consumerid >= ipc->consumers)
 		HALT_HERE("Wrong consumerid %d, this is bug", consumerid);
 
-	if (FAIL == ensure_chunks_in_local_queue(ipc, rcv, consumerid))
+	if (NULL != ipc->rings && NULL == rcv->rcv_queue && IPC2_RING_QUEUE_CHECK > rcv->ring_chunks) {
+		if (0 != (items = rings_receive_one_chunk(ipc, rcv, consumerid, receive_func, ctx_data))) {
+			rcv->ring_chunks++;
+			return items;
+		}
+
+		rings_checked = 1;
+	}
+
+	rcv->ring_chunks = 0;
+
+	if (FAIL == ensure_chunks_in_local_queue(ipc, rcv, consumerid)) {
+		if (NULL != ipc->rings && 0 == rings_checked)
+			return rings_receive_one_chunk(ipc, rcv, consumerid, receive_func, ctx_data);
+
 		return 0;
+	}
 
 	chunk = rcv->rcv_queue;
+
+	if (-1 != chunk->producerid) {
+		ipc2_ring_t *ring = &ipc->rings[consumerid * ipc->ring_producers + chunk->producerid];
+
+		if (atomic_load_explicit(&ring->tail, memory_order_relaxed) < chunk->ring_head)
+			return ring_receive_one_chunk(ring, receive_func, ctx_data);
+	}
+
 	rcv->rcv_queue = rcv->rcv_queue->next;
 	
 	void *data_ptr = (void *)chunk + sizeof(ipc2_chunk_t); 
@@ -187,12 +483,46 @@ int  ipc2_receive_one_chunk(ipc2_conf_t *ipc, ipc2_rcv_conf_t *rcv_in,  int cons
 
 	receive_func(data_ptr, ctx_data);
 	
-	int items = chunk->items;
+	items = chunk->items;
 	ipc->memf.free_func(chunk);
+	ipc->queues[consumerid].received++;
 	
 	return items;
 }
 
+/* the barrier is the consumer's queue and rings positions: the number of the last chunk queued
+   and each ring's head, it's passed when the consumer has processed all the chunks sent before it,
+   the producers' order is kept, but the chunks of different producers might be received in any 
+   order, so "the queue is empty" doesn't mean that under the load */
+u_int64_t *ipc2_get_barrier(ipc2_conf_t *ipc, int consumerid) {
+	u_int64_t *barrier = zbx_malloc(NULL, sizeof(u_int64_t) * (1 + ipc->ring_producers));
+	int i;
+
+	glb_lock_block(&ipc->queues[consumerid].lock);
+	barrier[0] = ipc->queues[consumerid].sent;
+	glb_lock_unlock(&ipc->queues[consumerid].lock);
+
+	for (i = 0; NULL != ipc->rings && i < ipc->ring_producers; i++)
+		barrier[1 + i] = atomic_load(&ipc->rings[consumerid * ipc->ring_producers + i].head);
+
+	return barrier;
+}
+
+/* must be called by the consumer itself */
+int ipc2_is_barrier_passed(ipc2_conf_t *ipc, int consumerid, const u_int64_t *barrier) {
+	int i;
+
+	if (ipc->queues[consumerid].received < barrier[0])
+		return FAIL;
+
+	for (i = 0; NULL != ipc->rings && i < ipc->ring_producers; i++) {
+		if (atomic_load(&ipc->rings[consumerid * ipc->ring_producers + i].tail) < barrier[1 + i])
+			return FAIL;
+	}
+
+	return SUCCEED;
+}
+
 ipc2_conf_t* ipc2_init(int consumers, mem_funcs_t *memf, char *name, zbx_shmem_info_t *mem_info) {
     
 	ipc2_conf_t *ipc;
@@ -223,6 +553,7 @@ ipc2_conf_t* ipc2_init(int consumers, mem_funcs_t *memf, char *name, zbx_shmem_i
 	
 	for (i=0; i< consumers; i++) {
 		glb_lock_init(&ipc->queues[i].lock);
+		ipc->queues[i].wakeup_fd = -1;
 	}
 	
 	ipc->rcv = zbx_calloc(NULL,0, sizeof(ipc2_rcv_conf_t));
@@ -238,11 +569,136 @@ void ipc2_deinit_receiver(ipc2_rcv_conf_t *ipc_rcv) {
 	zbx_free(ipc_rcv);
 }
 
+/* creates a wakeup channel for each consumer, the channels are inherited by the forks,
+   so this has to be called by the parent before the consumers are started.
+   Without wakeups support consumers have to poll the queue as before */
+int ipc2_init_wakeups(ipc2_conf_t *ipc) {
+#ifdef HAVE_SYS_EVENTFD_H
+	int i;
+
+	for (i = 0; i < ipc->consumers; i++) {
+		if (-1 == (ipc->queues[i].wakeup_fd = eventfd(0, EFD_NONBLOCK))) {
+			LOG_WRN("Cannot create wakeup eventfd for IPC '%s': %s", ipc->name, zbx_strerror(errno));
+
+			while (0 < i--) {
+				close(ipc->queues[i].wakeup_fd);
+				ipc->queues[i].wakeup_fd = -1;
+			}
+
+			return FAIL;
+		}
+	}
+
+	return SUCCEED;
+#else
+	return FAIL;
+#endif
+}
+
+/* returns the fd which becomes readable when the consumer's queue gets data or -1 */
+int ipc2_get_wakeup_fd(ipc2_conf_t *ipc, int consumerid) {
+	return ipc->queues[consumerid].wakeup_fd;
+}
+
+/* resets the wakeup channel, must be called before the queue is drained,
+   otherwise a chunk sent in between will not wake the consumer up */
+void ipc2_ack_wakeup(ipc2_conf_t *ipc, int consumerid) {
+#ifdef HAVE_SYS_EVENTFD_H
+	eventfd_t value;
+
+	if (-1 != ipc->queues[consumerid].wakeup_fd)
+		eventfd_read(ipc->queues[consumerid].wakeup_fd, &value);
+#endif
+}
+
+/* waits up to timeout_ms for the consumer's queue to get data, falls back to sleeping when
+   the queue has no wakeup channel */
+void ipc2_wait_wakeup(ipc2_conf_t *ipc, int consumerid, int timeout_ms) {
+	struct pollfd pfd = {.fd = ipc->queues[consumerid].wakeup_fd, .events = POLLIN};
+
+	if (-1 == pfd.fd) {
+		usleep(timeout_ms * 1000);
+		return;
+	}
+
+	if (0 < poll(&pfd, 1, timeout_ms))
+		ipc2_ack_wakeup(ipc, consumerid);
+}
+
+/* creates a ring for each producer and consumer pair, producers claim the rings on the first send,
+   so up to producers processes forked after the call send without locks and allocations,
+   the others and the chunks not fitting the ring go through the shared queues */
+int ipc2_init_rings(ipc2_conf_t *ipc, int producers, size_t ring_size) {
+	u_int64_t rings_num = (u_int64_t)producers * ipc->consumers, i;
+	char *data;
+
+	ring_size = ring_size & ~(size_t)7;
+
+	/* rings memory is never freed, what is left has to be enough for the queues */
+	if (ring_size * rings_num > ipc->mem_info->free_size / 2) {
+		LOG_WRN("IPC '%s': %d producers x %d consumers rings of %zu bytes need more than a half "
+				"of the IPC buffer, rings are disabled", ipc->name, producers, ipc->consumers, ring_size);
+		return FAIL;
+	}
+
+	if (NULL == (ipc->rings = ipc->memf.malloc_func(NULL, sizeof(ipc2_ring_t) * rings_num)) ||
+			NULL == (data = ipc->memf.malloc_func(NULL, ring_size * rings_num))) {
+		LOG_WRN("IPC '%s': cannot allocate rings", ipc->name);
+
+		if (NULL != ipc->rings)
+			ipc->memf.free_func(ipc->rings);
+
+		ipc->rings = NULL;
+		return FAIL;
+	}
+
+	memset((void *)ipc->rings, 0, sizeof(ipc2_ring_t) * rings_num);
+
+	for (i = 0; i < rings_num; i++) {
+		ipc->rings[i].data = data + i * ring_size;
+		ipc->rings[i].size = ring_size;
+	}
+
+	ipc->ring_producers = producers;
+
+	ipc->snd = zbx_calloc(NULL, 0, sizeof(ipc2_snd_conf_t));
+	ipc->snd->producerid = -1;
+	ipc->snd->queued = zbx_calloc(NULL, ipc->consumers, sizeof(u_int64_t));
+
+	if (0 == atfork_registered) {
+		pthread_atfork(NULL, NULL, ipc2_atfork_child);
+		atfork_registered = 1;
+	}
+
+	return SUCCEED;
+}
+
 void ipc2_destroy(ipc2_conf_t *ipc) {
+	int i;
+
+	for (i = 0; i < ipc->consumers; i++) {
+		if (-1 != ipc->queues[i].wakeup_fd)
+			close(ipc->queues[i].wakeup_fd);
+	}
+
+	if (NULL != ipc->rings) {
+		ipc->memf.free_func(ipc->rings[0].data);
+		ipc->memf.free_func(ipc->rings);
+		zbx_free(ipc->snd->queued);
+		zbx_free(ipc->snd);
+	}
+
 	ipc->memf.free_func(ipc->queues);
 	ipc->memf.free_func(ipc);
 }
 
+static int ipc2_get_rings_num(ipc2_conf_t *ipc) {
+	if (NULL == ipc->rings)
+		return 0;
+
+	return ipc->consumers * ipc->ring_producers;
+}
+
 u_int64_t ipc2_get_sent_chunks(ipc2_conf_t *ipc) {
 	int i;
 	u_int64_t sent = 0;
@@ -250,6 +706,9 @@ u_int64_t ipc2_get_sent_chunks(ipc2_conf_t *ipc) {
 	for (i = 0; i < ipc->consumers; i++) 
 		sent += ipc->queues[i].sent;
 	
+	for (i = 0; i < ipc2_get_rings_num(ipc); i++)
+		sent += ipc->rings[i].sent;
+
 	return sent;
 }
 
@@ -260,6 +719,9 @@ u_int64_t ipc2_get_sent_items(ipc2_conf_t *ipc) {
 	for (i = 0; i < ipc->consumers; i++) 
 		sent += ipc->queues[i].items_sent;
 	
+	for (i = 0; i < ipc2_get_rings_num(ipc); i++)
+		sent += ipc->rings[i].items_sent;
+
 	return sent;
 }
 
@@ -270,6 +732,14 @@ u_int64_t ipc2_get_queue_size(ipc2_conf_t *ipc) {
 	for (i = 0; i < ipc->consumers; i++) 
 		total += ipc->queues[i].items;
 	
+	/* counters are updated by different processes without locks, so it's an estimate */
+	for (i = 0; i < ipc2_get_rings_num(ipc); i++) {
+		ipc2_ring_t *ring = &ipc->rings[i];
+
+		if (ring->items_sent > ring->items_received)
+			total += ring->items_sent - ring->items_received;
+	}
+
 	return total;
 }
 
@@ -299,6 +769,18 @@ void 	ipc2_dump_queues(ipc2_conf_t *ipc) {
 		}
 		glb_lock_unlock(&ipc->queues[i].lock);
 
+		if (NULL != ipc->rings) {
+			int j;
+
+			for (j = 0; j < ipc->ring_producers; j++) {
+				ipc2_ring_t *ring = &ipc->rings[i * ipc->ring_producers + j];
+
+				chunks += ring->sent - ring->received;
+				items += ring->items_sent - ring->items_received;
+				size += atomic_load(&ring->head) - atomic_load(&ring->tail);
+			}
+		}
+
 		LOG_INF("IPC consumer %d: chunks %d, items %d, size %d", i , chunks, items, size);
 	}
 }
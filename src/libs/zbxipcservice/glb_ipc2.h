@@ -39,6 +39,15 @@ void ipc2_send_chunk(ipc2_conf_t *ipc, int consumerid, int sent_items, void *dat
 void ipc2_send_by_cb_fill(ipc2_conf_t *ipc, int consumerid, int items_count, size_t len, ipc2_receive_cb_t cb_func, void *ctx_data, int priority);
 int ipc2_receive_one_chunk(ipc2_conf_t *ipc, ipc2_rcv_conf_t *rcv, int consumerid, ipc2_receive_cb_t receive_func, void *ctx_data);
 
+int ipc2_init_rings(ipc2_conf_t *ipc, int producers, size_t ring_size);
+int ipc2_init_wakeups(ipc2_conf_t *ipc);
+int ipc2_get_wakeup_fd(ipc2_conf_t *ipc, int consumerid);
+void ipc2_ack_wakeup(ipc2_conf_t *ipc, int consumerid);
+void ipc2_wait_wakeup(ipc2_conf_t *ipc, int consumerid, int timeout_ms);
+
+u_int64_t *ipc2_get_barrier(ipc2_conf_t *ipc, int consumerid);
+int ipc2_is_barrier_passed(ipc2_conf_t *ipc, int consumerid, const u_int64_t *barrier);
+
 ipc2_rcv_conf_t *ipc2_init_receiver();
 void ipc2_deinit_receiver(ipc2_rcv_conf_t *rcv_ipc);
 
@@ -25,11 +25,15 @@
 #include "glb_lock.h"
 #include <threads.h>
 #include <stdatomic.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/wait.h>
 
 #include "metric.h"
 #include "../glb_ipc2.h"
 #include "../glb_serial_buffer.h"
 #include "../../../zabbix_server/tests/test_utils.h"
+#include "zbxtime.h"
 
 #define TEST_MEM_SIZE (u_int64_t)256 * ZBX_MEBIBYTE
 
@@ -62,7 +66,7 @@ static void run_tests() {
     rcv_ipc = ipc2_init_receiver();
     
     for (int i = 0; i < 10; i++) {
-        ipc2_send_chunk(ipc, 0, 13, test_line, strlen(test_line) + 1);
+        ipc2_send_chunk(ipc, 0, 13, test_line, strlen(test_line) + 1, ALLOC_PRIORITY_NORMAL);
         ipc2_receive_one_chunk(ipc, rcv_ipc, 0, test_receive_cb, test_line);
     }
     
@@ -116,7 +120,7 @@ void run_congestion_test(){
     thrd_create(&thr[0], ipc_slow_reader, ipc);
 
     for (int i = 0; i < IPC_CONGESTION_TEST_COUNT; i++) 
-        ipc2_send_chunk(ipc, 0, 13, test_line, strlen(test_line) + 1);
+        ipc2_send_chunk(ipc, 0, 13, test_line, strlen(test_line) + 1, ALLOC_PRIORITY_NORMAL);
 
     LOG_INF("Waiting for the reader finish");
     thrd_join(thr[0], NULL);
@@ -149,7 +153,7 @@ int ipc_sender(void* thr_data) {
     
     while (sent_messages < TEST_MESSAGES) {
     
-        ipc2_send_chunk(ipc, rand() % TEST_RECEIVERS, MSG_SIZE/100, buffer, MSG_SIZE);
+        ipc2_send_chunk(ipc, rand() % TEST_RECEIVERS, MSG_SIZE/100, buffer, MSG_SIZE, ALLOC_PRIORITY_NORMAL);
         sent_messages++;
     
     }
@@ -357,8 +361,273 @@ void test_serial_buffer_integrity() {
 
 
 
+static int wakeup_is_signaled(ipc2_conf_t *ipc, int consumerid) {
+    struct pollfd pfd = {.fd = ipc2_get_wakeup_fd(ipc, consumerid), .events = POLLIN};
+
+    return 0 < poll(&pfd, 1, 0);
+}
+
+void test_ipc_wakeups() {
+    mem_funcs_t *memf = NULL;
+    zbx_shmem_info_t	*shm_mem = NULL;
+    ipc2_conf_t *ipc;
+    ipc2_rcv_conf_t *ipc_rcv = ipc2_init_receiver();
+
+    assert(SUCCEED == tests_mem_allocate_shmem(TEST_MEM_SIZE, &memf, &shm_mem) && 
+                        "Test shmem should succeed on create");
+
+    ipc = ipc2_init(2, memf, "Wakeups", shm_mem);
+    assert(NULL != ipc && "IPC should be created");
+    assert(-1 == ipc2_get_wakeup_fd(ipc, 0) && "Wakeups are off by default");
+    assert(SUCCEED == ipc2_init_wakeups(ipc) && "Wakeups should be created");
+    assert(-1 != ipc2_get_wakeup_fd(ipc, 0) && -1 != ipc2_get_wakeup_fd(ipc, 1));
+
+    assert(0 == wakeup_is_signaled(ipc, 0) && "Empty queue shouldn't signal");
+
+    ipc2_send_chunk(ipc, 0, 1, test_line, strlen(test_line) + 1, ALLOC_PRIORITY_NORMAL);
+    assert(1 == wakeup_is_signaled(ipc, 0) && "First chunk should signal");
+    assert(0 == wakeup_is_signaled(ipc, 1) && "Other consumers shouldn't be signaled");
+    
+    ipc2_ack_wakeup(ipc, 0);
+    ipc2_send_chunk(ipc, 0, 1, test_line, strlen(test_line) + 1, ALLOC_PRIORITY_NORMAL);
+    assert(0 == wakeup_is_signaled(ipc, 0) && "Non empty queue shouldn't signal again");
+
+    while (0 < ipc2_receive_one_chunk(ipc, ipc_rcv, 0, test_receive_cb, test_line))
+        ;
+
+    ipc2_send_chunk(ipc, 0, 1, test_line, strlen(test_line) + 1, ALLOC_PRIORITY_NORMAL);
+    assert(1 == wakeup_is_signaled(ipc, 0) && "Drained queue should signal again");
+    
+    ipc2_wait_wakeup(ipc, 0, 1000);
+    assert(0 == wakeup_is_signaled(ipc, 0) && "Wait should reset the signal");
+    assert(1 == ipc2_receive_one_chunk(ipc, ipc_rcv, 0, test_receive_cb, test_line));
+
+    LOG_INF("IPC wakeups test passed");
+
+    ipc2_deinit_receiver(ipc_rcv);
+    ipc2_destroy(ipc);
+    test_mem_release_shmem();
+}
+
+#define RING_TEST_SIZE 4096
+
+static void ring_receive_cb(void *rcv_data, void *ctx_data) {
+    int *expected = ctx_data;
+    int *data = rcv_data;
+
+    assert(*data == *expected && "should get chunks in the order they were sent");
+    (*expected)++;
+}
+
+void test_ipc_rings() {
+    mem_funcs_t *memf = NULL;
+    zbx_shmem_info_t	*shm_mem = NULL;
+    ipc2_conf_t *ipc;
+    ipc2_rcv_conf_t *ipc_rcv = ipc2_init_receiver();
+    int i, sent = 0, expected = 0, data[RING_TEST_SIZE / sizeof(int)] = {0};
+
+    assert(SUCCEED == tests_mem_allocate_shmem(TEST_MEM_SIZE, &memf, &shm_mem) && 
+                        "Test shmem should succeed on create");
+
+    ipc = ipc2_init(2, memf, "Rings", shm_mem);
+    assert(NULL != ipc && "IPC should be created");
+    assert(FAIL == ipc2_init_rings(ipc, 1024, TEST_MEM_SIZE) && "Rings larger than the buffer shouldn't be created");
+    assert(SUCCEED == ipc2_init_rings(ipc, 2, RING_TEST_SIZE) && "Rings should be created");
+    
+    /* different sizes make the chunks wrap at different positions */
+    for (i = 0; i < 10000; i++) {
+        data[0] = sent++;
+        ipc2_send_chunk(ipc, 1, 1, data, sizeof(int) * (1 + i % 100), ALLOC_PRIORITY_NORMAL);
+        
+        if (0 == i % 3)
+            continue;
+
+        while (0 < ipc2_receive_one_chunk(ipc, ipc_rcv, 1, ring_receive_cb, &expected))
+            ;
+    }
+    
+    assert(0 == ipc2_receive_one_chunk(ipc, ipc_rcv, 0, ring_receive_cb, &expected) && 
+                        "Other consumer shouldn't get anything");
+    
+    while (0 < ipc2_receive_one_chunk(ipc, ipc_rcv, 1, ring_receive_cb, &expected))
+        ;
+
+    assert(sent == expected && "All chunks should be received");
+    assert(0 == ipc2_get_queue_size(ipc) && sent == ipc2_get_sent_items(ipc));
+
+    /* high priority chunks don't wait for the full ring and the big chunk doesn't fit it, 
+       both go through the queue, but still should be received in order */
+    for (i = 0; i < RING_TEST_SIZE / 64 + 1; i++) {
+        data[0] = sent++;
+        ipc2_send_chunk(ipc, 1, 1, data, 64, ALLOC_PRIORITY_HIGH);
+    }
+    
+    data[0] = sent++;
+    ipc2_send_chunk(ipc, 1, 1, data, RING_TEST_SIZE, ALLOC_PRIORITY_NORMAL);
+    data[0] = sent++;
+    ipc2_send_chunk(ipc, 1, 1, data, 64, ALLOC_PRIORITY_NORMAL);
+
+    assert(sent - expected == ipc2_get_queue_size(ipc));
+    
+    while (0 < ipc2_receive_one_chunk(ipc, ipc_rcv, 1, ring_receive_cb, &expected))
+        ;
+    
+    assert(sent == expected && "All chunks should be received");
+
+    /* big chunks go through the queue after more small ring chunks than the consumer reads 
+       before it checks the queue, they still should be received in order */
+    for (i = 0; i < 1000; i++) {
+        data[0] = sent++;
+        
+        if (0 == i % 150)
+            ipc2_send_chunk(ipc, 1, 1, data, RING_TEST_SIZE, ALLOC_PRIORITY_NORMAL);
+        else 
+            ipc2_send_chunk(ipc, 1, 1, data, sizeof(int), ALLOC_PRIORITY_NORMAL);
+
+        if (0 != i % 200)
+            continue;
+
+        while (0 < ipc2_receive_one_chunk(ipc, ipc_rcv, 1, ring_receive_cb, &expected))
+            ;
+    }
+
+    while (0 < ipc2_receive_one_chunk(ipc, ipc_rcv, 1, ring_receive_cb, &expected))
+        ;
+
+    assert(sent == expected && "All chunks should be received");
+    LOG_INF("IPC rings test passed");
+
+    ipc2_deinit_receiver(ipc_rcv);
+    ipc2_destroy(ipc);
+    test_mem_release_shmem();
+}
+
+/* the barrier is passed when the chunks sent before it are received, both from the rings 
+   and the queue, the chunks sent after it don't matter */
+void test_ipc_barrier() {
+    mem_funcs_t *memf = NULL;
+    zbx_shmem_info_t	*shm_mem = NULL;
+    ipc2_conf_t *ipc;
+    ipc2_rcv_conf_t *ipc_rcv = ipc2_init_receiver();
+    int i, sent = 0, expected = 0, data[RING_TEST_SIZE / sizeof(int)] = {0};
+    u_int64_t *barrier;
+
+    assert(SUCCEED == tests_mem_allocate_shmem(TEST_MEM_SIZE, &memf, &shm_mem) && 
+                        "Test shmem should succeed on create");
+
+    ipc = ipc2_init(2, memf, "Barrier", shm_mem);
+    assert(SUCCEED == ipc2_init_rings(ipc, 2, RING_TEST_SIZE) && "Rings should be created");
+
+    barrier = ipc2_get_barrier(ipc, 1);
+    assert(SUCCEED == ipc2_is_barrier_passed(ipc, 1, barrier) && "Nothing is sent before the barrier");
+    zbx_free(barrier);
+
+    for (i = 0; i < 100; i++) {
+        data[0] = sent++;
+        ipc2_send_chunk(ipc, 1, 1, data, sizeof(int), 0 == i % 10 ? ALLOC_PRIORITY_HIGH : ALLOC_PRIORITY_NORMAL);
+    }
+
+    barrier = ipc2_get_barrier(ipc, 1);
+    assert(FAIL == ipc2_is_barrier_passed(ipc, 1, barrier) && "The chunks before the barrier aren't received yet");
+
+    for (i = 0; i < 100; i++) {
+        data[0] = sent++;
+        ipc2_send_chunk(ipc, 1, 1, data, sizeof(int), 0 == i % 10 ? ALLOC_PRIORITY_HIGH : ALLOC_PRIORITY_NORMAL);
+    }
+
+    /* the only producer's chunks come in order, so the barrier is passed by the 100th one */
+    while (0 < ipc2_receive_one_chunk(ipc, ipc_rcv, 1, ring_receive_cb, &expected))
+        assert((expected >= 100 ? SUCCEED : FAIL) == ipc2_is_barrier_passed(ipc, 1, barrier) &&
+                        "The barrier should be passed when the chunks before it are received");
+
+    assert(sent == expected && "All chunks should be received");
+    zbx_free(barrier);
+
+    LOG_INF("IPC barrier test passed");
+
+    ipc2_deinit_receiver(ipc_rcv);
+    ipc2_destroy(ipc);
+    test_mem_release_shmem();
+}
+
+#define BENCH_PRODUCERS 16
+#define BENCH_CONSUMERS 4
+#define BENCH_CHUNKS    20000
+#define BENCH_CHUNK_LEN 1024
+
+static void bench_receive_cb(void *rcv_data, void *ctx_data) {
+}
+
+/* senders and receivers are forked processes like the real ones are */
+static double bench_ipc_contention(int ring_size) {
+    mem_funcs_t *memf = NULL;
+    zbx_shmem_info_t	*shm_mem = NULL;
+    ipc2_conf_t *ipc;
+    char data[BENCH_CHUNK_LEN] = {0};
+    double start;
+    int i;
+
+    assert(SUCCEED == tests_mem_allocate_shmem(TEST_MEM_SIZE, &memf, &shm_mem) && 
+                        "Test shmem should succeed on create");
+
+    ipc = ipc2_init(BENCH_CONSUMERS, memf, "Contention", shm_mem);
+    
+    if (0 != ring_size)
+        assert(SUCCEED == ipc2_init_rings(ipc, BENCH_PRODUCERS, ring_size));
+
+    start = zbx_time();
+
+    for (i = 0; i < BENCH_CONSUMERS; i++) {
+        if (0 == fork()) {
+            int received = 0;
+            ipc2_rcv_conf_t *ipc_rcv = ipc2_init_receiver();
+
+            while (received < BENCH_PRODUCERS * BENCH_CHUNKS / BENCH_CONSUMERS) {
+                int items = ipc2_receive_one_chunk(ipc, ipc_rcv, i, bench_receive_cb, NULL);
+
+                if (0 == items)
+                    sched_yield();
+
+                received += items;
+            }
+            _exit(EXIT_SUCCESS);
+        }
+    }
+    
+    for (i = 0; i < BENCH_PRODUCERS; i++) {
+        if (0 == fork()) {
+            for (int j = 0; j < BENCH_CHUNKS; j++) 
+                ipc2_send_chunk(ipc, j % BENCH_CONSUMERS, 1, data, BENCH_CHUNK_LEN, ALLOC_PRIORITY_NORMAL);
+
+            _exit(EXIT_SUCCESS);
+        }
+    }
+
+    while (0 < wait(NULL))
+        ;
+
+    start = zbx_time() - start;
+    
+    ipc2_destroy(ipc);
+    test_mem_release_shmem();
+
+    return start;
+}
+
+void bench_ipc_rings() {
+    double queue_time = bench_ipc_contention(0), ring_time = bench_ipc_contention(256 * ZBX_KIBIBYTE);
+
+    LOG_INF("IPC contention benchmark: %d senders, %d receivers, %d chunks of %d bytes: "
+            "shared queue %.3f sec, rings %.3f sec", BENCH_PRODUCERS, BENCH_CONSUMERS, 
+            BENCH_PRODUCERS * BENCH_CHUNKS, BENCH_CHUNK_LEN, queue_time, ring_time);
+}
+
 void glb_ipc2_run_serial_tests() {
   //  run_tests();
+    test_ipc_wakeups();
+    test_ipc_rings();
+    test_ipc_barrier();
+    bench_ipc_rings();
     test_serial_buffer_integrity();
     run_buffer_serialisation_test();
     run_many_senders_test(); //this has to be tuned according to situation to emulate the real load
@@ -2965,29 +2965,25 @@ int	zbx_jsonpath_query(const struct zbx_json_parse *jp, const char *path, char *
 
 /******************************************************************************
  *                                                                            *
- * Purpose: perform jsonpath query on the specified json object               *
+ * Purpose: perform precompiled jsonpath query on the specified json object   *
  *                                                                            *
- * Parameters: obj    - [IN] the json object                                  *
- *             path   - [IN] the jsonpath                                     *
- *             output - [OUT] the output value                                *
+ * Parameters: obj      - [IN] the json object                                *
+ *             jsonpath - [IN] the compiled jsonpath                          *
+ *             output   - [OUT] the output value                              *
  *                                                                            *
  * Return value: SUCCEED - the query was performed successfully (empty result *
  *                         being counted as successful query)                 *
  *               FAIL    - otherwise                                          *
  *                                                                            *
  ******************************************************************************/
-int	zbx_jsonobj_query(zbx_jsonobj_t *obj, const char *path, char **output)
+int	zbx_jsonobj_query_compiled(zbx_jsonobj_t *obj, const zbx_jsonpath_t *jsonpath, char **output)
 {
 	zbx_jsonpath_context_t	ctx;
-	zbx_jsonpath_t		jsonpath;
 	int			ret = SUCCEED;
 
-	if (FAIL == zbx_jsonpath_compile(path, &jsonpath))
-		return FAIL;
-
 	ctx.found = 0;
 	ctx.root = obj;
-	ctx.path = &jsonpath;
+	ctx.path = (zbx_jsonpath_t *)jsonpath;
 	zbx_vector_jsonobj_ref_create(&ctx.objects);
 
 	switch (obj->type)
@@ -3005,15 +3001,15 @@ int	zbx_jsonobj_query(zbx_jsonobj_t *obj, const char *path, char **output)
 	if (SUCCEED == ret)
 	{
 		zbx_vector_jsonobj_ref_t	out;
-		int				definite_path = jsonpath.definite, path_depth;
+		int				definite_path = jsonpath->definite, path_depth;
 
 		zbx_vector_jsonobj_ref_create(&out);
 
-		path_depth = jsonpath.segments_num;
-		while (0 < path_depth && ZBX_JSONPATH_SEGMENT_FUNCTION == jsonpath.segments[path_depth - 1].type)
+		path_depth = jsonpath->segments_num;
+		while (0 < path_depth && ZBX_JSONPATH_SEGMENT_FUNCTION == jsonpath->segments[path_depth - 1].type)
 			path_depth--;
 
-		if (path_depth < jsonpath.segments_num)
+		if (path_depth < jsonpath->segments_num)
 		{
 			if (SUCCEED == (ret = jsonpath_apply_functions(&ctx, path_depth, &definite_path, &out)))
 				ret = jsonpath_format_query_result(&out, definite_path, output);
@@ -3027,7 +3023,322 @@ int	zbx_jsonobj_query(zbx_jsonobj_t *obj, const char *path, char **output)
 
 	zbx_vector_jsonobj_ref_clear_ext(&ctx.objects);
 	zbx_vector_jsonobj_ref_destroy(&ctx.objects);
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: perform jsonpath query on the specified json object               *
+ *                                                                            *
+ * Parameters: obj    - [IN] the json object                                  *
+ *             path   - [IN] the jsonpath                                     *
+ *             output - [OUT] the output value                                *
+ *                                                                            *
+ * Return value: SUCCEED - the query was performed successfully (empty result *
+ *                         being counted as successful query)                 *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_jsonobj_query(zbx_jsonobj_t *obj, const char *path, char **output)
+{
+	zbx_jsonpath_t	jsonpath;
+	int		ret;
+
+	if (FAIL == zbx_jsonpath_compile(path, &jsonpath))
+		return FAIL;
+
+	ret = zbx_jsonobj_query_compiled(obj, &jsonpath, output);
 	zbx_jsonpath_clear(&jsonpath);
 
 	return ret;
 }
+
+/* jsonpath set - definite paths merged into a tree by their segments, so the values */
+/* of all the paths are extracted in one walk and the common prefixes are looked up */
+/* only once                                                                        */
+
+typedef struct zbx_jsonpath_set_node
+{
+	char				*name;		/* object member name, NULL for array element */
+	int				index;		/* array element index */
+	int				slot;		/* the path output slot, FAIL if no path ends here */
+	zbx_vector_ptr_t		children;
+}
+zbx_jsonpath_set_node_t;
+
+typedef struct
+{
+	char	*path;
+	int	slot;	/* FAIL if the path cannot be added to the set */
+}
+zbx_jsonpath_set_path_t;
+
+struct zbx_jsonpath_set
+{
+	zbx_jsonpath_set_node_t	root;
+	zbx_hashset_t		paths;
+	int			slots_num;
+};
+
+static zbx_hash_t	jsonpath_set_path_hash(const void *v)
+{
+	const zbx_jsonpath_set_path_t	*path = (const zbx_jsonpath_set_path_t *)v;
+
+	return ZBX_DEFAULT_STRING_HASH_FUNC(path->path);
+}
+
+static int	jsonpath_set_path_compare(const void *v1, const void *v2)
+{
+	const zbx_jsonpath_set_path_t	*path1 = (const zbx_jsonpath_set_path_t *)v1;
+	const zbx_jsonpath_set_path_t	*path2 = (const zbx_jsonpath_set_path_t *)v2;
+
+	return strcmp(path1->path, path2->path);
+}
+
+static void	jsonpath_set_path_clear(void *v)
+{
+	zbx_jsonpath_set_path_t	*path = (zbx_jsonpath_set_path_t *)v;
+
+	zbx_free(path->path);
+}
+
+static void	jsonpath_set_node_init(zbx_jsonpath_set_node_t *node, const char *name, int index)
+{
+	node->name = (NULL != name ? zbx_strdup(NULL, name) : NULL);
+	node->index = index;
+	node->slot = FAIL;
+	zbx_vector_ptr_create(&node->children);
+}
+
+static void	jsonpath_set_node_clear(zbx_jsonpath_set_node_t *node)
+{
+	int	i;
+
+	for (i = 0; i < node->children.values_num; i++)
+	{
+		zbx_jsonpath_set_node_t	*child = (zbx_jsonpath_set_node_t *)node->children.values[i];
+
+		jsonpath_set_node_clear(child);
+		zbx_free(child);
+	}
+
+	zbx_vector_ptr_destroy(&node->children);
+	zbx_free(node->name);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: create jsonpath set                                               *
+ *                                                                            *
+ * Return value: The created jsonpath set.                                    *
+ *                                                                            *
+ ******************************************************************************/
+zbx_jsonpath_set_t	*zbx_jsonpath_set_create(void)
+{
+	zbx_jsonpath_set_t	*set = (zbx_jsonpath_set_t *)zbx_malloc(NULL, sizeof(zbx_jsonpath_set_t));
+
+	jsonpath_set_node_init(&set->root, NULL, 0);
+	zbx_hashset_create_ext(&set->paths, 0, jsonpath_set_path_hash, jsonpath_set_path_compare,
+			jsonpath_set_path_clear, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+			ZBX_DEFAULT_MEM_FREE_FUNC);
+	set->slots_num = 0;
+
+	return set;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: free jsonpath set                                                 *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_jsonpath_set_free(zbx_jsonpath_set_t *set)
+{
+	jsonpath_set_node_clear(&set->root);
+	zbx_hashset_destroy(&set->paths);
+	zbx_free(set);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: check if the compiled jsonpath is a chain of single member names  *
+ *          or array indices which can be merged into a jsonpath set          *
+ *                                                                            *
+ ******************************************************************************/
+static int	jsonpath_set_is_supported(const zbx_jsonpath_t *jsonpath)
+{
+	int	i;
+
+	if (1 != jsonpath->definite)
+		return FAIL;
+
+	for (i = 0; i < jsonpath->segments_num; i++)
+	{
+		const zbx_jsonpath_segment_t	*segment = &jsonpath->segments[i];
+
+		if (ZBX_JSONPATH_SEGMENT_MATCH_LIST != segment->type || 0 != segment->detached ||
+				NULL == segment->data.list.values || NULL != segment->data.list.values->next)
+		{
+			return FAIL;
+		}
+	}
+
+	return SUCCEED;
+}
+
+static zbx_jsonpath_set_node_t	*jsonpath_set_node_add_child(zbx_jsonpath_set_node_t *node,
+		const zbx_jsonpath_segment_t *segment)
+{
+	const char		*name = NULL;
+	int			i, index = 0;
+	zbx_jsonpath_set_node_t	*child;
+
+	if (ZBX_JSONPATH_LIST_NAME == segment->data.list.type)
+		name = segment->data.list.values->data;
+	else
+		memcpy(&index, segment->data.list.values->data, sizeof(index));
+
+	for (i = 0; i < node->children.values_num; i++)
+	{
+		child = (zbx_jsonpath_set_node_t *)node->children.values[i];
+
+		if (NULL != name)
+		{
+			if (NULL != child->name && 0 == strcmp(child->name, name))
+				return child;
+		}
+		else if (NULL == child->name && child->index == index)
+			return child;
+	}
+
+	child = (zbx_jsonpath_set_node_t *)zbx_malloc(NULL, sizeof(zbx_jsonpath_set_node_t));
+	jsonpath_set_node_init(child, name, index);
+	zbx_vector_ptr_append(&node->children, child);
+
+	return child;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: add jsonpath to the set                                           *
+ *                                                                            *
+ * Parameters: set  - [IN/OUT] the jsonpath set                               *
+ *             path - [IN] the jsonpath                                       *
+ *                                                                            *
+ * Return value: The path output slot or FAIL if the path is not definite or  *
+ *               uses filters, ranges or functions.                           *
+ *                                                                            *
+ * Comments: Adding already known path is a lookup, the same path always gets *
+ *           the same slot.                                                   *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_jsonpath_set_add(zbx_jsonpath_set_t *set, const char *path)
+{
+	zbx_jsonpath_set_path_t	path_local, *set_path;
+	zbx_jsonpath_t		jsonpath;
+
+	path_local.path = (char *)path;
+
+	if (NULL != (set_path = (zbx_jsonpath_set_path_t *)zbx_hashset_search(&set->paths, &path_local)))
+		return set_path->slot;
+
+	path_local.path = zbx_strdup(NULL, path);
+	path_local.slot = FAIL;
+
+	if (SUCCEED == zbx_jsonpath_compile(path, &jsonpath))
+	{
+		if (SUCCEED == jsonpath_set_is_supported(&jsonpath))
+		{
+			zbx_jsonpath_set_node_t	*node = &set->root;
+			int			i;
+
+			for (i = 0; i < jsonpath.segments_num; i++)
+				node = jsonpath_set_node_add_child(node, &jsonpath.segments[i]);
+
+			node->slot = path_local.slot = set->slots_num++;
+		}
+
+		zbx_jsonpath_clear(&jsonpath);
+	}
+
+	zbx_hashset_insert(&set->paths, &path_local, sizeof(path_local));
+
+	return path_local.slot;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: get the number of jsonpath set output slots                       *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_jsonpath_set_slots_num(const zbx_jsonpath_set_t *set)
+{
+	return set->slots_num;
+}
+
+static void	jsonpath_set_query_node(const zbx_jsonpath_set_node_t *node, zbx_jsonobj_t *obj, char **outputs)
+{
+	int	i;
+
+	if (FAIL != node->slot)
+	{
+		size_t	output_alloc = 0, output_offset = 0;
+
+		if (SUCCEED != jsonpath_str_copy_value(&outputs[node->slot], &output_alloc, &output_offset, obj))
+			zbx_free(outputs[node->slot]);
+	}
+
+	for (i = 0; i < node->children.values_num; i++)
+	{
+		const zbx_jsonpath_set_node_t	*child = (const zbx_jsonpath_set_node_t *)node->children.values[i];
+
+		if (NULL != child->name)
+		{
+			zbx_jsonobj_el_t	el_local, *el;
+
+			if (ZBX_JSON_TYPE_OBJECT != obj->type)
+				continue;
+
+			el_local.name = child->name;
+
+			if (NULL != (el = (zbx_jsonobj_el_t *)zbx_hashset_search(&obj->data.object, &el_local)))
+				jsonpath_set_query_node(child, &el->value, outputs);
+		}
+		else
+		{
+			int	index = child->index;
+
+			if (ZBX_JSON_TYPE_ARRAY != obj->type)
+				continue;
+
+			if (0 > index)
+				index += obj->data.array.values_num;
+
+			if (0 <= index && index < obj->data.array.values_num)
+				jsonpath_set_query_node(child, obj->data.array.values[index], outputs);
+		}
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: extract values of all the set jsonpaths in one walk               *
+ *                                                                            *
+ * Parameters: obj     - [IN] the json object                                 *
+ *             set     - [IN] the jsonpath set                                *
+ *             outputs - [OUT] the output values by path slots, NULL if the   *
+ *                             path doesn't match, must have the set slots    *
+ *                             number of elements set to NULL                 *
+ *                                                                            *
+ * Comments: The outputs are the same as zbx_jsonobj_query() returns for each *
+ *           of the paths.                                                    *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_jsonobj_query_set(zbx_jsonobj_t *obj, const zbx_jsonpath_set_t *set, char **outputs)
+{
+	/* the same as the single path query, the paths can't match anything in scalar root */
+	if (ZBX_JSON_TYPE_OBJECT != obj->type && ZBX_JSON_TYPE_ARRAY != obj->type)
+		return;
+
+	jsonpath_set_query_node(&set->root, obj, outputs);
+}
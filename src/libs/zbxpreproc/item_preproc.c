@@ -570,56 +570,61 @@ int	item_preproc_2dec(zbx_variant_t *value, int op_type, char **errmsg)
  *                                                                            *
  * Parameters: value  - [IN/OUT] the value to process                         *
  *             params - [IN] the operation parameters                         *
+ *             regex  - [IN] the precompiled pattern (optional)               *
  *             errmsg - [OUT] error message                                   *
  *                                                                            *
  * Return value: SUCCEED - the value was processed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-int	item_preproc_regsub_op(zbx_variant_t *value, const char *params, char **errmsg)
+int	item_preproc_regsub_op(zbx_variant_t *value, const char *params, const zbx_regexp_t *regex, char **errmsg)
 {
-	char		*pattern, *output, *new_value = NULL;
-	const char	*regex_error;
-	zbx_regexp_t	*regex = NULL;
-	int		ret = FAIL;
+	char		*pattern, *new_value = NULL;
+	const char	*output, *regex_error;
+	zbx_regexp_t	*regex_local = NULL;
 
 	if (FAIL == item_preproc_convert_value(value, ZBX_VARIANT_STR, errmsg))
 		return FAIL;
 
-	pattern = zbx_strdup(NULL, params);
-
-	if (NULL == (output = strchr(pattern, '\n')))
+	if (NULL == (output = strchr(params, '\n')))
 	{
 		*errmsg = zbx_strdup(*errmsg, "cannot find second parameter");
-		goto out;
+		return FAIL;
 	}
 
-	*output++ = '\0';
+	output++;
 
-	if (FAIL == zbx_regexp_compile_ext(pattern, &regex, 0, &regex_error))	/* PCRE_MULTILINE is not used here */
+	if (NULL == regex)
 	{
-		*errmsg = zbx_dsprintf(*errmsg, "invalid regular expression: %s", regex_error);
-		zbx_regexp_err_msg_free(regex_error);
-		goto out;
+		pattern = zbx_strdup(NULL, params);
+		pattern[output - params - 1] = '\0';
+
+		/* PCRE_MULTILINE is not used here */
+		if (FAIL == zbx_regexp_compile_ext(pattern, &regex_local, 0, &regex_error))
+		{
+			*errmsg = zbx_dsprintf(*errmsg, "invalid regular expression: %s", regex_error);
+			zbx_regexp_err_msg_free(regex_error);
+			zbx_free(pattern);
+			return FAIL;
+		}
+
+		zbx_free(pattern);
+		regex = regex_local;
 	}
 
 	if (FAIL == zbx_mregexp_sub_precompiled(value->data.str, regex, output, ZBX_MAX_RECV_DATA_SIZE, &new_value))
-	{
 		*errmsg = zbx_strdup(*errmsg, "pattern does not match");
-		goto out;
-	}
 
-	zbx_variant_clear(value);
-	zbx_variant_set_str(value, new_value);
+	if (NULL != regex_local)
+		zbx_regexp_free(regex_local);
 
-	ret = SUCCEED;
-out:
-	if (NULL != regex)
-		zbx_regexp_free(regex);
+	if (NULL == new_value)
+		return FAIL;
 
-	zbx_free(pattern);
+	zbx_variant_clear(value);
+	zbx_variant_set_str(value, new_value);
 
-	return ret;
+	return SUCCEED;
 }
 
 /******************************************************************************
@@ -707,17 +712,19 @@ out:
  * Parameters: value_type - [IN] the item type                                *
  *             value      - [IN/OUT] the value to process                     *
  *             params     - [IN] the operation parameters                     *
+ *             regex      - [IN] the precompiled pattern (optional)           *
  *             errmsg     - [OUT] error message                               *
  *                                                                            *
  * Return value: SUCCEED - the preprocessing step finished successfully       *
  *               FAIL - otherwise, errmsg contains the error message          *
  *                                                                            *
  ******************************************************************************/
-int	item_preproc_validate_regex(const zbx_variant_t *value, const char *params, char **error)
+int	item_preproc_validate_regex(const zbx_variant_t *value, const char *params, const zbx_regexp_t *regex,
+		char **error)
 {
 	zbx_variant_t	value_str;
 	int		ret = FAIL;
-	zbx_regexp_t	*regex;
+	zbx_regexp_t	*regex_local = NULL;
 	const char	*errptr = NULL;
 	char		*errmsg;
 
@@ -729,11 +736,16 @@ int	item_preproc_validate_regex(const zbx_variant_t *value, const char *params,
 		goto out;
 	}
 
-	if (FAIL == zbx_regexp_compile(params, &regex, &errptr))
+	if (NULL == regex)
 	{
-		errmsg = zbx_dsprintf(NULL, "invalid regular expression pattern: %s", errptr);
-		zbx_regexp_err_msg_free(errptr);
-		goto out;
+		if (FAIL == zbx_regexp_compile(params, &regex_local, &errptr))
+		{
+			errmsg = zbx_dsprintf(NULL, "invalid regular expression pattern: %s", errptr);
+			zbx_regexp_err_msg_free(errptr);
+			goto out;
+		}
+
+		regex = regex_local;
 	}
 
 	if (0 != zbx_regexp_match_precompiled(value_str.data.str, regex))
@@ -741,7 +753,8 @@ int	item_preproc_validate_regex(const zbx_variant_t *value, const char *params,
 	else
 		ret = SUCCEED;
 
-	zbx_regexp_free(regex);
+	if (NULL != regex_local)
+		zbx_regexp_free(regex_local);
 out:
 	zbx_variant_clear(&value_str);
 
@@ -762,17 +775,19 @@ out:
  * Parameters: value_type - [IN] the item type                                *
  *             value      - [IN/OUT] the value to process                     *
  *             params     - [IN] the operation parameters                     *
+ *             regex      - [IN] the precompiled pattern (optional)           *
  *             errmsg     - [OUT] error message                               *
  *                                                                            *
  * Return value: SUCCEED - the preprocessing step finished successfully       *
  *               FAIL - otherwise, errmsg contains the error message          *
  *                                                                            *
  ******************************************************************************/
-int	item_preproc_validate_not_regex(const zbx_variant_t *value, const char *params, char **error)
+int	item_preproc_validate_not_regex(const zbx_variant_t *value, const char *params, const zbx_regexp_t *regex,
+		char **error)
 {
 	zbx_variant_t	value_str;
 	int		ret = FAIL;
-	zbx_regexp_t	*regex;
+	zbx_regexp_t	*regex_local = NULL;
 	const char	*errptr = NULL;
 	char		*errmsg;
 
@@ -784,11 +799,16 @@ int	item_preproc_validate_not_regex(const zbx_variant_t *value, const char *para
 		goto out;
 	}
 
-	if (FAIL == zbx_regexp_compile(params, &regex, &errptr))
+	if (NULL == regex)
 	{
-		errmsg = zbx_dsprintf(NULL, "invalid regular expression pattern: %s", errptr);
-		zbx_regexp_err_msg_free(errptr);
-		goto out;
+		if (FAIL == zbx_regexp_compile(params, &regex_local, &errptr))
+		{
+			errmsg = zbx_dsprintf(NULL, "invalid regular expression pattern: %s", errptr);
+			zbx_regexp_err_msg_free(errptr);
+			goto out;
+		}
+
+		regex = regex_local;
 	}
 
 	if (0 == zbx_regexp_match_precompiled(value_str.data.str, regex))
@@ -798,7 +818,8 @@ int	item_preproc_validate_not_regex(const zbx_variant_t *value, const char *para
 	else
 		ret = SUCCEED;
 
-	zbx_regexp_free(regex);
+	if (NULL != regex_local)
+		zbx_regexp_free(regex_local);
 out:
 	zbx_variant_clear(&value_str);
 
@@ -871,6 +892,7 @@ out:
  *                                                                            *
  * Parameters: value  - [IN/OUT] the value to process                         *
  *             params - [IN] the operation parameters                         *
+ *             xpath  - [IN] the precompiled xpath (optional)                 *
  *             error  - [OUT] the error message                               *
  *                                                                            *
  * Return value: FAIL - preprocessing step error                              *
@@ -882,7 +904,7 @@ out:
  *           error, while returning SUCCEED.                                  *
  *                                                                            *
  ******************************************************************************/
-int	item_preproc_get_error_from_xml(const zbx_variant_t *value, const char *params, char **error)
+int	item_preproc_get_error_from_xml(const zbx_variant_t *value, const char *params, void *xpath, char **error)
 {
 #ifndef HAVE_LIBXML2
 	ZBX_UNUSED(value);
@@ -912,7 +934,12 @@ int	item_preproc_get_error_from_xml(const zbx_variant_t *value, const char *para
 
 	xpathCtx = xmlXPathNewContext(doc);
 
-	if (NULL == (xpathObj = xmlXPathEvalExpression((const xmlChar *)params, xpathCtx)))
+	if (NULL != xpath)
+		xpathObj = xmlXPathCompiledEval((xmlXPathCompExprPtr)xpath, xpathCtx);
+	else
+		xpathObj = xmlXPathEvalExpression((const xmlChar *)params, xpathCtx);
+
+	if (NULL == xpathObj)
 	{
 		pErr = xmlGetLastError();
 		*error = zbx_dsprintf(*error, "cannot parse xpath \"%s\": %s", params, pErr->message);
@@ -973,6 +1000,7 @@ out:
  *                                                                            *
  * Parameters: value  - [IN/OUT] the value to process                         *
  *             params - [IN] the operation parameters                         *
+ *             regex  - [IN] the precompiled pattern (optional)               *
  *             error  - [OUT] the error message                               *
  *                                                                            *
  * Return value: FAIL - preprocessing step error                              *
@@ -984,7 +1012,8 @@ out:
  *           error, while returning SUCCEED.                                  *
  *                                                                            *
  ******************************************************************************/
-int	item_preproc_get_error_from_regex(const zbx_variant_t *value, const char *params, char **error)
+int	item_preproc_get_error_from_regex(const zbx_variant_t *value, const char *params, const zbx_regexp_t *regex,
+		char **error)
 {
 	zbx_variant_t	value_str;
 	int		ret;
@@ -1009,7 +1038,12 @@ int	item_preproc_get_error_from_regex(const zbx_variant_t *value, const char *pa
 
 	*output++ = '\0';
 
-	if (FAIL == zbx_mregexp_sub(value_str.data.str, pattern, output, error))
+	if (NULL != regex)
+	{
+		/* not matching precompiled expression leaves error empty */
+		(void)zbx_mregexp_sub_precompiled(value_str.data.str, regex, output, 0, error);
+	}
+	else if (FAIL == zbx_mregexp_sub(value_str.data.str, pattern, output, error))
 	{
 		*error = zbx_dsprintf(*error, "invalid regular expression \"%s\"", pattern);
 		ret = FAIL;
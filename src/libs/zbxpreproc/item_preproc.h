@@ -23,6 +23,7 @@
 #include "zbxcacheconfig.h"
 #include "preproc.h"
 #include "zbxembed.h"
+#include "zbxregexp.h"
 
 #define ZBX_PREPROC_MAX_PACKET_SIZE	(ZBX_MEBIBYTE * 128)
 
@@ -37,15 +38,18 @@ int	item_preproc_multiplier_variant(unsigned char value_type, zbx_variant_t *val
 int	item_preproc_trim(zbx_variant_t *value, int op_type, const char *params, char **errmsg);
 int	item_preproc_delta(unsigned char value_type, zbx_variant_t *value, const zbx_timespec_t *ts,
 		int op_type, zbx_variant_t *history_value, zbx_timespec_t *history_ts, char **errmsg);
-int	item_preproc_regsub_op(zbx_variant_t *value, const char *params, char **errmsg);
+int	item_preproc_regsub_op(zbx_variant_t *value, const char *params, const zbx_regexp_t *regex, char **errmsg);
 int	item_preproc_2dec(zbx_variant_t *value, int op_type, char **errmsg);
 int	item_preproc_validate_range(unsigned char value_type, const zbx_variant_t *value, const char *params,
 		char **errmsg);
-int	item_preproc_validate_regex(const zbx_variant_t *value, const char *params, char **error);
-int	item_preproc_validate_not_regex(const zbx_variant_t *value, const char *params, char **error);
+int	item_preproc_validate_regex(const zbx_variant_t *value, const char *params, const zbx_regexp_t *regex,
+		char **error);
+int	item_preproc_validate_not_regex(const zbx_variant_t *value, const char *params, const zbx_regexp_t *regex,
+		char **error);
 int	item_preproc_get_error_from_json(const zbx_variant_t *value, const char *params, char **error);
-int	item_preproc_get_error_from_xml(const zbx_variant_t *value, const char *params, char **error);
-int	item_preproc_get_error_from_regex(const zbx_variant_t *value, const char *params, char **error);
+int	item_preproc_get_error_from_xml(const zbx_variant_t *value, const char *params, void *xpath, char **error);
+int	item_preproc_get_error_from_regex(const zbx_variant_t *value, const char *params, const zbx_regexp_t *regex,
+		char **error);
 int	item_preproc_throttle_value(zbx_variant_t *value, const zbx_timespec_t *ts,
 		zbx_variant_t *history_value, zbx_timespec_t *history_ts);
 int	item_preproc_throttle_timed_value(zbx_variant_t *value, const zbx_timespec_t *ts, const char *params,
@@ -24,26 +24,43 @@
 #include "zbxprometheus.h"
 #include "preproc_snmp.h"
 
+static int	pp_cache_is_supported_type(int step_type)
+{
+	switch (step_type)
+	{
+		case ZBX_PREPROC_JSONPATH:
+		case ZBX_PREPROC_PROMETHEUS_PATTERN:
+		case ZBX_PREPROC_SNMP_WALK_TO_VALUE:
+			return SUCCEED;
+	}
+
+	return FAIL;
+}
+
 /******************************************************************************
  *                                                                            *
- * Purpose: create preprocessing cache                                        *
+ * Purpose: create preprocessing cache for the master item dependent items    *
  *                                                                            *
- * Parameters: preproc  - [IN] the preprocessing data                         *
+ * Parameters: preproc  - [IN] the master item preprocessing data             *
  *             value    - [IN/OUT] the input value - it will copied to cache  *
  *                                 and cleared                                *
  *                                                                            *
  * Return value: The created preprocessing cache                              *
  *                                                                            *
  ******************************************************************************/
-zbx_pp_cache_t	*pp_cache_create(const zbx_pp_item_preproc_t *preproc, const zbx_variant_t *value)
+zbx_pp_cache_t	*pp_cache_create(zbx_pp_item_preproc_t *preproc, const zbx_variant_t *value)
 {
 	zbx_pp_cache_t	*cache = (zbx_pp_cache_t *)zbx_malloc(NULL, sizeof(zbx_pp_cache_t));
 
-	cache->type = (0 != preproc->steps_num ? preproc->steps[0].type : ZBX_PREPROC_NONE);
+	cache->type = PP_CACHE_TYPE_ANY;
 	zbx_variant_copy(&cache->value, value);
 	cache->data = NULL;
 	cache->refcount = 1;
 
+	cache->preproc = pp_item_preproc_copy(preproc);
+	cache->jsonpath_values = NULL;
+	cache->jsonpath_values_num = 0;
+
 	return cache;
 }
 
@@ -56,8 +73,16 @@ zbx_pp_cache_t	*pp_cache_create(const zbx_pp_item_preproc_t *preproc, const zbx_
  ******************************************************************************/
 static void	pp_cache_free(zbx_pp_cache_t *cache)
 {
+	int	i;
+
 	zbx_variant_clear(&cache->value);
 
+	for (i = 0; i < cache->jsonpath_values_num; i++)
+		zbx_free(cache->jsonpath_values[i]);
+
+	zbx_free(cache->jsonpath_values);
+	zbx_pp_item_preproc_release(cache->preproc);
+
 	if (NULL != cache->data)
 	{
 		switch (cache->type)
@@ -128,6 +153,9 @@ zbx_pp_cache_t	*pp_cache_copy(zbx_pp_cache_t *cache)
  ******************************************************************************/
 void	pp_cache_prepare_output_value(zbx_pp_cache_t *cache, int step_type, zbx_variant_t *value)
 {
+	if (PP_CACHE_TYPE_ANY == cache->type && SUCCEED == pp_cache_is_supported_type(step_type))
+		cache->type = step_type;
+
 	if (NULL == cache->data || step_type != cache->type)
 		zbx_variant_copy(value, &cache->value);
 }
@@ -146,15 +174,53 @@ void	pp_cache_prepare_output_value(zbx_pp_cache_t *cache, int step_type, zbx_var
 int	pp_cache_is_supported(zbx_pp_item_preproc_t *preproc)
 {
 	if (0 < preproc->steps_num)
+		return pp_cache_is_supported_type(preproc->steps[0].type);
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: query the cached json object by the jsonpath, extracting values   *
+ *          of all the dependent items jsonpaths at once                      *
+ *                                                                            *
+ * Parameters: cache  - [IN] the preprocessing cache                          *
+ *             obj    - [IN] the cached json object                           *
+ *             path   - [IN] the jsonpath                                     *
+ *             output - [OUT] the output value, NULL if the path matches      *
+ *                            nothing                                         *
+ *                                                                            *
+ * Return value: SUCCEED - the value was taken from the extracted values      *
+ *               FAIL    - the path has to be queried separately              *
+ *                                                                            *
+ * Comments: The paths are collected in the master item preprocessing data   *
+ *           as the dependent items are processed, a new path is extracted    *
+ *           together with the others starting from the next master value.   *
+ *                                                                            *
+ ******************************************************************************/
+int	pp_cache_query_jsonpath(zbx_pp_cache_t *cache, zbx_jsonobj_t *obj, const char *path, char **output)
+{
+	int	slot;
+
+	if (NULL == cache->preproc->dep_jsonpaths)
+		cache->preproc->dep_jsonpaths = zbx_jsonpath_set_create();
+
+	if (FAIL == (slot = zbx_jsonpath_set_add(cache->preproc->dep_jsonpaths, path)))
+		return FAIL;
+
+	if (NULL == cache->jsonpath_values)
 	{
-		switch (preproc->steps[0].type)
-		{
-			case ZBX_PREPROC_JSONPATH:
-			case ZBX_PREPROC_PROMETHEUS_PATTERN:
-			case ZBX_PREPROC_SNMP_WALK_TO_VALUE:
-				return SUCCEED;
-		}
+		if (0 == (cache->jsonpath_values_num = zbx_jsonpath_set_slots_num(cache->preproc->dep_jsonpaths)))
+			return FAIL;
+
+		cache->jsonpath_values = (char **)zbx_calloc(NULL, (size_t)cache->jsonpath_values_num, sizeof(char *));
+		zbx_jsonobj_query_set(obj, cache->preproc->dep_jsonpaths, cache->jsonpath_values);
 	}
 
-	return FAIL;
+	if (slot >= cache->jsonpath_values_num)
+		return FAIL;
+
+	*output = (NULL != cache->jsonpath_values[slot] ? zbx_strdup(NULL, cache->jsonpath_values[slot]) : NULL);
+
+	return SUCCEED;
 }
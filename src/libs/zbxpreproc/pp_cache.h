@@ -22,6 +22,10 @@
 
 #include "pp_item.h"
 #include "zbxvariant.h"
+#include "zbxjson.h"
+
+/* the cache type is set by the first dependent item step which can use the cache */
+#define PP_CACHE_TYPE_ANY	-1
 
 typedef struct
 {
@@ -31,14 +35,20 @@ typedef struct
 
 	int		type;
 	void		*data;
+
+	zbx_pp_item_preproc_t	*preproc;		/* the master item preprocessing data */
+	char			**jsonpath_values;	/* the values of the master jsonpath set */
+	int			jsonpath_values_num;
 }
 zbx_pp_cache_t;
 
-zbx_pp_cache_t	*pp_cache_create(const zbx_pp_item_preproc_t *preproc, const zbx_variant_t *value);
+zbx_pp_cache_t	*pp_cache_create(zbx_pp_item_preproc_t *preproc, const zbx_variant_t *value);
 void	pp_cache_release(zbx_pp_cache_t *cache);
 zbx_pp_cache_t	*pp_cache_copy(zbx_pp_cache_t *cache);
 
 void	pp_cache_prepare_output_value(zbx_pp_cache_t *cache, int step_type, zbx_variant_t *value);
 int	pp_cache_is_supported(zbx_pp_item_preproc_t *preproc);
 
+int	pp_cache_query_jsonpath(zbx_pp_cache_t *cache, zbx_jsonobj_t *obj, const char *path, char **output);
+
 #endif
@@ -19,6 +19,7 @@
 
 #include "pp_execute.h"
 #include "pp_cache.h"
+#include "pp_step_cache.h"
 #include "pp_error.h"
 #include "log.h"
 #include "item_preproc.h"
@@ -196,19 +197,20 @@ static int	pp_execute_delta(int type, unsigned char value_type, zbx_variant_t *v
  *                                                                            *
  * Purpose: execute 'regsub' step                                             *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the input/output value                       *
- *             params - [IN] the preprocessing parameters                     *
+ * Parameters: step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the input/output value                   *
+ *             params     - [IN] the preprocessing parameters                 *
  *                                                                            *
  * Result value: SUCCEED - the preprocessing step was executed successfully.  *
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-static int	pp_execute_regsub(zbx_variant_t *value, const char *params)
+static int	pp_execute_regsub(const zbx_pp_step_cache_t *step_cache, zbx_variant_t *value, const char *params)
 {
 	char	*errmsg = NULL, *ptr;
 	int	len;
 
-	if (SUCCEED == item_preproc_regsub_op(value, params, &errmsg))
+	if (SUCCEED == item_preproc_regsub_op(value, params, step_cache->regexp, &errmsg))
 		return SUCCEED;
 
 	if (NULL == (ptr = strchr(params, '\n')))
@@ -226,20 +228,36 @@ static int	pp_execute_regsub(zbx_variant_t *value, const char *params)
 	return FAIL;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: query json object with compiled jsonpath if available             *
+ *                                                                            *
+ ******************************************************************************/
+static int	pp_jsonobj_query(zbx_jsonobj_t *obj, const zbx_pp_step_cache_t *step_cache, const char *params,
+		char **output)
+{
+	if (NULL != step_cache->jsonpath)
+		return zbx_jsonobj_query_compiled(obj, step_cache->jsonpath, output);
+
+	return zbx_jsonobj_query(obj, params, output);
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: execute jsonpath query                                            *
  *                                                                            *
- * Parameters: cache  - [IN] the preprocessing cache                          *
- *             value  - [IN/OUT] the value to process                         *
- *             params - [IN] the step parameters                              *
- *             errmsg - [OUT] error message                                   *
+ * Parameters: cache      - [IN] the preprocessing cache                      *
+ *             step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
+ *             params     - [IN] the step parameters                          *
+ *             errmsg     - [OUT] error message                               *
  *                                                                            *
  * Result value: SUCCEED - the query was executed successfully.               *
  *               FAIL    - otherwise.                                         *
  *                                                                            *
  ******************************************************************************/
-static int	pp_excute_jsonpath_query(zbx_pp_cache_t *cache, zbx_variant_t *value, const char *params, char **errmsg)
+static int	pp_excute_jsonpath_query(zbx_pp_cache_t *cache, const zbx_pp_step_cache_t *step_cache,
+		zbx_variant_t *value, const char *params, char **errmsg)
 {
 	char	*data = NULL;
 
@@ -256,7 +274,7 @@ static int	pp_excute_jsonpath_query(zbx_pp_cache_t *cache, zbx_variant_t *value,
 			return FAIL;
 		}
 
-		if (FAIL == zbx_jsonobj_query(&obj, params, &data))
+		if (FAIL == pp_jsonobj_query(&obj, step_cache, params, &data))
 		{
 			zbx_jsonobj_clear(&obj);
 			*errmsg = zbx_strdup(*errmsg, zbx_json_strerror());
@@ -287,13 +305,17 @@ static int	pp_excute_jsonpath_query(zbx_pp_cache_t *cache, zbx_variant_t *value,
 			cache->data = (void *)obj;
 		}
 
-		if (FAIL == zbx_jsonobj_query(obj, params, &data))
+		/* the definite paths of the dependent items are extracted together */
+		if (SUCCEED != pp_cache_query_jsonpath(cache, obj, params, &data))
 		{
-			*errmsg = zbx_strdup(*errmsg, zbx_json_strerror());
-			return FAIL;
-		}
+			if (FAIL == pp_jsonobj_query(obj, step_cache, params, &data))
+			{
+				*errmsg = zbx_strdup(*errmsg, zbx_json_strerror());
+				return FAIL;
+			}
 
-		zbx_jsonobj_disable_indexing(obj);
+			zbx_jsonobj_disable_indexing(obj);
+		}
 	}
 
 	if (NULL == data)
@@ -312,19 +334,21 @@ static int	pp_excute_jsonpath_query(zbx_pp_cache_t *cache, zbx_variant_t *value,
  *                                                                            *
  * Purpose: execute 'jsonpath' step                                           *
  *                                                                            *
- * Parameters: cache  - [IN] the preprocessing cache                          *
- *             value  - [IN/OUT] the value to process                         *
- *             params - [IN] the step parameters                              *
+ * Parameters: cache      - [IN] the preprocessing cache                      *
+ *             step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
+ *             params     - [IN] the step parameters                          *
  *                                                                            *
  * Result value: SUCCEED - the preprocessing step was executed successfully.  *
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-static int	pp_execute_jsonpath(zbx_pp_cache_t *cache, zbx_variant_t *value, const char *params)
+static int	pp_execute_jsonpath(zbx_pp_cache_t *cache, const zbx_pp_step_cache_t *step_cache, zbx_variant_t *value,
+		const char *params)
 {
 	char	*errmsg = NULL;
 
-	if (SUCCEED == pp_excute_jsonpath_query(cache, value, params, &errmsg))
+	if (SUCCEED == pp_excute_jsonpath_query(cache, step_cache, value, params, &errmsg))
 		return SUCCEED;
 
 	zbx_variant_clear(value);
@@ -390,22 +414,30 @@ static int	pp_execute_2dec(int type, zbx_variant_t *value)
  *                                                                            *
  * Purpose: execute xpath query                                               *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the step parameters                              *
- *             error  - [OUT] the error message                               *
+ * Parameters: step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
+ *             params     - [IN] the step parameters                          *
+ *             error      - [OUT] the error message                           *
  *                                                                            *
  * Result value: SUCCEED - the query was executed successfully.               *
  *               FAIL    - otherwise.                                         *
  *                                                                            *
  ******************************************************************************/
-static int	pp_execute_xpath_query(zbx_variant_t *value, const char *params, char **error)
+static int	pp_execute_xpath_query(const zbx_pp_step_cache_t *step_cache, zbx_variant_t *value, const char *params,
+		char **error)
 {
 	char	*errmsg = NULL;
+	int	ret;
 
 	if (FAIL == item_preproc_convert_value(value, ZBX_VARIANT_STR, error))
 		return FAIL;
 
-	if (SUCCEED == zbx_query_xpath(value, params, &errmsg))
+	if (NULL != step_cache->xpath)
+		ret = zbx_query_xpath_compiled(value, step_cache->xpath, &errmsg);
+	else
+		ret = zbx_query_xpath(value, params, &errmsg);
+
+	if (SUCCEED == ret)
 		return SUCCEED;
 
 	*error = zbx_dsprintf(NULL, "cannot extract XML value with xpath \"%s\": %s", params, errmsg);
@@ -418,18 +450,19 @@ static int	pp_execute_xpath_query(zbx_variant_t *value, const char *params, char
  *                                                                            *
  * Purpose: execute 'xpath' step                                              *
  *                                                                            *
- * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the step parameters                              *
+ * Parameters: step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
+ *             params     - [IN] the step parameters                          *
  *                                                                            *
  * Result value: SUCCEED - the preprocessing step was executed successfully.  *
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-static int	pp_execute_xpath(zbx_variant_t *value, const char *params)
+static int	pp_execute_xpath(const zbx_pp_step_cache_t *step_cache, zbx_variant_t *value, const char *params)
 {
 	char	*errmsg = NULL;
 
-	if (SUCCEED == pp_execute_xpath_query(value, params, &errmsg))
+	if (SUCCEED == pp_execute_xpath_query(step_cache, value, params, &errmsg))
 		return SUCCEED;
 
 	zbx_variant_clear(value);
@@ -467,18 +500,19 @@ static int	pp_validate_range(unsigned char value_type, zbx_variant_t *value, con
  *                                                                            *
  * Purpose: execute 'validate regex' step                                     *
  *                                                                            *
- * Parameters: value      - [IN/OUT] the value to process                     *
+ * Parameters: step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
  *             params     - [IN] the step parameters                          *
  *                                                                            *
  * Result value: SUCCEED - the preprocessing step was executed successfully.  *
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-static int	pp_validate_regex(zbx_variant_t *value, const char *params)
+static int	pp_validate_regex(const zbx_pp_step_cache_t *step_cache, zbx_variant_t *value, const char *params)
 {
 	char	*errmsg = NULL;
 
-	if (SUCCEED == item_preproc_validate_regex(value, params, &errmsg))
+	if (SUCCEED == item_preproc_validate_regex(value, params, step_cache->regexp, &errmsg))
 		return SUCCEED;
 
 	zbx_variant_clear(value);
@@ -491,18 +525,19 @@ static int	pp_validate_regex(zbx_variant_t *value, const char *params)
  *                                                                            *
  * Purpose: execute 'validate not regex' step                                 *
  *                                                                            *
- * Parameters: value      - [IN/OUT] the value to process                     *
+ * Parameters: step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
  *             params     - [IN] the step parameters                          *
  *                                                                            *
  * Result value: SUCCEED - the preprocessing step was executed successfully.  *
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-static int	pp_validate_not_regex(zbx_variant_t *value, const char *params)
+static int	pp_validate_not_regex(const zbx_pp_step_cache_t *step_cache, zbx_variant_t *value, const char *params)
 {
 	char	*errmsg = NULL;
 
-	if (SUCCEED == item_preproc_validate_not_regex(value, params, &errmsg))
+	if (SUCCEED == item_preproc_validate_not_regex(value, params, step_cache->regexp, &errmsg))
 		return SUCCEED;
 
 	zbx_variant_clear(value);
@@ -543,19 +578,20 @@ static int	pp_error_from_json(zbx_variant_t *value, const char *params)
  *                                                                            *
  * Purpose: execute 'error from xml' step                                     *
  *                                                                            *
- * Parameters: value      - [IN/OUT] the value to process                     *
+ * Parameters: step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
  *             params     - [IN] the step parameters                          *
  *                                                                            *
  * Result value: SUCCEED - the preprocessing step was executed successfully.  *
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-static int	pp_error_from_xml(zbx_variant_t *value, const char *params)
+static int	pp_error_from_xml(const zbx_pp_step_cache_t *step_cache, zbx_variant_t *value, const char *params)
 {
 	char	*errmsg = NULL;
 	int	ret;
 
-	ret = item_preproc_get_error_from_xml(value, params, &errmsg);
+	ret = item_preproc_get_error_from_xml(value, params, step_cache->xpath, &errmsg);
 
 	if (NULL != errmsg)
 	{
@@ -571,19 +607,20 @@ static int	pp_error_from_xml(zbx_variant_t *value, const char *params)
  *                                                                            *
  * Purpose: execute 'error from regex' step                                   *
  *                                                                            *
- * Parameters: value      - [IN/OUT] the value to process                     *
+ * Parameters: step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
  *             params     - [IN] the step parameters                          *
  *                                                                            *
  * Result value: SUCCEED - the preprocessing step was executed successfully.  *
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-static int	pp_error_from_regex(zbx_variant_t *value, const char *params)
+static int	pp_error_from_regex(const zbx_pp_step_cache_t *step_cache, zbx_variant_t *value, const char *params)
 {
 	char	*errmsg = NULL;
 	int	ret;
 
-	ret = item_preproc_get_error_from_regex(value, params, &errmsg);
+	ret = item_preproc_get_error_from_regex(value, params, step_cache->regexp, &errmsg);
 
 	if (NULL != errmsg)
 	{
@@ -653,43 +690,61 @@ static int	pp_execute_script(zbx_pp_context_t *ctx, zbx_variant_t *value, const
  *                                                                            *
  * Purpose: execute prometheus pattern query                                  *
  *                                                                            *
- * Parameters: cache  - [IN] the preprocessing cache                          *
- *             value  - [IN/OUT] the value to process                         *
- *             params - [IN] the step parameters                              *
- *             errmsg - [OUT] error message                                   *
+ * Parameters: cache      - [IN] the preprocessing cache                      *
+ *             step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
+ *             params     - [IN] the step parameters                          *
+ *             errmsg     - [OUT] error message                               *
  *                                                                            *
  * Return value: SUCCEED - the query was performed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-static int	pp_execute_prometheus_query(zbx_pp_cache_t *cache, zbx_variant_t *value, const char *params,
-		char **errmsg)
+static int	pp_execute_prometheus_query(zbx_pp_cache_t *cache, const zbx_pp_step_cache_t *step_cache,
+		zbx_variant_t *value, const char *params, char **errmsg)
 {
-	char	*pattern, *request, *output, *value_out = NULL, *err = NULL;
-	int	ret = FAIL;
-
-	pattern = zbx_strdup(NULL, params);
+	char		*pattern = NULL, *ptr, *value_out = NULL, *err = NULL;
+	const char	*request, *output;
+	int		ret = FAIL;
 
-	if (NULL == (request = strchr(pattern, '\n')))
+	if (NULL == step_cache->filter)
 	{
-		*errmsg = zbx_strdup(*errmsg, "cannot find second parameter");
-		goto out;
-	}
-	*request++ = '\0';
+		pattern = zbx_strdup(NULL, params);
 
-	if (NULL == (output = strchr(request, '\n')))
+		if (NULL == (ptr = strchr(pattern, '\n')))
+		{
+			*errmsg = zbx_strdup(*errmsg, "cannot find second parameter");
+			goto out;
+		}
+		*ptr++ = '\0';
+		request = ptr;
+
+		if (NULL == (ptr = strchr(request, '\n')))
+		{
+			*errmsg = zbx_strdup(*errmsg, "cannot find third parameter");
+			goto out;
+		}
+		*ptr++ = '\0';
+		output = ptr;
+	}
+	else
 	{
-		*errmsg = zbx_strdup(*errmsg, "cannot find third parameter");
-		goto out;
+		request = step_cache->request;
+		output = step_cache->output;
 	}
-	*output++ = '\0';
 
 	if (NULL == cache || ZBX_PREPROC_PROMETHEUS_PATTERN != cache->type)
 	{
 		if (FAIL == item_preproc_convert_value(value, ZBX_VARIANT_STR, errmsg))
 			goto out;
 
-		ret = zbx_prometheus_pattern(value->data.str, pattern, request, output, &value_out, &err);
+		if (NULL != step_cache->filter)
+		{
+			ret = zbx_prometheus_pattern_compiled(value->data.str, step_cache->filter, request, output,
+					&value_out, &err);
+		}
+		else
+			ret = zbx_prometheus_pattern(value->data.str, pattern, request, output, &value_out, &err);
 	}
 	else
 	{
@@ -712,7 +767,13 @@ static int	pp_execute_prometheus_query(zbx_pp_cache_t *cache, zbx_variant_t *val
 			cache->data = (void *)prom_cache;
 		}
 
-		ret = zbx_prometheus_pattern_ex(prom_cache, pattern, request, output, &value_out, &err);
+		if (NULL != step_cache->filter)
+		{
+			ret = zbx_prometheus_pattern_ex_compiled(prom_cache, step_cache->filter, request, output,
+					&value_out, &err);
+		}
+		else
+			ret = zbx_prometheus_pattern_ex(prom_cache, pattern, request, output, &value_out, &err);
 	}
 out:
 	zbx_free(pattern);
@@ -736,19 +797,21 @@ out:
  *                                                                            *
  * Purpose: execute 'prometheus pattern' step                                 *
  *                                                                            *
- * Parameters: cache  - [IN] the preprocessing cache                          *
- *             value  - [IN/OUT] the value to process                         *
- *             params - [IN] the step parameters                              *
+ * Parameters: cache      - [IN] the preprocessing cache                      *
+ *             step_cache - [IN] the compiled step parameters                 *
+ *             value      - [IN/OUT] the value to process                     *
+ *             params     - [IN] the step parameters                          *
  *                                                                            *
  * Result value: SUCCEED - the preprocessing step was executed successfully.  *
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-static int	pp_execute_prometheus_pattern(zbx_pp_cache_t *cache, zbx_variant_t *value, const char *params)
+static int	pp_execute_prometheus_pattern(zbx_pp_cache_t *cache, const zbx_pp_step_cache_t *step_cache,
+		zbx_variant_t *value, const char *params)
 {
 	char	*errmsg = NULL;
 
-	if (SUCCEED == pp_execute_prometheus_query(cache, value, params, &errmsg))
+	if (SUCCEED == pp_execute_prometheus_query(cache, step_cache, value, params, &errmsg))
 		return SUCCEED;
 
 	zbx_variant_clear(value);
@@ -908,6 +971,8 @@ static int	pp_execute_snmp_to_json(zbx_variant_t *value, const char *params)
  *                                                                            *
  * Parameters: ctx           - [IN] the worker specific execution context     *
  *             cache         - [IN] the preprocessing cache                   *
+ *             step_cache    - [IN/OUT] the compiled step parameters,         *
+ *                                      optional                              *
  *             value_type    - [IN] the item value type                       *
  *             value         - [IN/OUT] the input/output value                *
  *             ts            - [IN] the value timestamp                       *
@@ -919,11 +984,18 @@ static int	pp_execute_snmp_to_json(zbx_variant_t *value, const char *params)
  *               FAIL    - otherwise. The error message is stored in value.   *
  *                                                                            *
  ******************************************************************************/
-int	pp_execute_step(zbx_pp_context_t *ctx, const metric_t *metric_in, zbx_pp_cache_t *cache, unsigned char value_type,
-		zbx_variant_t *value, zbx_pp_step_t *step, zbx_variant_t *history_value,
-		zbx_timespec_t *history_ts)
+int	pp_execute_step(zbx_pp_context_t *ctx, const metric_t *metric_in, zbx_pp_cache_t *cache,
+		zbx_pp_step_cache_t *step_cache, unsigned char value_type, zbx_variant_t *value, zbx_pp_step_t *step,
+		zbx_variant_t *history_value, zbx_timespec_t *history_ts)
 {
-	int	ret;
+	int			ret;
+	zbx_pp_step_cache_t	step_cache_local = {0};
+
+	/* without cache the parameters are compiled by each step execution */
+	if (NULL == step_cache)
+		step_cache = &step_cache_local;
+	else
+		pp_step_cache_compile(step_cache, step);
 
 	DEBUG_ITEM( metric_in->itemid, "Processing step:%d params:'%s' value:'%s' cache:%p", 
 		step->type, ZBX_NULL2EMPTY_STR(step->params), zbx_variant_value_desc(value), (void *)cache);
@@ -939,7 +1011,7 @@ int	pp_execute_step(zbx_pp_context_t *ctx, const metric_t *metric_in, zbx_pp_cac
 			ret = pp_execute_trim(step->type, value, step->params);
 			goto out;
 		case ZBX_PREPROC_REGSUB:
-			ret = pp_execute_regsub(value, step->params);
+			ret = pp_execute_regsub(step_cache, value, step->params);
 			goto out;
 		case ZBX_PREPROC_BOOL2DEC:
 		case ZBX_PREPROC_OCT2DEC:
@@ -951,19 +1023,19 @@ int	pp_execute_step(zbx_pp_context_t *ctx, const metric_t *metric_in, zbx_pp_cac
 			ret = pp_execute_delta(step->type, value_type, value, metric_in->ts, history_value, history_ts);
 			goto out;
 		case ZBX_PREPROC_XPATH:
-			ret = pp_execute_xpath(value, step->params);
+			ret = pp_execute_xpath(step_cache, value, step->params);
 			goto out;
 		case ZBX_PREPROC_JSONPATH:
-			ret = pp_execute_jsonpath(cache, value, step->params);
+			ret = pp_execute_jsonpath(cache, step_cache, value, step->params);
 			goto out;
 		case ZBX_PREPROC_VALIDATE_RANGE:
 			ret = pp_validate_range(value_type, value, step->params);
 			goto out;
 		case ZBX_PREPROC_VALIDATE_REGEX:
-			ret = pp_validate_regex(value, step->params);
+			ret = pp_validate_regex(step_cache, value, step->params);
 			goto out;
 		case ZBX_PREPROC_VALIDATE_NOT_REGEX:
-			ret = pp_validate_not_regex(value, step->params);
+			ret = pp_validate_not_regex(step_cache, value, step->params);
 			goto out;
 		case ZBX_PREPROC_VALIDATE_NOT_SUPPORTED:
 			ret = pp_check_not_error(value);
@@ -972,10 +1044,10 @@ int	pp_execute_step(zbx_pp_context_t *ctx, const metric_t *metric_in, zbx_pp_cac
 			ret = pp_error_from_json(value, step->params);
 			goto out;
 		case ZBX_PREPROC_ERROR_FIELD_XML:
-			ret = pp_error_from_xml(value, step->params);
+			ret = pp_error_from_xml(step_cache, value, step->params);
 			goto out;
 		case ZBX_PREPROC_ERROR_FIELD_REGEX:
-			ret = pp_error_from_regex(value, step->params);
+			ret = pp_error_from_regex(step_cache, value, step->params);
 			goto out;
 		case ZBX_PREPROC_THROTTLE_VALUE:
 			ret = item_preproc_throttle_value(value, &metric_in->ts, history_value, history_ts);
@@ -987,7 +1059,7 @@ int	pp_execute_step(zbx_pp_context_t *ctx, const metric_t *metric_in, zbx_pp_cac
 			ret = pp_execute_script(ctx, value, step->params, history_value);
 			goto out;
 		case ZBX_PREPROC_PROMETHEUS_PATTERN:
-			ret = pp_execute_prometheus_pattern(cache, value, step->params);
+			ret = pp_execute_prometheus_pattern(cache, step_cache, value, step->params);
 			goto out;
 		case ZBX_PREPROC_PROMETHEUS_TO_JSON:
 			ret = pp_execute_prometheus_to_json(value, step->params);
@@ -1079,7 +1151,8 @@ void	pp_execute(zbx_pp_context_t *ctx, zbx_pp_item_preproc_t *preproc, zbx_pp_ca
 	{
 		/* preprocessing cache is enabled only for the first step, */
 		/* so prepare output value based on first step type        */
-		pp_cache_prepare_output_value(cache, preproc->steps[0].type, value_out);
+		pp_cache_prepare_output_value(cache, 0 != preproc->steps_num ? preproc->steps[0].type :
+				ZBX_PREPROC_NONE, value_out);
 
 		/* set input value for error reporting */
 		//value_in = &cache->value;
@@ -1106,8 +1179,9 @@ void	pp_execute(zbx_pp_context_t *ctx, zbx_pp_item_preproc_t *preproc, zbx_pp_ca
 
 		pp_history_pop(preproc->history, i, &history_value, &history_ts);
 
-		if (SUCCEED != pp_execute_step(ctx, metric_in, cache, preproc->value_type, value_out, preproc->steps + i,
-				&history_value, &history_ts))
+		if (SUCCEED != pp_execute_step(ctx, metric_in, cache,
+				NULL != preproc->steps_cache ? preproc->steps_cache + i : NULL, preproc->value_type,
+				value_out, preproc->steps + i, &history_value, &history_ts))
 		{
 			zbx_variant_copy(&value_raw, value_out);
 			if (ZBX_PREPROC_FAIL_DEFAULT == (action = pp_error_on_fail(value_out, preproc->steps + i)))
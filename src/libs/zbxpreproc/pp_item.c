@@ -19,7 +19,9 @@
 
 #include "pp_item.h"
 #include "pp_history.h"
+#include "pp_step_cache.h"
 #include "zbxvariant.h"
+#include "zbxjson.h"
 
 ZBX_PTR_VECTOR_IMPL(pp_step_ptr, zbx_pp_step_t *)
 
@@ -50,6 +52,8 @@ zbx_pp_item_preproc_t	*zbx_pp_item_preproc_create(unsigned char type, unsigned c
 
 	preproc->history = NULL;
 	preproc->history_num = 0;
+	preproc->steps_cache = NULL;
+	preproc->dep_jsonpaths = NULL;
 
 	preproc->mode = ZBX_PP_PROCESS_PARALLEL;
 
@@ -86,9 +90,53 @@ static void	pp_item_preproc_free(zbx_pp_item_preproc_t *preproc)
 	if (NULL != preproc->history)
 		pp_history_free(preproc->history);
 
+	if (NULL != preproc->steps_cache)
+		pp_step_cache_free(preproc->steps_cache, preproc->steps_num);
+
+	if (NULL != preproc->dep_jsonpaths)
+		zbx_jsonpath_set_free(preproc->dep_jsonpaths);
+
 	zbx_free(preproc);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: enable compiled step parameter cache for item preprocessing data  *
+ *                                                                            *
+ * Parameters: preproc - [IN] the item preprocessing data                     *
+ *                                                                            *
+ * Comments: The cache lives as long as the preprocessing data, so it's       *
+ *           dropped together with it when the item steps are changed.        *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_pp_item_preproc_cache_steps(zbx_pp_item_preproc_t *preproc)
+{
+	if (NULL != preproc->steps_cache || 0 == preproc->steps_num)
+		return;
+
+	preproc->steps_cache = pp_step_cache_create(preproc->steps_num);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: drop the jsonpaths collected from the dependent items             *
+ *                                                                            *
+ * Parameters: preproc - [IN] the master item preprocessing data              *
+ *                                                                            *
+ * Comments: The paths are only added as the dependent items are processed,   *
+ *           so the set is dropped when their steps are changed and built     *
+ *           again from the next master values.                               *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_pp_item_preproc_clear_dep_jsonpaths(zbx_pp_item_preproc_t *preproc)
+{
+	if (NULL == preproc->dep_jsonpaths)
+		return;
+
+	zbx_jsonpath_set_free(preproc->dep_jsonpaths);
+	preproc->dep_jsonpaths = NULL;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: copy item preprocessing data                                      *
@@ -0,0 +1,213 @@
+/*
+** Glaber
+** Copyright (C) 2001-2100 Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "zbxcommon.h"
+#include "pp_step_cache.h"
+#include "zbxxml.h"
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: create compiled step parameter cache for item preprocessing       *
+ *                                                                            *
+ * Parameters: steps_num - [IN] the number of preprocessing steps             *
+ *                                                                            *
+ * Return value: The created cache, the steps are compiled on first use.      *
+ *                                                                            *
+ ******************************************************************************/
+zbx_pp_step_cache_t	*pp_step_cache_create(int steps_num)
+{
+	zbx_pp_step_cache_t	*cache;
+
+	cache = (zbx_pp_step_cache_t *)zbx_malloc(NULL, sizeof(zbx_pp_step_cache_t) * (size_t)steps_num);
+	memset(cache, 0, sizeof(zbx_pp_step_cache_t) * (size_t)steps_num);
+
+	return cache;
+}
+
+static void	pp_step_cache_clear(zbx_pp_step_cache_t *step_cache)
+{
+	if (NULL != step_cache->regexp)
+		zbx_regexp_free(step_cache->regexp);
+
+	if (NULL != step_cache->jsonpath)
+	{
+		zbx_jsonpath_clear(step_cache->jsonpath);
+		zbx_free(step_cache->jsonpath);
+	}
+
+	if (NULL != step_cache->xpath)
+		zbx_xpath_free(step_cache->xpath);
+
+	if (NULL != step_cache->filter)
+		zbx_prometheus_filter_free(step_cache->filter);
+
+	zbx_free(step_cache->params);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: free compiled step parameter cache                                *
+ *                                                                            *
+ * Parameters: cache     - [IN] the cache                                     *
+ *             steps_num - [IN] the number of preprocessing steps             *
+ *                                                                            *
+ ******************************************************************************/
+void	pp_step_cache_free(zbx_pp_step_cache_t *cache, int steps_num)
+{
+	int	i;
+
+	for (i = 0; i < steps_num; i++)
+		pp_step_cache_clear(&cache[i]);
+
+	zbx_free(cache);
+}
+
+static int	pp_step_cache_compile_regexp(zbx_pp_step_cache_t *step_cache, const char *params, int multiline)
+{
+	char		*pattern, *ptr;
+	const char	*err_msg = NULL;
+	int		ret;
+
+	if (0 != multiline)
+	{
+		ret = zbx_regexp_compile(params, &step_cache->regexp, &err_msg);
+	}
+	else
+	{
+		/* regsub and error from regex steps have pattern and output template parameters */
+		if (NULL == (ptr = strchr(params, '\n')))
+			return FAIL;
+
+		pattern = zbx_strdup(NULL, params);
+		pattern[ptr - params] = '\0';
+		ret = zbx_regexp_compile_ext(pattern, &step_cache->regexp, 0, &err_msg);
+		zbx_free(pattern);
+	}
+
+	if (SUCCEED != ret)
+	{
+		zbx_regexp_err_msg_free(err_msg);
+		step_cache->regexp = NULL;
+		return FAIL;
+	}
+
+	zbx_regexp_jit_compile(step_cache->regexp);
+
+	return SUCCEED;
+}
+
+static int	pp_step_cache_compile_jsonpath(zbx_pp_step_cache_t *step_cache, const char *params)
+{
+	zbx_jsonpath_t	*jsonpath;
+
+	jsonpath = (zbx_jsonpath_t *)zbx_malloc(NULL, sizeof(zbx_jsonpath_t));
+
+	if (SUCCEED != zbx_jsonpath_compile(params, jsonpath))
+	{
+		zbx_free(jsonpath);
+		return FAIL;
+	}
+
+	step_cache->jsonpath = jsonpath;
+
+	return SUCCEED;
+}
+
+static int	pp_step_cache_compile_prometheus(zbx_pp_step_cache_t *step_cache, const char *params)
+{
+	char	*request, *output, *error = NULL;
+
+	step_cache->params = zbx_strdup(NULL, params);
+
+	if (NULL == (request = strchr(step_cache->params, '\n')))
+		goto fail;
+
+	*request++ = '\0';
+
+	if (NULL == (output = strchr(request, '\n')))
+		goto fail;
+
+	*output++ = '\0';
+
+	if (NULL == (step_cache->filter = zbx_prometheus_filter_create(step_cache->params, &error)))
+	{
+		zbx_free(error);
+		goto fail;
+	}
+
+	step_cache->request = request;
+	step_cache->output = output;
+
+	return SUCCEED;
+fail:
+	zbx_free(step_cache->params);
+
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile preprocessing step parameters if not done yet             *
+ *                                                                            *
+ * Parameters: step_cache - [IN/OUT] the step cache                           *
+ *             step       - [IN] the preprocessing step                       *
+ *                                                                            *
+ * Comments: Invalid parameters are not compiled and the step is executed     *
+ *           without cache, reporting the same errors as before.              *
+ *                                                                            *
+ ******************************************************************************/
+void	pp_step_cache_compile(zbx_pp_step_cache_t *step_cache, const zbx_pp_step_t *step)
+{
+	int	ret;
+
+	if (PP_STEP_CACHE_EMPTY != step_cache->state)
+		return;
+
+	if (NULL == step->params)
+	{
+		step_cache->state = PP_STEP_CACHE_FAILED;
+		return;
+	}
+
+	switch (step->type)
+	{
+		case ZBX_PREPROC_VALIDATE_REGEX:
+		case ZBX_PREPROC_VALIDATE_NOT_REGEX:
+			ret = pp_step_cache_compile_regexp(step_cache, step->params, 1);
+			break;
+		case ZBX_PREPROC_REGSUB:
+		case ZBX_PREPROC_ERROR_FIELD_REGEX:
+			ret = pp_step_cache_compile_regexp(step_cache, step->params, 0);
+			break;
+		case ZBX_PREPROC_JSONPATH:
+			ret = pp_step_cache_compile_jsonpath(step_cache, step->params);
+			break;
+		case ZBX_PREPROC_XPATH:
+		case ZBX_PREPROC_ERROR_FIELD_XML:
+			ret = (NULL != (step_cache->xpath = zbx_xpath_compile(step->params)) ? SUCCEED : FAIL);
+			break;
+		case ZBX_PREPROC_PROMETHEUS_PATTERN:
+			ret = pp_step_cache_compile_prometheus(step_cache, step->params);
+			break;
+		default:
+			ret = FAIL;
+	}
+
+	step_cache->state = (SUCCEED == ret ? PP_STEP_CACHE_COMPILED : PP_STEP_CACHE_FAILED);
+}
@@ -0,0 +1,52 @@
+/*
+** Glaber
+** Copyright (C) 2001-2100 Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef ZABBIX_PP_STEP_CACHE_H
+#define ZABBIX_PP_STEP_CACHE_H
+
+#include "zbxpreproc.h"
+#include "zbxregexp.h"
+#include "zbxjson.h"
+#include "zbxprometheus.h"
+
+#define PP_STEP_CACHE_EMPTY	0
+#define PP_STEP_CACHE_COMPILED	1
+#define PP_STEP_CACHE_FAILED	2
+
+/* step parameters compiled once per item preprocessing configuration, */
+/* the fields not used by the step type are NULL                        */
+struct zbx_pp_step_cache
+{
+	unsigned char		state;
+
+	zbx_regexp_t		*regexp;	/* regsub, validate (not) regex, error from regex */
+	zbx_jsonpath_t		*jsonpath;	/* jsonpath */
+	void			*xpath;		/* xpath, error from xml */
+
+	zbx_prometheus_filter_t	*filter;	/* prometheus pattern */
+	char			*params;	/* prometheus parameters split into pattern, request and output */
+	const char		*request;
+	const char		*output;
+};
+
+zbx_pp_step_cache_t	*pp_step_cache_create(int steps_num);
+void	pp_step_cache_free(zbx_pp_step_cache_t *cache, int steps_num);
+void	pp_step_cache_compile(zbx_pp_step_cache_t *cache, const zbx_pp_step_t *step);
+
+#endif
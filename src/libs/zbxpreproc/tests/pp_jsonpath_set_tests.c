@@ -0,0 +1,224 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "zbxstr.h"
+#include "zbxtime.h"
+#include "zbxjson.h"
+#include "zbx_item_constants.h"
+#include "../pp_execute.h"
+#include "../pp_cache.h"
+#include "pp_test_utils.h"
+
+#define BENCH_NODES	50
+#define BENCH_FIELDS	40
+#define BENCH_VALUES	20
+
+static const char *test_json = "{\"a\":{\"b\":{\"c\":\"text\",\"d\":12.5,\"e\":[1,{\"f\":\"x\"},null]}},"
+        "\"arr\":[{\"name\":\"first\"},{\"name\":\"last\"}],\"num\":100,\"t\":true,\"esc\":\"q\\\"uote\"}";
+
+static void test_set_matches_query() {
+    const char *paths[] = {"$.a.b.c", "$.a.b.d", "$.a.b", "$.a.b.e[1].f", "$.a.b.e[-1]", "$.a.b.e[5]", "$.arr[0].name",
+            "$.arr[-1].name", "$['num']", "$.t", "$.esc", "$.missing", "$.num.x", "$.arr.name", "$.a[0]", "$.a.b.c"};
+    const char *unsupported[] = {"$..c", "$.arr[*].name", "$.arr[0,1].name", "$.arr[0:1]", "$.a.b.e.length()",
+            "$.arr[?(@.name == 'last')].name", "$.a.b.e.first()", "$["};
+    zbx_jsonpath_set_t *set = zbx_jsonpath_set_create();
+    zbx_jsonobj_t obj;
+    char **outputs;
+    int i, slots[ARRSIZE(paths)];
+
+    LOG_INF("Testing jsonpath set results");
+
+    for (i = 0; i < ARRSIZE(paths); i++)
+        assert(FAIL != (slots[i] = zbx_jsonpath_set_add(set, paths[i])));
+
+    /* the same path shares the slot */
+    assert(slots[0] == slots[ARRSIZE(paths) - 1]);
+    assert(ARRSIZE(paths) - 1 == zbx_jsonpath_set_slots_num(set));
+
+    for (i = 0; i < ARRSIZE(unsupported); i++)
+        assert(FAIL == zbx_jsonpath_set_add(set, unsupported[i]));
+
+    assert(ARRSIZE(paths) - 1 == zbx_jsonpath_set_slots_num(set));
+    assert(SUCCEED == zbx_jsonobj_open(test_json, &obj));
+
+    outputs = (char **)zbx_calloc(NULL, zbx_jsonpath_set_slots_num(set), sizeof(char *));
+    zbx_jsonobj_query_set(&obj, set, outputs);
+
+    for (i = 0; i < ARRSIZE(paths); i++) {
+        char *output = NULL;
+
+        assert(SUCCEED == zbx_jsonobj_query(&obj, paths[i], &output));
+
+        if (NULL == output)
+            assert(NULL == outputs[slots[i]] && "Set should not match what the query doesn't");
+        else
+            assert(NULL != outputs[slots[i]] && 0 == strcmp(output, outputs[slots[i]]) &&
+                    "Set should return the same value as the query");
+
+        zbx_free(output);
+    }
+
+    for (i = 0; i < zbx_jsonpath_set_slots_num(set); i++)
+        zbx_free(outputs[i]);
+
+    zbx_free(outputs);
+    zbx_jsonobj_clear(&obj);
+    zbx_jsonpath_set_free(set);
+}
+
+/* runs the dependent items with and without the master's cache, returns the number of extracted paths */
+static int check_dependent_items(zbx_pp_context_t *ctx, zbx_pp_item_preproc_t *master, zbx_pp_item_preproc_t **deps,
+        int deps_num, zbx_variant_t *value) {
+    zbx_pp_cache_t *cache = pp_cache_create(master, value);
+    int i, values_num;
+
+    for (i = 0; i < deps_num; i++) {
+        char *result = pp_test_execute(ctx, deps[i], NULL, value->data.str),
+                *result_cached = pp_test_execute(ctx, deps[i], cache, value->data.str);
+
+        assert(0 == strcmp(result, result_cached) && "Cached dependent item should produce the same result");
+
+        zbx_free(result);
+        zbx_free(result_cached);
+    }
+
+    assert(ZBX_PREPROC_JSONPATH == cache->type && NULL != cache->data);
+    values_num = cache->jsonpath_values_num;
+
+    pp_cache_release(cache);
+
+    return values_num;
+}
+
+/* the master item has no steps, so the cache type is set by the dependent items */
+static void test_dependent_items_cache() {
+    const char *paths[] = {"$.a.b.c", "$.missing", "$.arr[*].name", "$.arr[-1].name", "$.a.b.e"};
+    zbx_pp_item_preproc_t *master = pp_test_create_preproc(ITEM_TYPE_DEPENDENT, 0, NULL), *deps[ARRSIZE(paths)];
+    zbx_variant_t value;
+    zbx_pp_context_t ctx;
+    int i;
+
+    LOG_INF("Testing dependent items cache");
+
+    pp_context_init(&ctx);
+    zbx_variant_set_str(&value, zbx_strdup(NULL, test_json));
+
+    for (i = 0; i < ARRSIZE(paths); i++)
+        deps[i] = pp_test_create_preproc(ITEM_TYPE_DEPENDENT, ZBX_PREPROC_JSONPATH, paths[i]);
+
+    /* paths are collected on the first value and extracted together on the next ones */
+    check_dependent_items(&ctx, master, deps, ARRSIZE(paths), &value);
+    assert(ARRSIZE(paths) - 1 == check_dependent_items(&ctx, master, deps, ARRSIZE(paths), &value));
+    assert(ARRSIZE(paths) - 1 == check_dependent_items(&ctx, master, deps, ARRSIZE(paths), &value));
+
+    /* a dependent item's path has changed, the set is collected again without the old path */
+    zbx_pp_item_preproc_release(deps[0]);
+    deps[0] = pp_test_create_preproc(ITEM_TYPE_DEPENDENT, ZBX_PREPROC_JSONPATH, "$.num");
+    assert(ARRSIZE(paths) == check_dependent_items(&ctx, master, deps, ARRSIZE(paths), &value));
+
+    zbx_pp_item_preproc_clear_dep_jsonpaths(master);
+    assert(NULL == master->dep_jsonpaths);
+
+    check_dependent_items(&ctx, master, deps, ARRSIZE(paths), &value);
+    assert(ARRSIZE(paths) - 1 == check_dependent_items(&ctx, master, deps, ARRSIZE(paths), &value));
+
+    for (i = 0; i < ARRSIZE(paths); i++)
+        zbx_pp_item_preproc_release(deps[i]);
+
+    zbx_variant_clear(&value);
+    zbx_pp_item_preproc_release(master);
+    pp_context_destroy(&ctx);
+}
+
+/* a parsed master value queried by each dependent item path against one walk for all of them */
+static void bench_dependent_items(int separate) {
+    char *json = NULL, *paths[BENCH_NODES * BENCH_FIELDS], *outputs[BENCH_NODES * BENCH_FIELDS];
+    size_t json_alloc = 0, json_offset = 0;
+    zbx_jsonpath_set_t *set = zbx_jsonpath_set_create();
+    double time_start;
+    int i, j, k;
+
+    zbx_strcpy_alloc(&json, &json_alloc, &json_offset, "{\"nodes\":{");
+
+    for (i = 0; i < BENCH_NODES; i++) {
+        zbx_snprintf_alloc(&json, &json_alloc, &json_offset, "%s\"node%d\":{\"name\":\"node-%d\",\"stats\":{",
+                0 == i ? "" : ",", i, i);
+
+        for (j = 0; j < BENCH_FIELDS; j++) {
+            zbx_snprintf_alloc(&json, &json_alloc, &json_offset, "%s\"field%d\":%d", 0 == j ? "" : ",", j, i * j);
+            paths[i * BENCH_FIELDS + j] = zbx_dsprintf(NULL, "$.nodes.node%d.stats.field%d", i, j);
+            zbx_jsonpath_set_add(set, paths[i * BENCH_FIELDS + j]);
+        }
+
+        zbx_strcpy_alloc(&json, &json_alloc, &json_offset, "}}");
+    }
+
+    zbx_strcpy_alloc(&json, &json_alloc, &json_offset, "}}");
+
+    time_start = zbx_time();
+
+    for (k = 0; k < BENCH_VALUES; k++) {
+        zbx_jsonobj_t obj;
+
+        assert(SUCCEED == zbx_jsonobj_open(json, &obj));
+        memset(outputs, 0, sizeof(outputs));
+
+        if (separate) {
+            for (i = 0; i < BENCH_NODES * BENCH_FIELDS; i++)
+                zbx_jsonobj_query(&obj, paths[i], &outputs[i]);
+        }
+        else
+            zbx_jsonobj_query_set(&obj, set, outputs);
+
+        for (i = 0; i < BENCH_NODES * BENCH_FIELDS; i++) {
+            assert(NULL != outputs[i]);
+            zbx_free(outputs[i]);
+        }
+
+        zbx_jsonobj_clear(&obj);
+    }
+
+    LOG_INF("Dependent items jsonpath %s: %d values of %d dependent items in %.3f sec",
+            separate ? "separate queries" : "path set", BENCH_VALUES, BENCH_NODES * BENCH_FIELDS,
+            zbx_time() - time_start);
+
+    for (i = 0; i < BENCH_NODES * BENCH_FIELDS; i++)
+        zbx_free(paths[i]);
+
+    zbx_free(json);
+    zbx_jsonpath_set_free(set);
+}
+
+void pp_jsonpath_set_run_tests(void) {
+    LOG_INF("Starting jsonpath set tests");
+
+    test_set_matches_query();
+    test_dependent_items_cache();
+
+    bench_dependent_items(1);
+    bench_dependent_items(0);
+
+    LOG_INF("Jsonpath set tests are finished");
+}
+
+#endif
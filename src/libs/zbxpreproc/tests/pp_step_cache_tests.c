@@ -0,0 +1,128 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "zbxtime.h"
+#include "zbx_item_constants.h"
+#include "../pp_execute.h"
+#include "../pp_step_cache.h"
+#include "pp_test_utils.h"
+
+static void test_cached_steps_match_uncached() {
+    struct {
+        int type;
+        const char *params;
+        const char *value;
+    } tests[] = {
+        {ZBX_PREPROC_VALIDATE_REGEX, "^ab+c", "abbbc"},
+        {ZBX_PREPROC_VALIDATE_REGEX, "^ab+c", "xabc"},
+        {ZBX_PREPROC_VALIDATE_REGEX, "(", "x"},
+        {ZBX_PREPROC_VALIDATE_NOT_REGEX, "error", "no error"},
+        {ZBX_PREPROC_REGSUB, "took ([0-9]+) ms\n\\1", "request took 153 ms"},
+        {ZBX_PREPROC_REGSUB, "took ([0-9]+) ms\n\\1", "no match"},
+        {ZBX_PREPROC_REGSUB, "no output", "value"},
+        {ZBX_PREPROC_ERROR_FIELD_REGEX, "ERROR: (.*)\n\\1", "ERROR: disk full"},
+        {ZBX_PREPROC_ERROR_FIELD_REGEX, "ERROR: (.*)\n\\1", "all ok"},
+        {ZBX_PREPROC_JSONPATH, "$.a[*].b.sum()", "{\"a\":[{\"b\":1},{\"b\":2}]}"},
+        {ZBX_PREPROC_JSONPATH, "$[", "{\"a\":1}"},
+        {ZBX_PREPROC_XPATH, "count(/r/v)", "<r><v>1</v><v>2</v></r>"},
+        {ZBX_PREPROC_ERROR_FIELD_XML, "/r/err", "<r><err>bad</err></r>"},
+        {ZBX_PREPROC_PROMETHEUS_PATTERN, "http_req{code=~\"2..\"}\nvalue\n",
+                "http_req{code=\"200\"} 5\nhttp_req{code=\"500\"} 7\n"},
+        {ZBX_PREPROC_PROMETHEUS_PATTERN, "http_req{code!~\"2..\"}\nvalue\n",
+                "http_req{code=\"200\"} 5\nhttp_req{code=\"500\"} 7\n"},
+    };
+    zbx_pp_context_t ctx;
+    int i, j;
+
+    pp_context_init(&ctx);
+
+    for (i = 0; i < ARRSIZE(tests); i++) {
+        zbx_pp_item_preproc_t *preproc = pp_test_create_preproc(ITEM_TYPE_TRAPPER, tests[i].type, tests[i].params),
+                *preproc_cached = pp_test_create_preproc(ITEM_TYPE_TRAPPER, tests[i].type, tests[i].params);
+
+        zbx_pp_item_preproc_cache_steps(preproc_cached);
+        assert(NULL != preproc_cached->steps_cache && "Steps cache should be created");
+
+        /* the second run uses already compiled parameters */
+        for (j = 0; j < 2; j++) {
+            char *result = pp_test_execute(&ctx, preproc, NULL, tests[i].value),
+                    *result_cached = pp_test_execute(&ctx, preproc_cached, NULL, tests[i].value);
+
+            assert(0 == strcmp(result, result_cached) && "Cached step should produce the same result");
+
+            zbx_free(result);
+            zbx_free(result_cached);
+        }
+
+        assert(PP_STEP_CACHE_EMPTY != preproc_cached->steps_cache[0].state);
+
+        zbx_pp_item_preproc_release(preproc);
+        zbx_pp_item_preproc_release(preproc_cached);
+    }
+
+    pp_context_destroy(&ctx);
+}
+
+#ifdef HAVE_GLB_BENCHMARKS
+#define BENCH_VALUES 200000
+
+static void bench_regsub(int cached) {
+    const char *value = "2023-10-11 12:00:01 [worker-17] INFO request id=83421 took 153 ms path=/api/v1/items status=200";
+    zbx_pp_item_preproc_t *preproc = pp_test_create_preproc(ITEM_TYPE_TRAPPER, ZBX_PREPROC_REGSUB, "took ([0-9]+) ms.*status=([0-9]+)\n\\1 \\2");
+    zbx_pp_context_t ctx;
+    double time_start;
+    int i;
+
+    pp_context_init(&ctx);
+
+    if (cached)
+        zbx_pp_item_preproc_cache_steps(preproc);
+
+    time_start = zbx_time();
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        char *result = pp_test_execute(&ctx, preproc, NULL, value);
+        zbx_free(result);
+    }
+
+    LOG_INF("Regsub %s: %d values in %.3f sec", cached ? "cached" : "uncached", BENCH_VALUES,
+            zbx_time() - time_start);
+
+    zbx_pp_item_preproc_release(preproc);
+    pp_context_destroy(&ctx);
+}
+#endif
+
+void pp_step_cache_run_tests(void) {
+    LOG_INF("Starting preprocessing step cache tests");
+    test_cached_steps_match_uncached();
+
+#ifdef HAVE_GLB_BENCHMARKS
+    bench_regsub(0);
+    bench_regsub(1);
+#endif
+
+    LOG_INF("Preprocessing step cache tests are finished");
+}
+
+#endif
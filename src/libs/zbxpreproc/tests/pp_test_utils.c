@@ -0,0 +1,62 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "zbx_item_constants.h"
+#include "metric.h"
+#include "pp_test_utils.h"
+
+zbx_pp_item_preproc_t *pp_test_create_preproc(unsigned char item_type, int step_type, const char *params) {
+    zbx_pp_item_preproc_t *preproc = zbx_pp_item_preproc_create(item_type, ITEM_VALUE_TYPE_TEXT, 0);
+
+    if (0 == step_type)
+        return preproc;
+
+    preproc->steps = (zbx_pp_step_t *)zbx_malloc(NULL, sizeof(zbx_pp_step_t));
+    preproc->steps_num = 1;
+    preproc->steps[0].type = step_type;
+    preproc->steps[0].params = zbx_strdup(NULL, params);
+    preproc->steps[0].error_handler = ZBX_PREPROC_FAIL_DEFAULT;
+    preproc->steps[0].error_handler_params = NULL;
+
+    return preproc;
+}
+
+char *pp_test_execute(zbx_pp_context_t *ctx, zbx_pp_item_preproc_t *preproc, zbx_pp_cache_t *cache,
+        const char *value) {
+    metric_t metric = {.itemid = 1, .hostid = 0};
+    zbx_variant_t value_out;
+    char *result;
+
+    zbx_variant_set_str(&metric.value, zbx_strdup(NULL, value));
+    zbx_variant_set_none(&value_out);
+
+    pp_execute(ctx, preproc, cache, &metric, &value_out, NULL, NULL);
+
+    result = zbx_dsprintf(NULL, "%s:%s", zbx_variant_type_desc(&value_out), zbx_variant_value_desc(&value_out));
+
+    zbx_variant_clear(&value_out);
+    zbx_variant_clear(&metric.value);
+
+    return result;
+}
+
+#endif
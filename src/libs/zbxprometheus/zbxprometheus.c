@@ -49,6 +49,8 @@ typedef struct
 	char				*key;
 	/* the pattern to match */
 	char				*pattern;
+	/* the compiled pattern of regex conditions, optional - can be NULL */
+	zbx_regexp_t			*regexp;
 	/* the condition operations */
 	zbx_prometheus_condition_op_t	op;
 }
@@ -57,7 +59,7 @@ zbx_prometheus_condition_t;
 ZBX_PTR_VECTOR_DECL(prometheus_condition, zbx_prometheus_condition_t *)
 
 /* the prometheus pattern filter */
-typedef struct
+struct zbx_prometheus_filter
 {
 	/* metric filter, optional - can be NULL */
 	zbx_prometheus_condition_t		*metric;
@@ -65,8 +67,7 @@ typedef struct
 	zbx_prometheus_condition_t		*value;
 	/* label filters */
 	zbx_vector_prometheus_condition_t	labels;
-}
-zbx_prometheus_filter_t;
+};
 
 /* the prometheus metric HELP, TYPE hints in comments */
 typedef struct
@@ -559,6 +560,10 @@ static void	prometheus_condition_free(zbx_prometheus_condition_t *condition)
 {
 	zbx_free(condition->key);
 	zbx_free(condition->pattern);
+
+	if (NULL != condition->regexp)
+		zbx_regexp_free(condition->regexp);
+
 	zbx_free(condition);
 }
 
@@ -581,6 +586,7 @@ static zbx_prometheus_condition_t	*prometheus_condition_create(char *key, char *
 	condition = (zbx_prometheus_condition_t *)zbx_malloc(NULL, sizeof(zbx_prometheus_condition_t));
 	condition->key = key;
 	condition->pattern = pattern;
+	condition->regexp = NULL;
 	condition->op = op;
 
 	return condition;
@@ -843,7 +849,12 @@ static int	condition_match_key_value(const zbx_prometheus_condition_t *condition
 				return FAIL;
 			break;
 		case ZBX_PROMETHEUS_CONDITION_OP_REGEX:
-			if (NULL == zbx_regexp_match(value, condition->pattern, NULL))
+			if (NULL != condition->regexp)
+			{
+				if (0 != zbx_regexp_match_precompiled(value, condition->regexp))
+					return FAIL;
+			}
+			else if (NULL == zbx_regexp_match(value, condition->pattern, NULL))
 				return FAIL;
 			break;
 		case ZBX_PROMETHEUS_CONDITION_OP_NOT_EQUAL:
@@ -851,7 +862,12 @@ static int	condition_match_key_value(const zbx_prometheus_condition_t *condition
 				return FAIL;
 			break;
 		case ZBX_PROMETHEUS_CONDITION_OP_REGEX_NOT_MATCHED:
-			if (NULL != zbx_regexp_match(value, condition->pattern, NULL))
+			if (NULL != condition->regexp)
+			{
+				if (0 == zbx_regexp_match_precompiled(value, condition->regexp))
+					return FAIL;
+			}
+			else if (NULL != zbx_regexp_match(value, condition->pattern, NULL))
 				return FAIL;
 			break;
 		default:
@@ -1934,6 +1950,127 @@ static int	prometheus_validate_request(const char *request, const char *output,
 	return SUCCEED;
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compiles regular expression of the filter condition               *
+ *                                                                            *
+ * Parameters: condition - [IN/OUT] the condition                             *
+ *                                                                            *
+ * Comments: conditions failing to compile are left to zbx_regexp_match(),    *
+ *           so the matching result is the same as for non compiled filter    *
+ *                                                                            *
+ ******************************************************************************/
+static void	prometheus_condition_compile(zbx_prometheus_condition_t *condition)
+{
+	const char	*err_msg = NULL;
+
+	if (ZBX_PROMETHEUS_CONDITION_OP_REGEX != condition->op &&
+			ZBX_PROMETHEUS_CONDITION_OP_REGEX_NOT_MATCHED != condition->op)
+	{
+		return;
+	}
+
+	if (SUCCEED != zbx_regexp_compile(condition->pattern, &condition->regexp, &err_msg))
+	{
+		zbx_regexp_err_msg_free(err_msg);
+		condition->regexp = NULL;
+		return;
+	}
+
+	zbx_regexp_jit_compile(condition->regexp);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: parses prometheus pattern filter and compiles its regular         *
+ *          expressions to be reused for multiple queries                     *
+ *                                                                            *
+ * Parameters: filter_data - [IN] the filter in text format                   *
+ *             error       - [OUT] the error message                          *
+ *                                                                            *
+ * Return value: the compiled filter or NULL on error                         *
+ *                                                                            *
+ ******************************************************************************/
+zbx_prometheus_filter_t	*zbx_prometheus_filter_create(const char *filter_data, char **error)
+{
+	zbx_prometheus_filter_t	*filter;
+	char			*errmsg = NULL;
+	int			i;
+
+	filter = (zbx_prometheus_filter_t *)zbx_malloc(NULL, sizeof(zbx_prometheus_filter_t));
+
+	if (FAIL == prometheus_filter_init(filter, filter_data, &errmsg))
+	{
+		*error = zbx_dsprintf(*error, "pattern error: %s", errmsg);
+		zbx_free(errmsg);
+		zbx_free(filter);
+		return NULL;
+	}
+
+	if (NULL != filter->metric)
+		prometheus_condition_compile(filter->metric);
+
+	for (i = 0; i < filter->labels.values_num; i++)
+		prometheus_condition_compile(filter->labels.values[i]);
+
+	return filter;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: frees filter created by zbx_prometheus_filter_create()            *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_prometheus_filter_free(zbx_prometheus_filter_t *filter)
+{
+	prometheus_filter_clear(filter);
+	zbx_free(filter);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: extract value from prometheus cache by the specified parsed       *
+ *          filter                                                            *
+ *                                                                            *
+ * Parameters: prom    - [IN] the prometheus cache                            *
+ *             filter  - [IN] the parsed filter                               *
+ *             request - [IN] the data request - value, label, function       *
+ *             output  - [IN] the output template/function name               *
+ *             value   - [OUT] the extracted value                            *
+ *             error   - [OUT] the error message                              *
+ *                                                                            *
+ * Return value: SUCCEED - the value was extracted successfully               *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_prometheus_pattern_ex_compiled(zbx_prometheus_t *prom, zbx_prometheus_filter_t *filter,
+		const char *request, const char *output, char **value, char **error)
+{
+	int				ret;
+	char				*errmsg = NULL;
+	zbx_vector_prometheus_row_t	rows, *prows;
+
+	if (SUCCEED != prometheus_validate_request(request, output, error))
+		return FAIL;
+
+	zbx_vector_prometheus_row_create(&rows);
+
+	if (SUCCEED != prometheus_get_indexed_rows_by_label(prom, filter, &prows) || NULL == prows)
+		prows = &prom->rows;
+
+	prometheus_filter_rows(prows, filter, &rows);
+
+	if (FAIL == (ret = prometheus_query_rows(&rows, request, output, value, &errmsg)))
+	{
+		*error = zbx_dsprintf(*error, "data extraction error: %s", errmsg);
+		zbx_free(errmsg);
+	}
+
+	zbx_vector_prometheus_row_destroy(&rows);
+
+	return ret;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: extract value from prometheus cache by the specified filter       *
@@ -1955,7 +2092,6 @@ int	zbx_prometheus_pattern_ex(zbx_prometheus_t *prom, const char *filter_data, c
 	zbx_prometheus_filter_t		filter;
 	int				ret = FAIL;
 	char				*errmsg = NULL;
-	zbx_vector_prometheus_row_t	rows, *prows;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
@@ -1966,26 +2102,58 @@ int	zbx_prometheus_pattern_ex(zbx_prometheus_t *prom, const char *filter_data, c
 		goto out;
 	}
 
-	zbx_vector_prometheus_row_create(&rows);
+	ret = zbx_prometheus_pattern_ex_compiled(prom, &filter, request, output, value, error);
+
+	prometheus_filter_clear(&filter);
+out:
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: extracts value from prometheus data by the specified parsed       *
+ *          filter                                                            *
+ *                                                                            *
+ * Parameters: data    - [IN] the prometheus data                             *
+ *             filter  - [IN] the parsed filter                               *
+ *             request - [IN] the data request - value, label, function       *
+ *             output  - [IN] the output template/function name               *
+ *             value   - [OUT] the extracted value                            *
+ *             error   - [OUT] the error message                              *
+ *                                                                            *
+ * Return value: SUCCEED - the value was extracted successfully               *
+ *               FAIL    - otherwise                                          *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_prometheus_pattern_compiled(const char *data, zbx_prometheus_filter_t *filter, const char *request,
+		const char *output, char **value, char **error)
+{
+	char				*errmsg = NULL;
+	int				ret = FAIL;
+	zbx_vector_prometheus_row_t	rows;
 
 	if (SUCCEED != prometheus_validate_request(request, output, error))
 		return FAIL;
 
-	if (SUCCEED != prometheus_get_indexed_rows_by_label(prom, &filter, &prows) || NULL == prows)
-		prows = &prom->rows;
+	zbx_vector_prometheus_row_create(&rows);
 
-	prometheus_filter_rows(prows, &filter, &rows);
+	if (FAIL == prometheus_parse_rows(filter, data, &rows, NULL, error))
+		goto out;
 
-	if (FAIL == (ret = prometheus_query_rows(&rows, request, output, value, &errmsg)))
+	if (FAIL == prometheus_query_rows(&rows, request, output, value, &errmsg))
 	{
 		*error = zbx_dsprintf(*error, "data extraction error: %s", errmsg);
 		zbx_free(errmsg);
+		goto out;
 	}
 
-	prometheus_filter_clear(&filter);
-	zbx_vector_prometheus_row_destroy(&rows);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s(): output:%s", __func__, *value);
+	ret = SUCCEED;
 out:
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
+	zbx_vector_prometheus_row_clear_ext(&rows, prometheus_row_free);
+	zbx_vector_prometheus_row_destroy(&rows);
 
 	return ret;
 }
@@ -2011,7 +2179,6 @@ int	zbx_prometheus_pattern(const char *data, const char *filter_data, const char
 	zbx_prometheus_filter_t		filter;
 	char				*errmsg = NULL;
 	int				ret = FAIL;
-	zbx_vector_prometheus_row_t	rows;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
@@ -2022,26 +2189,8 @@ int	zbx_prometheus_pattern(const char *data, const char *filter_data, const char
 		goto out;
 	}
 
-	zbx_vector_prometheus_row_create(&rows);
-
-	if (SUCCEED != prometheus_validate_request(request, output, error))
-		return FAIL;
-
-	if (FAIL == prometheus_parse_rows(&filter, data, &rows, NULL, error))
-		goto cleanup;
-
-	if (FAIL == prometheus_query_rows(&rows, request, output, value, &errmsg))
-	{
-		*error = zbx_dsprintf(*error, "data extraction error: %s", errmsg);
-		zbx_free(errmsg);
-		goto cleanup;
-	}
+	ret = zbx_prometheus_pattern_compiled(data, &filter, request, output, value, error);
 
-	zabbix_log(LOG_LEVEL_DEBUG, "%s(): output:%s", __func__, *value);
-	ret = SUCCEED;
-cleanup:
-	zbx_vector_prometheus_row_clear_ext(&rows, prometheus_row_free);
-	zbx_vector_prometheus_row_destroy(&rows);
 	prometheus_filter_clear(&filter);
 out:
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
@@ -234,6 +234,27 @@ int	zbx_regexp_compile_ext(const char *pattern, zbx_regexp_t **regexp, int flags
 	return regexp_compile(pattern, flags, regexp, err_msg);
 }
 
+/******************************************************************************
+ *                                                                            *
+ * Purpose: JIT compiles regular expression which is going to be matched      *
+ *          many times                                                        *
+ *                                                                            *
+ * Parameters: regexp - [IN/OUT] compiled regular expression                  *
+ *                                                                            *
+ * Comments: JIT is optional, on failure (pcre2 built without JIT support,    *
+ *           unsupported pattern) the interpreter is used for matching.       *
+ *           With PCRE1 the expression is already studied during compilation. *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_regexp_jit_compile(zbx_regexp_t *regexp)
+{
+#ifdef HAVE_PCRE2_H
+	(void)pcre2_jit_compile(regexp->pcre2_regexp, PCRE2_JIT_COMPLETE);
+#else
+	ZBX_UNUSED(regexp);
+#endif
+}
+
 /****************************************************************************************************
  *                                                                                                  *
  * Purpose: wrapper for zbx_regexp_compile. Caches and reuses the last used regexp.                 *
@@ -1398,6 +1398,24 @@ static int	evaluate_COUNT(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, co
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
+	/* plain count of all values doesn't need the values, it's calculated in the value cache */
+	if (COUNT_UNIQUE != unique && (NULL == pattern || '\0' == *pattern) && (NULL == operator ||
+			'\0' == *operator || OP_LIKE == op || OP_REGEXP == op || OP_IREGEXP == op))
+	{
+		glb_state_item_agg_t	agg = {0};
+
+		if (FAIL == glb_state_item_get_aggregate(item->itemid, item->value_type, &agg, seconds, nvalues,
+				ts_end.sec))
+		{
+			*error = zbx_strdup(*error, "cannot get values from value cache");
+			goto out;
+		}
+
+		zbx_variant_set_dbl(value, MIN(agg.count, limit));
+		ret = SUCCEED;
+		goto out;
+	}
+
 	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
@@ -1543,16 +1561,13 @@ out:
 static int	evaluate_SUM(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, const char *parameters, const zbx_timespec_t *ts,
 		char **error)
 {
-	int				arg1, i, ret = FAIL, seconds = 0, nvalues = 0, time_shift;
+	int				arg1, ret = FAIL, seconds = 0, nvalues = 0, time_shift;
 	zbx_value_type_t		arg1_type;
-	zbx_vector_history_record_t	values;
-	zbx_history_value_t		result;
+	glb_state_item_agg_t		agg = {0};
 	zbx_timespec_t			ts_end = *ts;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	zbx_history_record_vector_create(&values);
-
 	if (ITEM_VALUE_TYPE_FLOAT != item->value_type && ITEM_VALUE_TYPE_UINT64 != item->value_type)
 	{
 		*error = zbx_strdup(*error, "invalid value type");
@@ -1586,32 +1601,18 @@ static int	evaluate_SUM(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, cons
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
-	if (FAIL == zbx_vc_get_values( item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
+	if (FAIL == glb_state_item_get_aggregate(item->itemid, item->value_type, &agg, seconds, nvalues, ts_end.sec))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
 		goto out;
 	}
 
-	if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
-	{
-		result.dbl = 0;
-
-		for (i = 0; i < values.values_num; i++)
-			result.dbl += values.values[i].value.dbl;
-	}
-	else
-	{
-		result.ui64 = 0;
-
-		for (i = 0; i < values.values_num; i++)
-			result.ui64 += values.values[i].value.ui64;
-	}
+	if (0 == agg.count)
+		memset(&agg.sum, 0, sizeof(agg.sum));
 
-	zbx_history_value2variant(&result, item->value_type, value);
+	zbx_history_value2variant(&agg.sum, item->value_type, value);
 	ret = SUCCEED;
 out:
-	zbx_history_record_vector_destroy(&values, item->value_type);
-
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
 
 	return ret;
@@ -1635,15 +1636,13 @@ out:
 static int	evaluate_AVG(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, const char *parameters,
 		const zbx_timespec_t *ts, char **error)
 {
-	int				arg1, ret = FAIL, i, seconds = 0, nvalues = 0, time_shift;
+	int				arg1, ret = FAIL, seconds = 0, nvalues = 0, time_shift;
 	zbx_value_type_t		arg1_type;
-	zbx_vector_history_record_t	values;
+	glb_state_item_agg_t		agg = {0};
 	zbx_timespec_t			ts_end = *ts;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	zbx_history_record_vector_create(&values);
-
 	if (ITEM_VALUE_TYPE_FLOAT != item->value_type && ITEM_VALUE_TYPE_UINT64 != item->value_type)
 	{
 		*error = zbx_strdup(*error, "invalid value type");
@@ -1677,30 +1676,15 @@ static int	evaluate_AVG(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, cons
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
-	if (FAIL == zbx_vc_get_values( item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
+	if (FAIL == glb_state_item_get_aggregate(item->itemid, item->value_type, &agg, seconds, nvalues, ts_end.sec))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
 		goto out;
 	}
 
-	if (0 < values.values_num)
+	if (0 < agg.count)
 	{
-		double	avg = 0;
-
-		if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
-		{
-			for (i = 0; i < values.values_num; i++)
-				avg += values.values[i].value.dbl / (i + 1) - avg / (i + 1);
-		}
-		else
-		{
-			for (i = 0; i < values.values_num; i++)
-				avg += (double)values.values[i].value.ui64;
-
-			avg = avg / values.values_num;
-		}
-		zbx_variant_set_dbl(value, avg);
-
+		zbx_variant_set_dbl(value, agg.avg);
 		ret = SUCCEED;
 	}
 	else
@@ -1709,7 +1693,6 @@ static int	evaluate_AVG(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, cons
 		*error = zbx_strdup(*error, "not enough data");
 	}
 out:
-	zbx_history_record_vector_destroy(&values, item->value_type);
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
 
@@ -1753,13 +1736,6 @@ static int	evaluate_LAST(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, con
 #define EVALUATE_MIN	0
 #define EVALUATE_MAX	1
 
-#define LOOP_FIND_MIN_OR_MAX(type, mode_op)							\
-	for (i = 1; i < values.values_num; i++)							\
-	{											\
-		if (values.values[i].value.type mode_op values.values[index].value.type)	\
-			index = i;								\
-	}											\
-
 /******************************************************************************
  *                                                                            *
  * Purpose: evaluate function 'min' or 'max' for the item                     *
@@ -1779,15 +1755,13 @@ static int	evaluate_LAST(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, con
 static int	evaluate_MIN_or_MAX(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, const char *parameters,
 		const zbx_timespec_t *ts, char **error, int min_or_max)
 {
-	int				arg1, i, ret = FAIL, seconds = 0, nvalues = 0, time_shift;
+	int				arg1, ret = FAIL, seconds = 0, nvalues = 0, time_shift;
 	zbx_value_type_t		arg1_type;
-	zbx_vector_history_record_t	values;
+	glb_state_item_agg_t		agg = {0};
 	zbx_timespec_t			ts_end = *ts;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	zbx_history_record_vector_create(&values);
-
 	if (ITEM_VALUE_TYPE_FLOAT != item->value_type && ITEM_VALUE_TYPE_UINT64 != item->value_type)
 	{
 		*error = zbx_strdup(*error, "invalid value type");
@@ -1821,40 +1795,15 @@ static int	evaluate_MIN_or_MAX(zbx_variant_t *value, const DC_EVALUATE_ITEM *ite
 			THIS_SHOULD_NEVER_HAPPEN;
 	}
 
-	if (FAIL == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
+	if (FAIL == glb_state_item_get_aggregate(item->itemid, item->value_type, &agg, seconds, nvalues, ts_end.sec))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
 		goto out;
 	}
 
-	if (0 < values.values_num)
+	if (0 < agg.count)
 	{
-		int	index = 0;
-
-		if (ITEM_VALUE_TYPE_UINT64 == item->value_type)
-		{
-			if (EVALUATE_MIN == min_or_max)
-			{
-				LOOP_FIND_MIN_OR_MAX(ui64, <);
-			}
-			else
-			{
-				LOOP_FIND_MIN_OR_MAX(ui64, >);
-			}
-		}
-		else
-		{
-			if (EVALUATE_MIN == min_or_max)
-			{
-				LOOP_FIND_MIN_OR_MAX(dbl, <);
-			}
-			else
-			{
-				LOOP_FIND_MIN_OR_MAX(dbl, >);
-			}
-		}
-
-		zbx_history_value2variant(&values.values[index].value, item->value_type, value);
+		zbx_history_value2variant(EVALUATE_MIN == min_or_max ? &agg.min : &agg.max, item->value_type, value);
 		ret = SUCCEED;
 	}
 	else
@@ -1863,7 +1812,6 @@ static int	evaluate_MIN_or_MAX(zbx_variant_t *value, const DC_EVALUATE_ITEM *ite
 		*error = zbx_strdup(*error, "not enough data");
 	}
 out:
-	zbx_history_record_vector_destroy(&values, item->value_type);
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
 
@@ -1892,12 +1840,15 @@ static int	evaluate_PERCENTILE(zbx_variant_t  *value, const DC_EVALUATE_ITEM *it
 	int				arg1, time_shift, ret = FAIL, seconds = 0, nvalues = 0;
 	zbx_value_type_t		arg1_type;
 	double				percentage;
-	zbx_vector_history_record_t	values;
+	glb_state_item_agg_t		agg = {0};
+	zbx_vector_dbl_t		dbl_values;
+	zbx_vector_uint64_t		ui64_values;
 	zbx_timespec_t			ts_end = *ts;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	zbx_history_record_vector_create(&values);
+	zbx_vector_dbl_create(&dbl_values);
+	zbx_vector_uint64_create(&ui64_values);
 
 	if (ITEM_VALUE_TYPE_FLOAT != item->value_type && ITEM_VALUE_TYPE_UINT64 != item->value_type)
 	{
@@ -1939,27 +1890,36 @@ static int	evaluate_PERCENTILE(zbx_variant_t  *value, const DC_EVALUATE_ITEM *it
 		goto out;
 	}
 
-	if (FAIL == zbx_vc_get_values( item->itemid, item->value_type, &values, seconds, nvalues, &ts_end))
+	if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
+		agg.dbl_values = &dbl_values;
+	else
+		agg.ui64_values = &ui64_values;
+
+	if (FAIL == glb_state_item_get_aggregate(item->itemid, item->value_type, &agg, seconds, nvalues, ts_end.sec))
 	{
 		*error = zbx_strdup(*error, "cannot get values from value cache");
 		goto out;
 	}
 
-	if (0 < values.values_num)
+	if (0 < agg.count)
 	{
 		int	index;
 
-		if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
-			zbx_vector_history_record_sort(&values, (zbx_compare_func_t)history_record_float_compare);
-		else
-			zbx_vector_history_record_sort(&values, (zbx_compare_func_t)history_record_uint64_compare);
-
 		if (0 == percentage)
 			index = 1;
 		else
-			index = (int)ceil(values.values_num * (percentage / 100));
+			index = (int)ceil(agg.count * (percentage / 100));
 
-		zbx_history_value2variant(&values.values[index - 1].value, item->value_type, value);
+		if (ITEM_VALUE_TYPE_FLOAT == item->value_type)
+		{
+			zbx_vector_dbl_sort(&dbl_values, ZBX_DEFAULT_DBL_COMPARE_FUNC);
+			zbx_variant_set_dbl(value, dbl_values.values[index - 1]);
+		}
+		else
+		{
+			zbx_vector_uint64_sort(&ui64_values, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+			zbx_variant_set_ui64(value, ui64_values.values[index - 1]);
+		}
 
 		ret = SUCCEED;
 	}
@@ -1969,7 +1929,8 @@ static int	evaluate_PERCENTILE(zbx_variant_t  *value, const DC_EVALUATE_ITEM *it
 		*error = zbx_strdup(*error, "not enough data");
 	}
 out:
-	zbx_history_record_vector_destroy(&values, item->value_type);
+	zbx_vector_uint64_destroy(&ui64_values);
+	zbx_vector_dbl_destroy(&dbl_values);
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s():%s", __func__, zbx_result_string(ret));
 
@@ -2971,11 +2932,32 @@ static int	evaluate_FIRST(zbx_variant_t *value, const DC_EVALUATE_ITEM *item, co
 
 	ts_end.sec -= time_shift;
 
+	if (ITEM_VALUE_TYPE_FLOAT == item->value_type || ITEM_VALUE_TYPE_UINT64 == item->value_type)
+	{
+		glb_state_item_agg_t	agg = {0};
+
+		if (SUCCEED != glb_state_item_get_aggregate(item->itemid, item->value_type, &agg, seconds, 0,
+				ts_end.sec))
+		{
+			*error = zbx_strdup(*error, "cannot get values from value cache");
+		}
+		else if (0 < agg.count)
+		{
+			zbx_history_value2variant(&agg.first, item->value_type, value);
+			ret = SUCCEED;
+		}
+		else
+			*error = zbx_strdup(*error, "not enough data");
+
+		goto out;
+	}
+
+	/* the cached values go from the oldest to the newest */
 	if (SUCCEED == zbx_vc_get_values(item->itemid, item->value_type, &values, seconds, 0, &ts_end))
 	{
 		if (0 < values.values_num)
 		{
-			zbx_history_value2variant(&values.values[values.values_num - 1].value, item->value_type, value);
+			zbx_history_value2variant(&values.values[0].value, item->value_type, value);
 			ret = SUCCEED;
 		}
 		else
@@ -256,26 +256,22 @@ void zbx_xml_escape_xpath(char **data)
 	*data = buffer;
 }
 
+#ifdef HAVE_LIBXML2
 /******************************************************************************
  *                                                                            *
  * Purpose: execute xpath query                                               *
  *                                                                            *
  * Parameters: value  - [IN/OUT] the value to process                         *
- *             params - [IN] the operation parameters                         *
+ *             params - [IN] the xpath expression, used if xpath is NULL      *
+ *             xpath  - [IN] the compiled xpath expression (optional)         *
  *             errmsg - [OUT] error message                                   *
  *                                                                            *
  * Return value: SUCCEED - the value was processed successfully               *
  *               FAIL - otherwise                                             *
  *                                                                            *
  ******************************************************************************/
-int	zbx_query_xpath(zbx_variant_t *value, const char *params, char **errmsg)
+static int	xml_query_xpath(zbx_variant_t *value, const char *params, xmlXPathCompExprPtr xpath, char **errmsg)
 {
-#ifndef HAVE_LIBXML2
-	ZBX_UNUSED(value);
-	ZBX_UNUSED(params);
-	*errmsg = zbx_dsprintf(*errmsg, "Zabbix was compiled without libxml2 support");
-	return FAIL;
-#else
 	int		i, ret = FAIL;
 	char		buffer[32], *ptr;
 	xmlDoc		*doc = NULL;
@@ -296,7 +292,12 @@ int	zbx_query_xpath(zbx_variant_t *value, const char *params, char **errmsg)
 
 	xpathCtx = xmlXPathNewContext(doc);
 
-	if (NULL == (xpathObj = xmlXPathEvalExpression((xmlChar *)params, xpathCtx)))
+	if (NULL != xpath)
+		xpathObj = xmlXPathCompiledEval(xpath, xpathCtx);
+	else
+		xpathObj = xmlXPathEvalExpression((xmlChar *)params, xpathCtx);
+
+	if (NULL == xpathObj)
 	{
 		if (NULL != (pErr = xmlGetLastError()))
 			*errmsg = zbx_dsprintf(*errmsg, "cannot parse xpath: %s", pErr->message);
@@ -361,6 +362,87 @@ out:
 	xmlFreeDoc(doc);
 
 	return ret;
+}
+#endif
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: execute xpath query                                               *
+ *                                                                            *
+ * Parameters: value  - [IN/OUT] the value to process                         *
+ *             params - [IN] the operation parameters                         *
+ *             errmsg - [OUT] error message                                   *
+ *                                                                            *
+ * Return value: SUCCEED - the value was processed successfully               *
+ *               FAIL - otherwise                                             *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_query_xpath(zbx_variant_t *value, const char *params, char **errmsg)
+{
+#ifndef HAVE_LIBXML2
+	ZBX_UNUSED(value);
+	ZBX_UNUSED(params);
+	*errmsg = zbx_dsprintf(*errmsg, "Zabbix was compiled without libxml2 support");
+	return FAIL;
+#else
+	return xml_query_xpath(value, params, NULL, errmsg);
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: execute xpath query compiled by zbx_xpath_compile()               *
+ *                                                                            *
+ * Parameters: value  - [IN/OUT] the value to process                         *
+ *             xpath  - [IN] the compiled xpath expression                    *
+ *             errmsg - [OUT] error message                                   *
+ *                                                                            *
+ * Return value: SUCCEED - the value was processed successfully               *
+ *               FAIL - otherwise                                             *
+ *                                                                            *
+ ******************************************************************************/
+int	zbx_query_xpath_compiled(zbx_variant_t *value, void *xpath, char **errmsg)
+{
+#ifndef HAVE_LIBXML2
+	ZBX_UNUSED(value);
+	ZBX_UNUSED(xpath);
+	*errmsg = zbx_dsprintf(*errmsg, "Zabbix was compiled without libxml2 support");
+	return FAIL;
+#else
+	return xml_query_xpath(value, NULL, (xmlXPathCompExprPtr)xpath, errmsg);
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: compile xpath expression to be evaluated multiple times           *
+ *                                                                            *
+ * Parameters: expression - [IN] the xpath expression                         *
+ *                                                                            *
+ * Return value: the compiled expression or NULL if it cannot be compiled     *
+ *                                                                            *
+ ******************************************************************************/
+void	*zbx_xpath_compile(const char *expression)
+{
+#ifndef HAVE_LIBXML2
+	ZBX_UNUSED(expression);
+	return NULL;
+#else
+	return (void *)xmlXPathCompile((const xmlChar *)expression);
+#endif
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: free xpath expression compiled by zbx_xpath_compile()             *
+ *                                                                            *
+ ******************************************************************************/
+void	zbx_xpath_free(void *xpath)
+{
+#ifndef HAVE_LIBXML2
+	ZBX_UNUSED(xpath);
+#else
+	xmlXPathFreeCompExpr((xmlXPathCompExprPtr)xpath);
 #endif
 }
 
@@ -85,6 +85,7 @@ static int	proxy_data_sender(int *more, int now, int *hist_upload_state, const z
 		const zbx_thread_info_t *info, int config_timeout)
 {
 	static int		data_timestamp = 0, task_timestamp = 0, upload_state = SUCCEED;
+	static unsigned char	history_format = ZBX_PROXY_HISTORY_FORMAT_JSON;
 
 	zbx_socket_t		sock;
 	struct zbx_json		j, j1;
@@ -116,7 +117,7 @@ static int	proxy_data_sender(int *more, int now, int *hist_upload_state, const z
 		glb_state_hosts_get_changed_ifaces_json(last_avail_export_ts, &j);
 		zbx_json_close(&j);
 		
-		history_records = zbx_proxy_get_hist_data(&j, &history_lastid, &more_history);
+		history_records = zbx_proxy_get_hist_data(&j, history_format, &history_lastid, &more_history);
 		if (0 != history_lastid)
 			flags |= ZBX_DATASENDER_HISTORY;
 
@@ -212,6 +213,15 @@ static int	proxy_data_sender(int *more, int now, int *hist_upload_state, const z
 		}
 		else
 		{
+			unsigned char	sent_format = history_format;
+
+			/* the server announces binary history support in its responses, the history sent */
+			/* in binary to a server which does not confirm it is not marked as sent            */
+			history_format = zbx_get_proxy_history_format(sock.buffer);
+
+			if (ZBX_PROXY_HISTORY_FORMAT_BINARY == sent_format && sent_format != history_format)
+				flags &= ~(zbx_uint64_t)ZBX_DATASENDER_HISTORY;
+
 			zbx_set_availability_diff_ts(avail_exported_ts);
 
 			if (SUCCEED == zbx_json_open(sock.buffer, &jp))
@@ -26,6 +26,7 @@
 #include "zbxrtc.h"
 #include "zbxnum.h"
 #include "zbxtime.h"
+#include "zbxproxyjournal.h"
 #include "zbx_rtc_constants.h"
 #include "../../libs/glb_state/glb_state.h"
 
@@ -116,7 +117,16 @@ static int	housekeeping_history(int now)
 
         zabbix_log(LOG_LEVEL_DEBUG, "In housekeeping_history()");
 
-	records += delete_history("proxy_history", "history_lastid", now);
+	if (SUCCEED == zbx_proxy_journal_enabled())
+	{
+		int	segments;
+
+		if (0 != (segments = zbx_proxy_journal_housekeep(now)))
+			zabbix_log(LOG_LEVEL_DEBUG, "removed %d proxy history journal segments", segments);
+	}
+	else
+		records += delete_history("proxy_history", "history_lastid", now);
+
 	records += delete_history("proxy_dhistory", "dhistory_lastid", now);
 	records += delete_history("proxy_autoreg_host", "autoreg_host_lastid", now);
 
@@ -63,6 +63,7 @@
 #include "zbx_rtc_constants.h"
 #include "zbxicmpping.h"
 #include "zbxipcservice.h"
+#include "zbxproxyjournal.h"
 
 #include "preproc.h"
 #include "../zabbix_server/ipmi/ipmi_manager.h"
@@ -199,7 +200,11 @@ char *CONFIG_GLBMAP_LOCATION	= NULL;
 char *CONFIG_SNMP_WORKER_LOCATION = NULL;
 char *CONFIG_GLBMAP_OPTIONS		= NULL;
 int	CONFIG_SNMP_RETRIES			= 2;
+int	CONFIG_SNMP_MAX_VARBINDS		= 32;
+int	CONFIG_SNMP_MAX_PDU_SIZE		= 1400;
+int	CONFIG_SNMP_BULK_MAX_REPETITIONS	= 20;
 char *CONFIG_VCDUMP_LOCATION	= NULL;
+int CONFIG_VALUECACHE_COMPRESS = 0;
 int CONFIG_DISABLE_SNMPV1_ASYNC = 0;
 int CONFIG_SELF_MONITOR_PORT		= DEFAULT_SELF_MONITOR_PORT;
 char	*CONFIG_SELF_MONITOR_IP		= NULL;
@@ -301,6 +306,8 @@ int	CONFIG_TRAPPER_TIMEOUT		= 300;
 int	CONFIG_HOUSEKEEPING_FREQUENCY	= 1;
 int	CONFIG_PROXY_LOCAL_BUFFER	= 0;
 int	CONFIG_PROXY_OFFLINE_BUFFER	= 1;
+char	*CONFIG_PROXY_HISTORY_JOURNAL	= NULL;
+zbx_uint64_t	CONFIG_PROXY_HISTORY_JOURNAL_SIZE	= ZBX_GIBIBYTE;
 
 int	CONFIG_HEARTBEAT_FREQUENCY	= -1;
 
@@ -338,6 +345,9 @@ char	*CONFIG_HOSTNAME		= NULL;
 char	*CONFIG_HOSTNAME_ITEM		= NULL;
 
 char	*CONFIG_SNMPTRAP_FILE		= NULL;
+char	*CONFIG_SNMPTRAP_LISTEN_IP	= NULL;
+int	CONFIG_SNMPTRAP_LISTEN_PORT	= 0;
+char	*CONFIG_SNMPTRAP_COMMUNITY	= NULL;
 
 char	*CONFIG_JAVA_GATEWAY		= NULL;
 int	CONFIG_JAVA_GATEWAY_PORT	= ZBX_DEFAULT_GATEWAY_PORT;
@@ -353,6 +363,7 @@ char	*CONFIG_USER			= NULL;
 char 	*ICMP_METHOD_STR = NULL;
 
 u_int64_t 		CONFIG_IPC_BUFFER_SIZE		= 512 * ZBX_MEBIBYTE;
+u_int64_t 		CONFIG_IPC_RING_SIZE		= 0;
 /* web monitoring */
 char	*CONFIG_SSL_CA_LOCATION		= NULL;
 char	*CONFIG_SSL_CERT_LOCATION	= NULL;
@@ -499,6 +510,11 @@ int	get_process_info_by_thread(int local_server_num, unsigned char *local_proces
 		*local_process_type = GLB_PROCESS_TYPE_AGENT;
 		*local_process_num = local_server_num - server_count + CONFIG_FORKS[GLB_PROCESS_TYPE_AGENT];
 	}
+	else if (local_server_num <= (server_count +=CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP] ))
+	{
+		*local_process_type = GLB_PROCESS_TYPE_HTTP;
+		*local_process_num = local_server_num - server_count + CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP];
+	}
 	else if (local_server_num <= (server_count +=CONFIG_FORKS[GLB_PROCESS_TYPE_PINGER] ))
 	{
 		*local_process_type = GLB_PROCESS_TYPE_PINGER;
@@ -721,6 +737,8 @@ static void	zbx_validate_config(ZBX_TASK_EX *task)
 	err |= (FAIL == check_cfg_feature_str("Vault", zbx_config_vault.name, "cURL library"));
 	err |= (FAIL == check_cfg_feature_str("VaultToken", zbx_config_vault.token, "cURL library"));
 	err |= (FAIL == check_cfg_feature_str("VaultDBPath", zbx_config_vault.db_path, "cURL library"));
+	err |= (FAIL == check_cfg_feature_int("StartGlbHttpPollers", CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP],
+			"cURL library"));
 #endif
 #if !defined(HAVE_LIBXML2) || !defined(HAVE_LIBCURL)
 	err |= (FAIL == check_cfg_feature_int("StartVMwareCollectors", CONFIG_FORKS[ZBX_PROCESS_TYPE_VMWARE],
@@ -825,6 +843,9 @@ static void set_config_defaults() {
 	CONFIG_FORKS[GLB_PROCESS_TYPE_SERVER] = 1;
 	CONFIG_FORKS[GLB_PROCESS_TYPE_AGENT] = 1;
 	CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR] = 4;
+#ifdef HAVE_LIBCURL
+	CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP] = 1;
+#endif
 }
 
 /******************************************************************************
@@ -856,8 +877,16 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			 PARM_OPT, 1, 1000},
 		{"IPCBufferSize",		&CONFIG_IPC_BUFFER_SIZE,		TYPE_UINT64,
 			PARM_OPT,	1024*1024,			__UINT64_C(64) * ZBX_GIBIBYTE},	
+		{"IPCRingSize",			&CONFIG_IPC_RING_SIZE,			TYPE_UINT64,
+			PARM_OPT,	0,			64 * ZBX_MEBIBYTE},
 		{"SnmpRetries",			&CONFIG_SNMP_RETRIES,			TYPE_INT,
 			PARM_OPT,	1,			100},
+		{"SnmpMaxVarbinds",		&CONFIG_SNMP_MAX_VARBINDS,		TYPE_INT,
+			PARM_OPT,	1,			256},
+		{"SnmpMaxPDUSize",		&CONFIG_SNMP_MAX_PDU_SIZE,		TYPE_INT,
+			PARM_OPT,	484,			65000},
+		{"SnmpBulkMaxRepetitions",	&CONFIG_SNMP_BULK_MAX_REPETITIONS,	TYPE_INT,
+			PARM_OPT,	0,			1000},
 		{"DebugItem",			&CONFIG_DEBUG_ITEM,			TYPE_INT,
 			PARM_OPT,	0,			0},
 		{"DebugHost", &CONFIG_DEBUG_HOST, TYPE_INT,
@@ -910,12 +939,20 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			PARM_OPT,	0,			1000},
 		{"StartGlbAgentPollers",		&CONFIG_FORKS[GLB_PROCESS_TYPE_AGENT],			TYPE_INT,
 			PARM_OPT,	0,			10},	
+		{"StartGlbHttpPollers",		&CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP],			TYPE_INT,
+			PARM_OPT,	0,			10},
 		{"JavaGateway",			&CONFIG_JAVA_GATEWAY,			TYPE_STRING,
 			PARM_OPT,	0,			0},
 		{"JavaGatewayPort",		&CONFIG_JAVA_GATEWAY_PORT,		TYPE_INT,
 			PARM_OPT,	1024,			32767},
 		{"SNMPTrapperFile",		&CONFIG_SNMPTRAP_FILE,			TYPE_STRING,
 			PARM_OPT,	0,			0},
+		{"SNMPTrapperListenIP",		&CONFIG_SNMPTRAP_LISTEN_IP,		TYPE_STRING,
+			PARM_OPT,	0,			0},
+		{"SNMPTrapperListenPort",	&CONFIG_SNMPTRAP_LISTEN_PORT,		TYPE_INT,
+			PARM_OPT,	0,			65535},
+		{"SNMPTrapperCommunity",	&CONFIG_SNMPTRAP_COMMUNITY,		TYPE_STRING_LIST,
+			PARM_OPT,	0,			0},
 		{"StartSNMPTrapper",		&CONFIG_FORKS[ZBX_PROCESS_TYPE_SNMPTRAPPER],		TYPE_INT,
 			PARM_OPT,	0,			1},
 		{"CacheSize",			&CONFIG_CONF_CACHE_SIZE,		TYPE_UINT64,
@@ -926,6 +963,10 @@ static void	zbx_load_config(ZBX_TASK_EX *task)
 			PARM_OPT,	0,			720},
 		{"ProxyOfflineBuffer",		&CONFIG_PROXY_OFFLINE_BUFFER,		TYPE_INT,
 			PARM_OPT,	1,			720},
+		{"ProxyHistoryJournal",		&CONFIG_PROXY_HISTORY_JOURNAL,		TYPE_STRING,
+			PARM_OPT,	0,			0},
+		{"ProxyHistoryJournalSize",	&CONFIG_PROXY_HISTORY_JOURNAL_SIZE,	TYPE_UINT64,
+			PARM_OPT,	16 * ZBX_MEBIBYTE,	ZBX_TEBIBYTE},
 		{"HeartbeatFrequency",		&CONFIG_HEARTBEAT_FREQUENCY,		TYPE_INT,
 			PARM_OPT,	0,			ZBX_PROXY_HEARTBEAT_FREQUENCY_MAX},
 		{"ConfigFrequency",		&CONFIG_CONFSYNCER_FREQUENCY,		TYPE_INT,
@@ -1558,6 +1599,15 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 		zbx_free(error);
 		exit(EXIT_FAILURE);
 	}
+
+	if (NULL != CONFIG_PROXY_HISTORY_JOURNAL && '\0' != *CONFIG_PROXY_HISTORY_JOURNAL &&
+			SUCCEED != zbx_proxy_journal_init(CONFIG_PROXY_HISTORY_JOURNAL,
+			CONFIG_PROXY_HISTORY_JOURNAL_SIZE, CONFIG_PROXY_OFFLINE_BUFFER * SEC_PER_HOUR, &error))
+	{
+		zabbix_log(LOG_LEVEL_CRIT, "cannot initialize proxy history journal: %s", error);
+		zbx_free(error);
+		exit(EXIT_FAILURE);
+	}
 	
 	
 	if (SUCCEED != init_configuration_cache(&error))
@@ -1707,6 +1757,11 @@ int	MAIN_ZABBIX_ENTRY(int flags)
 				LOG_INF("Starting AGENT glb poller of type %d", poller_args.poller_type);
 				zbx_thread_start(glbpoller_thread, &thread_args, &threads[i]);
 				break;
+			case GLB_PROCESS_TYPE_HTTP:
+				thread_args.args = &poller_args;
+				LOG_INF("Starting HTTP glb poller of type %d", poller_args.poller_type);
+				zbx_thread_start(glbpoller_thread, &thread_args, &threads[i]);
+				break;
 			case GLB_PROCESS_TYPE_PREPROCESSOR:
 				zbx_thread_start(glb_preprocessing_worker_thread, &thread_args, &threads[i]);
 				break;
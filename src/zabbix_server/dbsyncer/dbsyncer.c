@@ -26,6 +26,7 @@
 #include "zbxcachehistory.h"
 #include "zbxexport.h"
 #include "zbxprof.h"
+#include "zbxproxyjournal.h"
 #include "trends.h"
 
 
@@ -193,7 +194,12 @@ ZBX_THREAD_ENTRY(dbsyncer_thread, args)
 	/* database APIs might not handle signals correctly and hang, block signals to avoid hanging */
 	zbx_block_signals(&orig_mask);
 
+	/* the batch kept after a failed journal write is not lost on shutdown */
+	if (SUCCEED == zbx_proxy_journal_enabled())
+		zbx_proxy_journal_flush();
+
 	trends_destroy_cache();
+	glb_history_destroy();
 
 	zbx_db_close();
 	zbx_unblock_signals(&orig_mask);
@@ -0,0 +1,345 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+/* history writers take the history storage writes out of the dbsyncers:
+   syncers serialize the values to the shared memory queue and continue
+   with triggers and events, writers do the (possibly slow) storage calls.
+   When the queue memory is low the ipc blocks senders, so a stalled storage
+   slows down syncers instead of growing without limits */
+
+#include "history_writer.h"
+
+#include "log.h"
+#include "zbxnix.h"
+#include "zbxself.h"
+#include "zbxtime.h"
+#include "zbxshmem.h"
+#include "zbxstr.h"
+#include "zbxcacheconfig.h"
+#include "zbx_item_constants.h"
+#include "../../libs/zbxipcservice/glb_serial_buffer.h"
+#include "../../libs/zbxipcservice/glb_ipc2.h"
+#include "../glb_poller/internal.h"
+
+extern int CONFIG_FORKS[ZBX_PROCESS_TYPE_COUNT];
+extern size_t CONFIG_IPC_BUFFER_SIZE;
+
+static zbx_shmem_info_t	*history_ipc_mem;
+
+ZBX_SHMEM_FUNC_IMPL(_historyipc, history_ipc_mem);
+
+typedef struct {
+	mem_funcs_t memf;
+	ipc2_conf_t *ipc;
+	int *lag; /* per writer, seconds between enqueue and write of the last chunk */
+} history_writer_conf_t;
+
+/* the first item of each chunk */
+typedef struct {
+	int enqueued;
+	int num;
+} history_chunk_header_t;
+
+static history_writer_conf_t *conf = NULL;
+
+INTERNAL_METRIC_CALLBACK(history_writers_stat_cb) {
+	size_t alloc = 0, offset = 0;
+	int i, lag = 0;
+
+	for (i = 0; i < CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER]; i++)
+		lag = MAX(lag, conf->lag[i]);
+
+	zbx_snprintf_alloc(result, &alloc, &offset,
+			"{\"queue_size\":\"" ZBX_FS_UI64 "\", \"sent\":\"" ZBX_FS_UI64 "\", \"lag\":\"%d\","
+			"\"mem_total\":\"%ld\", \"mem_used\":\"%ld\",\"mem_free_pcnt\":\"%0.2f\"}",
+			ipc2_get_queue_size(conf->ipc), ipc2_get_sent_items(conf->ipc), lag,
+			history_ipc_mem->total_size, history_ipc_mem->used_size,
+			((double)history_ipc_mem->free_size * 100.0)/((double)history_ipc_mem->total_size));
+
+	return SUCCEED;
+}
+
+int history_writer_ipc_init(void) {
+	char *error = NULL;
+
+	if (0 == CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER])
+		return SUCCEED;
+
+	if (SUCCEED != zbx_shmem_create(&history_ipc_mem, CONFIG_IPC_BUFFER_SIZE, "History writers IPC buffer size",
+			"IPCBufferSize", 1, &error)) {
+		LOG_WRN("Shared memory create failed: %s", error);
+		return FAIL;
+	}
+
+	conf = _historyipc_shmem_malloc_func(NULL, sizeof(history_writer_conf_t));
+
+	conf->memf.free_func = _historyipc_shmem_free_func;
+	conf->memf.malloc_func = _historyipc_shmem_malloc_func;
+	conf->memf.realloc_func = _historyipc_shmem_realloc_func;
+
+	conf->lag = _historyipc_shmem_malloc_func(NULL, sizeof(int) * CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER]);
+	memset(conf->lag, 0, sizeof(int) * CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER]);
+
+	if (NULL == (conf->ipc = ipc2_init(CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER], &conf->memf, "->history",
+			history_ipc_mem)))
+		return FAIL;
+
+	/* writers wait on the queue instead of sleeping, so values don't wait for the next second */
+	if (SUCCEED != ipc2_init_wakeups(conf->ipc))
+		LOG_INF("History IPC wakeups are not supported, writers will poll the queue");
+
+	glb_register_internal_metric_handler("history_writers", history_writers_stat_cb);
+
+	return SUCCEED;
+}
+
+void history_writer_ipc_destroy(void) {
+	if (NULL != conf)
+		zbx_shmem_destroy(history_ipc_mem);
+}
+
+/* returns the union member of the value that points to the heap, same rules as freeing the values */
+static char **history_value_str_ptr(ZBX_DC_HISTORY *h) {
+	if (ITEM_STATE_NOTSUPPORTED == h->state)
+		return &h->value.err;
+
+	if (ITEM_VALUE_TYPE_NONE == h->value_type || 0 != (ZBX_DC_FLAG_NOVALUE & h->flags))
+		return NULL;
+
+	if (ITEM_VALUE_TYPE_STR == h->value_type || ITEM_VALUE_TYPE_TEXT == h->value_type)
+		return &h->value.str;
+
+	return NULL;
+}
+
+static int history_value_is_log(const ZBX_DC_HISTORY *h) {
+	if (ITEM_STATE_NOTSUPPORTED == h->state || 0 != (ZBX_DC_FLAG_NOVALUE & h->flags) ||
+		ITEM_VALUE_TYPE_LOG != h->value_type || NULL == h->value.log)
+		return FAIL;
+
+	return SUCCEED;
+}
+
+static void *buffer_add_str(serial_buffer_t *sbuff, const char *str) {
+	if (NULL == str)
+		return NULL;
+
+	return serial_buffer_add_data(sbuff, (void *)str, strlen(str) + 1);
+}
+
+static void *buffer_get_str(void *buffer, const char *offset) {
+	if (NULL == offset)
+		return NULL;
+
+	return serial_buffer_get_real_addr(buffer, (u_int64_t)offset);
+}
+
+static void buffer_add_history(serial_buffer_t *sbuff, const ZBX_DC_HISTORY *h) {
+	ZBX_DC_HISTORY hist = *h;
+	char **str;
+
+	if (NULL != (str = history_value_str_ptr(&hist)))
+		*str = buffer_add_str(sbuff, *str);
+
+	if (SUCCEED == history_value_is_log(&hist)) {
+		zbx_log_value_t log = *h->value.log;
+
+		log.value = buffer_add_str(sbuff, log.value);
+		log.source = buffer_add_str(sbuff, log.source);
+		hist.value.log = serial_buffer_add_data(sbuff, &log, sizeof(zbx_log_value_t));
+	}
+
+	hist.host_name = buffer_add_str(sbuff, h->host_name);
+	hist.item_key = buffer_add_str(sbuff, h->item_key);
+
+	serial_buffer_add_item(sbuff, &hist, sizeof(ZBX_DC_HISTORY));
+}
+
+#define HISTORY_WRITER_BUFFER_SIZE	256 * ZBX_KIBIBYTE
+
+int history_writer_send_history(ZBX_DC_HISTORY *history, int history_num, int syncer_num) {
+	static serial_buffer_t *sbuff = NULL;
+	history_chunk_header_t hdr = {.enqueued = time(NULL), .num = history_num};
+	int i;
+
+	if (NULL == conf)
+		return glb_history_add_history(history, history_num);
+
+	if (0 == history_num)
+		return SUCCEED;
+
+	if (NULL == sbuff)
+		sbuff = serial_buffer_init(HISTORY_WRITER_BUFFER_SIZE);
+
+	serial_buffer_add_item(sbuff, &hdr, sizeof(hdr));
+
+	for (i = 0; i < history_num; i++)
+		buffer_add_history(sbuff, &history[i]);
+
+	/* all values of a syncer go to the same writer to keep the values order */
+	ipc2_send_chunk(conf->ipc, (syncer_num - 1) % ipc2_get_consumers(conf->ipc), history_num,
+		serial_buffer_get_buffer(sbuff), serial_buffer_get_used(sbuff), ALLOC_PRIORITY_NORMAL);
+
+	serial_buffer_clean(sbuff);
+
+	return SUCCEED;
+}
+
+/*******receiver-side functions *******/
+typedef struct {
+	ZBX_DC_HISTORY *history;
+	int num;
+	int alloc;
+	int enqueued;
+} history_batch_t;
+
+static void history_parse_cb(void *buffer, void *item, void *ctx_data, int i) {
+	history_batch_t *batch = ctx_data;
+	ZBX_DC_HISTORY *h;
+	char **str;
+
+	if (0 == i) {
+		history_chunk_header_t *hdr = item;
+
+		batch->enqueued = hdr->enqueued;
+		batch->num = 0;
+
+		if (hdr->num > batch->alloc) {
+			batch->alloc = hdr->num;
+			batch->history = zbx_realloc(batch->history, sizeof(ZBX_DC_HISTORY) * batch->alloc);
+		}
+		return;
+	}
+
+	/* items are copied out as they aren't aligned in the buffer */
+	h = &batch->history[batch->num++];
+	memcpy(h, item, sizeof(ZBX_DC_HISTORY));
+
+	if (NULL != (str = history_value_str_ptr(h)))
+		*str = buffer_get_str(buffer, *str);
+
+	if (SUCCEED == history_value_is_log(h)) {
+		h->value.log = serial_buffer_get_real_addr(buffer, (u_int64_t)h->value.log);
+		h->value.log->value = buffer_get_str(buffer, h->value.log->value);
+		h->value.log->source = buffer_get_str(buffer, h->value.log->source);
+	}
+
+	h->host_name = buffer_get_str(buffer, h->host_name);
+	h->item_key = buffer_get_str(buffer, h->item_key);
+}
+
+static void history_chunk_process_cb(void *buffer, void *ctx_data) {
+	history_batch_t *batch = ctx_data;
+
+	serial_buffer_process(buffer, history_parse_cb, batch);
+
+	/* the values point to the chunk memory which is freed after the callback */
+	glb_history_add_history(batch->history, batch->num);
+}
+
+static int history_writer_receive(int process_num, history_batch_t *batch) {
+	int num;
+
+	if (0 == (num = ipc2_receive_one_chunk(conf->ipc, NULL, process_num - 1, history_chunk_process_cb, batch)))
+		return 0;
+
+	conf->lag[process_num - 1] = time(NULL) - batch->enqueued;
+
+	return num;
+}
+
+ZBX_THREAD_ENTRY(history_writer_thread, args)
+{
+	int			total_values_num = 0, values_num, num;
+	double			sec;
+	time_t			last_stat_time;
+	char			*stats = NULL;
+	const char		*process_name;
+	size_t			stats_alloc = 0, stats_offset = 0;
+	history_batch_t		batch = {0};
+	const zbx_thread_info_t	*info = &((zbx_thread_args_t *)args)->info;
+	int			server_num = ((zbx_thread_args_t *)args)->info.server_num;
+	int			process_num = ((zbx_thread_args_t *)args)->info.process_num;
+	unsigned char		process_type = ((zbx_thread_args_t *)args)->info.process_type;
+
+	zabbix_log(LOG_LEVEL_INFORMATION, "%s #%d started [%s #%d]", get_program_type_string(info->program_type),
+			server_num, (process_name = get_process_type_string(process_type)), process_num);
+
+	zbx_update_selfmon_counter(info, ZBX_PROCESS_STATE_BUSY);
+
+#define STAT_INTERVAL	5	/* if a process is busy and does not sleep then update status not faster than */
+				/* once in STAT_INTERVAL seconds */
+
+	last_stat_time = time(NULL);
+	zbx_strcpy_alloc(&stats, &stats_alloc, &stats_offset, "started");
+
+	for (;;)
+	{
+		sec = zbx_time();
+		values_num = 0;
+
+		zbx_setproctitle("%s #%d [%s, writing history]", process_name, process_num, stats);
+
+		while (0 < (num = history_writer_receive(process_num, &batch))) {
+			values_num += num;
+
+			if (sec + 1 < zbx_time())
+				break;
+		}
+
+		/* lets the history modules do time based flushes of their buffers */
+		if (0 == values_num) {
+			glb_history_add_history(NULL, 0);
+			conf->lag[process_num - 1] = 0;
+		}
+
+		total_values_num += values_num;
+
+		if (STAT_INTERVAL <= time(NULL) - last_stat_time)
+		{
+			stats_offset = 0;
+			zbx_snprintf_alloc(&stats, &stats_alloc, &stats_offset, " %d values/sec, lag %d sec",
+					total_values_num/STAT_INTERVAL, conf->lag[process_num - 1]);
+
+			zbx_setproctitle("%s #%d [%s, writing history]", process_name, process_num, stats);
+			total_values_num = 0;
+			last_stat_time = time(NULL);
+		}
+
+		if (!ZBX_IS_RUNNING())
+			break;
+
+		if (0 == values_num) {
+			zbx_update_selfmon_counter(info, ZBX_PROCESS_STATE_IDLE);
+			ipc2_wait_wakeup(conf->ipc, process_num - 1, 1000);
+			zbx_update_selfmon_counter(info, ZBX_PROCESS_STATE_BUSY);
+		}
+	}
+
+	while (0 < history_writer_receive(process_num, &batch))
+		;
+
+	/* modules send the buffered values on destroy */
+	glb_history_destroy();
+
+	zbx_free(batch.history);
+	zbx_free(stats);
+
+	exit(EXIT_SUCCESS);
+#undef STAT_INTERVAL
+}
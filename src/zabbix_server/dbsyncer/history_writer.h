@@ -0,0 +1,32 @@
+/*
+** Copyright Glaber 2018-2023
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef GLB_HISTORY_WRITER_H
+#define GLB_HISTORY_WRITER_H
+
+#include "zbxthreads.h"
+#include "glb_history.h"
+
+int		history_writer_ipc_init(void);
+void	history_writer_ipc_destroy(void);
+
+int		history_writer_send_history(ZBX_DC_HISTORY *history, int history_num, int syncer_num);
+
+ZBX_THREAD_ENTRY(history_writer_thread, args);
+
+#endif
@@ -16,6 +16,8 @@
 #define SNMP_CMD_SET      (ASN1_CONTEXT | ASN1_CONSTRUCTOR | 0x03)
 #define SNMP_CMD_TRAP     (ASN1_CONTEXT | ASN1_CONSTRUCTOR | 0x04)
 #define SNMP_CMD_GET_BULK (ASN1_CONTEXT | ASN1_CONSTRUCTOR | 0x05)
+#define SNMP_CMD_INFORM   (ASN1_CONTEXT | ASN1_CONSTRUCTOR | 0x06)
+#define SNMP_CMD_TRAP2    (ASN1_CONTEXT | ASN1_CONSTRUCTOR | 0x07)
 
 #define SNMP_TP_BOOL     (ASN1_UNIVERSAL | 0x1)
 #define SNMP_TP_INT      (ASN1_UNIVERSAL | 0x2)
@@ -60,7 +62,7 @@ typedef struct {
 } csnmp_var_t;
 
 typedef struct {
-    struct sockaddr addr;
+    struct sockaddr_storage addr;
     socklen_t addr_len;
 
     int version;
@@ -89,6 +91,9 @@ int csnmp_add_error(csnmp_pdu_t* p, int code, const char* msg);
 int csnmp_set_error_index(csnmp_pdu_t* p, int code, int index);
 int csnmp_add_var(csnmp_pdu_t* p, asn1_oid_t oid, int tp, void* val);
 
+int snmp_dec_pdu(const char* buf, int buf_len, csnmp_pdu_t* p);
+int snmp_enc_pdu(char** buf, int* i, int* buf_len, csnmp_pdu_t* p);
+
 int csnmp_bind(uint32_t addr, int port);
 int csnmp_bind_addr(const char* addr);
 int csnmp_close(int fd);
@@ -34,6 +34,7 @@
 #include "glb_worker.h"
 #include "glb_server.h"
 #include "poller_tcp.h"
+#include "poller_http.h"
 #include "calculated.h"
 #include "poller_snmp_worker.h"
 
@@ -56,8 +57,10 @@ extern int  CONFIG_FORKS[ZBX_PROCESS_TYPE_COUNT];
 #define LOST_ITEMS_CHECK_INTERVAL 30 * 1000
 #define NEW_ITEMS_CHECK_INTERVAL 2 * 1000
 #define PROCTITLE_UPDATE_INTERVAL 5 * 1000
+#define NEXTCHECKS_FLUSH_INTERVAL 1 * 1000
 #define ASYNC_RUN_INTERVAL 1
 #define ITEMS_REINIT_INTERVAL 300  // after this time in poller item will be repolled whatever it's state is
+#define NEXTCHECKS_BATCH 1024 // that many updated nextchecks are saved to the state cache at once
 
 typedef struct
 {
@@ -118,6 +121,9 @@ typedef struct
 	poller_event_t *async_io_proc;
 	poller_event_t *lost_items_check;
 	poller_event_t *preprocessing_flush;
+	poller_event_t *nextchecks_flush;
+
+	zbx_hashset_t nextchecks;
 
 } poll_engine_t;
 
@@ -151,6 +157,41 @@ static int item_interface_is_pollable(poller_item_t *item, int *disabled_till) {
 
 }
 
+/* only the last nextcheck of an item matters, so the updates are collected
+   by the itemid and saved to the state cache in batches */
+static void poller_nextchecks_flush()
+{
+	glb_state_item_nextcheck_t *nextchecks, *nextcheck;
+	zbx_hashset_iter_t iter;
+	int num = 0;
+
+	if (0 == conf.nextchecks.num_data)
+		return;
+
+	nextchecks = zbx_malloc(NULL, sizeof(glb_state_item_nextcheck_t) * conf.nextchecks.num_data);
+	zbx_hashset_iter_reset(&conf.nextchecks, &iter);
+
+	while (NULL != (nextcheck = zbx_hashset_iter_next(&iter)))
+		nextchecks[num++] = *nextcheck;
+
+	qsort(nextchecks, num, sizeof(glb_state_item_nextcheck_t), ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	glb_state_items_update_nextchecks(nextchecks, num);
+
+	zbx_free(nextchecks);
+	zbx_hashset_clear(&conf.nextchecks);
+}
+
+static void poller_set_item_nextcheck(u_int64_t itemid, int nextcheck)
+{
+	glb_state_item_nextcheck_t *item_nextcheck, local_nextcheck = {.itemid = itemid};
+
+	item_nextcheck = zbx_hashset_insert(&conf.nextchecks, &local_nextcheck, sizeof(glb_state_item_nextcheck_t));
+	item_nextcheck->nextcheck = nextcheck;
+
+	if (NEXTCHECKS_BATCH <= conf.nextchecks.num_data)
+		poller_nextchecks_flush();
+}
+
 static int poller_update_item_nextcheck(poller_item_t *poller_item, int base_time) {
 	
 	int simple_interval, disabled_till, now = time(NULL);
@@ -167,7 +208,7 @@ static int poller_update_item_nextcheck(poller_item_t *poller_item, int base_tim
 	if (SUCCEED != zbx_interval_preproc(delay, &simple_interval, &custom_intervals, &error)) {
 		zabbix_log(LOG_LEVEL_INFORMATION, "Itemd %ld has wrong delay time set :%s :%s", poller_item->itemid, poller_item->delay, error);
 		poller_preprocess_error(poller_item, "error");
-		glb_state_item_update_nextcheck(poller_item->itemid, FAIL);
+		poller_set_item_nextcheck(poller_item->itemid, FAIL);
 		return FAIL;
 	}
 
@@ -180,7 +221,7 @@ static int poller_update_item_nextcheck(poller_item_t *poller_item, int base_tim
 
 	zbx_custom_interval_free(custom_intervals);
 
-	glb_state_item_update_nextcheck(poller_item->itemid, nextcheck);
+	poller_set_item_nextcheck(poller_item->itemid, nextcheck);
 
 	return nextcheck;
 }
@@ -337,7 +378,7 @@ int glb_poller_create_item(DC_ITEM *dc_item)
 	};
 
 	poller_run_timer_event(poller_item->poll_event, POLLER_NEW_ITEM_DELAY_TIME * 1000);
-	glb_state_item_update_nextcheck(dc_item->itemid, nextcheck + POLLER_NEW_ITEM_DELAY_TIME);
+	poller_set_item_nextcheck(dc_item->itemid, nextcheck + POLLER_NEW_ITEM_DELAY_TIME);
 
 	return SUCCEED;
 }
@@ -371,6 +412,11 @@ static int poll_module_init()
 		//glb_poller_agent_init();
 		break;
 
+	case GLB_PROCESS_TYPE_HTTP:
+		if (SUCCEED != glb_http_init())
+			return FAIL;
+		break;
+
 	case ZBX_PROCESS_TYPE_HISTORYPOLLER:
 		calculated_poller_init();
 		break;
@@ -389,6 +435,8 @@ void poll_shutdown()
 	if (NULL != conf.poller.shutdown) 
 		conf.poller.shutdown();
 
+	poller_nextchecks_flush();
+	zbx_hashset_destroy(&conf.nextchecks);
 	zbx_hashset_destroy(&conf.hosts);
 	zbx_hashset_destroy(&conf.items);
 	poller_contention_destroy();
@@ -437,6 +485,10 @@ static void preprocessing_flush_cb(poller_item_t *garbage, void *data) {
 	preprocessing_flush();
 }
 
+static void nextchecks_flush_cb(poller_item_t *garbage, void *data) {
+	poller_nextchecks_flush();
+}
+
 static void update_proc_title_cb(poller_item_t *garbage, void *data)
 {
 	static u_int64_t last_call = 0;
@@ -482,6 +534,7 @@ static int poller_init(zbx_thread_args_t *args)
 
 	zbx_hashset_create(&conf.items, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
 	zbx_hashset_create(&conf.hosts, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	zbx_hashset_create(&conf.nextchecks, NEXTCHECKS_BATCH, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
 
 	strpool_init(&conf.strpool, &local_memf);
 
@@ -496,6 +549,9 @@ static int poller_init(zbx_thread_args_t *args)
 	conf.preprocessing_flush = poller_create_event(NULL, preprocessing_flush_cb, 0, args, 1);
 	poller_run_timer_event(conf.preprocessing_flush, PROCTITLE_UPDATE_INTERVAL);
 
+	conf.nextchecks_flush = poller_create_event(NULL, nextchecks_flush_cb, 0, NULL, 1);
+	poller_run_timer_event(conf.nextchecks_flush, NEXTCHECKS_FLUSH_INTERVAL);
+
 	conf.lost_items_check = poller_create_event(NULL, lost_items_check_cb, 0, NULL, 1);
 	poller_run_timer_event(conf.lost_items_check, LOST_ITEMS_CHECK_INTERVAL);
 
@@ -568,7 +624,7 @@ void poller_return_delayed_item_to_queue(poller_item_t *item)
 
 	DEBUG_ITEM(item->itemid,"Item returned to the poller's queue, will repoll in %d sec", nextcheck);
 	
-	glb_state_item_update_nextcheck(item->itemid, time(NULL) + nextcheck * 1000 );
+	poller_set_item_nextcheck(item->itemid, time(NULL) + nextcheck * 1000 );
 	item->lastpolltime = time(NULL);
 	item->poll_state = POLL_QUEUED;
 
@@ -761,4 +817,74 @@ ZBX_THREAD_ENTRY(glbpoller_thread, args)
 	while (1)
 		zbx_sleep(SEC_PER_MIN);
 	
-}
\ No newline at end of file
+}
+
+#ifdef HAVE_GLB_TESTS
+/* the tests poll the items of a module directly, without the config cache, the poller's timers
+   and the item's interface state; the module reports the results by its own callbacks */
+void poller_test_init(void)
+{
+	mem_funcs_t local_memf = {.free_func = ZBX_DEFAULT_MEM_FREE_FUNC, 
+	  					.malloc_func = ZBX_DEFAULT_MEM_MALLOC_FUNC, 
+						.realloc_func = ZBX_DEFAULT_MEM_REALLOC_FUNC};
+
+	poller_contention_init();
+	zbx_hashset_create(&conf.items, 100, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC);
+	strpool_init(&conf.strpool, &local_memf);
+	poller_async_loop_init();
+}
+
+int poller_test_add_item(DC_ITEM *dc_item)
+{
+	poller_item_t *poller_item, local_item = {.itemid = dc_item->itemid};
+
+	poller_item = zbx_hashset_insert(&conf.items, &local_item, sizeof(local_item));
+	poller_item->poll_state = POLL_QUEUED;
+	poller_item->hostid = dc_item->host.hostid;
+	poller_item->value_type = dc_item->value_type;
+	poller_item->item_type = dc_item->type;
+
+	if (FAIL == conf.poller.init_item(dc_item, poller_item))
+	{
+		zbx_hashset_remove_direct(&conf.items, poller_item);
+		return FAIL;
+	}
+
+	return SUCCEED;
+}
+
+int poller_test_poll_item(u_int64_t itemid)
+{
+	poller_item_t *poller_item = poller_get_poller_item(itemid);
+
+	poller_item->poll_state = POLL_POLLING;
+
+	return conf.poller.start_poll(poller_item);
+}
+
+int poller_test_item_is_queued(u_int64_t itemid)
+{
+	return POLL_QUEUED == poller_get_poller_item(itemid)->poll_state;
+}
+
+void poller_test_destroy(void)
+{
+	zbx_hashset_iter_t iter;
+	poller_item_t *poller_item;
+
+	zbx_hashset_iter_reset(&conf.items, &iter);
+
+	while (NULL != (poller_item = zbx_hashset_iter_next(&iter)))
+		conf.poller.delete_item(poller_item);
+
+	if (NULL != conf.poller.shutdown)
+		conf.poller.shutdown();
+
+	zbx_hashset_destroy(&conf.items);
+	poller_contention_destroy();
+	strpool_destroy(&conf.strpool);
+
+	zbx_free(conf.poller.proto_name);
+	memset(&conf.poller, 0, sizeof(conf.poller));
+}
+#endif
@@ -105,6 +105,14 @@ const char *poller_strpool_add(const char * str);
 const char *poller_strpool_copy(const char * str);
 
 void poller_preprocess_error(poller_item_t *poller_item, const char *error);
+
+#ifdef HAVE_GLB_TESTS
+void	poller_test_init(void);
+int	poller_test_add_item(DC_ITEM *dc_item);
+int	poller_test_poll_item(u_int64_t itemid);
+int	poller_test_item_is_queued(u_int64_t itemid);
+void	poller_test_destroy(void);
+#endif
 void poller_preprocess_str(poller_item_t *poller_item, zbx_timespec_t *ts, const char *value);
 
 #endif
@@ -25,80 +25,311 @@
 #include <event2/dns.h>
 #include <event2/util.h>
 
+/* timers are kept in a hierarchical timing wheel of millisecond ticks: each level has
+   256 slots, the first one covers the next 256 msec, the upper ones are cascaded down
+   when the lower level wraps. Insert and cancel are O(1), libevent only gets one timer
+   to wake up at the nearest non-empty slot, plus the io events */
+#define WHEEL_LEVELS	4
+#define WHEEL_BITS		8
+#define WHEEL_SIZE		(1 << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SIZE - 1)
+#define WHEEL_MAX_DELAY	((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+typedef struct {
+	poller_event_t *slots[WHEEL_LEVELS][WHEEL_SIZE];
+	int	level_count[WHEEL_LEVELS];
+	int	count;
+	u_int64_t now; /* the next tick to process, msec */
+	u_int64_t wakeup; /* when the tick event is armed for, 0 if it isn't */
+	poller_event_t *firing; /* events of the slot being processed */
+	struct event *tick_event;
+} timer_wheel_t;
+
 typedef struct {
 	struct evdns_base *evdns_base;
 	struct event_base *events_base;
 	resolve_cb resolve_callback;
 	resolve_fail_cb resolve_fail_callback;
 	u_int32_t dns_requests;
+	timer_wheel_t wheel;
 } async_poller_conf_t;
 
 struct poller_event_t {
  	u_int64_t itemid;
  	poller_event_cb_func_t cb_func;
  	void* data;
- 	struct event* event;
+ 	struct event* event; /* io events only */
+	
+	/* timer events only */
+	u_int64_t expire;
+	u_int64_t interval;
+	poller_event_t *next;
+	poller_event_t *prev;
+	poller_event_t **list; /* the slot the event is linked to, NULL if not scheduled */
+	unsigned char level;
+	unsigned char persist;
  };
 
 static async_poller_conf_t conf = {0};
 
-static void poller_cb(int fd, short int flags, void *data) {
+#ifdef HAVE_GLB_TESTS
+static u_int64_t test_time_ms = 0;
+#endif
+
+static u_int64_t wheel_time_ms() {
+	struct timespec ts;
+
+#ifdef HAVE_GLB_TESTS
+	if (0 != test_time_ms)
+		return test_time_ms;
+#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void wheel_link(poller_event_t **list, poller_event_t *poll_event) {
+	poll_event->prev = NULL;
+	poll_event->next = *list;
+	
+	if (NULL != *list)
+		(*list)->prev = poll_event;
+
+	*list = poll_event;
+	poll_event->list = list;
+}
+
+static void wheel_unlink(timer_wheel_t *wheel, poller_event_t *poll_event) {
+	if (NULL == poll_event->list)
+		return;
+
+	if (NULL != poll_event->prev)
+		poll_event->prev->next = poll_event->next;
+	else
+		*poll_event->list = poll_event->next;
+
+	if (NULL != poll_event->next)
+		poll_event->next->prev = poll_event->prev;
+
+	if (poll_event->list != &wheel->firing)
+		wheel->level_count[poll_event->level]--;
+
+	poll_event->list = NULL;
+	poll_event->next = NULL;
+	poll_event->prev = NULL;
+	wheel->count--;
+}
+
+/* the event goes to the lowest level where it shares all the upper bits with the current
+   time, so it is always cascaded down before it's due */
+static void wheel_place(timer_wheel_t *wheel, poller_event_t *poll_event) {
+	int level = 0;
+
+	while (level < WHEEL_LEVELS - 1 && 
+			(poll_event->expire >> (WHEEL_BITS * (level + 1))) != (wheel->now >> (WHEEL_BITS * (level + 1))))
+		level++;
+
+	poll_event->level = level;
+	wheel->level_count[level]++;
+	wheel_link(&wheel->slots[level][(poll_event->expire >> (WHEEL_BITS * level)) & WHEEL_MASK], poll_event);
+}
+
+static void wheel_arm(timer_wheel_t *wheel, u_int64_t at) {
+	u_int64_t now = wheel_time_ms(), delay = at > now ? at - now : 0;
+	struct timeval tv = { .tv_sec = delay / 1000, .tv_usec = (delay % 1000) * 1000 };
+
+	wheel->wakeup = at;
+	event_add(wheel->tick_event, &tv);
+}
+
+static void wheel_add(timer_wheel_t *wheel, poller_event_t *poll_event, u_int64_t delay) {
+	
+	if (0 == wheel->count) /* nothing to process in between, the wheel might be idle for a long time */
+		wheel->now = MAX(wheel->now, wheel_time_ms());
+
+	if (delay > WHEEL_MAX_DELAY)
+		delay = WHEEL_MAX_DELAY;
+
+	poll_event->expire = MAX(wheel->now, wheel_time_ms() + delay);
+	
+	if (poll_event->expire - wheel->now > WHEEL_MAX_DELAY)
+		poll_event->expire = wheel->now + WHEEL_MAX_DELAY;
 	
-	poller_event_t *poll_event = data;
+	wheel->count++;
+	wheel_place(wheel, poll_event);
+
+	if (0 == wheel->wakeup || poll_event->expire < wheel->wakeup)
+		wheel_arm(wheel, poll_event->expire);
+}
+
+static void wheel_cascade(timer_wheel_t *wheel, int level) {
+	poller_event_t **slot = &wheel->slots[level][(wheel->now >> (WHEEL_BITS * level)) & WHEEL_MASK], *poll_event;
+
+	while (NULL != (poll_event = *slot)) {
+		wheel_unlink(wheel, poll_event);
+		wheel->count++;
+		wheel_place(wheel, poll_event);
+	}
+}
+
+static void poller_fire_event(poller_event_t *poll_event) {
 	poller_item_t *poller_item = poller_get_poller_item(poll_event->itemid);
-	DEBUG_ITEM(poll_event->itemid, "Item event %p has fired", poll_event->event);
+	
+	DEBUG_ITEM(poll_event->itemid, "Item event %p has fired", poll_event);
 
 	if (0 == poll_event->itemid || NULL != poller_item)  {
 		poll_event->cb_func(poller_item,poll_event->data);
 	} 
 }
 
+/* processes all the ticks up to the current time, events of a slot are moved to the firing list
+   first, so callbacks are free to add and delete any events */
+static void wheel_run(timer_wheel_t *wheel) {
+	u_int64_t target = wheel_time_ms();
+	poller_event_t *poll_event;
+	int i, idx;
+
+	while (wheel->now <= target && 0 < wheel->count) {
+		idx = wheel->now & WHEEL_MASK;
+
+		if (0 == idx) {
+			for (i = 1; i < WHEEL_LEVELS; i++) {
+				wheel_cascade(wheel, i);
+				if (0 != ((wheel->now >> (WHEEL_BITS * i)) & WHEEL_MASK))
+					break;
+			}
+		} else if (0 == wheel->level_count[0]) {
+			/* nothing until the next cascade */
+			wheel->now = MIN(target + 1, (wheel->now | WHEEL_MASK) + 1);
+			continue;
+		}
+		
+		if (NULL != wheel->slots[0][idx]) {
+			wheel->firing = wheel->slots[0][idx];
+			wheel->slots[0][idx] = NULL;
+			
+			for (poll_event = wheel->firing; NULL != poll_event; poll_event = poll_event->next) {
+				poll_event->list = &wheel->firing;
+				wheel->level_count[0]--;
+			}
+		}
+		
+		wheel->now++;
+
+		while (NULL != (poll_event = wheel->firing)) {
+			wheel_unlink(wheel, poll_event);
+
+			if (poll_event->persist)
+				wheel_add(wheel, poll_event, poll_event->interval);
+			
+			poller_fire_event(poll_event);
+		}
+	}
+
+	if (0 == wheel->count)
+		wheel->now = MAX(wheel->now, target + 1);
+}
+
+/* wakes up at the nearest non-empty slot of the lowest level or at the next cascade */
+static void wheel_tick_cb(int fd, short int flags, void *data) {
+	timer_wheel_t *wheel = data;
+	u_int64_t next;
+	int i, idx;
+
+	wheel->wakeup = 0;
+	wheel_run(wheel);
+
+	if (0 == wheel->count)
+		return;
+
+	idx = wheel->now & WHEEL_MASK;
+	
+	for (i = idx; i < WHEEL_SIZE && NULL == wheel->slots[0][i]; i++)
+		;
+
+	/* on the zero index the upper levels are still to be cascaded */
+	next = (0 == idx) ? wheel->now : wheel->now + (i - idx);
+
+	/* callbacks might have armed it already, but for a later time */
+	if (0 == wheel->wakeup || next < wheel->wakeup)
+		wheel_arm(wheel, next);
+}
+
+static void poller_cb(int fd, short int flags, void *data) {
+	poller_fire_event(data);
+}
+
 poller_event_t* poller_create_event(poller_item_t *poller_item, poller_event_cb_func_t callback_func, int fd, void *data, int persist) {
 	short int flags = 0;
 	poller_event_t *poller_event = zbx_calloc(NULL, 0, sizeof(poller_event_t));
 	
-	if ( 0 != fd)
-		flags = EV_READ;
+	poller_event->cb_func = callback_func;
+	poller_event->data = data;
+	poller_event->persist = persist;
+
+	if (NULL != poller_item) 
+		poller_event->itemid = poller_item_get_id(poller_item);
+
+	/* timers go to the wheel */
+	if (0 == fd)
+		return poller_event;
+
+	flags = EV_READ;
 	
 	if ( persist) 
 		flags |= EV_PERSIST;
 
-	poller_event->cb_func = callback_func;
-	poller_event->data = data;
-	
 	poller_event->event = event_new(conf.events_base, fd, flags, poller_cb, poller_event);
 	
 	/*note: give io more priority */
-	if (fd != 0) {
-		 event_priority_set(poller_event->event, 0);
-	} else {
-		 event_priority_set(poller_event->event, 1);
-	}
-
-	if (NULL != poller_item) 
-		poller_event->itemid = poller_item_get_id(poller_item);
+	event_priority_set(poller_event->event, 0);
 
 	return poller_event;
 };
 
+/* fd events are processed before the timers, an fd which is ready all the time
+   would starve them, so such fds are put to the timers priority */
+void poller_lower_event_priority(poller_event_t *poll_event) {
+	if (NULL != poll_event->event)
+		event_priority_set(poll_event->event, 1);
+}
+
 void poller_disable_event(poller_event_t *poll_event) {
-	event_del(poll_event->event);
+	if (NULL == poll_event->event)
+		wheel_unlink(&conf.wheel, poll_event);
+	else
+		event_del(poll_event->event);
 }
 
 int poller_destroy_event(poller_event_t *poll_event) {
 	if (NULL == poll_event)
 		return SUCCEED;
-	event_del(poll_event->event);
-	event_free(poll_event->event);
+	
+	if (NULL == poll_event->event)
+		wheel_unlink(&conf.wheel, poll_event);
+	else {
+		event_del(poll_event->event);
+		event_free(poll_event->event);
+	}
+	
 	zbx_free(poll_event);
 
 	return SUCCEED;
 }
 
 int poller_run_timer_event( poller_event_t *poll_event, u_int64_t tm_msec_relative) {
-	struct timeval tv = { .tv_sec = tm_msec_relative/1000, .tv_usec = (tm_msec_relative % 1000) * 1000 };
-	DEBUG_ITEM(poll_event->itemid, "Started timer event %p for the item in %ld sec, %ld msec", poll_event->event, tv.tv_sec, tv.tv_usec);;
-	return event_add(poll_event->event, &tv);
+	DEBUG_ITEM(poll_event->itemid, "Started timer event %p for the item in %ld msec", poll_event, tm_msec_relative);
+	
+	if (NULL != poll_event->event) {
+		THIS_SHOULD_NEVER_HAPPEN;
+		return FAIL;
+	}
+	
+	wheel_unlink(&conf.wheel, poll_event);
+	poll_event->interval = tm_msec_relative;
+	wheel_add(&conf.wheel, poll_event, tm_msec_relative);
+	
+	return 0;
 }
 
 void poller_run_fd_event(poller_event_t *poll_event) {
@@ -164,8 +395,11 @@ int poller_async_resolve(poller_item_t *poller_item,  const char *name) {
 			DEBUG_ITEM(poller_item_get_id(poller_item), "Async dns lookup failed for addr '%s'", name);
 			poller_preprocess_error(poller_item, "Cannot start DNS lookup. Check the item hostname or interface settings");
 		}
+		return FAIL;
 	}
 	conf.dns_requests++;
+	
+	return SUCCEED;
 }
 
 void poller_async_loop_run() {
@@ -184,8 +418,28 @@ void poller_async_loop_init() {
 	event_base_priority_init(conf.events_base, 2);
 	evdns_base_set_option(conf.evdns_base,"timeout","4");
 	evdns_base_set_option(conf.evdns_base, "randomize-case", "0");
+
+	/* nothing is kept from the timers of a previous loop, the server tests run one before the pollers fork */
+	memset(&conf.wheel, 0, sizeof(conf.wheel));
+	conf.wheel.now = wheel_time_ms();
+	conf.wheel.tick_event = event_new(conf.events_base, -1, 0, wheel_tick_cb, &conf.wheel);
+	event_priority_set(conf.wheel.tick_event, 1);
 }
 
 struct event_base* poller_async_get_events_base() {
 	return conf.events_base;
-}
\ No newline at end of file
+}
+
+#ifdef HAVE_GLB_TESTS
+/* the tests drive the timers by their own clock instead of the events loop, 0 sets the real clock back */
+void poller_async_set_test_time(u_int64_t time_ms) {
+	test_time_ms = time_ms;
+}
+
+/* processes the timers as the tick event would, returns the time the tick is armed for, 0 if it isn't */
+u_int64_t poller_async_run_test_timers() {
+	wheel_tick_cb(-1, 0, &conf.wheel);
+	
+	return conf.wheel.wakeup;
+}
+#endif
\ No newline at end of file
@@ -39,6 +39,7 @@ int   poller_run_timer_event( poller_event_t *poll_event, u_int64_t tm_msec);
 void  poller_run_fd_event(poller_event_t *poll_event);
 int   poller_destroy_event(poller_event_t *event);
 void  poller_disable_event(poller_event_t *poll_event);
+void  poller_lower_event_priority(poller_event_t *poll_event);
 
 void  poller_async_set_resolve_cb(resolve_cb callback);
 void  poller_async_set_resolve_fail_cb(resolve_fail_cb callback);
@@ -50,4 +51,9 @@ void  poller_async_loop_init();
 void  poller_async_loop_run();
 void  poller_async_loop_destroy();
 void  poller_async_loop_stop();
+
+#ifdef HAVE_GLB_TESTS
+void  poller_async_set_test_time(u_int64_t time_ms);
+u_int64_t poller_async_run_test_timers();
+#endif
    
\ No newline at end of file
@@ -0,0 +1,511 @@
+/*
+** Glaber
+** Copyright (C) 2001-2028 Glaber JSC
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+#include "log.h"
+#include "zbxcommon.h"
+#include "zbxhttp.h"
+
+#include "glb_poller.h"
+#include "poller_http.h"
+#include "poller_async_io.h"
+#include "poller_contention.h"
+
+#include <event2/event.h>
+
+#define HTTP_TARGET_HOUSEKEEP_TTL	120
+#define HTTP_POLLER_MAX_CONNECTIONS	4096	/* size of the idle connections cache shared by all the items */
+
+extern int	CONFIG_FORKS[ZBX_PROCESS_TYPE_COUNT];
+
+/* returns host[:port] part of the url, the requests are limited and queued by it */
+int	http_url_target(const char *url, char *target, size_t target_len)
+{
+	const char	*start, *end, *at;
+
+	if (NULL != (start = strstr(url, "://")))
+		start += ZBX_CONST_STRLEN("://");
+	else
+		start = url;
+
+	for (end = start; '\0' != *end && '/' != *end && '?' != *end && '#' != *end; end++)
+		;
+
+	/* user info is not the part of the target */
+	for (at = end; at > start && '@' != *(at - 1); at--)
+		;
+
+	if (at > start)
+		start = at;
+
+	if (start == end || (size_t)(end - start) >= target_len)
+		return FAIL;
+
+	memcpy(target, start, end - start);
+	target[end - start] = '\0';
+
+	zbx_strlower(target);
+
+	return SUCCEED;
+}
+
+#ifdef HAVE_LIBCURL
+
+/* the request is prepared once on the item creation and performed by the same easy handle on each poll,
+   all the handles are run by the single multi handle, so idle connections and resolves are shared */
+typedef struct
+{
+	zbx_http_context_t	context;
+	const char		*target;
+	char			*posts;		/* curl doesn't copy post fields */
+	char			*status_codes;
+	unsigned char		retrieve_mode;
+	unsigned char		output_format;
+	unsigned char		active;		/* the handle is added to the multi handle */
+} http_item_t;
+
+typedef struct
+{
+	const char		*target;
+	zbx_vector_uint64_t	pending;
+	int			lastuse;
+} http_target_t;
+
+typedef struct
+{
+	CURLM		*multi;
+	struct event	*timer;
+	zbx_hashset_t	targets;
+} http_conf_t;
+
+static http_conf_t	conf = {0};
+
+static void	http_target_kick(http_target_t *target);
+
+static http_target_t	*http_target_get(const char *name)
+{
+	http_target_t	*target, local_target = {.target = name};
+
+	if (NULL == (target = zbx_hashset_search(&conf.targets, &local_target)))
+	{
+		local_target.target = poller_strpool_copy(name);
+		target = zbx_hashset_insert(&conf.targets, &local_target, sizeof(local_target));
+		zbx_vector_uint64_create(&target->pending);
+	}
+
+	target->lastuse = time(NULL);
+
+	return target;
+}
+
+static void	http_target_clean(http_target_t *target)
+{
+	poller_strpool_free(target->target);
+	zbx_vector_uint64_destroy(&target->pending);
+}
+
+static void	http_item_reset_response(http_item_t *http_item)
+{
+	zbx_free(http_item->context.header.data);
+	zbx_free(http_item->context.body.data);
+
+	memset(&http_item->context.header, 0, sizeof(zbx_http_response_t));
+	memset(&http_item->context.body, 0, sizeof(zbx_http_response_t));
+	*http_item->context.errbuf = '\0';
+}
+
+static void	http_detach(poller_item_t *poller_item)
+{
+	http_item_t	*http_item = poller_item_get_specific_data(poller_item);
+
+	if (0 == http_item->active)
+		return;
+
+	curl_multi_remove_handle(conf.multi, http_item->context.easyhandle);
+	poller_contention_remove_session(http_item->target);
+	http_item->active = 0;
+}
+
+static void	http_finish(poller_item_t *poller_item, CURLcode err)
+{
+	http_item_t	*http_item = poller_item_get_specific_data(poller_item);
+	char		*out = NULL, *error = NULL;
+
+	http_detach(poller_item);
+	poller_inc_responses();
+
+	if (SUCCEED == zbx_http_handle_response(&http_item->context, err, http_item->retrieve_mode,
+			http_item->status_codes, http_item->output_format, &out, &error))
+	{
+		DEBUG_ITEM(poller_item_get_id(poller_item), "Got HTTP response of %zu bytes", strlen(out));
+		poller_preprocess_str(poller_item, NULL, out);
+	}
+	else
+	{
+		DEBUG_ITEM(poller_item_get_id(poller_item), "HTTP request failed: %s", error);
+		poller_preprocess_error(poller_item, error);
+	}
+
+	zbx_free(out);
+	zbx_free(error);
+	http_item_reset_response(http_item);
+
+	poller_return_item_to_queue(poller_item);
+	http_target_kick(http_target_get(http_item->target));
+}
+
+static void	http_check_multi_info(void)
+{
+	CURLMsg		*msg;
+	poller_item_t	*poller_item;
+	int		msgs_left;
+
+	while (NULL != (msg = curl_multi_info_read(conf.multi, &msgs_left)))
+	{
+		if (CURLMSG_DONE != msg->msg)
+			continue;
+
+		if (CURLE_OK != curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&poller_item) ||
+				NULL == poller_item)
+		{
+			THIS_SHOULD_NEVER_HAPPEN;
+			curl_multi_remove_handle(conf.multi, msg->easy_handle);
+			continue;
+		}
+
+		http_finish(poller_item, msg->data.result);
+	}
+}
+
+static void	http_socket_event_cb(evutil_socket_t fd, short events, void *arg)
+{
+	int	running, action = 0;
+
+	ZBX_UNUSED(arg);
+
+	if (0 != (events & EV_READ))
+		action |= CURL_CSELECT_IN;
+
+	if (0 != (events & EV_WRITE))
+		action |= CURL_CSELECT_OUT;
+
+	curl_multi_socket_action(conf.multi, fd, action, &running);
+	http_check_multi_info();
+
+	if (0 == running)
+		evtimer_del(conf.timer);
+}
+
+static void	http_timer_event_cb(evutil_socket_t fd, short events, void *arg)
+{
+	int	running;
+
+	ZBX_UNUSED(fd);
+	ZBX_UNUSED(events);
+	ZBX_UNUSED(arg);
+
+	curl_multi_socket_action(conf.multi, CURL_SOCKET_TIMEOUT, 0, &running);
+	http_check_multi_info();
+}
+
+/* curl tells which sockets and directions it waits for, they are watched by the poller's event loop */
+static int	http_socket_cb(CURL *easyhandle, curl_socket_t fd, int what, void *userp, void *socketp)
+{
+	struct event	*ev = socketp;
+	short		flags = EV_PERSIST;
+
+	ZBX_UNUSED(easyhandle);
+	ZBX_UNUSED(userp);
+
+	if (CURL_POLL_REMOVE == what)
+	{
+		if (NULL != ev)
+			event_free(ev);
+
+		return 0;
+	}
+
+	if (0 != (what & CURL_POLL_IN))
+		flags |= EV_READ;
+
+	if (0 != (what & CURL_POLL_OUT))
+		flags |= EV_WRITE;
+
+	if (NULL != ev)
+	{
+		event_del(ev);
+		event_assign(ev, poller_async_get_events_base(), fd, flags, http_socket_event_cb, NULL);
+	}
+	else
+	{
+		ev = event_new(poller_async_get_events_base(), fd, flags, http_socket_event_cb, NULL);
+		curl_multi_assign(conf.multi, fd, ev);
+	}
+
+	event_add(ev, NULL);
+
+	return 0;
+}
+
+static int	http_timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+	struct timeval	tv;
+
+	ZBX_UNUSED(multi);
+	ZBX_UNUSED(userp);
+
+	if (0 > timeout_ms)
+	{
+		evtimer_del(conf.timer);
+		return 0;
+	}
+
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+	evtimer_add(conf.timer, &tv);
+
+	return 0;
+}
+
+static void	http_send_request(poller_item_t *poller_item)
+{
+	http_item_t	*http_item = poller_item_get_specific_data(poller_item);
+	CURLMcode	err;
+
+	DEBUG_ITEM(poller_item_get_id(poller_item), "Starting HTTP request to %s", http_item->target);
+
+	/* each poll starts with no cookies as a new classic poller request does */
+	curl_easy_setopt(http_item->context.easyhandle, CURLOPT_COOKIELIST, "ALL");
+
+	if (CURLM_OK != (err = curl_multi_add_handle(conf.multi, http_item->context.easyhandle)))
+	{
+		poller_preprocess_error(poller_item, curl_multi_strerror(err));
+		poller_return_item_to_queue(poller_item);
+		return;
+	}
+
+	http_item->active = 1;
+	poller_contention_add_session(http_item->target);
+	poller_inc_requests();
+}
+
+/* starts waiting requests while there are free sessions for the target */
+static void	http_target_kick(http_target_t *target)
+{
+	poller_item_t	*poller_item;
+	u_int64_t	itemid;
+
+	while (0 < target->pending.values_num &&
+			DEFAULT_HTTP_HOST_CONTENTION > poller_contention_get_sessions(target->target))
+	{
+		itemid = target->pending.values[0];
+		zbx_vector_uint64_remove(&target->pending, 0);
+
+		if (NULL != (poller_item = poller_get_poller_item(itemid)))
+			http_send_request(poller_item);
+	}
+}
+
+static int	http_start_poll(poller_item_t *poller_item)
+{
+	http_item_t	*http_item = poller_item_get_specific_data(poller_item);
+	http_target_t	*target;
+	int		n;
+
+	if (DEFAULT_HTTP_HOST_CONTENTION <= (n = poller_contention_get_sessions(http_item->target)))
+	{
+		DEBUG_ITEM(poller_item_get_id(poller_item), "There are already %d requests to %s, waiting for a free one",
+				n, http_item->target);
+
+		target = http_target_get(http_item->target);
+		zbx_vector_uint64_append(&target->pending, poller_item_get_id(poller_item));
+
+		return POLL_STARTED_OK;
+	}
+
+	http_send_request(poller_item);
+
+	return POLL_STARTED_OK;
+}
+
+static void	http_free_item(poller_item_t *poller_item)
+{
+	http_item_t	*http_item = poller_item_get_specific_data(poller_item);
+	http_target_t	*target, local_target = {.target = http_item->target};
+	int		i;
+
+	if (NULL != (target = zbx_hashset_search(&conf.targets, &local_target)) &&
+			FAIL != (i = zbx_vector_uint64_search(&target->pending, poller_item_get_id(poller_item),
+			ZBX_DEFAULT_UINT64_COMPARE_FUNC)))
+	{
+		zbx_vector_uint64_remove(&target->pending, i);
+	}
+
+	if (0 != http_item->active)
+	{
+		http_detach(poller_item);
+
+		if (NULL != target)
+			http_target_kick(target);
+	}
+
+	zbx_http_context_destroy(&http_item->context);
+	poller_strpool_free(http_item->target);
+	zbx_free(http_item->posts);
+	zbx_free(http_item->status_codes);
+	zbx_free(http_item);
+}
+
+static int	http_init_item(DC_ITEM *dc_item, poller_item_t *poller_item)
+{
+	http_item_t	*http_item;
+	char		target[MAX_STRING_LEN], *error = NULL;
+
+	DEBUG_ITEM(poller_item_get_id(poller_item), "Doing http init of the item");
+
+	if (FAIL == http_url_target(dc_item->url, target, sizeof(target)))
+	{
+		poller_preprocess_error(poller_item, "Cannot parse host of the item's URL");
+		return FAIL;
+	}
+
+	http_item = zbx_calloc(NULL, 0, sizeof(http_item_t));
+	poller_set_item_specific_data(poller_item, http_item);
+
+	zbx_http_context_init(&http_item->context);
+
+	http_item->target = poller_strpool_add(target);
+	http_item->posts = zbx_strdup(NULL, dc_item->posts);
+	http_item->status_codes = zbx_strdup(NULL, dc_item->status_codes);
+	http_item->retrieve_mode = dc_item->retrieve_mode;
+	http_item->output_format = dc_item->output_format;
+
+	if (SUCCEED != zbx_http_request_prepare(&http_item->context, dc_item->request_method, dc_item->url,
+			dc_item->query_fields, dc_item->headers, http_item->posts, dc_item->retrieve_mode,
+			dc_item->http_proxy, dc_item->follow_redirects, dc_item->timeout, dc_item->ssl_cert_file,
+			dc_item->ssl_key_file, dc_item->ssl_key_password, dc_item->verify_peer, dc_item->verify_host,
+			dc_item->authtype, dc_item->username, dc_item->password, NULL, dc_item->post_type, &error))
+	{
+		DEBUG_ITEM(poller_item_get_id(poller_item), "Couldn't prepare the item's request: %s", error);
+		poller_preprocess_error(poller_item, error);
+		zbx_free(error);
+
+		http_free_item(poller_item);
+		return FAIL;
+	}
+
+	curl_easy_setopt(http_item->context.easyhandle, CURLOPT_PRIVATE, poller_item);
+
+	return SUCCEED;
+}
+
+static int	forks_count(void)
+{
+	return CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP];
+}
+
+/* restarts waiting requests if their sessions were expired by the contention housekeeper, drops unused targets */
+static void	http_housekeep(void)
+{
+	static int		last_housekeep = 0;
+	zbx_hashset_iter_t	iter;
+	http_target_t		*target;
+	int			now = time(NULL);
+
+	if (now == last_housekeep)
+		return;
+
+	last_housekeep = now;
+
+	zbx_hashset_iter_reset(&conf.targets, &iter);
+
+	while (NULL != (target = zbx_hashset_iter_next(&iter)))
+	{
+		http_target_kick(target);
+
+		if (0 == target->pending.values_num && target->lastuse + HTTP_TARGET_HOUSEKEEP_TTL < now &&
+				0 == poller_contention_get_sessions(target->target))
+		{
+			http_target_clean(target);
+			zbx_hashset_iter_remove(&iter);
+		}
+	}
+}
+
+static void	async_io(void)
+{
+	poller_contention_housekeep();
+	http_housekeep();
+}
+
+static void	http_shutdown_cb(void)
+{
+	zbx_hashset_iter_t	iter;
+	http_target_t		*target;
+
+	zbx_hashset_iter_reset(&conf.targets, &iter);
+
+	while (NULL != (target = zbx_hashset_iter_next(&iter)))
+		http_target_clean(target);
+
+	zbx_hashset_destroy(&conf.targets);
+
+	curl_multi_cleanup(conf.multi);
+	event_free(conf.timer);
+}
+
+int	glb_http_init(void)
+{
+	if (0 != curl_global_init(CURL_GLOBAL_DEFAULT))
+	{
+		LOG_WRN("Cannot initialize cURL library, HTTP items will not be polled");
+		return FAIL;
+	}
+
+	if (NULL == (conf.multi = curl_multi_init()))
+	{
+		LOG_WRN("Cannot initialize cURL multi handle, HTTP items will not be polled");
+		return FAIL;
+	}
+
+	curl_multi_setopt(conf.multi, CURLMOPT_SOCKETFUNCTION, http_socket_cb);
+	curl_multi_setopt(conf.multi, CURLMOPT_TIMERFUNCTION, http_timer_cb);
+	curl_multi_setopt(conf.multi, CURLMOPT_MAXCONNECTS, (long)HTTP_POLLER_MAX_CONNECTIONS);
+#if LIBCURL_VERSION_NUM >= 0x071e00
+	/* CURLMOPT_MAX_HOST_CONNECTIONS is supported starting with version 7.30.0 (0x071e00) */
+	curl_multi_setopt(conf.multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)DEFAULT_HTTP_HOST_CONTENTION);
+#endif
+	conf.timer = evtimer_new(poller_async_get_events_base(), http_timer_event_cb, NULL);
+
+	zbx_hashset_create(&conf.targets, 100, ZBX_DEFAULT_PTR_HASH_FUNC, ZBX_DEFAULT_PTR_COMPARE_FUNC);
+
+	poller_set_poller_callbacks(http_init_item, http_free_item, async_io, http_start_poll,
+			http_shutdown_cb, forks_count, NULL, NULL, "http", 0, 0);
+
+	return SUCCEED;
+}
+
+#else
+
+int	glb_http_init(void)
+{
+	LOG_WRN("HTTP agent items cannot be polled asynchronously: compiled without cURL support");
+	return FAIL;
+}
+
+#endif
@@ -0,0 +1,30 @@
+/*
+** Glaber
+** Copyright (C) 2001-2028 Glaber JSC
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+#ifndef GLABER_HTTP_POLL_H
+#define GLABER_HTTP_POLL_H
+
+#include "glb_poller.h"
+
+/* how many requests to the same host:port might be run at once, the rest wait in the host's queue */
+#define DEFAULT_HTTP_HOST_CONTENTION 4
+
+int	http_url_target(const char *url, char *target, size_t target_len);
+int	glb_http_init(void);
+
+#endif
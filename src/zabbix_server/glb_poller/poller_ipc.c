@@ -32,7 +32,7 @@ static mem_funcs_t ipc_memf = {
 		.malloc_func = __poller_ipc_notify_shmem_malloc_func, 
 		.realloc_func = __poller_ipc_notify_shmem_realloc_func};
 
-static ipc2_conf_t* ipc_poller_notify[ITEM_TYPE_MAX];
+static ipc2_conf_t* ipc_poller_notify[ZBX_PROCESS_TYPE_COUNT];
 
 static int poller_init_ipc_type(ipc2_conf_t* ipc_poll[], int type, int forks, mem_funcs_t *memf) {
 	char buffer[64];
@@ -54,6 +54,7 @@ int poller_notify_ipc_init(size_t mem_size) {
 	
 	poller_init_ipc_type(ipc_poller_notify, GLB_PROCESS_TYPE_SERVER, CONFIG_FORKS[GLB_PROCESS_TYPE_SERVER], &ipc_memf);
 	poller_init_ipc_type(ipc_poller_notify, GLB_PROCESS_TYPE_AGENT, CONFIG_FORKS[GLB_PROCESS_TYPE_AGENT], &ipc_memf);
+	poller_init_ipc_type(ipc_poller_notify, GLB_PROCESS_TYPE_HTTP, CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP], &ipc_memf);
 	poller_init_ipc_type(ipc_poller_notify, GLB_PROCESS_TYPE_SNMP, CONFIG_FORKS[GLB_PROCESS_TYPE_SNMP], &ipc_memf);
 	poller_init_ipc_type(ipc_poller_notify, GLB_PROCESS_TYPE_SNMP_WORKER, CONFIG_FORKS[GLB_PROCESS_TYPE_SNMP_WORKER], &ipc_memf);
 	poller_init_ipc_type(ipc_poller_notify, GLB_PROCESS_TYPE_PINGER, CONFIG_FORKS[GLB_PROCESS_TYPE_PINGER], &ipc_memf);
@@ -66,7 +67,7 @@ int poller_notify_ipc_init(size_t mem_size) {
 
 static int process_by_item_type[ITEM_TYPE_MAX] = {0};
 
-static zbx_vector_uint64_pair_t *notify_buffer[ITEM_TYPE_MAX];
+static zbx_vector_uint64_pair_t *notify_buffer[ZBX_PROCESS_TYPE_COUNT];
 
 int poller_item_notify_init() {
 	int i;
@@ -76,12 +77,13 @@ int poller_item_notify_init() {
 //	else 
 	process_by_item_type[ITEM_TYPE_SNMP] = GLB_PROCESS_TYPE_SNMP;
 	process_by_item_type[ITEM_TYPE_AGENT] = GLB_PROCESS_TYPE_AGENT;
+	process_by_item_type[ITEM_TYPE_HTTPAGENT] = GLB_PROCESS_TYPE_HTTP;
 	process_by_item_type[ITEM_TYPE_SIMPLE] = GLB_PROCESS_TYPE_PINGER;
 	process_by_item_type[ITEM_TYPE_CALCULATED] = ZBX_PROCESS_TYPE_HISTORYPOLLER;
 	process_by_item_type[ITEM_TYPE_WORKER_SERVER] = GLB_PROCESS_TYPE_SERVER;
 	process_by_item_type[ITEM_TYPE_EXTERNAL] = GLB_PROCESS_TYPE_WORKER;
 
-	for(i = 0; i < ITEM_TYPE_MAX; i++) {
+	for(i = 0; i < ZBX_PROCESS_TYPE_COUNT; i++) {
 		notify_buffer[i] = zbx_malloc(NULL, sizeof(zbx_vector_uint64_pair_t));
 		zbx_vector_uint64_pair_create(notify_buffer[i]);
 	}
@@ -35,6 +35,13 @@
 #include <event2/buffer.h>
 
 #define DNS_TTL	120
+#define TCP_IDLE_TIMEOUT	30	/* idle connections are closed if not reused within this time */
+#define TCP_KEEPALIVE_RECHECK	3600	/* how often interfaces closing connections are probed again */
+#define TCP_IFACE_HOUSEKEEP_TTL	120
+
+#define TCP_KEEPALIVE_UNKNOWN	0
+#define TCP_KEEPALIVE_YES	1
+#define TCP_KEEPALIVE_NO	2
 
 extern int  CONFIG_FORKS[ZBX_PROCESS_TYPE_COUNT];
 extern char *CONFIG_SOURCE_IP;
@@ -48,12 +55,316 @@ struct tcp_item_t
 	unsigned char poll_type;
 	struct bufferevent *bev;
 	void *proto_ctx;
-	int next_resolve;
+	unsigned char reused;	/* connection has been taken from the interface idle pool */
+	unsigned char connected;
+	unsigned char got_data;
 };
 typedef struct tcp_item_t tcp_item_t;
 
+typedef struct
+{
+	struct bufferevent *bev;
+	unsigned int port;
+} tcp_idle_conn_t;
+
+/* whether the service at the port answers more than one request per connection */
+typedef struct
+{
+	unsigned int port;
+	unsigned char keepalive;
+	int keepalive_recheck;
+} tcp_port_t;
+
+/* per-ip state: idle connections kept for reuse and items waiting for a free connection,
+   the session limit is still accounted by the contention module by the same ip */
+typedef struct
+{
+	const char *ipaddr;
+	zbx_vector_ptr_t ports;
+	int lastuse;
+	tcp_idle_conn_t idle[DEFAULT_TCP_HOST_CONTENTION];
+	int idle_num;
+	zbx_vector_uint64_t pending;
+} tcp_iface_t;
+
+/* single dns lookup is done for all the items of the same hostname */
+typedef struct
+{
+	const char *name;
+	const char *ipaddr;
+	int next_resolve;
+	int resolve_started;
+	zbx_vector_uint64_t waiting;
+} tcp_dns_t;
+
 static tcp_poll_type_procs_t conf[ASYNC_TCP_POLL_TYPE_COUNT] = {0};
 
+static zbx_hashset_t ifaces;
+static zbx_hashset_t names;
+
+static struct sockaddr_storage source_addr;
+static socklen_t source_addr_len = 0;
+
+static void tcp_iface_start(poller_item_t *poller_item);
+static void tcp_send_request(poller_item_t *poller_item);
+
+static int tcp_make_sockaddr(const char *ipaddr, unsigned int port, struct sockaddr_storage *addr, socklen_t *addr_len)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+
+	memset(addr, 0, sizeof(*addr));
+
+	if (1 == inet_pton(AF_INET, ipaddr, &sin->sin_addr))
+	{
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(port);
+		*addr_len = sizeof(*sin);
+
+		return SUCCEED;
+	}
+#ifdef HAVE_IPV6
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+
+	if (1 == inet_pton(AF_INET6, ipaddr, &sin6->sin6_addr))
+	{
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(port);
+		*addr_len = sizeof(*sin6);
+
+		return SUCCEED;
+	}
+#endif
+	return FAIL;
+}
+
+static tcp_iface_t *tcp_iface_find(const char *ipaddr)
+{
+	tcp_iface_t local_iface = {.ipaddr = ipaddr};
+
+	if (NULL == ipaddr)
+		return NULL;
+
+	return zbx_hashset_search(&ifaces, &local_iface);
+}
+
+static tcp_iface_t *tcp_iface_get(const char *ipaddr)
+{
+	tcp_iface_t *iface, local_iface = {0};
+	int now = time(NULL);
+
+	if (NULL == (iface = tcp_iface_find(ipaddr)))
+	{
+		local_iface.ipaddr = poller_strpool_copy(ipaddr);
+		iface = zbx_hashset_insert(&ifaces, &local_iface, sizeof(local_iface));
+		zbx_vector_uint64_create(&iface->pending);
+		zbx_vector_ptr_create(&iface->ports);
+	}
+
+	iface->lastuse = now;
+
+	return iface;
+}
+
+static tcp_port_t *tcp_iface_get_port(tcp_iface_t *iface, unsigned int port)
+{
+	tcp_port_t *tcp_port;
+	int i;
+
+	for (i = 0; i < iface->ports.values_num; i++)
+	{
+		tcp_port = iface->ports.values[i];
+
+		if (port != tcp_port->port)
+			continue;
+
+		if (TCP_KEEPALIVE_NO == tcp_port->keepalive && tcp_port->keepalive_recheck < time(NULL))
+			tcp_port->keepalive = TCP_KEEPALIVE_UNKNOWN;
+
+		return tcp_port;
+	}
+
+	tcp_port = zbx_calloc(NULL, 0, sizeof(tcp_port_t));
+	tcp_port->port = port;
+	zbx_vector_ptr_append(&iface->ports, tcp_port);
+
+	return tcp_port;
+}
+
+static void tcp_port_set_no_keepalive(tcp_port_t *tcp_port)
+{
+	tcp_port->keepalive = TCP_KEEPALIVE_NO;
+	tcp_port->keepalive_recheck = time(NULL) + TCP_KEEPALIVE_RECHECK;
+}
+
+/* returns port of the removed connection or 0 if it's not in the pool */
+static unsigned int tcp_iface_remove_idle(tcp_iface_t *iface, struct bufferevent *bev)
+{
+	unsigned int port;
+	int i;
+
+	for (i = 0; i < iface->idle_num; i++)
+	{
+		if (iface->idle[i].bev != bev)
+			continue;
+
+		port = iface->idle[i].port;
+		iface->idle[i] = iface->idle[--iface->idle_num];
+
+		return port;
+	}
+
+	return 0;
+}
+
+static void idle_events_cb(struct bufferevent *bev, short events, void *ptr)
+{
+	tcp_iface_t *iface = ptr;
+	tcp_port_t *tcp_port;
+	unsigned int port;
+
+	port = tcp_iface_remove_idle(iface, bev);
+	bufferevent_free(bev);
+
+	/* the other side closed the connection right after the answer, so it doesn't keep them */
+	if ((events & BEV_EVENT_EOF) && 0 != port &&
+			TCP_KEEPALIVE_UNKNOWN == (tcp_port = tcp_iface_get_port(iface, port))->keepalive)
+		tcp_port_set_no_keepalive(tcp_port);
+}
+
+static void idle_read_cb(struct bufferevent *bev, void *ptr)
+{
+	/* nothing is expected on an idle connection */
+	tcp_iface_remove_idle(ptr, bev);
+	bufferevent_free(bev);
+}
+
+static void tcp_iface_park_idle(tcp_iface_t *iface, struct bufferevent *bev, unsigned int port)
+{
+	const struct timeval idle_timeout = {.tv_sec = TCP_IDLE_TIMEOUT, .tv_usec = 0};
+
+	iface->idle[iface->idle_num].bev = bev;
+	iface->idle[iface->idle_num].port = port;
+	iface->idle_num++;
+
+	bufferevent_setcb(bev, idle_read_cb, NULL, idle_events_cb, iface);
+	bufferevent_set_timeouts(bev, &idle_timeout, NULL);
+}
+
+static struct bufferevent *tcp_iface_pop_idle(tcp_iface_t *iface, unsigned int port)
+{
+	struct bufferevent *bev;
+	int i;
+
+	for (i = 0; i < iface->idle_num; i++)
+	{
+		if (iface->idle[i].port != port)
+			continue;
+
+		bev = iface->idle[i].bev;
+		iface->idle[i] = iface->idle[--iface->idle_num];
+
+		return bev;
+	}
+
+	return NULL;
+}
+
+static void tcp_iface_remove_pending(tcp_iface_t *iface, u_int64_t itemid)
+{
+	int i;
+
+	if (FAIL != (i = zbx_vector_uint64_search(&iface->pending, itemid, ZBX_DEFAULT_UINT64_COMPARE_FUNC)))
+		zbx_vector_uint64_remove(&iface->pending, i);
+}
+
+/* returns the first waiting item which might be polled via a kept connection to the port */
+static poller_item_t *tcp_iface_pop_pending(tcp_iface_t *iface, unsigned int port)
+{
+	poller_item_t *poller_item;
+	tcp_item_t *tcp_item;
+	int i = 0;
+
+	while (i < iface->pending.values_num)
+	{
+		if (NULL == (poller_item = poller_get_poller_item(iface->pending.values[i])))
+		{
+			zbx_vector_uint64_remove(&iface->pending, i);
+			continue;
+		}
+
+		tcp_item = poller_item_get_specific_data(poller_item);
+
+		if (port == tcp_item->interface_port && 0 != conf[tcp_item->poll_type].keepalive)
+		{
+			zbx_vector_uint64_remove(&iface->pending, i);
+			return poller_item;
+		}
+
+		i++;
+	}
+
+	return NULL;
+}
+
+/* starts waiting items while there are free sessions for the ip */
+static void tcp_iface_kick(tcp_iface_t *iface)
+{
+	poller_item_t *poller_item;
+	u_int64_t itemid;
+
+	while (0 < iface->pending.values_num &&
+			DEFAULT_TCP_HOST_CONTENTION > poller_contention_get_sessions(iface->ipaddr))
+	{
+		itemid = iface->pending.values[0];
+		zbx_vector_uint64_remove(&iface->pending, 0);
+
+		if (NULL != (poller_item = poller_get_poller_item(itemid)))
+			tcp_iface_start(poller_item);
+	}
+}
+
+/* the port refuses connections, so there is no reason to make the waiting items wait for their own timeouts */
+static void tcp_iface_fail_pending(tcp_iface_t *iface, unsigned int port)
+{
+	poller_item_t *poller_item;
+	tcp_item_t *tcp_item;
+	int i = 0;
+
+	while (i < iface->pending.values_num)
+	{
+		if (NULL == (poller_item = poller_get_poller_item(iface->pending.values[i])))
+		{
+			zbx_vector_uint64_remove(&iface->pending, i);
+			continue;
+		}
+
+		tcp_item = poller_item_get_specific_data(poller_item);
+
+		if (port != tcp_item->interface_port)
+		{
+			i++;
+			continue;
+		}
+
+		zbx_vector_uint64_remove(&iface->pending, i);
+		conf[tcp_item->poll_type].conn_fail_cb(poller_item, tcp_item->proto_ctx, "Connection error");
+		poller_return_item_to_queue(poller_item);
+	}
+}
+
+static void tcp_iface_clean(tcp_iface_t *iface)
+{
+	int i;
+
+	for (i = 0; i < iface->idle_num; i++)
+		bufferevent_free(iface->idle[i].bev);
+
+	zbx_vector_uint64_destroy(&iface->pending);
+	zbx_vector_ptr_clear_ext(&iface->ports, zbx_ptr_free);
+	zbx_vector_ptr_destroy(&iface->ports);
+	poller_strpool_free(iface->ipaddr);
+}
+
 static void async_tcp_destroy_session(poller_item_t *poller_item)
 {
 	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
@@ -61,65 +372,157 @@ static void async_tcp_destroy_session(poller_item_t *poller_item)
 	if (NULL != tcp_item && NULL != tcp_item->bev) {
 		bufferevent_free(tcp_item->bev);
 		tcp_item->bev = NULL;
+		poller_contention_remove_session(tcp_item->ipaddr);
 	}
 
 	poller_return_item_to_queue(poller_item);
 
 }
 
-#define TCP_READ_BUFF_SIZE 8192 // libevent has max chunk size 4096 bytes
+static void tcp_session_failed(poller_item_t *poller_item, short events)
+{
+	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	tcp_iface_t *iface;
 
-static void response_cb(struct bufferevent *bev, void *ctx_ptr)
+	async_tcp_destroy_session(poller_item);
+
+	if (NULL == (iface = tcp_iface_find(tcp_item->ipaddr)))
+		return;
+
+	/* a timeout is the item's own, only the failed connect says the port is down for the waiting items */
+	if (0 != (events & BEV_EVENT_ERROR) && 0 == tcp_item->connected)
+		tcp_iface_fail_pending(iface, tcp_item->interface_port);
+
+	tcp_iface_kick(iface);
+}
+
+/* kept connection has been closed by the other side before the request, repeat it on a new one */
+static int tcp_retry_reused(poller_item_t *poller_item)
 {
-	int n, status;
-	char buf[TCP_READ_BUFF_SIZE];
+	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	tcp_iface_t *iface;
 
-	poller_item_t *poller_item = ctx_ptr;
+	if (0 == tcp_item->reused || 1 == tcp_item->got_data)
+		return FAIL;
+
+	DEBUG_ITEM(poller_item_get_id(poller_item), "Reused connection to %s has been closed, repeating on a new one",
+			tcp_item->ipaddr);
+
+	if (NULL != (iface = tcp_iface_find(tcp_item->ipaddr)))
+		tcp_port_set_no_keepalive(tcp_iface_get_port(iface, tcp_item->interface_port));
+
+	bufferevent_free(tcp_item->bev);
+	tcp_item->bev = NULL;
+	poller_contention_remove_session(tcp_item->ipaddr);
+
+	tcp_send_request(poller_item);
+
+	return SUCCEED;
+}
+
+#define TCP_READ_BUFF_SIZE 8192 // libevent has max chunk size 4096 bytes
+
+static void tcp_attach_connection(poller_item_t *poller_item, struct bufferevent *bev, unsigned char reused);
+static void tcp_write_request(poller_item_t *poller_item);
+
+/* item is done, the connection is either passed to the next waiting item, kept idle or closed */
+static void tcp_release_connection(poller_item_t *poller_item, int eof)
+{
 	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	struct bufferevent *bev = tcp_item->bev;
+	tcp_iface_t *iface = tcp_iface_get(tcp_item->ipaddr);
+	poller_item_t *next_item;
+	unsigned int port = tcp_item->interface_port;
+	tcp_port_t *tcp_port = tcp_iface_get_port(iface, port);
+	int keep = 0;
 
-	if (NULL == tcp_item->bev)  
+	tcp_item->bev = NULL;
+
+	if (1 == tcp_item->reused)
+		tcp_port->keepalive = TCP_KEEPALIVE_YES;
+
+	if (0 != conf[tcp_item->poll_type].keepalive && 0 == eof && TCP_KEEPALIVE_NO != tcp_port->keepalive &&
+			0 == evbuffer_get_length(bufferevent_get_input(bev)))
+		keep = 1;
+
+	poller_return_item_to_queue(poller_item);
+
+	if (1 == keep && NULL != (next_item = tcp_iface_pop_pending(iface, port)))
+	{
+		DEBUG_ITEM(poller_item_get_id(next_item), "Passing connection to %s to the item", iface->ipaddr);
+		tcp_attach_connection(next_item, bev, 1);
+		tcp_write_request(next_item);
+		poller_inc_requests();
 		return;
+	}
 
-	struct evbuffer *input = bufferevent_get_input(tcp_item->bev);
+	poller_contention_remove_session(iface->ipaddr);
 
-	n = evbuffer_get_length(input);
-	evbuffer_remove(input, buf, n);
+	if (1 == keep && DEFAULT_TCP_HOST_CONTENTION > iface->idle_num)
+		tcp_iface_park_idle(iface, bev, port);
+	else
+		bufferevent_free(bev);
+
+	tcp_iface_kick(iface);
+}
 
-	status = conf[tcp_item->poll_type].response_cb(poller_item, tcp_item->proto_ctx, buf, n);
+static void tcp_read_response(poller_item_t *poller_item, int eof)
+{
+	int n, status;
+	char buf[TCP_READ_BUFF_SIZE];
 
-	switch (status)
+	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	struct evbuffer *input = bufferevent_get_input(tcp_item->bev);
+
+	while (0 < (n = evbuffer_remove(input, buf, sizeof(buf))))
 	{
-	case ASYNC_IO_TCP_PROC_FINISH:
-		poller_iface_register_succeed(poller_item);
-		async_tcp_destroy_session(poller_item);
-		poller_contention_remove_session(tcp_item->ipaddr);
-		break;
+		tcp_item->got_data = 1;
 
-	case ASYNC_IO_TCP_PROC_CONTINUE:
-		break;
+		status = conf[tcp_item->poll_type].response_cb(poller_item, tcp_item->proto_ctx, buf, n);
 
-	default:
-		HALT_HERE("TCP Protocol specific function returned unknown processing status %d", status);
+		switch (status)
+		{
+		case ASYNC_IO_TCP_PROC_FINISH:
+			poller_iface_register_succeed(poller_item);
+			tcp_release_connection(poller_item, eof);
+			return;
+
+		case ASYNC_IO_TCP_PROC_CONTINUE:
+			break;
+
+		default:
+			HALT_HERE("TCP Protocol specific function returned unknown processing status %d", status);
+		}
 	}
 }
 
+static void response_cb(struct bufferevent *bev, void *ctx_ptr)
+{
+	poller_item_t *poller_item = ctx_ptr;
+	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+
+	if (NULL == tcp_item->bev)  
+		return;
+
+	tcp_read_response(poller_item, 0);
+}
+
 static void events_cb(struct bufferevent *bev, short events, void *ptr)
 {
-	char *buffer;
 	poller_item_t *poller_item = ptr;
 	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
 
 	if (events & BEV_EVENT_CONNECTED)
 	{
 		DEBUG_ITEM(poller_item_get_id(poller_item), "TCP Connected event");
+		tcp_item->connected = 1;
 
 		if (NULL != conf[tcp_item->poll_type].connect_cb)
 		{
 			unsigned char status = conf[tcp_item->poll_type].connect_cb(poller_item, tcp_item->proto_ctx);
 
 			if (ASYNC_IO_TCP_PROC_FINISH == status)
-				async_tcp_destroy_session(poller_item);
-				poller_contention_remove_session(tcp_item->ipaddr);
+				tcp_release_connection(poller_item, 1);
 		}
 
 		return;
@@ -127,9 +530,12 @@ static void events_cb(struct bufferevent *bev, short events, void *ptr)
 
 	if (events & BEV_EVENT_ERROR)
 	{
+		if (SUCCEED == tcp_retry_reused(poller_item))
+			return;
+
 		DEBUG_ITEM(poller_item_get_id(poller_item), "Connection error event");
 		conf[tcp_item->poll_type].conn_fail_cb(poller_item, tcp_item->proto_ctx, "Connection error");
-		async_tcp_destroy_session(poller_item);
+		tcp_session_failed(poller_item, events);
 
 		return;
 	};
@@ -139,8 +545,7 @@ static void events_cb(struct bufferevent *bev, short events, void *ptr)
 		DEBUG_ITEM(poller_item_get_id(poller_item), "Timeout event");
 
 		conf[tcp_item->poll_type].timeout_cb(poller_item, tcp_item->proto_ctx);
-
-		async_tcp_destroy_session(poller_item);
+		tcp_session_failed(poller_item, events);
 
 		return;
 	}
@@ -154,207 +559,242 @@ static void events_cb(struct bufferevent *bev, short events, void *ptr)
 		int n = evbuffer_get_length(input);
 
 		DEBUG_ITEM(poller_item_get_id(poller_item), "Connection has been dropped for the item, there is %d bytes in the buffer",n);
+
+		if (0 == n && SUCCEED == tcp_retry_reused(poller_item))
+			return;
+
 		if (n > 0)
 		{ // agent answered and closed connection - this is fine!
 			DEBUG_ITEM(poller_item_get_id(poller_item), "Connection closed, has %d byets to process", n);
-			response_cb(bev, ptr);
-			poller_contention_remove_session(tcp_item->ipaddr);
-		}
-		else
-		{
-			DEBUG_ITEM(poller_item_get_id(poller_item), "Connection is dropped");
-			conf[tcp_item->poll_type].conn_fail_cb(poller_item, tcp_item->proto_ctx, "Connection is dropped");
+			tcp_read_response(poller_item, 1);
+
+			if (NULL == tcp_item->bev)
+				return;
 		}
 
+		DEBUG_ITEM(poller_item_get_id(poller_item), "Connection is dropped");
+		conf[tcp_item->poll_type].conn_fail_cb(poller_item, tcp_item->proto_ctx, "Connection is dropped");
+
 		async_tcp_destroy_session(poller_item);
+		tcp_iface_kick(tcp_iface_get(tcp_item->ipaddr));
+
 		return;
 	}
 }
 
+static void tcp_attach_connection(poller_item_t *poller_item, struct bufferevent *bev, unsigned char reused)
+{
+	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	const struct timeval timeout = {.tv_sec = sysinfo_get_config_timeout(), .tv_usec = 0};
+
+	tcp_item->bev = bev;
+	tcp_item->reused = reused;
+	tcp_item->connected = reused;
+	tcp_item->got_data = 0;
 
-extern char *CONFIG_SOURCE_IP;
+	bufferevent_setcb(bev, response_cb, NULL, events_cb, poller_item);
+	bufferevent_enable(bev, EV_READ | EV_WRITE);
+	bufferevent_set_timeouts(bev, &timeout, &timeout);
+}
 
-static int tcp_bev_request(poller_item_t *poller_item, const char *request, int request_size)
+static void tcp_write_request(poller_item_t *poller_item)
 {
-	struct addrinfo *ai = NULL, *ai_bind = NULL, hints;
 	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
-	int true = 1, sock, ret = SUCCEED;
+	void *request = NULL;
+	size_t request_size = 0;
 
-#ifdef HAVE_IPV6
+	if (NULL != conf[tcp_item->poll_type].create_request)
+		conf[tcp_item->poll_type].create_request(poller_item, tcp_item->proto_ctx, &request, &request_size);
 
-	char service[8];
+	if (request_size > 0)
+		evbuffer_add(bufferevent_get_output(tcp_item->bev), request, request_size);
+}
 
-	zbx_snprintf(service, sizeof(service), "%hu", tcp_item->interface_port);
-	memset(&hints, 0x00, sizeof(struct addrinfo));
-	hints.ai_family = PF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
+/* address is always numeric here: names are resolved beforehand by evdns */
+static int tcp_connect(poller_item_t *poller_item)
+{
+	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	struct bufferevent *bev;
+	int sock;
 
-	if (0 != getaddrinfo(tcp_item->ipaddr, service, &hints, &ai))
+	if (FAIL == tcp_make_sockaddr(tcp_item->ipaddr, tcp_item->interface_port, &addr, &addr_len))
 	{
-		LOG_INF("cannot resolve %s", tcp_item->interface_addr);
-
-		if (NULL != ai)
-			freeaddrinfo(ai);
-
+		DEBUG_ITEM(poller_item_get_id(poller_item), "Cannot parse interface address '%s'", tcp_item->ipaddr);
 		return FAIL;
 	}
 
-	if (-1 == (sock = socket(ai->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol)))
+	if (-1 == (sock = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)))
 	{
 		LOG_INF("cannot create socket [[%s]:%hu]", tcp_item->ipaddr, tcp_item->interface_port);
-		freeaddrinfo(ai);
-
 		return FAIL;
 	}
 
-	//	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &true, sizeof(int));
-
-	if (NULL != CONFIG_SOURCE_IP)
+	if (NULL != CONFIG_SOURCE_IP && (0 == source_addr_len ||
+			ZBX_PROTO_ERROR == bind(sock, (struct sockaddr *)&source_addr, source_addr_len)))
 	{
-		memset(&hints, 0x00, sizeof(struct addrinfo));
+		LOG_WRN("Couldn't bind ip to the source ip %s", CONFIG_SOURCE_IP);
+		close(sock);
 
-		hints.ai_family = PF_UNSPEC;
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_flags = AI_NUMERICHOST;
+		return FAIL;
+	}
 
-		if (0 != getaddrinfo(CONFIG_SOURCE_IP, NULL, &hints, &ai_bind))
-		{
-			LOG_WRN(" invalid source IP address '%s'", CONFIG_SOURCE_IP);
+	evutil_make_socket_nonblocking(sock);
+	evutil_make_listen_socket_reuseable(sock);
+	evutil_make_listen_socket_reuseable_port(sock);
 
-			freeaddrinfo(ai);
-			if (NULL != ai_bind)
-				freeaddrinfo(ai_bind);
+	bev = bufferevent_socket_new(poller_async_get_events_base(), sock, BEV_OPT_CLOSE_ON_FREE);
+	
+	tcp_attach_connection(poller_item, bev, 0);
+	tcp_write_request(poller_item);
 
-			close(sock);
+	if (-1 == bufferevent_socket_connect(bev, (struct sockaddr *)&addr, addr_len))
+	{
+		DEBUG_ITEM(poller_item_get_id(poller_item), "Couldn't start connection");
+		bufferevent_free(bev);
+		tcp_item->bev = NULL;
 
-			return FAIL;
-		}
+		return FAIL;
+	}
 
-		if (ZBX_PROTO_ERROR == bind(sock, ai_bind->ai_addr, ai_bind->ai_addrlen))
-		{
-			LOG_WRN("Couldn't bind ip to the source ip %s", CONFIG_SOURCE_IP);
+	poller_contention_add_session(tcp_item->ipaddr);
 
-			freeaddrinfo(ai);
-			freeaddrinfo(ai_bind);
+	return SUCCEED;
+}
 
-			close(sock);
+static void tcp_send_request(poller_item_t *poller_item)
+{
+	DEBUG_ITEM(poller_item_get_id(poller_item), "Starting TCP connection");
 
-			return FAIL;
-		}
+	if (FAIL == tcp_connect(poller_item))
+	{
+		poller_preprocess_error(poller_item, "There was an error while connect");
+		poller_return_item_to_queue(poller_item);
+		return;
 	}
 
-#else
+	poller_inc_requests();
+}
 
-	ZBX_SOCKADDR servaddr_in;
-	char *error = NULL;
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = AF_INET;
-	hints.ai_socktype = SOCK_STREAM;
+/* polls via an idle connection, a new one or waits until some connection to the ip is released */
+static void tcp_iface_start(poller_item_t *poller_item)
+{
+	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	tcp_iface_t *iface = tcp_iface_get(tcp_item->ipaddr);
+	struct bufferevent *bev;
+	int n;
 
-	if (0 != getaddrinfo(tcp_item->ipaddr, NULL, &hints, &ai))
+	if (0 != conf[tcp_item->poll_type].keepalive &&
+			NULL != (bev = tcp_iface_pop_idle(iface, tcp_item->interface_port)))
 	{
-		zabbix_log(LOG_LEVEL_DEBUG, "Getaddrinfo failed for name: %s", tcp_item->ipaddr);
-		return FAIL;
-	}
+		DEBUG_ITEM(poller_item_get_id(poller_item), "Reusing idle connection to %s", tcp_item->ipaddr);
+
+		poller_contention_add_session(tcp_item->ipaddr);
+		tcp_attach_connection(poller_item, bev, 1);
+		tcp_write_request(poller_item);
+		poller_inc_requests();
 
-	servaddr_in.sin_family = AF_INET;
-	servaddr_in.sin_addr = ((struct sockaddr_in *)ai->ai_addr)->sin_addr;
-	servaddr_in.sin_port = htons(tcp_item->interface_port);
+		return;
+	}
 
-	if ( -1 == (sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)))
+	if (DEFAULT_TCP_HOST_CONTENTION <= (n = poller_contention_get_sessions(tcp_item->ipaddr)))
 	{
-		zabbix_log(LOG_LEVEL_WARNING, "Couldn't exec gettraddrinfo");
-		freeaddrinfo(ai);
-		return FAIL;
+		DEBUG_ITEM(poller_item_get_id(poller_item), "There are already %d connections for the %s host, waiting for a free one",
+				n, tcp_item->interface_addr);
+		zbx_vector_uint64_append(&iface->pending, poller_item_get_id(poller_item));
+
+		return;
 	}
 
-	if (NULL != CONFIG_SOURCE_IP)
+	tcp_send_request(poller_item);
+}
+
+static tcp_dns_t *tcp_dns_get(const char *name)
+{
+	tcp_dns_t *dns, local_dns = {.name = name};
+
+	if (NULL == (dns = zbx_hashset_search(&names, &local_dns)))
 	{
-		ZBX_SOCKADDR source_addr;
+		local_dns.name = poller_strpool_copy(name);
+		dns = zbx_hashset_insert(&names, &local_dns, sizeof(local_dns));
+		zbx_vector_uint64_create(&dns->waiting);
+	}
 
-		memset(&source_addr, 0, sizeof(source_addr));
+	return dns;
+}
 
-		source_addr.sin_family = AF_INET;
-		source_addr.sin_addr.s_addr = inet_addr(CONFIG_SOURCE_IP);
-		source_addr.sin_port = 0;
+static void tcp_dns_fail(tcp_dns_t *dns, const char *error, u_int64_t skip_itemid)
+{
+	poller_item_t *poller_item;
+	int i;
 
-		if (ZBX_PROTO_ERROR == bind(sock, (struct sockaddr *)&source_addr, sizeof(source_addr)))
-		{
-			zabbix_log(LOG_LEVEL_WARNING, "Couldn't bind ip to the source ip %s", CONFIG_SOURCE_IP);
-			close(sock);
-			freeaddrinfo(ai);
-			return FAIL;
-		}
+	for (i = 0; i < dns->waiting.values_num; i++)
+	{
+		if (NULL == (poller_item = poller_get_poller_item(dns->waiting.values[i])))
+			continue;
+
+		if (dns->waiting.values[i] != skip_itemid)
+			poller_preprocess_error(poller_item, error);
+
+		poller_return_item_to_queue(poller_item);
 	}
-#endif
 
-	const struct timeval timeout = {.tv_sec = sysinfo_get_config_timeout(), .tv_usec = 0};
-	evutil_make_socket_nonblocking(sock);
-	evutil_make_listen_socket_reuseable(sock);
-	evutil_make_listen_socket_reuseable_port(sock);
+	zbx_vector_uint64_clear(&dns->waiting);
+	dns->resolve_started = 0;
+}
 
-	tcp_item->bev = bufferevent_socket_new(poller_async_get_events_base(), sock, BEV_OPT_CLOSE_ON_FREE);
-	
-	bufferevent_setcb(tcp_item->bev, response_cb, NULL, events_cb, poller_item);
-	bufferevent_enable(tcp_item->bev, EV_READ | EV_WRITE);
-	bufferevent_set_timeouts(tcp_item->bev, &timeout, &timeout);
+static int tcp_dns_resolve(tcp_dns_t *dns, poller_item_t *poller_item)
+{
+	DEBUG_ITEM(poller_item_get_id(poller_item), "Need to resolve %s", dns->name);
 
-	if (request_size > 0)
-		evbuffer_add(bufferevent_get_output(tcp_item->bev), request, request_size);
+	dns->resolve_started = time(NULL);
 
-#ifdef HAVE_IPV6
-	if (-1 == bufferevent_socket_connect(tcp_item->bev, (struct sockaddr *)ai->ai_addr, sizeof(struct sockaddr)))
-#else
-	if (-1 == bufferevent_socket_connect(tcp_item->bev, (struct sockaddr *)&hints, sizeof(struct sockaddr)))
-#endif
+	if (FAIL == poller_async_resolve(poller_item, dns->name))
 	{
-		DEBUG_ITEM(poller_item_get_id(poller_item), "Couldn't start connection");
-		async_tcp_destroy_session(poller_item);
-		ret = FAIL;
-	}
+		DEBUG_ITEM(poller_item_get_id(poller_item), "Cannot resolve item's interface addr: '%s'", dns->name);
+		tcp_dns_fail(dns, "Cannot resolve item's interface hostname", poller_item_get_id(poller_item));
 
-	if (NULL != ai)
-		freeaddrinfo(ai);
-	if (NULL != ai_bind)
-		freeaddrinfo(ai_bind);
+		return FAIL;
+	}
 
-	return ret;
+	return SUCCEED;
 }
 
-static int tcp_send_request(poller_item_t *poller_item)
+static void resolve_ready_func_cb(poller_item_t *poller_item, const char *addr)
 {
-	DEBUG_ITEM(poller_item_get_id(poller_item), "Starting TCP connection");
-
 	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	tcp_dns_t *dns = tcp_dns_get(tcp_item->interface_addr);
+	int i;
 
-	void *request = NULL;
-	size_t request_size = 0;
+	DEBUG_ITEM(poller_item_get_id(poller_item), "Item ip %s resolved to '%s'", tcp_item->interface_addr, addr);
 
-	if (NULL != conf[tcp_item->poll_type].create_request)
-		conf[tcp_item->poll_type].create_request(poller_item, tcp_item->proto_ctx, &request, &request_size);
+	poller_strpool_free(dns->ipaddr);
+	dns->ipaddr = poller_strpool_add(addr);
+	dns->next_resolve = time(NULL) + DNS_TTL + rand() % 15;
+	dns->resolve_started = 0;
 
-	if (FAIL == tcp_bev_request(poller_item, request, request_size))
+	for (i = 0; i < dns->waiting.values_num; i++)
 	{
-		poller_preprocess_error(poller_item, "There was an error while connect");
-		return FAIL;
+		if (NULL == (poller_item = poller_get_poller_item(dns->waiting.values[i])))
+			continue;
+
+		tcp_item = poller_item_get_specific_data(poller_item);
+
+		poller_strpool_free(tcp_item->ipaddr);
+		tcp_item->ipaddr = poller_strpool_copy(dns->ipaddr);
+
+		tcp_iface_start(poller_item);
 	}
 
-	poller_contention_add_session(tcp_item->ipaddr);
-	poller_inc_requests();
-	return SUCCEED;
+	zbx_vector_uint64_clear(&dns->waiting);
 }
 
-void resolve_ready_func_cb(poller_item_t *poller_item, const char *addr)
+static void resolve_fail_func_cb(poller_item_t *poller_item)
 {
-
 	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
-	DEBUG_ITEM(poller_item_get_id(poller_item), "Item ip %s resolved to '%s'", tcp_item->interface_addr, addr);
 
-	poller_strpool_free(tcp_item->ipaddr);
-	tcp_item->ipaddr = poller_strpool_add(addr);
-	
-	tcp_item->next_resolve = time(NULL) + DNS_TTL + rand() % 15;
-	tcp_send_request(poller_item);
+	tcp_dns_fail(tcp_dns_get(tcp_item->interface_addr), "Couldn't resolve item's hostname", 0);
 }
 
 static int ip_str_version(const char *src) {
@@ -375,36 +815,37 @@ static int tcp_start_connection(poller_item_t *poller_item)
 	DEBUG_ITEM(poller_item_get_id(poller_item),
 			   "starting tcp connection for the item");
 	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
-	u_int64_t itemid = poller_item_get_id(poller_item);
-	int n;
-
-	if (DEFAULT_TCP_HOST_CONTENTION <= (n = poller_contention_get_sessions(tcp_item->ipaddr)))
-	{
-	 	DEBUG_ITEM(poller_item_get_id(poller_item), "There are already %d connections for the %s host, delaying poll", n, tcp_item->interface_addr);
-	 	return POLL_NEED_DELAY;
-	}
-	DEBUG_ITEM(poller_item_get_id(poller_item), "There are already %d connections for the %s host, doing poll", n, tcp_item->interface_addr);
+	tcp_dns_t *dns;
+	int now = time(NULL);
 
 	if (1 == tcp_item->useip) {
-		tcp_send_request(poller_item);
+		tcp_iface_start(poller_item);
 		return POLL_STARTED_OK;
 	}
 
-	if ( tcp_item->next_resolve < time(NULL))
+	dns = tcp_dns_get(tcp_item->interface_addr);
+
+	if (NULL != dns->ipaddr && dns->next_resolve >= now)
 	{
-		DEBUG_ITEM(poller_item_get_id(poller_item), "Need to resolve %s", tcp_item->interface_addr);
-	
-		if (FAIL == poller_async_resolve(poller_item, tcp_item->interface_addr))
+		if (tcp_item->ipaddr != dns->ipaddr)
 		{
-			DEBUG_ITEM(poller_item_get_id(poller_item), "Cannot resolve item's interface addr: '%s'", tcp_item->interface_addr);
-			poller_preprocess_error(poller_item, "Cannot resolve item's interface hostname");
-			poller_return_item_to_queue(poller_item);
-			return POLL_STARTED_FAIL;
+			poller_strpool_free(tcp_item->ipaddr);
+			tcp_item->ipaddr = poller_strpool_copy(dns->ipaddr);
 		}
-		
+
+		tcp_iface_start(poller_item);
+		return POLL_STARTED_OK;
 	}
-	//LOG_INF("This is dns name %s item, but still cached addres %s",tcp_item->interface_addr, tcp_item->ipaddr);
-	tcp_send_request(poller_item);
+
+	zbx_vector_uint64_append(&dns->waiting, poller_item_get_id(poller_item));
+
+	/* lookup for the name is already in progress */
+	if (dns->resolve_started + sysinfo_get_config_timeout() >= now)
+		return POLL_STARTED_OK;
+
+	if (FAIL == tcp_dns_resolve(dns, poller_item))
+		return POLL_STARTED_FAIL;
+
 	return POLL_STARTED_OK;
 }
 
@@ -412,10 +853,26 @@ static void tcp_free_item(poller_item_t *poller_item)
 {
 
 	tcp_item_t *tcp_item = poller_item_get_specific_data(poller_item);
+	u_int64_t itemid = poller_item_get_id(poller_item);
+	tcp_iface_t *iface = tcp_iface_find(tcp_item->ipaddr);
+	tcp_dns_t *dns, local_dns = {.name = tcp_item->interface_addr};
+	int i;
+
+	if (NULL != iface)
+		tcp_iface_remove_pending(iface, itemid);
+
+	if (0 == tcp_item->useip && NULL != (dns = zbx_hashset_search(&names, &local_dns)) &&
+			FAIL != (i = zbx_vector_uint64_search(&dns->waiting, itemid, ZBX_DEFAULT_UINT64_COMPARE_FUNC)))
+		zbx_vector_uint64_remove(&dns->waiting, i);
 
 	if (NULL != tcp_item->bev)
+	{
 		async_tcp_destroy_session(poller_item);
 
+		if (NULL != iface)
+			tcp_iface_kick(iface);
+	}
+
 	if ((NULL != tcp_item->proto_ctx) &&
 		(NULL != conf[tcp_item->poll_type].item_destroy))
 	{
@@ -482,21 +939,118 @@ static int forks_count(void)
 	return CONFIG_FORKS[GLB_PROCESS_TYPE_AGENT];
 }
 
+/* repeats lookups lost together with the item which started them, restarts waiting items
+   if their sessions were expired by the contention housekeeper, drops unused interfaces */
+static void tcp_housekeep(void)
+{
+	static int last_housekeep = 0;
+	zbx_hashset_iter_t iter;
+	tcp_iface_t *iface;
+	tcp_dns_t *dns;
+	poller_item_t *poller_item;
+	int now = time(NULL);
+
+	if (now == last_housekeep)
+		return;
+
+	last_housekeep = now;
+
+	zbx_hashset_iter_reset(&names, &iter);
+
+	while (NULL != (dns = zbx_hashset_iter_next(&iter)))
+	{
+		if (0 == dns->waiting.values_num)
+		{
+			if (dns->next_resolve + TCP_IFACE_HOUSEKEEP_TTL < now)
+			{
+				poller_strpool_free(dns->name);
+				poller_strpool_free(dns->ipaddr);
+				zbx_vector_uint64_destroy(&dns->waiting);
+				zbx_hashset_iter_remove(&iter);
+			}
+			continue;
+		}
+
+		if (dns->resolve_started + sysinfo_get_config_timeout() >= now)
+			continue;
+
+		poller_item = NULL;
+
+		while (0 < dns->waiting.values_num &&
+				NULL == (poller_item = poller_get_poller_item(dns->waiting.values[0])))
+			zbx_vector_uint64_remove(&dns->waiting, 0);
+
+		if (NULL != poller_item)
+			tcp_dns_resolve(dns, poller_item);
+	}
+
+	zbx_hashset_iter_reset(&ifaces, &iter);
+
+	while (NULL != (iface = zbx_hashset_iter_next(&iter)))
+	{
+		tcp_iface_kick(iface);
+
+		if (0 == iface->idle_num && 0 == iface->pending.values_num &&
+				iface->lastuse + TCP_IFACE_HOUSEKEEP_TTL < now &&
+				0 == poller_contention_get_sessions(iface->ipaddr))
+		{
+			tcp_iface_clean(iface);
+			zbx_hashset_iter_remove(&iter);
+		}
+	}
+}
+
 static void async_io(void) {
 	poller_contention_housekeep();
+	tcp_housekeep();
 }
 
 static void tcp_shutdown_cb()
 {
+	zbx_hashset_iter_t iter;
+	tcp_iface_t *iface;
+	tcp_dns_t *dns;
+
+	zbx_hashset_iter_reset(&ifaces, &iter);
+
+	while (NULL != (iface = zbx_hashset_iter_next(&iter)))
+		tcp_iface_clean(iface);
+
+	zbx_hashset_iter_reset(&names, &iter);
+
+	while (NULL != (dns = zbx_hashset_iter_next(&iter)))
+	{
+		poller_strpool_free(dns->name);
+		poller_strpool_free(dns->ipaddr);
+		zbx_vector_uint64_destroy(&dns->waiting);
+	}
+
+	zbx_hashset_destroy(&ifaces);
+	zbx_hashset_destroy(&names);
 }
 
 int glb_tcp_init(void)
 {
 	poller_set_poller_callbacks(tcp_init_item, tcp_free_item, async_io, tcp_start_connection, 
-		tcp_shutdown_cb, forks_count, resolve_ready_func_cb, NULL, "http", 0, 1);
+		tcp_shutdown_cb, forks_count, resolve_ready_func_cb, resolve_fail_func_cb, "http", 0, 1);
 
 	tcp_agent_proto_init(&conf[ASYNC_TCP_POLL_TYPE_AGENT]);
 	tcp_simple_http_proto_init(&conf[ASYNC_TCP_POLL_SIMPLE_HTTP_TYPE]);
 
+	zbx_hashset_create(&ifaces, 100, ZBX_DEFAULT_PTR_HASH_FUNC, ZBX_DEFAULT_PTR_COMPARE_FUNC);
+	zbx_hashset_create(&names, 100, ZBX_DEFAULT_PTR_HASH_FUNC, ZBX_DEFAULT_PTR_COMPARE_FUNC);
+
+	if (NULL != CONFIG_SOURCE_IP && FAIL == tcp_make_sockaddr(CONFIG_SOURCE_IP, 0, &source_addr, &source_addr_len))
+		LOG_WRN("Invalid source IP address '%s'", CONFIG_SOURCE_IP);
+
 	return SUCCEED;
 }
+
+#ifdef HAVE_GLB_TESTS
+/* the tests see the results of the polls by their own protocol instead of the agent's one */
+void glb_tcp_test_init(tcp_poll_type_procs_t *procs)
+{
+	glb_tcp_init();
+	conf[ASYNC_TCP_POLL_TYPE_AGENT] = *procs;
+}
+#endif
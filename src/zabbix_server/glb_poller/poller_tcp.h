@@ -48,8 +48,13 @@ typedef struct {
 	tcp_poll_timeout_cb_func	timeout_cb;
 	tcp_poll_fail_cb_func		conn_fail_cb;
 	tcp_poll_connect_cb_func connect_cb;
+	unsigned char keepalive; /* connection might be reused for the next item of the same interface */
 } tcp_poll_type_procs_t ;
 
 int     glb_tcp_init();
 
+#ifdef HAVE_GLB_TESTS
+void    glb_tcp_test_init(tcp_poll_type_procs_t *procs);
+#endif
+
 #endif
\ No newline at end of file
@@ -53,6 +53,9 @@ static void timeout_event_cb(poller_item_t *poller_item, void *data) {
 	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);    
 	
 	//LOG_INF("Item %ld timed out, cleaning session %u", poller_get_item_id(poller_item), snmp_item->sessid);
+	if (SNMP_CMD_GET == snmp_item->snmp_req_type)
+		snmp_get_drop_packet(snmp_item->sessid);
+
 	poller_sessions_close_session(snmp_item->sessid);
 	snmp_item->sessid = 0;
 
@@ -158,6 +161,10 @@ static int process_result(csnmp_pdu_t *pdu)
 	struct sockaddr_in *saddr = (struct sockaddr_in *)&pdu->addr;
 	
 	poller_inc_responses();
+
+	if (SUCCEED == snmp_get_process_packet(pdu))
+		return SUCCEED;
+
 	if (0 == (itemid = poller_sessions_close_session(pdu->req_id))) {
 		char addr_str[20];
 		inet_ntop(AF_INET, &(pdu->addr), addr_str, INET_ADDRSTRLEN);
@@ -206,6 +213,12 @@ void snmp_send_packet(poller_item_t *poller_item, csnmp_pdu_t *pdu) {
 	poller_inc_requests();
 }
 
+/* packed requests keep their sessions and timeouts on their own */
+void snmp_send_pdu(csnmp_pdu_t *pdu) {
+	csnmp_send_pdu(conf.socket, pdu);
+	poller_inc_requests();
+}
+
 static int snmp_send_request(poller_item_t *poller_item) {
  	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
 	snmp_item->retries = 0;
@@ -298,6 +311,7 @@ static void  handle_async_io(void) {
 }
 
 void snmp_async_shutdown(void) {
+	snmp_get_destroy();
 	poller_destroy_event(conf.socket_event);
 	poller_sessions_destroy();
 	close(conf.socket);
@@ -344,5 +358,6 @@ void snmp_async_init(void) {
 	poller_run_fd_event(conf.socket_event);
 	
 	poller_sessions_init();
+	snmp_get_init();
 	//LOG_INF("Finished snmp init");
 }
\ No newline at end of file
@@ -43,6 +43,10 @@ typedef struct  {
 	const char 		*community;
 	unsigned char	snmp_req_type;
 
+	/* walk requests shape learned from the device, 0 means defaults */
+	unsigned short	walk_repetitions;
+	unsigned char	walk_no_bulk;
+
 } snmp_item_t;
 
 
@@ -51,6 +55,7 @@ void	snmp_async_shutdown(void);
 
 int		snmp_set_result(poller_item_t *poller_item, csnmp_var_t *var, AGENT_RESULT *result);
 void 	snmp_send_packet(poller_item_t *poller_item, csnmp_pdu_t *pdu);
+void 	snmp_send_pdu(csnmp_pdu_t *pdu);
 int 	snmp_fill_pdu_header(poller_item_t *poller_item, csnmp_pdu_t *pdu, int command);
 
 #endif
\ No newline at end of file
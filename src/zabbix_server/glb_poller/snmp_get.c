@@ -27,10 +27,358 @@
 #include "poller_async_io.h"
 #include "snmp_util.h"
 #include "zbx_item_constants.h"
+#include "poller_sessions.h"
+#include "../../libs/zbxsysinfo/sysinfo.h"
 #include "../../libs/glb_state/glb_state_items.h"
 
 #define MAX_ITEM_SNMP_GET_FREQUENCY	15
 
+/* how long items are waiting for others of the same host to be packed into one PDU */
+#define SNMP_GET_PACK_WINDOW	100
+/* rough BER overhead: message and pdu headers and a NULL value varbind */
+#define SNMP_GET_PDU_OVERHEAD	32
+#define SNMP_GET_VAR_OVERHEAD	6
+
+extern int CONFIG_SNMP_MAX_VARBINDS;
+extern int CONFIG_SNMP_MAX_PDU_SIZE;
+
+/* items of one host waiting to be sent, interned strings of the key are referenced */
+typedef struct {
+	const char *ipaddr;
+	const char *community;
+	unsigned short port;
+	unsigned char version;
+	int size;
+	zbx_vector_uint64_t itemids;
+} snmp_get_batch_t;
+
+/* sent multi-oid request, the pdu vars are in the order of the itemids */
+typedef struct {
+	u_int32_t id;
+	zbx_vector_uint64_t itemids;
+	csnmp_pdu_t pdu;
+} snmp_get_packet_t;
+
+typedef struct {
+	zbx_hashset_t batches;
+	zbx_hashset_t packets;
+	poller_event_t *flush_event;
+	unsigned char flush_planned;
+} snmp_get_conf_t;
+
+static snmp_get_conf_t conf = {0};
+
+static zbx_hash_t batch_hash(const void *data) {
+	const snmp_get_batch_t *batch = data;
+	zbx_hash_t hash;
+
+	/* strings are interned, so pointers identify them */
+	hash = ZBX_DEFAULT_PTR_HASH_FUNC(&batch->ipaddr);
+	hash = ZBX_DEFAULT_PTR_HASH_ALGO(&batch->community, sizeof(batch->community), hash);
+	hash = ZBX_DEFAULT_UINT64_HASH_ALGO(&batch->port, sizeof(batch->port), hash);
+
+	return ZBX_DEFAULT_UINT64_HASH_ALGO(&batch->version, sizeof(batch->version), hash);
+}
+
+static int batch_compare(const void *d1, const void *d2) {
+	const snmp_get_batch_t *b1 = d1, *b2 = d2;
+
+	ZBX_RETURN_IF_NOT_EQUAL(b1->ipaddr, b2->ipaddr);
+	ZBX_RETURN_IF_NOT_EQUAL(b1->community, b2->community);
+	ZBX_RETURN_IF_NOT_EQUAL(b1->port, b2->port);
+	ZBX_RETURN_IF_NOT_EQUAL(b1->version, b2->version);
+
+	return 0;
+}
+
+static zbx_hash_t packet_hash(const void *data) {
+	return *(const u_int32_t *)data;
+}
+
+static int packet_compare(const void *d1, const void *d2) {
+	ZBX_RETURN_IF_NOT_EQUAL(*(const u_int32_t *)d1, *(const u_int32_t *)d2);
+
+	return 0;
+}
+
+static void packet_remove(snmp_get_packet_t *packet) {
+	zbx_vector_uint64_destroy(&packet->itemids);
+	csnmp_free_pdu(&packet->pdu);
+	zbx_hashset_remove_direct(&conf.packets, packet);
+}
+
+static void pack_error_item(poller_item_t *poller_item, const char *error) {
+	poller_preprocess_error(poller_item, error);
+	glb_state_item_update_nextcheck(poller_item_get_id(poller_item), FAIL);
+	poller_return_item_to_queue(poller_item);
+}
+
+/* sends itemids[from, to) as one GET, all the items must share host, port, community and version */
+static void send_packet(const zbx_vector_uint64_t *itemids, int from, int to) {
+	snmp_get_packet_t packet = {0};
+	int i;
+
+	zbx_vector_uint64_create(&packet.itemids);
+
+	for (i = from; i < to; i++) {
+		poller_item_t *poller_item;
+		snmp_item_t *snmp_item;
+		asn1_oid_t oid;
+
+		/* might have been deleted meanwhile */
+		if (NULL == (poller_item = poller_get_poller_item(itemids->values[i])))
+			continue;
+
+		snmp_item = poller_item_get_specific_data(poller_item);
+
+		if (FAIL == snmp_item_oid_to_asn(snmp_item->oid, &oid)) {
+			pack_error_item(poller_item, "Cannot parse oid");
+			continue;
+		}
+
+		if (0 == packet.itemids.values_num) {
+			snmp_fill_pdu_header(poller_item, &packet.pdu, SNMP_CMD_GET);
+			packet.id = poller_sessions_create_session(0, 0);
+			packet.pdu.req_id = packet.id;
+		}
+
+		csnmp_add_var(&packet.pdu, oid, SNMP_TP_NULL, NULL);
+		zbx_vector_uint64_append(&packet.itemids, itemids->values[i]);
+
+		snmp_item->sessid = packet.id;
+		poller_run_timer_event(snmp_item->tm_event, sysinfo_get_config_timeout() * 1000);
+	}
+
+	if (0 == packet.itemids.values_num) {
+		zbx_vector_uint64_destroy(&packet.itemids);
+		return;
+	}
+
+	DEBUG_ITEM(packet.itemids.values[0], "Sending packed GET of %d oids, id %u", packet.itemids.values_num, packet.id);
+	
+	snmp_send_pdu(&packet.pdu);
+	zbx_hashset_insert(&conf.packets, &packet, sizeof(packet));
+}
+
+static void batch_release(snmp_get_batch_t *batch) {
+	zbx_vector_uint64_destroy(&batch->itemids);
+	poller_strpool_free(batch->ipaddr);
+	poller_strpool_free(batch->community);
+}
+
+static void flush_batches_cb(poller_item_t *null_item, void *null_data) {
+	zbx_hashset_iter_t iter;
+	snmp_get_batch_t *batch;
+
+	conf.flush_planned = 0;
+	zbx_hashset_iter_reset(&conf.batches, &iter);
+
+	while (NULL != (batch = zbx_hashset_iter_next(&iter))) {
+		send_packet(&batch->itemids, 0, batch->itemids.values_num);
+		batch_release(batch);
+		zbx_hashset_iter_remove(&iter);
+	}
+}
+
+static void batch_add_item(poller_item_t *poller_item) {
+	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
+	snmp_get_batch_t *batch, local_batch = {.ipaddr = snmp_item->ipaddr, .community = snmp_item->community,
+			.port = snmp_item->interface_port, .version = snmp_item->snmp_version};
+	int size = strlen(snmp_item->oid) + SNMP_GET_VAR_OVERHEAD;
+
+	if (NULL == (batch = zbx_hashset_search(&conf.batches, &local_batch))) {
+		local_batch.ipaddr = poller_strpool_add(snmp_item->ipaddr);
+		local_batch.community = poller_strpool_add(snmp_item->community);
+		local_batch.size = SNMP_GET_PDU_OVERHEAD + strlen(snmp_item->community);
+		zbx_vector_uint64_create(&local_batch.itemids);
+		
+		batch = zbx_hashset_insert(&conf.batches, &local_batch, sizeof(local_batch));
+	}
+
+	/* doesn't fit, the collected ones go now */
+	if (0 < batch->itemids.values_num && batch->size + size > CONFIG_SNMP_MAX_PDU_SIZE) {
+		send_packet(&batch->itemids, 0, batch->itemids.values_num);
+		zbx_vector_uint64_clear(&batch->itemids);
+		batch->size = SNMP_GET_PDU_OVERHEAD + strlen(snmp_item->community);
+	}
+
+	zbx_vector_uint64_append(&batch->itemids, poller_item_get_id(poller_item));
+	batch->size += size;
+	snmp_item->sessid = 0;
+
+	if (batch->itemids.values_num >= CONFIG_SNMP_MAX_VARBINDS) {
+		send_packet(&batch->itemids, 0, batch->itemids.values_num);
+		batch_release(batch);
+		zbx_hashset_remove_direct(&conf.batches, batch);
+		return;
+	}
+
+	if (0 == conf.flush_planned) {
+		poller_run_timer_event(conf.flush_event, SNMP_GET_PACK_WINDOW);
+		conf.flush_planned = 1;
+	}
+}
+
+static void process_item_var(poller_item_t *poller_item, csnmp_var_t *var) {
+	AGENT_RESULT result = {0};
+	
+	zbx_init_agent_result(&result);
+
+	if (SUCCEED == snmp_set_result(poller_item, var, &result)) {
+		DEBUG_ITEM(poller_item_get_id(poller_item),"Async SNMP SUCCEED RESULT processing for the item, type is %d", result.type);
+		poller_preprocess_agent_result_value(poller_item, NULL, &result);
+	} else {
+		DEBUG_ITEM(poller_item_get_id(poller_item), "Async SNMP FAILED RESULT processing for the item: %s", result.msg );
+		poller_preprocess_error(poller_item, result.msg);
+	}
+
+	poller_iface_register_succeed(poller_item);
+	zbx_free_agent_result(&result);
+}
+
+/* the item still waits for this packet, not timed out and resent */
+static poller_item_t *packet_get_item(snmp_get_packet_t *packet, int i) {
+	poller_item_t *poller_item;
+	snmp_item_t *snmp_item;
+
+	if (NULL == (poller_item = poller_get_poller_item(packet->itemids.values[i])))
+		return NULL;
+
+	snmp_item = poller_item_get_specific_data(poller_item);
+
+	if (snmp_item->sessid != packet->id)
+		return NULL;
+
+	poller_disable_event(snmp_item->tm_event);
+	snmp_item->retries = 0;
+	snmp_item->sessid = 0;
+
+	return poller_item;
+}
+
+/* agents normally keep the varbinds order, if not, the oid is looked up */
+static csnmp_var_t *packet_find_var(snmp_get_packet_t *packet, const csnmp_pdu_t *pdu, int i) {
+	int j;
+
+	if (i < pdu->vars_len && 0 == asn1_cmp_oids(pdu->vars[i].oid, packet->pdu.vars[i].oid))
+		return &pdu->vars[i];
+
+	for (j = 0; j < pdu->vars_len; j++) {
+		if (0 == asn1_cmp_oids(pdu->vars[j].oid, packet->pdu.vars[i].oid))
+			return &pdu->vars[j];
+	}
+
+	return NULL;
+}
+
+static void packet_resend(snmp_get_packet_t *packet, int from, int to, int skip) {
+	zbx_vector_uint64_t itemids;
+	int i;
+
+	zbx_vector_uint64_create(&itemids);
+
+	for (i = from; i < to; i++) {
+		if (i != skip && NULL != packet_get_item(packet, i))
+			zbx_vector_uint64_append(&itemids, packet->itemids.values[i]);
+	}
+
+	if (0 < itemids.values_num)
+		send_packet(&itemids, 0, itemids.values_num);
+
+	zbx_vector_uint64_destroy(&itemids);
+}
+
+/* returns FAIL if the responce isn't for a packed request */
+int snmp_get_process_packet(const csnmp_pdu_t *pdu) {
+	snmp_get_packet_t *packet;
+	poller_item_t *poller_item;
+	int i, num, now = time(NULL);
+
+	if (NULL == (packet = zbx_hashset_search(&conf.packets, &pdu->req_id)))
+		return FAIL;
+
+	poller_sessions_close_session(packet->id);
+	num = packet->itemids.values_num;
+
+	/* the responce wouldn't fit, so each half is asked separately */
+	if (SNMP_ERR_TOO_BIG == pdu->error_status && 1 < num) {
+		DEBUG_ITEM(packet->itemids.values[0], "Got tooBig for %d oids, splitting the request", num);
+		packet_resend(packet, 0, num / 2, -1);
+		packet_resend(packet, num / 2, num, -1);
+		packet_remove(packet);
+		return SUCCEED;
+	}
+
+	/* in v1 a single bad oid fails the whole request, the rest are asked again without it */
+	if (SNMP_ERR_OK != pdu->error_status && 1 < num && 0 < pdu->error_index && pdu->error_index <= num) {
+		if (NULL != (poller_item = packet_get_item(packet, pdu->error_index - 1))) {
+			((snmp_item_t *)poller_item_get_specific_data(poller_item))->lastpolled = now;
+			poller_return_item_to_queue(poller_item);
+			poller_preprocess_error(poller_item, "Got responce PDU with error indication");
+		}
+		
+		packet_resend(packet, 0, num, pdu->error_index - 1);
+		packet_remove(packet);
+		return SUCCEED;
+	}
+
+	for (i = 0; i < num; i++) {
+		csnmp_var_t *var;
+
+		if (NULL == (poller_item = packet_get_item(packet, i)))
+			continue;
+
+		((snmp_item_t *)poller_item_get_specific_data(poller_item))->lastpolled = now;
+		poller_return_item_to_queue(poller_item);
+		
+		if (SNMP_ERR_OK != pdu->error_status)
+			poller_preprocess_error(poller_item, "Got responce PDU with error indication");
+		else if (NULL == (var = packet_find_var(packet, pdu, i)))
+			poller_preprocess_error(poller_item, "No value for the item's oid in the responce PDU");
+		else
+			process_item_var(poller_item, var);
+	}
+
+	packet_remove(packet);
+	return SUCCEED;
+}
+
+/* on timeout the packet is forgotten, items are retried on their own */
+void snmp_get_drop_packet(u_int32_t id) {
+	snmp_get_packet_t *packet;
+
+	if (NULL != (packet = zbx_hashset_search(&conf.packets, &id)))
+		packet_remove(packet);
+}
+
+void snmp_get_init(void) {
+	zbx_hashset_create(&conf.batches, 100, batch_hash, batch_compare);
+	zbx_hashset_create(&conf.packets, 100, packet_hash, packet_compare);
+	conf.flush_event = poller_create_event(NULL, flush_batches_cb, 0, NULL, 0);
+}
+
+void snmp_get_destroy(void) {
+	zbx_hashset_iter_t iter;
+	snmp_get_batch_t *batch;
+	snmp_get_packet_t *packet;
+
+	zbx_hashset_iter_reset(&conf.batches, &iter);
+	
+	while (NULL != (batch = zbx_hashset_iter_next(&iter)))
+		batch_release(batch);
+
+	zbx_hashset_iter_reset(&conf.packets, &iter);
+
+	while (NULL != (packet = zbx_hashset_iter_next(&iter))) {
+		zbx_vector_uint64_destroy(&packet->itemids);
+		csnmp_free_pdu(&packet->pdu);
+	}
+
+	zbx_hashset_destroy(&conf.batches);
+	zbx_hashset_destroy(&conf.packets);
+	poller_destroy_event(conf.flush_event);
+}
+
 int snmp_get_send_request(poller_item_t *poller_item) {
 	csnmp_pdu_t pdu;
 	asn1_oid_t oid;
@@ -44,6 +392,11 @@ int snmp_get_send_request(poller_item_t *poller_item) {
 		return SUCCEED;
 	}
 
+	if (1 < CONFIG_SNMP_MAX_VARBINDS) {
+		batch_add_item(poller_item);
+		return SUCCEED;
+	}
+
 	if (FAIL == snmp_fill_pdu_header(poller_item, &pdu, SNMP_CMD_GET))
 		return FAIL;
 		
@@ -94,23 +447,8 @@ void snmp_get_process_result(poller_item_t *poller_item, const csnmp_pdu_t* pdu)
 	if (SNMP_ERR_OK == pdu->error_status) {  
 		int i;
 
-		for (i = 0; i < pdu->vars_len; i++) {
-
-			AGENT_RESULT result = {0};
-			zbx_init_agent_result(&result);
-
- 			if (SUCCEED == snmp_set_result(poller_item, &pdu->vars[i], &result)) {
-				DEBUG_ITEM(poller_item_get_id(poller_item),"Async SNMP SUCCEED RESULT processing for the item, type is %d", result.type);
-				poller_preprocess_agent_result_value(poller_item, NULL, &result);
-				poller_iface_register_succeed(poller_item);
-			} else {
-				DEBUG_ITEM(poller_item_get_id(poller_item), "Async SNMP FAILED RESULT processing for the item: %s", result.msg );
-				poller_preprocess_error(poller_item, result.msg);
-				poller_iface_register_succeed(poller_item);
- 			}
-
-			zbx_free_agent_result(&result);
-		}	
+		for (i = 0; i < pdu->vars_len; i++)
+			process_item_var(poller_item, &pdu->vars[i]);
  	} else 
  		poller_preprocess_error(poller_item, "Got responce PDU with error indication");
 }
\ No newline at end of file
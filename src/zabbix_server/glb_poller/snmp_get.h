@@ -27,3 +27,8 @@
 int     snmp_get_send_request(poller_item_t *poller_item);
 void    snmp_get_timeout(poller_item_t *poller_item);
 void    snmp_get_process_result(poller_item_t *poller_item, const csnmp_pdu_t* pdu);
+
+void    snmp_get_init(void);
+void    snmp_get_destroy(void);
+int     snmp_get_process_packet(const csnmp_pdu_t *pdu);
+void    snmp_get_drop_packet(u_int32_t id);
@@ -45,19 +45,34 @@ typedef struct
 }
 snmp_dobject_t;
 
-/* helper data structure used by snmp discovery */
+/* walk state of one of the discovery OIDs (table columns), columns are walked in parallel */
 typedef struct
 {
 	csnmp_oid_t root_oid;
-	
+	csnmp_oid_t last_oid;
+
 	size_t root_oid_str_len;
 	size_t root_oid_num_len;
 
-	csnmp_oid_t last_oid;
 	int oids_looped;
+	unsigned char finished;
+}
+snmp_walk_column_t;
 
-	/* the index of OID being currently processed (walked) */
-	int			num;
+/* helper data structure used by snmp discovery */
+typedef struct
+{
+	snmp_walk_column_t *columns;
+	int columns_num;
+
+	/* columns asked in the request being processed, in the varbinds order */
+	int *active;
+	int active_num;
+
+	/* request shape, adapted on tooBig, errors and timeouts */
+	unsigned char use_bulk;
+	int repetitions;
+	int max_columns;
 
 	/* the discovered SNMP objects */
 	zbx_hashset_t		objects;
@@ -70,6 +85,11 @@ typedef struct
 }
 snmp_ddata_t;
 
+extern int CONFIG_SNMP_BULK_MAX_REPETITIONS;
+
+static void	snmp_ddata_clean(poller_item_t *poller_item);
+static int	snmp_walk_column_init(snmp_walk_column_t *column, const char *str_oid, const char **error);
+
 /* discovery objects hashset support */
 static zbx_hash_t	snmp_dobject_hash(const void *data)
 {
@@ -91,6 +111,7 @@ static int	snmp_ddata_init(poller_item_t *poller_item)
 	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
 	
 	snmp_ddata_t *data = zbx_calloc(NULL, 0, sizeof(snmp_ddata_t));
+	const char *error;
 	int	i, j, ret = CONFIG_ERROR;
 
 	zbx_init_agent_request(&data->request);
@@ -146,11 +167,31 @@ static int	snmp_ddata_init(poller_item_t *poller_item)
 		}
 	}
 
+	data->columns_num = data->request.nparam / 2;
+	data->columns = zbx_calloc(NULL, data->columns_num, sizeof(snmp_walk_column_t));
+	data->active = zbx_calloc(NULL, data->columns_num, sizeof(int));
+
+	for (i = 0; i < data->columns_num; i++)
+	{
+		if (SUCCEED != snmp_walk_column_init(&data->columns[i], data->request.params[i * 2 + 1], &error))
+		{
+			poller_preprocess_error(poller_item, error);
+			snmp_item->data = data;
+			snmp_ddata_clean(poller_item);
+			return FAIL;
+		}
+	}
+
 	zbx_hashset_create(&data->objects, 10, snmp_dobject_hash, snmp_dobject_compare);
 	zbx_vector_ptr_create(&data->index);
 	
-	data->num = -1;
-	data->oids_looped = 0;
+	/* bulk requests are only possible since v2c */
+	data->use_bulk = (ZBX_IF_SNMP_VERSION_1 != snmp_item->snmp_version && 0 < CONFIG_SNMP_BULK_MAX_REPETITIONS &&
+			0 == snmp_item->walk_no_bulk);
+	data->repetitions = 0 != snmp_item->walk_repetitions ? snmp_item->walk_repetitions : 
+			CONFIG_SNMP_BULK_MAX_REPETITIONS;
+	data->max_columns = MIN(data->columns_num, SNMP_WALK_MAX_COLUMNS);
+	
 	snmp_item->data = data;
 
 	return SUCCEED;
@@ -170,22 +211,30 @@ static void	snmp_ddata_clean(poller_item_t *poller_item)
 
 	snmp_item->data = NULL;
 
-	zbx_vector_ptr_destroy(&ddata->index);
-	zbx_hashset_iter_reset(&ddata->objects, &iter);
+	if (NULL != ddata->index.values) {
+		zbx_vector_ptr_destroy(&ddata->index);
+		zbx_hashset_iter_reset(&ddata->objects, &iter);
 
-	while (NULL != (obj = (snmp_dobject_t *)zbx_hashset_iter_next(&iter)))
-	{
-		for (i = 0; i < ddata->request.nparam / 2; i++)
-			zbx_free(obj->values[i]);
+		while (NULL != (obj = (snmp_dobject_t *)zbx_hashset_iter_next(&iter)))
+		{
+			for (i = 0; i < ddata->columns_num; i++)
+				zbx_free(obj->values[i]);
+
+			zbx_free(obj->index);
+			zbx_free(obj->values);
+		}
 
-		zbx_free(obj->index);
-		zbx_free(obj->values);
+		zbx_hashset_destroy(&ddata->objects);
+	}
+
+	for (i = 0; i < ddata->columns_num; i++) {
+		asn1_free_oid(&ddata->columns[i].last_oid);
+		asn1_free_oid(&ddata->columns[i].root_oid);
 	}
 
-	zbx_hashset_destroy(&ddata->objects);
 	zbx_free_agent_request(&ddata->request);
-	asn1_free_oid(&ddata->last_oid);
-	asn1_free_oid(&ddata->root_oid);
+	zbx_free(ddata->columns);
+	zbx_free(ddata->active);
 	zbx_free(ddata);
 }
 
@@ -315,129 +364,176 @@ numeric:
 	return SUCCEED;
 }
 
-int  snmp_walk_start_next_oid(poller_item_t *poller_item) {
-	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
-	snmp_ddata_t *ddata = snmp_item->data;
-
-	if (NULL == ddata) {
-		stop_item_poll(poller_item);
-		return FAIL;
-	}
-
-	ddata->num++;
-
-	if (ddata->num >= ddata->request.nparam / 2) {
-		DEBUG_ITEM(poller_item_get_id(poller_item), "All oids are parsed for item, submitting the result");
-		snmp_walk_submit_result(poller_item);
-		stop_item_poll(poller_item);
-		return SUCCEED;
-	}
-
-	DEBUG_ITEM(poller_item_get_id(poller_item),"Starting walking oid %d out of %d", ddata->num + 1,  ddata->request.nparam / 2);
-	char *next_oid = ddata->request.params[ddata->num * 2 + 1];
-	
+static int	snmp_walk_column_init(snmp_walk_column_t *column, const char *str_oid, const char **error)
+{
 	char buffer[MAX_STRING_LEN];
 	unsigned long root_oid[MAX_OID_LEN];
 	size_t root_oid_len = MAX_OID_LEN;
 
-	if (NULL == snmp_parse_oid(next_oid, root_oid, &root_oid_len))
+	if (NULL == snmp_parse_oid(str_oid, root_oid, &root_oid_len))
 	{
-		poller_preprocess_error(poller_item, "snmp_parse_oid(): cannot parse OID");
-		stop_item_poll(poller_item);
+		*error = "snmp_parse_oid(): cannot parse OID";
 	  	return FAIL;
 	}
 
 	if (FAIL == snmp_print_oid(buffer, MAX_STRING_LEN, root_oid, root_oid_len, ZBX_OID_INDEX_STRING))
 	{
-		poller_preprocess_error(poller_item, "snmp_print_oid(): cannot print OID with string indices.");
-		stop_item_poll(poller_item);
+		*error = "snmp_print_oid(): cannot print OID with string indices.";
 		return FAIL;
 	}
 
-	ddata->root_oid_str_len = strlen(buffer);
+	column->root_oid_str_len = strlen(buffer);
 
 	if (FAIL == snmp_print_oid(buffer, MAX_STRING_LEN, root_oid, root_oid_len, ZBX_OID_INDEX_NUMERIC))
 	{
-		poller_preprocess_error(poller_item, "snmp_print_oid(): cannot print OID  with numeric indices.");
-		stop_item_poll(poller_item);
+		*error = "snmp_print_oid(): cannot print OID  with numeric indices.";
 		return FAIL;
 	}
 
-	ddata->root_oid_num_len = strlen(buffer);
+	column->root_oid_num_len = strlen(buffer);
 
-	csnmp_pdu_t pdu={0};
-	asn1_oid_t coid;
+	if ( FAIL == snmp_item_oid_to_asn(str_oid, &column->root_oid)) {
+		*error = "Cannot parse oid";
+	  	return FAIL;
+	} 
 	
-	if (FAIL == snmp_fill_pdu_header(poller_item, &pdu, SNMP_CMD_GET_NEXT))
-		return FAIL;
+	copy_oid(&column->last_oid, &column->root_oid);
+
+	return SUCCEED;
+}
 
-	if ( FAIL == snmp_item_oid_to_asn(next_oid, &coid)) {
-	  	poller_preprocess_error(poller_item, "Cannot parse oid");
+/* successful walks let the repetitions grow back after the adaptation to errors or timeouts */
+static void snmp_walk_finish(poller_item_t *poller_item) {
+	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
+	snmp_ddata_t *ddata = snmp_item->data;
+
+	if (ddata->use_bulk && ddata->repetitions < CONFIG_SNMP_BULK_MAX_REPETITIONS)
+		snmp_item->walk_repetitions = MIN(ddata->repetitions * 2, CONFIG_SNMP_BULK_MAX_REPETITIONS);
+
+	DEBUG_ITEM(poller_item_get_id(poller_item), "All oids are walked for the item, submitting the result");
+	snmp_walk_submit_result(poller_item);
+	stop_item_poll(poller_item);
+}
+
+/* asks for the next portion of all the unfinished columns, up to max_columns of them in one PDU;
+   with GETBULK each of them gets up to repetitions values */
+static int snmp_walk_send_request(poller_item_t *poller_item) {
+	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
+	snmp_ddata_t *ddata = snmp_item->data;
+	csnmp_pdu_t pdu = {0};
+	int i;
+
+	if (NULL == ddata) {
 		stop_item_poll(poller_item);
+		return FAIL;
+	}
 
-		csnmp_free_pdu(&pdu);
-	  	return FAIL;
-	} 
-	
-	copy_oid(&ddata->root_oid, &coid);
-	copy_oid(&ddata->last_oid, &coid);
-	
-	ddata->oids_looped = 0;
+	ddata->active_num = 0;
+
+	for (i = 0; i < ddata->columns_num && ddata->active_num < ddata->max_columns; i++) {
+		if (0 == ddata->columns[i].finished)
+			ddata->active[ddata->active_num++] = i;
+	}
+
+	if (0 == ddata->active_num) {
+		snmp_walk_finish(poller_item);
+		return SUCCEED;
+	}
+
+	snmp_fill_pdu_header(poller_item, &pdu, ddata->use_bulk ? SNMP_CMD_GET_BULK : SNMP_CMD_GET_NEXT);
+
+	if (ddata->use_bulk) {
+		pdu.max_repeaters = 0;
+		pdu.max_repetitions = ddata->repetitions;
+	}
+
+	for (i = 0; i < ddata->active_num; i++) {
+		asn1_oid_t next_oid;
+
+		copy_oid(&next_oid, &ddata->columns[ddata->active[i]].last_oid);
+		csnmp_add_var(&pdu, next_oid, SNMP_TP_NULL, NULL);
+	}
+
+	DEBUG_ITEM(poller_item_get_id(poller_item), "Sending walk request for %d oids, bulk: %d, repetitions: %d", 
+			ddata->active_num, ddata->use_bulk, ddata->repetitions);
 
-	DEBUG_ITEM(poller_item_get_id(poller_item), "Sending first walk request for oid %s", next_oid);
-	
-	csnmp_add_var(&pdu, coid, SNMP_TP_NULL, NULL);
 	snmp_send_packet(poller_item, &pdu);
 	csnmp_free_pdu(&pdu);
 	
 	return SUCCEED;
 }
 
-static void	snmp_walk_save_result_value(snmp_ddata_t *data, const char *snmp_oid, const char *index, const char *value)
+/* makes the next request lighter: less repetitions, then GETNEXT, then less columns per request;
+   returns FAIL if there is nothing left to reduce */
+static int snmp_walk_reduce_request(poller_item_t *poller_item) {
+	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
+	snmp_ddata_t *ddata = snmp_item->data;
+
+	if (ddata->use_bulk && ddata->repetitions > 1) {
+		ddata->repetitions /= 2;
+		snmp_item->walk_repetitions = ddata->repetitions;
+		return SUCCEED;
+	}
+
+	if (ddata->use_bulk) {
+		ddata->use_bulk = 0;
+		snmp_item->walk_no_bulk = 1;
+		return SUCCEED;
+	}
+
+	if (ddata->active_num > 1) {
+		ddata->max_columns = ddata->active_num / 2;
+		return SUCCEED;
+	}
+
+	return FAIL;
+}
+
+static void	snmp_walk_save_result_value(snmp_ddata_t *data, int column, const char *index, const char *value)
 {
 	snmp_dobject_t	*obj;
-	ZBX_UNUSED(snmp_oid);
 
 	if (NULL == (obj = (snmp_dobject_t *)zbx_hashset_search(&data->objects, &index)))
 	{
 		snmp_dobject_t	new_obj;
 
 		new_obj.index = zbx_strdup(NULL, index);
-		new_obj.values = (char **)zbx_malloc(NULL, sizeof(char *) * data->request.nparam / 2);
-		memset(new_obj.values, 0, sizeof(char *) * data->request.nparam / 2);
+		new_obj.values = (char **)zbx_malloc(NULL, sizeof(char *) * data->columns_num);
+		memset(new_obj.values, 0, sizeof(char *) * data->columns_num);
 
 		obj = (snmp_dobject_t *)zbx_hashset_insert(&data->objects, &new_obj, sizeof(new_obj));
 		zbx_vector_ptr_append(&data->index, obj);
 	}
-	obj->values[data->num] = zbx_strdup(NULL, value);
+
+	/* bulk responses might overlap on retries */
+	zbx_free(obj->values[column]);
+	obj->values[column] = zbx_strdup(NULL, value);
 }
 
-/* returns SUCEED is get next requst is needed */
-int snmp_walk_process_var(poller_item_t *poller_item, csnmp_var_t *var) {
+/* the column is finished when it leaves its oid subtree or the mib ends;
+   returns FAIL if the walk failed, the error is already sent then */
+static int snmp_walk_process_var(poller_item_t *poller_item, snmp_walk_column_t *column, int column_num, 
+		csnmp_var_t *var) {
 	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
 	snmp_ddata_t *ddata = snmp_item->data;
 	
-	if (NULL == ddata) {
-		LOG_WRN("Arrived responce for the item %ld, but walk is not active for it", poller_item_get_id(poller_item));
-		return FAIL;
-	}
-
-	if (SNMP_TP_END_OF_MIB_VIEW == var->type || var->oid.len < ddata->root_oid.len ||
-			0 != memcmp(ddata->root_oid.b, var->oid.b, ddata->root_oid.len * sizeof(int))) {
-		return FAIL;
+	if (SNMP_TP_END_OF_MIB_VIEW == var->type || var->oid.len < column->root_oid.len ||
+			0 != memcmp(column->root_oid.b, var->oid.b, column->root_oid.len * sizeof(int))) {
+		column->finished = 1;
+		return SUCCEED;
 	}
 
-	if (SNMP_TP_NO_SUCH_INSTANCE == var->type && SNMP_TP_NO_SUCH_INSTANCE == var->type) {
+	if (SNMP_TP_NO_SUCH_INSTANCE == var->type || SNMP_TP_NO_SUCH_OBJ == var->type) {
 		poller_preprocess_error(poller_item, snmp_err_to_text(var->type));
 		return FAIL;
 	}
 	
-	if ( 0 == asn1_cmp_oids(ddata->last_oid, var->oid)) {
+	if ( 0 <= asn1_cmp_oids(column->last_oid, var->oid)) {
 		poller_preprocess_error(poller_item, "Cannot walk item: oid is not increasing");
 		return FAIL;
 	}
 	
-	if ( ddata->oids_looped++ > SNMP_WALK_MAX_OIDS ) {
+	if ( column->oids_looped++ > SNMP_WALK_MAX_OIDS ) {
 		poller_preprocess_error(poller_item, "Cannot walk item: too many oids or cycle");
 		return FAIL;
 	}
@@ -448,7 +544,7 @@ int snmp_walk_process_var(poller_item_t *poller_item, csnmp_var_t *var) {
 	csnmp_oid_2_netsnmp(&var->oid, obj_oid);
 
 	if (SUCCEED != snmp_choose_index(oid_index, sizeof(oid_index), obj_oid,
-						var->oid.len, ddata->root_oid_str_len, ddata->root_oid_num_len)) {
+						var->oid.len, column->root_oid_str_len, column->root_oid_num_len)) {
 		poller_preprocess_error(poller_item,"zbx_snmp_choose_index():"
 			" cannot choose appropriate index while walking for OID");
 		return FAIL;
@@ -459,59 +555,95 @@ int snmp_walk_process_var(poller_item_t *poller_item, csnmp_var_t *var) {
 
 	/*note: result absence is OK, not adding to indexes, but continue walking */
  	if (SUCCEED == snmp_set_result(poller_item, var, &result)) {
-		//if (ISSET_TEXT(&result) && ZBX_SNMP_STR_HEX == val_type)
-		//				zbx_remove_chars(snmp_result.text, "\r\n");
 		char **text_result = ZBX_GET_TEXT_RESULT(&result);
 		
 		DEBUG_ITEM(poller_item_get_id(poller_item),"Saving walk responce '%s'", *text_result);
 
 		if (NULL != *text_result) 
-			snmp_walk_save_result_value(ddata, ddata->request.params[ddata->num * 2 + 1], oid_index, *text_result );
+			snmp_walk_save_result_value(ddata, column_num, oid_index, *text_result );
 	}
 
 	zbx_free_agent_result(&result);
+
+	asn1_free_oid(&column->last_oid);
+	copy_oid(&column->last_oid, &var->oid);
+
 	return SUCCEED;
 }
 
 void snmp_walk_process_result(poller_item_t *poller_item, const csnmp_pdu_t *pdu) {
-	csnmp_pdu_t new_pdu;
-	csnmp_oid_t next_oid;
-	int i, ret;
+	int i;
 	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
 	snmp_ddata_t *ddata = snmp_item->data;
 	
 	DEBUG_ITEM(poller_item_get_id(poller_item), "Processing responce for the walk item");
 
-	if (pdu->vars_len < 1) {
-		snmp_walk_start_next_oid(poller_item);
+	if (NULL == ddata) {
+		LOG_WRN("Arrived responce for the item %ld, but walk is not active for it", poller_item_get_id(poller_item));
 		return;
 	}
 
+	if (SNMP_ERR_TOO_BIG == pdu->error_status) {
+		if (FAIL == snmp_walk_reduce_request(poller_item)) {
+			poller_preprocess_error(poller_item, "Cannot walk item: responce is too big even for a single oid");
+			stop_item_poll(poller_item);
+			return;
+		}
+
+		snmp_walk_send_request(poller_item);
+		return;
+	}
+
+	if (SNMP_ERR_OK != pdu->error_status) {
+		/* v1 agents report the end of the mib this way, the rest of the columns go further */
+		if (0 == ddata->use_bulk && 0 < pdu->error_index && pdu->error_index <= ddata->active_num) {
+			ddata->columns[ddata->active[pdu->error_index - 1]].finished = 1;
+		} else if (ddata->use_bulk) {
+			DEBUG_ITEM(poller_item_get_id(poller_item), "Bulk request failed, falling back to GETNEXT");
+			ddata->use_bulk = 0;
+			snmp_item->walk_no_bulk = 1;
+		} else {
+			poller_preprocess_error(poller_item, "Got responce PDU with error indication");
+			stop_item_poll(poller_item);
+			return;
+		}
+
+		snmp_walk_send_request(poller_item);
+		return;
+	}
+
+	/* an agent which can't fit even a single value returns no vars */
+	if (0 == pdu->vars_len) {
+		if (FAIL == snmp_walk_reduce_request(poller_item)) {
+			poller_preprocess_error(poller_item, "Cannot walk item: got empty responce");
+			stop_item_poll(poller_item);
+			return;
+		}
+
+		snmp_walk_send_request(poller_item);
+		return;
+	}
+
+	/* bulk responce is row by row: the first repetition of each requested column, then the second ...
+	   the agent might truncate it to fit the size limit, so the columns missing or cut in the responce
+	   are asked again from their last oid */
 	for (i = 0; i < pdu->vars_len; i++) {
-		/* either tree finished or walk fail - processing next oid or finishing the walk */
+		int column_num = ddata->active[i % ddata->active_num];
+		snmp_walk_column_t *column = &ddata->columns[column_num];
 		
-		if (FAIL == snmp_walk_process_var(poller_item, &pdu->vars[i])) {
-			snmp_walk_start_next_oid(poller_item);
+		if (column->finished)
+			continue;
+
+		if (FAIL == snmp_walk_process_var(poller_item, column, column_num, &pdu->vars[i])) {
+			stop_item_poll(poller_item);
 			return;
 		}
 	}
 
-
-	copy_oid(&next_oid, &pdu->vars[pdu->vars_len-1].oid);
-	asn1_free_oid(&ddata->last_oid);
-	copy_oid(&ddata->last_oid, &pdu->vars[pdu->vars_len-1].oid);
-	
-	snmp_fill_pdu_header(poller_item, &new_pdu, SNMP_CMD_GET_NEXT);
-	csnmp_add_var(&new_pdu, next_oid, SNMP_TP_NULL, NULL);
-	snmp_send_packet(poller_item, &new_pdu);
-	csnmp_free_pdu(&new_pdu);
+	snmp_walk_send_request(poller_item);
 }
 
 int snmp_walk_send_first_request(poller_item_t *poller_item) {
-	csnmp_pdu_t pdu;
-	asn1_oid_t oid;
-	char *start_oid;
-
 	snmp_item_t *snmp_item = poller_item_get_specific_data(poller_item);
 	
 	DEBUG_ITEM(poller_item_get_id(poller_item), "Starting async walk on item ");
@@ -521,10 +653,12 @@ int snmp_walk_send_first_request(poller_item_t *poller_item) {
 		return FAIL;
 	}
 
-	if (FAIL == snmp_ddata_init(poller_item)) 
+	if (FAIL == snmp_ddata_init(poller_item)) {
+		poller_return_item_to_queue(poller_item);
 		return FAIL;
+	}
 	
-	snmp_walk_start_next_oid(poller_item);
+	return snmp_walk_send_request(poller_item);
 }
 
 void snmp_walk_timeout(poller_item_t *poller_item) {
@@ -538,20 +672,14 @@ void snmp_walk_timeout(poller_item_t *poller_item) {
 		poller_preprocess_error(poller_item, "SNMP timeout: max retries exceeded");
 		snmp_ddata_clean(poller_item);
 		poller_return_item_to_queue(poller_item);
-	//	snmp_item->sessid = 0;
 	} else { /*one more retry */
-		
-		csnmp_pdu_t pdu;
-		snmp_ddata_t *ddata = snmp_item->data;
-		asn1_oid_t last_oid;
 		DEBUG_ITEM( poller_item_get_id(poller_item),"Sending retry, retry %d", snmp_item->retries);
 		
-		snmp_fill_pdu_header(poller_item, &pdu, SNMP_CMD_GET_NEXT);
-		copy_oid(&last_oid, &ddata->last_oid);
+		/* big bulk responces might be dropped on the way or ignored by the agent */
+		if (NULL != snmp_item->data && ((snmp_ddata_t *)snmp_item->data)->use_bulk)
+			snmp_walk_reduce_request(poller_item);
 
-		csnmp_add_var(&pdu, last_oid, SNMP_TP_NULL, NULL);
-		snmp_send_packet(poller_item, &pdu);
-		csnmp_free_pdu(&pdu);
 		snmp_item->retries++;
+		snmp_walk_send_request(poller_item);
 	}
-}
\ No newline at end of file
+}
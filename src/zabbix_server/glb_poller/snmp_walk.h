@@ -22,6 +22,7 @@
 #include "glb_poller.h"
 
 #define SNMP_WALK_MAX_OIDS 100000
+#define SNMP_WALK_MAX_COLUMNS 64
 
 void snmp_walk_destroy_item(poller_item_t *poller_item);
 void snmp_walk_timeout(poller_item_t *poller_item);
@@ -251,4 +251,5 @@ void tcp_agent_proto_init(tcp_poll_type_procs_t *procs) {
     procs->response_cb = response_cb;
     procs->create_request = create_request;
     procs->timeout_cb = timeout_cb;
+    procs->keepalive = 1;
 }
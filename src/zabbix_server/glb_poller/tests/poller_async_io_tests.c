@@ -0,0 +1,288 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "../poller_async_io.h"
+
+/* the wheel levels cover 256 msec, 65.5 sec, 4.66 hours and 49.7 days */
+#define TEST_LEVEL_BITS		8
+#define TEST_MAX_DELAY		((1ULL << 32) - 1)
+
+typedef struct test_timer_t test_timer_t;
+
+struct test_timer_t {
+	poller_event_t *event;
+	u_int64_t due;
+	u_int64_t interval; /* persistent timers are due again in the interval after each fire */
+	int fires;
+	int cancelled;
+	test_timer_t *other; /* the timer the callback cancels or re-adds */
+	u_int64_t delay; /* the delay the callback re-adds a timer with */
+};
+
+static u_int64_t test_now;
+
+static void set_test_time(u_int64_t time_ms) {
+	test_now = time_ms;
+	poller_async_set_test_time(time_ms);
+}
+
+/* jumps the clock to the time the wheel asks to be woken up at, as the events loop would do,
+   returns the number of the wakeups */
+static int run_timers_till(u_int64_t till) {
+	u_int64_t wakeup;
+	int wakeups = 0;
+
+	while (0 != (wakeup = poller_async_run_test_timers()) && wakeup <= till) {
+		assert(wakeup > test_now && "The tick should be armed for the future");
+		set_test_time(wakeup);
+		wakeups++;
+	}
+
+	if (till > test_now)
+		set_test_time(till);
+
+	return wakeups;
+}
+
+static void timer_fired(test_timer_t *timer) {
+	assert(0 == timer->cancelled && "Cancelled timer should not fire");
+	assert(test_now >= timer->due && "Timer should not fire early");
+	assert(test_now == timer->due && "Timer should fire on its tick");
+
+	timer->fires++;
+	timer->due += timer->interval;
+}
+
+static void check_cb(poller_item_t *poller_item, void *data) {
+	timer_fired(data);
+}
+
+static void cancel_other_cb(poller_item_t *poller_item, void *data) {
+	test_timer_t *timer = data;
+
+	timer_fired(timer);
+	poller_disable_event(timer->other->event);
+	timer->other->cancelled = 1;
+}
+
+static void readd_other_cb(poller_item_t *poller_item, void *data) {
+	test_timer_t *timer = data;
+
+	timer_fired(timer);
+	poller_run_timer_event(timer->other->event, timer->delay);
+	timer->other->due = test_now + timer->delay;
+}
+
+static void readd_self_cb(poller_item_t *poller_item, void *data) {
+	test_timer_t *timer = data;
+
+	timer_fired(timer);
+
+	if (1 == timer->fires) {
+		poller_run_timer_event(timer->event, timer->delay);
+		timer->due = test_now + timer->delay;
+	}
+}
+
+static void destroy_self_cb(poller_item_t *poller_item, void *data) {
+	test_timer_t *timer = data;
+
+	timer_fired(timer);
+
+	if (3 == timer->fires) {
+		poller_destroy_event(timer->event);
+		timer->event = NULL;
+	}
+}
+
+static void disable_self_cb(poller_item_t *poller_item, void *data) {
+	test_timer_t *timer = data;
+
+	timer_fired(timer);
+
+	if (2 == timer->fires)
+		poller_disable_event(timer->event);
+}
+
+static void add_timer(test_timer_t *timer, poller_event_cb_func_t cb, u_int64_t delay, int persist) {
+	timer->event = poller_create_event(NULL, cb, 0, timer, persist);
+	timer->due = test_now + delay;
+	timer->interval = persist ? delay : 0;
+
+	poller_run_timer_event(timer->event, delay);
+}
+
+static void destroy_timers(test_timer_t *timers, int num) {
+	int i;
+
+	for (i = 0; i < num; i++)
+		poller_destroy_event(timers[i].event);
+}
+
+/* the timers are due around the next wrap of each level, so they are cascaded down from all the levels */
+static void test_wheel_boundaries(void) {
+	test_timer_t timers[32] = {0};
+	u_int64_t start = test_now, step, aligned;
+	int i, num = 0, level;
+
+	LOG_INF("Testing timers across the wheel levels");
+
+	for (level = 1; level < 4; level++) {
+		step = 1ULL << (TEST_LEVEL_BITS * level);
+		aligned = (start + step) & ~(step - 1);
+
+		add_timer(&timers[num++], check_cb, aligned - 1 - start, 0);
+		add_timer(&timers[num++], check_cb, aligned - start, 0);
+		add_timer(&timers[num++], check_cb, aligned + 1 - start, 0);
+		add_timer(&timers[num++], check_cb, step - 1, 0);
+		add_timer(&timers[num++], check_cb, step, 0);
+		add_timer(&timers[num++], check_cb, step + 1, 0);
+	}
+
+	add_timer(&timers[num++], check_cb, 0, 0);
+	add_timer(&timers[num++], check_cb, 1, 0);
+	add_timer(&timers[num++], check_cb, 1000, 0);
+	add_timer(&timers[num++], check_cb, 1000000, 0);
+	add_timer(&timers[num++], check_cb, 1000000, 0);
+
+	run_timers_till(start + (1ULL << (TEST_LEVEL_BITS * 3)) * 2);
+
+	for (i = 0; i < num; i++)
+		assert(1 == timers[i].fires && "Timer should fire once");
+
+	/* the wheel is idle with no timers */
+	assert(0 == poller_async_run_test_timers() && "Idle wheel should not be armed");
+
+	destroy_timers(timers, num);
+}
+
+static void test_wheel_persistent(void) {
+	test_timer_t timers[4] = {0};
+	u_int64_t start = test_now;
+
+	LOG_INF("Testing persistent timers");
+
+	/* re-armed before their callback, so they keep the interval and may be destroyed by it */
+	add_timer(&timers[0], destroy_self_cb, 65537, 1);
+	add_timer(&timers[1], check_cb, 255, 1);
+	add_timer(&timers[2], check_cb, 1000, 1);
+	add_timer(&timers[3], disable_self_cb, 300, 1);
+
+	run_timers_till(start + 65537 * 4);
+
+	assert(3 == timers[0].fires && NULL == timers[0].event && "Destroyed timer should not fire again");
+	assert(2 == timers[3].fires && "Disabled timer should not fire again");
+	assert(65537 * 4 / 255 == timers[1].fires && "Persistent timer should fire each interval");
+	assert(65537 * 4 / 1000 == timers[2].fires && "Persistent timer should fire each interval");
+
+	poller_disable_event(timers[2].event);
+	run_timers_till(test_now + 5000);
+	assert(65537 * 4 / 1000 == timers[2].fires && "Disabled timer should not fire");
+
+	destroy_timers(timers, 4);
+}
+
+/* the timers due on the same tick are fired from a separate list, so they might change each other */
+static void test_wheel_callbacks(void) {
+	test_timer_t timers[9] = {0};
+	u_int64_t start = test_now;
+
+	LOG_INF("Testing timers cancelled and re-added by the callbacks");
+
+	/* whichever fires first cancels the other one */
+	add_timer(&timers[0], cancel_other_cb, 100, 0);
+	add_timer(&timers[1], cancel_other_cb, 100, 0);
+	timers[0].other = &timers[1];
+	timers[1].other = &timers[0];
+
+	/* moves a timer of an upper level closer */
+	add_timer(&timers[2], readd_other_cb, 100, 0);
+	add_timer(&timers[3], check_cb, 70000, 0);
+	timers[2].other = &timers[3];
+	timers[2].delay = 50;
+
+	/* moves a timer of the next tick further */
+	add_timer(&timers[4], readd_other_cb, 100, 0);
+	add_timer(&timers[5], check_cb, 101, 0);
+	timers[4].other = &timers[5];
+	timers[4].delay = 300;
+
+	/* re-adds itself over the level wrap */
+	add_timer(&timers[6], readd_self_cb, 100, 0);
+	timers[6].delay = 70000;
+
+	/* cancels a timer of an upper level */
+	add_timer(&timers[7], cancel_other_cb, 100, 0);
+	add_timer(&timers[8], check_cb, 100000, 0);
+	timers[7].other = &timers[8];
+
+	run_timers_till(start + 200000);
+
+	assert(1 == timers[0].fires + timers[1].fires && "Only one of the cancelling timers should fire");
+	assert(1 == timers[2].fires && 1 == timers[3].fires && start + 150 == timers[3].due);
+	assert(1 == timers[4].fires && 1 == timers[5].fires && start + 400 == timers[5].due);
+	assert(2 == timers[6].fires && start + 70100 == timers[6].due);
+	assert(1 == timers[7].fires && 0 == timers[8].fires);
+
+	destroy_timers(timers, 9);
+}
+
+static void test_wheel_limits(void) {
+	test_timer_t timers[2] = {0};
+	u_int64_t start;
+
+	LOG_INF("Testing timers after the idle time and beyond the wheel");
+
+	/* the idle wheel doesn't go through the ticks it missed */
+	set_test_time(test_now + 36000000);
+	start = test_now;
+
+	add_timer(&timers[0], check_cb, 5, 0);
+	assert(1 == run_timers_till(start + 10) && 1 == timers[0].fires);
+
+	/* the longer delays are cut to the wheel's range */
+	add_timer(&timers[1], check_cb, TEST_MAX_DELAY + 1000000, 0);
+	timers[1].due = test_now + TEST_MAX_DELAY;
+
+	run_timers_till(test_now + TEST_MAX_DELAY + 1000000);
+	assert(1 == timers[1].fires && "Timer should fire at the wheel's max delay");
+
+	destroy_timers(timers, 2);
+}
+
+void poller_async_io_run_tests(void) {
+	/* the clock starts a bit before a wrap of the upper levels */
+	set_test_time((5ULL << 32) + 0xfefe25);
+	poller_async_loop_init();
+
+	test_wheel_boundaries();
+	test_wheel_persistent();
+	test_wheel_callbacks();
+	test_wheel_limits();
+
+	poller_async_set_test_time(0);
+
+	LOG_INF("Finished poller timers tests");
+}
+
+#endif
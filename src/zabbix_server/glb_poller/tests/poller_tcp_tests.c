@@ -0,0 +1,392 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "zbxstr.h"
+#include "../../../libs/zbxsysinfo/sysinfo.h"
+#include "../glb_poller.h"
+#include "../poller_tcp.h"
+#include "../poller_async_io.h"
+#include "../poller_contention.h"
+
+#include <netinet/in.h>
+#include <sys/wait.h>
+#include <event2/event.h>
+
+#define TEST_ITEMS	32
+#define TEST_ADDR	"127.0.0.1"
+
+/* the test protocol is a line per request and a line per response, so the connection might be kept */
+typedef struct {
+	char request[64];
+	size_t request_size;
+	char response[128];
+	size_t response_size;
+} test_proto_t;
+
+typedef struct {
+	int responses;
+	int timeouts;
+	int fails;
+	int fail_order;
+	char response[128];
+} test_result_t;
+
+static test_result_t results[TEST_ITEMS];
+static int results_num, fails_num;
+
+static void *test_item_init(poller_item_t *poller_item, DC_ITEM *dc_item) {
+	test_proto_t *proto = zbx_calloc(NULL, 0, sizeof(test_proto_t));
+
+	proto->request_size = zbx_snprintf(proto->request, sizeof(proto->request), "%s\n", dc_item->key);
+
+	return proto;
+}
+
+static void test_item_destroy(void *proto_ctx) {
+	zbx_free(proto_ctx);
+}
+
+static void test_create_request(poller_item_t *poller_item, void *proto_ctx, void **buffer, size_t *buf_size) {
+	test_proto_t *proto = proto_ctx;
+
+	proto->response_size = 0;
+	*buffer = proto->request;
+	*buf_size = proto->request_size;
+}
+
+static unsigned char test_response_cb(poller_item_t *poller_item, void *proto_ctx, const char *response,
+		size_t response_size) {
+	test_proto_t *proto = proto_ctx;
+	test_result_t *result = &results[poller_item_get_id(poller_item)];
+	char *eol;
+
+	response_size = MIN(response_size, sizeof(proto->response) - proto->response_size - 1);
+	memcpy(proto->response + proto->response_size, response, response_size);
+	proto->response_size += response_size;
+	proto->response[proto->response_size] = '\0';
+
+	if (NULL == (eol = strchr(proto->response, '\n')))
+		return ASYNC_IO_TCP_PROC_CONTINUE;
+
+	*eol = '\0';
+	zbx_strlcpy(result->response, proto->response, sizeof(result->response));
+	result->responses++;
+	results_num++;
+
+	return ASYNC_IO_TCP_PROC_FINISH;
+}
+
+static void test_timeout_cb(poller_item_t *poller_item, void *proto_ctx) {
+	results[poller_item_get_id(poller_item)].timeouts++;
+	results_num++;
+}
+
+static void test_fail_cb(poller_item_t *poller_item, void *proto_ctx, const char *error) {
+	test_result_t *result = &results[poller_item_get_id(poller_item)];
+
+	zbx_strlcpy(result->response, error, sizeof(result->response));
+	result->fails++;
+	result->fail_order = ++fails_num;
+	results_num++;
+}
+
+static int listen_local(unsigned short *port) {
+	struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+	socklen_t addr_len = sizeof(addr);
+	int fd;
+
+	assert(-1 != (fd = socket(AF_INET, SOCK_STREAM, 0)));
+	assert(0 == bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+	assert(0 == listen(fd, 16));
+	assert(0 == getsockname(fd, (struct sockaddr *)&addr, &addr_len));
+
+	*port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+/* answers each request line by the connection and request numbers, "slow" is never answered,
+   "drop" closes the connection unless it's the first request on it */
+static void serve_connection(int conn, int conn_num) {
+	char buf[1024], *line, *eol, answer[256];
+	size_t len = 0;
+	ssize_t n;
+	int req_num = 0;
+
+	while (0 < (n = read(conn, buf + len, sizeof(buf) - len - 1))) {
+		len += n;
+		buf[len] = '\0';
+		line = buf;
+
+		while (NULL != (eol = strchr(line, '\n'))) {
+			*eol = '\0';
+			req_num++;
+
+			if (0 == strcmp(line, "drop") && 1 < req_num)
+				_exit(EXIT_SUCCESS);
+
+			if (0 != strcmp(line, "slow")) {
+				n = zbx_snprintf(answer, sizeof(answer), "conn %d req %d %s\n", conn_num, req_num, line);
+
+				if (0 > write(conn, answer, n))
+					_exit(EXIT_FAILURE);
+			}
+
+			line = eol + 1;
+		}
+
+		len -= line - buf;
+		memmove(buf, line, len);
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+static void serve_requests(int fd) {
+	int conn, conn_num = 0;
+
+	signal(SIGCHLD, SIG_IGN);
+
+	while (-1 != (conn = accept(fd, NULL, NULL))) {
+		conn_num++;
+
+		if (0 == fork()) {
+			close(fd);
+			serve_connection(conn, conn_num);
+		}
+
+		close(conn);
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+/* the server and its connections are in their own process group to be killed together */
+static pid_t start_server(unsigned short *port) {
+	int fd = listen_local(port);
+	pid_t server;
+
+	if (0 == (server = fork())) {
+		setpgid(0, 0);
+		serve_requests(fd);
+	}
+
+	setpgid(server, server);
+	close(fd);
+
+	return server;
+}
+
+static void stop_server(pid_t server) {
+	kill(-server, SIGKILL);
+	waitpid(server, NULL, 0);
+}
+
+/* sessions are counted by the pooled address string of the items */
+static int get_sessions(void) {
+	const char *ipaddr = poller_strpool_add(TEST_ADDR);
+	int sessions = poller_contention_get_sessions(ipaddr);
+
+	poller_strpool_free(ipaddr);
+
+	return sessions;
+}
+
+static void add_item(u_int64_t itemid, const char *key, unsigned short port) {
+	static DC_ITEM dc_item;
+	static char addr[] = TEST_ADDR;
+
+	memset(&dc_item, 0, sizeof(dc_item));
+	dc_item.itemid = itemid;
+	dc_item.type = ITEM_TYPE_AGENT;
+	dc_item.value_type = ITEM_VALUE_TYPE_TEXT;
+	zbx_strlcpy(dc_item.key_orig, key, sizeof(dc_item.key_orig));
+	dc_item.key = dc_item.key_orig;
+	dc_item.interface.useip = 1;
+	dc_item.interface.addr = addr;
+	dc_item.interface.port = port;
+
+	assert(SUCCEED == poller_test_add_item(&dc_item) && "Item should be added");
+}
+
+static void poll_item(u_int64_t itemid) {
+	assert(POLL_STARTED_OK == poller_test_poll_item(itemid) && "Item poll should start");
+}
+
+/* runs the poller's events till the number of the polls is finished, returns the time it took */
+static double run_polls(int polls) {
+	double start = zbx_time(), deadline = start + sysinfo_get_config_timeout() * 3;
+
+	while (results_num < polls && zbx_time() < deadline)
+		assert(-1 != event_base_loop(poller_async_get_events_base(), EVLOOP_ONCE));
+
+	assert(results_num == polls && "Polls should finish");
+	results_num = 0;
+
+	return zbx_time() - start;
+}
+
+static void parse_response(u_int64_t itemid, int *conn_num, int *req_num) {
+	assert(1 == results[itemid].responses && 0 == results[itemid].fails && 0 == results[itemid].timeouts);
+	assert(2 == sscanf(results[itemid].response, "conn %d req %d", conn_num, req_num));
+	assert(poller_test_item_is_queued(itemid) && "Item should be returned to the queue");
+}
+
+static void test_tcp_reuse(void) {
+	unsigned short port;
+	pid_t server = start_server(&port);
+	int conn1, req1, conn2, req2;
+
+	LOG_INF("Testing tcp connection reuse");
+
+	add_item(1, "first", port);
+	add_item(2, "second", port);
+
+	poll_item(1);
+	run_polls(1);
+	parse_response(1, &conn1, &req1);
+	assert(NULL != strstr(results[1].response, " first") && "Response should be for the item's request");
+
+	/* the finished connection is kept idle and the next item of the port reuses it */
+	poll_item(2);
+	assert(1 == get_sessions() && "Reused connection should hold a session");
+	run_polls(1);
+	parse_response(2, &conn2, &req2);
+	assert(conn1 == conn2 && 1 == req1 && 2 == req2 && "Kept connection should be reused");
+	assert(0 == get_sessions() && "Idle connection should not hold a session");
+
+	stop_server(server);
+}
+
+static void test_tcp_retry(void) {
+	unsigned short port;
+	pid_t server = start_server(&port);
+	int conn1, req1, conn2, req2, conn3, req3;
+
+	LOG_INF("Testing tcp retry on a closed kept connection");
+
+	add_item(3, "first", port);
+	add_item(4, "drop", port);
+	add_item(5, "third", port);
+
+	poll_item(3);
+	run_polls(1);
+	parse_response(3, &conn1, &req1);
+
+	/* the agent closes the kept connection, the request is repeated on a new one */
+	poll_item(4);
+	run_polls(1);
+	parse_response(4, &conn2, &req2);
+	assert(conn1 != conn2 && 1 == req2 && "Request should be repeated on a new connection");
+
+	/* the port doesn't keep connections now, so each poll makes its own */
+	poll_item(5);
+	run_polls(1);
+	parse_response(5, &conn3, &req3);
+	assert(conn2 != conn3 && 1 == req3 && "Connection should not be kept for the port");
+	assert(0 == get_sessions());
+
+	stop_server(server);
+}
+
+/* six items of the port, the four first ones connect and the rest wait for a free session */
+static void test_tcp_refused(void) {
+	unsigned short port;
+	int i;
+
+	LOG_INF("Testing tcp pending items on refused connection");
+
+	/* nobody listens on the port after it's closed */
+	close(listen_local(&port));
+	fails_num = 0;
+
+	for (i = 10; i < 16; i++) {
+		add_item(i, "first", port);
+		poll_item(i);
+	}
+
+	assert(DEFAULT_TCP_HOST_CONTENTION == get_sessions());
+
+	assert(sysinfo_get_config_timeout() > run_polls(6) && "Pending items should fail without a timeout");
+
+	/* the waiting items fail right after the first refused connection, they don't try their own ones */
+	assert(2 == results[14].fail_order && 3 == results[15].fail_order && "Waiting items should fail at once");
+
+	for (i = 10; i < 16; i++) {
+		assert(1 == results[i].fails && 0 == results[i].responses && 0 == results[i].timeouts &&
+				"Each item should fail once");
+		assert(poller_test_item_is_queued(i) && "Item should be returned to the queue");
+	}
+
+	assert(0 == get_sessions());
+}
+
+/* four slow items take all the sessions, the fifth waits and is polled after their timeouts */
+static void test_tcp_timeout(void) {
+	unsigned short port;
+	pid_t server = start_server(&port);
+	int i, conn, req;
+
+	LOG_INF("Testing tcp pending items on read timeout");
+
+	for (i = 20; i < 24; i++) {
+		add_item(i, "slow", port);
+		poll_item(i);
+	}
+
+	add_item(24, "first", port);
+	poll_item(24);
+
+	run_polls(5);
+
+	for (i = 20; i < 24; i++)
+		assert(1 == results[i].timeouts && 0 == results[i].responses && 0 == results[i].fails &&
+				"Slow item should time out");
+
+	parse_response(24, &conn, &req);
+	assert(1 == req && "Waiting item should be polled after the timeouts");
+	assert(0 == get_sessions());
+
+	stop_server(server);
+}
+
+void poller_tcp_run_tests(void) {
+	tcp_poll_type_procs_t procs = {.type = ASYNC_TCP_POLL_TYPE_AGENT, .item_init = test_item_init,
+			.item_destroy = test_item_destroy, .create_request = test_create_request,
+			.response_cb = test_response_cb, .timeout_cb = test_timeout_cb, .conn_fail_cb = test_fail_cb,
+			.keepalive = 1};
+
+	poller_test_init();
+	glb_tcp_test_init(&procs);
+
+	test_tcp_reuse();
+	test_tcp_retry();
+	test_tcp_refused();
+	test_tcp_timeout();
+
+	poller_test_destroy();
+
+	LOG_INF("Finished tcp poller tests");
+}
+
+#endif
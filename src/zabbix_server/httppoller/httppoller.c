@@ -102,7 +102,12 @@ ZBX_THREAD_ENTRY(httppoller_thread, args)
 			last_stat_time = time(NULL);
 		}
 
-		zbx_sleep_loop(info, sleeptime);
+		/* while scenarios are running the transfers are waited for instead of sleeping, */
+		/* the wait is limited to a second to start the due scenarios in time */
+		if (0 != httptests_running())
+			httptests_count += httptests_perform(info, MIN(sleeptime, 1));
+		else
+			zbx_sleep_loop(info, sleeptime);
 	}
 
 	zbx_setproctitle("%s #%d [terminated]", get_process_type_string(process_type), process_num);
@@ -22,6 +22,7 @@
 #include "log.h"
 #include "preproc.h"
 #include "zbxnix.h"
+#include "zbxself.h"
 #include "zbxserver.h"
 #include "zbxregexp.h"
 #include "zbxhttp.h"
@@ -46,6 +47,13 @@ typedef struct
 }
 zbx_httpstat_t;
 
+#ifdef HAVE_GLB_TESTS
+/* the tests run the scenarios without the database and the configuration cache, */
+/* the results of the steps and of the scenarios are reported to them instead */
+static httptest_test_step_cb_t	test_step_cb = NULL;
+static httptest_test_done_cb_t	test_done_cb = NULL;
+#endif
+
 #ifdef HAVE_LIBCURL
 
 typedef struct
@@ -56,23 +64,20 @@ typedef struct
 }
 zbx_httppage_t;
 
-static zbx_httppage_t	page;
-
 static size_t	curl_write_cb(void *ptr, size_t size, size_t nmemb, void *userdata)
 {
-	size_t	r_size = size * nmemb;
-
-	ZBX_UNUSED(userdata);
+	size_t		r_size = size * nmemb;
+	zbx_httppage_t	*page = (zbx_httppage_t *)userdata;
 
 	/* first piece of data */
-	if (NULL == page.data)
+	if (NULL == page->data)
 	{
-		page.allocated = MAX(8096, r_size);
-		page.offset = 0;
-		page.data = (char *)zbx_malloc(page.data, page.allocated);
+		page->allocated = MAX(8096, r_size);
+		page->offset = 0;
+		page->data = (char *)zbx_malloc(page->data, page->allocated);
 	}
 
-	zbx_strncpy_alloc(&page.data, &page.allocated, &page.offset, (char *)ptr, r_size);
+	zbx_strncpy_alloc(&page->data, &page->allocated, &page->offset, (char *)ptr, r_size);
 
 	return r_size;
 }
@@ -123,6 +128,13 @@ static void	process_test_data(zbx_uint64_t httptestid, int lastfailedstep, doubl
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
+#ifdef HAVE_GLB_TESTS
+	if (NULL != test_done_cb)
+	{
+		test_done_cb(httptestid, lastfailedstep, err_str);
+		return;
+	}
+#endif
 	result = zbx_db_select("select type,itemid from httptestitem where httptestid=" ZBX_FS_UI64, httptestid);
 
 	while (NULL != (row = zbx_db_fetch(result)))
@@ -266,6 +278,13 @@ static void	process_step_data(zbx_uint64_t httpstepid, zbx_httpstat_t *stat, zbx
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s() rspcode:%ld time:" ZBX_FS_DBL " speed:" ZBX_FS_DBL,
 			__func__, stat->rspcode, stat->total_time, stat->speed_download);
 
+#ifdef HAVE_GLB_TESTS
+	if (NULL != test_step_cb)
+	{
+		test_step_cb(httpstepid, stat->rspcode);
+		return;
+	}
+#endif
 	result = zbx_db_select("select type,itemid from httpstepitem where httpstepid=" ZBX_FS_UI64, httpstepid);
 
 	while (NULL != (row = zbx_db_fetch(result)))
@@ -365,6 +384,12 @@ static int	httpstep_load_pairs(DC_HOST *host, zbx_httpstep_t *httpstep)
 	zbx_vector_ptr_pair_create(&post_fields);
 	zbx_vector_ptr_pair_create(&httpstep->variables);
 
+#ifdef HAVE_GLB_TESTS
+	/* the test steps have no fields */
+	if (NULL != test_step_cb)
+		result = NULL;
+	else
+#endif
 	result = zbx_db_select(
 			"select name,value,type"
 			" from httpstep_field"
@@ -606,562 +631,955 @@ out:
 	return ret;
 }
 
+
+#define HTTPTEST_MAX_RUNNING	512	/* web scenarios run at once by a single http poller */
+
+typedef struct
+{
+	zbx_uint64_t	httpstepid;
+	int		no;
+	int		post_type;
+	int		follow_redirects;
+	int		retrieve_mode;
+	char		*name;
+	char		*url;
+	char		*timeout;
+	char		*posts;
+	char		*required;
+	char		*status_codes;
+}
+zbx_httpstep_row_t;
+
+/* the web scenario being run, steps are performed one by one as non-blocking transfers, */
+/* the cookies (kept by the easy handle), variables and statistics are carried in between */
+typedef struct
+{
+	DC_HOST			host;
+	zbx_httptest_t		httptest;
+	zbx_httpstep_row_t	*steps;
+	int			steps_num;
+	int			step;		/* index of the step being performed */
+	int			delay;
+	int			lastfailedstep;
+	const char		*failedstep_name;
+	char			*err_str;
+	double			speed_download;
+	int			speed_download_num;
+	zbx_db_httpstep		db_httpstep;
+	zbx_httpstep_t		httpstep;
+#ifdef HAVE_LIBCURL
+	CURL			*easyhandle;
+	struct curl_slist	*headers_slist;
+	zbx_httppage_t		page;
+	char			errbuf[CURL_ERROR_SIZE];
+#endif
+}
+zbx_httptest_run_t;
+
+static int	httptests_running_num = 0, httptests_finished_num = 0;
+
+#ifdef HAVE_LIBCURL
+static CURLM	*httptests_multi = NULL;
+#endif
+
+static void	httptest_run_free(zbx_httptest_run_t *run)
+{
+	int	i;
+
+	for (i = 0; i < run->steps_num; i++)
+	{
+		zbx_httpstep_row_t	*row = &run->steps[i];
+
+		zbx_free(row->name);
+		zbx_free(row->url);
+		zbx_free(row->timeout);
+		zbx_free(row->posts);
+		zbx_free(row->required);
+		zbx_free(row->status_codes);
+	}
+
+	zbx_free(run->steps);
+#ifdef HAVE_LIBCURL
+	if (NULL != run->easyhandle)
+		curl_easy_cleanup(run->easyhandle);
+#endif
+	zbx_free(run->httptest.httptest.ssl_key_password);
+	zbx_free(run->httptest.httptest.ssl_key_file);
+	zbx_free(run->httptest.httptest.ssl_cert_file);
+	zbx_free(run->httptest.httptest.http_proxy);
+	zbx_free(run->httptest.httptest.http_password);
+	zbx_free(run->httptest.httptest.http_user);
+	zbx_free(run->httptest.httptest.agent);
+	zbx_free(run->httptest.httptest.delay);
+	zbx_free(run->httptest.httptest.name);
+	zbx_free(run->httptest.headers);
+	httppairs_free(&run->httptest.variables);
+
+	/* clear the macro cache used in this http test */
+	httptest_remove_macros(&run->httptest);
+	zbx_vector_ptr_pair_destroy(&run->httptest.macros);
+
+	zbx_free(run->err_str);
+	zbx_free(run);
+}
+
 /******************************************************************************
  *                                                                            *
- * Purpose: process single scenario of http test                              *
+ * Purpose: reports the scenario results, queues its next check and frees it *
  *                                                                            *
  ******************************************************************************/
-static void	process_httptest(DC_HOST *host, zbx_httptest_t *httptest, int *delay)
+static void	httptest_run_finish(zbx_httptest_run_t *run)
 {
-	DB_RESULT	result;
-	zbx_db_httpstep	db_httpstep;
-	char		*err_str = NULL, *buffer = NULL;
-	int		lastfailedstep = 0;
 	zbx_timespec_t	ts;
-	double		speed_download = 0;
-	int		speed_download_num = 0;
-#ifdef HAVE_LIBCURL
-	DB_ROW		row;
-	zbx_httpstat_t	stat;
-	char		errbuf[CURL_ERROR_SIZE];
-	CURL		*easyhandle = NULL;
-	CURLcode	err;
-	zbx_httpstep_t	httpstep;
+
+	zbx_timespec(&ts);
+
+	if (NULL != run->err_str)
+	{
+		if (0 >= run->lastfailedstep)
+		{
+			/* we are here because web scenario update interval is invalid, */
+			/* cURL initialization failed or we have been compiled without cURL library */
+
+			run->lastfailedstep = 1;
+		}
+
+		if (NULL != run->failedstep_name)
+		{
+			zabbix_log(LOG_LEVEL_DEBUG, "cannot process step \"%s\" of web scenario \"%s\" on host \"%s\": "
+					"%s", run->failedstep_name, run->httptest.httptest.name, run->host.name,
+					run->err_str);
+		}
+	}
+
+	if (0 != run->speed_download_num)
+		run->speed_download /= run->speed_download_num;
+
+	process_test_data(run->httptest.httptest.httptestid, run->lastfailedstep, run->speed_download, run->err_str,
+			&ts);
+
+#ifdef HAVE_GLB_TESTS
+	if (NULL == test_done_cb)
 #endif
-	zabbix_log(LOG_LEVEL_DEBUG, "In %s() httptestid:" ZBX_FS_UI64 " name:'%s'",
-			__func__, httptest->httptest.httptestid, httptest->httptest.name);
+	zbx_dc_httptest_queue(ts.sec, run->httptest.httptest.httptestid, run->delay);
 
-	result = zbx_db_select(
-			"select httpstepid,no,name,url,timeout,posts,required,status_codes,post_type,follow_redirects,"
-				"retrieve_mode"
-			" from httpstep"
-			" where httptestid=" ZBX_FS_UI64
-			" order by no",
-			httptest->httptest.httptestid);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() httptestid:" ZBX_FS_UI64 " name:'%s'", __func__,
+			run->httptest.httptest.httptestid, run->httptest.httptest.name);
 
-	buffer = zbx_strdup(buffer, httptest->httptest.delay);
-	zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-				&buffer, MACRO_TYPE_COMMON, NULL, 0);
+	httptest_run_free(run);
+
+	httptests_running_num--;
+	httptests_finished_num++;	/* performance metric */
+}
+
+#ifdef HAVE_LIBCURL
+static void	httptest_step_clean(zbx_httptest_run_t *run)
+{
+	zbx_free(run->db_httpstep.status_codes);
+	zbx_free(run->db_httpstep.required);
+	zbx_free(run->db_httpstep.posts);
+	zbx_free(run->db_httpstep.url);
 
-	/* Avoid the potential usage of uninitialized values when: */
-	/* 1) compile without libCURL support */
-	/* 2) update interval is invalid */
-	db_httpstep.name = NULL;
+	httppairs_free(&run->httpstep.variables);
 
-	if (SUCCEED != zbx_is_time_suffix(buffer, delay, ZBX_LENGTH_UNLIMITED))
+	if (ZBX_POSTTYPE_FORM == run->db_httpstep.post_type)
+		zbx_free(run->httpstep.posts);
+
+	zbx_free(run->httpstep.url);
+	zbx_free(run->httpstep.headers);
+
+	curl_slist_free_all(run->headers_slist);	/* must be called after the transfer is done */
+	run->headers_slist = NULL;
+
+	zbx_free(run->page.data);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: prepares the current step of the scenario and adds its transfer   *
+ *          to the multi handle                                               *
+ *                                                                            *
+ * Return value: SUCCEED - the transfer was started                           *
+ *               FAIL - the step cannot be performed, the error is set        *
+ *                                                                            *
+ ******************************************************************************/
+static int	httptest_step_start(zbx_httptest_run_t *run)
+{
+	zbx_httpstep_row_t	*row = &run->steps[run->step];
+	zbx_db_httpstep		*db_httpstep = &run->db_httpstep;
+	zbx_httpstep_t		*httpstep = &run->httpstep;
+	DC_HOST			*host = &run->host;
+	CURL			*easyhandle = run->easyhandle;
+	CURLcode		err;
+	CURLMcode		merr;
+	char			*header_cookie = NULL, *buffer = NULL;
+	int			ret = FAIL;
+	zbx_dc_um_handle_t	*um_handle;
+	size_t			(*curl_header_cb)(void *ptr, size_t size, size_t nmemb, void *userdata);
+	size_t			(*curl_body_cb)(void *ptr, size_t size, size_t nmemb, void *userdata);
+
+	um_handle = zbx_dc_open_user_macros();
+
+	db_httpstep->httpstepid = row->httpstepid;
+	db_httpstep->httptestid = run->httptest.httptest.httptestid;
+	db_httpstep->no = row->no;
+	db_httpstep->name = row->name;
+
+	db_httpstep->url = zbx_strdup(NULL, row->url);
+	zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, NULL, host, NULL, NULL, NULL, NULL, NULL,
+			NULL, &db_httpstep->url, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
+	http_substitute_variables(&run->httptest, &db_httpstep->url);
+
+	db_httpstep->required = zbx_strdup(NULL, row->required);
+	zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, host, NULL, NULL, NULL, NULL, NULL, NULL,
+			&db_httpstep->required, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
+
+	db_httpstep->status_codes = zbx_strdup(NULL, row->status_codes);
+	zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, &db_httpstep->status_codes, MACRO_TYPE_COMMON, NULL, 0);
+
+	db_httpstep->post_type = row->post_type;
+
+	if (ZBX_POSTTYPE_RAW == db_httpstep->post_type)
 	{
-		err_str = zbx_dsprintf(err_str, "update interval \"%s\" is invalid", buffer);
-		lastfailedstep = -1;
-		*delay = ZBX_DEFAULT_INTERVAL;
-		goto httptest_error;
+		db_httpstep->posts = zbx_strdup(NULL, row->posts);
+		zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, NULL, host, NULL, NULL, NULL, NULL,
+				NULL, NULL, &db_httpstep->posts, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
+		http_substitute_variables(&run->httptest, &db_httpstep->posts);
 	}
+	else
+		db_httpstep->posts = NULL;
 
-#ifdef HAVE_LIBCURL
-	if (NULL == (easyhandle = curl_easy_init()))
+	if (SUCCEED != httpstep_load_pairs(host, httpstep))
+	{
+		run->err_str = zbx_strdup(run->err_str, "cannot load web scenario step data");
+		goto out;
+	}
+
+	buffer = zbx_strdup(buffer, row->timeout);
+	zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, &buffer, MACRO_TYPE_COMMON, NULL, 0);
+
+	if (SUCCEED != zbx_is_time_suffix(buffer, &db_httpstep->timeout, ZBX_LENGTH_UNLIMITED))
 	{
-		err_str = zbx_strdup(err_str, "cannot initialize cURL library");
-		goto clean;
+		run->err_str = zbx_dsprintf(run->err_str, "timeout \"%s\" is invalid", buffer);
+		goto out;
 	}
+	else if (db_httpstep->timeout < 1 || SEC_PER_HOUR < db_httpstep->timeout)
+	{
+		run->err_str = zbx_dsprintf(run->err_str, "timeout \"%s\" is out of 1-3600 seconds bounds", buffer);
+		goto out;
+	}
+
+	db_httpstep->follow_redirects = row->follow_redirects;
+	db_httpstep->retrieve_mode = row->retrieve_mode;
 
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_PROXY, httptest->httptest.http_proxy)) ||
-			CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_COOKIEFILE, "")) ||
-			CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_USERAGENT, httptest->httptest.agent)) ||
-			CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_ERRORBUFFER, errbuf)) ||
-			CURLE_OK != (err = curl_easy_setopt(easyhandle, ZBX_CURLOPT_ACCEPT_ENCODING, "")))
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() use step \"%s\"", __func__, db_httpstep->name);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() use post \"%s\"", __func__, ZBX_NULL2EMPTY_STR(httpstep->posts));
+
+	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_POSTFIELDS, httpstep->posts)))
 	{
-		err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-		goto clean;
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		goto out;
 	}
 
-#if LIBCURL_VERSION_NUM >= 0x071304
-	/* CURLOPT_PROTOCOLS is supported starting with version 7.19.4 (0x071304) */
-	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS)))
+	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_POST, (NULL != httpstep->posts &&
+			'\0' != *httpstep->posts) ? 1L : 0L)))
 	{
-		err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-		goto clean;
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		goto out;
 	}
-#endif
 
-	if (SUCCEED != zbx_http_prepare_ssl(easyhandle, httptest->httptest.ssl_cert_file,
-			httptest->httptest.ssl_key_file, httptest->httptest.ssl_key_password,
-			httptest->httptest.verify_peer, httptest->httptest.verify_host, &err_str))
+	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_FOLLOWLOCATION,
+			0 == db_httpstep->follow_redirects ? 0L : 1L)))
 	{
-		goto clean;
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		goto out;
+	}
+
+	if (0 != db_httpstep->follow_redirects)
+	{
+		if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_MAXREDIRS, ZBX_CURLOPT_MAXREDIRS)))
+		{
+			run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+			goto out;
+		}
 	}
 
-	httpstep.httptest = httptest;
-	httpstep.httpstep = &db_httpstep;
+	/* headers defined in a step overwrite headers defined in scenario */
+	if (NULL != httpstep->headers && '\0' != *httpstep->headers)
+		add_http_headers(httpstep->headers, &run->headers_slist, &header_cookie);
+	else if (NULL != run->httptest.headers && '\0' != *run->httptest.headers)
+		add_http_headers(run->httptest.headers, &run->headers_slist, &header_cookie);
 
-	while (NULL != (row = zbx_db_fetch(result)) && ZBX_IS_RUNNING())
+	err = curl_easy_setopt(easyhandle, CURLOPT_COOKIE, header_cookie);
+	zbx_free(header_cookie);
+
+	if (CURLE_OK != err)
 	{
-		struct curl_slist	*headers_slist = NULL;
-		char			*header_cookie = NULL;
-		size_t			(*curl_header_cb)(void *ptr, size_t size, size_t nmemb, void *userdata);
-		size_t			(*curl_body_cb)(void *ptr, size_t size, size_t nmemb, void *userdata);
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		goto out;
+	}
 
-		/* NOTE: do not break or return from this block! */
-		/*       process_step_data() call is required! */
+	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_HTTPHEADER, run->headers_slist)))
+	{
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		goto out;
+	}
 
-		ZBX_STR2UINT64(db_httpstep.httpstepid, row[0]);
-		db_httpstep.httptestid = httptest->httptest.httptestid;
-		db_httpstep.no = atoi(row[1]);
-		db_httpstep.name = row[2];
+	switch (db_httpstep->retrieve_mode)
+	{
+		case ZBX_RETRIEVE_MODE_CONTENT:
+			curl_header_cb = curl_ignore_cb;
+			curl_body_cb = curl_write_cb;
+			break;
+		case ZBX_RETRIEVE_MODE_BOTH:
+			curl_header_cb = curl_body_cb = curl_write_cb;
+			break;
+		case ZBX_RETRIEVE_MODE_HEADERS:
+			curl_header_cb = curl_write_cb;
+			curl_body_cb = curl_ignore_cb;
+			break;
+		default:
+			THIS_SHOULD_NEVER_HAPPEN;
+			run->err_str = zbx_strdup(run->err_str, "invalid retrieve mode");
+			goto out;
+	}
 
-		db_httpstep.url = zbx_strdup(NULL, row[3]);
-		zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, NULL, host, NULL, NULL, NULL, NULL, NULL,
-				NULL, &db_httpstep.url, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
-		http_substitute_variables(httptest, &db_httpstep.url);
+	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_WRITEFUNCTION, curl_body_cb)) ||
+			CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_HEADERFUNCTION, curl_header_cb)))
+	{
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		goto out;
+	}
 
-		db_httpstep.required = zbx_strdup(NULL, row[6]);
-		zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, host, NULL, NULL, NULL, NULL, NULL, NULL,
-				&db_httpstep.required, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
+	/* enable/disable fetching the body */
+	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_NOBODY,
+			ZBX_RETRIEVE_MODE_HEADERS == db_httpstep->retrieve_mode ? 1L : 0L)))
+	{
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		goto out;
+	}
 
-		db_httpstep.status_codes = zbx_strdup(NULL, row[7]);
-		zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL, NULL, NULL, NULL,
-				NULL, &db_httpstep.status_codes, MACRO_TYPE_COMMON, NULL, 0);
+	if (SUCCEED != zbx_http_prepare_auth(easyhandle, run->httptest.httptest.authentication,
+			run->httptest.httptest.http_user, run->httptest.httptest.http_password, NULL, &run->err_str))
+	{
+		goto out;
+	}
 
-		db_httpstep.post_type = atoi(row[8]);
+	zabbix_log(LOG_LEVEL_DEBUG, "%s() go to URL \"%s\"", __func__, httpstep->url);
 
-		if (ZBX_POSTTYPE_RAW == db_httpstep.post_type)
-		{
-			db_httpstep.posts = zbx_strdup(NULL, row[5]);
-			zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, NULL, host, NULL, NULL, NULL, NULL,
-					NULL, NULL, &db_httpstep.posts, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
-			http_substitute_variables(httptest, &db_httpstep.posts);
-		}
-		else
-			db_httpstep.posts = NULL;
+	if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_TIMEOUT, (long)db_httpstep->timeout)) ||
+			CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_URL, httpstep->url)))
+	{
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		goto out;
+	}
 
-		if (SUCCEED != httpstep_load_pairs(host, &httpstep))
-		{
-			err_str = zbx_strdup(err_str, "cannot load web scenario step data");
-			goto httpstep_error;
-		}
+	memset(&run->page, 0, sizeof(run->page));
+	run->errbuf[0] = '\0';
+
+	if (CURLM_OK != (merr = curl_multi_add_handle(httptests_multi, easyhandle)))
+	{
+		run->err_str = zbx_strdup(run->err_str, curl_multi_strerror(merr));
+		goto out;
+	}
 
-		buffer = zbx_strdup(buffer, row[4]);
-		zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL, NULL, NULL, NULL,
-				NULL, &buffer, MACRO_TYPE_COMMON, NULL, 0);
+	ret = SUCCEED;
+out:
+	zbx_free(buffer);
+	zbx_dc_close_user_macros(um_handle);
 
-		if (SUCCEED != zbx_is_time_suffix(buffer, &db_httpstep.timeout, ZBX_LENGTH_UNLIMITED))
-		{
-			err_str = zbx_dsprintf(err_str, "timeout \"%s\" is invalid", buffer);
-			goto httpstep_error;
-		}
-		else if (db_httpstep.timeout < 1 || SEC_PER_HOUR < db_httpstep.timeout)
-		{
-			err_str = zbx_dsprintf(err_str, "timeout \"%s\" is out of 1-3600 seconds bounds", buffer);
-			goto httpstep_error;
-		}
+	return ret;
+}
 
-		db_httpstep.follow_redirects = atoi(row[9]);
-		db_httpstep.retrieve_mode = atoi(row[10]);
+/******************************************************************************
+ *                                                                            *
+ * Purpose: starts the steps of the scenario until one of them is started or  *
+ *          failed, finishes the scenario when there are no more steps        *
+ *                                                                            *
+ ******************************************************************************/
+static void	httptest_run_next(zbx_httptest_run_t *run)
+{
+	for (; run->step < run->steps_num && ZBX_IS_RUNNING(); run->step++)
+	{
+		if (SUCCEED == httptest_step_start(run))
+			return;
+
+		/* the step could not be started so the scenario fails on it */
+		run->lastfailedstep = run->db_httpstep.no;
+		run->failedstep_name = run->db_httpstep.name;
+		httptest_step_clean(run);
+		break;
+	}
 
-		memset(&stat, 0, sizeof(stat));
+	httptest_run_finish(run);
+}
 
-		zabbix_log(LOG_LEVEL_DEBUG, "%s() use step \"%s\"", __func__, db_httpstep.name);
-		zabbix_log(LOG_LEVEL_DEBUG, "%s() use post \"%s\"", __func__, ZBX_NULL2EMPTY_STR(httpstep.posts));
+/******************************************************************************
+ *                                                                            *
+ * Purpose: processes the completed transfer of the current scenario step    *
+ *                                                                            *
+ ******************************************************************************/
+static void	httptest_step_done(zbx_httptest_run_t *run, CURLcode err)
+{
+	zbx_db_httpstep	*db_httpstep = &run->db_httpstep;
+	zbx_httpstep_t	*httpstep = &run->httpstep;
+	CURL		*easyhandle = run->easyhandle;
+	zbx_httpstat_t	stat;
+	zbx_timespec_t	ts;
+	CURLMcode	merr;
 
-		if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_POSTFIELDS, httpstep.posts)))
-		{
-			err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			goto httpstep_error;
-		}
+	/* try to retrieve page several times depending on number of retries */
+	if (CURLE_OK != err && 0 < --run->httptest.httptest.retries)
+	{
+		zbx_free(run->page.data);
+		memset(&run->page, 0, sizeof(run->page));
+		run->errbuf[0] = '\0';
 
-		if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_POST, (NULL != httpstep.posts &&
-				'\0' != *httpstep.posts) ? 1L : 0L)))
-		{
-			err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			goto httpstep_error;
-		}
+		if (CURLM_OK == (merr = curl_multi_add_handle(httptests_multi, easyhandle)))
+			return;
 
-		if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_FOLLOWLOCATION,
-				0 == db_httpstep.follow_redirects ? 0L : 1L)))
-		{
-			err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			goto httpstep_error;
-		}
+		zbx_snprintf(run->errbuf, sizeof(run->errbuf), "%s", curl_multi_strerror(merr));
+	}
 
-		if (0 != db_httpstep.follow_redirects)
-		{
-			if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_MAXREDIRS, ZBX_CURLOPT_MAXREDIRS)))
-			{
-				err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-				goto httpstep_error;
-			}
-		}
+	memset(&stat, 0, sizeof(stat));
 
-		/* headers defined in a step overwrite headers defined in scenario */
-		if (NULL != httpstep.headers && '\0' != *httpstep.headers)
-			add_http_headers(httpstep.headers, &headers_slist, &header_cookie);
-		else if (NULL != httptest->headers && '\0' != *httptest->headers)
-			add_http_headers(httptest->headers, &headers_slist, &header_cookie);
+	if (CURLE_OK == err)
+	{
+		char	*var_err_str = NULL;
 
-		err = curl_easy_setopt(easyhandle, CURLOPT_COOKIE, header_cookie);
-		zbx_free(header_cookie);
+		zabbix_log(LOG_LEVEL_TRACE, "%s() page.data from %s:'%s'", __func__, httpstep->url, run->page.data);
 
-		if (CURLE_OK != err)
+		/* first get the data that is needed even if step fails */
+		if (CURLE_OK != (err = curl_easy_getinfo(easyhandle, CURLINFO_RESPONSE_CODE, &stat.rspcode)))
 		{
-			err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			goto httpstep_error;
+			run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
 		}
-
-		if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_HTTPHEADER, headers_slist)))
+		else if ('\0' != *db_httpstep->status_codes &&
+				FAIL == zbx_int_in_list(db_httpstep->status_codes, stat.rspcode))
 		{
-			err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			goto httpstep_error;
+			run->err_str = zbx_dsprintf(run->err_str, "response code \"%ld\" did not match any of the"
+					" required status codes \"%s\"", stat.rspcode, db_httpstep->status_codes);
 		}
 
-		switch (db_httpstep.retrieve_mode)
+		if (CURLE_OK != (err = curl_easy_getinfo(easyhandle, CURLINFO_TOTAL_TIME, &stat.total_time)) &&
+				NULL == run->err_str)
 		{
-			case ZBX_RETRIEVE_MODE_CONTENT:
-				curl_header_cb = curl_ignore_cb;
-				curl_body_cb = curl_write_cb;
-				break;
-			case ZBX_RETRIEVE_MODE_BOTH:
-				curl_header_cb = curl_body_cb = curl_write_cb;
-				break;
-			case ZBX_RETRIEVE_MODE_HEADERS:
-				curl_header_cb = curl_write_cb;
-				curl_body_cb = curl_ignore_cb;
-				break;
-			default:
-				THIS_SHOULD_NEVER_HAPPEN;
-				err_str = zbx_strdup(err_str, "invalid retrieve mode");
-				goto httpstep_error;
+			run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
 		}
 
-		if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_WRITEFUNCTION, curl_body_cb)) ||
-				CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_HEADERFUNCTION, curl_header_cb)))
+		if (CURLE_OK != (err = curl_easy_getinfo(easyhandle, CURLINFO_SPEED_DOWNLOAD,
+				&stat.speed_download)) && NULL == run->err_str)
 		{
-			err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			goto httpstep_error;
+			run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
 		}
-
-		/* enable/disable fetching the body */
-		if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_NOBODY,
-				ZBX_RETRIEVE_MODE_HEADERS == db_httpstep.retrieve_mode ? 1L : 0L)))
+		else
 		{
-			err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			goto httpstep_error;
+			run->speed_download += stat.speed_download;
+			run->speed_download_num++;
 		}
 
-		if (SUCCEED != zbx_http_prepare_auth(easyhandle, httptest->httptest.authentication,
-				httptest->httptest.http_user, httptest->httptest.http_password, NULL, &err_str))
+		/* required pattern */
+		if (NULL == run->err_str && '\0' != *db_httpstep->required &&
+				NULL == zbx_regexp_match(run->page.data, db_httpstep->required, NULL))
 		{
-			goto httpstep_error;
+			run->err_str = zbx_dsprintf(run->err_str, "required pattern \"%s\" was not found on %s",
+					db_httpstep->required, httpstep->url);
 		}
 
-		zabbix_log(LOG_LEVEL_DEBUG, "%s() go to URL \"%s\"", __func__, httpstep.url);
-
-		if (CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_TIMEOUT, (long)db_httpstep.timeout)) ||
-				CURLE_OK != (err = curl_easy_setopt(easyhandle, CURLOPT_URL, httpstep.url)))
+		/* variables defined in scenario */
+		if (NULL == run->err_str && FAIL == http_process_variables(&run->httptest, &run->httptest.variables,
+				run->page.data, &var_err_str))
 		{
-			err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			goto httpstep_error;
+			char	*variables = NULL;
+			size_t	alloc_len = 0, offset;
+
+			httpstep_pairs_join(&variables, &alloc_len, &offset, "=", " ", &run->httptest.variables);
+
+			run->err_str = zbx_dsprintf(run->err_str, "error in scenario variables \"%s\": %s", variables,
+					var_err_str);
+
+			zbx_free(variables);
 		}
 
-		/* try to retrieve page several times depending on number of retries */
-		do
+		/* variables defined in a step */
+		if (NULL == run->err_str && FAIL == http_process_variables(&run->httptest, &httpstep->variables,
+				run->page.data, &var_err_str))
 		{
-			memset(&page, 0, sizeof(page));
-			errbuf[0] = '\0';
+			char	*variables = NULL;
+			size_t	alloc_len = 0, offset;
 
-			if (CURLE_OK == (err = curl_easy_perform(easyhandle)))
-				break;
+			httpstep_pairs_join(&variables, &alloc_len, &offset, "=", " ", &httpstep->variables);
 
-			zbx_free(page.data);
+			run->err_str = zbx_dsprintf(run->err_str, "error in step variables \"%s\": %s", variables,
+					var_err_str);
+
+			zbx_free(variables);
 		}
-		while (0 < --httptest->httptest.retries);
 
-		curl_slist_free_all(headers_slist);	/* must be called after curl_easy_perform() */
+		zbx_free(var_err_str);
 
-		if (CURLE_OK == err)
-		{
-			char	*var_err_str = NULL;
+		zbx_timespec(&ts);
+		process_step_data(db_httpstep->httpstepid, &stat, &ts);
+	}
+	else
+	{
+		run->err_str = zbx_dsprintf(run->err_str, "%s", 0 < strlen(run->errbuf) ? run->errbuf :
+				curl_easy_strerror(err));
+	}
 
-			zabbix_log(LOG_LEVEL_TRACE, "%s() page.data from %s:'%s'", __func__, httpstep.url, page.data);
+	httptest_step_clean(run);
 
-			/* first get the data that is needed even if step fails */
-			if (CURLE_OK != (err = curl_easy_getinfo(easyhandle, CURLINFO_RESPONSE_CODE, &stat.rspcode)))
-			{
-				err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			}
-			else if ('\0' != *db_httpstep.status_codes &&
-					FAIL == zbx_int_in_list(db_httpstep.status_codes, stat.rspcode))
-			{
-				err_str = zbx_dsprintf(err_str, "response code \"%ld\" did not match any of the"
-						" required status codes \"%s\"", stat.rspcode,
-						db_httpstep.status_codes);
-			}
+	if (NULL != run->err_str)
+	{
+		run->lastfailedstep = db_httpstep->no;
+		run->failedstep_name = db_httpstep->name;
+		httptest_run_finish(run);
+		return;
+	}
 
-			if (CURLE_OK != (err = curl_easy_getinfo(easyhandle, CURLINFO_TOTAL_TIME, &stat.total_time)) &&
-					NULL == err_str)
-			{
-				err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			}
+	run->step++;
+	httptest_run_next(run);
+}
 
-			if (CURLE_OK != (err = curl_easy_getinfo(easyhandle, CURLINFO_SPEED_DOWNLOAD,
-					&stat.speed_download)) && NULL == err_str)
-			{
-				err_str = zbx_strdup(err_str, curl_easy_strerror(err));
-			}
-			else
-			{
-				speed_download += stat.speed_download;
-				speed_download_num++;
-			}
+/******************************************************************************
+ *                                                                            *
+ * Purpose: creates the scenario easy handle, it is reused by all the steps   *
+ *          so the cookies are kept between them                              *
+ *                                                                            *
+ ******************************************************************************/
+static int	httptest_run_prepare_handle(zbx_httptest_run_t *run)
+{
+	zbx_db_httptest	*httptest = &run->httptest.httptest;
+	CURLcode	err;
 
-			/* required pattern */
-			if (NULL == err_str && '\0' != *db_httpstep.required &&
-					NULL == zbx_regexp_match(page.data, db_httpstep.required, NULL))
-			{
-				err_str = zbx_dsprintf(err_str, "required pattern \"%s\" was not found on %s",
-						db_httpstep.required, httpstep.url);
-			}
+	if (NULL == httptests_multi && NULL == (httptests_multi = curl_multi_init()))
+	{
+		run->err_str = zbx_strdup(run->err_str, "cannot initialize cURL multi session");
+		return FAIL;
+	}
 
-			/* variables defined in scenario */
-			if (NULL == err_str && FAIL == http_process_variables(httptest, &httptest->variables, page.data,
-					&var_err_str))
-			{
-				char	*variables = NULL;
-				size_t	alloc_len = 0, offset;
+	if (NULL == (run->easyhandle = curl_easy_init()))
+	{
+		run->err_str = zbx_strdup(run->err_str, "cannot initialize cURL library");
+		return FAIL;
+	}
 
-				httpstep_pairs_join(&variables, &alloc_len, &offset, "=", " ", &httptest->variables);
+	if (CURLE_OK != (err = curl_easy_setopt(run->easyhandle, CURLOPT_PROXY, httptest->http_proxy)) ||
+			CURLE_OK != (err = curl_easy_setopt(run->easyhandle, CURLOPT_COOKIEFILE, "")) ||
+			CURLE_OK != (err = curl_easy_setopt(run->easyhandle, CURLOPT_USERAGENT, httptest->agent)) ||
+			CURLE_OK != (err = curl_easy_setopt(run->easyhandle, CURLOPT_ERRORBUFFER, run->errbuf)) ||
+			CURLE_OK != (err = curl_easy_setopt(run->easyhandle, ZBX_CURLOPT_ACCEPT_ENCODING, "")) ||
+			CURLE_OK != (err = curl_easy_setopt(run->easyhandle, CURLOPT_WRITEDATA, &run->page)) ||
+			CURLE_OK != (err = curl_easy_setopt(run->easyhandle, CURLOPT_HEADERDATA, &run->page)) ||
+			CURLE_OK != (err = curl_easy_setopt(run->easyhandle, CURLOPT_PRIVATE, run)))
+	{
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		return FAIL;
+	}
 
-				err_str = zbx_dsprintf(err_str, "error in scenario variables \"%s\": %s", variables,
-						var_err_str);
+#if LIBCURL_VERSION_NUM >= 0x071304
+	/* CURLOPT_PROTOCOLS is supported starting with version 7.19.4 (0x071304) */
+	if (CURLE_OK != (err = curl_easy_setopt(run->easyhandle, CURLOPT_PROTOCOLS,
+			CURLPROTO_HTTP | CURLPROTO_HTTPS)))
+	{
+		run->err_str = zbx_strdup(run->err_str, curl_easy_strerror(err));
+		return FAIL;
+	}
+#endif
 
-				zbx_free(variables);
-			}
+	return zbx_http_prepare_ssl(run->easyhandle, httptest->ssl_cert_file, httptest->ssl_key_file,
+			httptest->ssl_key_password, httptest->verify_peer, httptest->verify_host, &run->err_str);
+}
+#endif	/* HAVE_LIBCURL */
 
-			/* variables defined in a step */
-			if (NULL == err_str && FAIL == http_process_variables(httptest, &httpstep.variables, page.data,
-					&var_err_str))
-			{
-				char	*variables = NULL;
-				size_t	alloc_len = 0, offset;
+/******************************************************************************
+ *                                                                            *
+ * Purpose: loads the scenario steps, the transfers are started one by one    *
+ *                                                                            *
+ ******************************************************************************/
+static void	httptest_load_steps(zbx_httptest_run_t *run)
+{
+	DB_RESULT	result;
+	DB_ROW		row;
+	int		steps_alloc = 0;
 
-				httpstep_pairs_join(&variables, &alloc_len, &offset, "=", " ", &httpstep.variables);
+	result = zbx_db_select(
+			"select httpstepid,no,name,url,timeout,posts,required,status_codes,post_type,follow_redirects,"
+				"retrieve_mode"
+			" from httpstep"
+			" where httptestid=" ZBX_FS_UI64
+			" order by no",
+			run->httptest.httptest.httptestid);
 
-				err_str = zbx_dsprintf(err_str, "error in step variables \"%s\": %s", variables,
-						var_err_str);
+	while (NULL != (row = zbx_db_fetch(result)))
+	{
+		zbx_httpstep_row_t	*step;
 
-				zbx_free(variables);
-			}
+		if (run->steps_num == steps_alloc)
+		{
+			steps_alloc = (0 == steps_alloc ? 4 : steps_alloc * 2);
+			run->steps = (zbx_httpstep_row_t *)zbx_realloc(run->steps,
+					sizeof(zbx_httpstep_row_t) * (size_t)steps_alloc);
+		}
 
-			zbx_free(var_err_str);
+		step = &run->steps[run->steps_num++];
+
+		ZBX_STR2UINT64(step->httpstepid, row[0]);
+		step->no = atoi(row[1]);
+		step->name = zbx_strdup(NULL, row[2]);
+		step->url = zbx_strdup(NULL, row[3]);
+		step->timeout = zbx_strdup(NULL, row[4]);
+		step->posts = zbx_strdup(NULL, row[5]);
+		step->required = zbx_strdup(NULL, row[6]);
+		step->status_codes = zbx_strdup(NULL, row[7]);
+		step->post_type = atoi(row[8]);
+		step->follow_redirects = atoi(row[9]);
+		step->retrieve_mode = atoi(row[10]);
+	}
+	zbx_db_free_result(result);
+}
 
-			zbx_timespec(&ts);
-			process_step_data(db_httpstep.httpstepid, &stat, &ts);
+/******************************************************************************
+ *                                                                            *
+ * Purpose: starts single scenario of http test, its steps are performed by   *
+ *          httptests_perform()                                               *
+ *                                                                            *
+ ******************************************************************************/
+static void	httptest_run_start(zbx_uint64_t httptestid)
+{
+	DB_RESULT		result;
+	DB_ROW			row;
+	zbx_httptest_run_t	*run;
+	zbx_httptest_t		*httptest;
+	DC_HOST			*host;
+	char			*buffer;
 
-			zbx_free(page.data);
-		}
-		else
-			err_str = zbx_dsprintf(err_str, "%s", 0 < strlen(errbuf) ? errbuf : curl_easy_strerror(err));
+	zabbix_log(LOG_LEVEL_DEBUG, "In %s() httptestid:" ZBX_FS_UI64, __func__, httptestid);
 
-httpstep_error:
-		zbx_free(db_httpstep.status_codes);
-		zbx_free(db_httpstep.required);
-		zbx_free(db_httpstep.posts);
-		zbx_free(db_httpstep.url);
+	result = zbx_db_select(
+			"select h.hostid,h.host,h.name,t.httptestid,t.name,t.agent,"
+				"t.authentication,t.http_user,t.http_password,t.http_proxy,t.retries,t.ssl_cert_file,"
+				"t.ssl_key_file,t.ssl_key_password,t.verify_peer,t.verify_host,t.delay"
+			" from httptest t,hosts h"
+			" where t.hostid=h.hostid"
+				" and t.httptestid=" ZBX_FS_UI64,
+			httptestid);
+
+	if (NULL == (row = zbx_db_fetch(result)))
+		goto out;
 
-		httppairs_free(&httpstep.variables);
+	run = (zbx_httptest_run_t *)zbx_calloc(NULL, 1, sizeof(zbx_httptest_run_t));
+	httptest = &run->httptest;
+	host = &run->host;
 
-		if (ZBX_POSTTYPE_FORM == httpstep.httpstep->post_type)
-			zbx_free(httpstep.posts);
+	/* create macro cache to use in http test */
+	zbx_vector_ptr_pair_create(&httptest->macros);
 
-		zbx_free(httpstep.url);
-		zbx_free(httpstep.headers);
+	ZBX_STR2UINT64(host->hostid, row[0]);
+	zbx_strscpy(host->host, row[1]);
+	zbx_strlcpy_utf8(host->name, row[2], sizeof(host->name));
 
-		if (NULL != err_str)
-		{
-			lastfailedstep = db_httpstep.no;
-			break;
-		}
+	ZBX_STR2UINT64(httptest->httptest.httptestid, row[3]);
+	httptest->httptest.name = zbx_strdup(NULL, row[4]);
+
+	if (SUCCEED != httptest_load_pairs(host, httptest))
+	{
+		zabbix_log(LOG_LEVEL_WARNING, "cannot process web scenario \"%s\" on host \"%s\": "
+				"cannot load web scenario data", httptest->httptest.name, host->name);
+		THIS_SHOULD_NEVER_HAPPEN;
+		httptest_run_free(run);
+		goto out;
 	}
-clean:
-	curl_easy_cleanup(easyhandle);
-#else
-	err_str = zbx_strdup(err_str, "cURL library is required for Web monitoring support");
-#endif	/* HAVE_LIBCURL */
 
-httptest_error:
-	zbx_timespec(&ts);
+	httptest->httptest.agent = zbx_strdup(NULL, row[5]);
+	zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, &httptest->httptest.agent, MACRO_TYPE_COMMON, NULL, 0);
 
-	if (NULL != err_str)
+	if (HTTPTEST_AUTH_NONE != (httptest->httptest.authentication = atoi(row[6])))
 	{
-		if (0 >= lastfailedstep)
-		{
-			/* we are here because web scenario update interval is invalid, */
-			/* cURL initialization failed or we have been compiled without cURL library */
-
-			lastfailedstep = 1;
-		}
+		httptest->httptest.http_user = zbx_strdup(NULL, row[7]);
+		zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL,
+				NULL, NULL, NULL, NULL, NULL, &httptest->httptest.http_user,
+				MACRO_TYPE_COMMON, NULL, 0);
+
+		httptest->httptest.http_password = zbx_strdup(NULL, row[8]);
+		zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL,
+				NULL, NULL, NULL, NULL, NULL, &httptest->httptest.http_password,
+				MACRO_TYPE_COMMON, NULL, 0);
+	}
 
-		if (NULL != db_httpstep.name)
-		{
-			zabbix_log(LOG_LEVEL_DEBUG, "cannot process step \"%s\" of web scenario \"%s\" on host \"%s\": "
-					"%s", db_httpstep.name, httptest->httptest.name, host->name, err_str);
-		}
+	if ('\0' != *row[9])
+	{
+		httptest->httptest.http_proxy = zbx_strdup(NULL, row[9]);
+		zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL,
+				NULL, NULL, NULL, NULL, &httptest->httptest.http_proxy,
+				MACRO_TYPE_COMMON, NULL, 0);
 	}
-	zbx_db_free_result(result);
 
-	if (0 != speed_download_num)
-		speed_download /= speed_download_num;
+	httptest->httptest.retries = atoi(row[10]);
+
+	httptest->httptest.ssl_cert_file = zbx_strdup(NULL, row[11]);
+	zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, host, NULL, NULL, NULL, NULL, NULL,
+			NULL, &httptest->httptest.ssl_cert_file, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
+
+	httptest->httptest.ssl_key_file = zbx_strdup(NULL, row[12]);
+	zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, host, NULL, NULL, NULL, NULL, NULL,
+			NULL, &httptest->httptest.ssl_key_file, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
+
+	httptest->httptest.ssl_key_password = zbx_strdup(NULL, row[13]);
+	zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, &httptest->httptest.ssl_key_password, MACRO_TYPE_COMMON,
+			NULL, 0);
+
+	httptest->httptest.verify_peer = atoi(row[14]);
+	httptest->httptest.verify_host = atoi(row[15]);
+
+	httptest->httptest.delay = zbx_strdup(NULL, row[16]);
 
-	process_test_data(httptest->httptest.httptestid, lastfailedstep, speed_download, err_str, &ts);
+	/* add httptest variables to the current test macro cache */
+	http_process_variables(httptest, &httptest->variables, NULL, NULL);
+
+	httptests_running_num++;
+
+	buffer = zbx_strdup(NULL, httptest->httptest.delay);
+	zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host->hostid, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+				&buffer, MACRO_TYPE_COMMON, NULL, 0);
+
+	if (SUCCEED != zbx_is_time_suffix(buffer, &run->delay, ZBX_LENGTH_UNLIMITED))
+	{
+		run->err_str = zbx_dsprintf(run->err_str, "update interval \"%s\" is invalid", buffer);
+		run->lastfailedstep = -1;
+		run->delay = ZBX_DEFAULT_INTERVAL;
+		zbx_free(buffer);
+		httptest_run_finish(run);
+		goto out;
+	}
 
 	zbx_free(buffer);
-	zbx_free(err_str);
-	preprocessing_force_flush();
+
+#ifdef HAVE_LIBCURL
+	if (SUCCEED != httptest_run_prepare_handle(run))
+	{
+		httptest_run_finish(run);
+		goto out;
+	}
+
+	httptest_load_steps(run);
+
+	run->httpstep.httptest = httptest;
+	run->httpstep.httpstep = &run->db_httpstep;
+
+	httptest_run_next(run);
+#else
+	run->err_str = zbx_strdup(run->err_str, "cURL library is required for Web monitoring support");
+	httptest_run_finish(run);
+#endif
+out:
+	zbx_db_free_result(result);
 
 	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
 }
 
+static int	httptests_flush_finished(void)
+{
+	int	finished = httptests_finished_num;
+
+	if (0 != finished)
+	{
+#ifdef HAVE_GLB_TESTS
+		if (NULL == test_done_cb)
+#endif
+		preprocessing_force_flush();
+	}
+
+	httptests_finished_num = 0;
+
+	return finished;
+}
+
 /******************************************************************************
  *                                                                            *
- * Purpose: process httptests                                                 *
+ * Purpose: starts due httptests                                              *
  *                                                                            *
  * Parameters: now - current timestamp                                        *
  *                                                                            *
- * Return value: number of processed httptests                                *
+ * Return value: number of httptests finished right away (the ones failed    *
+ *               before their first transfer)                                 *
  *                                                                            *
- * Comments: always SUCCEED                                                   *
+ * Comments: up to HTTPTEST_MAX_RUNNING scenarios are run at once, the rest   *
+ *           are started when the running ones finish                         *
  *                                                                            *
  ******************************************************************************/
 int	process_httptests(int now, time_t *nextcheck)
 {
-	DB_RESULT		result;
-	DB_ROW			row;
-	zbx_uint64_t		httptestid;
-	zbx_httptest_t		httptest;
-	DC_HOST			host;
-	int			httptests_count = 0;
-	zbx_dc_um_handle_t	*um_handle;
+	zbx_uint64_t	httptestid;
 
 	zabbix_log(LOG_LEVEL_DEBUG, "In %s()", __func__);
 
-	if (SUCCEED != zbx_dc_httptest_next(now, &httptestid, nextcheck))
-		goto out;
+	while (ZBX_IS_RUNNING())
+	{
+		if (HTTPTEST_MAX_RUNNING <= httptests_running_num)
+		{
+			/* check the queue again as soon as some of the running scenarios finish */
+			*nextcheck = now + 1;
+			break;
+		}
 
-	um_handle = zbx_dc_open_user_macros();
+		if (SUCCEED != zbx_dc_httptest_next(now, &httptestid, nextcheck))
+			break;
 
-	/* create macro cache to use in http tests */
-	zbx_vector_ptr_pair_create(&httptest.macros);
+		httptest_run_start(httptestid);
+	}
 
-	do
-	{
-		int	delay = 0;
-
-		result = zbx_db_select(
-				"select h.hostid,h.host,h.name,t.httptestid,t.name,t.agent,"
-					"t.authentication,t.http_user,t.http_password,t.http_proxy,t.retries,t.ssl_cert_file,"
-					"t.ssl_key_file,t.ssl_key_password,t.verify_peer,t.verify_host,t.delay"
-				" from httptest t,hosts h"
-				" where t.hostid=h.hostid"
-					" and t.httptestid=" ZBX_FS_UI64,
-				httptestid);
-
-		if (NULL != (row = zbx_db_fetch(result)))
-		{
-			ZBX_STR2UINT64(host.hostid, row[0]);
-			zbx_strscpy(host.host, row[1]);
-			zbx_strlcpy_utf8(host.name, row[2], sizeof(host.name));
+	zabbix_log(LOG_LEVEL_DEBUG, "End of %s() running:%d", __func__, httptests_running_num);
 
-			ZBX_STR2UINT64(httptest.httptest.httptestid, row[3]);
-			httptest.httptest.name = row[4];
+	return httptests_flush_finished();
+}
 
-			if (SUCCEED != httptest_load_pairs(&host, &httptest))
-			{
-				zabbix_log(LOG_LEVEL_WARNING, "cannot process web scenario \"%s\" on host \"%s\": "
-						"cannot load web scenario data", httptest.httptest.name, host.name);
-				zbx_db_free_result(result);
-				THIS_SHOULD_NEVER_HAPPEN;
-				continue;
-			}
+/******************************************************************************
+ *                                                                            *
+ * Purpose: returns number of the scenarios waiting for their transfers       *
+ *                                                                            *
+ ******************************************************************************/
+int	httptests_running(void)
+{
+	return httptests_running_num;
+}
 
-			httptest.httptest.agent = zbx_strdup(NULL, row[5]);
-			zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host.hostid, NULL, NULL, NULL, NULL, NULL,
-					NULL, NULL, &httptest.httptest.agent, MACRO_TYPE_COMMON, NULL, 0);
+/******************************************************************************
+ *                                                                            *
+ * Purpose: waits for the transfers of the running scenarios and advances     *
+ *          the scenarios which transfers are completed                       *
+ *                                                                            *
+ * Parameters: info    - [IN] the process info for self monitoring            *
+ *             timeout - [IN] the maximum time to wait, seconds               *
+ *                                                                            *
+ * Return value: number of finished httptests                                 *
+ *                                                                            *
+ ******************************************************************************/
+int	httptests_perform(const zbx_thread_info_t *info, int timeout)
+{
+#ifdef HAVE_LIBCURL
+	CURLMsg		*msg;
+	CURLMcode	merr;
+	int		running_handles, msgs_left;
 
-			if (HTTPTEST_AUTH_NONE != (httptest.httptest.authentication = atoi(row[6])))
-			{
-				httptest.httptest.http_user = zbx_strdup(NULL, row[7]);
-				zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, &host.hostid, NULL, NULL,
-						NULL, NULL, NULL, NULL, NULL, &httptest.httptest.http_user,
-						MACRO_TYPE_COMMON, NULL, 0);
-
-				httptest.httptest.http_password = zbx_strdup(NULL, row[8]);
-				zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, &host.hostid, NULL, NULL,
-						NULL, NULL, NULL, NULL, NULL, &httptest.httptest.http_password,
-						MACRO_TYPE_COMMON, NULL, 0);
-			}
+	if (0 == httptests_running_num)
+		return httptests_flush_finished();
 
-			if ('\0' != *row[9])
-			{
-				httptest.httptest.http_proxy = zbx_strdup(NULL, row[9]);
-				zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, &host.hostid, NULL, NULL, NULL,
-						NULL, NULL, NULL, NULL, &httptest.httptest.http_proxy,
-						MACRO_TYPE_COMMON, NULL, 0);
-			}
-			else
-				httptest.httptest.http_proxy = NULL;
+	zbx_update_selfmon_counter(info, ZBX_PROCESS_STATE_IDLE);
+	merr = curl_multi_wait(httptests_multi, NULL, 0, timeout * 1000, NULL);
+	zbx_update_selfmon_counter(info, ZBX_PROCESS_STATE_BUSY);
 
-			httptest.httptest.retries = atoi(row[10]);
+	if (CURLM_OK != merr)
+		zabbix_log(LOG_LEVEL_WARNING, "cannot wait for web scenario transfers: %s", curl_multi_strerror(merr));
+
+	if (CURLM_OK != (merr = curl_multi_perform(httptests_multi, &running_handles)))
+		zabbix_log(LOG_LEVEL_WARNING, "cannot perform web scenario transfers: %s", curl_multi_strerror(merr));
+
+	while (NULL != (msg = curl_multi_info_read(httptests_multi, &msgs_left)))
+	{
+		zbx_httptest_run_t	*run;
+		CURL			*easyhandle = msg->easy_handle;
+		CURLcode		err = msg->data.result;
 
-			httptest.httptest.ssl_cert_file = zbx_strdup(NULL, row[11]);
-			zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, &host, NULL, NULL, NULL, NULL, NULL,
-					NULL, &httptest.httptest.ssl_cert_file, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
+		if (CURLMSG_DONE != msg->msg)
+			continue;
 
-			httptest.httptest.ssl_key_file = zbx_strdup(NULL, row[12]);
-			zbx_substitute_simple_macros(NULL, NULL, NULL, NULL, NULL, &host, NULL, NULL, NULL, NULL, NULL,
-					NULL, &httptest.httptest.ssl_key_file, MACRO_TYPE_HTTPTEST_FIELD, NULL, 0);
+		curl_easy_getinfo(easyhandle, CURLINFO_PRIVATE, (char **)&run);
+		curl_multi_remove_handle(httptests_multi, easyhandle);
 
-			httptest.httptest.ssl_key_password = zbx_strdup(NULL, row[13]);
-			zbx_substitute_simple_macros_unmasked(NULL, NULL, NULL, NULL, &host.hostid, NULL, NULL, NULL,
-					NULL, NULL, NULL, NULL, &httptest.httptest.ssl_key_password, MACRO_TYPE_COMMON,
-					NULL, 0);
+		httptest_step_done(run, err);
+	}
+#else
+	ZBX_UNUSED(info);
+	ZBX_UNUSED(timeout);
+#endif
+	return httptests_flush_finished();
+}
 
-			httptest.httptest.verify_peer = atoi(row[14]);
-			httptest.httptest.verify_host = atoi(row[15]);
+#ifdef HAVE_GLB_TESTS
+void	httptest_test_init(httptest_test_step_cb_t step_cb, httptest_test_done_cb_t done_cb)
+{
+	test_step_cb = step_cb;
+	test_done_cb = done_cb;
+}
 
-			httptest.httptest.delay = row[16];
+void	httptest_test_destroy(void)
+{
+	test_step_cb = NULL;
+	test_done_cb = NULL;
+#ifdef HAVE_LIBCURL
+	/* the http pollers are forked after the tests, so they start their own multi handle */
+	if (NULL != httptests_multi)
+	{
+		curl_multi_cleanup(httptests_multi);
+		httptests_multi = NULL;
+	}
+#endif
+}
 
-			/* add httptest variables to the current test macro cache */
-			http_process_variables(&httptest, &httptest.variables, NULL, NULL);
+#ifdef HAVE_LIBCURL
+/******************************************************************************
+ *                                                                            *
+ * Purpose: starts the scenario of the test steps the way                     *
+ *          httptest_run_start() does, but without the database               *
+ *                                                                            *
+ ******************************************************************************/
+void	httptest_test_run_start(zbx_uint64_t httptestid, int retries, const httptest_test_step_t *steps,
+		int steps_num)
+{
+	zbx_httptest_run_t	*run;
+	int			i;
 
-			process_httptest(&host, &httptest, &delay);
-			zbx_dc_httptest_queue(now, httptestid, delay);
+	run = (zbx_httptest_run_t *)zbx_calloc(NULL, 1, sizeof(zbx_httptest_run_t));
 
-			zbx_free(httptest.httptest.ssl_key_password);
-			zbx_free(httptest.httptest.ssl_key_file);
-			zbx_free(httptest.httptest.ssl_cert_file);
-			zbx_free(httptest.httptest.http_proxy);
+	zbx_vector_ptr_pair_create(&run->httptest.macros);
+	zbx_vector_ptr_pair_create(&run->httptest.variables);
 
-			if (HTTPTEST_AUTH_NONE != httptest.httptest.authentication)
-			{
-				zbx_free(httptest.httptest.http_password);
-				zbx_free(httptest.httptest.http_user);
-			}
-			zbx_free(httptest.httptest.agent);
-			zbx_free(httptest.headers);
-			httppairs_free(&httptest.variables);
+	run->httptest.httptest.httptestid = httptestid;
+	run->httptest.httptest.name = zbx_dsprintf(NULL, "test scenario " ZBX_FS_UI64, httptestid);
+	run->httptest.httptest.agent = zbx_strdup(NULL, "Glaber tests");
+	run->httptest.httptest.authentication = HTTPTEST_AUTH_NONE;
+	run->httptest.httptest.retries = retries;
+	run->httptest.httptest.ssl_cert_file = zbx_strdup(NULL, "");
+	run->httptest.httptest.ssl_key_file = zbx_strdup(NULL, "");
+	run->httptest.httptest.ssl_key_password = zbx_strdup(NULL, "");
+	run->delay = SEC_PER_MIN;
 
-			/* clear the macro cache used in this http test */
-			httptest_remove_macros(&httptest);
+	run->steps = (zbx_httpstep_row_t *)zbx_calloc(NULL, (size_t)steps_num, sizeof(zbx_httpstep_row_t));
 
-			httptests_count++;	/* performance metric */
-		}
-		zbx_db_free_result(result);
+	for (i = 0; i < steps_num; i++)
+	{
+		zbx_httpstep_row_t	*step = &run->steps[run->steps_num++];
+
+		step->httpstepid = steps[i].httpstepid;
+		step->no = i + 1;
+		step->name = zbx_strdup(NULL, steps[i].name);
+		step->url = zbx_strdup(NULL, steps[i].url);
+		step->timeout = zbx_strdup(NULL, "5s");
+		step->posts = zbx_strdup(NULL, "");
+		step->required = zbx_strdup(NULL, steps[i].required);
+		step->status_codes = zbx_strdup(NULL, steps[i].status_codes);
+		step->post_type = ZBX_POSTTYPE_RAW;
+		step->follow_redirects = 1;
+		step->retrieve_mode = ZBX_RETRIEVE_MODE_CONTENT;
 	}
-	while (ZBX_IS_RUNNING() && SUCCEED == zbx_dc_httptest_next(now, &httptestid, nextcheck));
 
-	/* destroy the macro cache used in http tests */
-	zbx_vector_ptr_pair_destroy(&httptest.macros);
+	httptests_running_num++;
 
-	zbx_dc_close_user_macros(um_handle);
-out:
-	zabbix_log(LOG_LEVEL_DEBUG, "End of %s()", __func__);
+	if (SUCCEED != httptest_run_prepare_handle(run))
+	{
+		httptest_run_finish(run);
+		return;
+	}
 
-	return httptests_count;
+	run->httpstep.httptest = &run->httptest;
+	run->httpstep.httpstep = &run->db_httpstep;
+
+	httptest_run_next(run);
 }
+#endif
+#endif
@@ -21,7 +21,30 @@
 #define ZABBIX_HTTPTEST_H
 
 #include "zbxcommon.h"
+#include "zbxthreads.h"
 
 int	process_httptests(int now, time_t *nextcheck);
+int	httptests_running(void);
+int	httptests_perform(const zbx_thread_info_t *info, int timeout);
+
+#ifdef HAVE_GLB_TESTS
+typedef struct
+{
+	zbx_uint64_t	httpstepid;
+	const char	*name;
+	const char	*url;
+	const char	*required;
+	const char	*status_codes;
+}
+httptest_test_step_t;
+
+typedef void	(*httptest_test_step_cb_t)(zbx_uint64_t httpstepid, long rspcode);
+typedef void	(*httptest_test_done_cb_t)(zbx_uint64_t httptestid, int lastfailedstep, const char *err_str);
+
+void	httptest_test_init(httptest_test_step_cb_t step_cb, httptest_test_done_cb_t done_cb);
+void	httptest_test_destroy(void);
+void	httptest_test_run_start(zbx_uint64_t httptestid, int retries, const httptest_test_step_t *steps,
+		int steps_num);
+#endif
 
 #endif
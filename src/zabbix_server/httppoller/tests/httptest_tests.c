@@ -0,0 +1,273 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "zbxstr.h"
+#include "zbxtime.h"
+#include "zbxhttp.h"
+#include "../httptest.h"
+
+#ifdef HAVE_LIBCURL
+
+#include <netinet/in.h>
+#include <sys/wait.h>
+
+#define TEST_STEPS	8
+#define TEST_SCENARIOS	8
+
+typedef struct {
+	zbx_uint64_t httpstepid;
+	long rspcode;
+} test_step_result_t;
+
+typedef struct {
+	int done;
+	int lastfailedstep;
+	char err_str[256];
+} test_result_t;
+
+static test_step_result_t steps_done[TEST_STEPS];
+static int steps_done_num;
+static test_result_t results[TEST_SCENARIOS];
+
+static void test_step_cb(zbx_uint64_t httpstepid, long rspcode) {
+	assert(TEST_STEPS > steps_done_num && "Too many steps reported");
+
+	steps_done[steps_done_num].httpstepid = httpstepid;
+	steps_done[steps_done_num].rspcode = rspcode;
+	steps_done_num++;
+}
+
+static void test_done_cb(zbx_uint64_t httptestid, int lastfailedstep, const char *err_str) {
+	test_result_t *result = &results[httptestid];
+
+	result->done++;
+	result->lastfailedstep = lastfailedstep;
+	zbx_strlcpy(result->err_str, ZBX_NULL2EMPTY_STR(err_str), sizeof(result->err_str));
+}
+
+/* returns the response code the step was reported with or 0 if it wasn't performed */
+static long step_rspcode(zbx_uint64_t httpstepid) {
+	long rspcode = 0;
+	int i;
+
+	for (i = 0; i < steps_done_num; i++) {
+		if (httpstepid != steps_done[i].httpstepid)
+			continue;
+
+		assert(0 == rspcode && "Step should be reported once");
+		rspcode = steps_done[i].rspcode;
+	}
+
+	return rspcode;
+}
+
+static int listen_local(unsigned short *port) {
+	struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+	socklen_t addr_len = sizeof(addr);
+	int fd;
+
+	assert(-1 != (fd = socket(AF_INET, SOCK_STREAM, 0)));
+	assert(0 == bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+	assert(0 == listen(fd, 16));
+	assert(0 == getsockname(fd, (struct sockaddr *)&addr, &addr_len));
+
+	*port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+static void respond(int conn, const char *status, const char *headers, const char *body) {
+	char response[512];
+	size_t len;
+
+	len = zbx_snprintf(response, sizeof(response), "HTTP/1.1 %s\r\n%sContent-Length: %d\r\n"
+			"Connection: close\r\n\r\n%s", status, headers, (int)strlen(body), body);
+
+	if (0 > write(conn, response, len))
+		_exit(EXIT_FAILURE);
+}
+
+/* the server answers by the request path: "/login" sets the session cookie and "/check" requires it,
+   "/flaky" closes the first connection without an answer and "/drop" closes all of them */
+static void serve_requests(int fd) {
+	char request[1024];
+	int conn, flaky_num = 0;
+	ssize_t len;
+
+	while (-1 != (conn = accept(fd, NULL, NULL))) {
+		if (0 >= (len = read(conn, request, sizeof(request) - 1))) {
+			close(conn);
+			continue;
+		}
+
+		request[len] = '\0';
+
+		if (0 == strncmp(request, "GET /login ", 11))
+			respond(conn, "200 OK", "Set-Cookie: session=abc; Path=/\r\n", "welcome");
+		else if (0 == strncmp(request, "GET /check ", 11) && NULL != strstr(request, "session=abc"))
+			respond(conn, "200 OK", "", "logged in as session=abc");
+		else if (0 == strncmp(request, "GET /check ", 11))
+			respond(conn, "403 Forbidden", "", "forbidden");
+		else if (0 == strncmp(request, "GET /flaky ", 11) && 1 < ++flaky_num)
+			respond(conn, "200 OK", "", "recovered");
+		else if (0 == strncmp(request, "GET /ok ", 8))
+			respond(conn, "200 OK", "", "ok");
+		else if (0 == strncmp(request, "GET /missing ", 13))
+			respond(conn, "404 Not Found", "", "missing");
+
+		close(conn);
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+/* waits for the transfers the way the http poller does till all the scenarios are finished */
+static void run_scenarios(int scenarios_num) {
+	zbx_thread_info_t info = {.process_type = ZBX_PROCESS_TYPE_UNKNOWN};
+	double deadline = zbx_time() + 10;
+	int finished = 0;
+
+	while (0 != httptests_running() && zbx_time() < deadline)
+		finished += httptests_perform(&info, 1);
+
+	assert(0 == httptests_running() && "Scenarios should finish");
+	assert(scenarios_num == finished && "Each scenario should finish once");
+}
+
+static void make_step(httptest_test_step_t *step, zbx_uint64_t httpstepid, char *url, size_t url_size,
+		unsigned short port, const char *path, const char *required, const char *status_codes) {
+	zbx_snprintf(url, url_size, "http://127.0.0.1:%hu%s", port, path);
+
+	step->httpstepid = httpstepid;
+	step->name = path;
+	step->url = url;
+	step->required = required;
+	step->status_codes = status_codes;
+}
+
+/* the second scenario has no login step, so it doesn't get the first one's cookie even run at once */
+static void test_httptest_cookies(unsigned short port) {
+	httptest_test_step_t steps[2], check;
+	char urls[3][64];
+
+	LOG_INF("Testing web scenario cookies carried between steps");
+
+	make_step(&steps[0], 11, urls[0], sizeof(urls[0]), port, "/login", "", "200");
+	make_step(&steps[1], 12, urls[1], sizeof(urls[1]), port, "/check", "session=abc", "200");
+	make_step(&check, 21, urls[2], sizeof(urls[2]), port, "/check", "", "200");
+
+	httptest_test_run_start(1, 1, steps, 2);
+	httptest_test_run_start(2, 1, &check, 1);
+	assert(2 == httptests_running() && "Scenarios should run at once");
+
+	run_scenarios(2);
+
+	assert(1 == results[1].done && 0 == results[1].lastfailedstep && '\0' == *results[1].err_str &&
+			"Scenario should succeed");
+	assert(200 == step_rspcode(11) && 200 == step_rspcode(12) && "Cookie should be sent by the next step");
+
+	assert(1 == results[2].done && 1 == results[2].lastfailedstep && 403 == step_rspcode(21) &&
+			"Cookie should not be shared by the scenarios");
+	assert(NULL != strstr(results[2].err_str, "\"403\"") && "Error should tell the response code");
+}
+
+static void test_httptest_retry(unsigned short port) {
+	httptest_test_step_t steps[2], drop;
+	char urls[3][64];
+
+	LOG_INF("Testing web scenario retries after failed transfer");
+
+	make_step(&steps[0], 31, urls[0], sizeof(urls[0]), port, "/flaky", "recovered", "200");
+	make_step(&steps[1], 32, urls[1], sizeof(urls[1]), port, "/ok", "", "200");
+	make_step(&drop, 41, urls[2], sizeof(urls[2]), port, "/drop", "", "");
+
+	/* the first transfer gets nothing, the second attempt is answered */
+	httptest_test_run_start(3, 2, steps, 2);
+	run_scenarios(1);
+
+	assert(1 == results[3].done && 0 == results[3].lastfailedstep && '\0' == *results[3].err_str &&
+			"Scenario should succeed after the retry");
+	assert(200 == step_rspcode(31) && 200 == step_rspcode(32) && "Steps should be reported once");
+
+	/* the failed transfer is not reported as a step, the scenario fails on it */
+	httptest_test_run_start(4, 2, &drop, 1);
+	run_scenarios(1);
+
+	assert(1 == results[4].done && 1 == results[4].lastfailedstep && '\0' != *results[4].err_str &&
+			"Scenario should fail when the retries are over");
+	assert(0 == step_rspcode(41) && "Failed transfer should not be reported");
+}
+
+static void test_httptest_failed_step(unsigned short port) {
+	httptest_test_step_t steps[3];
+	char urls[3][64];
+
+	LOG_INF("Testing web scenario stopped by failed step");
+
+	make_step(&steps[0], 51, urls[0], sizeof(urls[0]), port, "/ok", "^ok$", "200");
+	make_step(&steps[1], 52, urls[1], sizeof(urls[1]), port, "/missing", "", "200,201");
+	make_step(&steps[2], 53, urls[2], sizeof(urls[2]), port, "/ok", "", "200");
+
+	httptest_test_run_start(5, 1, steps, 3);
+	run_scenarios(1);
+
+	assert(1 == results[5].done && 2 == results[5].lastfailedstep && "Second step should be the failed one");
+	assert(NULL != strstr(results[5].err_str, "\"404\"") && "Error should tell the response code");
+	assert(200 == step_rspcode(51) && 404 == step_rspcode(52) && "Failed step should be reported");
+	assert(0 == step_rspcode(53) && "Steps after the failed one should not be performed");
+}
+
+static void test_httptests(void) {
+	unsigned short port;
+	int fd = listen_local(&port);
+	pid_t server;
+
+	assert(0 == curl_global_init(CURL_GLOBAL_DEFAULT));
+
+	if (0 == (server = fork()))
+		serve_requests(fd);
+
+	close(fd);
+
+	httptest_test_init(test_step_cb, test_done_cb);
+
+	test_httptest_cookies(port);
+	test_httptest_retry(port);
+	test_httptest_failed_step(port);
+
+	httptest_test_destroy();
+
+	kill(server, SIGKILL);
+	waitpid(server, NULL, 0);
+}
+
+#endif
+
+void httptest_run_tests(void) {
+#ifdef HAVE_LIBCURL
+	test_httptests();
+#endif
+	LOG_INF("Finished web scenario tests");
+}
+
+#endif
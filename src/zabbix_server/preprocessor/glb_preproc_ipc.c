@@ -28,12 +28,15 @@
 #include "zbxlld.h"
 #include "../glb_poller/internal.h"
 #include "glb_preproc.h"
+#include "glb_preproc_ipc.h"
+#include "glb_preproc_route.h"
 
 
 u_int64_t DC_config_get_hostid_by_itemid(u_int64_t itemid);
 extern int CONFIG_FORKS[ZBX_PROCESS_TYPE_COUNT];
 
 extern size_t  CONFIG_IPC_BUFFER_SIZE;
+extern u_int64_t CONFIG_IPC_RING_SIZE;
 extern int CONFIG_PREPROC_IPC_METRICS_PER_PREPROCESSOR;  //128 * 1024
 extern int CONFIG_PROC_IPC_METRICS_PER_SYNCER; //128 * 1024
 
@@ -122,6 +125,77 @@ static void buffer_add_metric(serial_buffer_t *sbuff, const metric_t * metric) {
  }
 
 #define METRICS_IPC_FLUSH_PERIOD 1
+
+/* the poll results are applied to the state cache in batches, the same way
+   and with the same delay the metrics themselves are sent to preprocessing */
+#define POLL_RESULTS_BATCH 1024
+
+static glb_state_item_poll_result_t poll_results[POLL_RESULTS_BATCH];
+static int poll_results_num = 0;
+static int poll_results_time_created = 0;
+
+static int poll_results_compare(const void *d1, const void *d2) {
+    const glb_state_item_poll_result_t *res1 = d1, *res2 = d2;
+
+    ZBX_RETURN_IF_NOT_EQUAL(res1->itemid, res2->itemid);
+    ZBX_RETURN_IF_NOT_EQUAL(res1->lastcheck, res2->lastcheck);
+
+    return 0;
+}
+
+static void poll_results_force_flush() {
+    int i, num = 0;
+
+    if (0 == poll_results_num)
+        return;
+
+    /* only the latest result of an item is applied; qsort isn't stable, but the results
+       of the same item and second are all the same normal state, so their order doesn't matter */
+    qsort(poll_results, poll_results_num, sizeof(glb_state_item_poll_result_t), poll_results_compare);
+
+    for (i = 0; i < poll_results_num; i++) {
+        if (i + 1 < poll_results_num && poll_results[i].itemid == poll_results[i + 1].itemid)
+            continue;
+
+        poll_results[num++] = poll_results[i];
+    }
+
+    glb_state_items_set_poll_results(poll_results, num);
+    
+    poll_results_num = 0;
+}
+
+static void poll_results_flush() {
+    if (poll_results_time_created < time(NULL) - METRICS_IPC_FLUSH_PERIOD)
+        poll_results_force_flush();
+}
+
+static void poll_results_add(const metric_t *metric) {
+    if (POLL_RESULTS_BATCH == poll_results_num)
+        poll_results_force_flush();
+    
+    if (0 == poll_results_num)
+        poll_results_time_created = time(NULL);
+
+    poll_results[poll_results_num].itemid = metric->itemid;
+    poll_results[poll_results_num].lastcheck = metric->ts.sec;
+    poll_results[poll_results_num].state = ITEM_STATE_NORMAL;
+    
+    poll_results_num++;
+}
+
+static void buffer_flush(ipc2_conf_t *ipc, serial_buffer_t **sbuff, int consumer, int priority) {
+    /* the results go to the state before their metrics, otherwise the buffered normal state
+       might overwrite the error the preprocessing of the metric sets */
+    if (sbuff == conf->buff_preproc)
+        poll_results_force_flush();
+
+    ipc2_send_chunk(ipc, consumer, serial_buffer_get_items_count(sbuff[consumer]), 
+        serial_buffer_get_buffer(sbuff[consumer]), serial_buffer_get_used(sbuff[consumer]), priority); 
+
+    serial_buffer_clean(sbuff[consumer]);
+}
+
 static void buffers_flush_ext(ipc2_conf_t *ipc, serial_buffer_t **sbuff, int flush_period, int buffer_limit, int priority) {
     int i;
     int flush_time = time(NULL) - flush_period;
@@ -129,13 +203,8 @@ static void buffers_flush_ext(ipc2_conf_t *ipc, serial_buffer_t **sbuff, int flu
     for (i = 0; i < ipc2_get_consumers(ipc); i++) {
  
          if (serial_buffer_get_time_created(sbuff[i]) < flush_time || 
-            (buffer_limit > 0 && buffer_limit <= serial_buffer_get_items_count(sbuff[i]) ) ) {  
-            
-            ipc2_send_chunk(ipc, i, serial_buffer_get_items_count(sbuff[i]), serial_buffer_get_buffer(sbuff[i]), 
-                serial_buffer_get_used(sbuff[i]), priority); 
-
-            serial_buffer_clean(sbuff[i]);
-        }
+            (buffer_limit > 0 && buffer_limit <= serial_buffer_get_items_count(sbuff[i]) ) )
+            buffer_flush(ipc, sbuff, i, priority);
     }
 }
 
@@ -151,6 +220,19 @@ static void processing_buffers_flush(ipc2_conf_t *ipc, serial_buffer_t **sbuff)
     buffers_flush_ext(ipc, sbuff, 2, 1000, ALLOC_PRIORITY_NORMAL );
 }
 
+/* each process might be a producer, rings are claimed by the processes on their first send */
+static void metrics_ipc_init_rings(ipc2_conf_t *ipc) {
+    int i, producers = 1;
+
+    if (0 == CONFIG_IPC_RING_SIZE)
+        return;
+
+    for (i = 0; i < ZBX_PROCESS_TYPE_COUNT; i++)
+        producers += CONFIG_FORKS[i];
+
+    ipc2_init_rings(ipc, producers, CONFIG_IPC_RING_SIZE);
+}
+
 int metrics_ipc_init() {
     char *error = NULL;
     
@@ -177,9 +259,19 @@ int metrics_ipc_init() {
     if (NULL == (conf->preproc_ipc = ipc2_init(CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR], &conf->preproc_memf, "->preproc", preproc_ipc_mem )))
         return FAIL;
     
+    /* workers sleep in the events loop till metrics arrive instead of polling the queue */
+    if (SUCCEED != ipc2_init_wakeups(conf->preproc_ipc))
+        LOG_INF("Preprocessing IPC wakeups are not supported, workers will poll the queue");
+
+    if (SUCCEED != preproc_route_init(CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR], &conf->preproc_memf))
+        return FAIL;
+
     if (NULL == (conf->process_ipc = ipc2_init(CONFIG_FORKS[ZBX_PROCESS_TYPE_HISTSYNCER], &conf->proc_memf, "->processing", proc_ipc_mem )))
         return FAIL;
 
+    metrics_ipc_init_rings(conf->preproc_ipc);
+    metrics_ipc_init_rings(conf->process_ipc);
+
     conf->buff_preproc = init_buffers(CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR]);
     conf->buff_proc = init_buffers(CONFIG_FORKS[ZBX_PROCESS_TYPE_HISTSYNCER]);
 
@@ -195,25 +287,75 @@ void metrics_ipc_destroy() {
 }
 
 int preprocess_send_metric_hi_priority(const metric_t *metric) {
-    int queue_num = metric->hostid % CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR];
+    int queue_num = preproc_route_get_consumer(metric->itemid);
     
-    glb_state_items_set_poll_result(metric->itemid, metric->ts.sec, ITEM_STATE_NORMAL);
+    poll_results_add(metric);
     DEBUG_ITEM(metric->itemid, "Sending metric to preprocessing");
 
     buffer_add_metric(conf->buff_preproc[queue_num], metric);
     buffers_flush(conf->preproc_ipc, conf->buff_preproc, ALLOC_PRIORITY_HIGH);
+    poll_results_flush();
 }
 
 int preprocess_send_metric(const metric_t *metric) {
-    int queue_num = metric->hostid % CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR];
+    int queue_num = preproc_route_get_consumer(metric->itemid);
     
-    glb_state_items_set_poll_result(metric->itemid, metric->ts.sec, ITEM_STATE_NORMAL);
+    poll_results_add(metric);
     DEBUG_ITEM(metric->itemid, "Sending metric to preprocessing");
    
     buffer_add_metric(conf->buff_preproc[queue_num], metric);
     buffers_flush(conf->preproc_ipc, conf->buff_preproc, ALLOC_PRIORITY_NORMAL);
+    poll_results_flush();
+}
+
+/* the batch goes to the owner of it's first dependent item, so the batch stays on the worker
+   when the master is moved and so does the preprocessing history of it's items */
+void preprocess_send_dependent_batch(const metric_t *metric, int consumer, int batch) {
+    metric_t batch_metric = *metric;
+    
+    batch_metric.flags = METRIC_FLAG_DEPENDENT_BATCH | (u_int64_t)batch;
+    DEBUG_ITEM(metric->itemid, "Sending dependent items batch %d to preprocessing worker #%d", batch, consumer + 1);
+
+    buffer_add_metric(conf->buff_preproc[consumer], &batch_metric);
+}
+
+/* workers send batches to each other, so they never wait for the room in the rings
+   and don't hold the batches till the periodic flush */
+void preprocess_flush_dependent_batches(int consumer) {
+    buffer_flush(conf->preproc_ipc, conf->buff_preproc, consumer, ALLOC_PRIORITY_HIGH);
+}
+
+/* the values of a moved node coming to the old owner after it has drained */
+void preprocess_forward_metric(const metric_t *metric, int consumer) {
+    metric_t fwd_metric = *metric;
+
+    fwd_metric.flags |= METRIC_FLAG_ROUTE_FORWARDED;
+    DEBUG_ITEM(metric->itemid, "Forwarding metric to the item's preprocessing worker #%d", consumer + 1);
+    
+    buffer_add_metric(conf->buff_preproc[consumer], &fwd_metric);
 }
 
+/* one step history value of a moved item, the metric carries the value and it's timestamp */
+void preprocess_send_route_history(const metric_t *metric, int consumer, int step) {
+    metric_t hist_metric = *metric;
+
+    hist_metric.flags = METRIC_FLAG_ROUTE_HISTORY | (u_int64_t)step;
+    DEBUG_ITEM(metric->itemid, "Sending step %d preprocessing history to the worker #%d", step, consumer + 1);
+    
+    buffer_add_metric(conf->buff_preproc[consumer], &hist_metric);
+}
+
+/* the mark goes after the history and the values the old owner has sent to the new one, 
+   so the new owner gets them before it */
+void preprocess_send_route_drained(int consumer) {
+    metric_t mark = {.flags = METRIC_FLAG_ROUTE_DRAINED};
+
+    zbx_variant_set_none(&mark.value);
+    buffer_add_metric(conf->buff_preproc[consumer], &mark);
+    buffer_flush(conf->preproc_ipc, conf->buff_preproc, consumer, ALLOC_PRIORITY_HIGH);
+}
+
+/* processing stays partitioned by host: triggers of a host are calculated by one syncer */
 int processing_send_metric(const metric_t *metric) {
     int queue_num = metric->hostid % CONFIG_FORKS[ZBX_PROCESS_TYPE_HISTSYNCER];
     DEBUG_ITEM(metric->itemid, "Sending metric to processing");
@@ -244,6 +386,22 @@ int preproc_receive_metrics(int process_num, metric_preprocess_func_t proc_func,
     int i = ipc2_receive_one_chunk(conf->preproc_ipc, NULL, process_num - 1, metrics_chunk_process_cb, proc_func);
     return i;
 };
+int preproc_get_wakeup_fd(int process_num) {
+    return ipc2_get_wakeup_fd(conf->preproc_ipc, process_num - 1);
+}
+
+void preproc_ack_wakeup(int process_num) {
+    ipc2_ack_wakeup(conf->preproc_ipc, process_num - 1);
+}
+
+u_int64_t *preproc_get_barrier(int process_num) {
+    return ipc2_get_barrier(conf->preproc_ipc, process_num - 1);
+}
+
+int preproc_is_barrier_passed(int process_num, const u_int64_t *barrier) {
+    return ipc2_is_barrier_passed(conf->preproc_ipc, process_num - 1, barrier);
+}
+
 typedef struct {
     void *ctx_data;
     metric_process_func_t proc_func;
@@ -437,10 +595,12 @@ int processing_force_flush() {
 
 int preprocessing_force_flush() {
     buffers_force_flush(conf->preproc_ipc, conf->buff_preproc);
+    poll_results_force_flush();
 }
 
 int preprocessing_flush(int priority) {
     buffers_flush(conf->preproc_ipc, conf->buff_preproc, priority);
+    poll_results_flush();
 }
 
 int processing_flush() {
@@ -22,6 +22,26 @@
 int processing_send_metric(const metric_t *metric);
 int processing_flush();
 
+/* marks a metric carrying the master item value for a batch of it's dependent items,
+   the batch number is kept in the lower bits */
+#define METRIC_FLAG_DEPENDENT_BATCH	(__UINT64_C(1) << 63)
+#define METRIC_DEPENDENT_BATCH(flags)	((int)((flags) & 0xffffffff))
+
+void preprocess_send_dependent_batch(const metric_t *metric, int consumer, int batch);
+void preprocess_flush_dependent_batches(int consumer);
+
+/* the metrics the workers send to each other when the items are moved between them: 
+   the values forwarded by the old owner, the preprocessing history values with the step
+   index in the lower bits and the mark the old owner has sent all of them */
+#define METRIC_FLAG_ROUTE_FORWARDED	(__UINT64_C(1) << 62)
+#define METRIC_FLAG_ROUTE_HISTORY	(__UINT64_C(1) << 61)
+#define METRIC_FLAG_ROUTE_DRAINED	(__UINT64_C(1) << 60)
+#define METRIC_ROUTE_HISTORY_STEP(flags)	((int)((flags) & 0xffff))
+
+void preprocess_forward_metric(const metric_t *metric, int consumer);
+void preprocess_send_route_history(const metric_t *metric, int consumer, int step);
+void preprocess_send_route_drained(int consumer);
+
 int metrics_ipc_init();
 void preproc_ipc_destroy();
 
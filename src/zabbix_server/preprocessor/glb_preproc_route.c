@@ -0,0 +1,285 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+/* Routes metrics to the preprocessing workers. Items are hashed to the virtual nodes,
+   each node belongs to a worker, so all values of an item (and it's dependent items, which
+   are calculated by the master's worker) are processed by one worker in order. The dependent
+   items of the big masters are split to batches, each batch is routed by it's first item.
+   Workers account the time spent on each node's items, the first worker periodically moves
+   the busiest node fitting the gap from the most loaded worker to the least loaded one.
+   A move is done in three steps: the node is first marked as pending, so the new owner loads
+   the configuration of it's items, then the metrics are routed to the new owner, which holds
+   them till the old owner has processed the values sent to it before the move. The old owner
+   waits for the senders to flush their buffers, takes the barrier of it's queue and when it
+   has processed everything queued before the barrier, it sends the preprocessing history of
+   the node's items and the drained mark to the new owner, which then processes the held values.
+   The values coming to the old owner after that are forwarded to the new one.
+   Only the workers involved in the move reload their configuration */
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "glb_preproc_route.h"
+
+#include <stdatomic.h>
+
+#define PREPROC_ROUTE_VNODES_BITS	12
+
+/* a worker has to be busier than the average by this factor to move it's nodes */
+#define PREPROC_ROUTE_IMBALANCE		1.25
+/* microseconds per balance interval, smaller loads are not worth balancing */
+#define PREPROC_ROUTE_MIN_LOAD		100000
+/* seconds, the senders flush their buffers each second, so after that time the values of
+   the node sent before the move are in the old owner's queue */
+#define PREPROC_ROUTE_DRAIN_DELAY	2
+
+typedef struct {
+	int consumers;
+	_Atomic u_int64_t *revision; /* per worker, changes when the set of it's items changes */
+
+	int owner[PREPROC_ROUTE_VNODES];
+	int prev_owner[PREPROC_ROUTE_VNODES];
+	u_int64_t load[PREPROC_ROUTE_VNODES];
+
+	int pending_vnode;
+	int pending_consumer;
+	u_int64_t pending_revision;
+
+	int drain_vnode;
+	int drain_time;
+
+	u_int64_t *synced;
+} preproc_route_t;
+
+static preproc_route_t *route = NULL;
+
+/* process local, the time the worker spent on each node since the last publish */
+static u_int64_t *local_load = NULL;
+
+static int item_vnode(u_int64_t itemid) {
+	/* fibonacci hashing spreads the sequential itemids of a host over all the nodes */
+	return (int)((itemid * __UINT64_C(11400714819323198485)) >> (64 - PREPROC_ROUTE_VNODES_BITS));
+}
+
+int preproc_route_init(int consumers, mem_funcs_t *memf) {
+	int i;
+
+	if (NULL == (route = memf->malloc_func(NULL, sizeof(preproc_route_t))) ||
+			NULL == (route->synced = memf->malloc_func(NULL, sizeof(u_int64_t) * consumers)) ||
+			NULL == (route->revision = memf->malloc_func(NULL, sizeof(u_int64_t) * consumers)))
+		return FAIL;
+
+	route->consumers = consumers;
+	route->pending_vnode = -1;
+	route->pending_consumer = -1;
+	route->pending_revision = 0;
+	route->drain_vnode = -1;
+	route->drain_time = 0;
+
+	memset(route->synced, 0, sizeof(u_int64_t) * consumers);
+
+	for (i = 0; i < consumers; i++)
+		atomic_init(&route->revision[i], 0);
+	memset(route->load, 0, sizeof(route->load));
+
+	for (i = 0; i < PREPROC_ROUTE_VNODES; i++) {
+		route->owner[i] = i % consumers;
+		route->prev_owner[i] = -1;
+	}
+
+	return SUCCEED;
+}
+
+int preproc_route_get_consumers(void) {
+	return route->consumers;
+}
+
+int preproc_route_get_consumer(u_int64_t itemid) {
+	return route->owner[item_vnode(itemid)];
+}
+
+int preproc_route_get_vnode(u_int64_t itemid) {
+	return item_vnode(itemid);
+}
+
+/* config sync filter: the worker loads items routed to it, being moved to it and the ones
+   it has handed over as their values might still be in it's queue */
+int preproc_route_is_consumer_item(u_int64_t itemid, void *data) {
+	int consumer = *(int *)data, vnode = item_vnode(itemid);
+
+	if (consumer == route->owner[vnode] || consumer == route->prev_owner[vnode] ||
+			(vnode == route->pending_vnode && consumer == route->pending_consumer))
+		return SUCCEED;
+
+	return FAIL;
+}
+
+void preproc_route_account_item(u_int64_t itemid, u_int64_t usec) {
+	if (NULL == local_load)
+		local_load = zbx_calloc(NULL, PREPROC_ROUTE_VNODES, sizeof(u_int64_t));
+
+	local_load[item_vnode(itemid)] += usec;
+}
+
+/* the load is collected locally and copied to the shared table at once, so workers don't
+   write to the same cache lines on each metric */
+void preproc_route_publish_load(int consumer) {
+	int i;
+
+	if (NULL == local_load)
+		return;
+
+	for (i = 0; i < PREPROC_ROUTE_VNODES; i++) {
+		if (consumer == route->owner[i])
+			route->load[i] = local_load[i];
+	}
+
+	memset(local_load, 0, sizeof(u_int64_t) * PREPROC_ROUTE_VNODES);
+}
+
+u_int64_t preproc_route_get_revision(int consumer) {
+	return atomic_load(&route->revision[consumer]);
+}
+
+void preproc_route_set_synced(int consumer, u_int64_t revision) {
+	route->synced[consumer] = revision;
+}
+
+/* values of the node being drained are held by the new owner, except the ones forwarded by the old owner */
+int preproc_route_is_held_item(u_int64_t itemid, int consumer) {
+	int vnode = route->drain_vnode;
+
+	if (-1 == vnode || consumer != route->owner[vnode] || vnode != item_vnode(itemid))
+		return FAIL;
+
+	return SUCCEED;
+}
+
+/* the values of the moved items that came to the old owner after it has drained */
+int preproc_route_is_forwarded_item(u_int64_t itemid, int consumer) {
+	int vnode = item_vnode(itemid);
+
+	if (consumer == route->owner[vnode] || consumer == route->prev_owner[vnode])
+		return FAIL;
+
+	return SUCCEED;
+}
+
+/* returns the node the old owner has to drain when the senders have flushed the values sent to
+   it before the move, -1 otherwise */
+int preproc_route_get_drain_vnode(int consumer, int *new_owner) {
+	int vnode = route->drain_vnode;
+
+	if (-1 == vnode || consumer != route->prev_owner[vnode] || time(NULL) < route->drain_time + PREPROC_ROUTE_DRAIN_DELAY)
+		return -1;
+
+	*new_owner = route->owner[vnode];
+
+	return vnode;
+}
+
+/* the old owner has processed the values queued before the barrier and sent the drained mark,
+   it reloads the configuration without the node's items and forwards their values from now on */
+void preproc_route_drained(int consumer) {
+	int vnode = route->drain_vnode;
+
+	if (-1 == vnode || consumer != route->prev_owner[vnode])
+		return;
+
+	route->prev_owner[vnode] = -1;
+	atomic_fetch_add(&route->revision[consumer], 1);
+
+	LOG_DBG("Preprocessing: worker #%d has drained items node %d", consumer + 1, vnode);
+}
+
+/* returns SUCCEED to the new owner getting the drained mark, the caller has to process the held
+   values before the new ones */
+int preproc_route_finish_drain(int consumer) {
+	int vnode = route->drain_vnode;
+
+	if (-1 == vnode || consumer != route->owner[vnode])
+		return FAIL;
+
+	route->drain_vnode = -1;
+
+	return SUCCEED;
+}
+
+static void route_commit_pending(void) {
+	int vnode = route->pending_vnode;
+
+	LOG_INF("Preprocessing: moving items node %d with load %ld usec from worker #%d to worker #%d",
+			vnode, route->load[vnode], route->owner[vnode] + 1, route->pending_consumer + 1);
+
+	route->prev_owner[vnode] = route->owner[vnode];
+	route->drain_time = time(NULL);
+	route->drain_vnode = vnode;
+	route->owner[vnode] = route->pending_consumer;
+	route->pending_vnode = -1;
+}
+
+void preproc_route_rebalance(void) {
+	u_int64_t *loads, total = 0;
+	int i, max = 0, min = 0, vnode = -1;
+
+	if (1 == route->consumers || -1 != route->drain_vnode)
+		return;
+
+	if (-1 != route->pending_vnode) {
+		if (route->synced[route->pending_consumer] >= route->pending_revision)
+			route_commit_pending();
+
+		return;
+	}
+
+	loads = zbx_calloc(NULL, route->consumers, sizeof(u_int64_t));
+
+	for (i = 0; i < PREPROC_ROUTE_VNODES; i++) {
+		loads[route->owner[i]] += route->load[i];
+		total += route->load[i];
+	}
+
+	for (i = 1; i < route->consumers; i++) {
+		if (loads[i] > loads[max])
+			max = i;
+
+		if (loads[i] < loads[min])
+			min = i;
+	}
+
+	if (PREPROC_ROUTE_MIN_LOAD > loads[max] ||
+			(double)loads[max] * route->consumers < (double)total * PREPROC_ROUTE_IMBALANCE)
+		goto out;
+
+	/* the busiest node which doesn't make the target worker busier than the source was */
+	for (i = 0; i < PREPROC_ROUTE_VNODES; i++) {
+		if (max != route->owner[i] || 0 == route->load[i] || loads[min] + route->load[i] >= loads[max])
+			continue;
+
+		if (-1 == vnode || route->load[i] > route->load[vnode])
+			vnode = i;
+	}
+
+	if (-1 == vnode)
+		goto out;
+
+	route->pending_consumer = min;
+	route->pending_vnode = vnode;
+	route->pending_revision = atomic_fetch_add(&route->revision[min], 1) + 1;
+out:
+	zbx_free(loads);
+}
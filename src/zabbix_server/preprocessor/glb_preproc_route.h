@@ -0,0 +1,49 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef GLB_PREPROC_ROUTE_H
+#define GLB_PREPROC_ROUTE_H
+
+#include "zbxcommon.h"
+#include "zbxalgo.h"
+
+/* items are hashed to the virtual nodes, each node is owned by one preprocessing worker */
+#define PREPROC_ROUTE_VNODES	4096
+
+int	preproc_route_init(int consumers, mem_funcs_t *memf);
+
+int	preproc_route_get_consumers(void);
+int	preproc_route_get_consumer(u_int64_t itemid);
+int	preproc_route_get_vnode(u_int64_t itemid);
+int	preproc_route_is_consumer_item(u_int64_t itemid, void *consumer);
+
+void	preproc_route_account_item(u_int64_t itemid, u_int64_t usec);
+void	preproc_route_publish_load(int consumer);
+
+u_int64_t	preproc_route_get_revision(int consumer);
+void	preproc_route_set_synced(int consumer, u_int64_t revision);
+
+int	preproc_route_is_held_item(u_int64_t itemid, int consumer);
+int	preproc_route_is_forwarded_item(u_int64_t itemid, int consumer);
+int	preproc_route_get_drain_vnode(int consumer, int *new_owner);
+void	preproc_route_drained(int consumer);
+int	preproc_route_finish_drain(int consumer);
+
+void	preproc_route_rebalance(void);
+
+#endif
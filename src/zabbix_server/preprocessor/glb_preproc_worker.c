@@ -24,6 +24,7 @@
 #include "metric.h"
 #include "glb_preproc_ipc.h"
 #include "glb_preproc.h"
+#include "glb_preproc_route.h"
 #include "zbxpreproc.h"
 #include "zbxcacheconfig.h"
 #include "../../libs/zbxpreproc/pp_history.h"
@@ -39,6 +40,11 @@ extern unsigned char program_type;
 #define PREPROC_CONFIG_SYNC_INTERVAL 1
 #define PROCTITLE_UPDATE_INTERVAL 5 
 #define FLUSH_INTERVAL  1
+#define PREPROC_ROUTE_INTERVAL 10
+
+/* dependent items of big masters are calculated in batches by all the workers */
+#define PREPROC_DEP_BATCH_SIZE 256
+#define PREPROC_DEP_FANOUT_MIN (2 * PREPROC_DEP_BATCH_SIZE)
 
 
 /* c-paste of zbx preprocessing manager data */
@@ -50,17 +56,24 @@ typedef struct
     unsigned char process_type;
     int server_num;
     int  process_num;
+    int  consumer;
+    u_int64_t route_revision;
     int total_proc; 
     zbx_pp_context_t ctx;
     poller_event_t *new_config_check;
     poller_event_t *proctitle_update;
     poller_event_t *periodic_flush;
     poller_event_t *processing;
+    poller_event_t *wakeup;
+    poller_event_t *route_update;
+    zbx_vector_ptr_t held_metrics; /* values of the node moved to the worker till the old owner drains */
+    u_int64_t *drain_barrier; /* the queue positions to pass before the node moved out is drained */
 } glb_preproc_worker_conf_t;
 
 static glb_preproc_worker_conf_t conf = {0};
 
 static void process_dependent_metrics(metric_t *metric, zbx_pp_item_preproc_t *preproc, int max_dep);
+static void hold_metric(const metric_t *metric);
 
 zbx_pp_item_t *get_prperoc_item(u_int64_t itemid) {
     return zbx_hashset_search(&conf.items, &itemid);
@@ -109,6 +122,8 @@ static void preprocess_metric_execute_steps(const metric_t *metric, zbx_pp_cache
 
 	DEBUG_ITEM(metric->itemid, "Runing preprocessing for item, %d steps",   preproc_conf->preproc->steps_num);
 
+	/* compiled step parameters stay with the item until its steps are changed by config sync */
+	zbx_pp_item_preproc_cache_steps(preproc_conf->preproc);
 	pp_execute(&conf.ctx, preproc_conf->preproc, cache, metric, &value_out, NULL, NULL);
 
     DEBUG_ITEM(metric->itemid, "Result of preprocessing of in: '%s', result is '%s'",
@@ -121,10 +136,87 @@ static void preprocess_metric_execute_steps(const metric_t *metric, zbx_pp_cache
  	zbx_variant_clear(&value_out);
 }
 
-static void process_dependent_metrics(metric_t * metric, zbx_pp_item_preproc_t *preproc_conf, int level) {
+/* the master value is parsed once per cache, not per each dependent item */
+static void process_dependent_range(const metric_t * metric, zbx_pp_item_preproc_t *preproc_conf, 
+        zbx_pp_cache_t *cache, int from, int to, int level) {
     metric_t dep_metric = *metric;
-    zbx_pp_cache_t*		cache;
 	int i;
+
+    for (i = from; i < to; i++ ) {
+        DEBUG_ITEM(metric->itemid, "Processing dependat metric %ld", preproc_conf->dep_itemids[i]);
+		dep_metric.itemid = preproc_conf->dep_itemids[i];
+        preprocess_metric_execute_steps(&dep_metric, cache, level);
+        DEBUG_ITEM(metric->itemid, "Finished processing dependat metric %ld", preproc_conf->dep_itemids[i]);
+	}
+}
+
+static int dependent_batches_num(const zbx_pp_item_preproc_t *preproc_conf) {
+    return (preproc_conf->dep_itemids_num + PREPROC_DEP_BATCH_SIZE - 1) / PREPROC_DEP_BATCH_SIZE;
+}
+
+/* the batch is routed by it's first item, the key doesn't change when the master is moved */
+static u_int64_t dependent_batch_key(const zbx_pp_item_preproc_t *preproc_conf, int batch) {
+    return preproc_conf->dep_itemids[batch * PREPROC_DEP_BATCH_SIZE];
+}
+
+static void process_dependent_batch(const metric_t * metric, zbx_pp_item_preproc_t *preproc_conf, 
+        zbx_pp_cache_t *cache, int batch, int level) {
+    int from = batch * PREPROC_DEP_BATCH_SIZE;
+
+    process_dependent_range(metric, preproc_conf, cache, from, 
+        MIN(from + PREPROC_DEP_BATCH_SIZE, preproc_conf->dep_itemids_num), level);
+}
+
+/* batches are sent to the other workers first, so they run in parallel with the local ones, 
+   the worker gets a copy of the master value per batch, but parses it once for the batches
+   coming one after another */
+static void fanout_dependent_metrics(metric_t * metric, zbx_pp_item_preproc_t *preproc_conf, int level) {
+    int i, consumer, batches = dependent_batches_num(preproc_conf);
+    unsigned char *sent = zbx_calloc(NULL, preproc_route_get_consumers(), sizeof(unsigned char));
+    zbx_pp_cache_t *cache = NULL;
+
+    DEBUG_ITEM(metric->itemid, "Spreading %d dependent items in %d batches", preproc_conf->dep_itemids_num, batches);
+
+    for (i = 0; i < batches; i++) {
+        if (conf.consumer == (consumer = preproc_route_get_consumer(dependent_batch_key(preproc_conf, i))))
+            continue;
+
+        preprocess_send_dependent_batch(metric, consumer, i);
+        sent[consumer] = 1;
+    }
+
+    for (i = 0; i < preproc_route_get_consumers(); i++) {
+        if (0 != sent[i])
+            preprocess_flush_dependent_batches(i);
+    }
+
+    zbx_free(sent);
+
+    for (i = 0; i < batches; i++) {
+        metric_t batch_metric = *metric;
+        u_int64_t batch_key = dependent_batch_key(preproc_conf, i);
+
+        if (conf.consumer != preproc_route_get_consumer(batch_key))
+            continue;
+
+        /* the batch's node is being moved to the worker */
+        if (SUCCEED == preproc_route_is_held_item(batch_key, conf.consumer)) {
+            batch_metric.flags = METRIC_FLAG_DEPENDENT_BATCH | (u_int64_t)i;
+            hold_metric(&batch_metric);
+            continue;
+        }
+
+        if (NULL == cache)
+            cache = pp_cache_create(preproc_conf, &metric->value);
+
+        process_dependent_batch(metric, preproc_conf, cache, i, level);
+    }
+
+    pp_cache_release(cache);
+}
+
+static void process_dependent_metrics(metric_t * metric, zbx_pp_item_preproc_t *preproc_conf, int level) {
+    zbx_pp_cache_t *cache;
 	
 	if (level < 0) //recursion protection
 		return;
@@ -134,28 +226,293 @@ static void process_dependent_metrics(metric_t * metric, zbx_pp_item_preproc_t *
     
     DEBUG_ITEM(metric->itemid, "Processing dependat metrics");
 
-    
+    /* only the top level masters are spread, deeper levels are calculated within the batch */
+    if (MAX_DEPENDENCY_LEVEL - 1 == level && PREPROC_DEP_FANOUT_MIN <= preproc_conf->dep_itemids_num &&
+        1 < preproc_route_get_consumers()) {
+        fanout_dependent_metrics(metric, preproc_conf, level);
+        return;
+    }
 
     cache = pp_cache_create(preproc_conf, &metric->value);
-	
-    for (i = 0; i < preproc_conf->dep_itemids_num; i++ ) {
-        DEBUG_ITEM(metric->itemid, "Processing dependat metric %ld", preproc_conf->dep_itemids[i]);
-		dep_metric.itemid = preproc_conf->dep_itemids[i];
-        preprocess_metric_execute_steps(&dep_metric, cache, level);
-        DEBUG_ITEM(metric->itemid, "Finished processing dependat metric %ld", preproc_conf->dep_itemids[i]);
-	}
-
+    process_dependent_range(metric, preproc_conf, cache, 0, preproc_conf->dep_itemids_num, level);
     pp_cache_release(cache);
 }
 
+/* the master value parsed for the last incoming batch, the batches of a master value
+   come one after another, the cache is released when the worker's queue is processed */
+static struct {
+    u_int64_t itemid;
+    zbx_timespec_t ts;
+    zbx_pp_cache_t *cache;
+} batch_cache = {0};
+
+static void release_batch_cache(void) {
+    pp_cache_release(batch_cache.cache);
+    batch_cache.cache = NULL;
+}
+
+static zbx_pp_cache_t *get_batch_cache(const metric_t *metric, zbx_pp_item_preproc_t *preproc_conf) {
+
+    if (NULL != batch_cache.cache && metric->itemid == batch_cache.itemid && 
+            0 == zbx_timespec_compare(&metric->ts, &batch_cache.ts))
+        return batch_cache.cache;
+
+    release_batch_cache();
+
+    batch_cache.itemid = metric->itemid;
+    batch_cache.ts = metric->ts;
+    batch_cache.cache = pp_cache_create(preproc_conf, &metric->value);
+
+    return batch_cache.cache;
+}
+
+/* the batches arrive with the already preprocessed master value */
+static void process_incoming_batch(const metric_t *metric) {
+    zbx_pp_item_t *preproc_conf;
+    int batch = METRIC_DEPENDENT_BATCH(metric->flags);
+
+    if (NULL == (preproc_conf = get_prperoc_item(metric->itemid))) {
+        DEBUG_ITEM(metric->itemid, "No preprocessing conf found for the dependent items batch master, skipping");
+        return;
+    }
+
+    if (batch >= dependent_batches_num(preproc_conf->preproc)) {
+        DEBUG_ITEM(metric->itemid, "The master has less dependent items than the batch %d needs, skipping", batch);
+        return;
+    }
+
+    process_dependent_batch(metric, preproc_conf->preproc, get_batch_cache(metric, preproc_conf->preproc),
+        batch, MAX_DEPENDENCY_LEVEL - 1);
+}
+
+/* the batches follow their first item's node as the other metrics do */
+static void route_incoming_batch(const metric_t *metric) {
+    zbx_pp_item_t *preproc_conf;
+    u_int64_t batch_key;
+    int batch = METRIC_DEPENDENT_BATCH(metric->flags);
+
+    if (NULL == (preproc_conf = get_prperoc_item(metric->itemid)) || 
+            batch >= dependent_batches_num(preproc_conf->preproc)) {
+        process_incoming_batch(metric);
+        return;
+    }
+
+    batch_key = dependent_batch_key(preproc_conf->preproc, batch);
+
+    if (SUCCEED == preproc_route_is_forwarded_item(batch_key, conf.consumer)) {
+        preprocess_forward_metric(metric, preproc_route_get_consumer(batch_key));
+        return;
+    }
+
+    if (0 == (metric->flags & METRIC_FLAG_ROUTE_FORWARDED) &&
+            SUCCEED == preproc_route_is_held_item(batch_key, conf.consumer)) {
+        hold_metric(metric);
+        return;
+    }
+
+    process_incoming_batch(metric);
+}
+
+static void process_metric(const metric_t *metric) {
+    double start = zbx_time();
 
-void metrics_proc_cb(const metric_t *metric) {
     preprocess_metric_execute_steps(metric, NULL, MAX_DEPENDENCY_LEVEL);
+    /* dependent items are accounted to the master as they move together */
+    preproc_route_account_item(metric->itemid, (zbx_time() - start) * 1000000 + 1);
+}
+
+static void hold_metric(const metric_t *metric) {
+    metric_t *held = zbx_malloc(NULL, sizeof(metric_t));
+
+    DEBUG_ITEM(metric->itemid, "Item's node is being drained by the previous worker, holding the metric");
+    
+    *held = *metric;
+    zbx_variant_copy(&held->value, &metric->value);
+    zbx_vector_ptr_append(&conf.held_metrics, held);
+}
+
+static void process_held_metrics(glb_preproc_worker_conf_t *conf) {
+    int i;
+
+    LOG_DBG("Processing %d metrics held during the items node move", conf->held_metrics.values_num);
+
+    for (i = 0; i < conf->held_metrics.values_num; i++) {
+        metric_t *metric = conf->held_metrics.values[i];
+        
+        if (0 != (metric->flags & METRIC_FLAG_DEPENDENT_BATCH))
+            process_incoming_batch(metric);
+        else
+            process_metric(metric);
+        zbx_variant_clear(&metric->value);
+        zbx_free(metric);
+    }
+
+    zbx_vector_ptr_clear(&conf->held_metrics);
+}
+
+/* the history of the moved item's steps comes before the drained mark, so it's restored before
+   the held values are processed */
+static void restore_route_history(const metric_t *metric) {
+    zbx_pp_item_t *preproc_conf;
+    zbx_variant_t value;
+    zbx_timespec_t ts;
+    int step = METRIC_ROUTE_HISTORY_STEP(metric->flags);
+
+    if (NULL == (preproc_conf = get_prperoc_item(metric->itemid))) {
+        DEBUG_ITEM(metric->itemid, "No preprocessing conf found for the moved item, skipping it's history");
+        return;
+    }
+
+    DEBUG_ITEM(metric->itemid, "Restoring step %d preprocessing history of the moved item", step);
+
+    if (NULL == preproc_conf->preproc->history)
+        preproc_conf->preproc->history = zbx_pp_history_create(preproc_conf->preproc->history_num);
+
+    /* the old owner's value replaces the one the worker might have from the item's previous stay */
+    pp_history_pop(preproc_conf->preproc->history, step, &value, &ts);
+    zbx_variant_clear(&value);
+
+    zbx_variant_copy(&value, &metric->value);
+    zbx_pp_history_add(preproc_conf->preproc->history, step, &value, metric->ts);
+}
+
+static void send_item_route_history(const zbx_pp_item_preproc_t *preproc, u_int64_t itemid, u_int64_t hostid,
+        int consumer) {
+    int i;
+
+    if (NULL == preproc->history)
+        return;
+
+    for (i = 0; i < preproc->history->step_history.values_num; i++) {
+        const zbx_pp_step_history_t *step_history = &preproc->history->step_history.values[i];
+        metric_t metric = {.itemid = itemid, .hostid = hostid, .ts = step_history->ts, .value = step_history->value};
+
+        /* the compiled scripts are kept as the history, they are compiled again by the new owner */
+        if (ZBX_VARIANT_STR != step_history->value.type && ZBX_VARIANT_DBL != step_history->value.type &&
+                ZBX_VARIANT_UI64 != step_history->value.type)
+            continue;
+
+        preprocess_send_route_history(&metric, consumer, step_history->index);
+    }
+}
+
+/* dependent items move with their master, except the dependent items of big masters which
+   are processed by all the workers in batches */
+static void send_route_history_rec(const zbx_pp_item_t *item, int consumer, int level) {
+    int i;
+    zbx_pp_item_t *dep_item;
+
+    if (level < 0)
+        return;
+
+    send_item_route_history(item->preproc, item->itemid, item->hostid, consumer);
+
+    if (PREPROC_DEP_FANOUT_MIN <= item->preproc->dep_itemids_num)
+        return;
+
+    for (i = 0; i < item->preproc->dep_itemids_num; i++) {
+        if (NULL != (dep_item = get_prperoc_item(item->preproc->dep_itemids[i])))
+            send_route_history_rec(dep_item, consumer, level - 1);
+    }
+}
+
+/* the batches of the big masters move with their first item's node */
+static void send_batches_route_history(const zbx_pp_item_t *item, int vnode, int consumer) {
+    int i, j;
+    zbx_pp_item_t *dep_item;
+
+    for (i = 0; i < dependent_batches_num(item->preproc); i++) {
+        if (vnode != preproc_route_get_vnode(dependent_batch_key(item->preproc, i)))
+            continue;
+
+        for (j = i * PREPROC_DEP_BATCH_SIZE; j < MIN((i + 1) * PREPROC_DEP_BATCH_SIZE, 
+                item->preproc->dep_itemids_num); j++) {
+            if (NULL != (dep_item = get_prperoc_item(item->preproc->dep_itemids[j])))
+                send_route_history_rec(dep_item, consumer, MAX_DEPENDENCY_LEVEL - 1);
+        }
+    }
+}
+
+static void send_route_history(glb_preproc_worker_conf_t *conf, int vnode, int consumer) {
+    zbx_hashset_iter_t iter;
+    zbx_pp_item_t *item;
+
+    zbx_hashset_iter_reset(&conf->items, &iter);
+
+    while (NULL != (item = zbx_hashset_iter_next(&iter))) {
+        if (ITEM_TYPE_DEPENDENT == item->preproc->type)
+            continue;
+
+        if (PREPROC_DEP_FANOUT_MIN <= item->preproc->dep_itemids_num)
+            send_batches_route_history(item, vnode, consumer);
+
+        if (vnode == preproc_route_get_vnode(item->itemid))
+            send_route_history_rec(item, consumer, MAX_DEPENDENCY_LEVEL);
+    }
+}
+
+void metrics_proc_cb(const metric_t *metric) {
+
+    if (0 != (metric->flags & METRIC_FLAG_ROUTE_HISTORY)) {
+        restore_route_history(metric);
+        return;
+    }
+
+    if (0 != (metric->flags & METRIC_FLAG_ROUTE_DRAINED)) {
+        if (SUCCEED == preproc_route_finish_drain(conf.consumer))
+            process_held_metrics(&conf);
+        return;
+    }
+
+    if (0 != (metric->flags & METRIC_FLAG_DEPENDENT_BATCH)) {
+        route_incoming_batch(metric);
+        return;
+    }
+
+    /* the producers which have sent the value before they've seen the move */
+    if (SUCCEED == preproc_route_is_forwarded_item(metric->itemid, conf.consumer)) {
+        preprocess_forward_metric(metric, preproc_route_get_consumer(metric->itemid));
+        return;
+    }
+
+    if (0 == (metric->flags & METRIC_FLAG_ROUTE_FORWARDED) &&
+            SUCCEED == preproc_route_is_held_item(metric->itemid, conf.consumer)) {
+        hold_metric(metric);
+        return;
+    }
+
+    process_metric(metric);
+}
+
+/* any worker might get a batch of a big master, so all of them keep such masters */
+static int preprocessing_item_filter(u_int64_t itemid, int dep_items_num, void *data) {
+  if (PREPROC_DEP_FANOUT_MIN <= dep_items_num)
+    return SUCCEED;
+
+  return preproc_route_is_consumer_item(itemid, data);
 }
 
 void preprocessing_sync_conf(poller_item_t *poller_item, void *data) {
   glb_preproc_worker_conf_t *conf = data;
-  DCconfig_get_preprocessable_items(&conf->items, &conf->cfg_revision, conf->process_num );
+  u_int64_t route_revision = preproc_route_get_revision(conf->consumer);
+
+  /* items has been moved between the workers, the set of items changed regardless of the config */
+  if (route_revision != conf->route_revision) 
+    conf->cfg_revision = 0;
+
+  DCconfig_get_preprocessable_items(&conf->items, &conf->cfg_revision, preprocessing_item_filter, &conf->consumer);
+  
+  conf->route_revision = route_revision;
+  preproc_route_set_synced(conf->consumer, route_revision);
+}
+
+static void route_update(poller_item_t *poller_item, void *data) {
+  glb_preproc_worker_conf_t *conf = data;
+
+  preproc_route_publish_load(conf->consumer);
+
+  if (0 == conf->consumer)
+    preproc_route_rebalance();
 }
 
 void proctitle_update(poller_item_t *poller_item, void *data) {
@@ -168,28 +525,80 @@ void proctitle_update(poller_item_t *poller_item, void *data) {
 
 #define BATCH_PROCESS_METRICS 32768
 
-void process_incoming_metrics(poller_item_t *poller_item, void *data) {
-    glb_preproc_worker_conf_t *conf = data;
+/* the old owner of a moved node takes the positions of it's queue and the producers' rings when
+   the producers have flushed the values sent before the move, when it has processed everything
+   up to them, it sends the node's history and the drained mark to the new owner, the values
+   coming after that are forwarded */
+static void route_check_drain(glb_preproc_worker_conf_t *conf) {
+    int vnode, new_owner;
+
+    if (-1 == (vnode = preproc_route_get_drain_vnode(conf->consumer, &new_owner)))
+        return;
+
+    if (NULL == conf->drain_barrier) {
+        conf->drain_barrier = preproc_get_barrier(conf->process_num);
+        return;
+    }
+
+    if (SUCCEED != preproc_is_barrier_passed(conf->process_num, conf->drain_barrier))
+        return;
+
+    zbx_free(conf->drain_barrier);
+
+    LOG_DBG("Node %d is drained, sending it's history to the worker #%d", vnode, new_owner + 1);
+
+    send_route_history(conf, vnode, new_owner);
+    preprocess_send_route_drained(new_owner);
+    preproc_route_drained(conf->consumer);
+}
+
+static void receive_incoming_metrics(glb_preproc_worker_conf_t *conf) {
     int cnt;
     
     while (0 != (cnt = preproc_receive_metrics(conf->process_num, metrics_proc_cb, NULL, BATCH_PROCESS_METRICS))) 
         conf->total_proc += cnt;
+
+    release_batch_cache();
+
+    route_check_drain(conf);
+}
+
+void process_incoming_metrics(poller_item_t *poller_item, void *data) {
+    glb_preproc_worker_conf_t *conf = data;
     
+    receive_incoming_metrics(conf);
     poller_run_timer_event(conf->processing, 1);
 }
 
+/* the queue is drained till it's empty, so the next metric sent will signal again */
+static void wakeup_incoming_metrics(poller_item_t *poller_item, void *data) {
+    glb_preproc_worker_conf_t *conf = data;
+
+    preproc_ack_wakeup(conf->process_num);
+    receive_incoming_metrics(conf);
+}
+
 void ipc_flush(poller_item_t *poller_item, void *data) {
+    glb_preproc_worker_conf_t *conf = data;
+
+    /* workers waiting for the wakeups don't receive while their queue is empty */
+    if (NULL == conf->processing)
+        receive_incoming_metrics(conf);
+
     preprocessing_flush();
     processing_flush();
 }
 
 void preprocessing_worker_init(zbx_thread_args_t *args, glb_preproc_worker_conf_t *conf) {
+  int wakeup_fd;
   
  	conf->process_type = args->info.process_type;
 	conf->server_num = args->info.server_num;
 	conf->process_num = args->info.process_num;
+	conf->consumer = args->info.process_num - 1;
     
     bzero(&conf->ctx, sizeof(conf->ctx));
+    zbx_vector_ptr_create(&conf->held_metrics);
   
  	zbx_hashset_create_ext(&conf->items, 0, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC,
 			(zbx_clean_func_t)pp_item_clear,
@@ -224,8 +633,17 @@ void preprocessing_worker_init(zbx_thread_args_t *args, glb_preproc_worker_conf_
   conf->periodic_flush = poller_create_event(NULL, ipc_flush , 0, conf, 1);
   poller_run_timer_event(conf->periodic_flush, FLUSH_INTERVAL * 1000 );
 
-  conf->processing = poller_create_event(NULL, process_incoming_metrics , 0, conf, 0);
-  poller_run_timer_event(conf->processing, 1 );
+  conf->route_update = poller_create_event(NULL, route_update , 0, conf, 1);
+  poller_run_timer_event(conf->route_update, PREPROC_ROUTE_INTERVAL * 1000 );
+
+  if (-1 != (wakeup_fd = preproc_get_wakeup_fd(conf->process_num))) {
+    conf->wakeup = poller_create_event(NULL, wakeup_incoming_metrics, wakeup_fd, conf, 1);
+    poller_lower_event_priority(conf->wakeup);
+    poller_run_fd_event(conf->wakeup);
+  } else {
+    conf->processing = poller_create_event(NULL, process_incoming_metrics , 0, conf, 0);
+    poller_run_timer_event(conf->processing, 1 );
+  }
 
 }
 
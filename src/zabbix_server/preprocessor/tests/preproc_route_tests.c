@@ -0,0 +1,214 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "../glb_preproc_route.h"
+
+#define TEST_CONSUMERS	4
+#define TEST_ITEMS	100000
+
+static int count_consumers(u_int64_t itemid) {
+	int i, count = 0;
+
+	for (i = 0; i < TEST_CONSUMERS; i++) {
+		if (SUCCEED == preproc_route_is_consumer_item(itemid, &i))
+			count++;
+	}
+
+	return count;
+}
+
+static void test_route_distribution(void) {
+	int i, items[TEST_CONSUMERS] = {0};
+	u_int64_t itemid;
+
+	LOG_INF("Testing items distribution");
+
+	for (itemid = 1; itemid <= TEST_ITEMS; itemid++) {
+		int consumer = preproc_route_get_consumer(itemid);
+
+		assert(consumer >= 0 && consumer < TEST_CONSUMERS);
+		assert(SUCCEED == preproc_route_is_consumer_item(itemid, &consumer));
+		assert(1 == count_consumers(itemid));
+		items[consumer]++;
+	}
+
+	/* sequential itemids must not stick to one worker */
+	for (i = 0; i < TEST_CONSUMERS; i++)
+		assert(items[i] > TEST_ITEMS / TEST_CONSUMERS / 2);
+}
+
+#define TEST_BATCH_SIZE	256
+#define TEST_BATCHES	64
+
+static void test_route_batches(void) {
+	int i, used[TEST_CONSUMERS] = {0};
+	u_int64_t first_itemid = 12345;
+
+	LOG_INF("Testing dependent items batches spreading");
+
+	assert(TEST_CONSUMERS == preproc_route_get_consumers());
+
+	/* batches are routed by their first item, the sequential dependent items go to all the workers */
+	for (i = 0; i < TEST_BATCHES; i++)
+		used[preproc_route_get_consumer(first_itemid + i * TEST_BATCH_SIZE)]++;
+
+	for (i = 0; i < TEST_CONSUMERS; i++)
+		assert(0 < used[i]);
+}
+
+static void test_route_rebalance(void) {
+	u_int64_t hot_itemid = 0, itemid;
+	int i, old_consumer = 0, new_consumer = -1, batch_consumers[TEST_BATCHES];
+
+	LOG_INF("Testing rebalance");
+
+	/* idle workers are never balanced */
+	preproc_route_rebalance();
+	
+	for (i = 0; i < TEST_CONSUMERS; i++)
+		assert(0 == preproc_route_get_revision(i));
+
+	for (itemid = 1; itemid <= TEST_ITEMS; itemid++) {
+		if (old_consumer != preproc_route_get_consumer(itemid))
+			continue;
+
+		if (0 == hot_itemid)
+			hot_itemid = itemid;
+
+		preproc_route_account_item(itemid, 1);
+	}
+
+	preproc_route_account_item(hot_itemid, 10000000);
+	preproc_route_publish_load(old_consumer);
+
+	for (i = 0; i < TEST_BATCHES; i++)
+		batch_consumers[i] = preproc_route_get_consumer(hot_itemid + 1 + i * TEST_BATCH_SIZE);
+
+	preproc_route_rebalance();
+
+	/* only the target worker reloads the config */
+	for (i = 0; i < TEST_CONSUMERS; i++) {
+		if (0 == preproc_route_get_revision(i))
+			continue;
+
+		assert(-1 == new_consumer && 1 == preproc_route_get_revision(i));
+		new_consumer = i;
+	}
+
+	assert(-1 != new_consumer && old_consumer != new_consumer);
+
+	/* the node is pending, metrics still go to the old worker, the new one loads the config */
+	assert(old_consumer == preproc_route_get_consumer(hot_itemid));
+	assert(2 == count_consumers(hot_itemid));
+
+	/* the move waits for the target worker config sync */
+	preproc_route_rebalance();
+	assert(old_consumer == preproc_route_get_consumer(hot_itemid));
+
+	preproc_route_set_synced(new_consumer, 1);
+	preproc_route_rebalance();
+	
+	assert(new_consumer == preproc_route_get_consumer(hot_itemid));
+	assert(SUCCEED == preproc_route_is_consumer_item(hot_itemid, &new_consumer));
+	/* the batches of the moved master's dependent items stay where they were */
+	for (i = 0; i < TEST_BATCHES; i++) {
+		itemid = hot_itemid + 1 + i * TEST_BATCH_SIZE;
+
+		if (preproc_route_get_vnode(itemid) != preproc_route_get_vnode(hot_itemid))
+			assert(batch_consumers[i] == preproc_route_get_consumer(itemid));
+	}
+
+	/* the old worker keeps the config for the values already queued to it */
+	assert(SUCCEED == preproc_route_is_consumer_item(hot_itemid, &old_consumer));
+
+	/* the new owner holds the node's values till the old one drains */
+	assert(SUCCEED == preproc_route_is_held_item(hot_itemid, new_consumer));
+	assert(FAIL == preproc_route_is_held_item(hot_itemid, old_consumer));
+	assert(FAIL == preproc_route_is_held_item(hot_itemid + 1, new_consumer));
+
+	/* the senders might still have the values for the old owner in their buffers */
+	assert(-1 == preproc_route_get_drain_vnode(old_consumer, &i));
+	assert(FAIL == preproc_route_finish_drain(old_consumer));
+
+	/* both workers process the node's values, the others forward them to the owner */
+	assert(FAIL == preproc_route_is_forwarded_item(hot_itemid, old_consumer));
+	assert(FAIL == preproc_route_is_forwarded_item(hot_itemid, new_consumer));
+
+	for (i = 0; i < TEST_CONSUMERS; i++) {
+		if (i != old_consumer && i != new_consumer)
+			assert(SUCCEED == preproc_route_is_forwarded_item(hot_itemid, i));
+	}
+
+	/* nothing is moved till the drain is finished */
+	preproc_route_publish_load(old_consumer);
+	preproc_route_rebalance();
+	
+	for (i = 0; i < TEST_CONSUMERS; i++)
+		assert((i == new_consumer ? 1 : 0) == preproc_route_get_revision(i));
+
+	sleep(3);
+
+	/* only the old owner drains the node */
+	assert(-1 == preproc_route_get_drain_vnode(new_consumer, &i));
+	assert(preproc_route_get_vnode(hot_itemid) == preproc_route_get_drain_vnode(old_consumer, &i));
+	assert(new_consumer == i);
+
+	/* the drained mark isn't sent yet */
+	assert(FAIL == preproc_route_finish_drain(old_consumer));
+
+	preproc_route_drained(new_consumer);
+	assert(0 == preproc_route_get_revision(old_consumer));
+
+	preproc_route_drained(old_consumer);
+	assert(-1 == preproc_route_get_drain_vnode(old_consumer, &i));
+
+	/* the old worker drops the node's items and forwards the late values */
+	assert(1 == count_consumers(hot_itemid));
+	assert(1 == preproc_route_get_revision(old_consumer));
+	assert(SUCCEED == preproc_route_is_forwarded_item(hot_itemid, old_consumer));
+
+	/* the new one holds the values till it gets the drained mark */
+	assert(SUCCEED == preproc_route_is_held_item(hot_itemid, new_consumer));
+	assert(SUCCEED == preproc_route_finish_drain(new_consumer));
+	assert(FAIL == preproc_route_finish_drain(new_consumer));
+
+	assert(FAIL == preproc_route_is_held_item(hot_itemid, new_consumer));
+	assert(1 == preproc_route_get_revision(new_consumer));
+}
+
+void preproc_route_run_tests(void) {
+	mem_funcs_t memf = { .malloc_func = zbx_default_mem_malloc_func,
+			.free_func = zbx_default_mem_free_func, .realloc_func = zbx_default_mem_realloc_func};
+
+	LOG_INF("Starting preprocessing route tests");
+
+	assert(SUCCEED == preproc_route_init(TEST_CONSUMERS, &memf));
+
+	test_route_distribution();
+	test_route_batches();
+	test_route_rebalance();
+
+	LOG_INF("Finished preprocessing route tests");
+}
+
+#endif
@@ -168,6 +168,12 @@ static int	get_data_from_proxy(DC_PROXY *proxy, const char *request, int config_
 
 	zbx_json_addstring(&j, "request", request, ZBX_JSON_TYPE_STRING);
 
+	if (0 == strcmp(request, ZBX_PROTO_VALUE_PROXY_DATA))
+	{
+		zbx_json_addstring(&j, ZBX_PROTO_TAG_HISTORY_FORMAT, ZBX_PROTO_VALUE_HISTORY_FORMAT_BINARY,
+				ZBX_JSON_TYPE_STRING);
+	}
+
 	if (0 != proxy->auto_compress)
 	{
 		if (SUCCEED != zbx_compress(j.buffer, j.buffer_size, &buffer, &buffer_size))
@@ -38,6 +38,7 @@
 
 #include "alerter/alerter.h"
 #include "dbsyncer/dbsyncer.h"
+#include "dbsyncer/history_writer.h"
 #include "dbconfig/dbconfig.h"
 #include "discoverer/discoverer.h"
 #include "httppoller/httppoller.h"
@@ -105,6 +106,7 @@ u_int64_t CONFIG_DEBUG_HOST = 0;
 int CONFIG_ICMP_METHOD = GLB_ICMP;
 char *CONFIG_VCDUMP_LOCATION = NULL;
 int CONFIG_VCDUMP_FREQUENCY = 60;
+int CONFIG_VALUECACHE_COMPRESS = 0;
 int CONFIG_ICMP_NA_ON_RESOLVE_FAIL = 0;
 
 int CONFIG_PREPROC_IPC_METRICS_PER_PREPROCESSOR = 64 * ZBX_KIBIBYTE;
@@ -379,6 +381,7 @@ zbx_uint64_t CONFIG_TRENDS_CACHE_SIZE = 4 * ZBX_MEBIBYTE;
 zbx_uint64_t CONFIG_VALUE_CACHE_SIZE = 256 * ZBX_MEBIBYTE;
 zbx_uint64_t CONFIG_VMWARE_CACHE_SIZE = 8 * ZBX_MEBIBYTE;
 u_int64_t CONFIG_IPC_BUFFER_SIZE = 512 * ZBX_MEBIBYTE;
+u_int64_t CONFIG_IPC_RING_SIZE = 0;
 
 char *CONFIG_WORKERS_DIR = NULL;
 char *CONFIG_GLBMAP_LOCATION = NULL;
@@ -390,6 +393,9 @@ char *CONFIG_SELF_MONITOR_IP = NULL;
 
 char **CONFIG_HISTORY_MODULE = NULL;
 int CONFIG_SNMP_RETRIES = 2;
+int CONFIG_SNMP_MAX_VARBINDS = 32;
+int CONFIG_SNMP_MAX_PDU_SIZE = 1400;
+int CONFIG_SNMP_BULK_MAX_REPETITIONS = 20;
 
 int CONFIG_UNREACHABLE_TIMEOUT = 45;
 int CONFIG_UNREACHABLE_DELAY = 15;
@@ -405,6 +411,9 @@ int CONFIG_UNSAFE_USER_PARAMETERS = 0;
 int CONFIG_DISABLE_SNMPV1_ASYNC = 0;
 
 char *CONFIG_SNMPTRAP_FILE = NULL;
+char *CONFIG_SNMPTRAP_LISTEN_IP = NULL;
+int CONFIG_SNMPTRAP_LISTEN_PORT = 0;
+char *CONFIG_SNMPTRAP_COMMUNITY = NULL;
 char *ICMP_METHOD_STR = NULL;
 
 char *CONFIG_JAVA_GATEWAY = NULL;
@@ -597,6 +606,11 @@ int get_process_info_by_thread(int local_server_num, unsigned char *local_proces
 		*local_process_type = GLB_PROCESS_TYPE_AGENT;
 		*local_process_num = local_server_num - server_count + CONFIG_FORKS[GLB_PROCESS_TYPE_AGENT];
 	}
+	else if (local_server_num <= (server_count += CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP]))
+	{
+		*local_process_type = GLB_PROCESS_TYPE_HTTP;
+		*local_process_num = local_server_num - server_count + CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP];
+	}
 	else if (local_server_num <= (server_count += CONFIG_FORKS[GLB_PROCESS_TYPE_WORKER]))
 	{
 		*local_process_type = GLB_PROCESS_TYPE_WORKER;
@@ -607,6 +621,11 @@ int get_process_info_by_thread(int local_server_num, unsigned char *local_proces
 		*local_process_type = GLB_PROCESS_TYPE_SNMP_WORKER;
 		*local_process_num = local_server_num - server_count + CONFIG_FORKS[GLB_PROCESS_TYPE_SNMP_WORKER];
 	}
+	else if (local_server_num <= (server_count += CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER]))
+	{
+		*local_process_type = GLB_PROCESS_TYPE_HISTORY_WRITER;
+		*local_process_num = local_server_num - server_count + CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER];
+	}
 	else if (local_server_num <= (server_count += CONFIG_FORKS[GLB_PROCESS_TYPE_SERVER]))
 	{
 		*local_process_type = GLB_PROCESS_TYPE_SERVER;
@@ -866,6 +885,8 @@ static void zbx_validate_config(ZBX_TASK_EX *task)
 	err |= (FAIL == check_cfg_feature_int("HistoryStorageDateIndex", CONFIG_HISTORY_STORAGE_PIPELINES,
 										  "cURL library"));
 	err |= (FAIL == check_cfg_feature_str("Vault", zbx_config_vault.name, "cURL library"));
+	err |= (FAIL == check_cfg_feature_int("StartGlbHttpPollers", CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP],
+										  "cURL library"));
 	err |= (FAIL == check_cfg_feature_str("VaultToken", zbx_config_vault.token, "cURL library"));
 	err |= (FAIL == check_cfg_feature_str("VaultDBPath", zbx_config_vault.db_path, "cURL library"));
 
@@ -949,6 +970,10 @@ static void set_config_defaults() {
 	CONFIG_FORKS[GLB_PROCESS_TYPE_AGENT] = 1;
 	CONFIG_FORKS[GLB_PROCESS_TYPE_API_TRAPPER] = 3;
 	CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR] = 4;
+	CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER] = 0;
+#ifdef HAVE_LIBCURL
+	CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP] = 1;
+#endif
 }
 
 /******************************************************************************
@@ -976,6 +1001,12 @@ static void zbx_load_config(ZBX_TASK_EX *task)
 			 PARM_OPT, 0, 1},
 			{"SnmpRetries", &CONFIG_SNMP_RETRIES, TYPE_INT,
 			 PARM_OPT, 1, 100},
+			{"SnmpMaxVarbinds", &CONFIG_SNMP_MAX_VARBINDS, TYPE_INT,
+			 PARM_OPT, 1, 256},
+			{"SnmpMaxPDUSize", &CONFIG_SNMP_MAX_PDU_SIZE, TYPE_INT,
+			 PARM_OPT, 484, 65000},
+			{"SnmpBulkMaxRepetitions", &CONFIG_SNMP_BULK_MAX_REPETITIONS, TYPE_INT,
+			 PARM_OPT, 0, 1000},
 			{"DebugItem", &CONFIG_DEBUG_ITEM, TYPE_INT,
 			 PARM_OPT, 0, 0},
 			{"DebugTrigger", &CONFIG_DEBUG_TRIGGER, TYPE_INT,
@@ -988,6 +1019,8 @@ static void zbx_load_config(ZBX_TASK_EX *task)
 			 PARM_OPT, 0, 32},
 			{"StartGlbAgentPollers", &CONFIG_FORKS[GLB_PROCESS_TYPE_AGENT], TYPE_INT,
 			 PARM_OPT, 0, 10},
+			{"StartGlbHttpPollers", &CONFIG_FORKS[GLB_PROCESS_TYPE_HTTP], TYPE_INT,
+			 PARM_OPT, 0, 10},
 			{"StartGlbPingers", &CONFIG_FORKS[GLB_PROCESS_TYPE_PINGER], TYPE_INT,
 			 PARM_OPT, 0, 10},
 			{"StartGlbWorkers", &CONFIG_FORKS[GLB_PROCESS_TYPE_WORKER], TYPE_INT,
@@ -1000,6 +1033,8 @@ static void zbx_load_config(ZBX_TASK_EX *task)
 			 PARM_OPT, 0, 0},
 			{"ValueCacheDumpFrequency", &CONFIG_VCDUMP_FREQUENCY, TYPE_INT,
 			 PARM_OPT, 10, SEC_PER_HOUR},
+			{"ValueCacheCompress", &CONFIG_VALUECACHE_COMPRESS, TYPE_INT,
+			 PARM_OPT, 0, 1},
 			{"StartPreprocessorManagers", &CONFIG_FORKS[GLB_PROCESS_TYPE_PREPROCESSOR], TYPE_INT,
 			 PARM_OPT, 1, 64},
 			{"StartAPITrappers", &CONFIG_FORKS[GLB_PROCESS_TYPE_API_TRAPPER], TYPE_INT,
@@ -1014,6 +1049,8 @@ static void zbx_load_config(ZBX_TASK_EX *task)
 			 PARM_OPT, 1, 1000},
 			{"StartDBSyncers", &CONFIG_FORKS[ZBX_PROCESS_TYPE_HISTSYNCER], TYPE_INT,
 			 PARM_OPT, 1, 100},
+			{"StartGlbHistoryWriters", &CONFIG_FORKS[GLB_PROCESS_TYPE_HISTORY_WRITER], TYPE_INT,
+			 PARM_OPT, 0, 100},
 			{"StartDiscoverers", &CONFIG_FORKS[ZBX_PROCESS_TYPE_DISCOVERER], TYPE_INT,
 			 PARM_OPT, 0, 250},
 			{"StartHTTPPollers", &CONFIG_FORKS[ZBX_PROCESS_TYPE_HTTPPOLLER], TYPE_INT,
@@ -1040,6 +1077,12 @@ static void zbx_load_config(ZBX_TASK_EX *task)
 			 PARM_OPT, 1024, 32767},
 			{"SNMPTrapperFile", &CONFIG_SNMPTRAP_FILE, TYPE_STRING,
 			 PARM_OPT, 0, 0},
+			{"SNMPTrapperListenIP", &CONFIG_SNMPTRAP_LISTEN_IP, TYPE_STRING,
+			 PARM_OPT, 0, 0},
+			{"SNMPTrapperListenPort", &CONFIG_SNMPTRAP_LISTEN_PORT, TYPE_INT,
+			 PARM_OPT, 0, 65535},
+			{"SNMPTrapperCommunity", &CONFIG_SNMPTRAP_COMMUNITY, TYPE_STRING_LIST,
+			 PARM_OPT, 0, 0},
 			{"StartSNMPTrapper", &CONFIG_FORKS[ZBX_PROCESS_TYPE_SNMPTRAPPER], TYPE_INT,
 			 PARM_OPT, 0, 1},
 			{"CacheSize", &CONFIG_CONF_CACHE_SIZE, TYPE_UINT64,
@@ -1048,6 +1091,8 @@ static void zbx_load_config(ZBX_TASK_EX *task)
 			 PARM_OPT, 0, __UINT64_C(64) * ZBX_GIBIBYTE},
 			{"IPCBufferSize", &CONFIG_IPC_BUFFER_SIZE, TYPE_UINT64,
 			 PARM_OPT, 1024 * 1024, __UINT64_C(64) * ZBX_GIBIBYTE},
+			{"IPCRingSize", &CONFIG_IPC_RING_SIZE, TYPE_UINT64,
+			 PARM_OPT, 0, 64 * ZBX_MEBIBYTE},
 			{"CacheUpdateFrequency", &CONFIG_CONFSYNCER_FREQUENCY, TYPE_INT,
 			 PARM_OPT, 1, 24 * SEC_PER_HOUR},
 			{"HousekeepingFrequency", &CONFIG_HOUSEKEEPING_FREQUENCY, TYPE_INT,
@@ -1311,6 +1356,9 @@ static void zbx_on_exit(int ret)
 		/* free state cache */
 		glb_state_destroy();
 
+		/* free history writers IPC, the writers have already exited */
+		history_writer_ipc_destroy();
+
 		/* free vmware support */
 		zbx_vmware_destroy();
 
@@ -1679,6 +1727,12 @@ static int server_startup(zbx_socket_t *listen_sock, zbx_socket_t *api_listen_so
 		exit(EXIT_FAILURE);
 	}
 
+	if (FAIL == history_writer_ipc_init())
+	{
+		zbx_error("Cannot initialize history writers IPC");
+		exit(EXIT_FAILURE);
+	}
+
 	if (NULL != CONFIG_VCDUMP_LOCATION && FAIL == glb_state_load())
 	{
 		zabbix_log(LOG_LEVEL_CRIT, "Failed to check read-write permissions on cache file %s, check permissions", CONFIG_VCDUMP_LOCATION);
@@ -1780,6 +1834,11 @@ static int server_startup(zbx_socket_t *listen_sock, zbx_socket_t *api_listen_so
 			LOG_INF("Starting AGENT glb poller of type %d", poller_args.poller_type);
 			zbx_thread_start(glbpoller_thread, &thread_args, &threads[i]);
 			break;
+		case GLB_PROCESS_TYPE_HTTP:
+			thread_args.args = &poller_args;
+			LOG_INF("Starting HTTP glb poller of type %d", poller_args.poller_type);
+			zbx_thread_start(glbpoller_thread, &thread_args, &threads[i]);
+			break;
 		case GLB_PROCESS_TYPE_API_TRAPPER:
 			thread_args.args = &trapper_api_args;
 			LOG_INF("Starting GLB api trapper of type");
@@ -1788,6 +1847,9 @@ static int server_startup(zbx_socket_t *listen_sock, zbx_socket_t *api_listen_so
 		case GLB_PROCESS_TYPE_PREPROCESSOR:
 			zbx_thread_start(glb_preprocessing_worker_thread, &thread_args, &threads[i]);
 			break;
+		case GLB_PROCESS_TYPE_HISTORY_WRITER:
+			zbx_thread_start(history_writer_thread, &thread_args, &threads[i]);
+			break;
 
 		case ZBX_PROCESS_TYPE_SERVICEMAN:
 			threads_flags[i] = ZBX_THREAD_PRIORITY_SECOND;
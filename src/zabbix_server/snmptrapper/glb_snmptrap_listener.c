@@ -0,0 +1,523 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_snmptrap_listener.h"
+#include "glb_snmptrap_matcher.h"
+#include "../glb_poller/poller_async_io.h"
+#include "zbxnix.h"
+#include "zbxself.h"
+#include "zbxstr.h"
+#include "zbxtime.h"
+#include "glb_preproc.h"
+#include "log.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#define SNMPTRAP_MAX_PACKET		65536
+#define SNMPTRAP_RECV_BATCH		1024
+#define SNMPTRAP_SOCKET_BUFFER		(16 * ZBX_MEBIBYTE)
+#define SNMPTRAP_SYNC_INTERVAL		1
+#define SNMPTRAP_PROCTITLE_INTERVAL	5
+
+#ifdef HAVE_IPV6
+#	define LISTEN_ANY_IP	"::"
+#else
+#	define LISTEN_ANY_IP	"0.0.0.0"
+#endif
+
+#define LISTEN_IP_STR	(NULL != CONFIG_SNMPTRAP_LISTEN_IP ? CONFIG_SNMPTRAP_LISTEN_IP : LISTEN_ANY_IP)
+#define COMMUNITY_STR	(NULL != CONFIG_SNMPTRAP_COMMUNITY ? CONFIG_SNMPTRAP_COMMUNITY : "public")
+
+typedef struct {
+	int		fd;
+	char		*buffer;
+	char		*trap;
+	size_t		trap_alloc;
+	u_int64_t	received;
+	u_int64_t	matched;
+	u_int64_t	errors;
+	u_int64_t	rejected;	/* traps with unknown community since the last warning */
+	time_t		rejected_log_time;
+
+	zbx_vector_str_t	communities;
+
+	poller_event_t	*recv_event;
+	poller_event_t	*sync_event;
+	poller_event_t	*proctitle_event;
+
+	const zbx_thread_info_t	*info;
+} snmptrap_listener_t;
+
+static void	format_oid(char **trap, size_t *trap_alloc, size_t *trap_offset, const asn1_oid_t *oid)
+{
+	int	i;
+
+	for (i = 0; i < oid->len; i++)
+		zbx_snprintf_alloc(trap, trap_alloc, trap_offset, ".%u", (unsigned int)oid->b[i]);
+}
+
+static void	format_octet_string(char **trap, size_t *trap_alloc, size_t *trap_offset, const asn1_str_t *str)
+{
+	int	i;
+
+	for (i = 0; i < str->len; i++)
+	{
+		unsigned char	c = (unsigned char)str->b[i];
+
+		if (0 == isprint(c) && 0 == isspace(c))
+			break;
+	}
+
+	if (i == str->len)
+	{
+		zbx_strcpy_alloc(trap, trap_alloc, trap_offset, "STRING: \"");
+		zbx_strncpy_alloc(trap, trap_alloc, trap_offset, str->b, str->len);
+		zbx_chrcpy_alloc(trap, trap_alloc, trap_offset, '"');
+		return;
+	}
+
+	zbx_strcpy_alloc(trap, trap_alloc, trap_offset, "Hex-STRING: ");
+
+	for (i = 0; i < str->len; i++)
+		zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "%02X ", (unsigned char)str->b[i]);
+}
+
+/* net-snmp style: "Timeticks: (1234567) 3:25:45.67", days are added when there are any */
+static void	format_timeticks(char **trap, size_t *trap_alloc, size_t *trap_offset, unsigned long long ticks)
+{
+	unsigned long long	days = ticks / 8640000;
+	unsigned int		rest = ticks % 8640000;
+
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "Timeticks: (%llu) ", ticks);
+
+	if (0 < days)
+		zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "%llu %s, ", days, 1 == days ? "day" : "days");
+
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "%u:%02u:%02u.%02u", rest / 360000, rest / 6000 % 60,
+			rest / 100 % 60, rest % 100);
+}
+
+static void	format_var_value(char **trap, size_t *trap_alloc, size_t *trap_offset, const csnmp_var_t *var)
+{
+	if (NULL == var->value)
+	{
+		zbx_strcpy_alloc(trap, trap_alloc, trap_offset, "NULL");
+		return;
+	}
+
+	switch (var->type)
+	{
+		case SNMP_TP_BOOL:
+		case SNMP_TP_INT:
+			zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "INTEGER: %d", *(int *)var->value);
+			break;
+		case SNMP_TP_COUNTER:
+			zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "Counter32: %u", *(unsigned int *)var->value);
+			break;
+		case SNMP_TP_GAUGE:
+			zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "Gauge32: %u", *(unsigned int *)var->value);
+			break;
+		case SNMP_TP_TIMETICKS:
+			format_timeticks(trap, trap_alloc, trap_offset, *(unsigned long long *)var->value);
+			break;
+		case SNMP_TP_COUNTER64:
+			zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "Counter64: %llu",
+					*(unsigned long long *)var->value);
+			break;
+		case SNMP_TP_INT64:
+			zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "Integer64: %lld",
+					*(long long *)var->value);
+			break;
+		case SNMP_TP_UINT64:
+			zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "UInt64: %llu",
+					*(unsigned long long *)var->value);
+			break;
+		case SNMP_TP_OID:
+			zbx_strcpy_alloc(trap, trap_alloc, trap_offset, "OID: ");
+			format_oid(trap, trap_alloc, trap_offset, (asn1_oid_t *)var->value);
+			break;
+		case SNMP_TP_IP_ADDR: {
+			const asn1_str_t	*str = var->value;
+
+			if (4 == str->len)
+			{
+				zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "IpAddress: %hhu.%hhu.%hhu.%hhu",
+						(unsigned char)str->b[0], (unsigned char)str->b[1],
+						(unsigned char)str->b[2], (unsigned char)str->b[3]);
+				break;
+			}
+
+			format_octet_string(trap, trap_alloc, trap_offset, str);
+			break;
+		}
+		default:
+			/* the rest of the types are decoded as octet strings */
+			format_octet_string(trap, trap_alloc, trap_offset, (asn1_str_t *)var->value);
+	}
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: format the trap the same way zabbix_trap_receiver.pl does, but    *
+ *          without the "ZBXTRAP <addr>" header, OIDs are always numeric      *
+ *                                                                            *
+ ******************************************************************************/
+void	snmptrap_format_trap(char **trap, size_t *trap_alloc, size_t *trap_offset, const csnmp_pdu_t *pdu,
+		const char *addr, unsigned short port, time_t now)
+{
+	char		date[32];
+	struct tm	tm;
+	int		i;
+
+	localtime_r(&now, &tm);
+	strftime(date, sizeof(date), "%H:%M:%S %Y/%m/%d", &tm);
+
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "%s PDU INFO:\n", date);
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "  %-30s %s\n", "notificationtype",
+			SNMP_CMD_INFORM == pdu->command ? "INFORM" : "TRAP");
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "  %-30s %d\n", "version", pdu->version);
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "  %-30s UDP: [%s]:%hu\n", "receivedfrom", addr, port);
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "  %-30s %d\n", "errorstatus", pdu->error_status);
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "  %-30s %.*s\n", "community", pdu->community.len,
+			NULL == pdu->community.b ? "" : pdu->community.b);
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "  %-30s %d\n", "errorindex", pdu->error_index);
+	zbx_snprintf_alloc(trap, trap_alloc, trap_offset, "  %-30s %d\n", "requestid", pdu->req_id);
+	zbx_strcpy_alloc(trap, trap_alloc, trap_offset, "VARBINDS:");
+
+	for (i = 0; i < pdu->vars_len; i++)
+	{
+		const csnmp_var_t	*var = &pdu->vars[i];
+		size_t			oid_offset;
+
+		zbx_strcpy_alloc(trap, trap_alloc, trap_offset, "\n  ");
+		oid_offset = *trap_offset;
+		format_oid(trap, trap_alloc, trap_offset, &var->oid);
+
+		/* perl's "%-30s" */
+		while (*trap_offset - oid_offset < 30)
+			zbx_chrcpy_alloc(trap, trap_alloc, trap_offset, ' ');
+
+		zbx_snprintf_alloc(trap, trap_alloc, trap_offset, " type=%-2d value=", (unsigned char)var->type);
+		format_var_value(trap, trap_alloc, trap_offset, var);
+	}
+}
+
+/* v4 senders arriving on the dual stack socket are reported by their plain v4 address, */
+/* the way they are set in the host interfaces */
+static int	format_sender_addr(const struct sockaddr_storage *from, char *addr, size_t addr_size,
+		unsigned short *port)
+{
+	if (AF_INET == from->ss_family)
+	{
+		const struct sockaddr_in	*sin = (const struct sockaddr_in *)from;
+
+		*port = ntohs(sin->sin_port);
+		return NULL == inet_ntop(AF_INET, &sin->sin_addr, addr, addr_size) ? FAIL : SUCCEED;
+	}
+#ifdef HAVE_IPV6
+	if (AF_INET6 == from->ss_family)
+	{
+		const struct sockaddr_in6	*sin6 = (const struct sockaddr_in6 *)from;
+
+		*port = ntohs(sin6->sin6_port);
+
+		if (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr))
+			return NULL == inet_ntop(AF_INET, &sin6->sin6_addr.s6_addr[12], addr, addr_size) ? FAIL : SUCCEED;
+
+		return NULL == inet_ntop(AF_INET6, &sin6->sin6_addr, addr, addr_size) ? FAIL : SUCCEED;
+	}
+#endif
+	return FAIL;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: split the comma separated list of the allowed trap communities    *
+ *                                                                            *
+ ******************************************************************************/
+void	snmptrap_parse_communities(zbx_vector_str_t *communities, const char *config)
+{
+	const char	*start = config, *end;
+
+	do
+	{
+		size_t	len;
+		char	*community;
+
+		len = (NULL != (end = strchr(start, ',')) ? (size_t)(end - start) : strlen(start));
+		community = zbx_malloc(NULL, len + 1);
+		memcpy(community, start, len);
+		community[len] = '\0';
+
+		zbx_vector_str_append(communities, community);
+		start = end + 1;
+	}
+	while (NULL != end);
+}
+
+int	snmptrap_is_community_allowed(const zbx_vector_str_t *communities, const csnmp_str_t *community)
+{
+	int	i;
+
+	for (i = 0; i < communities->values_num; i++)
+	{
+		if (strlen(communities->values[i]) == (size_t)community->len &&
+				0 == memcmp(communities->values[i], community->b, community->len))
+		{
+			return SUCCEED;
+		}
+	}
+
+	return FAIL;
+}
+
+/* a misconfigured agent or a scan would flood the log, so the rejects are reported once in a while */
+static void	reject_trap(snmptrap_listener_t *listener, const char *addr)
+{
+	time_t	now = time(NULL);
+
+	listener->errors++;
+	listener->rejected++;
+
+	if (LOG_ENTRY_INTERVAL_DELAY > now - listener->rejected_log_time)
+		return;
+
+	LOG_WRN("SNMP trapper has rejected " ZBX_FS_UI64 " traps with a community not listed in"
+			" SNMPTrapperCommunity, the last one from %s", listener->rejected, addr);
+
+	listener->rejected = 0;
+	listener->rejected_log_time = now;
+}
+
+static void	process_packet(snmptrap_listener_t *listener, int len, const struct sockaddr_storage *from,
+		socklen_t from_len)
+{
+	csnmp_pdu_t	pdu = {0};
+	char		addr[INET6_ADDRSTRLEN];
+	unsigned short	port;
+	size_t		trap_offset = 0;
+	zbx_timespec_t	ts;
+
+	listener->received++;
+
+	if (0 != snmp_dec_pdu(listener->buffer, len, &pdu))
+	{
+		LOG_DBG("Cannot decode trap packet: %s at %d", ZBX_NULL2EMPTY_STR(pdu.error.message), pdu.error.pos);
+		listener->errors++;
+		goto out;
+	}
+
+	/* v1 traps have their own pdu layout, they still have to come via snmptrapd and the trap file */
+	if (SNMP_CMD_TRAP2 != pdu.command && SNMP_CMD_INFORM != pdu.command)
+	{
+		LOG_DBG("Skipping snmp packet with command %s", csnmp_command_str(pdu.command));
+		listener->errors++;
+		goto out;
+	}
+
+	if (SUCCEED != format_sender_addr(from, addr, sizeof(addr), &port))
+		goto out;
+
+	/* neither matched nor acked, so the sender can't tell a wrong community from a lost packet */
+	if (SUCCEED != snmptrap_is_community_allowed(&listener->communities, &pdu.community))
+	{
+		reject_trap(listener, addr);
+		goto out;
+	}
+
+	zbx_timespec(&ts);
+	snmptrap_format_trap(&listener->trap, &listener->trap_alloc, &trap_offset, &pdu, addr, port, ts.sec);
+
+	/* the sender waits for the ack and retransmits, so it goes out before the matching */
+	if (SNMP_CMD_INFORM == pdu.command)
+	{
+		pdu.command = SNMP_CMD_RESPONSE;
+		pdu.error_status = SNMP_ERR_OK;
+		pdu.error_index = 0;
+		memcpy(&pdu.addr, from, from_len);
+		pdu.addr_len = from_len;
+
+		if (0 > csnmp_send_pdu(listener->fd, &pdu))
+			LOG_DBG("Cannot send inform response to %s: %s", addr, ZBX_NULL2EMPTY_STR(pdu.error.message));
+	}
+
+	if (SUCCEED == snmptrap_matcher_process(addr, listener->trap, &ts))
+		listener->matched++;
+out:
+	csnmp_free_pdu(&pdu);
+}
+
+/* the socket is drained by batches so a storm won't starve the timers */
+static void	receive_traps_cb(poller_item_t *poller_item, void *data)
+{
+	snmptrap_listener_t	*listener = data;
+	int			i;
+
+	for (i = 0; i < SNMPTRAP_RECV_BATCH; i++)
+	{
+		struct sockaddr_storage	from;
+		socklen_t		from_len = sizeof(from);
+		ssize_t			len;
+
+		if (0 > (len = recvfrom(listener->fd, listener->buffer, SNMPTRAP_MAX_PACKET, MSG_DONTWAIT,
+				(struct sockaddr *)&from, &from_len)))
+		{
+			if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+				LOG_WRN("Cannot receive trap: %s", zbx_strerror(errno));
+			break;
+		}
+
+		process_packet(listener, (int)len, &from, from_len);
+	}
+
+	if (0 < i)
+		preprocessing_flush();
+}
+
+static void	sync_cb(poller_item_t *poller_item, void *data)
+{
+	if (!ZBX_IS_RUNNING())
+	{
+		poller_async_loop_stop();
+		return;
+	}
+
+	snmptrap_matcher_sync();
+}
+
+static void	proctitle_cb(poller_item_t *poller_item, void *data)
+{
+	snmptrap_listener_t	*listener = data;
+
+	zbx_setproctitle("%s #%d [received %lu traps/sec, matched %lu, errors %lu]",
+			get_process_type_string(listener->info->process_type), listener->info->process_num,
+			listener->received / SNMPTRAP_PROCTITLE_INTERVAL, listener->matched / SNMPTRAP_PROCTITLE_INTERVAL,
+			listener->errors / SNMPTRAP_PROCTITLE_INTERVAL);
+
+	listener->received = 0;
+	listener->matched = 0;
+	listener->errors = 0;
+}
+
+static int	listener_bind(void)
+{
+	struct addrinfo	hints = {0}, *ai = NULL;
+	char		port[8];
+	int		fd, ret, buf_size = SNMPTRAP_SOCKET_BUFFER;
+
+#ifdef HAVE_IPV6
+	hints.ai_family = AF_UNSPEC;
+#else
+	hints.ai_family = AF_INET;
+#endif
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV | AI_PASSIVE;
+	zbx_snprintf(port, sizeof(port), "%d", CONFIG_SNMPTRAP_LISTEN_PORT);
+
+	if (0 != (ret = getaddrinfo(LISTEN_IP_STR, port, &hints, &ai)))
+	{
+		LOG_WRN("Invalid SNMP trap listen address '%s': %s", LISTEN_IP_STR, gai_strerror(ret));
+		return FAIL;
+	}
+
+	if (-1 == (fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK, ai->ai_protocol)))
+	{
+		LOG_WRN("Cannot create SNMP trap socket: %s", zbx_strerror(errno));
+		freeaddrinfo(ai);
+		return FAIL;
+	}
+#ifdef HAVE_IPV6
+	/* the default wildcard listener takes the v4 traps too */
+	if (AF_INET6 == ai->ai_family && NULL == CONFIG_SNMPTRAP_LISTEN_IP)
+	{
+		int	v6only = 0;
+
+		if (0 != setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)))
+			LOG_DBG("Cannot allow v4 traps on the SNMP trap socket: %s", zbx_strerror(errno));
+	}
+#endif
+
+	/* storms come in bursts, the kernel buffer keeps them while the matching catches up */
+	if (0 != setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size)))
+		LOG_DBG("Cannot set SNMP trap socket buffer size: %s", zbx_strerror(errno));
+
+	if (0 != bind(fd, ai->ai_addr, ai->ai_addrlen))
+	{
+		LOG_WRN("Cannot bind SNMP trap socket to %s:%d: %s", LISTEN_IP_STR,
+				CONFIG_SNMPTRAP_LISTEN_PORT, zbx_strerror(errno));
+		freeaddrinfo(ai);
+		close(fd);
+		return FAIL;
+	}
+
+	freeaddrinfo(ai);
+
+	return fd;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: receive v2c traps and informs on the udp socket and match them    *
+ *          to the trap items                                                 *
+ *                                                                            *
+ * Return value: FAIL - the socket cannot be opened                           *
+ *                                                                            *
+ ******************************************************************************/
+int	snmptrap_listener_run(const zbx_thread_info_t *info)
+{
+	snmptrap_listener_t	listener = {.info = info};
+
+	if (FAIL == (listener.fd = listener_bind()))
+		return FAIL;
+
+	LOG_INF("SNMP trapper is listening for traps on %s:%d", LISTEN_IP_STR,
+			CONFIG_SNMPTRAP_LISTEN_PORT);
+
+	zbx_vector_str_create(&listener.communities);
+	snmptrap_parse_communities(&listener.communities, COMMUNITY_STR);
+
+	listener.buffer = zbx_malloc(NULL, SNMPTRAP_MAX_PACKET);
+
+	poller_async_loop_init();
+
+	listener.recv_event = poller_create_event(NULL, receive_traps_cb, listener.fd, &listener, 1);
+	poller_lower_event_priority(listener.recv_event);
+	poller_run_fd_event(listener.recv_event);
+
+	listener.sync_event = poller_create_event(NULL, sync_cb, 0, &listener, 1);
+	poller_run_timer_event(listener.sync_event, SNMPTRAP_SYNC_INTERVAL * 1000);
+
+	listener.proctitle_event = poller_create_event(NULL, proctitle_cb, 0, &listener, 1);
+	poller_run_timer_event(listener.proctitle_event, SNMPTRAP_PROCTITLE_INTERVAL * 1000);
+
+	poller_async_loop_run();
+
+	poller_destroy_event(listener.recv_event);
+	poller_destroy_event(listener.sync_event);
+	poller_destroy_event(listener.proctitle_event);
+
+	close(listener.fd);
+	zbx_free(listener.buffer);
+	zbx_free(listener.trap);
+
+	zbx_vector_str_clear_ext(&listener.communities, zbx_str_free);
+	zbx_vector_str_destroy(&listener.communities);
+
+	return SUCCEED;
+}
@@ -0,0 +1,42 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef GLB_SNMPTRAP_LISTENER_H
+#define GLB_SNMPTRAP_LISTENER_H
+
+#include "zbxcommon.h"
+#include "zbxalgo.h"
+#include "zbxthreads.h"
+#include "../glb_poller/csnmp.h"
+
+extern char	*CONFIG_SNMPTRAP_LISTEN_IP;
+extern int	CONFIG_SNMPTRAP_LISTEN_PORT;
+extern char	*CONFIG_SNMPTRAP_COMMUNITY;
+
+/* traps are formatted the way zabbix_trap_receiver.pl writes them, so the items regexps
+   work the same with the listener and with the trap file */
+void	snmptrap_format_trap(char **trap, size_t *trap_alloc, size_t *trap_offset, const csnmp_pdu_t *pdu,
+		const char *addr, unsigned short port, time_t now);
+
+/* only the traps with the listed communities are accepted */
+void	snmptrap_parse_communities(zbx_vector_str_t *communities, const char *config);
+int	snmptrap_is_community_allowed(const zbx_vector_str_t *communities, const csnmp_str_t *community);
+
+int	snmptrap_listener_run(const zbx_thread_info_t *info);
+
+#endif
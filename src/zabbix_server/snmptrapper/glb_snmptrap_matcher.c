@@ -0,0 +1,376 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_snmptrap_matcher.h"
+#include "zbxcacheconfig.h"
+#include "zbxserver.h"
+#include "zbxregexp.h"
+#include "zbxsysinfo.h"
+#include "zbxdbhigh.h"
+#include "preproc.h"
+#include "log.h"
+
+typedef struct {
+	zbx_uint64_t	itemid;
+	zbx_uint64_t	hostid;
+	u_int64_t	flags;
+	unsigned char	value_type;
+	char		*logtimefmt;	/* the log timestamp format of the log items, NULL if not set */
+	char		*regex;		/* NULL matches any trap */
+	zbx_regexp_t	*regexp;	/* compiled regex, NULL for the global ones */
+	char		*error;		/* the item is reported as not supported on each trap */
+} trap_item_t;
+
+typedef struct {
+	zbx_uint64_t		interfaceid;
+	trap_item_t		*items;
+	int			items_num;
+	int			fallback;	/* index of the snmptrap.fallback item, -1 if there is none */
+	zbx_vector_expression_t	regexps;	/* global regexps referred by the items */
+} trap_interface_t;
+
+typedef struct {
+	char			*addr;
+	zbx_vector_uint64_t	interfaceids;
+} trap_addr_t;
+
+typedef struct {
+	zbx_hashset_t	addrs;
+	zbx_hashset_t	interfaces;
+	zbx_uint64_t	revision;
+	unsigned char	logging;
+} snmptrap_matcher_t;
+
+static snmptrap_matcher_t matcher = {0};
+
+static zbx_hash_t	trap_addr_hash_func(const void *data)
+{
+	return zbx_default_string_hash_func(((const trap_addr_t *)data)->addr);
+}
+
+static void	trap_addr_clean(void *data)
+{
+	trap_addr_t	*trap_addr = data;
+
+	zbx_free(trap_addr->addr);
+	zbx_vector_uint64_destroy(&trap_addr->interfaceids);
+}
+
+static void	trap_interface_clean(void *data)
+{
+	trap_interface_t	*iface = data;
+	int			i;
+
+	for (i = 0; i < iface->items_num; i++)
+	{
+		trap_item_t	*item = &iface->items[i];
+
+		if (NULL != item->regexp)
+			zbx_regexp_free(item->regexp);
+
+		zbx_free(item->regex);
+		zbx_free(item->logtimefmt);
+		zbx_free(item->error);
+	}
+
+	zbx_free(iface->items);
+	zbx_regexp_clean_expressions(&iface->regexps);
+	zbx_vector_expression_destroy(&iface->regexps);
+}
+
+void	snmptrap_matcher_init(void)
+{
+	zbx_hashset_create_ext(&matcher.addrs, 0, trap_addr_hash_func, ZBX_DEFAULT_STR_COMPARE_FUNC, trap_addr_clean,
+			ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC, ZBX_DEFAULT_MEM_FREE_FUNC);
+	zbx_hashset_create_ext(&matcher.interfaces, 0, ZBX_DEFAULT_UINT64_HASH_FUNC, ZBX_DEFAULT_UINT64_COMPARE_FUNC,
+			trap_interface_clean, ZBX_DEFAULT_MEM_MALLOC_FUNC, ZBX_DEFAULT_MEM_REALLOC_FUNC,
+			ZBX_DEFAULT_MEM_FREE_FUNC);
+	matcher.revision = 0;
+}
+
+void	snmptrap_matcher_destroy(void)
+{
+	zbx_hashset_destroy(&matcher.addrs);
+	zbx_hashset_destroy(&matcher.interfaces);
+}
+
+/* the matchers are dropped on a configuration change and rebuilt lazily by the next trap of the interface */
+void	snmptrap_matcher_sync(void)
+{
+	zbx_uint64_t	revision = zbx_dc_get_config_revision();
+	zbx_config_t	cfg;
+
+	if (revision == matcher.revision)
+		return;
+
+	LOG_DBG("Configuration revision changed %lu -> %lu, resetting trap matchers", matcher.revision, revision);
+
+	zbx_hashset_clear(&matcher.addrs);
+	zbx_hashset_clear(&matcher.interfaces);
+
+	zbx_config_get(&cfg, ZBX_CONFIG_FLAGS_SNMPTRAP_LOGGING);
+	matcher.logging = cfg.snmptrap_logging;
+	zbx_config_clean(&cfg);
+
+	matcher.revision = revision;
+}
+
+static trap_addr_t	*get_trap_addr(const char *addr)
+{
+	trap_addr_t	*trap_addr, local = {.addr = (char *)addr};
+	zbx_uint64_t	*interfaceids = NULL;
+	int		i, count;
+
+	if (NULL != (trap_addr = zbx_hashset_search(&matcher.addrs, &local)))
+		return trap_addr;
+
+	/* unknown addresses are cached too, so a storm from a host without interfaces won't lock the cache */
+	local.addr = zbx_strdup(NULL, addr);
+	zbx_vector_uint64_create(&local.interfaceids);
+
+	count = DCconfig_get_snmp_interfaceids_by_addr(addr, &interfaceids);
+
+	for (i = 0; i < count; i++)
+		zbx_vector_uint64_append(&local.interfaceids, interfaceids[i]);
+
+	zbx_free(interfaceids);
+
+	return zbx_hashset_insert(&matcher.addrs, &local, sizeof(local));
+}
+
+/* returns SUCCEED if the item is a trap item, fills the regex or the error */
+static int	prepare_trap_item(trap_interface_t *iface, DC_ITEM *dc_item, trap_item_t *item, int *fallback)
+{
+	char		error[ZBX_ITEM_ERROR_LEN_MAX];
+	const char	*regex, *err_msg = NULL;
+	AGENT_REQUEST	request;
+	int		ret = FAIL;
+
+	item->itemid = dc_item->itemid;
+	item->hostid = dc_item->host.hostid;
+	item->flags = dc_item->flags;
+	item->value_type = dc_item->value_type;
+
+	if (ITEM_VALUE_TYPE_LOG == dc_item->value_type && '\0' != *dc_item->logtimefmt)
+		item->logtimefmt = zbx_strdup(NULL, dc_item->logtimefmt);
+
+	dc_item->key = zbx_strdup(dc_item->key, dc_item->key_orig);
+
+	if (SUCCEED != zbx_substitute_key_macros(&dc_item->key, NULL, dc_item, NULL, NULL,
+			MACRO_TYPE_ITEM_KEY, error, sizeof(error)))
+	{
+		item->error = zbx_strdup(NULL, error);
+		return SUCCEED;
+	}
+
+	if (0 == strcmp(dc_item->key, "snmptrap.fallback"))
+	{
+		*fallback = 1;
+		return SUCCEED;
+	}
+
+	zbx_init_agent_request(&request);
+
+	if (SUCCEED != zbx_parse_item_key(dc_item->key, &request) || 0 != strcmp(get_rkey(&request), "snmptrap") ||
+			1 < get_rparams_num(&request))
+	{
+		goto out;
+	}
+
+	ret = SUCCEED;
+
+	if (NULL == (regex = get_rparam(&request, 0)) || '\0' == *regex)
+		goto out;
+
+	item->regex = zbx_strdup(NULL, regex);
+
+	if ('@' == *regex)
+	{
+		if (FAIL == zbx_global_regexp_exists(regex + 1, &iface->regexps))
+			DCget_expressions_by_name(&iface->regexps, regex + 1);
+
+		if (FAIL == zbx_global_regexp_exists(regex + 1, &iface->regexps))
+			item->error = zbx_dsprintf(NULL, "Global regular expression \"%s\" does not exist.", regex + 1);
+
+		goto out;
+	}
+
+	if (SUCCEED != zbx_regexp_compile(regex, &item->regexp, &err_msg))
+	{
+		item->error = zbx_dsprintf(NULL, "Invalid regular expression \"%s\".", regex);
+		goto out;
+	}
+
+	zbx_regexp_jit_compile(item->regexp);
+out:
+	zbx_free_agent_request(&request);
+
+	return ret;
+}
+
+static trap_interface_t	*get_trap_interface(zbx_uint64_t interfaceid)
+{
+	trap_interface_t	*iface, local = {.interfaceid = interfaceid, .fallback = -1};
+	DC_ITEM			*dc_items = NULL;
+	zbx_dc_um_handle_t	*um_handle;
+	size_t			i, num;
+
+	if (NULL != (iface = zbx_hashset_search(&matcher.interfaces, &interfaceid)))
+		return iface;
+
+	zbx_vector_expression_create(&local.regexps);
+
+	um_handle = zbx_dc_open_user_macros();
+
+	num = DCconfig_get_snmp_items_by_interfaceid(interfaceid, &dc_items);
+
+	if (0 < num)
+		local.items = zbx_calloc(NULL, num, sizeof(trap_item_t));
+
+	for (i = 0; i < num; i++)
+	{
+		trap_item_t	*item = &local.items[local.items_num];
+		int		fallback = 0;
+
+		if (SUCCEED != prepare_trap_item(&local, &dc_items[i], item, &fallback))
+		{
+			zbx_free(item->regex);
+			zbx_free(item->logtimefmt);
+			memset(item, 0, sizeof(trap_item_t));
+			continue;
+		}
+
+		if (0 != fallback)
+			local.fallback = local.items_num;
+
+		local.items_num++;
+	}
+
+	for (i = 0; i < num; i++)
+		zbx_free(dc_items[i].key);
+
+	DCconfig_clean_items(dc_items, NULL, num);
+	zbx_free(dc_items);
+
+	zbx_dc_close_user_macros(um_handle);
+
+	LOG_DBG("Built trap matcher for interface %lu: %d items", interfaceid, local.items_num);
+
+	return zbx_hashset_insert(&matcher.interfaces, &local, sizeof(local));
+}
+
+static int	match_trap_item(const trap_interface_t *iface, trap_item_t *item, const char *trap)
+{
+	int	ret;
+
+	if (NULL == item->regex)
+		return SUCCEED;
+
+	if (NULL != item->regexp)
+		return (0 == zbx_regexp_match_precompiled(trap, item->regexp) ? SUCCEED : FAIL);
+
+	if (FAIL == (ret = zbx_regexp_match_ex(&iface->regexps, trap, item->regex, ZBX_CASE_SENSITIVE)))
+		item->error = zbx_dsprintf(NULL, "Invalid regular expression \"%s\".", item->regex);
+
+	return (ZBX_REGEXP_MATCH == ret ? SUCCEED : FAIL);
+}
+
+/* log items get the trap as a log value with the timestamp parsed by the item's format */
+static void	send_trap_value(const trap_item_t *item, const char *trap, const zbx_timespec_t *ts)
+{
+	AGENT_RESULT	result;
+
+	if (ITEM_VALUE_TYPE_LOG != item->value_type)
+	{
+		preprocess_str(item->hostid, item->itemid, item->flags, ts, trap);
+		return;
+	}
+
+	zbx_init_agent_result(&result);
+	/* the log value is a copy of the trap, it isn't modified */
+	zbx_set_agent_result_type(&result, ITEM_VALUE_TYPE_LOG, (char *)trap);
+
+	if (NULL != item->logtimefmt)
+		zbx_calc_timestamp(result.log->value, &result.log->timestamp, item->logtimefmt);
+
+	preprocess_agent_result(item->hostid, item->itemid, item->flags, ts, &result, ITEM_VALUE_TYPE_LOG);
+	zbx_free_agent_result(&result);
+}
+
+static int	process_trap_for_interface(trap_interface_t *iface, const char *trap, const zbx_timespec_t *ts)
+{
+	int	i, ret = FAIL;
+
+	for (i = 0; i < iface->items_num; i++)
+	{
+		trap_item_t	*item = &iface->items[i];
+
+		if (i == iface->fallback)
+			continue;
+
+		if (NULL == item->error && SUCCEED == match_trap_item(iface, item, trap))
+		{
+			send_trap_value(item, trap, ts);
+			ret = SUCCEED;
+		}
+
+		if (NULL != item->error)
+			preprocess_error(item->hostid, item->itemid, item->flags, ts, item->error);
+	}
+
+	if (FAIL == ret && -1 != iface->fallback)
+	{
+		trap_item_t	*item = &iface->items[iface->fallback];
+
+		if (NULL == item->error)
+			send_trap_value(item, trap, ts);
+		else
+			preprocess_error(item->hostid, item->itemid, item->flags, ts, item->error);
+
+		ret = SUCCEED;
+	}
+
+	return ret;
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: send the trap to all matching items of the address interfaces     *
+ *                                                                            *
+ * Return value: SUCCEED - a matching item was found                          *
+ *               FAIL - no matching item was found (including fallback items) *
+ *                                                                            *
+ ******************************************************************************/
+int	snmptrap_matcher_process(const char *addr, const char *trap, const zbx_timespec_t *ts)
+{
+	trap_addr_t	*trap_addr = get_trap_addr(addr);
+	int		i, ret = FAIL;
+
+	for (i = 0; i < trap_addr->interfaceids.values_num; i++)
+	{
+		trap_interface_t	*iface = get_trap_interface(trap_addr->interfaceids.values[i]);
+
+		if (SUCCEED == process_trap_for_interface(iface, trap, ts))
+			ret = SUCCEED;
+	}
+
+	if (FAIL == ret && ZBX_SNMPTRAP_LOGGING_ENABLED == matcher.logging)
+		zabbix_log(LOG_LEVEL_WARNING, "unmatched trap received from \"%s\": %s", addr, trap);
+
+	return ret;
+}
@@ -0,0 +1,33 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#ifndef GLB_SNMPTRAP_MATCHER_H
+#define GLB_SNMPTRAP_MATCHER_H
+
+#include "zbxcommon.h"
+#include "zbxtime.h"
+
+/* trap items of the interfaces are parsed and their regexps are compiled on the first trap
+   after a configuration change, the rest of the traps are only matched */
+void	snmptrap_matcher_init(void);
+void	snmptrap_matcher_destroy(void);
+void	snmptrap_matcher_sync(void);
+
+int	snmptrap_matcher_process(const char *addr, const char *trap, const zbx_timespec_t *ts);
+
+#endif
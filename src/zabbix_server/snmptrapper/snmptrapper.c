@@ -18,18 +18,17 @@
 **/
 
 #include "snmptrapper.h"
+#include "glb_snmptrap_matcher.h"
+#include "glb_snmptrap_listener.h"
 #include "zbxserver.h"
 #include "zbxdbwrap.h"
 
 #include "zbxself.h"
 #include "zbxnix.h"
 #include "log.h"
-#include "zbxregexp.h"
 #include "preproc.h"
 #include "zbxnum.h"
 #include "zbxtime.h"
-#include "zbxsysinfo.h"
-#include "zbx_item_constants.h"
 
 static int	trap_fd = -1;
 static off_t	trap_lastsize;
@@ -67,164 +66,6 @@ static void	DBupdate_lastsize(void)
 	zbx_db_commit();
 }
 
-/******************************************************************************
- *                                                                            *
- * Purpose: add trap to all matching items for the specified interface        *
- *                                                                            *
- * Return value: SUCCEED - a matching item was found                          *
- *               FAIL - no matching item was found (including fallback items) *
- *                                                                            *
- ******************************************************************************/
-static int	process_trap_for_interface(zbx_uint64_t interfaceid, char *trap, zbx_timespec_t *ts)
-{
-	DC_ITEM			*items = NULL;
-	const char		*regex;
-	char			error[ZBX_ITEM_ERROR_LEN_MAX];
-	size_t			num, i;
-	int			ret = FAIL, fb = -1, *lastclocks = NULL, *errcodes = NULL, value_type, regexp_ret;
-	zbx_uint64_t		*itemids = NULL;
-	AGENT_RESULT		*results = NULL;
-	AGENT_REQUEST		request;
-	zbx_vector_expression_t	regexps;
-	zbx_dc_um_handle_t	*um_handle;
-
-	zbx_vector_expression_create(&regexps);
-
-	um_handle = zbx_dc_open_user_macros();
-
-	num = DCconfig_get_snmp_items_by_interfaceid(interfaceid, &items);
-
-	itemids = (zbx_uint64_t *)zbx_malloc(itemids, sizeof(zbx_uint64_t) * num);
-	lastclocks = (int *)zbx_malloc(lastclocks, sizeof(int) * num);
-	errcodes = (int *)zbx_malloc(errcodes, sizeof(int) * num);
-	results = (AGENT_RESULT *)zbx_malloc(results, sizeof(AGENT_RESULT) * num);
-
-	for (i = 0; i < num; i++)
-	{
-		zbx_init_agent_result(&results[i]);
-		errcodes[i] = FAIL;
-
-		items[i].key = zbx_strdup(items[i].key, items[i].key_orig);
-		if (SUCCEED != zbx_substitute_key_macros(&items[i].key, NULL, &items[i], NULL, NULL,
-				MACRO_TYPE_ITEM_KEY, error, sizeof(error)))
-		{
-			SET_MSG_RESULT(&results[i], zbx_strdup(NULL, error));
-			errcodes[i] = NOTSUPPORTED;
-			continue;
-		}
-
-		if (0 == strcmp(items[i].key, "snmptrap.fallback"))
-		{
-			fb = i;
-			continue;
-		}
-
-		zbx_init_agent_request(&request);
-
-		if (SUCCEED != zbx_parse_item_key(items[i].key, &request))
-			goto next;
-
-		if (0 != strcmp(get_rkey(&request), "snmptrap"))
-			goto next;
-
-		if (1 < get_rparams_num(&request))
-			goto next;
-
-		if (NULL != (regex = get_rparam(&request, 0)))
-		{
-			if ('@' == *regex)
-			{
-				DCget_expressions_by_name(&regexps, regex + 1);
-
-				if (0 == regexps.values_num)
-				{
-					SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL,
-							"Global regular expression \"%s\" does not exist.", regex + 1));
-					errcodes[i] = NOTSUPPORTED;
-					goto next;
-				}
-			}
-
-			if (ZBX_REGEXP_NO_MATCH == (regexp_ret = zbx_regexp_match_ex(&regexps, trap, regex,
-					ZBX_CASE_SENSITIVE)))
-			{
-				goto next;
-			}
-			else if (FAIL == regexp_ret)
-			{
-				SET_MSG_RESULT(&results[i], zbx_dsprintf(NULL,
-						"Invalid regular expression \"%s\".", regex));
-				errcodes[i] = NOTSUPPORTED;
-				goto next;
-			}
-		}
-
-		value_type = (ITEM_VALUE_TYPE_LOG == items[i].value_type ? ITEM_VALUE_TYPE_LOG : ITEM_VALUE_TYPE_TEXT);
-		zbx_set_agent_result_type(&results[i], value_type, trap);
-		errcodes[i] = SUCCEED;
-		ret = SUCCEED;
-next:
-		zbx_free_agent_request(&request);
-	}
-
-	if (FAIL == ret && -1 != fb)
-	{
-		value_type = (ITEM_VALUE_TYPE_LOG == items[fb].value_type ? ITEM_VALUE_TYPE_LOG : ITEM_VALUE_TYPE_TEXT);
-		zbx_set_agent_result_type(&results[fb], value_type, trap);
-		errcodes[fb] = SUCCEED;
-		ret = SUCCEED;
-	}
-
-	for (i = 0; i < num; i++)
-	{
-		switch (errcodes[i])
-		{
-			case SUCCEED:
-				if (ITEM_VALUE_TYPE_LOG == items[i].value_type)
-				{
-					zbx_calc_timestamp(results[i].log->value, &results[i].log->timestamp,
-							items[i].logtimefmt);
-				}
-
-				preprocess_agent_result(items[i].host.hostid, items[i].itemid, items[i].flags, ts, &results[i], items[i].value_type);
-
-				itemids[i] = items[i].itemid;
-				lastclocks[i] = ts->sec;
-				break;
-			case NOTSUPPORTED:
-				preprocess_error(items[i].host.hostid, items[i].itemid, items[i].flags, ts, results[i].msg );
-
-				itemids[i] = items[i].itemid;
-				lastclocks[i] = ts->sec;
-				break;
-		}
-
-		zbx_free(items[i].key);
-		zbx_free_agent_result(&results[i]);
-	}
-
-	zbx_free(results);
-
-	DCrequeue_items(itemids, lastclocks, errcodes, num);
-
-	zbx_free(errcodes);
-	zbx_free(lastclocks);
-	zbx_free(itemids);
-
-	DCconfig_clean_items(items, NULL, num);
-	zbx_free(items);
-
-	zbx_dc_close_user_macros(um_handle);
-
-	zbx_regexp_clean_expressions(&regexps);
-	zbx_vector_expression_destroy(&regexps);
-
-	preprocessing_force_flush();
-	//zbx_preprocessor_flush();
-
-	return ret;
-}
-
 /******************************************************************************
  *                                                                            *
  * Purpose: process a single trap                                             *
@@ -237,34 +78,13 @@ next:
 static void	process_trap(const char *addr, char *begin, char *end)
 {
 	zbx_timespec_t	ts;
-	zbx_uint64_t	*interfaceids = NULL;
-	int		count, i, ret = FAIL;
 	char		*trap = NULL;
 
 	zbx_timespec(&ts);
 	trap = zbx_dsprintf(trap, "%s%s", begin, end);
 
-	count = DCconfig_get_snmp_interfaceids_by_addr(addr, &interfaceids);
-
-	for (i = 0; i < count; i++)
-	{
-		if (SUCCEED == process_trap_for_interface(interfaceids[i], trap, &ts))
-			ret = SUCCEED;
-	}
-
-	if (FAIL == ret)
-	{
-		zbx_config_t	cfg;
-
-		zbx_config_get(&cfg, ZBX_CONFIG_FLAGS_SNMPTRAP_LOGGING);
-
-		if (ZBX_SNMPTRAP_LOGGING_ENABLED == cfg.snmptrap_logging)
-			zabbix_log(LOG_LEVEL_WARNING, "unmatched trap received from \"%s\": %s", addr, trap);
+	snmptrap_matcher_process(addr, trap, &ts);
 
-		zbx_config_clean(&cfg);
-	}
-
-	zbx_free(interfaceids);
 	zbx_free(trap);
 }
 
@@ -597,6 +417,12 @@ ZBX_THREAD_ENTRY(snmptrapper_thread, args)
 
 	zbx_update_selfmon_counter(info, ZBX_PROCESS_STATE_BUSY);
 
+	snmptrap_matcher_init();
+	snmptrap_matcher_sync();
+
+	if (0 != CONFIG_SNMPTRAP_LISTEN_PORT && SUCCEED == snmptrap_listener_run(info))
+		goto out;
+
 	zbx_setproctitle("%s [connecting to the database]", get_process_type_string(process_type));
 
 	zbx_db_connect(ZBX_DB_CONNECT_NORMAL);
@@ -613,8 +439,12 @@ ZBX_THREAD_ENTRY(snmptrapper_thread, args)
 
 		zbx_setproctitle("%s [processing data]", get_process_type_string(process_type));
 
+		snmptrap_matcher_sync();
+
 		while (ZBX_IS_RUNNING() && SUCCEED == get_latest_data())
 			read_traps();
+
+		preprocessing_force_flush();
 		sec = zbx_time() - sec;
 
 		zbx_setproctitle("%s [processed data in " ZBX_FS_DBL " sec, idle 1 sec]",
@@ -627,6 +457,8 @@ ZBX_THREAD_ENTRY(snmptrapper_thread, args)
 
 	if (-1 != trap_fd)
 		close(trap_fd);
+out:
+	snmptrap_matcher_destroy();
 
 	zbx_setproctitle("%s #%d [terminated]", get_process_type_string(process_type), process_num);
 
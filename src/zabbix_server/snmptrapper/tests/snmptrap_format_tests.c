@@ -0,0 +1,187 @@
+/*
+** Copyright Glaber
+**
+** This program is free software; you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation; either version 2 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+**/
+
+#include "glb_common.h"
+#ifdef HAVE_GLB_TESTS
+
+#include "zbxcommon.h"
+#include "log.h"
+#include "../glb_snmptrap_listener.h"
+
+static asn1_str_t *new_str(const char *str) {
+	asn1_str_t *s = zbx_malloc(NULL, sizeof(asn1_str_t));
+
+	s->len = strlen(str);
+	s->b = zbx_malloc(NULL, s->len);
+	memcpy(s->b, str, s->len);
+
+	return s;
+}
+
+/* builds a v2c trap the way an agent sends it and returns the decoded copy */
+static void build_trap(csnmp_pdu_t *decoded, int command) {
+	static const int uptime_oid[] = {1, 3, 6, 1, 2, 1, 1, 3, 0};
+	static const int trap_oid[] = {1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0};
+	static const int link_down[] = {1, 3, 6, 1, 6, 3, 1, 1, 5, 3};
+	static const int if_descr[] = {1, 3, 6, 1, 2, 1, 2, 2, 1, 2, 7};
+	static const int if_index[] = {1, 3, 6, 1, 2, 1, 2, 2, 1, 1, 7};
+	static const int mac[] = {1, 3, 6, 1, 2, 1, 2, 2, 1, 6, 7};
+	csnmp_pdu_t pdu = {0};
+	asn1_str_t *bin;
+	int len = 1024, offset = 0;
+	char *buf = zbx_malloc(NULL, len);
+
+	pdu.version = SNMP_VERSION_2c;
+	bin = new_str("public");
+	pdu.community = *bin;
+	zbx_free(bin);
+
+	pdu.command = command;
+	pdu.req_id = 4242;
+
+	csnmp_add_var(&pdu, asn1_crt_oid(uptime_oid, ARRSIZE(uptime_oid)), SNMP_TP_TIMETICKS,
+			csnmp_new_long(8640000 + 3600 * 100 + 61 * 100 + 5));
+	csnmp_add_var(&pdu, asn1_crt_oid(trap_oid, ARRSIZE(trap_oid)), SNMP_TP_OID,
+			asn1_new_oid(link_down, ARRSIZE(link_down)));
+	csnmp_add_var(&pdu, asn1_crt_oid(if_index, ARRSIZE(if_index)), SNMP_TP_INT, csnmp_new_int(7));
+	csnmp_add_var(&pdu, asn1_crt_oid(if_descr, ARRSIZE(if_descr)), SNMP_TP_OCT_STR, new_str("ge-0/0/7"));
+
+	/* a mac address is not printable, it goes as hex */
+	bin = new_str("-\x1b\x21\xaa");
+	bin->b[0] = '\0';
+	csnmp_add_var(&pdu, asn1_crt_oid(mac, ARRSIZE(mac)), SNMP_TP_OCT_STR, bin);
+
+	assert(0 == snmp_enc_pdu(&buf, &offset, &len, &pdu));
+	assert(0 == snmp_dec_pdu(buf, offset, decoded));
+
+	csnmp_free_pdu(&pdu);
+	zbx_free(buf);
+}
+
+static void test_format_trap(void) {
+	csnmp_pdu_t pdu = {0};
+	char *trap = NULL;
+	size_t trap_alloc = 0, trap_offset = 0;
+
+	LOG_INF("Testing v2c trap formatting");
+
+	build_trap(&pdu, SNMP_CMD_TRAP2);
+
+	assert(SNMP_CMD_TRAP2 == pdu.command);
+	assert(5 == pdu.vars_len);
+
+	snmptrap_format_trap(&trap, &trap_alloc, &trap_offset, &pdu, "192.168.1.1", 50162, time(NULL));
+	LOG_INF("Formatted trap:\n%s", trap);
+
+	assert(NULL != strstr(trap, " PDU INFO:\n"));
+	assert(NULL != strstr(trap, "  notificationtype               TRAP\n"));
+	assert(NULL != strstr(trap, "  receivedfrom                   UDP: [192.168.1.1]:50162\n"));
+	assert(NULL != strstr(trap, "  community                      public\n"));
+	assert(NULL != strstr(trap, "  requestid                      4242\n"));
+	assert(NULL != strstr(trap, "\nVARBINDS:\n"));
+	assert(NULL != strstr(trap, "  .1.3.6.1.2.1.1.3.0             type=67 value=Timeticks: (9006105) 1 day, 1:01:01.05\n"));
+	assert(NULL != strstr(trap, "  .1.3.6.1.6.3.1.1.4.1.0         type=6  value=OID: .1.3.6.1.6.3.1.1.5.3\n"));
+	assert(NULL != strstr(trap, "  .1.3.6.1.2.1.2.2.1.1.7         type=2  value=INTEGER: 7\n"));
+	assert(NULL != strstr(trap, "  .1.3.6.1.2.1.2.2.1.2.7         type=4  value=STRING: \"ge-0/0/7\"\n"));
+
+	/* the trap has no trailing new line, the same as the traps from the file */
+	assert(NULL != strstr(trap, "  .1.3.6.1.2.1.2.2.1.6.7         type=4  value=Hex-STRING: 00 1B 21 AA "));
+	assert(' ' == trap[trap_offset - 1]);
+
+	/* the buffer is reused for the next trap */
+	trap_offset = 0;
+	csnmp_free_pdu(&pdu);
+	memset(&pdu, 0, sizeof(pdu));
+
+	build_trap(&pdu, SNMP_CMD_INFORM);
+	snmptrap_format_trap(&trap, &trap_alloc, &trap_offset, &pdu, "10.0.0.1", 162, time(NULL));
+	assert(NULL != strstr(trap, "  notificationtype               INFORM\n"));
+	assert(strlen(trap) == trap_offset);
+
+	csnmp_free_pdu(&pdu);
+	zbx_free(trap);
+}
+
+static void test_format_64bit_values(void) {
+	static const int counter_oid[] = {1, 3, 6, 1, 2, 1, 31, 1, 1, 1, 6, 7};
+	static const int uint_oid[] = {1, 3, 6, 1, 4, 1, 9999, 2};
+	csnmp_pdu_t pdu = {0}, decoded = {0};
+	char *trap = NULL, *buf = zbx_malloc(NULL, 1024);
+	size_t trap_alloc = 0, trap_offset = 0;
+	int len = 1024, offset = 0;
+
+	LOG_INF("Testing 64 bit values formatting");
+
+	pdu.version = SNMP_VERSION_2c;
+	pdu.command = SNMP_CMD_TRAP2;
+
+	csnmp_add_var(&pdu, asn1_crt_oid(counter_oid, ARRSIZE(counter_oid)), SNMP_TP_COUNTER64,
+			csnmp_new_long(5000000000LL));
+	csnmp_add_var(&pdu, asn1_crt_oid(uint_oid, ARRSIZE(uint_oid)), SNMP_TP_UINT64, csnmp_new_long(42));
+
+	assert(0 == snmp_enc_pdu(&buf, &offset, &len, &pdu));
+	assert(0 == snmp_dec_pdu(buf, offset, &decoded));
+
+	snmptrap_format_trap(&trap, &trap_alloc, &trap_offset, &decoded, "::1", 162, time(NULL));
+	LOG_INF("Formatted trap:\n%s", trap);
+
+	assert(NULL != strstr(trap, "  receivedfrom                   UDP: [::1]:162\n"));
+	assert(NULL != strstr(trap, "value=Counter64: 5000000000\n"));
+	assert(NULL != strstr(trap, "value=UInt64: 42"));
+
+	csnmp_free_pdu(&decoded);
+	csnmp_free_pdu(&pdu);
+	zbx_free(trap);
+	zbx_free(buf);
+}
+
+static void test_communities(void) {
+	zbx_vector_str_t communities;
+	csnmp_str_t public = {.b = "public", .len = 6}, private = {.b = "private", .len = 7},
+		prefix = {.b = "pub", .len = 3}, empty = {.b = "", .len = 0};
+
+	LOG_INF("Testing trap communities check");
+
+	zbx_vector_str_create(&communities);
+
+	snmptrap_parse_communities(&communities, "public");
+	assert(1 == communities.values_num);
+	assert(SUCCEED == snmptrap_is_community_allowed(&communities, &public));
+	assert(FAIL == snmptrap_is_community_allowed(&communities, &private));
+	assert(FAIL == snmptrap_is_community_allowed(&communities, &prefix));
+	assert(FAIL == snmptrap_is_community_allowed(&communities, &empty));
+
+	zbx_vector_str_clear_ext(&communities, zbx_str_free);
+
+	snmptrap_parse_communities(&communities, "private,public");
+	assert(2 == communities.values_num);
+	assert(SUCCEED == snmptrap_is_community_allowed(&communities, &public));
+	assert(SUCCEED == snmptrap_is_community_allowed(&communities, &private));
+	assert(FAIL == snmptrap_is_community_allowed(&communities, &prefix));
+
+	zbx_vector_str_clear_ext(&communities, zbx_str_free);
+	zbx_vector_str_destroy(&communities);
+}
+
+void snmptrap_format_run_tests(void) {
+	test_format_trap();
+	test_format_64bit_values();
+	test_communities();
+}
+
+#endif
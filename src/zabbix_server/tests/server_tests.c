@@ -26,10 +26,21 @@
 
 #include "../../libs/glb_state/tests/glb_state_tests.h"
 #include "../../libs/zbxipcservice/tests/glb_ipc2_serial_tests.h"
+#include "../../libs/glb_history/tests/clickhouse_format_tests.h"
+#include "../../libs/zbxpreproc/tests/pp_step_cache_tests.h"
+#include "../../libs/zbxpreproc/tests/pp_jsonpath_set_tests.h"
+#include "../../libs/zbxdbwrap/tests/proxy_history_bin_tests.h"
+#include "../../libs/zbxdbwrap/tests/proxy_journal_tests.h"
 #include "../../libs/zbxalgo/tests/algo_tests.h"
 
 #include "../preprocessor/tests/preproc_tests.h"
+#include "../preprocessor/tests/preproc_route_tests.h"
+#include "../snmptrapper/tests/snmptrap_format_tests.h"
 #include "../glb_poller/tests/test_internal.h"
+#include "../glb_poller/tests/poller_http_tests.h"
+#include "../glb_poller/tests/poller_async_io_tests.h"
+#include "../glb_poller/tests/poller_tcp_tests.h"
+#include "../httppoller/tests/httptest_tests.h"
 
 
 
@@ -40,15 +51,46 @@ void tests_server_run(void) {
     LOG_INF("Running server tests");    
     sleep(1);
     
-    LOG_INF("Running server IPC2 tests");    
-    glb_ipc2_run_serial_tests();
-
     LOG_INF("Running state tests");
     glb_state_run_tests();
     
+    LOG_INF("Running clickhouse format tests");
+    glb_history_clickhouse_format_run_tests();
+
+    LOG_INF("Running preprocessing step cache tests");
+    pp_step_cache_run_tests();
+
+    LOG_INF("Running jsonpath set tests");
+    pp_jsonpath_set_run_tests();
+
+    LOG_INF("Running proxy binary history tests");
+    proxy_history_bin_run_tests();
+
+    LOG_INF("Running proxy history journal tests");
+    proxy_journal_run_tests();
+
     LOG_INF("Reunning preprocessing tests");
     run_proc_ipc_tests();
+
+    LOG_INF("Running preprocessing route tests");
+    preproc_route_run_tests();
+
+    LOG_INF("Running snmp trap format tests");
+    snmptrap_format_run_tests();
     
+    LOG_INF("Running http poller tests");
+    poller_http_run_tests();
+
+    LOG_INF("Running poller timers tests");
+    poller_async_io_run_tests();
+
+    LOG_INF("Running tcp poller tests");
+    poller_tcp_run_tests();
+
+    LOG_INF("Running web scenario tests");
+    httptest_run_tests();
+
+    /* the internal metric tests halt the server */
     LOG_INF("Running internal metric tests");
     run_internal_metric_tests();
     
@@ -65,6 +107,10 @@ void tests_server_run(void) {
     LOG_INF("Running algo tests");
 //    tests_algo_run();
     
+    /* the serial buffer tests halt the server, so they are run the last */
+    LOG_INF("Running server IPC2 tests");    
+    glb_ipc2_run_serial_tests();
+
     LOG_INF("Server tests finished");
  //   HALT_HERE("It's not supposed to run server after tests, remove HAVE_GLB_TESTS in zbxcommon.h")
 }
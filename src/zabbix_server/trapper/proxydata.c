@@ -61,6 +61,10 @@ int	zbx_send_proxy_data_response(const DC_PROXY *proxy, zbx_socket_t *sock, cons
 			break;
 	}
 
+	/* let proxy know it can send history in binary format */
+	zbx_json_addstring(&json, ZBX_PROTO_TAG_HISTORY_FORMAT, ZBX_PROTO_VALUE_HISTORY_FORMAT_BINARY,
+			ZBX_JSON_TYPE_STRING);
+
 	if (SUCCEED == status)
 	{
 		zbx_json_addstring(&json, ZBX_PROTO_TAG_RESPONSE, ZBX_PROTO_VALUE_SUCCESS, ZBX_JSON_TYPE_STRING);
@@ -277,7 +281,7 @@ void	zbx_send_proxy_data(zbx_socket_t *sock, zbx_timespec_t *ts, const zbx_confi
 	zbx_json_init(&j, ZBX_JSON_STAT_BUF_LEN);
 
 	zbx_json_addstring(&j, ZBX_PROTO_TAG_SESSION, zbx_dc_get_session_token(), ZBX_JSON_TYPE_STRING);
-	zbx_proxy_get_hist_data(&j, &history_lastid, &more_history);
+	zbx_proxy_get_hist_data(&j, zbx_get_proxy_history_format(sock->buffer), &history_lastid, &more_history);
 	zbx_proxy_get_dhis_data(&j, &discovery_lastid, &more_discovery);
 	zbx_proxy_get_areg_data(&j, &areg_lastid, &more_areg);
 	
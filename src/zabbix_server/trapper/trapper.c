@@ -420,6 +420,189 @@ static int recv_history_get_data(zbx_socket_t *sock, struct zbx_json_parse *jp)
 
 
 
+#define HISTORY_BATCH_STREAM_CHUNK	(64 * ZBX_KIBIBYTE)
+
+/* the batch response is sent without the protocol header by chunks as the rows come from the
+   history storage, the client reads it till the connection is closed:
+   {"errors":[{"itemid":"2", "error":"..."},...],
+    "data":[{"itemid":"1", "value_type":0, "values":[{...},...]},...], "response":"success"}
+   the response status goes last, so a storage failure in the middle of the data is reported as
+   "response":"failed" with the "error" after the rows sent before it */
+typedef struct {
+	zbx_socket_t *sock;
+	char *buffer;
+	size_t alloc;
+	size_t offset;
+	u_int64_t itemid;
+	int value_type;
+	int items;
+	unsigned char failed;
+	struct zbx_json row_json;
+} history_batch_out_t;
+
+static void history_batch_flush(history_batch_out_t *out, int force) {
+	if (0 == out->offset || (0 == force && HISTORY_BATCH_STREAM_CHUNK > out->offset))
+		return;
+
+	if (0 == out->failed && SUCCEED != zbx_tcp_send_raw(out->sock, out->buffer)) {
+		LOG_DBG("Couldn't send history batch to %s: %s", out->sock->peer, zbx_socket_strerror());
+		out->failed = 1;
+	}
+	
+	out->offset = 0;
+	out->buffer[0] = '\0';
+}
+
+static void history_batch_close_item(history_batch_out_t *out) {
+	if (0 == out->itemid)
+		return;
+
+	zbx_strcpy_alloc(&out->buffer, &out->alloc, &out->offset, "]}");
+	out->itemid = 0;
+}
+
+/* the storage returns the rows of an item one after another, see glb_history_get_history_aggregates_multi */
+static void history_batch_row_cb(const glb_history_agg_row_t *row, void *cb_data) {
+	history_batch_out_t *out = cb_data;
+
+	if (row->itemid != out->itemid) {
+		history_batch_close_item(out);
+		zbx_snprintf_alloc(&out->buffer, &out->alloc, &out->offset, "%s{\"itemid\":\"" ZBX_FS_UI64 "\","
+				"\"value_type\":%d,\"values\":[", 0 == out->items ? "" : ",", row->itemid, out->value_type);
+		out->itemid = row->itemid;
+		out->items++;
+	} else 
+		zbx_chrcpy_alloc(&out->buffer, &out->alloc, &out->offset, ',');
+
+	zbx_json_clean(&out->row_json);
+	zbx_json_addstring(&out->row_json, "clock", row->clock, ZBX_JSON_TYPE_INT);
+	zbx_json_addstring(&out->row_json, "i", row->i, ZBX_JSON_TYPE_INT);
+	zbx_json_addstring(&out->row_json, "count", row->count, ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring(&out->row_json, "min", row->min, ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring(&out->row_json, "max", row->max, ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring(&out->row_json, "avg", row->avg, ZBX_JSON_TYPE_STRING);
+	zbx_strcpy_alloc(&out->buffer, &out->alloc, &out->offset, out->row_json.buffer);
+
+	DEBUG_ITEM(row->itemid, "Batch history row: %s", out->row_json.buffer);
+
+	history_batch_flush(out, 0);
+}
+
+static void history_batch_add_error(struct zbx_json *errors, const char *itemid, const char *error) {
+	zbx_json_addobject(errors, NULL);
+	zbx_json_addstring(errors, "itemid", itemid, ZBX_JSON_TYPE_STRING);
+	zbx_json_addstring(errors, ZBX_PROTO_TAG_ERROR, error, ZBX_JSON_TYPE_STRING);
+	zbx_json_close(errors);
+}
+
+/******************************************************************************
+ *                                                                            *
+ * Purpose: aggregated history or trends of a list of items, one storage      *
+ *          request is done per each value type                               *
+ *                                                                            *
+ ******************************************************************************/
+static int recv_history_get_batch(zbx_socket_t *sock, struct zbx_json_parse *jp)
+{
+	char tmp[MAX_ID_LEN], req_type[MAX_ID_LEN];
+	const char *p = NULL;
+	int value_type, i, start, end, aggregates, ret = SUCCEED;
+	zbx_vector_uint64_t itemids[ITEM_VALUE_TYPE_MAX];
+	struct zbx_json_parse jp_items;
+	struct zbx_json errors;
+	zbx_json_type_t type;
+	history_batch_out_t out = {.sock = sock};
+
+	LOG_DBG("In %s()", __func__);
+
+	if (FAIL == zbx_json_brackets_by_name(jp, "itemids", &jp_items) ||
+		FAIL == zbx_json_value_by_name(jp, "type", req_type, MAX_ID_LEN, &type) ||
+		FAIL == zbx_json_value_by_name(jp, "start", tmp, MAX_ID_LEN, &type) ||
+		FAIL == zbx_is_uint31(tmp, &start) ||
+		FAIL == zbx_json_value_by_name(jp, "end", tmp, MAX_ID_LEN, &type) ||
+		FAIL == zbx_is_uint31(tmp, &end) ||
+		FAIL == zbx_json_value_by_name(jp, "aggregates", tmp, MAX_ID_LEN, &type) ||
+		FAIL == zbx_is_uint31(tmp, &aggregates) || 0 == aggregates ||
+		(0 != strcmp(req_type, "history") && 0 != strcmp(req_type, "trends")))
+	{
+		failed_json_responce(sock, "Wrong history batch request: one of fields [itemids, type, start, end, aggregates] is missing or wrong");
+		return FAIL;
+	}
+
+	for (i = 0; i < ITEM_VALUE_TYPE_MAX; i++)
+		zbx_vector_uint64_create(&itemids[i]);
+
+	zbx_json_initarray(&errors, ZBX_JSON_STAT_BUF_LEN);
+
+	while (NULL != (p = zbx_json_next_value(&jp_items, p, tmp, MAX_ID_LEN, &type))) {
+		zbx_uint64_t itemid;
+
+		if (SUCCEED != zbx_is_uint64(tmp, &itemid)) {
+			history_batch_add_error(&errors, tmp, "invalid itemid");
+			continue;
+		}
+
+		if (FAIL == zbx_dc_get_item_type(itemid, &value_type) || 0 > value_type || ITEM_VALUE_TYPE_MAX <= value_type) {
+			DEBUG_ITEM(itemid, "Wrong history batch request: itemid doesn't exist in the config");
+			history_batch_add_error(&errors, tmp, "itemid doesn't exist in the config");
+			continue;
+		}
+
+		if (ITEM_VALUE_TYPE_FLOAT != value_type && ITEM_VALUE_TYPE_UINT64 != value_type) {
+			DEBUG_ITEM(itemid, "Wrong history batch request: item isn't numeric, aggregation isn't possible");
+			history_batch_add_error(&errors, tmp, "item isn't numeric, aggregation isn't possible");
+			continue;
+		}
+
+		zbx_vector_uint64_append(&itemids[value_type], itemid);
+	}
+
+	zbx_json_init(&out.row_json, ZBX_JSON_STAT_BUF_LEN);
+	zbx_snprintf_alloc(&out.buffer, &out.alloc, &out.offset, "{\"errors\":%s,\"%s\":[", errors.buffer, 
+			ZBX_PROTO_TAG_DATA);
+
+	for (value_type = 0; value_type < ITEM_VALUE_TYPE_MAX; value_type++) {
+		
+		if (0 == itemids[value_type].values_num)
+			continue;
+
+		out.value_type = value_type;
+
+		if (0 == strcmp(req_type, "history"))
+			ret = glb_history_get_history_aggregates_multi(&itemids[value_type], value_type, start, end, 
+					aggregates, history_batch_row_cb, &out);
+		else 
+			ret = glb_history_get_trends_aggregates_multi(&itemids[value_type], value_type, start, end, 
+					aggregates, history_batch_row_cb, &out);
+
+		history_batch_close_item(&out);
+
+		if (SUCCEED != ret) {
+			LOG_DBG("History batch request from %s failed: couldn't read %s of value type %d", sock->peer,
+					req_type, value_type);
+			zbx_snprintf_alloc(&out.buffer, &out.alloc, &out.offset, "],\"%s\":\"%s\",\"%s\":\"Couldn't read %s"
+					" of value type %d from the history storage\"}", ZBX_PROTO_TAG_RESPONSE, 
+					ZBX_PROTO_VALUE_FAILED, ZBX_PROTO_TAG_ERROR, req_type, value_type);
+			break;
+		}
+	}
+
+	if (SUCCEED == ret)
+		zbx_snprintf_alloc(&out.buffer, &out.alloc, &out.offset, "],\"%s\":\"%s\"}", ZBX_PROTO_TAG_RESPONSE, 
+				ZBX_PROTO_VALUE_SUCCESS);
+	
+	history_batch_flush(&out, 1);
+
+	for (i = 0; i < ITEM_VALUE_TYPE_MAX; i++)
+		zbx_vector_uint64_destroy(&itemids[i]);
+	
+	zbx_json_free(&errors);
+	zbx_json_free(&out.row_json);
+	zbx_free(out.buffer);
+
+	LOG_DBG("End of %s()", __func__);
+	return ret;
+}
+
 /******************************************************************************
  *                                                                            *
  * Purpose: processes the received values from active agents                  *
@@ -1478,6 +1661,9 @@ static int	process_trap(zbx_socket_t *sock, char *s, ssize_t bytes_received, zbx
 		} else if (0 == strcmp(value, "history.get"))
 		{
 			ret = recv_history_get_data(sock, &jp);
+		} else if (0 == strcmp(value, "history.get.batch"))
+		{
+			ret = recv_history_get_batch(sock, &jp);
 		} else if (0 == strcmp(value, "lastvalues.get"))
 			ret = get_items_lastvalues(sock, &jp);
 		else if (0 == strcmp(value, "itemsstate.get"))